@@ -0,0 +1,38 @@
+#ifndef STANZAWATCHER_H
+#define STANZAWATCHER_H
+
+#include <QList>
+#include <QString>
+#include <QtPlugin>
+
+class QDomElement;
+
+// Lighter alternative to StanzaFilter: only stanzas matching one of
+// watchedStanzas() are passed to the plugin.
+class StanzaWatcher {
+public:
+    enum Direction { Incoming = 1, Outgoing = 2, AnyDirection = Incoming | Outgoing };
+
+    struct Watch {
+        QString tagName; // "message", "presence", "iq" or empty for any
+        QString ns;      // namespace of a child element or empty for any
+        int     directions = AnyDirection;
+        bool    modify     = false; // pass matching outgoing stanzas to modifyOutgoingStanza()
+    };
+
+    virtual ~StanzaWatcher() { }
+
+    // asked once when the plugin is enabled
+    virtual QList<Watch> watchedStanzas() const = 0;
+
+    // read-only, called after filters; xml must not be kept
+    virtual void stanzaWatched(int account, Direction direction, const QDomElement &xml) = 0;
+
+    // only for watches with modify set
+    // true = handled, don't pass to next handler
+    virtual bool modifyOutgoingStanza(int account, QDomElement &xml) = 0;
+};
+
+Q_DECLARE_INTERFACE(StanzaWatcher, "org.psi-im.StanzaWatcher/0.1");
+
+#endif // STANZAWATCHER_H
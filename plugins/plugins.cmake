@@ -45,6 +45,7 @@ list(APPEND PLUGINS_INCLUDES
     ${CMAKE_CURRENT_LIST_DIR}/include/soundaccessor.h
     ${CMAKE_CURRENT_LIST_DIR}/include/stanzafilter.h
     ${CMAKE_CURRENT_LIST_DIR}/include/stanzasender.h
+    ${CMAKE_CURRENT_LIST_DIR}/include/stanzawatcher.h
     ${CMAKE_CURRENT_LIST_DIR}/include/stanzasendinghost.h
     ${CMAKE_CURRENT_LIST_DIR}/include/toolbariconaccessor.h
     ${CMAKE_CURRENT_LIST_DIR}/include/webkitaccessor.h
@@ -4,6 +4,7 @@ HEADERS += \
     $$psi_plugins_include_dir/psiplugin.h \
     $$psi_plugins_include_dir/stanzafilter.h \
     $$psi_plugins_include_dir/stanzasender.h \
+    $$psi_plugins_include_dir/stanzawatcher.h \
     $$psi_plugins_include_dir/stanzasendinghost.h \
     $$psi_plugins_include_dir/iqfilter.h \
     $$psi_plugins_include_dir/iqnamespacefilter.h \
@@ -12,8 +12,21 @@ include(../../src/src.pri)
 
 SOURCES += \
     guitest.cpp \
-    guitestmanager.cpp
+    guitestmanager.cpp \
+    stanzareplaytest.cpp
 
 include(../../src/privacy/guitest/guitest.pri)
 
+# "make massif" and "make heaptrack" profile the load test (see ../valgrind/alloc-profile.sh for all scenarios)
+DESTDIR      = $$OUT_PWD
+PROFILE_ARGS = StanzaReplay -platform offscreen
+include(../valgrind/valgrind.pri)
+
+# allocation counts of the replay scenarios against ../valgrind/alloc-baseline.txt
+unix {
+    QMAKE_EXTRA_TARGETS += alloc_check
+    alloc_check.depends = $$TARGET
+    alloc_check.commands = $$PWD/../valgrind/alloc-profile.sh $$DESTDIR/$$TARGET
+}
+
 QMAKE_CLEAN += ${QMAKE_TARGET}
@@ -0,0 +1,283 @@
+#include "guitest.h"
+#include "guitestmanager.h"
+#include "profiles.h"
+#include "psiaccount.h"
+#include "psicon.h"
+#include "psicontactlist.h"
+#include "xmpp_client.h"
+#include "xmpp_task.h"
+
+#include <QApplication>
+#include <QDateTime>
+#include <QDomDocument>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QTimer>
+#include <QWidget>
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+// event loop latency probe, milliseconds
+#define REPLAY_PROBE_INTERVAL 10
+// top level windows are repainted and timed this often, milliseconds
+#define REPLAY_FRAME_INTERVAL 100
+// stanzas delivered per event loop turn at most, so the probes keep running
+#define REPLAY_MAX_BATCH 200
+
+// Replays a stanza trace into an offline account and reports how the UI copes.
+//
+// The trace is either read from PSI_REPLAY_TRACE, in the format "Dump Ringbuf" puts into the XML console
+// (stanzas, each optionally preceded by a <!-- TS:date --> comment), or generated by PSI_REPLAY_SCENARIO:
+//   presence - PSI_REPLAY_COUNT contacts come online
+//   muc      - a room with PSI_REPLAY_COUNT occupants is joined
+//   messages - PSI_REPLAY_COUNT chat messages from 10 contacts
+//   roster   - PSI_REPLAY_COUNT roster pushes
+// PSI_REPLAY_SPEED scales the recorded timing (0 delivers as fast as possible), generated stanzas come at
+// PSI_REPLAY_RATE per second. Run headless with e.g.
+//   PSI_REPLAY_SCENARIO=muc PSI_REPLAY_COUNT=2000 ./guitest StanzaReplay -platform offscreen
+class StanzaReplayTest : public QObject, public GUITest {
+    Q_OBJECT
+public:
+    StanzaReplayTest() { GUITestManager::instance()->registerTest(this); }
+
+    QString name() { return "StanzaReplay"; }
+    bool    run();
+
+private slots:
+    void deliver();
+    void probe();
+    void frame();
+
+private:
+    struct Stanza {
+        qint64      due; // milliseconds from the start
+        QDomElement e;
+    };
+
+    bool loadTrace(const QString &fileName, double speed);
+    void generate(const QString &scenario, int count, int rate);
+    void finish();
+
+    static qint64  residentBytes();
+    static QString percentiles(QVector<qint64> samples);
+
+    QTemporaryDir   home_;
+    PsiCon *        psi_     = nullptr;
+    PsiAccount *    account_ = nullptr;
+    QDomDocument    doc_;
+    QList<Stanza>   trace_;
+    int             next_ = 0;
+    QTimer *        deliverTimer_;
+    QTimer *        probeTimer_;
+    QTimer *        frameTimer_;
+    QElapsedTimer   clock_;
+    qint64          lastProbe_ = 0;
+    QVector<qint64> latencies_; // microseconds
+    QVector<qint64> frames_;    // microseconds
+    qint64          peakRss_ = 0;
+};
+
+bool StanzaReplayTest::run()
+{
+    qputenv("PSIDATADIR", home_.path().toLocal8Bit());
+    activeProfile = "replay";
+    psi_          = new PsiCon();
+    if (!psi_->init())
+        return false;
+    account_ = psi_->contactList()->createAccount("replay", XMPP::Jid("replay@example.org/psi"));
+
+    const double speed = qEnvironmentVariableIsSet("PSI_REPLAY_SPEED")
+        ? QString::fromLocal8Bit(qgetenv("PSI_REPLAY_SPEED")).toDouble()
+        : 1.0;
+    const int count = qEnvironmentVariableIsSet("PSI_REPLAY_COUNT") ? qEnvironmentVariableIntValue("PSI_REPLAY_COUNT")
+                                                                     : 1000;
+    const int rate  = qEnvironmentVariableIsSet("PSI_REPLAY_RATE") ? qEnvironmentVariableIntValue("PSI_REPLAY_RATE")
+                                                                    : 1000;
+    const QString file = QString::fromLocal8Bit(qgetenv("PSI_REPLAY_TRACE"));
+    if (!file.isEmpty()) {
+        if (!loadTrace(file, speed))
+            return false;
+    } else
+        generate(QString::fromLocal8Bit(qgetenv("PSI_REPLAY_SCENARIO")), count, rate);
+    if (trace_.isEmpty()) {
+        qWarning("StanzaReplay: nothing to replay");
+        return false;
+    }
+
+    deliverTimer_ = new QTimer(this);
+    deliverTimer_->setSingleShot(true);
+    connect(deliverTimer_, SIGNAL(timeout()), SLOT(deliver()));
+    probeTimer_ = new QTimer(this);
+    probeTimer_->setTimerType(Qt::PreciseTimer);
+    probeTimer_->setInterval(REPLAY_PROBE_INTERVAL);
+    connect(probeTimer_, SIGNAL(timeout()), SLOT(probe()));
+    frameTimer_ = new QTimer(this);
+    frameTimer_->setInterval(REPLAY_FRAME_INTERVAL);
+    connect(frameTimer_, SIGNAL(timeout()), SLOT(frame()));
+
+    clock_.start();
+    probeTimer_->start();
+    frameTimer_->start();
+    deliverTimer_->start(0);
+    return true;
+}
+
+bool StanzaReplayTest::loadTrace(const QString &fileName, double speed)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning("StanzaReplay: can't open %s", qUtf8Printable(fileName));
+        return false;
+    }
+    // the stanzas of a dump have no common root
+    QString error;
+    if (!doc_.setContent("<trace>" + QString::fromUtf8(f.readAll()) + "</trace>", &error)) {
+        qWarning("StanzaReplay: %s", qUtf8Printable(error));
+        return false;
+    }
+
+    QDateTime start, stamp;
+    for (QDomNode n = doc_.documentElement().firstChild(); !n.isNull(); n = n.nextSibling()) {
+        if (n.isComment()) {
+            const QString text = n.toComment().data().trimmed();
+            if (text.startsWith("TS:"))
+                stamp = QDateTime::fromString(text.mid(3), Qt::ISODate);
+        } else if (n.isElement()) {
+            if (!start.isValid())
+                start = stamp;
+            const qint64 due = speed > 0 && start.isValid() && stamp.isValid() ? start.msecsTo(stamp) / speed : 0;
+            trace_ += Stanza { due, n.toElement() };
+        }
+    }
+    return true;
+}
+
+void StanzaReplayTest::generate(const QString &scenario, int count, int rate)
+{
+    const QString own = account_->jid().bare();
+    QString       xml;
+    QTextStream   ts(&xml);
+    if (scenario == "muc") {
+        account_->groupChatJoin("conference.example.org", "replay", "me", QString(), true);
+        for (int n = 0; n < count; ++n)
+            ts << QString("<presence from='replay@conference.example.org/user%1' to='%2'>"
+                          "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                          "<item affiliation='none' role='participant' jid='user%1@example.org/res'/></x>"
+                          "</presence>")
+                      .arg(n)
+                      .arg(own);
+        ts << QString("<presence from='replay@conference.example.org/me' to='%1'>"
+                      "<x xmlns='http://jabber.org/protocol/muc#user'>"
+                      "<item affiliation='member' role='participant'/><status code='110'/></x></presence>")
+                  .arg(own);
+    } else if (scenario == "messages") {
+        for (int n = 0; n < count; ++n)
+            ts << QString("<message from='contact%1@example.org/res' to='%2' type='chat' id='m%3'>"
+                          "<body>message %3, see https://example.org/%3 :)</body></message>")
+                      .arg(n % 10)
+                      .arg(own)
+                      .arg(n);
+    } else if (scenario == "roster") {
+        for (int n = 0; n < count; ++n)
+            ts << QString("<iq type='set' id='push%1' to='%2'><query xmlns='jabber:iq:roster'>"
+                          "<item jid='contact%1@example.org' name='Contact %1' subscription='both'>"
+                          "<group>Group %3</group></item></query></iq>")
+                      .arg(n)
+                      .arg(own)
+                      .arg(n % 20);
+    } else {
+        for (int n = 0; n < count; ++n)
+            ts << QString("<presence from='contact%1@example.org/res' to='%2'><show>%3</show>"
+                          "<status>status of contact %1</status></presence>")
+                      .arg(n)
+                      .arg(own)
+                      .arg(n % 3 ? "chat" : "away");
+    }
+    ts.flush();
+
+    doc_.setContent("<trace>" + xml + "</trace>");
+    int n = 0;
+    for (QDomElement e = doc_.documentElement().firstChildElement(); !e.isNull(); e = e.nextSiblingElement(), ++n)
+        trace_ += Stanza { rate > 0 ? qint64(n) * 1000 / rate : 0, e };
+}
+
+void StanzaReplayTest::deliver()
+{
+    // as if it came from the stream, the tasks of the offline client take it
+    const qint64 now = clock_.elapsed();
+    for (int n = 0; n < REPLAY_MAX_BATCH && next_ < trace_.size() && trace_[next_].due <= now; ++n)
+        account_->client()->rootTask()->take(trace_[next_++].e);
+
+    if (next_ < trace_.size())
+        deliverTimer_->start(int(qMax<qint64>(0, trace_[next_].due - clock_.elapsed())));
+    else
+        QTimer::singleShot(1000, this, [this]() { finish(); }); // let the views settle
+}
+
+void StanzaReplayTest::probe()
+{
+    const qint64 now = clock_.nsecsElapsed() / 1000;
+    if (lastProbe_)
+        latencies_ += qMax<qint64>(0, now - lastProbe_ - REPLAY_PROBE_INTERVAL * 1000);
+    lastProbe_ = now;
+}
+
+void StanzaReplayTest::frame()
+{
+    QElapsedTimer t;
+    t.start();
+    for (QWidget *w : QApplication::topLevelWidgets())
+        if (w->isVisible())
+            w->repaint();
+    frames_ += t.nsecsElapsed() / 1000;
+    peakRss_ = qMax(peakRss_, residentBytes());
+}
+
+void StanzaReplayTest::finish()
+{
+    probeTimer_->stop();
+    frameTimer_->stop();
+
+    QTextStream out(stdout);
+    out << "stanzas:        " << trace_.size() << " in " << clock_.elapsed() << " ms\n";
+    out << "loop latency:   " << percentiles(latencies_) << "\n";
+    out << "frame time:     " << percentiles(frames_) << "\n";
+    out << "peak resident:  " << (peakRss_ >= 0 ? QString::number(peakRss_ / 1024) + " KiB" : "n/a") << "\n";
+    out.flush();
+
+    delete psi_;
+    psi_ = nullptr;
+    qApp->quit();
+}
+
+qint64 StanzaReplayTest::residentBytes()
+{
+#ifdef Q_OS_LINUX
+    QFile f("/proc/self/statm");
+    if (f.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> fields = f.readAll().split(' ');
+        if (fields.size() > 1)
+            return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+    }
+#endif
+    return -1;
+}
+
+// microsecond samples as "p50 / p99 / max" in milliseconds
+QString StanzaReplayTest::percentiles(QVector<qint64> samples)
+{
+    if (samples.isEmpty())
+        return "n/a";
+    std::sort(samples.begin(), samples.end());
+    auto ms = [](qint64 us) { return QString::number(us / 1000.0, 'f', 2); };
+    return QString("p50 %1 / p99 %2 / max %3 ms")
+        .arg(ms(samples[samples.size() / 2]), ms(samples[samples.size() * 99 / 100]), ms(samples.last()));
+}
+
+static StanzaReplayTest *stanzaReplayTestInstance = new StanzaReplayTest();
+
+#include "stanzareplaytest.moc"
@@ -0,0 +1,85 @@
+#!/bin/sh
+
+# Runs the StanzaReplay load test of qa/guitest under heaptrack (and optionally massif)
+# and checks the allocation count of every scenario against alloc-baseline.txt.
+#
+# Usage: alloc-profile.sh [--massif] [--update-baseline] <guitest binary> [scenario...]
+#
+# For each scenario the output directory (ALLOC_OUT, default ./alloc-profile) gets
+#   <scenario>.heaptrack.zst        the raw heaptrack data
+#   <scenario>-<path>.svg           allocation flame graph of the stacks going through <path>
+#                                   (needs flamegraph.pl in PATH, else the collapsed stacks are kept)
+#   <scenario>.massif               massif heap snapshots, with --massif
+# Exits with 1 if a scenario allocates more than ALLOC_TOLERANCE percent (default 10) above its baseline.
+
+set -e
+
+HERE="$(cd "$(dirname "$0")" && pwd)"
+BASELINE="${HERE}/alloc-baseline.txt"
+OUT="${ALLOC_OUT:-./alloc-profile}"
+TOLERANCE="${ALLOC_TOLERANCE:-10}"
+COUNT="${PSI_REPLAY_COUNT:-2000}"
+PATHS="PsiAccount ContactListModel AvatarFactory ChatView"
+
+MASSIF=0
+UPDATE=0
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --massif) MASSIF=1 ;;
+        --update-baseline) UPDATE=1 ;;
+        *) break ;;
+    esac
+    shift
+done
+
+if [ $# -lt 1 ]; then
+    sed -n '3,14p' "$0" | sed 's/^# \{0,1\}//'
+    exit 2
+fi
+GUITEST="$1"
+shift
+SCENARIOS="${*:-presence muc messages roster}"
+
+command -v heaptrack >/dev/null || { echo "heaptrack not found" >&2; exit 2; }
+mkdir -p "${OUT}"
+touch "${BASELINE}"
+
+FAILED=0
+for SCENARIO in ${SCENARIOS}; do
+    echo "== ${SCENARIO}"
+    export PSI_REPLAY_SCENARIO="${SCENARIO}" PSI_REPLAY_COUNT="${COUNT}" PSI_REPLAY_RATE=0
+    rm -f "${OUT}/${SCENARIO}".heaptrack.*
+    heaptrack -o "${OUT}/${SCENARIO}.heaptrack" "${GUITEST}" StanzaReplay -platform offscreen
+    DATA="$(ls "${OUT}/${SCENARIO}".heaptrack.* | head -n 1)"
+
+    heaptrack_print -f "${DATA}" -F "${OUT}/${SCENARIO}.stacks" > "${OUT}/${SCENARIO}.txt"
+    for P in ${PATHS}; do
+        grep "${P}" "${OUT}/${SCENARIO}.stacks" > "${OUT}/${SCENARIO}-${P}.stacks" || true
+        if command -v flamegraph.pl >/dev/null; then
+            flamegraph.pl --title "${SCENARIO}: ${P} allocations" --countname allocations \
+                "${OUT}/${SCENARIO}-${P}.stacks" > "${OUT}/${SCENARIO}-${P}.svg"
+            rm -f "${OUT}/${SCENARIO}-${P}.stacks"
+        fi
+    done
+    rm -f "${OUT}/${SCENARIO}.stacks"
+
+    if [ "${MASSIF}" = 1 ]; then
+        valgrind --tool=massif --suppressions="${HERE}/valgrind.supp" --massif-out-file="${OUT}/${SCENARIO}.massif" \
+            "${GUITEST}" StanzaReplay -platform offscreen
+    fi
+
+    CALLS="$(sed -n 's/^calls to allocation functions: \([0-9]*\).*/\1/p' "${OUT}/${SCENARIO}.txt")"
+    BASE="$(awk -v s="${SCENARIO}" -v c="${COUNT}" '$1 == s && $2 == c { print $3 }' "${BASELINE}")"
+    echo "allocations: ${CALLS}, baseline: ${BASE:-none}"
+
+    if [ "${UPDATE}" = 1 ]; then
+        grep -v "^${SCENARIO} ${COUNT} " "${BASELINE}" > "${BASELINE}.new" || true
+        echo "${SCENARIO} ${COUNT} ${CALLS}" >> "${BASELINE}.new"
+        mv "${BASELINE}.new" "${BASELINE}"
+    elif [ -n "${BASE}" ] && [ "${CALLS}" -gt $((BASE + BASE * TOLERANCE / 100)) ]; then
+        echo "REGRESSION: ${SCENARIO} allocates ${CALLS} times, baseline ${BASE}" >&2
+        FAILED=1
+    fi
+done
+
+exit ${FAILED}
@@ -16,4 +16,13 @@ unix {
     QMAKE_EXTRA_TARGETS += callgrind
     callgrind.depends = $$DEPENDS
     callgrind.commands = $$COMMAND callgrind
+
+    # heap profiling
+    QMAKE_EXTRA_TARGETS += massif
+    massif.depends = $$DEPENDS
+    massif.commands = $$COMMAND massif
+
+    QMAKE_EXTRA_TARGETS += heaptrack
+    heaptrack.depends = $$DEPENDS
+    heaptrack.commands = $$COMMAND heaptrack
 }
@@ -3,15 +3,24 @@ unix {
     VALGRIND_OPTIONS = -q --num-callers=40 --leak-check=full --show-reachable=yes --suppressions=$$PWD/valgrind.supp
     QMAKE_EXTRA_TARGETS += valgrind
     valgrind.depends = $$TARGET
-    valgrind.commands = valgrind $$VALGRIND_OPTIONS $$DESTDIR/$$TARGET | grep -E '==[0-9]+=='
+    valgrind.commands = valgrind $$VALGRIND_OPTIONS $$DESTDIR/$$TARGET $$PROFILE_ARGS | grep -E '==[0-9]+=='
 
     # valgrind_supp target (generate suppressions)
     QMAKE_EXTRA_TARGETS += valgrind_supp
     valgrind_supp.depends = $$TARGET
-    valgrind_supp.commands = valgrind $$VALGRIND_OPTIONS --gen-suppressions=all $$DESTDIR/$$TARGET
+    valgrind_supp.commands = valgrind $$VALGRIND_OPTIONS --gen-suppressions=all $$DESTDIR/$$TARGET $$PROFILE_ARGS
 
     # callgrind profiling
     QMAKE_EXTRA_TARGETS += callgrind
     callgrind.depends = $$TARGET
-    callgrind.commands = valgrind --tool=callgrind --dump-instr=yes --collect-jumps=yes $$DESTDIR/$$TARGET
+    callgrind.commands = valgrind --tool=callgrind --dump-instr=yes --collect-jumps=yes $$DESTDIR/$$TARGET $$PROFILE_ARGS
+
+    # heap profiling, PROFILE_ARGS are passed to the target
+    QMAKE_EXTRA_TARGETS += massif
+    massif.depends = $$TARGET
+    massif.commands = valgrind --tool=massif --suppressions=$$PWD/valgrind.supp $$DESTDIR/$$TARGET $$PROFILE_ARGS
+
+    QMAKE_EXTRA_TARGETS += heaptrack
+    heaptrack.depends = $$TARGET
+    heaptrack.commands = heaptrack $$DESTDIR/$$TARGET $$PROFILE_ARGS
 }
@@ -13,6 +13,7 @@
 #include <QDir>
 #include <QDomDocument>
 #include <QFile>
+#include <QFileInfo>
 #include <QMessageBox>
 #include <QStringList>
 #include <QtCrypto>
@@ -20,6 +21,11 @@
 
 using namespace QCA;
 
+// seconds the loaded certificate stores are reused while none of the store directories changes
+#define CERT_STORE_TTL 3600
+// longest an account takes a certificate it checked before without checking again, seconds
+#define CERT_ACCEPT_TTL (24 * 3600)
+
 /**
  * \class CertificateHelpers
  * \brief A class providing utility functions for Certificates.
@@ -32,6 +38,21 @@ using namespace QCA;
  */
 CertificateCollection CertificateHelpers::allCertificates(const QStringList &storeDirs)
 {
+    // every login asks for this, the files are read again only when a directory changed
+    static CertificateCollection cached;
+    static QStringList           cachedDirs;
+    static QList<QDateTime>      cachedStamps;
+    static QDateTime             cachedExpires;
+
+    QList<QDateTime> stamps;
+    for (const auto &s : storeDirs) {
+        stamps += QFileInfo(s).lastModified();
+    }
+    const QDateTime now = QDateTime::currentDateTimeUtc();
+    if (cachedExpires.isValid() && now < cachedExpires && cachedDirs == storeDirs && cachedStamps == stamps) {
+        return cached;
+    }
+
     CertificateCollection certs(systemStore());
     for (const auto &s : storeDirs) {
         QDir store(s);
@@ -83,9 +104,35 @@ CertificateCollection CertificateHelpers::allCertificates(const QStringList &sto
             }
         }
     }
+
+    cached        = certs;
+    cachedDirs    = storeDirs;
+    cachedStamps  = stamps;
+    cachedExpires = now.addSecs(CERT_STORE_TTL);
     return certs;
 }
 
+/**
+ * \brief Returns the SHA-256 digest of \a cert, or an empty array if no plugin provides SHA-256.
+ */
+QByteArray CertificateHelpers::fingerprint(const QCA::Certificate &cert)
+{
+    if (cert.isNull() || !QCA::isSupported("sha256"))
+        return QByteArray();
+    return QCA::Hash("sha256").hash(cert.toDER()).toByteArray();
+}
+
+/**
+ * \brief Returns the SHA-256 digest of the public key of \a cert, which a renewed certificate keeps
+ * as long as the key isn't changed.
+ */
+QByteArray CertificateHelpers::publicKeyDigest(const QCA::Certificate &cert)
+{
+    if (cert.isNull() || !QCA::isSupported("sha256"))
+        return QByteArray();
+    return QCA::Hash("sha256").hash(cert.subjectPublicKey().toDER()).toByteArray();
+}
+
 QString CertificateHelpers::validityToString(QCA::Validity v)
 {
     QString s;
@@ -155,19 +202,38 @@ QString CertificateHelpers::resultToString(int result, QCA::Validity validity)
     return s;
 }
 
-// shared by PsiAccount and MiniClient
+// shared by PsiAccount and MiniClient.
+// a certificate found in \a accepted is taken as is, one that passes goes there until it expires
 bool CertificateHelpers::checkCertificate(QCA::TLS *tls, XMPP::QCATLSHandler *tlsHandler, QString &tlsOverrideDomain,
                                           QByteArray &tlsOverrideCert, QObject *canceler, const QString &title,
-                                          const QString &host)
+                                          const QString &host, AcceptedCertificates *accepted)
 {
     auto chain = tls->peerCertificateChain();
     if (chain.isEmpty()) {
         qWarning("Certificate chain is empty");
         return false;
     }
-    QCA::Certificate cert   = tls->peerCertificateChain().primary();
+    QCA::Certificate cert   = chain.primary();
     int              result = tls->peerIdentityResult();
     QString          hostnameOverrideable;
+    const QDateTime  now    = QDateTime::currentDateTimeUtc();
+
+    QString          acceptedKey;
+    const QByteArray digest = accepted ? fingerprint(cert) : QByteArray();
+    if (!digest.isEmpty()) {
+        acceptedKey = host + QLatin1Char('/') + QString::fromLatin1(digest.toHex());
+        auto it     = accepted->find(acceptedKey);
+        if (it != accepted->end()) {
+            if (now < it.value())
+                return true;
+            accepted->erase(it);
+        }
+    }
+    // remembered only while the certificate itself is valid
+    auto remember = [&]() {
+        if (!acceptedKey.isEmpty() && cert.notValidBefore() <= now && now < cert.notValidAfter())
+            accepted->insert(acceptedKey, qMin(cert.notValidAfter().toUTC(), now.addSecs(CERT_ACCEPT_TTL)));
+    };
 
     if (result == QCA::TLS::Valid && !tlsHandler->certMatchesHostname()) {
         QList<QString> lst = cert.subjectInfo().values(QCA::CommonName);
@@ -180,9 +246,15 @@ bool CertificateHelpers::checkCertificate(QCA::TLS *tls, XMPP::QCATLSHandler *tl
     }
 
     // if this cert equals the user trusted certificate, just trust the user's choice.
+    // a renewal of it with the same key, while valid, is trusted as well
     if (result != QCA::TLS::Valid && !tlsOverrideCert.isEmpty()) {
         if (cert.toDER() == tlsOverrideCert) {
             result = QCA::TLS::Valid;
+        } else if (cert.notValidBefore() <= now && now < cert.notValidAfter()) {
+            const QByteArray pinned = publicKeyDigest(QCA::Certificate::fromDER(tlsOverrideCert));
+            if (!pinned.isEmpty() && pinned == publicKeyDigest(cert)) {
+                result = QCA::TLS::Valid;
+            }
         }
     }
 
@@ -193,8 +265,9 @@ bool CertificateHelpers::checkCertificate(QCA::TLS *tls, XMPP::QCATLSHandler *tl
             QObject::connect(canceler, SIGNAL(disconnected()), &errorDialog, SLOT(reject()), Qt::AutoConnection);
             QObject::connect(canceler, SIGNAL(reconnecting()), &errorDialog, SLOT(reject()), Qt::AutoConnection);
         }
-        return (errorDialog.exec() == QDialog::Accepted);
-    } else {
-        return true;
+        if (errorDialog.exec() != QDialog::Accepted)
+            return false;
     }
+    remember();
+    return true;
 }
@@ -7,6 +7,8 @@
 #ifndef CERTUTIL_H
 #define CERTUTIL_H
 
+#include <QDateTime>
+#include <QHash>
 #include <QtCrypto>
 
 class QString;
@@ -21,11 +23,16 @@ class QCATLSHandler;
 
 class CertificateHelpers {
 public:
+    // host and leaf fingerprint -> until when the certificate is taken without asking again
+    typedef QHash<QString, QDateTime> AcceptedCertificates;
+
     static QCA::CertificateCollection allCertificates(const QStringList &dirs);
     static QString                    resultToString(int result, QCA::Validity);
+    static QByteArray                 fingerprint(const QCA::Certificate &cert);
+    static QByteArray                 publicKeyDigest(const QCA::Certificate &cert);
     static bool checkCertificate(QCA::TLS *tls, XMPP::QCATLSHandler *tlsHandler, QString &tlsOverrideDomain,
                                  QByteArray &tlsOverrideCert, QObject *canceler, const QString &title,
-                                 const QString &host);
+                                 const QString &host, AcceptedCertificates *accepted = nullptr);
 
 protected:
     static QString validityToString(QCA::Validity);
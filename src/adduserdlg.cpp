@@ -339,7 +339,7 @@ void AddUserDlg::resolveNickActivated()
                 le_nick->setText(nickname);
             }
         },
-        false);
+        false, false, true, VCardFactory::InteractivePriority);
     d->tasks->append(jt);
 }
 
@@ -25,61 +25,134 @@
 #include <QDir>
 #include <QFileInfo>
 
+// directory entries per form, only these are stat'ed for a reply
+#define FILESERVER_PAGE_SIZE 50
+// browsing sessions kept at once, the oldest is dropped beyond that
+#define FILESERVER_MAX_SESSIONS 8
+
 using namespace XMPP;
 
 bool AHFileServer::isAllowed(const Jid &j) const { return manager()->account()->jid().compare(j, false); }
 
 AHCommand AHFileServer::execute(const AHCommand &c, const Jid &requester)
 {
-    // Extract the file
-    QString file;
+    Session *s = sessions_.contains(c.sessionId()) ? &sessions_[c.sessionId()] : nullptr;
+
+    // paging through the listing already made
+    if (s && (c.action() == AHCommand::Next || c.action() == AHCommand::Prev)) {
+        const int page = s->page + (c.action() == AHCommand::Next ? 1 : -1);
+        s->page        = qBound(0, page, qMax(0, (s->entries.size() - 1) / FILESERVER_PAGE_SIZE));
+        return listing(c, c.sessionId(), *s);
+    }
+
+    // Extract the selection
+    QStringList selected;
     if (c.hasData()) {
-        QString          fileName, curDir;
-        XData::FieldList fl = c.data().fields();
-        for (unsigned int i = 0; i < fl.count(); i++) {
-            if (fl[i].var() == "file" && !(fl[i].value().isEmpty())) {
-                file = fl[i].value().first();
-            }
+        const XData::FieldList fl = c.data().fields();
+        for (const XData::Field &f : fl) {
+            if (f.var() == "file")
+                selected += f.value();
         }
-    } else {
-        file = QDir::currentDirPath();
     }
 
-    if (QFileInfo(file).isDir()) {
-        // Return a form with a filelist
-        XData form;
-        form.setTitle(QObject::tr("Choose file"));
-        form.setInstructions(QObject::tr("Choose a file"));
-        form.setType(XData::Data_Form);
-        XData::FieldList fields;
-
-        XData::Field files_field;
-        files_field.setType(XData::Field::Field_ListSingle);
-        files_field.setVar("file");
-        files_field.setLabel(QObject::tr("File"));
-        files_field.setRequired(true);
-
-        XData::Field::OptionList file_options;
-        QDir                     d(file);
-        // d.setFilter(QDir::Files|QDir::Hidden|QDir::NoSymLinks);
-        QStringList l = d.entryList();
-        for (QStringList::Iterator it = l.begin(); it != l.end(); ++it) {
-            XData::Field::Option file_option;
-            QFileInfo            fi(QDir(file).filePath(*it));
-            file_option.label
-                = *it + (fi.isDir() ? QString(" [DIR]") : QString(" (%1 bytes)").arg(QString::number(fi.size())));
-            file_option.value = QDir(file).absFilePath(*it);
-            file_options += file_option;
+    QStringList files;
+    QString     dir;
+    if (selected.isEmpty() && !s) {
+        dir = QDir::currentPath();
+    } else {
+        for (const QString &path : qAsConst(selected)) {
+            if (QFileInfo(path).isDir()) {
+                if (dir.isEmpty())
+                    dir = path;
+            } else
+                files += path;
         }
-        files_field.setOptions(file_options);
-        fields += files_field;
-
-        form.setFields(fields);
+    }
 
-        return AHCommand::formReply(c, form);
-    } else {
-        QStringList l(file);
-        manager()->account()->sendFiles(requester, l, true);
+    if (!files.isEmpty()) {
+        // all of them in one go, the transfer queues and pipelines them
+        closeSession(c.sessionId());
+        manager()->account()->sendFiles(requester, files);
         return AHCommand::completedReply(c);
     }
+
+    QString sessionId = c.sessionId();
+    if (!s) {
+        sessionId = QString::number(++lastSession_);
+        s         = openSession(sessionId);
+    }
+    if (!dir.isEmpty())
+        openDir(s, dir);
+    return listing(c, sessionId, *s);
+}
+
+void AHFileServer::cancel(const AHCommand &c) { closeSession(c.sessionId()); }
+
+AHFileServer::Session *AHFileServer::openSession(const QString &sessionId)
+{
+    while (sessionOrder_.size() >= FILESERVER_MAX_SESSIONS)
+        sessions_.remove(sessionOrder_.takeFirst());
+    sessionOrder_ += sessionId;
+    return &sessions_[sessionId];
+}
+
+void AHFileServer::openDir(Session *s, const QString &dir)
+{
+    // names only, the stat'ing is left to the page shown
+    s->dir     = QDir::cleanPath(QDir(dir).absolutePath());
+    s->entries = QDir(s->dir).entryList(QDir::AllEntries | QDir::NoDot,
+                                        QDir::DirsFirst | QDir::Name | QDir::IgnoreCase);
+    s->page    = 0;
+}
+
+void AHFileServer::closeSession(const QString &sessionId)
+{
+    sessions_.remove(sessionId);
+    sessionOrder_.removeAll(sessionId);
+}
+
+AHCommand AHFileServer::listing(const AHCommand &c, const QString &sessionId, const Session &s) const
+{
+    const int pages = qMax(1, (s.entries.size() + FILESERVER_PAGE_SIZE - 1) / FILESERVER_PAGE_SIZE);
+
+    // Return a form with a filelist
+    XData form;
+    form.setTitle(QObject::tr("Choose file"));
+    form.setInstructions(pages > 1 ? QObject::tr("Choose files to send, or a directory to open (%1, page %2 of %3)")
+                                         .arg(s.dir)
+                                         .arg(s.page + 1)
+                                         .arg(pages)
+                                   : QObject::tr("Choose files to send, or a directory to open (%1)").arg(s.dir));
+    form.setType(XData::Data_Form);
+    XData::FieldList fields;
+
+    XData::Field files_field;
+    files_field.setType(XData::Field::Field_ListMulti);
+    files_field.setVar("file");
+    files_field.setLabel(QObject::tr("File"));
+    files_field.setRequired(true);
+
+    XData::Field::OptionList file_options;
+    const QDir               d(s.dir);
+    const int                end = qMin(s.entries.size(), (s.page + 1) * FILESERVER_PAGE_SIZE);
+    for (int i = s.page * FILESERVER_PAGE_SIZE; i < end; ++i) {
+        XData::Field::Option file_option;
+        QFileInfo            fi(d.filePath(s.entries[i]));
+        file_option.label = s.entries[i]
+            + (fi.isDir() ? QString(" [DIR]") : QString(" (%1 bytes)").arg(QString::number(fi.size())));
+        file_option.value = fi.absoluteFilePath();
+        file_options += file_option;
+    }
+    files_field.setOptions(file_options);
+    fields += files_field;
+
+    form.setFields(fields);
+
+    AHCommand::ActionList actions;
+    if (s.page > 0)
+        actions += AHCommand::Prev;
+    if (s.page + 1 < pages)
+        actions += AHCommand::Next;
+    actions += AHCommand::Complete;
+    return AHCommand::formReply(c, form, sessionId, actions, AHCommand::Complete);
 }
@@ -21,7 +21,14 @@
 #ifndef AHFILESERVER_H
 #define AHFILESERVER_H
 
-#include "adhoc.h"
+#include "ahcommand.h"
+#include "ahcommandserver.h"
+#include "xmpp_jid.h"
+
+#include <QHash>
+#include <QStringList>
+
+using namespace XMPP;
 
 class AHFileServer : public AHCommandServer {
 public:
@@ -30,6 +37,24 @@ public:
     virtual bool      isAllowed(const Jid &) const;
     virtual QString   name() const { return QString("Send file"); }
     virtual AHCommand execute(const AHCommand &c, const Jid &);
+    virtual void      cancel(const AHCommand &c);
+
+private:
+    // a directory being browsed, listed once and then paged through
+    struct Session {
+        QString     dir;
+        QStringList entries;
+        int         page = 0;
+    };
+
+    Session * openSession(const QString &sessionId);
+    void      openDir(Session *s, const QString &dir);
+    AHCommand listing(const AHCommand &c, const QString &sessionId, const Session &s) const;
+    void      closeSession(const QString &sessionId);
+
+    QHash<QString, Session> sessions_;
+    QStringList             sessionOrder_; // oldest first
+    int                     lastSession_ = 0;
 };
 
 #endif // AHFILESERVER_H
@@ -163,6 +163,14 @@ QDomElement AHCommand::toXml(QDomDocument *doc, bool submit) const
     QDomElement command = doc->createElementNS(AHC_NS, "command");
     if (d->status != NoStatus)
         command.setAttribute("status", status2string(status()));
+    if (!submit && !d->actions.isEmpty()) {
+        QDomElement actions = doc->createElement("actions");
+        if (d->defaultAction != NoAction)
+            actions.setAttribute("execute", action2string(d->defaultAction));
+        for (Action a : qAsConst(d->actions))
+            actions.appendChild(doc->createElement(action2string(a)));
+        command.appendChild(actions);
+    }
     if (hasData())
         command.appendChild(data().toXml(doc, submit));
     if (d->action != Execute)
@@ -188,6 +196,16 @@ AHCommand AHCommand::formReply(const AHCommand &c, const XData &data, const QStr
     return r;
 }
 
+AHCommand AHCommand::formReply(const AHCommand &c, const XData &data, const QString &sessionId,
+                               const ActionList &actions, Action defaultAction)
+{
+    AHCommand r(c.node(), data, sessionId);
+    r.setStatus(AHCommand::Executing);
+    r.d->actions = actions;
+    r.setDefaultAction(defaultAction);
+    return r;
+}
+
 AHCommand AHCommand::canceledReply(const AHCommand &c)
 {
     AHCommand r(c.node(), c.sessionId());
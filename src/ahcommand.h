@@ -100,6 +100,8 @@ public:
     // Helper constructors
     static AHCommand formReply(const AHCommand &, const XMPP::XData &);
     static AHCommand formReply(const AHCommand &, const XMPP::XData &, const QString &sessionId);
+    static AHCommand formReply(const AHCommand &, const XMPP::XData &, const QString &sessionId,
+                               const ActionList &actions, Action defaultAction);
     static AHCommand canceledReply(const AHCommand &);
     static AHCommand completedReply(const AHCommand &);
     static AHCommand completedReply(const AHCommand &, const XMPP::XData &);
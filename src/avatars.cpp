@@ -29,6 +29,7 @@
 #include "applicationinfo.h"
 #include "filecache.h"
 #include "iconset.h"
+#include "memorytrimmer.h"
 #include "pepmanager.h"
 #include "pixmaputil.h"
 #include "profiles.h"
@@ -43,15 +44,20 @@
 #include "xmpp_xmlcommon.h"
 
 #include <QBuffer>
+#include <QCache>
 #include <QDateTime>
 #include <QDir>
 #include <QDomElement>
 #include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QImageReader>
 #include <QPainter>
 #include <QPainterPath>
 #include <QPixmap>
+#include <QSet>
+#include <QtConcurrentRun>
 #include <QtCrypto>
 
 // we have retine nowdays and various other huge resolutions.96px is not that big already.
@@ -59,6 +65,12 @@
 #define MAX_AVATAR_SIZE 96
 //#define MAX_AVATAR_DISPLAY_SIZE 64
 
+// memory for rendered avatar variants, in KiB
+#define AVATAR_VARIANTS_CACHE_SIZE 4096
+
+// memory for decoded muc avatars of all rooms, in KiB
+#define MUC_AVATAR_PIXMAPS_SIZE 16384
+
 //------------------------------------------------------------------------------
 
 static QByteArray scaleAvatar(const QByteArray &b)
@@ -81,6 +93,41 @@ static QByteArray scaleAvatar(const QByteArray &b)
     }
 }
 
+// squares, scales and rounds an avatar in device pixels. works on QImage only, so it's fine off the gui thread
+static QImage renderAvatar(const QByteArray &data, int size, int radius, qreal dpr)
+{
+    QImage img = QImage::fromData(data);
+    if (img.isNull()) {
+        return img;
+    }
+
+    if (img.width() != img.height()) {
+        int    side = qMax(img.width(), img.height());
+        QImage square(side, side, QImage::Format_ARGB32_Premultiplied);
+        square.fill(Qt::transparent);
+        QPainter p(&square);
+        p.drawImage((side - img.width()) / 2, (side - img.height()) / 2, img);
+        p.end();
+        img = square;
+    }
+
+    int side = qRound(qMax(size, radius * 2) * dpr);
+    img      = img.scaled(side, side, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    if (radius != 0) {
+        QImage rounded(img.size(), QImage::Format_ARGB32_Premultiplied);
+        rounded.fill(Qt::transparent);
+        QPainterPath pp;
+        pp.addRoundedRect(0, 0, img.width(), img.height(), radius * dpr, radius * dpr);
+        QPainter p(&rounded);
+        p.setRenderHints(QPainter::Antialiasing, true);
+        p.fillPath(pp, QBrush(img));
+        p.end();
+        img = rounded;
+    }
+    img.setDevicePixelRatio(dpr);
+    return img;
+}
+
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
@@ -544,46 +591,68 @@ public:
     PsiAccount *pa_;
     Iconset     iconset_;
 
-    QQueue<std::tuple<Jid, QByteArray, bool>> vcardReqQueue_;
-    QTimer                                    vcardReqTimer_;
+    // missing avatars are fetched by a small request pipeline. the same hash advertised by many
+    // contacts (muc participants, shared avatars) is requested once and handed to all of them.
+    struct Request {
+        enum Kind { VCard, PepData };
+        Kind       kind;
+        Jid        jid;
+        QByteArray hash;
+        QString    itemId; // pep item id
+        bool       isMuc;
+    };
+    QQueue<Request>                   reqQueue_;
+    QSet<QByteArray>                  requested_; // queued or in flight
+    QHash<QByteArray, QList<Request>> waiters_;   // other users of a requested hash
+    QTimer                            reqTimer_;
+    int                               inFlight_ = 0;
+
+    void enqueue(const Request &r)
+    {
+        if (requested_.contains(r.hash)) {
+            waiters_[r.hash].append(r);
+            return;
+        }
+        requested_.insert(r.hash);
+        reqQueue_.enqueue(r);
+        if (!reqTimer_.isActive())
+            reqTimer_.start();
+    }
+
+    void clearRequests()
+    {
+        reqQueue_.clear();
+        requested_.clear();
+        waiters_.clear();
+        reqTimer_.stop();
+        inFlight_ = 0;
+    }
+
+    QCache<QString, QPixmap> variants_; // hash/size/radius/dpr => rendered avatar, cost in KiB
+    QSet<QString>            rendering_;
 };
 
+static QCache<QByteArray, QPixmap> &mucAvatarPixmaps();
+
 AvatarFactory::AvatarFactory(PsiAccount *pa) : d(new Private)
 {
+    d->variants_.setMaxCost(AVATAR_VARIANTS_CACHE_SIZE);
+    // rendered from the avatar cache again when painted, so only when memory is short
+    MemoryTrimmer::instance()->add(
+        this, [this]() { return qint64(d->variants_.totalCost()) * 1024; },
+        [this](MemoryTrimmer::Level level) {
+            if (level == MemoryTrimmer::Critical) {
+                d->variants_.clear();
+                mucAvatarPixmaps().clear();
+            }
+        });
     d->pa_ = pa;
     // Register iconset
     d->iconset_.addToFactory();
 
-    d->vcardReqTimer_.setSingleShot(false);
-    d->vcardReqTimer_.setInterval(VcardReqInterval);
-    QObject::connect(&d->vcardReqTimer_, &QTimer::timeout, this, [this]() {
-        Jid        j;
-        QByteArray hash;
-        bool       isMuc;
-        std::tie(j, hash, isMuc) = d->vcardReqQueue_.dequeue();
-        if (d->vcardReqQueue_.isEmpty()) {
-            d->vcardReqTimer_.stop();
-        }
-        if (!d->pa_->isConnected())
-            return;
-        VCardFactory::instance()->getVCard(
-            j, d->pa_->client()->rootTask(), this,
-            [this, hash]() {
-                auto task = dynamic_cast<JT_VCard *>(sender());
-                if (task->success() && !task->vcard().isNull()) {
-                    QByteArray ba = task->vcard().photo();
-                    if (!ba.isNull()) {
-                        QString fullJid = task->jid().full(); // jids for regular contacts are already without resource
-                        if (AvatarCache::instance()->setIcon(AvatarCache::VCardType, fullJid, ba, hash)
-                            == AvatarCache::UserUpdateRequired) {
-                            d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(task->jid().full()));
-                            emit avatarChanged(task->jid());
-                        }
-                    }
-                }
-            },
-            !isMuc, isMuc, false);
-    });
+    d->reqTimer_.setSingleShot(false);
+    d->reqTimer_.setInterval(VcardReqInterval);
+    QObject::connect(&d->reqTimer_, &QTimer::timeout, this, &AvatarFactory::sendAvatarRequests);
 
     // Connect signals
     connect(VCardFactory::instance(), &VCardFactory::vcardPhotoAvailable, this, &AvatarFactory::vcardUpdated);
@@ -637,7 +706,8 @@ QPixmap AvatarFactory::getAvatar(const Jid &_jid)
     }
 
     if (img.isNull()) {
-        auto vcard = VCardFactory::instance()->vcard(_jid);
+        // never wait for the disk here. if it's not loaded yet, vcardUpdated() will follow
+        auto vcard = VCardFactory::instance()->cachedVCard(_jid);
         if (vcard.isNull() || vcard.photo().isNull()) {
             return QPixmap();
         }
@@ -666,6 +736,67 @@ QPixmap AvatarFactory::getAvatar(const Jid &_jid)
     return pm;
 }
 
+/**
+ * \brief Returns the avatar of \a jid squared, scaled to \a size and rounded with \a radius, ready to paint.
+ *
+ * Nothing is read or decoded here. The first request renders the variant in background and returns a null pixmap,
+ * avatarRendered() is emitted when it's ready. Variants are keyed by the avatar hash, so a new avatar
+ * doesn't need any invalidation, the old ones just age out.
+ */
+QPixmap AvatarFactory::avatarVariant(const Jid &jid, int size, int radius, qreal dpr, bool isMuc)
+{
+    if (size <= 0) {
+        return QPixmap();
+    }
+
+    QString        cacheJid = isMuc ? jid.full() : jid.bare();
+    FileCacheItem *item     = AvatarCache::instance()->activeAvatarIcon(AvatarCache::instance()->icons(cacheJid));
+    if (!item) {
+        // the vcard photo might be not in the avatar cache yet
+        VCard vcard = isMuc ? VCardFactory::instance()->mucVcard(jid) : VCardFactory::instance()->cachedVCard(jid);
+        if (vcard.isNull() || vcard.photo().isNull()
+            || AvatarCache::instance()->setIcon(AvatarCache::VCardType, cacheJid, vcard.photo())
+                == AvatarCache::NoData) {
+            return QPixmap();
+        }
+        item = AvatarCache::instance()->activeAvatarIcon(AvatarCache::instance()->icons(cacheJid));
+        if (!item) {
+            return QPixmap();
+        }
+    }
+
+    const QString key = QString("%1/%2/%3/%4")
+                            .arg(QString::fromLatin1(item->id().data().toHex()))
+                            .arg(size)
+                            .arg(radius)
+                            .arg(dpr);
+    QPixmap *pix = d->variants_.object(key);
+    if (pix) {
+        return *pix; // null if the data can't be decoded
+    }
+    if (d->rendering_.contains(key)) {
+        return QPixmap();
+    }
+
+    d->rendering_.insert(key);
+    item->loadData(this, [this, key, jid, size, radius, dpr](const QByteArray &data) {
+        auto watcher = new QFutureWatcher<QImage>(this);
+        connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, key, jid]() {
+            QImage img = watcher->result();
+            watcher->deleteLater();
+            d->rendering_.remove(key);
+            auto pix = new QPixmap(QPixmap::fromImage(std::move(img)));
+            d->variants_.insert(key, pix, qMax(1, pix->width() * pix->height() * 4 / 1024));
+            if (!pix->isNull()) {
+                emit avatarRendered(jid);
+            }
+        });
+        watcher->setFuture(
+            QtConcurrent::run([data, size, radius, dpr]() { return renderAvatar(data, size, radius, dpr); }));
+    });
+    return QPixmap();
+}
+
 #if 0
 QPixmap AvatarFactory::getAvatarByHash(const QString &hash)
 {
@@ -723,46 +854,79 @@ AvatarFactory::UserHashes AvatarFactory::userHashes(const Jid &jid) const
 
 QPixmap AvatarFactory::getMucAvatar(const Jid &_jid)
 {
-    QString fullJid = _jid.full();
+    // occupants are too many to keep a pixmap for each one. they share decoded pixmaps by hash instead
+    QPixmap pm = mucAvatarPixmap(mucAvatarHash(_jid));
+    if (!pm.isNull()) {
+        return pm;
+    }
 
-    QString iconName = QString("avatars/%1").arg(fullJid);
-    auto    iconp    = d->iconset_.icon(iconName);
-    if (iconp) {
-        return iconp->pixmap();
+    QByteArray data = mucAvatarData(_jid);
+    if (data.isEmpty()) {
+        return QPixmap();
     }
 
-    auto       icons = AvatarCache::instance()->icons(fullJid);
+    // for mucs icons.avatar is always made of vcard and anything else is not supported. at least for now.
+    QImage img(QImage::fromData(data));
+
+    if (img.isNull()) {
+        return QPixmap();
+    }
+
+    pm = QPixmap::fromImage(std::move(img));
+    pm = ensureSquareAvatar(pm);
+    cacheMucAvatarPixmap(mucAvatarHash(_jid), pm);
+
+    return pm;
+}
+
+QByteArray AvatarFactory::mucAvatarData(const Jid &_jid)
+{
+    QString    fullJid = _jid.full();
+    auto       icons   = AvatarCache::instance()->icons(fullJid);
     QByteArray data;
     if (!icons.avatar) {
         auto vcard = VCardFactory::instance()->mucVcard(_jid);
         if (vcard.isNull() || vcard.photo().isNull()) {
-            return QPixmap();
+            return QByteArray();
         }
         data = vcard.photo();
-        AvatarCache::instance()->setIcon(AvatarCache::VCardType, _jid.full(), data);
+        AvatarCache::instance()->setIcon(AvatarCache::VCardType, fullJid, data);
         icons = AvatarCache::instance()->icons(fullJid); // should return scaled copy
     }
 
     if (icons.avatar) {
         data = icons.avatar->data();
     }
+    return data;
+}
 
-    // for mucs icons.avatar is always made of vcard and anything else is not supported. at least for now.
-    QImage img(QImage::fromData(data));
+QByteArray AvatarFactory::mucAvatarHash(const Jid &jid) const
+{
+    auto icons = AvatarCache::instance()->icons(jid.full());
+    return icons.avatar ? icons.avatar->id().data() : QByteArray();
+}
 
-    if (img.isNull()) {
+static QCache<QByteArray, QPixmap> &mucAvatarPixmaps()
+{
+    static QCache<QByteArray, QPixmap> pixmaps(MUC_AVATAR_PIXMAPS_SIZE);
+    return pixmaps;
+}
+
+QPixmap AvatarFactory::mucAvatarPixmap(const QByteArray &hash)
+{
+    if (hash.isEmpty()) {
         return QPixmap();
     }
+    QPixmap *pix = mucAvatarPixmaps().object(hash);
+    return pix ? *pix : QPixmap();
+}
 
-    QPixmap pm = QPixmap::fromImage(std::move(img));
-    pm         = ensureSquareAvatar(pm);
-
-    // Update iconset
-    PsiIcon icon;
-    icon.setImpix(pm);
-    d->iconset_.setIcon(QString("avatars/%1").arg(fullJid), icon); // FIXME do we ever release it?
-
-    return pm;
+void AvatarFactory::cacheMucAvatarPixmap(const QByteArray &hash, const QPixmap &pix)
+{
+    if (hash.isEmpty() || pix.isNull()) {
+        return;
+    }
+    mucAvatarPixmaps().insert(hash, new QPixmap(pix), qMax(1, pix.width() * pix.height() * pix.depth() / 8 / 1024));
 }
 
 void AvatarFactory::setSelfAvatar(const QString &fileName)
@@ -842,15 +1006,87 @@ void AvatarFactory::statusUpdate(const Jid &jid, const XMPP::Status &status)
                 d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
                 emit avatarChanged(jid);
             } else if (result == AvatarCache::NoData) {
-                d->vcardReqQueue_.enqueue(std::tuple<Jid, QByteArray, bool> { jid, hash, isMuc });
-                if (!d->vcardReqTimer_.isActive()) {
-                    d->vcardReqTimer_.start();
+                d->enqueue({ Private::Request::VCard, jid, hash, QString(), isMuc });
+            }
+        }
+    }
+}
+
+// sends as many queued requests as the pipeline allows. the timer keeps the pace on a loaded roster
+void AvatarFactory::sendAvatarRequests()
+{
+    if (!d->pa_->isConnected()) {
+        d->clearRequests();
+        return;
+    }
+    while (!d->reqQueue_.isEmpty() && d->inFlight_ < MaxAvatarRequests) {
+        const Private::Request r = d->reqQueue_.dequeue();
+        ++d->inFlight_;
+        if (r.kind == Private::Request::PepData) {
+            // itemPublished() stores the data before this is called
+            Task *task = d->pa_->pepManager()->get(r.jid, PEP_AVATAR_DATA_NS, r.itemId);
+            connect(task, &Task::finished, this, [this, hash = r.hash]() { avatarRequestFinished(hash); });
+            continue;
+        }
+        VCardFactory::instance()->getVCard(
+            r.jid, d->pa_->client()->rootTask(), this,
+            [this, hash = r.hash]() {
+                auto task = dynamic_cast<JT_VCard *>(sender());
+                if (task->success() && !task->vcard().isNull()) {
+                    QByteArray ba = task->vcard().photo();
+                    if (!ba.isNull()) {
+                        QString fullJid = task->jid().full(); // jids for regular contacts are already without resource
+                        if (AvatarCache::instance()->setIcon(AvatarCache::VCardType, fullJid, ba, hash)
+                            == AvatarCache::UserUpdateRequired) {
+                            d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(task->jid().full()));
+                            emit avatarChanged(task->jid());
+                        }
+                    }
                 }
+                avatarRequestFinished(hash);
+            },
+            !r.isMuc, r.isMuc, false);
+    }
+    if (d->reqQueue_.isEmpty())
+        d->reqTimer_.stop();
+}
+
+void AvatarFactory::avatarRequestFinished(const QByteArray &hash)
+{
+    if (d->inFlight_ == 0)
+        return; // requests were dropped on disconnect
+
+    --d->inFlight_;
+    AvatarCache *           cache   = AvatarCache::instance();
+    QList<Private::Request> waiters = d->waiters_.take(hash);
+    if (cache->get(XMPP::Hash { XMPP::Hash::Sha1, hash })) {
+        for (const auto &w : waiters) {
+            auto    type    = w.kind == Private::Request::PepData ? AvatarCache::AvatarType : AvatarCache::VCardType;
+            QString fullJid = w.jid.full();
+            if (cache->appendUser(hash, type, fullJid) == AvatarCache::UserUpdateRequired) {
+                d->iconset_.removeIcon(QString(QLatin1String("avatars/%1")).arg(fullJid));
+                emit avatarChanged(w.jid);
             }
         }
+        d->requested_.remove(hash);
+    } else if (!waiters.isEmpty()) {
+        // this one didn't deliver. maybe the next user of the hash will
+        d->reqQueue_.enqueue(waiters.takeFirst());
+        if (!waiters.isEmpty())
+            d->waiters_.insert(hash, waiters);
+    } else
+        d->requested_.remove(hash);
+
+    if (!d->reqQueue_.isEmpty()) {
+        if (!d->reqTimer_.isActive())
+            d->reqTimer_.start();
+    } else if (d->inFlight_ == 0) {
+        cache->sync(); // store everything fetched by this batch at once
     }
 }
 
+FileCache::Stats AvatarFactory::cacheStats() { return AvatarCache::instance()->stats(); }
+
 QString AvatarFactory::getCacheDir()
 {
     QDir avatars(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/avatars");
@@ -977,7 +1213,7 @@ void AvatarFactory::itemPublished(const Jid &jid, const QString &n, const PubSub
                 // found in-band png (by xep84 hash is for png) avatar. So we can make request
                 result = cache->appendUser(hash, AvatarCache::AvatarType, jidFull);
                 if (result == AvatarCache::NoData) {
-                    d->pa_->pepManager()->get(jid, PEP_AVATAR_DATA_NS, item.id());
+                    d->enqueue({ Private::Request::PepData, jid, hash, item.id(), false });
                     return;
                 }
                 break;
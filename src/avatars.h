@@ -20,6 +20,8 @@
 #ifndef AVATARS_H
 #define AVATARS_H
 
+#include "filecache.h"
+
 #include <QByteArray>
 #include <QMap>
 #include <QPixmap>
@@ -53,7 +55,8 @@ using namespace XMPP;
 class AvatarFactory : public QObject {
     Q_OBJECT
 
-    static const int VcardReqInterval = 500; // query vcard avatars once per half second
+    static const int VcardReqInterval  = 500; // send queued avatar requests once per half second
+    static const int MaxAvatarRequests = 4;   // avatar requests in flight at once
 
 public:
     struct UserHashes {
@@ -70,6 +73,7 @@ public:
     ~AvatarFactory();
 
     QPixmap getAvatar(const Jid &jid);
+    QPixmap avatarVariant(const Jid &jid, int size, int radius, qreal dpr, bool isMuc = false);
     // QPixmap getAvatarByHash(const QString& hash);
     static AvatarData avatarDataByHash(const QByteArray &hash);
     UserHashes        userHashes(const Jid &jid) const;
@@ -80,16 +84,24 @@ public:
     void removeManualAvatar(const Jid &j);
     bool hasManualAvatar(const Jid &j);
 
-    void    newMucItem(const Jid &fullJid, const Status &s);
-    QPixmap getMucAvatar(const Jid &jid);
+    void       newMucItem(const Jid &fullJid, const Status &s);
+    QPixmap    getMucAvatar(const Jid &jid);
+    QByteArray mucAvatarData(const Jid &jid); // undecoded image, for decoding off the gui thread
+    QByteArray mucAvatarHash(const Jid &jid) const;
+
+    // decoded muc avatars are shared by hash between all occupants and rooms
+    static QPixmap mucAvatarPixmap(const QByteArray &hash);
+    static void    cacheMucAvatarPixmap(const QByteArray &hash, const QPixmap &pix);
 
-    static QString getCacheDir();
-    static int     maxAvatarSize();
-    static QPixmap roundedAvatar(const QPixmap &pix, int rad, int avatarSize);
+    static QString          getCacheDir();
+    static FileCache::Stats cacheStats();
+    static int              maxAvatarSize();
+    static QPixmap          roundedAvatar(const QPixmap &pix, int rad, int avatarSize);
 
     void statusUpdate(const Jid &jid, const XMPP::Status &status);
 signals:
     void avatarChanged(const XMPP::Jid &);
+    void avatarRendered(const XMPP::Jid &); // a variant requested with avatarVariant() is ready
 
 protected slots:
     void itemPublished(const XMPP::Jid &, const QString &, const PubSubItem &);
@@ -100,6 +112,9 @@ private slots:
     void vcardUpdated(const XMPP::Jid &, bool isMuc);
 
 private:
+    void sendAvatarRequests();
+    void avatarRequestFinished(const QByteArray &hash);
+
     class Private;
     Private *d;
 };
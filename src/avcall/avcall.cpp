@@ -34,10 +34,17 @@
 #include <QCoreApplication>
 #include <QDir>
 #include <QLibrary>
+#include <QTimer>
 #include <QtCrypto>
 #include <cstdio>
 #include <cstdlib>
 
+// sending bitrate bounds of the congestion control, used when neither side gave a limit
+#define AVCALL_MIN_KBPS 64
+#define AVCALL_MAX_KBPS 1000
+// how often the receiver reports are looked at
+#define AVCALL_RATE_INTERVAL 1000 // ms
+
 // threaded mode is unstable. Enable it at your own risk.
 // most likely moveToThread below has to be handled carefully to call changeThread of Ice176
 //#define USE_THREAD
@@ -121,6 +128,7 @@ public:
 private slots:
     void audio_readyRead()
     {
+        QVector<JingleRtp::RtpPacket> jpackets;
         while (audio->packetsAvailable() > 0) {
             PsiMedia::RtpPacket packet = audio->read();
 
@@ -129,12 +137,14 @@ private slots:
             jpacket.portOffset = packet.portOffset();
             jpacket.value      = packet.rawValue();
 
-            transport->write(jpacket);
+            jpackets.append(std::move(jpacket));
         }
+        transport->write(jpackets);
     }
 
     void video_readyRead()
     {
+        QVector<JingleRtp::RtpPacket> jpackets;
         while (video->packetsAvailable() > 0) {
             PsiMedia::RtpPacket packet = video->read();
 
@@ -143,15 +153,15 @@ private slots:
             jpacket.portOffset = packet.portOffset();
             jpacket.value      = packet.rawValue();
 
-            transport->write(jpacket);
+            jpackets.append(std::move(jpacket));
         }
+        transport->write(jpackets);
     }
 
     void transport_readyRead()
     {
-        while (transport->packetsAvailable()) {
-            JingleRtp::RtpPacket jpacket = transport->read();
-
+        const QVector<JingleRtp::RtpPacket> jpackets = transport->readAll();
+        for (const JingleRtp::RtpPacket &jpacket : jpackets) {
             if (jpacket.type == JingleRtp::Audio && audio) // FIXME why audio could null but we still receive packets?
                                                            // (the check was added to fix a crash)
                 audio->write(PsiMedia::RtpPacket(jpacket.value, jpacket.portOffset));
@@ -262,11 +272,19 @@ public:
     bool                  transmitting;
     AvTransmit *          avTransmit;
     AvTransmitThread *    avTransmitThread;
+    QTimer                rateTimer;
+    int                   sendRate;    // kbps, what the encoder is currently limited to
+    int                   maxSendRate; // kbps, negotiated ceiling
+    quint64               lastReports;
+    double                lastJitter;
 
     explicit AvCallPrivate(AvCall *_q) :
         QObject(_q), q(_q), manager(nullptr), sess(nullptr), transmitAudio(false), transmitVideo(false),
-        transmitting(false), avTransmit(nullptr), avTransmitThread(nullptr)
+        transmitting(false), avTransmit(nullptr), avTransmitThread(nullptr), sendRate(0), maxSendRate(0),
+        lastReports(0), lastJitter(0)
     {
+        rateTimer.setInterval(AVCALL_RATE_INTERVAL);
+        connect(&rateTimer, SIGNAL(timeout()), SLOT(rate_timeout()));
         connect(&rtp, SIGNAL(started()), SLOT(rtp_started()));
         connect(&rtp, SIGNAL(preferencesUpdated()), SLOT(rtp_preferencesUpdated()));
         connect(&rtp, SIGNAL(stopped()), SLOT(rtp_stopped()));
@@ -383,6 +401,8 @@ private:
 
     void cleanup()
     {
+        rateTimer.stop();
+
         // if we had a thread, this will move the object back
         delete avTransmitThread;
         avTransmitThread = nullptr;
@@ -618,10 +638,53 @@ private slots:
         if (transmitVideo)
             rtp.transmitVideo();
 
+        // only video has enough of a bitrate to be worth adapting
+        if (transmitVideo) {
+            maxSendRate = bitrate != -1 ? bitrate : AVCALL_MAX_KBPS;
+            if (sess->remoteMaximumBitrate() > 0)
+                maxSendRate = qMin(maxSendRate, sess->remoteMaximumBitrate());
+            maxSendRate = qMax(maxSendRate, AVCALL_MIN_KBPS);
+            sendRate    = maxSendRate;
+            lastReports = 0;
+            lastJitter  = 0;
+            rateTimer.start();
+        }
+
         transmitting = true;
         emit q->activated();
     }
 
+    // loss based control as in GCC (draft-ietf-rmcat-gcc), growing queues on the path are
+    //   seen as a rising jitter in the peer's receiver reports
+    void rate_timeout()
+    {
+        const JingleRtpStats s = sess->rtpChannel()->stats(JingleRtp::Video);
+        if (s.reportsReceived == lastReports)
+            return;
+        lastReports = s.reportsReceived;
+
+        const double loss     = s.remoteLoss / 100;
+        const bool   overused = s.remoteJitter > 30 && s.remoteJitter > lastJitter * 1.5;
+        lastJitter            = s.remoteJitter;
+
+        int rate = sendRate;
+        if (loss > 0.1)
+            rate = int(rate * (1 - 0.5 * loss));
+        else if (overused)
+            rate = int(rate * 0.85);
+        else if (loss < 0.02)
+            rate = int(rate * 1.08) + 1;
+        rate = qBound(AVCALL_MIN_KBPS, rate, maxSendRate);
+
+        // small steps aren't worth reconfiguring the encoder for
+        if (qAbs(rate - sendRate) * 20 < sendRate && rate != maxSendRate)
+            return;
+        if (rate != sendRate) {
+            sendRate = rate;
+            rtp.setMaximumSendingBitrate(sendRate);
+        }
+    }
+
     void sess_remoteMediaUpdated()
     {
         setup_remote_media();
@@ -650,6 +713,13 @@ XMPP::Jid AvCall::jid() const
 
 AvCall::Mode AvCall::mode() const { return d->mode; }
 
+JingleRtpStats AvCall::stats(Mode type) const
+{
+    if (!d->sess || !d->sess->rtpChannel())
+        return JingleRtpStats();
+    return d->sess->rtpChannel()->stats(type == Video ? JingleRtp::Video : JingleRtp::Audio);
+}
+
 void AvCall::connectToJid(const XMPP::Jid &jid, Mode mode, int kbps, PeerFeatures features)
 {
     d->peer         = jid;
@@ -25,6 +25,7 @@
 
 class AvCallManagerPrivate;
 class AvCallPrivate;
+class JingleRtpStats;
 class PsiAccount;
 class QHostAddress;
 
@@ -59,6 +60,9 @@ public:
 
     QString errorString() const;
 
+    // zero until the session is active, refreshed once a second
+    JingleRtpStats stats(Mode type) const;
+
     // if we use deleteLater() on a call, then it won't detach from the
     //   manager until the deletion resolves.  use unlink() to immediately
     //   detach, and then call deleteLater().
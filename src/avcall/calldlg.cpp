@@ -23,6 +23,7 @@
 #include "avcall.h"
 #include "common.h"
 #include "iconset.h"
+#include "jinglertp.h"
 #include "psiaccount.h"
 #include "psioptions.h"
 #include "ui_call.h"
@@ -81,6 +82,8 @@ public:
         ui.pb_accept->setDefault(true);
         ui.pb_accept->setFocus();
 
+        ui.lb_stats->hide();
+
         timer = new QTimer(q);
         connect(timer, SIGNAL(timeout()), SLOT(update_call_duration()));
 
@@ -211,6 +214,8 @@ private slots:
         ui.pb_accept->hide();
         ui.pb_reject->setText(tr("&Hang up"));
         ui.lb_status->setText(tr("Call active"));
+        ui.lb_stats->setText(QString());
+        ui.lb_stats->show();
 
         call_duration = QTime(0, 0, 0, 0);
         timer->start(1000);
@@ -233,6 +238,23 @@ private slots:
     {
         call_duration = call_duration.addSecs(1);
         ui.lb_status->setText(tr("Call duration: %1").arg(call_duration.toString("mm:ss")));
+
+        QStringList    lines;
+        JingleRtpStats s = sess->stats(AvCall::Audio);
+        lines += tr("Audio: %1/%2 kbps, loss %3%, jitter %4 ms")
+                     .arg(s.receiveKbps)
+                     .arg(s.sendKbps)
+                     .arg(s.lossPercent(), 0, 'f', 1)
+                     .arg(s.jitter, 0, 'f', 1);
+        if (sess->mode() == AvCall::Video || sess->mode() == AvCall::Both) {
+            s = sess->stats(AvCall::Video);
+            lines += tr("Video: %1/%2 kbps, loss %3%, jitter %4 ms")
+                         .arg(s.receiveKbps)
+                         .arg(s.sendKbps)
+                         .arg(s.lossPercent(), 0, 'f', 1)
+                         .arg(s.jitter, 0, 'f', 1);
+        }
+        ui.lb_stats->setText(lines.join('\n'));
     }
 };
 
@@ -26,9 +26,19 @@
 #include "jingle.h"
 #include "xmpp_client.h"
 
+#include <QElapsedTimer>
+#include <QMutex>
 #include <QtCrypto>
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <vector>
+
+// incoming packets the channel holds before dropping new ones, a power of two.
+// about a second of 720p video
+#define RTP_RING_SIZE 1024
+// JingleRtpChannel::stats() refresh period
+#define RTP_STATS_INTERVAL 1000 // ms
 
 // TODO: reject offers that don't contain at least one of audio or video
 // TODO: support candidate negotiations over the JingleRtpChannel thread
@@ -230,18 +240,233 @@ private:
 //----------------------------------------------------------------------------
 // JingleRtp
 //----------------------------------------------------------------------------
+// single producer, single consumer queue over preallocated packet slots.
+// slots are reused, so queueing a packet allocates nothing, and neither side waits for the other
+class RtpPacketRing {
+public:
+    RtpPacketRing() : slots_(RTP_RING_SIZE) { }
+
+    bool isEmpty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+    // producer side. false if the ring is full
+    bool push(JingleRtp::Type type, int portOffset, QByteArray &&value)
+    {
+        const quint32 tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == RTP_RING_SIZE)
+            return false;
+        JingleRtp::RtpPacket &slot = slots_[tail & (RTP_RING_SIZE - 1)];
+        slot.type                  = type;
+        slot.portOffset            = portOffset;
+        slot.value                 = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. an empty packet if there is none
+    JingleRtp::RtpPacket pop()
+    {
+        JingleRtp::RtpPacket packet;
+        const quint32        head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return packet;
+        JingleRtp::RtpPacket &slot = slots_[head & (RTP_RING_SIZE - 1)];
+        packet.type                = slot.type;
+        packet.portOffset          = slot.portOffset;
+        packet.value               = std::move(slot.value);
+        head_.store(head + 1, std::memory_order_release);
+        return packet;
+    }
+
+    // consumer side. everything queued so far, handing the slots back to the producer once
+    QVector<JingleRtp::RtpPacket> popAll()
+    {
+        QVector<JingleRtp::RtpPacket> packets;
+        const quint32                 head = head_.load(std::memory_order_relaxed);
+        const quint32                 tail = tail_.load(std::memory_order_acquire);
+        packets.reserve(int(tail - head));
+        for (quint32 n = head; n != tail; ++n) {
+            JingleRtp::RtpPacket &slot = slots_[n & (RTP_RING_SIZE - 1)];
+            JingleRtp::RtpPacket  packet;
+            packet.type       = slot.type;
+            packet.portOffset = slot.portOffset;
+            packet.value      = std::move(slot.value);
+            packets.append(std::move(packet));
+        }
+        head_.store(tail, std::memory_order_release);
+        return packets;
+    }
+
+private:
+    std::vector<JingleRtp::RtpPacket> slots_;
+    std::atomic<quint32>              head_ { 0 }; // next slot to read, only the consumer moves it
+    std::atomic<quint32>              tail_ { 0 }; // next slot to fill, only the producer moves it
+};
+
+static quint32 readUInt32(const uchar *p) { return quint32(p[0]) << 24 | quint32(p[1]) << 16 | quint32(p[2]) << 8 | p[3]; }
+
+// rtcp may be multiplexed on the rtp port (RFC 5761), its types 200-204 don't clash with rtp payload types
+static bool isRtcp(const QByteArray &packet)
+{
+    const int pt = packet.size() >= 2 ? uchar(packet[1]) & 0x7f : 0;
+    return pt >= 72 && pt <= 76;
+}
+
+// receive and send accounting of one stream, the fixed rtp header is enough for it
+class RtpStreamStats {
+public:
+    void received(const QByteArray &packet, qint64 arrivalNs, int clockRate);
+    void sent(const QByteArray &packet, int clockRate)
+    {
+        ++stats_.packetsSent;
+        stats_.bytesSent += quint64(packet.size());
+        if (packet.size() >= 12) {
+            localSsrc_      = readUInt32(reinterpret_cast<const uchar *>(packet.constData()) + 8);
+            localClockRate_ = clockRate;
+        }
+    }
+    // picks the peer's report blocks about our source out of a compound rtcp packet
+    void reportReceived(const QByteArray &packet);
+
+    // closes an interval of \a ms for the bitrates
+    JingleRtpStats sample(qint64 ms);
+
+private:
+    JingleRtpStats stats_;
+    bool           started_        = false;
+    quint32        ssrc_           = 0;
+    quint32        baseSeq_        = 0;
+    quint16        maxSeq_         = 0;
+    quint32        cycles_         = 0;     // sequence number wraps, times 0x10000
+    quint64        seqReceived_    = 0;     // packets of the current source
+    bool           haveTransit_    = false;
+    double         lastArrival_    = 0;     // in timestamp units
+    quint32        lastTs_         = 0;
+    double         jitter_         = 0;     // in timestamp units
+    quint64        lastBytesIn_    = 0;
+    quint64        lastBytesOut_   = 0;
+    quint32        localSsrc_      = 0;
+    int            localClockRate_ = 0;     // of the last payload type sent
+};
+
+void RtpStreamStats::received(const QByteArray &packet, qint64 arrivalNs, int clockRate)
+{
+    ++stats_.packetsReceived;
+    stats_.bytesReceived += quint64(packet.size());
+
+    // version 2 only
+    const uchar *p = reinterpret_cast<const uchar *>(packet.constData());
+    if (packet.size() < 12 || (p[0] >> 6) != 2 || isRtcp(packet))
+        return;
+    const quint16 seq  = quint16(p[2] << 8 | p[3]);
+    const quint32 ts   = readUInt32(p + 4);
+    const quint32 ssrc = readUInt32(p + 8);
+
+    if (!started_ || ssrc != ssrc_) {
+        // a new source starts its own sequence space
+        started_     = true;
+        ssrc_        = ssrc;
+        baseSeq_     = seq;
+        maxSeq_      = seq;
+        cycles_      = 0;
+        seqReceived_ = 0;
+        haveTransit_ = false;
+        jitter_      = 0;
+    } else {
+        const quint16 delta = quint16(seq - maxSeq_);
+        if (delta > 0 && delta < 0x8000) {
+            if (seq < maxSeq_)
+                cycles_ += 0x10000;
+            maxSeq_ = seq;
+        } else if (delta >= 0x8000) {
+            ++stats_.packetsReordered;
+        }
+    }
+    ++seqReceived_;
+    stats_.packetsLost = qint64(cycles_) + maxSeq_ - baseSeq_ + 1 - qint64(seqReceived_);
+
+    if (clockRate <= 0)
+        return;
+    const double arrival = double(arrivalNs) * clockRate / 1e9;
+    if (haveTransit_) {
+        // difference of transit times, the timestamp difference is signed to survive its wrap
+        const double d = qAbs((arrival - lastArrival_) - double(qint32(ts - lastTs_)));
+        jitter_ += (d - jitter_) / 16;
+        stats_.jitter = jitter_ * 1000 / clockRate;
+    }
+    haveTransit_ = true;
+    lastArrival_ = arrival;
+    lastTs_      = ts;
+}
+
+void RtpStreamStats::reportReceived(const QByteArray &packet)
+{
+    const uchar *p   = reinterpret_cast<const uchar *>(packet.constData());
+    const uchar *end = p + packet.size();
+    while (end - p >= 8 && (p[0] >> 6) == 2) {
+        const uchar *next = p + (int(p[2] << 8 | p[3]) + 1) * 4;
+        if (next > end)
+            break;
+        // sender reports carry 20 bytes of sender info before the report blocks
+        const uchar *block = p[1] == 200 ? p + 28 : p[1] == 201 ? p + 8 : next;
+        for (int n = p[0] & 0x1f; n > 0 && block + 24 <= next; --n, block += 24) {
+            if (readUInt32(block) != localSsrc_)
+                continue;
+            ++stats_.reportsReceived;
+            stats_.remoteLoss = block[4] * 100.0 / 256;
+            if (localClockRate_ > 0)
+                stats_.remoteJitter = readUInt32(block + 12) * 1000.0 / localClockRate_;
+        }
+        p = next;
+    }
+}
+
+JingleRtpStats RtpStreamStats::sample(qint64 ms)
+{
+    if (ms > 0) {
+        // bytes * 8 / ms is kbit/s
+        stats_.receiveKbps = int((stats_.bytesReceived - lastBytesIn_) * 8 / quint64(ms));
+        stats_.sendKbps    = int((stats_.bytesSent - lastBytesOut_) * 8 / quint64(ms));
+    }
+    lastBytesIn_  = stats_.bytesReceived;
+    lastBytesOut_ = stats_.bytesSent;
+    return stats_;
+}
+
 class JingleRtpChannelPrivate : public QObject {
     Q_OBJECT
 
 public:
     JingleRtpChannel *q;
 
-    QMutex                      m;
-    XMPP::UdpPortReserver *     portReserver;
-    XMPP::Ice176 *              iceA;
-    XMPP::Ice176 *              iceV;
-    QTimer *                    rtpActivityTimer;
-    QList<JingleRtp::RtpPacket> in;
+    XMPP::UdpPortReserver *portReserver;
+    XMPP::Ice176 *         iceA;
+    XMPP::Ice176 *         iceV;
+    QTimer *               rtpActivityTimer;
+    RtpPacketRing          in;
+    int                    dropped = 0; // incoming packets lost to a full ring
+
+    // what write() uses, published once the ice objects are set up for this thread
+    std::atomic<XMPP::Ice176 *> outA { nullptr };
+    std::atomic<XMPP::Ice176 *> outV { nullptr };
+
+    // write() and the ice signals run in this object's thread, only the samples are shared
+    std::atomic<int> clockRates[128] {}; // payload type -> clock rate
+    RtpStreamStats   streamStats[2];     // audio, video
+    QElapsedTimer    clock;
+    QTimer *         statsTimer;
+    QElapsedTimer    statsInterval;
+    mutable QMutex   statsMutex;
+    JingleRtpStats   samples[2];
+
+    void setClockRates(const QList<JingleRtpPayloadType> &types);
+
+    void writePacket(XMPP::Ice176 *ice, const JingleRtp::RtpPacket &packet)
+    {
+        ice->writeDatagram(packet.portOffset, packet.value);
+        if (packet.portOffset == 0 && packet.value.size() >= 2)
+            streamStats[packet.type == JingleRtp::Audio ? 0 : 1].sent(
+                packet.value, clockRates[uchar(packet.value[1]) & 0x7f].load(std::memory_order_relaxed));
+    }
 
     explicit JingleRtpChannelPrivate(JingleRtpChannel *_q);
     ~JingleRtpChannelPrivate() override;
@@ -254,6 +479,7 @@ private slots:
     void ice_readyRead(int componentIndex);
     void ice_datagramsWritten(int componentIndex, int count);
     void rtpActivity_timeout();
+    void stats_timeout();
 };
 
 class JingleRtpManagerPrivate : public QObject {
@@ -1074,6 +1300,9 @@ private:
                 iceV->setParent(nullptr);
             }
 
+            // the negotiated payload types tell the statistics the rtp clock of each packet
+            rtpChannel->d->setClockRates(localAudioPayloadTypes + remoteAudioPayloadTypes + localVideoPayloadTypes
+                                         + remoteVideoPayloadTypes);
             rtpChannel->d->setIceObjects(portReserver, iceA, iceV);
 
             portReserver = nullptr;
@@ -1246,6 +1475,11 @@ JingleRtpChannelPrivate::JingleRtpChannelPrivate(JingleRtpChannel *_q) :
 {
     rtpActivityTimer = new QTimer(this);
     connect(rtpActivityTimer, SIGNAL(timeout()), SLOT(rtpActivity_timeout()));
+
+    statsTimer = new QTimer(this);
+    statsTimer->setInterval(RTP_STATS_INTERVAL);
+    connect(statsTimer, SIGNAL(timeout()), SLOT(stats_timeout()));
+    clock.start();
 }
 
 JingleRtpChannelPrivate::~JingleRtpChannelPrivate()
@@ -1277,15 +1511,26 @@ JingleRtpChannelPrivate::~JingleRtpChannelPrivate()
     rtpActivityTimer->setParent(nullptr);
     rtpActivityTimer->disconnect(this);
     rtpActivityTimer->deleteLater();
+
+    statsTimer->setParent(nullptr);
+    statsTimer->disconnect(this);
+    statsTimer->deleteLater();
+}
+
+void JingleRtpChannelPrivate::setClockRates(const QList<JingleRtpPayloadType> &types)
+{
+    for (const JingleRtpPayloadType &pt : types) {
+        if (pt.id >= 0 && pt.id < 128 && pt.clockrate > 0)
+            clockRates[pt.id].store(pt.clockrate, std::memory_order_relaxed);
+    }
 }
 
 void JingleRtpChannelPrivate::setIceObjects(XMPP::UdpPortReserver *_portReserver, XMPP::Ice176 *_iceA,
                                             XMPP::Ice176 *_iceV)
 {
     if (QThread::currentThread() != thread()) {
-        // if called from another thread, safely change ownership
-        QMutexLocker locker(&m);
-
+        // if called from another thread, safely change ownership.
+        // write() doesn't see the objects before they are published below
         portReserver = _portReserver;
         iceA         = _iceA;
         iceV         = _iceV;
@@ -1305,6 +1550,8 @@ void JingleRtpChannelPrivate::setIceObjects(XMPP::UdpPortReserver *_portReserver
             connect(iceV, SIGNAL(datagramsWritten(int, int)), SLOT(ice_datagramsWritten(int, int)));
         }
 
+        outA.store(iceA, std::memory_order_release);
+        outV.store(iceV, std::memory_order_release);
         QMetaObject::invokeMethod(this, "start", Qt::QueuedConnection);
     } else {
         portReserver = _portReserver;
@@ -1321,6 +1568,8 @@ void JingleRtpChannelPrivate::setIceObjects(XMPP::UdpPortReserver *_portReserver
             connect(iceV, SIGNAL(datagramsWritten(int, int)), SLOT(ice_datagramsWritten(int, int)));
         }
 
+        outA.store(iceA, std::memory_order_release);
+        outV.store(iceV, std::memory_order_release);
         start();
     }
 }
@@ -1341,6 +1590,8 @@ void JingleRtpChannelPrivate::start()
     if (iceV)
         iceV->setParent(this);
     restartRtpActivityTimer();
+    statsInterval.start();
+    statsTimer->start();
 }
 
 void JingleRtpChannelPrivate::ice_readyRead(int componentIndex)
@@ -1350,26 +1601,25 @@ void JingleRtpChannelPrivate::ice_readyRead(int componentIndex)
     if (ice == iceA && componentIndex == 0)
         restartRtpActivityTimer();
 
-    if (ice == iceA) {
-        while (iceA->hasPendingDatagrams(componentIndex)) {
-            JingleRtp::RtpPacket packet;
-            packet.type       = JingleRtp::Audio;
-            packet.portOffset = componentIndex;
-            packet.value      = iceA->readDatagram(componentIndex);
-            in += packet;
-        }
-    } else // iceV
-    {
-        while (iceV->hasPendingDatagrams(componentIndex)) {
-            JingleRtp::RtpPacket packet;
-            packet.type       = JingleRtp::Video;
-            packet.portOffset = componentIndex;
-            packet.value      = iceV->readDatagram(componentIndex);
-            in += packet;
-        }
+    const JingleRtp::Type type   = ice == iceA ? JingleRtp::Audio : JingleRtp::Video;
+    RtpStreamStats &      stats  = streamStats[ice == iceA ? 0 : 1];
+    bool                  queued = false;
+    while (ice->hasPendingDatagrams(componentIndex)) {
+        QByteArray datagram = ice->readDatagram(componentIndex);
+        if (componentIndex == 1 || isRtcp(datagram))
+            stats.reportReceived(datagram);
+        else if (datagram.size() >= 2)
+            stats.received(datagram, clock.nsecsElapsed(),
+                           clockRates[uchar(datagram[1]) & 0x7f].load(std::memory_order_relaxed));
+        // a stalled reader loses the newest packets, rtp copes with that better than with delay
+        if (in.push(type, componentIndex, std::move(datagram)))
+            queued = true;
+        else if (dropped++ % RTP_RING_SIZE == 0)
+            printf("warning: RTP reader is behind, %d packets dropped\n", dropped);
     }
 
-    emit q->readyRead();
+    if (queued)
+        emit q->readyRead();
 }
 
 void JingleRtpChannelPrivate::ice_datagramsWritten(int componentIndex, int count)
@@ -1384,22 +1634,53 @@ void JingleRtpChannelPrivate::rtpActivity_timeout()
     printf("warning: 5 seconds passed without receiving audio RTP\n");
 }
 
+void JingleRtpChannelPrivate::stats_timeout()
+{
+    const qint64   ms    = statsInterval.restart();
+    JingleRtpStats audio = streamStats[0].sample(ms);
+    JingleRtpStats video = streamStats[1].sample(ms);
+
+    QMutexLocker locker(&statsMutex);
+    samples[0] = audio;
+    samples[1] = video;
+}
+
 JingleRtpChannel::JingleRtpChannel() { d = new JingleRtpChannelPrivate(this); }
 
 JingleRtpChannel::~JingleRtpChannel() { delete d; }
 
 bool JingleRtpChannel::packetsAvailable() const { return !d->in.isEmpty(); }
 
-JingleRtp::RtpPacket JingleRtpChannel::read() { return d->in.takeFirst(); }
+JingleRtp::RtpPacket JingleRtpChannel::read() { return d->in.pop(); }
+
+QVector<JingleRtp::RtpPacket> JingleRtpChannel::readAll() { return d->in.popAll(); }
 
 void JingleRtpChannel::write(const JingleRtp::RtpPacket &packet)
 {
-    QMutexLocker locker(&d->m);
+    XMPP::Ice176 *ice = packet.type == JingleRtp::Audio ? d->outA.load(std::memory_order_acquire)
+                                                        : d->outV.load(std::memory_order_acquire);
+    if (ice)
+        d->writePacket(ice, packet);
+}
 
-    if (packet.type == JingleRtp::Audio && d->iceA)
-        d->iceA->writeDatagram(packet.portOffset, packet.value);
-    else if (packet.type == JingleRtp::Video && d->iceV)
-        d->iceV->writeDatagram(packet.portOffset, packet.value);
+void JingleRtpChannel::write(const QVector<JingleRtp::RtpPacket> &packets)
+{
+    if (packets.isEmpty())
+        return;
+    // one lookup per batch, the ice objects don't change while a call is running
+    XMPP::Ice176 *iceA = d->outA.load(std::memory_order_acquire);
+    XMPP::Ice176 *iceV = d->outV.load(std::memory_order_acquire);
+    for (const JingleRtp::RtpPacket &packet : packets) {
+        XMPP::Ice176 *out = packet.type == JingleRtp::Audio ? iceA : iceV;
+        if (out)
+            d->writePacket(out, packet);
+    }
+}
+
+JingleRtpStats JingleRtpChannel::stats(JingleRtp::Type type) const
+{
+    QMutexLocker locker(&d->statsMutex);
+    return d->samples[type == JingleRtp::Audio ? 0 : 1];
 }
 
 //----------------------------------------------------------------------------
@@ -22,11 +22,36 @@
 #include "jinglertptasks.h"
 #include "xmpp.h"
 
+#include <QVector>
+
 class JingleRtpChannel;
 class JingleRtpChannelPrivate;
 class JingleRtpManagerPrivate;
 class JingleRtpPrivate;
 
+// what JingleRtpChannel measured for one media stream, refreshed once a second
+class JingleRtpStats {
+public:
+    quint64 packetsReceived  = 0;
+    quint64 bytesReceived    = 0;
+    qint64  packetsLost      = 0; // expected minus received (RFC 3550 A.3), negative with duplicates
+    quint64 packetsReordered = 0; // arrived after a later sequence number
+    double  jitter           = 0; // ms, interarrival jitter (RFC 3550 A.8)
+    quint64 packetsSent      = 0;
+    quint64 bytesSent        = 0;
+    int     receiveKbps      = 0; // over the last second
+    int     sendKbps         = 0;
+    quint64 reportsReceived  = 0; // rtcp report blocks about what we send
+    double  remoteLoss       = 0; // percent, as last reported by the peer
+    double  remoteJitter     = 0; // ms, as last reported by the peer
+
+    double lossPercent() const
+    {
+        const qint64 expected = qint64(packetsReceived) + packetsLost;
+        return expected > 0 && packetsLost > 0 ? 100.0 * double(packetsLost) / double(expected) : 0.0;
+    }
+};
+
 class JingleRtp : public QObject {
     Q_OBJECT
 
@@ -105,6 +130,13 @@ public:
     JingleRtp::RtpPacket read();
     void                 write(const JingleRtp::RtpPacket &packet);
 
+    // batched forms of read() and write(), preferred when several packets are at hand
+    QVector<JingleRtp::RtpPacket> readAll();
+    void                          write(const QVector<JingleRtp::RtpPacket> &packets);
+
+    // safe to call from any thread
+    JingleRtpStats stats(JingleRtp::Type type) const;
+
 signals:
     void readyRead();
 
@@ -24,6 +24,7 @@
 MediaDeviceWatcher::MediaDeviceWatcher(QObject *parent) : QObject(parent)
 {
     connect(&_features, &PsiMedia::Features::availibityChanged, this, &MediaDeviceWatcher::availibityChanged);
+    connect(&_features, &PsiMedia::Features::updated, this, &MediaDeviceWatcher::features_updated);
 }
 
 MediaDeviceWatcher *MediaDeviceWatcher::_instance = nullptr;
@@ -36,6 +37,28 @@ MediaDeviceWatcher *MediaDeviceWatcher::instance()
 
 void MediaDeviceWatcher::setup() { _features.setup(); }
 
+void MediaDeviceWatcher::features_updated()
+{
+    _devices.ready               = true;
+    _devices.audioInputDevices   = _features.audioInputDevices();
+    _devices.audioOutputDevices  = _features.audioOutputDevices();
+    _devices.videoInputDevices   = _features.videoInputDevices();
+    _devices.supportedAudioModes = _features.supportedAudioModes();
+    _devices.supportedVideoModes = _features.supportedVideoModes();
+    emit devicesChanged();
+}
+
+MediaConfiguration MediaDeviceWatcher::configuration() const
+{
+    MediaConfiguration config = _configuration;
+    if (_devices.ready) {
+        config.audioInDeviceId  = defaultDeviceId(_devices.audioInputDevices, config.audioInDeviceId);
+        config.audioOutDeviceId = defaultDeviceId(_devices.audioOutputDevices, config.audioOutDeviceId);
+        config.videoInDeviceId  = defaultDeviceId(_devices.videoInputDevices, config.videoInDeviceId);
+    }
+    return config;
+}
+
 void MediaDeviceWatcher::selectDevices(const QString &audioInput, const QString &audioOutput, const QString &videoInput)
 {
     _configuration.audioInDeviceId  = audioInput;
@@ -44,7 +67,7 @@ void MediaDeviceWatcher::selectDevices(const QString &audioInput, const QString
     emit updated();
 }
 
-QString MediaDeviceWatcher::defaultDeviceId(const QList<PsiMedia::Device> &devs, const QString &userPref)
+QString MediaDeviceWatcher::defaultDeviceId(const QList<PsiMedia::Device> &devs, const QString &userPref) const
 {
     QString def;
     bool    userPrefFound = false;
@@ -34,30 +34,47 @@ public:
     QString extHost;
 };
 
+// what the provider last reported. kept up to date by the provider's hot-plug monitor
+class MediaDevices {
+public:
+    bool                         ready = false; // false until the first lookup has completed
+    QList<PsiMedia::Device>      audioInputDevices;
+    QList<PsiMedia::Device>      audioOutputDevices;
+    QList<PsiMedia::Device>      videoInputDevices;
+    QList<PsiMedia::AudioParams> supportedAudioModes;
+    QList<PsiMedia::VideoParams> supportedVideoModes;
+};
+
 class MediaDeviceWatcher : public QObject {
     Q_OBJECT
 
     explicit MediaDeviceWatcher(QObject *parent = nullptr);
-    QString defaultDeviceId(const QList<PsiMedia::Device> &devs, const QString &userPref);
+    QString defaultDeviceId(const QList<PsiMedia::Device> &devs, const QString &userPref) const;
+    void    features_updated();
 
 public:
     static MediaDeviceWatcher *instance();
     void                       setup();
     void selectDevices(const QString &audioInput, const QString &audioOutput, const QString &videoInput);
-    inline const MediaConfiguration &configuration() const { return _configuration; }
 
-    inline QList<PsiMedia::Device>      audioInputDevices() { return _features.audioInputDevices(); }
-    inline QList<PsiMedia::Device>      audioOutputDevices() { return _features.audioOutputDevices(); }
-    inline QList<PsiMedia::Device>      videoInputDevices() { return _features.videoInputDevices(); }
-    inline QList<PsiMedia::AudioParams> supportedAudioModes() { return _features.supportedAudioModes(); }
-    inline QList<PsiMedia::VideoParams> supportedVideoModes() { return _features.supportedVideoModes(); }
+    // selected devices, unset or unplugged ones resolved against the cached lists. never probes
+    MediaConfiguration         configuration() const;
+    inline const MediaDevices &devices() const { return _devices; }
+
+    inline QList<PsiMedia::Device>      audioInputDevices() const { return _devices.audioInputDevices; }
+    inline QList<PsiMedia::Device>      audioOutputDevices() const { return _devices.audioOutputDevices; }
+    inline QList<PsiMedia::Device>      videoInputDevices() const { return _devices.videoInputDevices; }
+    inline QList<PsiMedia::AudioParams> supportedAudioModes() const { return _devices.supportedAudioModes; }
+    inline QList<PsiMedia::VideoParams> supportedVideoModes() const { return _devices.supportedVideoModes; }
 
 signals:
     void updated();
+    void devicesChanged();
     void availibityChanged();
 
 private:
     MediaConfiguration         _configuration;
+    MediaDevices               _devices;
     PsiMedia::Features         _features;
     static MediaDeviceWatcher *_instance;
 };
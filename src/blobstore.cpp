@@ -0,0 +1,159 @@
+/*
+ * blobstore.cpp - content addressed storage shared by the file caches
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "blobstore.h"
+
+#include "applicationinfo.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// smaller data is not worth hashing to share it in memory
+#define BLOB_INTERN_MIN 1024
+
+BlobStore::BlobStore() : dir_(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/blobs")
+{
+    QDir().mkpath(dir_);
+    QtConcurrent::run([this]() { gc(); });
+}
+
+BlobStore *BlobStore::instance()
+{
+    static BlobStore *store = new BlobStore;
+    return store;
+}
+
+/**
+ * Writes \a data to \a fileName, as a link to the blob with the same content if possible.
+ * The file must not be modified in place afterwards, other caches may see it.
+ */
+bool BlobStore::write(const QByteArray &data, const QString &fileName)
+{
+    const QString blob
+        = dir_ + "/" + QString::fromLatin1(QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex());
+    QFile::remove(fileName);
+
+    {
+        QMutexLocker locker(&mutex_);
+        bool         exists = QFile::exists(blob);
+        if (!exists) {
+            QSaveFile f(blob);
+            exists = f.open(QIODevice::WriteOnly) && f.write(data) == data.size() && f.commit();
+        }
+        if (exists && createLink(blob, fileName)) {
+            return true;
+        }
+    }
+
+    // other filesystem or no hard links there, keep a plain copy
+    QFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("Can't open file %s for writing", qPrintable(fileName));
+        return false;
+    }
+    return f.write(data) == data.size();
+}
+
+/**
+ * Returns a copy of \a data sharing memory with equal data already loaded by some cache.
+ */
+QByteArray BlobStore::intern(const QByteArray &data)
+{
+    if (data.size() < BLOB_INTERN_MIN) {
+        return data;
+    }
+
+    const QByteArray sum = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+    QMutexLocker     locker(&mutex_);
+    auto             it = memory_.constFind(sum);
+    if (it != memory_.constEnd()) {
+        return *it;
+    }
+    memory_.insert(sum, data);
+    return data;
+}
+
+/**
+ * Drops data nobody but the store holds anymore. FileCache calls it after it unloads items.
+ */
+void BlobStore::sweep()
+{
+    QMutexLocker locker(&mutex_);
+    for (auto it = memory_.begin(); it != memory_.end();) {
+        if (it.value().isDetached()) {
+            it = memory_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * Removes blobs which are not linked from any cache anymore.
+ */
+void BlobStore::gc()
+{
+    QMutexLocker      locker(&mutex_);
+    QDir              dir(dir_);
+    const QStringList files = dir.entryList(QDir::Files);
+    for (const QString &name : files) {
+        if (linkCount(dir.filePath(name)) == 1) {
+            dir.remove(name);
+        }
+    }
+}
+
+bool BlobStore::createLink(const QString &target, const QString &link)
+{
+#ifdef Q_OS_WIN
+    return CreateHardLinkW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(link).utf16()),
+                           reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()), nullptr);
+#else
+    return ::link(QFile::encodeName(target).constData(), QFile::encodeName(link).constData()) == 0;
+#endif
+}
+
+int BlobStore::linkCount(const QString &fileName)
+{
+#ifdef Q_OS_WIN
+    HANDLE h = CreateFileW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(fileName).utf16()), 0,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    BY_HANDLE_FILE_INFORMATION info;
+    int                        ret = GetFileInformationByHandle(h, &info) ? int(info.nNumberOfLinks) : -1;
+    CloseHandle(h);
+    return ret;
+#else
+    struct stat st;
+    return ::stat(QFile::encodeName(fileName).constData(), &st) == 0 ? int(st.st_nlink) : -1;
+#endif
+}
@@ -0,0 +1,52 @@
+/*
+ * blobstore.h - content addressed storage shared by the file caches
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Keeps one copy of each content for all the FileCache instances (avatars, bob, file shares).
+// Every cache still has its own registry, file names and eviction, this is only the storage below them.
+// On disk the cache files are hard links to blobs/<sha1>, so the link count tells if a blob is still
+// used by anybody. In memory equal data is shared between the items. Thread safe.
+class BlobStore {
+public:
+    static BlobStore *instance();
+
+    bool       write(const QByteArray &data, const QString &fileName);
+    QByteArray intern(const QByteArray &data);
+    void       sweep();
+    void       gc();
+
+private:
+    BlobStore();
+
+    static bool createLink(const QString &target, const QString &link);
+    static int  linkCount(const QString &fileName);
+
+    QString                       dir_;
+    QMutex                        mutex_;
+    QHash<QByteArray, QByteArray> memory_; // sha1 => data shared by the items in memory
+};
+
+#endif // BLOBSTORE_H
@@ -61,4 +61,6 @@ BoBData BoBFileCache::get(const Hash &h)
     return bd;
 }
 
+const FileCache::Stats &BoBFileCache::stats() const { return _fileCache->stats(); }
+
 BoBFileCache *BoBFileCache::_instance = nullptr;
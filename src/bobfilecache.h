@@ -20,10 +20,9 @@
 #ifndef BOBFILECACHE_H
 #define BOBFILECACHE_H
 
+#include "filecache.h"
 #include "iris/xmpp_bitsofbinary.h"
 
-class FileCache;
-
 using namespace XMPP;
 
 class BoBFileCache : public BoBCache {
@@ -34,6 +33,8 @@ public:
     virtual void    put(const BoBData &) override;
     virtual BoBData get(const Hash &) override;
 
+    const FileCache::Stats &stats() const;
+
 private:
     BoBFileCache();
 
@@ -19,9 +19,12 @@
 
 #include "bookmarkmanager.h"
 
+#include "pepmanager.h"
 #include "psiaccount.h"
 #include "psioptions.h"
 #include "xmpp_client.h"
+#include "xmpp_pubsubitem.h"
+#include "xmpp_pubsubretraction.h"
 #include "xmpp_task.h"
 #include "xmpp_xmlcommon.h"
 
@@ -111,9 +114,125 @@ private:
 
 // -----------------------------------------------------------------------------
 
+// XEP-0402 bookmarks, one item per room on our own pep node
+class PEPBookmarkTask : public Task {
+public:
+    PEPBookmarkTask(Task *parent) : Task(parent) { }
+
+    void get()
+    {
+        iq_ = createIQ(doc(), "get", "", id());
+
+        QDomElement pubsub = doc()->createElementNS("http://jabber.org/protocol/pubsub", "pubsub");
+        iq_.appendChild(pubsub);
+
+        QDomElement items = doc()->createElement("items");
+        items.setAttribute("node", PEP_BOOKMARKS_NS);
+        pubsub.appendChild(items);
+    }
+
+    void publish(const ConferenceBookmark &c)
+    {
+        conferences_ = QList<ConferenceBookmark>() << c;
+        jid_         = c.jid();
+
+        iq_ = createIQ(doc(), "set", "", id());
+
+        QDomElement pubsub = doc()->createElementNS("http://jabber.org/protocol/pubsub", "pubsub");
+        iq_.appendChild(pubsub);
+
+        QDomElement publish = doc()->createElement("publish");
+        publish.setAttribute("node", PEP_BOOKMARKS_NS);
+        pubsub.appendChild(publish);
+
+        QDomElement item = doc()->createElement("item");
+        item.setAttribute("id", c.jid().bare());
+        item.appendChild(c.toPepXml(*doc()));
+        publish.appendChild(item);
+
+        // the node keeps all the rooms and only we may read it
+        QDomElement options = doc()->createElement("publish-options");
+        QDomElement x       = doc()->createElementNS("jabber:x:data", "x");
+        x.setAttribute("type", "submit");
+        auto addField = [this, &x](const QString &var, const QString &value, bool hidden = false) {
+            QDomElement field = doc()->createElement("field");
+            field.setAttribute("var", var);
+            if (hidden)
+                field.setAttribute("type", "hidden");
+            field.appendChild(textTag(doc(), "value", value));
+            x.appendChild(field);
+        };
+        addField("FORM_TYPE", "http://jabber.org/protocol/pubsub#publish-options", true);
+        addField("pubsub#persist_items", "true");
+        addField("pubsub#max_items", "max");
+        addField("pubsub#send_last_published_item", "never");
+        addField("pubsub#access_model", "whitelist");
+        options.appendChild(x);
+        pubsub.appendChild(options);
+    }
+
+    void retract(const XMPP::Jid &jid)
+    {
+        jid_ = jid;
+
+        iq_ = createIQ(doc(), "set", "", id());
+
+        QDomElement pubsub = doc()->createElementNS("http://jabber.org/protocol/pubsub", "pubsub");
+        iq_.appendChild(pubsub);
+
+        QDomElement retract = doc()->createElement("retract");
+        retract.setAttribute("node", PEP_BOOKMARKS_NS);
+        retract.setAttribute("notify", "true");
+        pubsub.appendChild(retract);
+
+        QDomElement item = doc()->createElement("item");
+        item.setAttribute("id", jid.bare());
+        retract.appendChild(item);
+    }
+
+    void onGo() { send(iq_); }
+
+    bool take(const QDomElement &x)
+    {
+        if (!iqVerify(x, "", id()))
+            return false;
+
+        if (x.attribute("type") == "result") {
+            QDomElement items = x.firstChildElement("pubsub").firstChildElement("items");
+            // a result to a publish has no items, so what we sent stays
+            if (!items.isNull())
+                conferences_.clear();
+            for (QDomElement i = items.firstChildElement("item"); !i.isNull(); i = i.nextSiblingElement("item")) {
+                QDomElement c = i.firstChildElement(PEP_BOOKMARKS_TN);
+                XMPP::Jid   j(i.attribute("id"));
+                if (!c.isNull() && c.namespaceURI() == PEP_BOOKMARKS_NS && j.isValid())
+                    conferences_ += ConferenceBookmark(j, c);
+            }
+            setSuccess();
+        } else {
+            setError(x);
+        }
+        return true;
+    }
+
+    const XMPP::Jid &jid() const { return jid_; }
+
+    const QList<ConferenceBookmark> &conferences() const { return conferences_; }
+
+private:
+    QDomElement               iq_;
+    XMPP::Jid                 jid_;
+    QList<ConferenceBookmark> conferences_;
+};
+
+// -----------------------------------------------------------------------------
+
 BookmarkManager::BookmarkManager(PsiAccount *account) : account_(account), accountAvailable_(false), isAvailable_(false)
 {
     connect(account_, SIGNAL(updatedActivity()), SLOT(accountStateChanged()));
+    connect(account_, SIGNAL(disconnected()), SLOT(accountDisconnected()));
+    connect(account_->pepManager(), &PEPManager::itemPublished, this, &BookmarkManager::pepItemPublished);
+    connect(account_->pepManager(), &PEPManager::itemRetracted, this, &BookmarkManager::pepItemRetracted);
 }
 
 bool BookmarkManager::isAvailable() const { return isAvailable_; }
@@ -135,6 +254,10 @@ void BookmarkManager::addConference(const ConferenceBookmark &newb)
     auto it = std::find_if(conferences_.begin(), conferences_.end(),
                            [newb](auto const &c) { return newb.jid().compare(c.jid(), false); });
     if (it == conferences_.end()) {
+        if (pep_) {
+            publishConference(newb);
+            return;
+        }
         auto copy = conferences_;
         copy.append(newb);
         setBookmarks(copy);
@@ -143,7 +266,10 @@ void BookmarkManager::addConference(const ConferenceBookmark &newb)
 
 void BookmarkManager::removeConference(const XMPP::Jid &j)
 {
-    if (isAvailable_) {
+    if (isAvailable_ && pep_) {
+        if (indexOfConference(j) >= 0)
+            retractConference(j);
+    } else if (isAvailable_) {
         QList<ConferenceBookmark> confs;
         for (const ConferenceBookmark &c : qAsConst(conferences_)) {
             if (!c.jid().compare(j, false)) {
@@ -183,27 +309,71 @@ QString BookmarkManager::conferenceName(const Jid &j) const
 
 void BookmarkManager::accountStateChanged()
 {
-    if (!account_->isAvailable()) {
+    // prefetched bookmarks stay while the account is still logging in
+    if (!account_->isAvailable() && accountAvailable_) {
         setIsAvailable(false);
+        fetched_ = false;
     }
 
     if (account_->isAvailable() && !accountAvailable_) {
-        getBookmarks();
+        prefetch();
     }
 
     accountAvailable_ = account_->isAvailable();
 }
 
+void BookmarkManager::accountDisconnected()
+{
+    setIsAvailable(false);
+    fetched_  = false;
+    fetching_ = 0; // whatever is still running is stale
+}
+
+void BookmarkManager::prefetch()
+{
+    if (!fetched_) {
+        fetched_ = true;
+        getBookmarks();
+    }
+}
+
 void BookmarkManager::getBookmarks()
 {
+    // asking for both at once costs no extra round trip when the pep node isn't there
+    fetching_      = 2;
+    legacyFetched_ = false;
+    pepFetched_    = false;
+
     BookmarkTask *t = new BookmarkTask(account_->client()->rootTask());
     connect(t, SIGNAL(finished()), SLOT(getBookmarks_finished()));
     t->get();
     t->go(true);
+
+    PEPBookmarkTask *p = new PEPBookmarkTask(account_->client()->rootTask());
+    connect(p, SIGNAL(finished()), SLOT(getPepBookmarks_finished()));
+    p->get();
+    p->go(true);
 }
 
 void BookmarkManager::setBookmarks(const QList<URLBookmark> &urls, const QList<ConferenceBookmark> &conferences)
 {
+    if (pep_) {
+        // only what changed goes to the pep node, private storage keeps the urls for everybody
+        for (const ConferenceBookmark &c : conferences) {
+            int i = indexOfConference(c.jid());
+            if (i < 0 || !(conferences_[i] == c))
+                publishConference(c);
+        }
+        for (const ConferenceBookmark &c : qAsConst(conferences_)) {
+            auto it = std::find_if(conferences.begin(), conferences.end(),
+                                   [&c](auto const &n) { return n.jid().compare(c.jid(), false); });
+            if (it == conferences.end())
+                retractConference(c.jid());
+        }
+        if (urls == urls_)
+            return;
+    }
+
     BookmarkTask *t = new BookmarkTask(account_->client()->rootTask());
     connect(t, SIGNAL(finished()), SLOT(setBookmarks_finished()));
     t->set(urls, conferences);
@@ -217,29 +387,43 @@ void BookmarkManager::setBookmarks(const QList<ConferenceBookmark> &conferences)
 void BookmarkManager::getBookmarks_finished()
 {
     BookmarkTask *t = static_cast<BookmarkTask *>(sender());
-    if (t->success()) {
-        bool urlsWereChanged        = urls_ != t->urls();
-        bool conferencesWereChanged = conferences_ != t->conferences();
-        urls_                       = t->urls();
-        QStringList   localMucs     = account_->localMucBookmarks();
-        QStringList   mucIgnore     = account_->ignoreMucBookmarks();
-        QSet<QString> strippedMucs;
-        for (const QString &m : localMucs) {
-            Jid j(m);
-            if (j.isValid()) {
-                strippedMucs.insert(j.bare());
-            }
-        }
+    if (fetching_ == 0)
+        return;
+    legacyFetched_ = t->success();
+    if (legacyFetched_) {
+        fetchedUrls_        = t->urls();
+        fetchedConferences_ = t->conferences();
+    }
+    if (--fetching_ == 0)
+        fetchFinished();
+}
 
-        conferences_ = t->conferences();
-        for (auto &muc : conferences_) {
-            if (strippedMucs.contains(muc.jid().bare())) {
-                muc.setAutoJoin(ConferenceBookmark::OnlyThisComputer);
-            }
-            if (mucIgnore.contains(muc.jid().bare())) {
-                muc.setAutoJoin(ConferenceBookmark::ExceptThisComputer);
-            }
-        }
+void BookmarkManager::getPepBookmarks_finished()
+{
+    PEPBookmarkTask *t = static_cast<PEPBookmarkTask *>(sender());
+    if (fetching_ == 0)
+        return;
+    // an error, item-not-found usually, means the server doesn't keep bookmarks there
+    pepFetched_ = t->success();
+    if (pepFetched_)
+        fetchedPepConferences_ = t->conferences();
+    if (--fetching_ == 0)
+        fetchFinished();
+}
+
+void BookmarkManager::fetchFinished()
+{
+    if (legacyFetched_ || pepFetched_) {
+        // fetchedUrls_ stays empty when private storage failed
+        pep_                 = pepFetched_;
+        bool urlsWereChanged = urls_ != fetchedUrls_;
+        urls_                = fetchedUrls_;
+
+        QList<ConferenceBookmark> conferences = pep_ ? fetchedPepConferences_ : fetchedConferences_;
+        for (auto &muc : conferences)
+            applyLocalJoin(muc);
+        bool conferencesWereChanged = conferences_ != conferences;
+        conferences_                = conferences;
 
         if (urlsWereChanged)
             emit urlsChanged(urls_);
@@ -250,6 +434,122 @@ void BookmarkManager::getBookmarks_finished()
     } else {
         setIsAvailable(false);
     }
+    fetchedUrls_.clear();
+    fetchedConferences_.clear();
+    fetchedPepConferences_.clear();
+    emit fetched();
+}
+
+// the join types private to this computer are kept in the account, the server knows only autojoin
+void BookmarkManager::applyLocalJoin(ConferenceBookmark &muc) const
+{
+    const QStringList &localMucs = account_->localMucBookmarks();
+    for (const QString &m : localMucs) {
+        Jid j(m);
+        if (j.isValid() && j.bare() == muc.jid().bare()) {
+            muc.setAutoJoin(ConferenceBookmark::OnlyThisComputer);
+            break;
+        }
+    }
+    if (account_->ignoreMucBookmarks().contains(muc.jid().bare()))
+        muc.setAutoJoin(ConferenceBookmark::ExceptThisComputer);
+}
+
+void BookmarkManager::storeLocalJoin(const Jid &room, ConferenceBookmark::JoinType type, const QString &nick)
+{
+    QStringList localMucs;
+    const auto &oldLocal = account_->localMucBookmarks();
+    for (const QString &m : oldLocal) {
+        if (Jid(m).bare() != room.bare())
+            localMucs += m;
+    }
+    QStringList ignoreMucs = account_->ignoreMucBookmarks();
+    ignoreMucs.removeAll(room.bare());
+
+    if (type == ConferenceBookmark::OnlyThisComputer)
+        localMucs.append(room.withResource(nick).full());
+    if (type == ConferenceBookmark::ExceptThisComputer)
+        ignoreMucs.append(room.bare());
+
+    account_->setLocalMucBookmarks(localMucs);
+    account_->setIgnoreMucBookmarks(ignoreMucs);
+}
+
+void BookmarkManager::publishConference(const ConferenceBookmark &c)
+{
+    PEPBookmarkTask *t = new PEPBookmarkTask(account_->client()->rootTask());
+    connect(t, SIGNAL(finished()), SLOT(publishConference_finished()));
+    t->publish(c);
+    t->go(true);
+}
+
+void BookmarkManager::retractConference(const Jid &j)
+{
+    PEPBookmarkTask *t = new PEPBookmarkTask(account_->client()->rootTask());
+    connect(t, SIGNAL(finished()), SLOT(retractConference_finished()));
+    t->retract(j);
+    t->go(true);
+}
+
+void BookmarkManager::publishConference_finished()
+{
+    PEPBookmarkTask *t = static_cast<PEPBookmarkTask *>(sender());
+    if (t->success() && !t->conferences().isEmpty()) {
+        const ConferenceBookmark &c = t->conferences().first();
+        storeLocalJoin(c.jid(), c.autoJoin(), c.nick());
+        conferenceStored(c);
+        emit bookmarksSaved();
+    }
+}
+
+void BookmarkManager::retractConference_finished()
+{
+    PEPBookmarkTask *t = static_cast<PEPBookmarkTask *>(sender());
+    if (t->success()) {
+        storeLocalJoin(t->jid(), ConferenceBookmark::Never);
+        conferenceRemoved(t->jid());
+        emit bookmarksSaved();
+    }
+}
+
+void BookmarkManager::conferenceStored(const ConferenceBookmark &c)
+{
+    int i = indexOfConference(c.jid());
+    if (i >= 0 && conferences_[i] == c)
+        return;
+    if (i >= 0)
+        conferences_[i] = c;
+    else
+        conferences_ += c;
+    emit conferencesChanged(conferences_);
+}
+
+void BookmarkManager::conferenceRemoved(const Jid &j)
+{
+    int i = indexOfConference(j);
+    if (i < 0)
+        return;
+    conferences_.removeAt(i);
+    emit conferencesChanged(conferences_);
+}
+
+// changes made by our other clients, and the echo of our own
+void BookmarkManager::pepItemPublished(const Jid &j, const QString &n, const PubSubItem &item)
+{
+    if (!pep_ || !isAvailable_ || n != PEP_BOOKMARKS_NS || !j.compare(account_->jid(), false))
+        return;
+    ConferenceBookmark c(Jid(item.id()), item.payload());
+    if (!c.jid().isValid())
+        return;
+    applyLocalJoin(c);
+    conferenceStored(c);
+}
+
+void BookmarkManager::pepItemRetracted(const Jid &j, const QString &n, const PubSubRetraction &item)
+{
+    if (!pep_ || !isAvailable_ || n != PEP_BOOKMARKS_NS || !j.compare(account_->jid(), false))
+        return;
+    conferenceRemoved(Jid(item.id()));
 }
 
 void BookmarkManager::setBookmarks_finished()
@@ -28,6 +28,11 @@
 
 class PsiAccount;
 
+namespace XMPP {
+class PubSubItem;
+class PubSubRetraction;
+}
+
 class BookmarkManager : public QObject {
     Q_OBJECT
 
@@ -48,27 +53,54 @@ public:
     void addConference(const ConferenceBookmark &newb);
     void removeConference(const XMPP::Jid &);
 
+    // fetches the bookmarks while the account is still logging in, instead of once it is available
+    void prefetch();
+
 signals:
     void availabilityChanged();
     void urlsChanged(const QList<URLBookmark> &);
     void conferencesChanged(const QList<ConferenceBookmark> &);
     void bookmarksSaved();
+    void fetched(); // successful or not
 
 private slots:
     void getBookmarks_finished();
+    void getPepBookmarks_finished();
     void setBookmarks_finished();
+    void publishConference_finished();
+    void retractConference_finished();
+    void pepItemPublished(const XMPP::Jid &, const QString &, const XMPP::PubSubItem &);
+    void pepItemRetracted(const XMPP::Jid &, const QString &, const XMPP::PubSubRetraction &);
     void accountStateChanged();
+    void accountDisconnected();
 
 private:
     void getBookmarks();
+    void fetchFinished();
     void setIsAvailable(bool available);
+    void applyLocalJoin(ConferenceBookmark &) const;
+    void storeLocalJoin(const XMPP::Jid &room, ConferenceBookmark::JoinType, const QString &nick = QString());
+    void publishConference(const ConferenceBookmark &);
+    void retractConference(const XMPP::Jid &);
+    void conferenceStored(const ConferenceBookmark &);
+    void conferenceRemoved(const XMPP::Jid &);
 
 private:
     PsiAccount *              account_;
     bool                      accountAvailable_;
     bool                      isAvailable_;
+    bool                      fetched_ = false; // asked for since the account connected
     QList<URLBookmark>        urls_;
     QList<ConferenceBookmark> conferences_;
+
+    // XEP-0402, one pep item per room. private storage is still used for the urls,
+    // and for everything on servers without the bookmarks node
+    bool                      pep_           = false;
+    int                       fetching_      = 0; // gets still running, legacy and pep go in parallel
+    bool                      legacyFetched_ = false;
+    bool                      pepFetched_    = false;
+    QList<URLBookmark>        fetchedUrls_;
+    QList<ConferenceBookmark> fetchedConferences_, fetchedPepConferences_;
 };
 
 #endif // BOOKMARKMANAGER_H
@@ -42,6 +42,7 @@ ByteArrayReply::ByteArrayReply(const QNetworkRequest &request, const QByteArray
             setHeader(QNetworkRequest::ContentTypeHeader, mimeType);
         }
         setHeader(QNetworkRequest::ContentLengthHeader, QByteArray::number(origLen));
+        setRawHeader("ETag", '"' + QByteArray::number(qHash(ba), 16) + '"');
         QTimer::singleShot(0, this, SIGNAL(metaDataChanged()));
         QTimer::singleShot(0, this, SIGNAL(readyRead()));
     }
@@ -21,6 +21,8 @@
 
 #include "accountlabel.h"
 #include "avatars.h"
+#include "chathistoryprefetch.h"
+#include "chatstatesender.h"
 #include "chatview.h"
 #include "eventdb.h"
 #include "fancylabel.h"
@@ -31,6 +33,7 @@
 #include "iconselect.h"
 #include "iconwidget.h"
 #include "jidutil.h"
+#include "mamsync.h"
 #include "msgmle.h"
 #include "pgputil.h"
 #ifdef PSI_PLUGINS
@@ -128,6 +131,7 @@ ChatDlg::ChatDlg(const Jid &jid, PsiAccount *pa, TabManager *tabManager) :
     }
     lastChatState_       = XMPP::StateNone;
     sendComposingEvents_ = false;
+    contactAvailable_    = false;
     isComposing_         = false;
     composingTimer_      = nullptr;
     updateRealJid();
@@ -170,6 +174,9 @@ void ChatDlg::init()
     connect(account(), SIGNAL(encryptedMessageSent(int, bool, int, const QString &)),
             SLOT(encryptedMessageSent(int, bool, int, const QString &)));
     account()->dialogRegister(this, jid());
+    // messages seen by other clients are in the history the next time it is loaded
+    if (account()->mamSync() && !account()->findGCContact(jid()))
+        account()->mamSync()->sync(jid());
 
     chatView()->setFocusPolicy(Qt::NoFocus);
     chatEdit()->setFocus();
@@ -178,6 +185,9 @@ void ChatDlg::init()
 ChatDlg::~ChatDlg()
 {
     delete delayedMessages;
+    // likely opened again soon
+    if (account()->historyPrefetch())
+        account()->historyPrefetch()->prefetch(jid());
     account()->dialogUnregister(this);
 }
 
@@ -425,12 +435,21 @@ void ChatDlg::preloadHistory()
         holdMessages(true);
         if (cnt > 100) // This is limit, just in case.
             cnt = 100;
-        EDBHandle *h = new EDBHandle(account()->edb());
-        connect(h, SIGNAL(finished()), this, SLOT(getHistory()));
         Jid j = jid();
         if (!account()->findGCContact(j))
             j = jid().bare();
         int start = account()->eventQueue()->count(jid(), false);
+
+        // prefetched when the contact was hovered, had unread events or was closed recently.
+        // the view isn't set up yet, the page is shown on the first event loop pass
+        EDBResult r;
+        if (account()->historyPrefetch()->take(j, start, cnt, &r)) {
+            QTimer::singleShot(0, this, [this, r]() { appendHistory(r); });
+            return;
+        }
+
+        EDBHandle *h = new EDBHandle(account()->edb());
+        connect(h, SIGNAL(finished()), this, SLOT(getHistory()));
         h->get(account()->id(), j, QDateTime(), EDB::Backward, start, cnt);
     }
 }
@@ -441,8 +460,13 @@ void ChatDlg::getHistory()
     if (!h)
         return;
 
-    historyState       = true;
-    const EDBResult &r = h->result();
+    appendHistory(h->result());
+    delete h;
+}
+
+void ChatDlg::appendHistory(const EDBResult &r)
+{
+    historyState = true;
     for (int i = r.count() - 1; i >= 0; --i) {
         const EDBItemPtr &item = r.at(i);
         PsiEvent::Ptr     e    = item->event();
@@ -451,7 +475,6 @@ void ChatDlg::getHistory()
             appendMessage(me->message(), me->originLocal());
         }
     }
-    delete h;
     holdMessages(false);
 }
 
@@ -478,6 +501,8 @@ void ChatDlg::updateContact(const Jid &j, bool fromPresence)
 
     if (jid().compare(j, false)) {
         QList<UserListItem *> ul = account()->findRelevant(j);
+        // what setChatState() sends to
+        contactAvailable_ = !ul.isEmpty() && ul.first()->isAvailable();
         if (ul.isEmpty()) {
             qWarning("Trying to update not existing contact");
             return;
@@ -728,8 +753,10 @@ void ChatDlg::doSend()
         m.setChatState(XMPP::StateActive);
     }
 
-    // Update current state
+    // Update current state, the message itself tells it
     setChatState(XMPP::StateActive);
+    if (account()->chatStates())
+        account()->chatStates()->carried(m);
 
     if (isPgpEncryptionEnabled()) {
         chatEdit()->setEnabled(false);
@@ -975,6 +1002,9 @@ void ChatDlg::displayMessage(const MessageView &mv)
     // else {
     //    messagesRead(jid());
     //}
+    // read as it arrives
+    if (type == MessageView::Message && !mv.isLocal() && !mv.isSpooled() && isActiveTab())
+        account()->chatDisplayed(jid());
 
     if (!mv.isLocal()) {
         keepOpen_ = true;
@@ -986,26 +1016,20 @@ void ChatDlg::updateIsComposing(bool b) { setChatState(b ? XMPP::StateComposing
 
 void ChatDlg::setChatState(ChatState state)
 {
-    if (PsiOptions::instance()->getOption("options.messages.send-composing-events").toBool()
-        && (sendComposingEvents_ || (contactChatState_ != XMPP::StateNone))) {
-        // Don't send to offline resource
-        QList<UserListItem *> ul = account()->findRelevant(jid());
-        if (ul.isEmpty()) {
-            sendComposingEvents_ = false;
-            lastChatState_       = XMPP::StateNone;
-            return;
-        }
+    static const auto sendComposing  = PsiOptions::handle<bool>("options.messages.send-composing-events");
+    static const auto sendInactivity = PsiOptions::handle<bool>("options.messages.send-inactivity-events");
+    static const auto dontSend       = PsiOptions::handle<bool>("options.messages.dont-send-composing-events");
 
-        UserListItem *u = ul.first();
-        if (!u->isAvailable()) {
+    if (sendComposing.value() && (sendComposingEvents_ || (contactChatState_ != XMPP::StateNone))) {
+        // Don't send to offline resource
+        if (!contactAvailable_) {
             sendComposingEvents_ = false;
             lastChatState_       = XMPP::StateNone;
             return;
         }
 
         // Transform to more privacy-enabled chat states if necessary
-        if (!PsiOptions::instance()->getOption("options.messages.send-inactivity-events").toBool()
-            && (state == XMPP::StateGone || state == XMPP::StateInactive)) {
+        if (!sendInactivity.value() && (state == XMPP::StateGone || state == XMPP::StateInactive)) {
             state = XMPP::StatePaused;
         }
 
@@ -1026,8 +1050,9 @@ void ChatDlg::setChatState(ChatState state)
             return;
         }
 
-        // Build event message
-        if (!PsiOptions::instance()->getOption("options.messages.dont-send-composing-events").toBool()) {
+        // Build event message. the receiver only keeps the latest state, so inactive <-> composing
+        // goes without the paused one in between
+        if (!dontSend.value()) {
             Message m(jid());
             if (sendComposingEvents_) {
                 m.setEventId(eventId_);
@@ -1038,24 +1063,14 @@ void ChatDlg::setChatState(ChatState state)
                 }
             }
             if (contactChatState_ != XMPP::StateNone) {
-                if ((state == XMPP::StateInactive && lastChatState_ == XMPP::StateComposing)
-                    || (state == XMPP::StateComposing && lastChatState_ == XMPP::StateInactive)) {
-                    // First go to the paused state
-                    Message tm(jid());
-                    m.setType("chat");
-                    m.setChatState(XMPP::StatePaused);
-                    if (account()->isAvailable()) {
-                        account()->dj_sendMessage(m, false);
-                    }
-                }
                 m.setChatState(state);
             }
 
             // Send event message
             if (m.containsEvents() || m.chatState() != XMPP::StateNone) {
                 m.setType("chat");
-                if (account()->isAvailable()) {
-                    account()->dj_sendMessage(m, false);
+                if (account()->isAvailable() && account()->chatStates()) {
+                    account()->chatStates()->send(m);
                 }
             }
         }
@@ -21,6 +21,7 @@
 #define CHATDLG_H
 
 #include "advwidget.h"
+#include "eventdb.h"
 #include "messageview.h"
 #include "tabbablewidget.h"
 
@@ -158,6 +159,7 @@ protected:
     void         resetComposing();
     void         doneSend();
     void         holdMessages(bool hold);
+    void         appendHistory(const EDBResult &r);
     void         displayMessage(const MessageView &mv);
     virtual void setLooks();
     virtual void chatEditCreated();
@@ -211,6 +213,7 @@ private:
     QTimer *            composingTimer_;
     bool                isComposing_;
     bool                sendComposingEvents_;
+    bool                contactAvailable_; // the first relevant contact is, see updateContact()
     bool                historyState;
     QString             eventId_;
     ChatState           contactChatState_;
@@ -33,7 +33,7 @@ ChatEditProxy::ChatEditProxy(QWidget *parent) :
     layout_->setMargin(0);
     layout_->setSpacing(0);
 
-    connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, &ChatEditProxy::optionsChanged);
+    PsiOptions::watch(expandingLineEdit, this, [this](const QString &option) { optionsChanged(option); });
     optionsChanged(expandingLineEdit);
 }
 
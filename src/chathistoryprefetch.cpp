@@ -0,0 +1,170 @@
+/*
+ * chathistoryprefetch.cpp - first history pages of chats likely to be opened next
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "chathistoryprefetch.h"
+
+#include "avatars.h"
+#include "eventqueue.h"
+#include "memorytrimmer.h"
+#include "psiaccount.h"
+#include "psioptions.h"
+
+#include <QTimer>
+
+// history items kept for all prefetched chats of an account
+#define HISTORY_PREFETCH_CACHE 2000
+// requests waiting for the database, older ones are dropped
+#define HISTORY_PREFETCH_QUEUE 8
+// quiet time before loading, milliseconds
+#define HISTORY_PREFETCH_DELAY 250
+// same limit as ChatDlg::preloadHistory()
+#define HISTORY_PREFETCH_MAX_PAGE 100
+// rough size of a history item
+#define HISTORY_PREFETCH_ITEM_BYTES 1024
+
+ChatHistoryPrefetch::ChatHistoryPrefetch(PsiAccount *account) :
+    QObject(account), account_(account), cache_(HISTORY_PREFETCH_CACHE)
+{
+    timer_ = new QTimer(this);
+    timer_->setSingleShot(true);
+    timer_->setInterval(HISTORY_PREFETCH_DELAY);
+    connect(timer_, &QTimer::timeout, this, &ChatHistoryPrefetch::startNext);
+
+    if (account_->edb())
+        connect(account_->edb(), &EDB::erasing, this, &ChatHistoryPrefetch::edb_erasing);
+
+    // nothing is about to be opened while the user is away
+    MemoryTrimmer::instance()->add(
+        this, [this]() { return qint64(cache_.totalCost()) * HISTORY_PREFETCH_ITEM_BYTES; },
+        [this](MemoryTrimmer::Level) { cache_.clear(); });
+}
+
+ChatHistoryPrefetch::~ChatHistoryPrefetch() { delete handle_; }
+
+XMPP::Jid ChatHistoryPrefetch::historyJid(const XMPP::Jid &jid) const
+{
+    // as ChatDlg keys its history
+    return account_->findGCContact(jid) ? jid : jid.bare();
+}
+
+int ChatHistoryPrefetch::pageSize() const
+{
+    static const auto preloadSize = PsiOptions::handle<int>("options.ui.chat.history.preload-history-size");
+    return qMin(preloadSize.value(), HISTORY_PREFETCH_MAX_PAGE);
+}
+
+void ChatHistoryPrefetch::prefetch(const XMPP::Jid &jid)
+{
+    if (!account_->edb() || !account_->userAccount().opt_log || pageSize() <= 0 || jid.isEmpty())
+        return;
+
+    const XMPP::Jid hj  = historyJid(jid);
+    const QString   key = hj.full();
+    if (Page *p = cache_.object(key)) {
+        // still right unless events were queued or read since
+        if (p->start == account_->eventQueue()->count(hj, false) && p->count == pageSize())
+            return;
+        cache_.remove(key);
+    }
+    if (key == handleKey_ && !handleStale_)
+        return;
+
+    if (queued_.contains(key)) {
+        for (int n = 0; n < queue_.size(); ++n) {
+            if (queue_[n].full() == key) {
+                queue_.removeAt(n);
+                break;
+            }
+        }
+    }
+    queued_.insert(key);
+    queue_ += hj;
+    if (queue_.size() > HISTORY_PREFETCH_QUEUE)
+        queued_.remove(queue_.takeFirst().full());
+
+    if (!handle_)
+        timer_->start();
+}
+
+bool ChatHistoryPrefetch::take(const XMPP::Jid &jid, int start, int count, EDBResult *result)
+{
+    const QString key = historyJid(jid).full();
+    Page *        p   = cache_.object(key);
+    if (!p || p->start != start || p->count != count)
+        return false;
+    *result = p->result;
+    cache_.remove(key);
+    return true;
+}
+
+void ChatHistoryPrefetch::invalidate(const XMPP::Jid &jid)
+{
+    const QString key = historyJid(jid).full();
+    cache_.remove(key);
+    if (key == handleKey_)
+        handleStale_ = true;
+}
+
+void ChatHistoryPrefetch::startNext()
+{
+    while (!handle_ && !queue_.isEmpty()) {
+        // the latest hover is the most likely to be clicked
+        const XMPP::Jid hj = queue_.takeLast();
+        queued_.remove(hj.full());
+        // an open chat has its history already
+        if (account_->findChatDialogEx(hj, true))
+            continue;
+
+        if (!account_->findGCContact(hj))
+            account_->avatarFactory()->getAvatar(hj);
+
+        handleKey_   = hj.full();
+        handleStale_ = false;
+        handlePage_  = { account_->eventQueue()->count(hj, false), pageSize(), EDBResult() };
+        handle_      = new EDBHandle(account_->edb());
+        connect(handle_, &EDBHandle::finished, this, &ChatHistoryPrefetch::edb_finished);
+        handle_->get(account_->id(), hj, QDateTime(), EDB::Backward, handlePage_.start, handlePage_.count);
+    }
+}
+
+void ChatHistoryPrefetch::edb_finished()
+{
+    if (!handleStale_) {
+        handlePage_.result = handle_->result();
+        cache_.insert(handleKey_, new Page(handlePage_), qMax(1, handlePage_.result.count()));
+    }
+    handle_->deleteLater();
+    handle_ = nullptr;
+    handleKey_.clear();
+    handlePage_.result.clear();
+
+    if (!queue_.isEmpty())
+        timer_->start();
+}
+
+void ChatHistoryPrefetch::edb_erasing(const QString &accId, const XMPP::Jid &jid)
+{
+    if (!accId.isEmpty() && accId != account_->id())
+        return;
+    if (jid.isEmpty()) {
+        cache_.clear();
+        handleStale_ = true;
+    } else
+        invalidate(jid);
+}
@@ -0,0 +1,75 @@
+/*
+ * chathistoryprefetch.h - first history pages of chats likely to be opened next
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CHATHISTORYPREFETCH_H
+#define CHATHISTORYPREFETCH_H
+
+#include "eventdb.h"
+
+#include <QCache>
+#include <QObject>
+#include <QSet>
+
+class EDBHandle;
+class PsiAccount;
+class QTimer;
+
+// Loads the history page ChatDlg preloads for contacts the user is about to open
+// (hovered in the roster, with unread events, recently closed), and warms their avatars.
+// A chat opened with its page ready shows the history without waiting for the database
+class ChatHistoryPrefetch : public QObject {
+    Q_OBJECT
+public:
+    ChatHistoryPrefetch(PsiAccount *account);
+    ~ChatHistoryPrefetch();
+
+    // loaded after a short delay, so sweeping the mouse over the roster costs nothing
+    void prefetch(const XMPP::Jid &jid);
+    // moves the page out of the cache if it was loaded for this position in the history
+    bool take(const XMPP::Jid &jid, int start, int count, EDBResult *result);
+    // the history of the chat changed, its page is loaded again on the next request
+    void invalidate(const XMPP::Jid &jid);
+
+private slots:
+    void startNext();
+    void edb_finished();
+    void edb_erasing(const QString &accId, const XMPP::Jid &jid);
+
+private:
+    struct Page {
+        int       start;
+        int       count;
+        EDBResult result;
+    };
+
+    XMPP::Jid historyJid(const XMPP::Jid &jid) const;
+    int       pageSize() const;
+
+    PsiAccount *          account_;
+    QCache<QString, Page> cache_; // history jid -> page, cost is the number of items
+    QList<XMPP::Jid>      queue_; // newest request last
+    QSet<QString>         queued_;
+    QTimer *              timer_;
+    EDBHandle *           handle_ = nullptr;
+    QString               handleKey_;
+    Page                  handlePage_;
+    bool                  handleStale_ = false; // written to while loading
+};
+
+#endif // CHATHISTORYPREFETCH_H
@@ -32,7 +32,7 @@
 ChatSplitter::ChatSplitter(QWidget *parent) :
     QWidget(parent), splitterEnabled_(true), splitter_(nullptr), layout_(nullptr)
 {
-    connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString &)), SLOT(optionsChanged()));
+    PsiOptions::watch("options.ui.chat.use-expanding-line-edit", this, [this](const QString &) { optionsChanged(); });
     optionsChanged();
 
     if (!layout_)
@@ -0,0 +1,81 @@
+/*
+ * chatstatesender.cpp - coalesces outgoing chat states
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "chatstatesender.h"
+
+#include "psiaccount.h"
+#include "xmpp_client.h"
+
+#include <QTimer>
+
+// how long a chat state waits for the next one, milliseconds
+#define CHAT_STATE_DELAY 300
+
+using namespace XMPP;
+
+ChatStateSender::ChatStateSender(PsiAccount *account) : QObject(account), account_(account)
+{
+    timer_ = new QTimer(this);
+    timer_->setSingleShot(true);
+    timer_->setInterval(CHAT_STATE_DELAY);
+    connect(timer_, &QTimer::timeout, this, &ChatStateSender::flush);
+}
+
+void ChatStateSender::send(const Message &m)
+{
+    pending_.insert(m.to().full(), m);
+    if (!timer_->isActive())
+        timer_->start();
+}
+
+void ChatStateSender::carried(const Message &m)
+{
+    if (m.chatState() == StateNone)
+        return;
+    pending_.remove(m.to().full());
+    lastSent_.insert(m.to().full(), m.chatState());
+}
+
+void ChatStateSender::clear()
+{
+    timer_->stop();
+    pending_.clear();
+    lastSent_.clear();
+}
+
+void ChatStateSender::flush()
+{
+    if (!account_->isAvailable()) {
+        clear();
+        return;
+    }
+
+    const QHash<QString, Message> pending = pending_;
+    pending_.clear();
+    for (auto it = pending.constBegin(); it != pending.constEnd(); ++it) {
+        Message m = it.value();
+        if (!m.containsEvents()) {
+            if (m.chatState() == StateNone || lastSent_.value(it.key(), StateNone) == m.chatState())
+                continue;
+        }
+        if (m.chatState() != StateNone)
+            lastSent_.insert(it.key(), m.chatState());
+        account_->client()->sendMessage(m);
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * chatstatesender.h - coalesces outgoing chat states
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CHATSTATESENDER_H
+#define CHATSTATESENDER_H
+
+#include "xmpp_message.h"
+
+#include <QHash>
+#include <QObject>
+
+class PsiAccount;
+class QTimer;
+
+// Sends chat states (XEP-0085) and message events (XEP-0022) of the chat dialogs straight to
+// the client, none of the message hooks care about a message without a body. A state is held
+// back for a moment, so composing/paused flips while typing end up as the last state only,
+// and nothing at all when that is what the contact has already
+class ChatStateSender : public QObject {
+    Q_OBJECT
+public:
+    ChatStateSender(PsiAccount *account);
+
+    // m carries no body, a later one to the same jid before it was sent replaces it
+    void send(const XMPP::Message &m);
+    // m went out as a normal message with its chat state, a queued one to the same jid is void
+    void carried(const XMPP::Message &m);
+    // nothing queued is sent, e.g. after a disconnect
+    void clear();
+
+private:
+    void flush();
+
+    PsiAccount *                    account_;
+    QTimer *                        timer_;
+    QHash<QString, XMPP::Message>   pending_;  // full jid -> message to send
+    QHash<QString, XMPP::ChatState> lastSent_; // full jid -> state the contact knows
+};
+
+#endif // CHATSTATESENDER_H
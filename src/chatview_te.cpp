@@ -21,6 +21,7 @@
 
 #include "coloropt.h"
 #include "common.h"
+#include "debug.h"
 #include "iconset.h"
 #include "messageview.h"
 #include "msgmle.h"
@@ -98,6 +99,8 @@ void ChatView::setSessionData(bool isMuc, bool isMucPrivate, const XMPP::Jid &ji
 void ChatView::clear()
 {
     PsiTextView::clear();
+    markerPos_.clear();
+    markerShift_ = 0;
     addLogIconsResources();
 }
 
@@ -260,6 +263,9 @@ void ChatView::insertText(const QString &text, QTextCursor &insertCursor)
 
     if (insertCursor.isNull()) {
         PsiTextView::appendText(text);
+        // while the user reads older messages, the view is left as is
+        if (doScrollToBottom)
+            trimLog();
     } else {
         PsiTextView::insertText(text, insertCursor);
     }
@@ -276,8 +282,72 @@ void ChatView::appendText(const QString &text)
     insertText(text, c);
 }
 
+// every message is a paragraph, the oldest ones over the limit are dropped
+void ChatView::trimLog()
+{
+    const int max = PsiOptions::instance()->getOption("options.ui.chat.max-log-messages").toInt();
+    if (max <= 0 || document()->blockCount() <= max)
+        return;
+
+    QTextCursor cursor(document());
+    cursor.movePosition(QTextCursor::NextBlock, QTextCursor::KeepAnchor, document()->blockCount() - max);
+    const int removed = cursor.selectionEnd();
+    for (QTextBlock block = document()->begin(); block.isValid() && block.position() < removed; block = block.next()) {
+        for (auto it = block.begin(); !it.atEnd(); ++it) {
+            const QString id = PsiRichText::markerId(it.fragment().charFormat());
+            if (!id.isEmpty())
+                markerPos_.remove(id);
+        }
+    }
+    cursor.removeSelectedText();
+    markerShift_ += removed;
+    oldTrackBarPosition = oldTrackBarPosition > removed ? oldTrackBarPosition - removed : 0;
+}
+
+// selection on the marker, found by its remembered position. the document is searched if that fails
+QTextCursor ChatView::findMessageMarker(const QString &id) const
+{
+    auto it = markerPos_.constFind(id);
+    if (it != markerPos_.constEnd()) {
+        const int pos = it.value() - markerShift_;
+        if (pos >= 0 && pos + 1 < document()->characterCount()) {
+            QTextCursor cursor(document());
+            cursor.setPosition(pos);
+            cursor.setPosition(pos + 1, QTextCursor::KeepAnchor);
+            if (PsiRichText::markerId(cursor.charFormat()) == id)
+                return cursor;
+        }
+    }
+    return PsiRichText::findMarker(QTextCursor(document()), id);
+}
+
+// a message was corrected, everything after it moved
+void ChatView::shiftMarkers(int after, int delta)
+{
+    if (!delta)
+        return;
+    for (auto it = markerPos_.begin(); it != markerPos_.end(); ++it) {
+        if (it.value() - markerShift_ > after)
+            it.value() += delta;
+    }
+}
+
+// no repaints while a bunch of messages is added
+void ChatView::beginMessageBatch()
+{
+    if (batchDepth_++ == 0)
+        setUpdatesEnabled(false);
+}
+
+void ChatView::endMessageBatch()
+{
+    if (--batchDepth_ == 0)
+        setUpdatesEnabled(true);
+}
+
 void ChatView::dispatchMessage(const MessageView &mv)
 {
+    TRACE_SCOPE("ChatView::dispatchMessage");
     const QString &replaceId = mv.replaceId();
     if ((mv.type() == MessageView::Message || mv.type() == MessageView::Subject)
         && ChatViewCommon::updateLastMsgTime(mv.dateTime()) && replaceId.isEmpty()) {
@@ -294,11 +364,12 @@ void ChatView::dispatchMessage(const MessageView &mv)
         bool        isReplace      = !replaceId.isEmpty();
         QTextCursor cursor         = textCursor(), replaceCursor;
         auto        sel            = PsiRichText::saveSelection(this, cursor);
+        int         replacePos     = 0; // where the corrected message starts
+        int         lengthBefore   = 0;
         cursor.clearSelection();
         setTextCursor(cursor);
         if (isReplace) {
-            cursor.setPosition(0);
-            replaceCursor = PsiRichText::findMarker(cursor, replaceId + "_" + mv.userId());
+            replaceCursor = findMessageMarker(replaceId + "_" + mv.userId());
             isReplace     = !replaceCursor.isNull(); // marker not found
         }
         if (isReplace) {
@@ -314,10 +385,14 @@ void ChatView::dispatchMessage(const MessageView &mv)
                     QTextCursor::KeepAnchor); // returne cursor is a selection of marker. so we need anchor
             }
             // qDebug("text to remove: %s", qPrintable(cursor.selectedText()));
+            markerPos_.remove(replaceId + "_" + mv.userId());
+            replacePos   = cursor.anchor();
+            lengthBefore = document()->characterCount();
         } else {
             cursor.movePosition(QTextCursor::End); // no luck with replace, then insert into the end of doc
         }
         PsiRichText::insertMarker(cursor, mv.messageId() + "_" + mv.userId());
+        markerPos_.insert(mv.messageId() + "_" + mv.userId(), cursor.position() - 1 + markerShift_);
         setTextCursor(cursor); // make sure the message is rendered here and nowhere else
         if (isMuc_) {
             renderMucMessage(mv, cursor);
@@ -332,6 +407,7 @@ void ChatView::dispatchMessage(const MessageView &mv)
             cursor.insertImage(imageFormat);
             // PsiRichText::insertIcon(cursor, QLatin1String("psi/action_templates_edit"), tr("The message was
             // corrected"));
+            shiftMarkers(replacePos, document()->characterCount() - lengthBefore);
         } else {
             // qDebug("end marker at %d", cursor.position());
             PsiRichText::insertMarker(cursor, QString()); // end marker
@@ -340,6 +416,8 @@ void ChatView::dispatchMessage(const MessageView &mv)
         PsiRichText::restoreSelection(this, cursor, sel);
         setTextCursor(cursor);
         if (doScrollBottom) {
+            if (!isReplace)
+                trimLog();
             scrollToBottom();
         } else {
             verticalScrollBar()->setValue(scrollPos);
@@ -370,14 +448,63 @@ QString ChatView::replaceMarker(const MessageView &mv) const
     return "<a name=\"msgid_" + TextUtil::escape(mv.messageId() + "_" + mv.userId()) + "\"> </a>";
 }
 
+// the same anchor as replaceMarker() produces, for text inserted without html
+QTextCharFormat ChatView::markerCharFormat(const MessageView &mv, QTextCharFormat format) const
+{
+    format.setAnchor(true);
+    format.setAnchorNames({ "msgid_" + mv.messageId() + "_" + mv.userId() });
+    return format;
+}
+
+// formatted text without any markup may go to the document as is
+bool ChatView::isPlainBody(const QString &html)
+{
+    for (const QChar &c : html) {
+        if (c == QLatin1Char('<') || c == QLatin1Char('&') || c == QLatin1Char('\n'))
+            return false;
+    }
+    return true;
+}
+
+// puts an already formatted message line into the document, the html parser is not involved
+void ChatView::insertRuns(const QString &icon, const TextRuns &runs, QTextCursor &insertCursor)
+{
+    bool doScrollToBottom = atBottom();
+    int  scrollbarValue   = verticalScrollBar()->value();
+
+    insertCursor.beginEditBlock();
+    if (!insertCursor.atBlockStart()) {
+        insertCursor.insertBlock();
+
+        // clear trackbar for new blocks
+        QTextBlockFormat blockFormat = insertCursor.blockFormat();
+        blockFormat.setTopMargin(0);
+        blockFormat.setBottomMargin(0);
+        blockFormat.clearProperty(QTextFormat::BlockTrailingHorizontalRulerWidth);
+        insertCursor.setBlockFormat(blockFormat);
+    }
+    if (!icon.isEmpty()) {
+        QTextImageFormat imageFormat;
+        imageFormat.setName(icon);
+        insertCursor.insertImage(imageFormat);
+    }
+    for (const auto &run : runs)
+        insertCursor.insertText(run.first, run.second);
+    insertCursor.endEditBlock();
+
+    if (doScrollToBottom)
+        scrollToBottom();
+    else
+        verticalScrollBar()->setValue(scrollbarValue);
+}
+
 void ChatView::renderMucMessage(const MessageView &mv, QTextCursor &insertCursor)
 {
     const QString timestr = formatTimeStamp(mv.dateTime());
     QString       alerttagso, alerttagsc, nickcolor;
     QString       textcolor = palette().color(QPalette::Active, QPalette::Text).name();
-    QString       icon;
+    QString       icon, sRes;
     if (useMessageIcons_) {
-        QString sRes;
         if (mv.isLocal()) {
             if (isEncryptionEnabled_)
                 sRes = "icon:log_icon_delivered_encrypted";
@@ -403,17 +530,43 @@ void ChatView::renderMucMessage(const MessageView &mv, QTextCursor &insertCursor
     } else {
         nickcolor = getMucNickColor(mv.nick(), mv.isLocal());
     }
-    QString nick = QString("<a href=\"addnick://psi/") + QUrl::toPercentEncoding(mv.nick())
-        + "\" style=\"color: " + nickcolor + "; text-decoration: none; \">" + TextUtil::escape(mv.nick()) + "</a>";
+    const bool    saysStyle = PsiOptions::instance()->getOption("options.ui.chat.use-chat-says-style").toBool();
+    const QString body      = mv.formattedText();
+
+    if (isPlainBody(body) && (mv.isEmote() || !saysStyle)) {
+        QTextCharFormat nickFormat;
+        nickFormat.setForeground(QColor(nickcolor));
+        QTextCharFormat linkFormat = nickFormat;
+        linkFormat.setAnchor(true);
+        linkFormat.setAnchorHref(QString("addnick://psi/") + QUrl::toPercentEncoding(mv.nick()));
+        QTextCharFormat textFormat = nickFormat;
+        if (!mv.isEmote())
+            textFormat.setForeground(QColor(textcolor));
+        if (mv.isAlert())
+            textFormat.setFontWeight(QFont::Bold);
+
+        TextRuns runs;
+        if (mv.isEmote()) {
+            runs << qMakePair(QString("[%1] *").arg(timestr), nickFormat) << qMakePair(mv.nick(), linkFormat)
+                 << qMakePair(QString(" "), nickFormat);
+        } else {
+            runs << qMakePair(QString("[%1] <").arg(timestr), nickFormat) << qMakePair(mv.nick(), linkFormat)
+                 << qMakePair(QString(">"), nickFormat) << qMakePair(QString(" "), QTextCharFormat());
+        }
+        runs << qMakePair(body, textFormat) << qMakePair(QString(" "), markerCharFormat(mv, textFormat));
+        insertRuns(sRes, runs, insertCursor);
+    } else {
+        QString nick = QString("<a href=\"addnick://psi/") + QUrl::toPercentEncoding(mv.nick())
+            + "\" style=\"color: " + nickcolor + "; text-decoration: none; \">" + TextUtil::escape(mv.nick())
+            + "</a>";
 
-    QString inner = alerttagso + mv.formattedText() + replaceMarker(mv) + alerttagsc;
+        QString inner = alerttagso + body + replaceMarker(mv) + alerttagsc;
 
-    if (mv.isEmote()) {
-        insertText(icon + QString("<font color=\"%1\">").arg(nickcolor) + QString("[%1]").arg(timestr)
-                       + QString(" *%1 ").arg(nick) + inner + "</font>",
-                   insertCursor);
-    } else {
-        if (PsiOptions::instance()->getOption("options.ui.chat.use-chat-says-style").toBool()) {
+        if (mv.isEmote()) {
+            insertText(icon + QString("<font color=\"%1\">").arg(nickcolor) + QString("[%1]").arg(timestr)
+                           + QString(" *%1 ").arg(nick) + inner + "</font>",
+                       insertCursor);
+        } else if (saysStyle) {
             insertText(icon + QString("<font color=\"%1\">").arg(nickcolor) + QString("[%1] ").arg(timestr)
                            + QString("%1 says:").arg(nick) + "</font><br>"
                            + QString("<font color=\"%1\">").arg(textcolor) + inner + "</font>",
@@ -442,9 +595,8 @@ void ChatView::renderMessage(const MessageView &mv, QTextCursor &insertCursor)
         document()->addResource(QTextDocument::ImageResource, QUrl(QString("icon:delivery") + mv.messageId()),
                                 sendIcon);
     }
-    QString icon;
+    QString icon, sRes;
     if (useMessageIcons_) {
-        QString sRes;
         if (mv.isSpooled())
             sRes = "icon:log_icon_history";
         else if (mv.isLocal()) {
@@ -462,27 +614,49 @@ void ChatView::renderMessage(const MessageView &mv, QTextCursor &insertCursor)
         }
         icon = QString("<img src=\"%1\" />").arg(sRes);
     }
-    QString str;
-
-    QString inner = mv.formattedText() + replaceMarker(mv);
-    if (mv.isEmote()) {
-        str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1]").arg(timestr)
-            + QString(" *%1 ").arg(TextUtil::escape(mv.nick())) + inner + "</span>";
+    const bool    saysStyle = PsiOptions::instance()->getOption("options.ui.chat.use-chat-says-style").toBool();
+    const QString body      = mv.formattedText();
+
+    if (isPlainBody(body) && (mv.isEmote() || !saysStyle)) {
+        QTextCharFormat nickFormat;
+        nickFormat.setForeground(QColor(color));
+        QTextCharFormat textFormat;
+        if (mv.isEmote())
+            textFormat = nickFormat;
+        else if (mv.isSpooled())
+            textFormat.setForeground(ColorOpt::instance()->color("options.ui.look.colors.messages.usertext"));
+
+        TextRuns runs;
+        if (mv.isEmote())
+            runs << qMakePair(QString("[%1] *%2 ").arg(timestr, mv.nick()), nickFormat);
+        else
+            runs << qMakePair(QString("[%1] <%2>").arg(timestr, mv.nick()), nickFormat)
+                 << qMakePair(QString(" "), QTextCharFormat());
+        runs << qMakePair(body, textFormat) << qMakePair(QString(" "), markerCharFormat(mv, textFormat));
+        insertRuns(sRes, runs, insertCursor);
     } else {
-        if (PsiOptions::instance()->getOption("options.ui.chat.use-chat-says-style").toBool()) {
-            str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1] ").arg(timestr)
-                + tr("%1 says:").arg(TextUtil::escape(mv.nick())) + "</span><br>";
+        QString str;
+        QString inner = body + replaceMarker(mv);
+        if (mv.isEmote()) {
+            str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1]").arg(timestr)
+                + QString(" *%1 ").arg(TextUtil::escape(mv.nick())) + inner + "</span>";
         } else {
-            str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1] &lt;").arg(timestr)
-                + TextUtil::escape(mv.nick()) + QString("&gt;</span> ");
+            if (saysStyle) {
+                str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1] ").arg(timestr)
+                    + tr("%1 says:").arg(TextUtil::escape(mv.nick())) + "</span><br>";
+            } else {
+                str = icon + QString("<span style=\"color: %1\">").arg(color) + QString("[%1] &lt;").arg(timestr)
+                    + TextUtil::escape(mv.nick()) + QString("&gt;</span> ");
+            }
+            if (mv.isSpooled())
+                str.append(
+                    QString("<span style=\"color: %1\">%2</span>")
+                        .arg(ColorOpt::instance()->color("options.ui.look.colors.messages.usertext").name(), inner));
+            else
+                str.append(inner);
         }
-        if (mv.isSpooled())
-            str.append(QString("<span style=\"color: %1\">%2</span>")
-                           .arg(ColorOpt::instance()->color("options.ui.look.colors.messages.usertext").name(), inner));
-        else
-            str.append(inner);
+        insertText(str, insertCursor);
     }
-    insertText(str, insertCursor);
 
     if (mv.isLocal() && PsiOptions::instance()->getOption("options.ui.chat.auto-scroll-to-bottom").toBool()) {
         deferredScroll();
@@ -26,7 +26,9 @@
 
 #include <QContextMenuEvent>
 #include <QDateTime>
+#include <QHash>
 #include <QPointer>
+#include <QTextCharFormat>
 #include <QWidget>
 
 class ChatEdit;
@@ -61,6 +63,8 @@ public:
     void insertText(const QString &text, QTextCursor &insertCursor);
     void appendText(const QString &text);
     void dispatchMessage(const MessageView &);
+    void beginMessageBatch();
+    void endMessageBatch();
     bool handleCopyEvent(QObject *object, QEvent *event, ChatEdit *chatEdit);
 
     void      deferredScroll();
@@ -90,6 +94,16 @@ protected:
     void    renderSubject(const MessageView &);
     void    renderMucSubject(const MessageView &);
     void    renderUrls(const MessageView &);
+    void    trimLog();
+
+    QTextCursor findMessageMarker(const QString &id) const;
+    void        shiftMarkers(int after, int delta);
+
+    typedef QList<QPair<QString, QTextCharFormat>> TextRuns;
+
+    QTextCharFormat markerCharFormat(const MessageView &mv, QTextCharFormat format) const;
+    static bool     isPlainBody(const QString &html);
+    void            insertRuns(const QString &icon, const TextRuns &runs, QTextCursor &insertCursor);
 
 protected slots:
     void autoCopy();
@@ -103,15 +117,18 @@ signals:
     void nickInsertClick(const QString &nick);
 
 private:
-    bool              isMuc_;
-    bool              isMucPrivate_;
-    bool              isEncryptionEnabled_;
-    bool              useMessageIcons_;
-    int               oldTrackBarPosition;
-    XMPP::Jid         jid_;
-    QString           name_;
-    QPointer<QWidget> dialog_;
-    QAction *         actQuote_;
+    bool                isMuc_;
+    bool                isMucPrivate_;
+    bool                isEncryptionEnabled_;
+    bool                useMessageIcons_;
+    int                 oldTrackBarPosition;
+    int                 batchDepth_ = 0;
+    QHash<QString, int> markerPos_;       // message marker id => its position + markerShift_
+    int                 markerShift_ = 0; // characters trimmed from the top since the last clear
+    XMPP::Jid           jid_;
+    QString             name_;
+    QPointer<QWidget>   dialog_;
+    QAction *           actQuote_;
 };
 
 #endif // CHATVIEW_TE_H
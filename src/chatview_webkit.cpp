@@ -23,6 +23,7 @@
 #include "avatars.h"
 #include "chatviewtheme.h"
 #include "chatviewthemeprovider.h"
+#include "debug.h"
 #include "desktoputil.h"
 #include "filesharingmanager.h"
 #include "jsutil.h"
@@ -53,6 +54,7 @@
 #include <QMetaProperty>
 #include <QNetworkReply>
 #include <QPalette>
+#include <QTimer>
 #include <QWidget>
 #ifdef WEBENGINE
 #if QT_VERSION >= QT_VERSION_CHECK(5, 7, 0)
@@ -65,6 +67,14 @@
 #include <QWebPage>
 #endif
 
+// messages for js are collected for about one frame and sent together
+#define JS_FLUSH_INTERVAL 16 // ms
+
+#if defined(WEBENGINE) && QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+// pages of hidden views are dropped and rebuilt from the replay log when shown again
+#define CHATVIEW_DISCARD_PAGES
+#endif
+
 class ChatViewJSObject;
 class ChatViewThemeSessionBridge;
 
@@ -78,7 +88,9 @@ public:
     QAction                  *quoteAction = nullptr;
     ChatViewJSObject         *jsObject    = nullptr;
     QList<QVariantMap>        jsBuffer_;
+    QTimer                   *jsFlushTimer  = nullptr;
     bool                      sessionReady_ = false;
+    int                       batchDepth_   = 0; // jsBuffer_ is held while positive
     QPointer<QWidget>         dialog_;
     bool                      isMuc_               = false;
     bool                      isMucPrivate_        = false;
@@ -89,9 +101,36 @@ public:
     AvatarFactory::UserHashes remoteIcons;
     AvatarFactory::UserHashes localIcons;
     ChatViewThemeProvider    *themeProvider = nullptr;
+    QHash<QString, QString>   mucAvatarUrls; // nick => url, updated on avatar change
+#ifdef CHATVIEW_DISCARD_PAGES
+    QList<QVariantMap>        replayLog_;
+    QTimer                   *discardTimer = nullptr;
+    bool                      discarded_   = false;
+
+    // everything a fresh page needs to show the same log
+    void toReplayLog(const QVariantMap &map)
+    {
+        const QString type = map.value(QLatin1String("type")).toString();
+        if (type == QLatin1String("receivehooks") || type == QLatin1String("settings")) {
+            return; // current ones are sent anyway
+        }
+        if (type == QLatin1String("clear")) {
+            replayLog_.clear();
+            return;
+        }
+        replayLog_.append(map);
+        const int max = PsiOptions::instance()->getOption("options.ui.chat.max-log-messages").toInt();
+        while (max > 0 && replayLog_.size() > max) {
+            replayLog_.removeFirst();
+        }
+    }
+#endif
 
     static QString closeIconTags(const QString &richText)
     {
+        if (!richText.contains(QLatin1String("<icon "))) {
+            return richText;
+        }
         static QRegExp mIcon("(<icon [^>]+>)");
         QString        s(richText);
         s.replace(mIcon, "\\1</icon>");
@@ -100,6 +139,9 @@ public:
 
     QString prepareShares(const QString &msg)
     {
+        if (!msg.contains(QLatin1String("<share "))) {
+            return msg;
+        }
         static QRegularExpression re("<share id=\"([^\"]+)\"(?: +text=\"([^\"]+)\")?/>");
         int                       post = 0;
         QString                   ret;
@@ -389,6 +431,11 @@ ChatView::ChatView(QWidget *parent) : QFrame(parent), d(new ChatViewPrivate)
     d->webView->setFocusPolicy(Qt::NoFocus);
     d->webView->setPage(new ChatViewPage(d->webView));
 
+    d->jsFlushTimer = new QTimer(this);
+    d->jsFlushTimer->setSingleShot(true);
+    d->jsFlushTimer->setInterval(JS_FLUSH_INTERVAL);
+    connect(d->jsFlushTimer, &QTimer::timeout, this, &ChatView::flushJsBuffer);
+
     d->quoteAction = new QAction(tr("Quote"), this);
     d->quoteAction->setShortcut(QKeySequence(tr("Ctrl+S")));
     d->webView->addContextMenuAction(d->quoteAction);
@@ -404,25 +451,33 @@ ChatView::ChatView(QWidget *parent) : QFrame(parent), d(new ChatViewPrivate)
     setLooks(d->webView);
 
 #ifndef HAVE_X11 // linux has this feature built-in
-    connect(PsiOptions::instance(), SIGNAL(optionChanged(QString)),
-            SLOT(psiOptionChanged(QString)));                        // needed only for save autocopy state atm
+    // needed only for save autocopy state atm
+    PsiOptions::watch("options.ui.automatically-copy-selected-text", this,
+                      [this](const QString &option) { psiOptionChanged(option); });
     psiOptionChanged("options.ui.automatically-copy-selected-text"); // init autocopy
                                                                      // connection
 #endif
     connect(d->jsObject, &ChatViewJSObject::inited, this, &ChatView::sessionInited);
 
-#ifdef PSI_PLUGINS
-    QVariantMap m;
-    m["type"]  = "receivehooks";
-    m["hooks"] = PluginManager::instance()->messageViewJSFilters();
-    sendJsObject(m);
-    connect(PluginManager::instance(), &PluginManager::jsFiltersUpdated, this, [this]() {
-        QVariantMap m;
-        m["type"]  = "receivehooks";
-        m["hooks"] = PluginManager::instance()->messageViewJSFilters();
-        sendJsObject(m);
+#ifdef CHATVIEW_DISCARD_PAGES
+    d->discardTimer = new QTimer(this);
+    d->discardTimer->setSingleShot(true);
+    connect(d->discardTimer, &QTimer::timeout, this, [this]() {
+        if (isVisible() || d->discarded_) {
+            return;
+        }
+        d->discarded_    = true;
+        d->sessionReady_ = false;
+        d->jsFlushTimer->stop();
+        d->jsBuffer_.clear();
+        d->webView->page()->setLifecycleState(QWebEnginePage::LifecycleState::Discarded);
     });
 #endif
+
+#ifdef PSI_PLUGINS
+    sendJsHooks();
+    connect(PluginManager::instance(), &PluginManager::jsFiltersUpdated, this, &ChatView::sendJsHooks);
+#endif
 }
 
 ChatView::~ChatView()
@@ -543,16 +598,85 @@ void ChatView::psiOptionChanged(const QString &option)
 
 void ChatView::sendJsObject(const QVariantMap &map)
 {
+#ifdef CHATVIEW_DISCARD_PAGES
+    d->toReplayLog(map);
+    if (d->discarded_) {
+        return;
+    }
+#endif
     d->jsBuffer_.append(map);
     checkJsBuffer();
 }
 
+void ChatView::sendJsHooks()
+{
+#ifdef PSI_PLUGINS
+    QVariantMap m;
+    m["type"]  = "receivehooks";
+    m["hooks"] = PluginManager::instance()->messageViewJSFilters();
+    sendJsObject(m);
+#endif
+}
+
+#ifdef CHATVIEW_DISCARD_PAGES
+void ChatView::showEvent(QShowEvent *event)
+{
+    d->discardTimer->stop();
+    if (d->discarded_) {
+        // the page is loaded again and gets the whole log once its session is inited
+        d->discarded_ = false;
+        sendJsHooks();
+        d->jsBuffer_.append(d->replayLog_);
+        d->webView->page()->setLifecycleState(QWebEnginePage::LifecycleState::Active);
+    }
+    QFrame::showEvent(event);
+}
+
+void ChatView::hideEvent(QHideEvent *event)
+{
+    const int secs = PsiOptions::instance()->getOption("options.ui.chat.discard-hidden-view-after").toInt();
+    if (secs > 0 && d->sessionReady_) {
+        d->discardTimer->start(secs * 1000);
+    }
+    QFrame::hideEvent(event);
+}
+#endif
+
 void ChatView::checkJsBuffer()
 {
-    if (d->sessionReady_) {
-        while (!d->jsBuffer_.isEmpty()) {
-            emit d->jsObject->newMessage(d->jsBuffer_.takeFirst());
-        }
+    if (d->sessionReady_ && !d->batchDepth_ && !d->jsBuffer_.isEmpty() && !d->jsFlushTimer->isActive()) {
+        d->jsFlushTimer->start();
+    }
+}
+
+void ChatView::flushJsBuffer()
+{
+    if (!d->sessionReady_ || d->batchDepth_ || d->jsBuffer_.isEmpty()) {
+        return;
+    }
+    if (d->jsBuffer_.size() == 1) {
+        emit d->jsObject->newMessage(d->jsBuffer_.takeFirst());
+        return;
+    }
+    // one trip to js for all of them. util.js unpacks it and lets the theme insert them in bulk
+    QVariantList items;
+    items.reserve(d->jsBuffer_.size());
+    for (const QVariantMap &m : qAsConst(d->jsBuffer_)) {
+        items.append(m);
+    }
+    d->jsBuffer_.clear();
+    QVariantMap batch;
+    batch["type"]  = "batch";
+    batch["items"] = items;
+    emit d->jsObject->newMessage(batch);
+}
+
+void ChatView::beginMessageBatch() { d->batchDepth_++; }
+
+void ChatView::endMessageBatch()
+{
+    if (--d->batchDepth_ == 0) {
+        checkJsBuffer();
     }
 }
 
@@ -580,6 +704,7 @@ bool ChatView::handleCopyEvent(QObject *object, QEvent *event, ChatEdit *chatEdi
 // input point of all messages
 void ChatView::dispatchMessage(const MessageView &mv)
 {
+    TRACE_SCOPE("ChatView::dispatchMessage");
     QString replaceId = mv.replaceId();
     if (replaceId.isEmpty() && (mv.type() == MessageView::Message || mv.type() == MessageView::Subject)
         && updateLastMsgTime(mv.dateTime())) {
@@ -591,8 +716,13 @@ void ChatView::dispatchMessage(const MessageView &mv)
     }
     QVariantMap vm = mv.toVariantMap(d->isMuc_, true);
     if (mv.type() == MessageView::MUCJoin) {
-        Jid j           = d->jid_.withResource(mv.nick());
-        vm["avatar"]    = ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(j).avatar);
+        auto urlIt = d->mucAvatarUrls.constFind(mv.nick());
+        if (urlIt == d->mucAvatarUrls.constEnd()) {
+            Jid j = d->jid_.withResource(mv.nick());
+            urlIt = d->mucAvatarUrls.insert(
+                mv.nick(), ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(j).avatar));
+        }
+        vm["avatar"]    = urlIt.value();
         vm["nickcolor"] = getMucNickColor(mv.nick(), mv.isLocal());
     }
     auto it = vm.find(QLatin1String("usertext"));
@@ -601,8 +731,7 @@ void ChatView::dispatchMessage(const MessageView &mv)
     }
     it = vm.find(QLatin1String("message"));
     if (it != vm.end()) {
-        *it = d->prepareShares(it.value().toString());
-        *it = ChatViewPrivate::closeIconTags(it.value().toString());
+        *it = ChatViewPrivate::closeIconTags(d->prepareShares(it.value().toString()));
     }
 
     vm["encrypted"] = d->isEncryptionEnabled_;
@@ -660,6 +789,7 @@ void ChatView::updateAvatar(const Jid &jid, UserType utype)
         m["type"]   = "avatar";
         m["sender"] = jid.resource();
         m["avatar"] = ChatViewJSObject::avatarUrl(d->account_->avatarFactory()->userHashes(jid).avatar);
+        d->mucAvatarUrls.insert(jid.resource(), m["avatar"].toString());
         sendJsObject(m);
     }
 }
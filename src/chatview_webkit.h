@@ -59,6 +59,8 @@ public:
 
     void sendJsObject(const QVariantMap &);
     void dispatchMessage(const MessageView &m);
+    void beginMessageBatch();
+    void endMessageBatch();
     void sendJsCode(const QString &js);
 
     void     clear();
@@ -78,6 +80,10 @@ protected:
     // override the tab/esc behavior
     bool focusNextPrevChild(bool next);
     void changeEvent(QEvent *event);
+#if defined(WEBENGINE) && QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    void showEvent(QShowEvent *event);
+    void hideEvent(QHideEvent *event);
+#endif
     // void keyPressEvent(QKeyEvent *);
 
 protected slots:
@@ -89,6 +95,8 @@ public slots:
 
 private slots:
     void checkJsBuffer();
+    void flushJsBuffer();
+    void sendJsHooks();
     void sessionInited();
 
 signals:
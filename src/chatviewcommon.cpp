@@ -41,15 +41,51 @@ bool ChatViewCommon::updateLastMsgTime(QDateTime t)
     return doInsert;
 }
 
+// bumped on any change of the options nick colors depend on
+static int nickColorsGeneration()
+{
+    static int  generation = 0;
+    static bool connected  = false;
+    if (!connected) {
+        connected = true;
+        QObject::connect(PsiOptions::instance(), &PsiOptions::optionChanged, [](const QString &option) {
+            if (option.startsWith(QLatin1String("options.ui.muc.use-"))
+                || option == QLatin1String("options.ui.look.colors.muc.nick-colors")) {
+                ++generation;
+            }
+        });
+    }
+    return generation;
+}
+
 QString ChatViewCommon::getMucNickColor(const QString &nick, bool isSelf)
 {
+    const int  generation = nickColorsGeneration();
+    const QRgb bg         = qApp->palette().color(QPalette::Base).rgb();
+    if (generation != _nickColorsGeneration || bg != _nickColorsBg) {
+        _nickColors.clear();
+        _nickColorsGeneration = generation;
+        _nickColorsBg         = bg;
+    }
+
+    const QString key = isSelf ? QChar(1) + nick : nick; // no nick starts with a control char
+    auto          it  = _nickColors.constFind(key);
+    if (it != _nickColors.constEnd()) {
+        return it.value();
+    }
+    return *_nickColors.insert(key, nickColor(nick, isSelf));
+}
+
+QString ChatViewCommon::nickColor(const QString &nick, bool isSelf)
+{
+    static const QRegExp underscores("(^_*|_*$)");
     do {
         if (!PsiOptions::instance()->getOption("options.ui.muc.use-nick-coloring").toBool()) {
             break;
         }
 
         QString nickwoun = nick; // nick without underscores
-        nickwoun.remove(QRegExp("(^_*|_*$)"));
+        nickwoun.remove(underscores);
 
         if (PsiOptions::instance()->getOption("options.ui.muc.use-hash-nick-coloring").toBool()) {
             /* Hash-driven colors */
@@ -22,6 +22,7 @@
 
 #include <QColor>
 #include <QDateTime>
+#include <QHash>
 #include <QMap>
 #include <QStringList>
 
@@ -42,10 +43,16 @@ protected:
     QDateTime _lastMsgTime;
 
 private:
+    QString            nickColor(const QString &, bool);
     QList<QColor> &    generatePalette();
     bool               compatibleColors(const QColor &, const QColor &);
     int                _nickNumber;
     QMap<QString, int> _nicks;
+
+    // colors already given to nicks, valid while the coloring options and background stay the same
+    QHash<QString, QString> _nickColors;
+    int                     _nickColorsGeneration = -1;
+    QRgb                    _nickColorsBg         = 0;
 };
 
 #endif // CHATVIEWBASE_H
@@ -19,6 +19,7 @@
 
 #include "chatviewtheme.h"
 
+#include "applicationinfo.h"
 #include "avatars.h"
 #include "chatviewtheme_p.h"
 #include "chatviewthemeprovider.h"
@@ -32,10 +33,15 @@
 #include "webview.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QDirIterator>
 #include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMetaProperty>
+#include <QSaveFile>
 #include <QScopedPointer>
 #include <QTimer>
 #include <time.h>
@@ -53,17 +59,126 @@
 #include <QWebPage>
 #endif
 
+// loaded themes are kept on disk, so next time no loader page has to be run
+static const quint32 THEME_CACHE_MAGIC   = 0x50534954; // "PSIT"
+static const quint32 THEME_CACHE_VERSION = 1;
+
 #ifndef WEBENGINE
 QVariant ChatViewThemePrivate::evaluateFromFile(const QString fileName, QWebFrame *frame)
 {
-    QFile f(fileName);
-    if (f.open(QIODevice::ReadOnly)) {
-        return frame->evaluateJavaScript(f.readAll());
+    // the same helper scripts are evaluated in every chat page, read them once
+    static QHash<QString, QPair<QDateTime, QString>> sources;
+
+    const QDateTime mtime = QFileInfo(fileName).lastModified();
+    auto            it    = sources.find(fileName);
+    if (it == sources.end() || it->first != mtime) {
+        QFile f(fileName);
+        if (!f.open(QIODevice::ReadOnly)) {
+            return QVariant();
+        }
+        it = sources.insert(fileName, qMakePair(mtime, QString::fromUtf8(f.readAll())));
     }
-    return QVariant();
+    return frame->evaluateJavaScript(it->second);
 }
 #endif
 
+QStringList ChatViewThemePrivate::helperScripts() const
+{
+    return QStringList() << PsiThemeProvider::themePath(QLatin1String("chatview/moment-with-locales.js"))
+                         << PsiThemeProvider::themePath(QLatin1String("chatview/util.js"))
+                         << PsiThemeProvider::themePath(QLatin1String("chatview/") + id.section('/', 0, 0)
+                                                        + QLatin1String("/adapter.js"));
+}
+
+// the newest modification time of the theme and the scripts loading it
+qint64 ChatViewThemePrivate::sourcesTimestamp() const
+{
+    qint64    stamp = 0;
+    QFileInfo fi(filepath);
+    if (fi.isDir()) {
+        QDirIterator it(filepath, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            it.next();
+            stamp = qMax(stamp, it.fileInfo().lastModified().toMSecsSinceEpoch());
+        }
+    }
+    stamp = qMax(stamp, fi.lastModified().toMSecsSinceEpoch());
+    for (const QString &script : helperScripts()) {
+        stamp = qMax(stamp, QFileInfo(script).lastModified().toMSecsSinceEpoch());
+    }
+    return stamp;
+}
+
+QString ChatViewThemePrivate::diskCacheFileName() const
+{
+    const QByteArray key = (isMuc() ? QByteArray("muc/") : QByteArray("chat/")) + filepath.toUtf8();
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/chatview/")
+        + QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex())
+        + QLatin1String(".cache");
+}
+
+bool ChatViewThemePrivate::loadFromDiskCache()
+{
+    QFile f(diskCacheFileName());
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&f);
+    quint32     magic, version;
+    QString     appVersion, path;
+    qint64      stamp;
+    in >> magic >> version >> appVersion >> path >> stamp;
+    if (in.status() != QDataStream::Ok || magic != THEME_CACHE_MAGIC || version != THEME_CACHE_VERSION
+        || appVersion != ApplicationInfo::version() || path != filepath || stamp != sourcesTimestamp()) {
+        return false;
+    }
+
+    QString                 cName, cVersion, cDescription, cHomeUrl, cHtml, cHttpRelPath;
+    QStringList             cAuthors;
+    bool                    cTransparent, cCaseInsensitive;
+    QMap<QString, QVariant> cCache;
+    in >> cName >> cVersion >> cDescription >> cHomeUrl >> cAuthors >> cHtml >> cHttpRelPath >> cTransparent
+        >> cCaseInsensitive >> cCache;
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    name                  = cName;
+    this->version         = cVersion;
+    description           = cDescription;
+    homeUrl               = cHomeUrl;
+    authors               = cAuthors;
+    html                  = cHtml;
+    httpRelPath           = cHttpRelPath;
+    transparentBackground = cTransparent;
+    caseInsensitiveFS     = cCaseInsensitive;
+    cache                 = cCache;
+    return true;
+}
+
+void ChatViewThemePrivate::saveToDiskCache() const
+{
+    // such themes need the loader page for every session anyway
+    if (prepareSessionHtml) {
+        return;
+    }
+
+    const QString fileName = diskCacheFileName();
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&f);
+    out << THEME_CACHE_MAGIC << THEME_CACHE_VERSION << ApplicationInfo::version() << filepath << sourcesTimestamp();
+    out << name << version << description << homeUrl << authors << html << httpRelPath << transparentBackground
+        << caseInsensitiveFS << cache;
+    if (out.status() == QDataStream::Ok) {
+        f.commit();
+    }
+}
+
 ChatViewThemePrivate::ChatViewThemePrivate(ChatViewThemeProvider *provider) : ThemePrivate(provider)
 {
     nam = provider->psi()->networkAccessManager();
@@ -109,13 +224,23 @@ bool ChatViewThemePrivate::load(std::function<void(bool)> loadCallback)
         jsLoader.reset(new ChatViewJSLoader(this));
         jsUtil.reset(new ChatViewThemeJSUtil(this));
     }
+    if (loadFromDiskCache()) {
+        qDebug("%s theme is restored from cache for %s", qPrintable(id), isMuc() ? "muc" : "chat");
+        Theme(this).setState(Theme::State::Loaded);
+        auto callbacks = loadCallbacks;
+        loadCallbacks.clear();
+        for (auto &cb : callbacks) {
+            cb(true);
+        }
+        return true;
+    }
     if (wv.isNull()) {
         wv = new WebView(nullptr);
     }
 
-    QString themeType = id.section('/', 0, 0);
 #ifdef WEBENGINE
-    QWebChannel *channel = new QWebChannel(wv->page());
+    QString      themeType = id.section('/', 0, 0);
+    QWebChannel *channel   = new QWebChannel(wv->page());
     wv->page()->setWebChannel(channel);
     channel->registerObject(QLatin1String("srvLoader"), jsLoader.data());
     channel->registerObject(QLatin1String("srvUtil"), jsUtil.data());
@@ -140,10 +265,7 @@ bool ChatViewThemePrivate::load(std::function<void(bool)> loadCallback)
     return true;
 #else
     wv->page()->setNetworkAccessManager(nam);
-    QStringList scriptPaths = QStringList()
-        << PsiThemeProvider::themePath(QLatin1String("chatview/moment-with-locales.js"))
-        << PsiThemeProvider::themePath(QLatin1String("chatview/util.js"))
-        << PsiThemeProvider::themePath(QLatin1String("chatview/") + themeType + QLatin1String("/adapter.js"));
+    QStringList scriptPaths = helperScripts();
 
     wv->page()->mainFrame()->addToJavaScriptWindowObject("srvLoader", jsLoader.data(), QWebFrame::QtOwnership);
     wv->page()->mainFrame()->addToJavaScriptWindowObject("srvUtil", jsUtil.data(), QWebFrame::QtOwnership);
@@ -215,13 +337,7 @@ void ChatViewThemePrivate::embedSessionJsObject(ChatViewThemeSession *session)
     wf->addToJavaScriptWindowObject("srvUtil", new ChatViewThemeJSUtil(this, session->webView()));
     wf->addToJavaScriptWindowObject("srvSession", session);
 
-    QStringList scriptPaths = QStringList()
-        << PsiThemeProvider::themePath(QLatin1String("chatview/moment-with-locales.js"))
-        << PsiThemeProvider::themePath(QLatin1String("chatview/util.js"))
-        << PsiThemeProvider::themePath(QLatin1String("chatview/") + id.section('/', 0, 0)
-                                       + QLatin1String("/adapter.js"));
-
-    for (const QString &script : scriptPaths) {
+    for (const QString &script : helperScripts()) {
         evaluateFromFile(script, wf);
     }
 }
@@ -450,6 +566,7 @@ void ChatViewJSLoader::finishThemeLoading()
 {
     qDebug("%s theme is successfully loaded for %s", qPrintable(theme->id), theme->isMuc() ? "muc" : "chat");
     Theme(theme).setState(Theme::State::Loaded);
+    theme->saveToDiskCache();
 #ifdef WEBENGINE
     _callFinishLoadCalbacks();
 #else
@@ -153,6 +153,11 @@ public:
 #ifndef WEBENGINE
     QVariant evaluateFromFile(const QString fileName, QWebFrame *frame);
 #endif
+    QStringList helperScripts() const;
+    qint64      sourcesTimestamp() const;
+    QString     diskCacheFileName() const;
+    bool        loadFromDiskCache();
+    void        saveToDiskCache() const;
 
     friend class ChatViewThemeJSUtil;
 
@@ -31,6 +31,9 @@
 #endif
 
 #include <QBuffer>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 #include <QPointer>
 #include <QUrlQuery>
 #ifdef WEBENGINE
@@ -66,6 +69,20 @@ void ChatViewUrlRequestInterceptor::interceptRequest(QWebEngineUrlRequestInfo &i
 }
 #endif
 
+#ifdef WEBENGINE
+// sets the ETag. if the view has this version already, answers 304 and the request is done
+static bool notModified(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res, const QByteArray &etag)
+{
+    res->addHeader("ETag", etag);
+    res->addHeader("Cache-Control", "no-cache"); // revalidated on each use, mostly a 304
+    if (req->headers().value("if-none-match") != etag)
+        return false;
+    res->setStatusCode(qhttp::ESTATUS_NOT_MODIFIED);
+    res->end();
+    return true;
+}
+#endif
+
 ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
 {
 #ifdef WEBENGINE
@@ -77,6 +94,13 @@ ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
         fn = PsiThemeProvider::themePath(fn);
 
         if (!fn.isEmpty()) {
+            // a file is the same as long as its time and size are, no need to read it then
+            QFileInfo fi(fn);
+            if (fi.isFile()
+                && notModified(req, res,
+                               '"' + QByteArray::number(fi.lastModified().toMSecsSinceEpoch(), 16) + '-'
+                                   + QByteArray::number(fi.size(), 16) + '"'))
+                return true;
             QFile f(fn);
             if (f.open(QIODevice::ReadOnly)) {
                 res->setStatusCode(qhttp::ESTATUS_OK);
@@ -100,6 +124,8 @@ ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
 
         if (icon) {
             auto ba = icon->raw();
+            if (notModified(req, res, '"' + QByteArray::number(qHash(ba), 16) + '"'))
+                return true;
             res->addHeader("Content-Type", icon->mimeType().toLatin1());
             res->addHeader("Content-Length", QByteArray::number(ba.size()));
             if (ba.size() > 1 && std::uint8_t(ba.at(0)) == 0x1f && std::uint8_t(ba.at(1)) == 0x8b) {
@@ -130,6 +156,8 @@ ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
         } else {
             AvatarFactory::AvatarData ad = AvatarFactory::avatarDataByHash(QByteArray::fromHex(hash.toLatin1()));
             if (!ad.data.isEmpty()) {
+                // named by the hash of its data, it never changes
+                res->addHeader("Cache-Control", "max-age=31536000, immutable");
                 res->setStatusCode(qhttp::ESTATUS_OK);
                 res->headers().insert("Content-Type", ad.metaType.toLatin1());
                 res->end(ad.data);
@@ -233,35 +261,29 @@ ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
     QWebEngineProfile::defaultProfile()->setCachePath(cachePath + "/cache");
     QWebEngineProfile::defaultProfile()->setPersistentStoragePath(cachePath + "/presistent_storage");
 #else
-    pc->networkAccessManager()->registerPathHandler([](const QNetworkRequest &req, QByteArray &data, QByteArray &mime) {
-        QString path = req.url().path();
-        if (path.startsWith("/psi/themes/")) {
-            QString fn = path.mid(sizeof("/psi/themes"));
+    // theme files are read by the view as it goes
+    pc->networkAccessManager()->registerDeviceHandler(
+        "/psi/themes/", [](const QNetworkRequest &req, QByteArray &mime) -> QIODevice * {
+            QString fn = req.url().path().mid(sizeof("/psi/themes"));
             fn.replace("..", ""); // a little security
             fn = PsiThemeProvider::themePath(fn);
+            if (fn.isEmpty())
+                return nullptr;
 
-            if (!fn.isEmpty()) {
-                QFile f(fn);
-                if (f.open(QIODevice::ReadOnly)) {
-                    if (fn.endsWith(QLatin1String(".js"))) {
-                        mime = "application/javascript;charset=utf-8";
-                    }
-                    data = f.readAll();
-                    f.close();
-                    return true;
-                }
+            auto f = new QFile(fn);
+            if (!f->open(QIODevice::ReadOnly)) {
+                delete f;
+                return nullptr;
             }
-        }
-        return false;
-    });
-
-    pc->networkAccessManager()->registerPathHandler([](const QNetworkRequest &req, QByteArray &data, QByteArray &mime) {
-        QUrl    url  = req.url();
-        QString path = url.path();
-        if (!path.startsWith(QLatin1String("/psi/icon/"))) {
-            return false;
-        }
-        QString iconId = path.mid(sizeof("/psi/icon/") - 1);
+            if (fn.endsWith(QLatin1String(".js")))
+                mime = "application/javascript;charset=utf-8";
+            return f;
+        });
+
+    pc->networkAccessManager()->registerPathHandler("/psi/icon/", [](const QNetworkRequest &req, QByteArray &data,
+                                                                      QByteArray &mime) {
+        QUrl    url    = req.url();
+        QString iconId = url.path().mid(sizeof("/psi/icon/") - 1);
         int     w      = QUrlQuery(url.query()).queryItemValue("w").toInt();
         int     h      = QUrlQuery(url.query()).queryItemValue("h").toInt();
         auto    icon   = IconsetFactory::iconPtr(iconId);
@@ -289,26 +311,24 @@ ChatViewCon::ChatViewCon(PsiCon *pc) : QObject(pc), pc(pc)
         return false;
     });
 
-    pc->networkAccessManager()->registerPathHandler([](const QNetworkRequest &req, QByteArray &data, QByteArray &mime) {
-        QString path = req.url().path();
-        if (path.startsWith(QLatin1String("/psi/avatar/"))) {
-            QString hash = path.mid(sizeof("/psi/avatar")); // no / because of null pointer
-            if (hash == QLatin1String("default.png")) {
-                QPixmap p;
-                QBuffer buffer(&data);
-                buffer.open(QIODevice::WriteOnly);
-                p = IconsetFactory::icon(QLatin1String("psi/default_avatar")).pixmap();
-                if (p.save(&buffer, "PNG")) {
-                    mime = "image/png";
-                    return true;
-                }
-            } else {
-                AvatarFactory::AvatarData ad = AvatarFactory::avatarDataByHash(QByteArray::fromHex(hash.toLatin1()));
-                if (!ad.data.isEmpty()) {
-                    data = ad.data;
-                    mime = ad.metaType.toLatin1();
-                    return true;
-                }
+    pc->networkAccessManager()->registerPathHandler("/psi/avatar/", [](const QNetworkRequest &req, QByteArray &data,
+                                                                        QByteArray &mime) {
+        QString hash = req.url().path().mid(sizeof("/psi/avatar")); // no / because of null pointer
+        if (hash == QLatin1String("default.png")) {
+            QPixmap p;
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            p = IconsetFactory::icon(QLatin1String("psi/default_avatar")).pixmap();
+            if (p.save(&buffer, "PNG")) {
+                mime = "image/png";
+                return true;
+            }
+        } else {
+            AvatarFactory::AvatarData ad = AvatarFactory::avatarDataByHash(QByteArray::fromHex(hash.toLatin1()));
+            if (!ad.data.isEmpty()) {
+                data = ad.data;
+                mime = ad.metaType.toLatin1();
+                return true;
             }
         }
         return false;
@@ -29,6 +29,7 @@
 #include "psiiconset.h"
 #include "psioptions.h"
 #include "rtparse.h"
+#include "soundplayer.h"
 #include "tabdlg.h"
 #ifdef HAVE_X11
 #include "x11windowsystem.h"
@@ -44,9 +45,7 @@
 #include <QMessageBox>
 #include <QObject>
 #include <QPaintDevice>
-#include <QProcess>
 #include <QRegExp>
-#include <QSound>
 #include <QUrl>
 #include <QUuid>
 #ifdef __GLIBC__
@@ -272,31 +271,12 @@ void soundPlay(const QString &s)
     if (s.isEmpty())
         return;
 
-    QString str = s;
-    if (str == "!beep") {
+    if (s == "!beep") {
         QApplication::beep();
         return;
     }
 
-    if (QDir::isRelativePath(str)) {
-        str = ApplicationInfo::resourcesDir() + '/' + str;
-    }
-
-    if (!QFile::exists(str)) {
-        return;
-    }
-
-#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
-    QSound::play(str);
-#else
-    QString player = PsiOptions::instance()->getOption("options.ui.notifications.sounds.unix-sound-player").toString();
-    if (player == "")
-        player = soundDetectPlayer();
-    QStringList args = player.split(' ');
-    args += str;
-    QString prog = args.takeFirst();
-    QProcess::startDetached(prog, args);
-#endif
+    SoundPlayer::instance()->play(s);
 }
 
 bool lastPriorityNotEmpty()
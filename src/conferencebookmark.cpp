@@ -36,6 +36,12 @@ ConferenceBookmark::ConferenceBookmark(const QString &name, const XMPP::Jid &jid
 
 ConferenceBookmark::ConferenceBookmark(const QDomElement &el) { fromXml(el); }
 
+ConferenceBookmark::ConferenceBookmark(const XMPP::Jid &jid, const QDomElement &pepItem)
+{
+    fromXml(pepItem);
+    jid_ = jid;
+}
+
 QStringList ConferenceBookmark::joinTypeNames()
 {
     static QStringList jtn;
@@ -104,6 +110,20 @@ QDomElement ConferenceBookmark::toXml(QDomDocument &doc) const
     return e;
 }
 
+QDomElement ConferenceBookmark::toPepXml(QDomDocument &doc) const
+{
+    QDomElement e = doc.createElementNS(PEP_BOOKMARKS_NS, PEP_BOOKMARKS_TN);
+    e.setAttribute("name", name_);
+    if (auto_join_ == Always || auto_join_ == ExceptThisComputer)
+        e.setAttribute("autojoin", "true");
+    if (!nick_.isEmpty())
+        e.appendChild(textTag(&doc, "nick", nick_));
+    if (!password_.isEmpty())
+        e.appendChild(textTag(&doc, "password", password_));
+
+    return e;
+}
+
 bool ConferenceBookmark::operator==(const ConferenceBookmark &other) const
 {
     return name_ == other.name_ && jid_.full() == other.jid_.full() && auto_join_ == other.auto_join_
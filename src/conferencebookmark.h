@@ -24,6 +24,9 @@
 
 #include <QString>
 
+#define PEP_BOOKMARKS_TN "conference"
+#define PEP_BOOKMARKS_NS "urn:xmpp:bookmarks:1"
+
 class QDomDocument;
 class QDomElement;
 
@@ -34,6 +37,7 @@ public:
     ConferenceBookmark(const QString &name, const XMPP::Jid &jid, JoinType auto_join, const QString &nick = QString(),
                        const QString &password = QString());
     ConferenceBookmark(const QDomElement &);
+    ConferenceBookmark(const XMPP::Jid &jid, const QDomElement &pepItem); // XEP-0402, the item id is the jid
 
     static QStringList joinTypeNames();
 
@@ -49,6 +53,7 @@ public:
 
     void        fromXml(const QDomElement &);
     QDomElement toXml(QDomDocument &) const;
+    QDomElement toPepXml(QDomDocument &) const;
 
     bool operator==(const ConferenceBookmark &other) const;
 
@@ -0,0 +1,163 @@
+/*
+ * contactinfocache.cpp - keeps the version, time and last activity answers of contacts
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "contactinfocache.h"
+
+#include "common.h"
+#include "lastactivitytask.h"
+#include "psiaccount.h"
+#include "userlist.h"
+#include "xmpp_client.h"
+#include "xmpp_tasks.h"
+
+// how long answers are used before the contact is asked again, seconds
+#define CONTACT_VERSION_TTL 3600
+#define CONTACT_TIME_TTL 3600
+#define CONTACT_LAST_ACTIVITY_TTL 600
+
+using namespace XMPP;
+
+ContactInfoCache::ContactInfoCache(PsiAccount *account) : QObject(account), account_(account) { }
+
+ContactInfoCache::~ContactInfoCache() { }
+
+int ContactInfoCache::fresh(const Entry &e) const
+{
+    const qint64 now   = QDateTime::currentMSecsSinceEpoch();
+    int          kinds = 0;
+    if (e.versionAt && now - e.versionAt < CONTACT_VERSION_TTL * 1000)
+        kinds |= Version;
+    if (e.timeAt && now - e.timeAt < CONTACT_TIME_TTL * 1000)
+        kinds |= Time;
+    if (e.lastAt && now - e.lastAt < CONTACT_LAST_ACTIVITY_TTL * 1000)
+        kinds |= LastActivity;
+    return kinds;
+}
+
+void ContactInfoCache::request(const Jid &jid, int kinds)
+{
+    if (!account_->isAvailable())
+        return;
+
+    Entry &   e    = entries_[jid.full()];
+    const int have = fresh(e);
+    const int ask  = kinds & ~have & ~e.pending;
+    Task *    root = account_->client()->rootTask();
+
+    // answers of a lost connection aren't kept, the contact is asked again after the reconnect
+    if (ask & Version) {
+        JT_ClientVersion *task = new JT_ClientVersion(root);
+        connect(task, &Task::finished, this, [this, task, jid]() {
+            Entry &e = entries_[jid.full()];
+            e.pending &= ~Version;
+            if (task->statusCode() == Task::ErrDisc)
+                return;
+            e.versionAt = QDateTime::currentMSecsSinceEpoch();
+            if (task->success()) {
+                e.hasVersion = true;
+                e.name       = task->name();
+                e.version    = task->version();
+                e.os         = task->os();
+            }
+            publish(jid);
+        });
+        task->get(jid);
+        task->go(true);
+    }
+    if (ask & Time) {
+        JT_EntityTime *task = new JT_EntityTime(root);
+        connect(task, &Task::finished, this, [this, task, jid]() {
+            Entry &e = entries_[jid.full()];
+            e.pending &= ~Time;
+            if (task->statusCode() == Task::ErrDisc)
+                return;
+            e.timeAt = QDateTime::currentMSecsSinceEpoch();
+            if (task->success()) {
+                e.hasTime = true;
+                e.tzo     = task->timezoneOffset();
+            }
+            publish(jid);
+        });
+        task->get(jid);
+        task->go(true);
+    }
+    if (ask & LastActivity) {
+        LastActivityTask *task = new LastActivityTask(jid, root);
+        connect(task, &Task::finished, this, [this, task, jid]() {
+            Entry &e = entries_[jid.full()];
+            e.pending &= ~LastActivity;
+            if (task->statusCode() == Task::ErrDisc)
+                return;
+            e.lastAt = QDateTime::currentMSecsSinceEpoch();
+            if (task->success()) {
+                e.hasLast    = true;
+                e.lastTime   = task->time();
+                e.lastStatus = task->status();
+            }
+            publish(jid);
+        });
+        task->go(true);
+    }
+    e.pending |= ask;
+
+    // known already, though the roster item may have lost it, e.g. with the resource
+    if (kinds & have)
+        publish(jid);
+}
+
+bool ContactInfoCache::apply(const Jid &jid, UserListItem *u) const
+{
+    auto it = entries_.constFind(jid.full());
+    if (it == entries_.constEnd())
+        return false;
+
+    bool changed = false;
+    if (jid.resource().isEmpty()) {
+        if (it->hasLast && u->lastAvailable() != it->lastTime) {
+            u->setLastUnavailableStatus(makeStatus(STATUS_OFFLINE, it->lastStatus));
+            u->setLastAvailable(it->lastTime);
+            changed = true;
+        }
+        return changed;
+    }
+
+    UserResourceList::Iterator rit = u->userResourceList().find(jid.resource());
+    if (rit == u->userResourceList().end())
+        return false;
+    UserResource &r = *rit;
+    if (it->hasVersion && (r.clientName() != it->name || r.clientVersion() != it->version || r.clientOS() != it->os)) {
+        r.setClient(it->name, it->version, it->os);
+        changed = true;
+    }
+    if (it->hasTime && !(r.timezoneOffset().hasValue() && r.timezoneOffset().value() == it->tzo)) {
+        r.setTimezone(it->tzo);
+        changed = true;
+    }
+    return changed;
+}
+
+void ContactInfoCache::publish(const Jid &jid)
+{
+    const auto &items = account_->findRelevant(jid);
+    for (UserListItem *u : items) {
+        if (apply(jid, u))
+            account_->updateEntry(*u);
+    }
+    emit updated(jid);
+}
@@ -0,0 +1,73 @@
+/*
+ * contactinfocache.h - keeps the version, time and last activity answers of contacts
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONTACTINFOCACHE_H
+#define CONTACTINFOCACHE_H
+
+#include "xmpp_jid.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QObject>
+
+class PsiAccount;
+class UserListItem;
+
+// XEP-0092 version, XEP-0202 time and XEP-0012 last activity answers of the account's contacts,
+// kept for the session so tooltips and info dialogs don't ask the same contact again and again.
+// Answers, failures included, count until they expire. Roster items get them applied
+class ContactInfoCache : public QObject {
+    Q_OBJECT
+public:
+    enum Kind { Version = 0x1, Time = 0x2, LastActivity = 0x4 };
+
+    ContactInfoCache(PsiAccount *account);
+    ~ContactInfoCache();
+
+    // asks jid for the kinds not known or expired, updated() tells when the answers are in
+    void request(const XMPP::Jid &jid, int kinds);
+    // puts what is known about jid into u, true when something changed
+    bool apply(const XMPP::Jid &jid, UserListItem *u) const;
+
+signals:
+    void updated(const XMPP::Jid &jid);
+
+private:
+    struct Entry {
+        qint64    versionAt  = 0; // msecs since epoch of the answer, 0 when never answered
+        qint64    timeAt     = 0;
+        qint64    lastAt     = 0;
+        int       pending    = 0; // kinds asked and not answered yet
+        bool      hasVersion = false;
+        bool      hasTime    = false;
+        bool      hasLast    = false;
+        QString   name, version, os;
+        int       tzo = 0;
+        QDateTime lastTime;
+        QString   lastStatus;
+    };
+
+    int  fresh(const Entry &e) const;
+    void publish(const XMPP::Jid &jid);
+
+    PsiAccount *          account_;
+    QHash<QString, Entry> entries_; // full jid => answers
+};
+
+#endif // CONTACTINFOCACHE_H
@@ -53,6 +53,7 @@ class ContactListAccountMenu::Private : public QObject {
     QAction *          serviceDiscoveryAction_;
     QAction *          newMessageAction_;
     QAction *          xmlConsoleAction_;
+    QAction *          performanceAction_;
     QAction *          privacyListsAction_;
     QAction *          modifyAccountAction_;
     QMenu *            adminMenu_;
@@ -124,6 +125,9 @@ public:
         xmlConsoleAction_ = new IconAction(tr("&XML Console"), this, "psi/xml");
         connect(xmlConsoleAction_, SIGNAL(triggered()), SLOT(xmlConsole()));
 
+        performanceAction_ = new QAction(tr("&Performance"), this);
+        connect(performanceAction_, SIGNAL(triggered()), SLOT(performance()));
+
         modifyAccountAction_ = new IconAction(tr("&Modify Account..."), this, "psi/account");
         connect(modifyAccountAction_, SIGNAL(triggered()), SLOT(modifyAccount()));
 
@@ -161,6 +165,7 @@ public:
         menu->addAction(privacyListsAction_);
         menu->addSeparator();
         menu->addAction(xmlConsoleAction_);
+        menu->addAction(performanceAction_);
         menu->addSeparator();
         menu->addAction(modifyAccountAction_);
 
@@ -377,6 +382,14 @@ private slots:
         account->showXmlConsole();
     }
 
+    void performance()
+    {
+        if (!account)
+            return;
+
+        account->showPerformanceDlg();
+    }
+
     void modifyAccount()
     {
         if (!account)
@@ -27,13 +27,21 @@
 #include "psicontact.h"
 #include "userlist.h"
 
+#include <QCollator>
 #include <QCoreApplication>
 #include <QTextDocument>
 
+// all items are sorted in the gui thread, so one collator does for all of them
+static const QCollator &sortCollator()
+{
+    static const QCollator collator(QLocale::system());
+    return collator;
+}
+
 ContactListItem::ContactListItem(ContactListModel *model, Type type, SpecialGroupType specialGropType) :
     AbstractTreeItem(), _model(model), _type(type), _specialGroupType(specialGropType), _editing(false),
     _selfValid(true), _contact(nullptr), _account(nullptr), _expanded(true), _internalName(), _displayName(),
-    _totalContacts(0), _onlineContacts(0), _shouldBeVisible(type != Type::GroupType), _hidden(false)
+    _totalContacts(0), _onlineContacts(0), _shouldBeVisible(type != Type::GroupType), _hidden(false), _lazy(false)
 {
     switch (_specialGroupType) {
     case SpecialGroupType::GeneralSpecialGroupType:
@@ -102,6 +110,11 @@ bool ContactListItem::isEditable() const
                 return true;
             }
         }
+        for (const PsiContact *contact : _pendingContacts) {
+            if (contact->account() && contact->inList()) {
+                return true;
+            }
+        }
         return false;
     }
 }
@@ -136,6 +149,24 @@ bool ContactListItem::expanded() const { return _expanded; }
 
 void ContactListItem::setExpanded(bool expanded) { _expanded = expanded; }
 
+bool ContactListItem::isLazy() const { return _lazy; }
+
+void ContactListItem::setLazy(bool lazy) { _lazy = lazy && _type == Type::GroupType; }
+
+const QList<PsiContact *> &ContactListItem::pendingContacts() const { return _pendingContacts; }
+
+void ContactListItem::addPendingContact(PsiContact *contact) { _pendingContacts.append(contact); }
+
+void ContactListItem::removePendingContact(PsiContact *contact) { _pendingContacts.removeOne(contact); }
+
+QList<PsiContact *> ContactListItem::takePendingContacts()
+{
+    _lazy = false;
+    QList<PsiContact *> res;
+    res.swap(_pendingContacts);
+    return res;
+}
+
 ContactListItemMenu *ContactListItem::contextMenu()
 {
     ContactListItemMenu *menu = nullptr;
@@ -164,15 +195,15 @@ bool ContactListItem::lessThan(const ContactListItem *other) const
         if (_specialGroupType != other->_specialGroupType) {
             return _specialGroupType < other->_specialGroupType;
         } else {
-            return QString::localeAwareCompare(_displayName.toLower(), other->_displayName.toLower()) < 0;
+            return collationKey().compare(other->collationKey()) < 0;
         }
     } else if (_type == Type::ContactType && other->_type == Type::ContactType) {
         int rank = rankStatus(_contact->status().type()) - rankStatus(other->_contact->status().type());
         if (rank == 0)
-            rank = QString::localeAwareCompare(_contact->name().toLower(), other->_contact->name().toLower());
+            rank = collationKey().compare(other->collationKey());
         return rank < 0;
     } else if (_type == Type::AccountType && other->_type == Type::AccountType) {
-        return QString::localeAwareCompare(_account->name().toLower(), other->_account->name().toLower()) < 0;
+        return collationKey().compare(other->collationKey()) < 0;
     } else if (_type == Type::ContactType && other->_type == Type::GroupType) {
         return _contact->isSelf();
     } else if (_type == Type::GroupType && other->_type == Type::ContactType) {
@@ -182,6 +213,29 @@ bool ContactListItem::lessThan(const ContactListItem *other) const
     return false;
 }
 
+const QString &ContactListItem::foldedName() const
+{
+    updateSortKeys();
+    return _foldedName;
+}
+
+const QCollatorSortKey &ContactListItem::collationKey() const
+{
+    updateSortKeys();
+    return *_collationKey;
+}
+
+void ContactListItem::updateSortKeys() const
+{
+    const QString n = name();
+    if (_collationKey && n == _sortSource)
+        return;
+
+    _sortSource   = n;
+    _foldedName   = n.toLower();
+    _collationKey = sortCollator().sortKey(_foldedName);
+}
+
 QString ContactListItem::name() const
 {
     QString name;
@@ -283,6 +337,7 @@ QList<PsiContact *> ContactListItem::contacts()
             res += item->contacts();
         }
     }
+    res += _pendingContacts;
 
     return res;
 }
@@ -593,6 +648,16 @@ void ContactListItem::updateContactsCount() const
             _onlineContacts += item->_onlineContacts;
         }
     }
+
+    for (const PsiContact *contact : _pendingContacts) {
+        _totalContacts++;
+        if (contact->alerting() || contact->isAlwaysVisible()) {
+            _shouldBeVisible = true;
+        }
+        if (contact->isOnline()) {
+            _onlineContacts++;
+        }
+    }
 }
 
 QList<ContactListItem *> ContactListItem::allChildren() const
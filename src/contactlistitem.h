@@ -21,10 +21,13 @@
 
 #include "abstracttreeitem.h"
 
+#include <QCollatorSortKey>
+#include <QList>
 #include <QObject>
 #include <QPointer>
 #include <QString>
 #include <QVariant>
+#include <optional>
 
 class ContactListItem;
 class ContactListItemMenu;
@@ -73,12 +76,24 @@ public:
     bool expanded() const;
     void setExpanded(bool expanded);
 
+    // a lazy group keeps its contacts in pendingContacts() until it is expanded once
+    bool                       isLazy() const;
+    void                       setLazy(bool lazy);
+    const QList<PsiContact *> &pendingContacts() const;
+    void                       addPendingContact(PsiContact *contact);
+    void                       removePendingContact(PsiContact *contact);
+    QList<PsiContact *>        takePendingContacts();
+
     ContactListItemMenu *contextMenu();
 
     bool isFixedSize() const;
 
     bool lessThan(const ContactListItem *other) const;
 
+    // name() prepared for sorting, rebuilt only when the name changes
+    const QString &         foldedName() const;
+    const QCollatorSortKey &collationKey() const;
+
     bool editing() const;
     void setEditing(bool editing);
 
@@ -130,6 +145,14 @@ private:
     mutable int          _onlineContacts;
     mutable bool         _shouldBeVisible;
     bool                 _hidden;
+    bool                 _lazy;
+    QList<PsiContact *>  _pendingContacts;
+
+    mutable QString                         _sortSource; // name() the sort keys were built from
+    mutable QString                         _foldedName;
+    mutable std::optional<QCollatorSortKey> _collationKey;
+
+    void updateSortKeys() const;
 };
 
 Q_DECLARE_METATYPE(ContactListItem *)
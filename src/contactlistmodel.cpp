@@ -30,8 +30,11 @@
 #include <QIcon>
 #include <QMessageBox>
 #include <QModelIndex>
+#include <QSet>
 #include <QTextDocument>
 #include <QVariant>
+#include <QVector>
+#include <algorithm>
 
 #define MAX_COMMIT_DELAY 30 /* seconds */
 #define COMMIT_INTERVAL 100 /* msecs */
@@ -56,88 +59,151 @@ ContactListModel::Private::Private(ContactListModel *parent) :
 
 ContactListModel::Private::~Private() { }
 
-void ContactListModel::Private::realAddContact(PsiContact *contact)
+void ContactListModel::Private::addContacts(const QList<PsiContact *> &contacts)
 {
-    ContactListItem *root = static_cast<ContactListItem *>(q->root());
-    ;
-    if (accountsEnabled) {
-        PsiAccount *     account     = contact->account();
-        ContactListItem *accountItem = root->findAccount(account);
-
-        if (!accountItem) {
-            accountItem = new ContactListItem(q, ContactListItem::Type::AccountType);
-            accountItem->setAccount(account);
-            accountItem->setExpanded(!collapsed.contains(accountItem->internalName()));
+    SLOW_TIMER(100);
 
-            connect(account, SIGNAL(accountDestroyed()), SLOT(onAccountDestroyed()));
-            connect(account, SIGNAL(updatedAccount()), SLOT(updateAccount()));
+    if (contacts.isEmpty())
+        return;
 
-            root->appendChild(accountItem);
+    // New items are collected per parent, so every parent already in the model gets
+    // a single insert range. Accounts and groups created here are filled while detached.
+    ContactListItem *                                           root = static_cast<ContactListItem *>(q->root());
+    QList<ContactListItem *>                                    parents;
+    QHash<ContactListItem *, QList<ContactListItem *>>          newChildren;
+    QSet<ContactListItem *>                                     detached;
+    QHash<PsiAccount *, ContactListItem *>                      accountItems;
+    QHash<QPair<ContactListItem *, QString>, ContactListItem *> groupItems;
+    QSet<QPair<ContactListItem *, PsiContact *>>                grouped;
+    struct NewContact {
+        PsiContact *     contact;
+        ContactListItem *parent;
+        int              row;
+    };
+    QList<NewContact>       newContacts;
+    QSet<ContactListItem *> lazyGroups; // lazy groups already in the model that got contacts
+
+    // returns the row the child will get
+    auto addChild = [&](ContactListItem *parent, ContactListItem *child) {
+        if (detached.contains(parent)) {
+            parent->appendChild(child);
+            return parent->childCount() - 1;
         }
-        root = accountItem;
-    }
-
-    if (!contact->isSelf() && groupsEnabled) {
-        ContactListItem::SpecialGroupType specialGroupType = specialGroupFor(contact);
-        QStringList groups = specialGroupType == ContactListItem::SpecialGroupType::NoneSpecialGroupType
-            ? contact->groups()
-            : QStringList { QString() };
-
-        for (const QString &groupName : groups) {
-
-            ContactListItem *groupItem = nullptr;
-            if (specialGroupType == ContactListItem::SpecialGroupType::NoneSpecialGroupType)
-                groupItem = root->findGroup(groupName);
-            else
-                groupItem = root->findGroup(specialGroupType);
-
-            // No duplicates
-            if (groupItem && groupItem->findContact(contact)) {
-                continue;
+        auto it = newChildren.find(parent);
+        if (it == newChildren.end()) {
+            parents.append(parent);
+            it = newChildren.insert(parent, QList<ContactListItem *>());
+        }
+        it->append(child);
+        return parent->childCount() + it->size() - 1;
+    };
+
+    auto addContactItem = [&](ContactListItem *parent, PsiContact *contact) {
+        // collapsed groups get items for their contacts only when expanded
+        if (parent->isLazy()) {
+            parent->addPendingContact(contact);
+            pendingContacts.insert(contact, parent);
+            if (!detached.contains(parent))
+                lazyGroups.insert(parent);
+            return;
+        }
+        ContactListItem *item = new ContactListItem(q, ContactListItem::Type::ContactType);
+        item->setContact(contact);
+        newContacts.append({ contact, parent, addChild(parent, item) });
+    };
+
+    for (PsiContact *contact : contacts) {
+        ContactListItem *parent = root;
+        if (accountsEnabled) {
+            PsiAccount *     account     = contact->account();
+            ContactListItem *accountItem = accountItems.value(account);
+            if (!accountItem)
+                accountItem = root->findAccount(account);
+
+            if (!accountItem) {
+                accountItem = new ContactListItem(q, ContactListItem::Type::AccountType);
+                accountItem->setAccount(account);
+                accountItem->setExpanded(!collapsed.contains(accountItem->internalName()));
+
+                connect(account, SIGNAL(accountDestroyed()), SLOT(onAccountDestroyed()));
+                connect(account, SIGNAL(updatedAccount()), SLOT(updateAccount()));
+
+                addChild(root, accountItem);
+                detached.insert(accountItem);
             }
+            accountItems.insert(account, accountItem);
+            parent = accountItem;
+        }
 
-            ContactListItem *item = new ContactListItem(q, ContactListItem::Type::ContactType);
-            item->setContact(contact);
-
-            if (!groupItem) {
-                groupItem = new ContactListItem(q, ContactListItem::Type::GroupType, specialGroupType);
-                if (specialGroupType == ContactListItem::SpecialGroupType::NoneSpecialGroupType)
-                    groupItem->setName(groupName);
-
-                root->appendChild(groupItem);
-                groupItem->setExpanded(!collapsed.contains(groupItem->internalName()));
-                groupItem->setHidden(hidden.contains(groupItem->internalName()), false);
+        if (!contact->isSelf() && groupsEnabled) {
+            ContactListItem::SpecialGroupType specialGroupType = specialGroupFor(contact);
+            const bool  special = specialGroupType != ContactListItem::SpecialGroupType::NoneSpecialGroupType;
+            QStringList groups  = special ? QStringList { QString() } : contact->groups();
+
+            for (const QString &groupName : groups) {
+                const QPair<ContactListItem *, QString> key(
+                    parent, special ? QString::number(int(specialGroupType)) : QString("|" + groupName));
+                ContactListItem *groupItem = groupItems.value(key);
+                if (!groupItem)
+                    groupItem = special ? parent->findGroup(specialGroupType) : parent->findGroup(groupName);
+
+                // No duplicates
+                if (groupItem && grouped.contains(qMakePair(groupItem, contact)))
+                    continue;
+
+                if (!groupItem) {
+                    groupItem = new ContactListItem(q, ContactListItem::Type::GroupType, specialGroupType);
+                    if (!special)
+                        groupItem->setName(groupName);
+
+                    addChild(parent, groupItem);
+                    detached.insert(groupItem);
+                    groupItem->setExpanded(!collapsed.contains(groupItem->internalName()));
+                    groupItem->setLazy(!groupItem->expanded());
+                    groupItem->setHidden(hidden.contains(groupItem->internalName()), false);
+                }
+                // root->findGroup() only resolves "account::group" names, so without accounts
+                // every plain group is a new one, as it has always been
+                if (special || parent != root)
+                    groupItems.insert(key, groupItem);
+                grouped.insert(qMakePair(groupItem, contact));
+
+                addContactItem(groupItem, contact);
             }
-            groupItem->appendChild(item);
-
-            monitoredContacts.insert(contact, q->toModelIndex(item));
+        } else {
+            addContactItem(parent, contact);
         }
-    } else {
-        ContactListItem *item = new ContactListItem(q, ContactListItem::Type::ContactType);
-        item->setContact(contact);
-        root->appendChild(item);
-        monitoredContacts.insert(contact, q->toModelIndex(item));
-    }
 
-    connect(contact, SIGNAL(destroyed(PsiContact *)), SLOT(removeContact(PsiContact *)));
-    connect(contact, SIGNAL(groupsChanged()), SLOT(contactGroupsChanged()));
-    connect(contact, SIGNAL(updated()), SLOT(contactUpdated()));
-    connect(contact, SIGNAL(alert()), SLOT(contactUpdated()));
-    connect(contact, SIGNAL(anim()), SLOT(contactUpdated()));
-}
+        connect(contact, static_cast<void (PsiContact::*)(PsiContact *)>(&PsiContact::destroyed), this,
+                &Private::removeContact);
+        connect(contact, &PsiContact::groupsChanged, this, &Private::contactGroupsChanged);
+        connect(contact, &PsiContact::updated, this, &Private::contactUpdated);
+        connect(contact, &PsiContact::alert, this, &Private::contactUpdated);
+        connect(contact, &PsiContact::anim, this, &Private::contactUpdated);
+    }
 
-void ContactListModel::Private::addContacts(const QList<PsiContact *> &contacts)
-{
-    SLOW_TIMER(100);
+    for (ContactListItem *parent : qAsConst(parents)) {
+        const QList<ContactListItem *> &items = newChildren[parent];
+        const int                       first = parent->childCount();
+        q->beginInsertRows(q->toModelIndex(parent), first, first + items.size() - 1);
+        for (ContactListItem *item : items)
+            parent->appendChild(item);
+        q->endInsertRows();
+    }
 
-    if (contacts.isEmpty())
-        return;
+    QHash<ContactListItem *, QModelIndex> parentIndexes;
+    for (const NewContact &c : qAsConst(newContacts)) {
+        auto it = parentIndexes.constFind(c.parent);
+        if (it == parentIndexes.constEnd())
+            it = parentIndexes.insert(c.parent, q->toModelIndex(c.parent));
+        monitoredContacts.insert(c.contact, q->index(c.row, 0, it.value()));
+    }
 
-    emit q->layoutAboutToBeChanged();
-    for (auto *contact : contacts) {
-        realAddContact(contact);
+    // their counts changed
+    for (ContactListItem *group : qAsConst(lazyGroups)) {
+        QModelIndex index = q->toModelIndex(group);
+        emit q->dataChanged(index, index);
     }
-    emit q->layoutChanged();
 }
 
 void ContactListModel::Private::updateContacts(const QList<PsiContact *> &contacts)
@@ -147,45 +213,51 @@ void ContactListModel::Private::updateContacts(const QList<PsiContact *> &contac
     if (contacts.isEmpty())
         return;
 
-    // prepare ranges for updating to reduce 'emit dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
-    QModelIndexList                     indexes;
-    for (const PsiContact *contact : contacts) {
-        QModelIndexList indexes2 = q->indexesFor(contact);
-        indexes += indexes2;
-
-        for (const QModelIndex &index : qAsConst(indexes2)) {
-            QModelIndex parent = index.parent();
-            int         row    = index.row();
-            if (ranges.contains(parent)) {
-                if (index.row() < ranges.value(parent).first)
-                    ranges[parent].first = row;
-                else if (index.row() > ranges.value(parent).second)
-                    ranges[parent].second = row;
-            } else {
-                ranges.insert(parent, QPair<int, int>(row, row));
-            }
-        }
+    // Changed rows are collected per parent and reported as contiguous runs. One range
+    // spanning unchanged rows would make the proxy re-filter and re-sort all of them.
+    QHash<QModelIndex, QVector<int>> rows;
+    QSet<ContactListItem *>          lazyGroups;
+    for (PsiContact *contact : contacts) {
+        const QModelIndexList indexes = q->indexesFor(contact);
+        for (const QModelIndex &index : indexes)
+            rows[index.parent()].append(index.row());
+
+        const auto groups = pendingContacts.values(contact);
+        for (ContactListItem *group : groups)
+            lazyGroups.insert(group);
     }
 
-    QHashIterator<QModelIndex, QPair<int, int>> it(ranges);
-    while (it.hasNext()) {
-        it.next();
-        int         row1  = it.value().first;
-        int         row2  = it.value().second;
-        QModelIndex index = it.key();
+    // contacts without items change only their group's counts
+    for (ContactListItem *group : qAsConst(lazyGroups)) {
+        QModelIndex index = q->toModelIndex(group);
+        emit q->dataChanged(index, index);
+    }
 
-        // update contact
-        emit q->dataChanged(q->index(row1, 0, index), q->index(row2, 0, index));
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+        const QModelIndex &parent = it.key();
+        QVector<int> &     list   = it.value();
+        std::sort(list.begin(), list.end());
+        int first = list.first();
+        int last  = first;
+        for (int i = 1; i <= list.size(); ++i) {
+            if (i < list.size() && list.at(i) <= last + 1) {
+                last = list.at(i);
+                continue;
+            }
+            // update contacts
+            emit q->dataChanged(q->index(first, 0, parent), q->index(last, 0, parent));
+            if (i < list.size())
+                first = last = list.at(i);
+        }
 
         // Update group
-        emit q->dataChanged(index, index);
+        emit q->dataChanged(parent, parent);
     }
 }
 
 void ContactListModel::Private::addOperation(PsiContact *contact, ContactListModel::Private::Operation operation)
 {
-    if (operation == AddContact && monitoredContacts.contains(contact)) {
+    if (operation == AddContact && isMonitored(contact)) {
         Q_ASSERT(false);
     }
 
@@ -200,7 +272,18 @@ void ContactListModel::Private::addOperation(PsiContact *contact, ContactListMod
 
     if (commitTimerStartTime.secsTo(QDateTime::currentDateTime()) > MAX_COMMIT_DELAY)
         commit();
-    else
+    else if (!bulkDepth)
+        commitTimer->start();
+}
+
+void ContactListModel::Private::beginBulkUpdate() { ++bulkDepth; }
+
+void ContactListModel::Private::endBulkUpdate()
+{
+    if (bulkDepth == 0 || --bulkDepth > 0)
+        return;
+    // what was held goes out in one commit
+    if (!operationQueue.isEmpty())
         commitTimer->start();
 }
 
@@ -229,6 +312,52 @@ ContactListItem::SpecialGroupType ContactListModel::Private::specialGroupFor(Psi
     return type;
 }
 
+bool ContactListModel::Private::isMonitored(PsiContact *contact) const
+{
+    return monitoredContacts.contains(contact) || pendingContacts.contains(contact);
+}
+
+// Creates items for the contacts a lazy group was holding back
+void ContactListModel::Private::materializeGroup(ContactListItem *group)
+{
+    if (!group->isLazy())
+        return;
+
+    const QList<PsiContact *> contacts = group->takePendingContacts();
+    if (contacts.isEmpty())
+        return;
+
+    const QModelIndex parent = q->toModelIndex(group);
+    const int         first  = group->childCount();
+    q->beginInsertRows(parent, first, first + contacts.size() - 1);
+    for (PsiContact *contact : contacts) {
+        ContactListItem *item = new ContactListItem(q, ContactListItem::Type::ContactType);
+        item->setContact(contact);
+        group->appendChild(item);
+    }
+    q->endInsertRows();
+
+    for (int i = 0; i < contacts.size(); ++i) {
+        pendingContacts.remove(contacts.at(i), group);
+        monitoredContacts.insert(contacts.at(i), q->index(first + i, 0, parent));
+    }
+}
+
+void ContactListModel::Private::removeGroupIfEmpty(ContactListItem *group)
+{
+    QModelIndex index = q->toModelIndex(group);
+    // Delete empty group
+    if (group->isGroup() && !group->childCount() && group->pendingContacts().isEmpty()) {
+        q->beginRemoveRows(index.parent(), index.row(), index.row());
+        delete group;
+        q->endRemoveRows();
+
+    } else {
+        // Update group
+        emit q->dataChanged(index, index);
+    }
+}
+
 void ContactListModel::Private::commit()
 {
     SLOW_TIMER(100);
@@ -242,6 +371,7 @@ void ContactListModel::Private::commit()
     QHashIterator<PsiContact *, int> it(operationQueue);
 
     QList<PsiContact *> contactsForAdding;
+    QSet<PsiContact *>  addingSet;
     QList<PsiContact *> contactsForUpdate;
 
     while (it.hasNext()) {
@@ -250,11 +380,12 @@ void ContactListModel::Private::commit()
 
         int operations = simplifiedOperationList(it.value());
         if (operations & AddContact) {
-            Q_ASSERT(!monitoredContacts.contains(contact));
-            if (monitoredContacts.contains(contact))
+            Q_ASSERT(!isMonitored(contact));
+            if (isMonitored(contact))
                 continue;
 
             contactsForAdding << contact;
+            addingSet << contact;
         }
         if (operations & RemoveContact)
             Q_ASSERT(false);
@@ -262,8 +393,9 @@ void ContactListModel::Private::commit()
             contactsForUpdate << contact;
         if (operations & ContactGroupsChanged) {
             removeContact(contact);
-            if (!contactsForAdding.contains(contact)) {
+            if (!addingSet.contains(contact)) {
                 contactsForAdding << contact;
+                addingSet << contact;
             }
         }
     }
@@ -297,13 +429,18 @@ void ContactListModel::Private::clear()
     }
     monitoredContacts.clear();
 
+    const auto pending = pendingContacts.uniqueKeys();
+    for (PsiContact *contact : pending)
+        disconnect(contact, nullptr, this, nullptr);
+    pendingContacts.clear();
+
     q->endResetModel();
 }
 
 void ContactListModel::Private::addContact(PsiContact *contact)
 {
-    Q_ASSERT(!monitoredContacts.contains(contact));
-    if (monitoredContacts.contains(contact))
+    Q_ASSERT(!isMonitored(contact));
+    if (isMonitored(contact))
         return;
 
     addOperation(contact, AddContact);
@@ -316,9 +453,22 @@ void ContactListModel::Private::addContact(PsiContact *contact)
 
 void ContactListModel::Private::removeContact(PsiContact *contact)
 {
-    Q_ASSERT(monitoredContacts.contains(contact));
-    if (!monitoredContacts.contains(contact))
+    // added and removed again before a commit, e.g. within a bulk update
+    if (!isMonitored(contact) && (operationQueue.value(contact) & AddContact)) {
+        operationQueue.remove(contact);
         return;
+    }
+
+    Q_ASSERT(isMonitored(contact));
+    if (!isMonitored(contact))
+        return;
+
+    const auto groups = pendingContacts.values(contact);
+    pendingContacts.remove(contact);
+    for (ContactListItem *group : groups) {
+        group->removePendingContact(contact);
+        removeGroupIfEmpty(group);
+    }
 
     while (monitoredContacts.contains(contact)) {
         QModelIndex index = monitoredContacts.take(contact);
@@ -333,17 +483,7 @@ void ContactListModel::Private::removeContact(PsiContact *contact)
         delete item;
         q->endRemoveRows();
 
-        index = q->toModelIndex(group);
-        // Delete empty group
-        if (group->isGroup() && !group->childCount()) {
-            q->beginRemoveRows(index.parent(), index.row(), index.row());
-            delete group;
-            q->endRemoveRows();
-
-        } else {
-            // Update group
-            emit q->dataChanged(index, index);
-        }
+        removeGroupIfEmpty(group);
     }
     disconnect(contact, nullptr, this, nullptr);
     operationQueue.remove(contact);
@@ -352,13 +492,20 @@ void ContactListModel::Private::removeContact(PsiContact *contact)
 void ContactListModel::Private::contactUpdated()
 {
     PsiContact *contact = qobject_cast<PsiContact *>(sender());
-    Q_ASSERT(monitoredContacts.contains(contact));
-    if (!monitoredContacts.contains(contact))
+    Q_ASSERT(isMonitored(contact));
+    if (!isMonitored(contact))
         return;
 
+    // an alerting contact needs its item, so the view can reach it
+    if (contact->alerting()) {
+        const auto groups = pendingContacts.values(contact);
+        for (ContactListItem *group : groups)
+            materializeGroup(group);
+    }
+
     // Check for groups changing
     // Maybe very difficult and should be simplified?
-    QList<ContactListItem *> groupItems;
+    QList<ContactListItem *> groupItems = pendingContacts.values(contact);
     const auto &             indexes = monitoredContacts.values(contact);
     for (const QPersistentModelIndex &index : indexes) {
         ContactListItem *item   = q->toItem(index);
@@ -392,8 +539,8 @@ void ContactListModel::Private::contactUpdated()
 void ContactListModel::Private::contactGroupsChanged()
 {
     PsiContact *contact = qobject_cast<PsiContact *>(sender());
-    Q_ASSERT(monitoredContacts.contains(contact));
-    if (!monitoredContacts.contains(contact))
+    Q_ASSERT(isMonitored(contact));
+    if (!isMonitored(contact))
         return;
 
     addOperation(contact, ContactGroupsChanged);
@@ -445,6 +592,8 @@ ContactListModel::ContactListModel(PsiContactList *contactList, QObject *parent)
 
     connect(contactList, SIGNAL(addedContact(PsiContact *)), d, SLOT(addContact(PsiContact *)));
     connect(contactList, SIGNAL(removedContact(PsiContact *)), d, SLOT(removeContact(PsiContact *)));
+    connect(contactList, SIGNAL(beginBulkContactUpdate()), d, SLOT(beginBulkUpdate()));
+    connect(contactList, SIGNAL(endBulkContactUpdate()), d, SLOT(endBulkUpdate()));
 
     connect(d->contactList, SIGNAL(destroying()), SLOT(destroyingContactList()));
     connect(d->contactList, SIGNAL(showOfflineChanged(bool)), SIGNAL(showOfflineChanged()));
@@ -520,16 +669,8 @@ void ContactListModel::invalidateLayout()
     if (!d->contactList)
         return;
 
-    emit layoutAboutToBeChanged();
-
-    for (PsiContact *contact : d->contactList->contacts()) {
-        Q_ASSERT(!d->monitoredContacts.contains(contact));
-        if (d->monitoredContacts.contains(contact))
-            continue;
-
-        d->realAddContact(contact);
-    }
-    emit layoutChanged();
+    // the model is empty after clear(), so the whole roster goes in as one pass
+    d->addContacts(d->contactList->contacts());
 }
 
 PsiContact *ContactListModel::contactFor(const QModelIndex &index) const
@@ -610,12 +751,8 @@ bool ContactListModel::setData(const QModelIndex &index, const QVariant &data, i
             item->setName(name);
             emit dataChanged(index, index);
         } else if (item->isGroup() && !name.isEmpty()) {
-            QString             oldName = item->name();
-            QList<PsiContact *> contacts;
-            for (int i = 0; i < item->childCount(); ++i) {
-                if (item->child(i)->isContact())
-                    contacts << item->child(i)->contact();
-            }
+            QString             oldName  = item->name();
+            QList<PsiContact *> contacts = item->contacts();
 
             for (PsiContact *contact : qAsConst(contacts)) {
                 QStringList groups = contact->groups();
@@ -629,12 +766,31 @@ bool ContactListModel::setData(const QModelIndex &index, const QVariant &data, i
     } else if (role == ExpandedRole) {
         if (!item->isContact()) {
             item->setExpanded(data.toBool());
+            if (data.toBool())
+                d->materializeGroup(item);
         }
     }
 
     return true;
 }
 
+/**
+ * Lazy groups report children before they have any items.
+ */
+bool ContactListModel::hasChildren(const QModelIndex &parent) const
+{
+    ContactListItem *item = toItem(parent);
+    return item->childCount() > 0 || !item->pendingContacts().isEmpty();
+}
+
+bool ContactListModel::canFetchMore(const QModelIndex &parent) const
+{
+    ContactListItem *item = toItem(parent);
+    return item->isLazy() && !item->pendingContacts().isEmpty();
+}
+
+void ContactListModel::fetchMore(const QModelIndex &parent) { d->materializeGroup(toItem(parent)); }
+
 /**
  * Returns the number of columns in the \param parent model item.
  */
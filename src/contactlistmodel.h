@@ -109,6 +109,9 @@ public:
     virtual int   columnCount(const QModelIndex &parent) const;
     Qt::ItemFlags flags(const QModelIndex &index) const;
     virtual bool  setData(const QModelIndex &index, const QVariant &data, int role);
+    bool          hasChildren(const QModelIndex &parent = QModelIndex()) const;
+    bool          canFetchMore(const QModelIndex &parent) const;
+    void          fetchMore(const QModelIndex &parent);
 
     ContactListItem *toItem(const QModelIndex &index) const;
     QModelIndex      toModelIndex(ContactListItem *item) const;
@@ -23,7 +23,6 @@ public:
     Private(ContactListModel *parent);
     ~Private();
 
-    void realAddContact(PsiContact *contact);
     void addContacts(const QList<PsiContact *> &contacts);
     void updateContacts(const QList<PsiContact *> &contacts);
 
@@ -32,8 +31,14 @@ public:
 
     ContactListItem::SpecialGroupType specialGroupFor(PsiContact *contact);
 
+    bool isMonitored(PsiContact *contact) const;
+    void materializeGroup(ContactListItem *group);
+    void removeGroupIfEmpty(ContactListItem *group);
+
 public slots:
     void commit();
+    void beginBulkUpdate();
+    void endBulkUpdate();
     void clear();
     void addContact(PsiContact *contact);
     void removeContact(PsiContact *contact);
@@ -54,7 +59,9 @@ public:
     PsiContactList *                                contactList;
     QTimer *                                        commitTimer;
     QDateTime                                       commitTimerStartTime;
-    QMultiHash<PsiContact *, QPersistentModelIndex> monitoredContacts; // always keeps all the contacts
+    int                                             bulkDepth = 0; // operations are held while > 0
+    QMultiHash<PsiContact *, QPersistentModelIndex> monitoredContacts; // contacts that have items
+    QMultiHash<PsiContact *, ContactListItem *>     pendingContacts;   // contacts waiting in lazy groups
     QHash<PsiContact *, int>                        operationQueue;
     QStringList                                     collapsed;
     QStringList                                     hidden;
@@ -27,7 +27,8 @@
 #include "psicontactlist.h"
 #include "userlist.h"
 
-ContactListProxyModel::ContactListProxyModel(QObject *parent) : QSortFilterProxyModel(parent)
+ContactListProxyModel::ContactListProxyModel(QObject *parent) : QSortFilterProxyModel(parent), sortByStatus_(true), showOffline_(true), showSelf_(true), showTransports_(true),
+    showHidden_(true)
 {
     sort(0, Qt::AscendingOrder);
 
@@ -44,21 +45,27 @@ void ContactListProxyModel::setSourceModel(QAbstractItemModel *model)
     connect(model, SIGNAL(showTransportsChanged()), SLOT(filterParametersChanged()));
     connect(model, SIGNAL(showHiddenChanged()), SLOT(filterParametersChanged()));
     connect(model, SIGNAL(contactSortStyleChanged()), SLOT(updateSorting()));
+    sortByStatus_ = qobject_cast<ContactListModel *>(model)->contactSortStyle() == "status";
+    updateFilterParameters();
 }
 
-bool ContactListProxyModel::showOffline() const
+// filterAcceptsRow() runs for every row, so it reads these copies instead of the model
+void ContactListProxyModel::updateFilterParameters()
 {
-    return qobject_cast<ContactListModel *>(sourceModel())->showOffline();
+    ContactListModel *model = qobject_cast<ContactListModel *>(sourceModel());
+    showOffline_            = model->showOffline();
+    showSelf_               = model->showSelf();
+    showTransports_         = model->showTransports();
+    showHidden_             = model->showHidden();
 }
 
-bool ContactListProxyModel::showSelf() const { return qobject_cast<ContactListModel *>(sourceModel())->showSelf(); }
+bool ContactListProxyModel::showOffline() const { return showOffline_; }
 
-bool ContactListProxyModel::showTransports() const
-{
-    return qobject_cast<ContactListModel *>(sourceModel())->showTransports();
-}
+bool ContactListProxyModel::showSelf() const { return showSelf_; }
 
-bool ContactListProxyModel::showHidden() const { return qobject_cast<ContactListModel *>(sourceModel())->showHidden(); }
+bool ContactListProxyModel::showTransports() const { return showTransports_; }
+
+bool ContactListProxyModel::showHidden() const { return showHidden_; }
 
 bool ContactListProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
 {
@@ -147,23 +154,29 @@ bool ContactListProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &s
 
 bool ContactListProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
-    ContactListItem *item1 = qvariant_cast<ContactListItem *>(left.data(ContactListModel::ContactListItemRole));
-    ContactListItem *item2 = qvariant_cast<ContactListItem *>(right.data(ContactListModel::ContactListItemRole));
+    // called a lot while sorting, so no QVariant round trip through data()
+    const ContactListItem *item1 = static_cast<ContactListItem *>(left.internalPointer());
+    const ContactListItem *item2 = static_cast<ContactListItem *>(right.internalPointer());
     if (!item1 || !item2)
         return false;
 
-    ContactListModel *model = qobject_cast<ContactListModel *>(sourceModel());
-    if (model->contactSortStyle() == "status" || !item1->isContact() || !item2->isContact()) {
+    if (sortByStatus_ || !item1->isContact() || !item2->isContact()) {
         return item1->lessThan(item2);
     } else {
-        return item1->name().toLower() < item2->name().toLower();
+        return item1->foldedName() < item2->foldedName();
     }
 }
 
 void ContactListProxyModel::filterParametersChanged()
 {
-    invalidate();
+    // the order of the rows doesn't depend on these, only their visibility does
+    updateFilterParameters();
+    invalidateFilter();
     emit recalculateSize();
 }
 
-void ContactListProxyModel::updateSorting() { invalidate(); }
+void ContactListProxyModel::updateSorting()
+{
+    sortByStatus_ = qobject_cast<ContactListModel *>(sourceModel())->contactSortStyle() == "status";
+    invalidate();
+}
@@ -48,6 +48,15 @@ protected:
 
 private slots:
     void filterParametersChanged();
+
+private:
+    bool sortByStatus_;
+    bool showOffline_;
+    bool showSelf_;
+    bool showTransports_;
+    bool showHidden_;
+
+    void updateFilterParameters();
 };
 
 #endif // CONTACTLISTPROXYMODEL_H
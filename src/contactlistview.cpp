@@ -19,11 +19,14 @@
 
 #include "contactlistview.h"
 
+#include "chathistoryprefetch.h"
 #include "contactlistitem.h"
 #include "contactlistitemmenu.h"
 #include "contactlistmodel.h"
 #include "contactlistproxymodel.h"
 #include "debug.h"
+#include "psiaccount.h"
+#include "psicontact.h"
 #include "psioptions.h"
 #include "psitooltip.h"
 
@@ -60,6 +63,7 @@ ContactListView::ContactListView(QWidget *parent) : HoverableTreeView(parent), c
 #endif
 
     connect(this, &ContactListView::doubleClicked, this, &ContactListView::itemActivated);
+    connect(this, &ContactListView::entered, this, &ContactListView::prefetchHistory);
     // showStatus_ = PsiOptions::instance()->getOption("options.ui.contactlist.status-messages.show").toBool();
 }
 
@@ -103,6 +107,21 @@ void ContactListView::selectionChanged(const QItemSelection &selected, const QIt
     updateContextMenu();
 }
 
+void ContactListView::currentChanged(const QModelIndex &current, const QModelIndex &previous)
+{
+    HoverableTreeView::currentChanged(current, previous);
+
+    prefetchHistory(current);
+}
+
+// the contact under the mouse or keyboard cursor is likely to be opened next
+void ContactListView::prefetchHistory(const QModelIndex &index)
+{
+    ContactListItem *item = itemProxy(index);
+    if (item && item->isContact() && item->contact()->account())
+        item->contact()->account()->historyPrefetch()->prefetch(item->contact()->jid());
+}
+
 void ContactListView::updateContextMenu()
 {
     if (isContextMenuVisible())
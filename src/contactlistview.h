@@ -71,9 +71,11 @@ protected slots:
 
     virtual void showOfflineChanged();
     void         updateGroupExpandedState();
+    void         prefetchHistory(const QModelIndex &index);
 
     // reimplamented
     void selectionChanged(const QItemSelection &selected, const QItemSelection &deselected) override;
+    void currentChanged(const QModelIndex &current, const QModelIndex &previous) override;
     void focusInEvent(QFocusEvent *event) override;
     void focusOutEvent(QFocusEvent *event) override;
 
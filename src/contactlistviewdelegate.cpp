@@ -18,6 +18,7 @@
  */
 
 #include "activity.h"
+#include "anim.h"
 #include "avatars.h"
 #include "coloropt.h"
 #include "common.h"
@@ -27,6 +28,8 @@
 #include "contactlistviewdelegate_p.h"
 #include "debug.h"
 #include "mood.h"
+#include "psiaccount.h"
+#include "psicontact.h"
 #include "psiiconset.h"
 #include "psioptions.h"
 
@@ -39,8 +42,9 @@
 #include <QSetIterator>
 #include <QSortFilterProxyModel>
 
-#define ALERT_INTERVAL 100 /* msecs */
-#define ANIM_INTERVAL 300  /* msecs */
+#define ALERT_INTERVAL 100     /* msecs */
+#define ANIM_INTERVAL 300      /* msecs */
+#define PIXMAP_CACHE_SIZE 8192 /* kilobytes */
 
 #define PSI_HIDPI computeScaleFactor(contactList)
 //#define PSI_HIDPI (2) // for testing purposes
@@ -113,7 +117,7 @@ static QRect relativeRect(const QStyleOption &option, const QSize &size, const Q
 
 ContactListViewDelegate::Private::Private(ContactListViewDelegate *parent, ContactListView *contactList) :
     QObject(), q(parent), contactList(contactList), horizontalMargin_(5), verticalMargin_(3), statusIconSize_(0),
-    avatarRadius_(0), alertTimer_(new QTimer(this)), animTimer(new QTimer(this)), fontMetrics_(QFont()),
+    avatarRadius_(0), lastAlertFrame_(0), lastAnimFrame_(0), fontMetrics_(QFont()),
     statusFontMetrics_(QFont()), statusSingle_(false), showStatusMessages_(false), slimGroup_(false),
     outlinedGroup_(false), showClientIcons_(false), showMoodIcons_(false), showActivityIcons_(false),
     showGeolocIcons_(false), showTuneIcons_(false), showAvatars_(false), useDefaultAvatar_(false), avatarAtLeft_(false),
@@ -122,15 +126,13 @@ ContactListViewDelegate::Private::Private(ContactListViewDelegate *parent, Conta
     _animation1Color(QColor()), _animation2Color(QColor()), _statusMessageColor(QColor()),
     _headerBackgroundColor(QColor()), _headerForegroundColor(QColor())
 {
-    alertTimer_->setInterval(ALERT_INTERVAL);
-    alertTimer_->setSingleShot(false);
-    connect(alertTimer_, SIGNAL(timeout()), SLOT(updateAlerts()));
+    pixmapCache_.setMaxCost(PIXMAP_CACHE_SIZE);
 
-    animTimer->setInterval(ANIM_INTERVAL);
-    animTimer->setSingleShot(false);
-    connect(animTimer, SIGNAL(timeout()), SLOT(updateAnim()));
+    connect(AnimClock::instance(), &AnimClock::frame, this, &Private::animFrame);
 
-    connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString &)), SLOT(optionChanged(const QString &)));
+    for (auto prefix : { "options.ui.contactlist", "options.ui.look.contactlist", "options.ui.look.font.contactlist",
+                         "options.ui.look.colors.contactlist" })
+        PsiOptions::watch(prefix, this, [this](const QString &option) { optionChanged(option); });
     connect(ColorOpt::instance(), SIGNAL(changed(const QString &)), SLOT(colorOptionChanged(const QString &)));
     connect(PsiIconset::instance(), SIGNAL(rosterIconsSizeChanged(int)), SLOT(rosterIconsSizeChanged(int)));
 
@@ -261,6 +263,11 @@ void ContactListViewDelegate::Private::optionChanged(const QString &option)
         updateGeometry = true;
     }
 
+    // any of the above or an iconset switch may change what is painted
+    if (updateGeometry || updateViewport || option.startsWith(QLatin1String("options.iconsets."))) {
+        pixmapCache_.clear();
+    }
+
     if (!bulkUpdate) {
         if (updateGeometry) {
             recomputeGeometry();
@@ -326,66 +333,38 @@ void ContactListViewDelegate::Private::colorOptionChanged(const QString &option)
         contactList->viewport()->update();
 }
 
-void ContactListViewDelegate::Private::updateAlerts()
+void ContactListViewDelegate::Private::animFrame(qint64 elapsed)
 {
-    // Q_ASSERT(!alertingIndexes_.isEmpty());
-
-    if (!contactList->isVisible())
-        return; // needed?
-
-    // prepare ranges for updating to reduce 'dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
-
-    // Remove invalid indexes
-    QMutableSetIterator<QPersistentModelIndex> it(alertingIndexes);
-    while (it.hasNext()) {
-        QModelIndex index = it.next();
-
-        // Clean invalid indexes
-        if (!index.isValid()) {
-            it.remove();
-            continue;
-        }
+    bool alertTick = !alertingIndexes.isEmpty() && elapsed - lastAlertFrame_ >= ALERT_INTERVAL;
+    bool animTick  = !animIndexes.isEmpty() && elapsed - lastAnimFrame_ >= ANIM_INTERVAL;
+    if (!alertTick && !animTick)
+        return;
 
-        QModelIndex parent = index.parent();
-        int         row    = index.row();
-        if (ranges.contains(parent)) {
-            if (index.row() < ranges.value(parent).first)
-                ranges[parent].first = row;
-            else if (index.row() > ranges.value(parent).second)
-                ranges[parent].second = row;
-        } else {
-            ranges.insert(parent, QPair<int, int>(row, row));
-        }
+    if (alertTick)
+        lastAlertFrame_ = elapsed;
+    if (animTick) {
+        lastAnimFrame_ = elapsed;
+        animPhase      = !animPhase;
     }
 
-    QHashIterator<QModelIndex, QPair<int, int>> it2(ranges);
-    while (it2.hasNext()) {
-        it2.next();
-        int         row1  = it2.value().first;
-        int         row2  = it2.value().second;
-        QModelIndex index = it2.key();
+    if (!contactList->isVisible() || contactList->window()->isMinimized())
+        return;
 
-        // update contacts
-        contactList->dataChanged(contactList->model()->index(row1, 0, index),
-                                 contactList->model()->index(row2, 0, index));
-    }
+    // one viewport update for everything that changed on this frame
+    QRegion region;
+    if (alertTick)
+        collectRects(alertingIndexes, &region);
+    if (animTick)
+        collectRects(animIndexes, &region);
+    if (!region.isEmpty())
+        contactList->viewport()->update(region);
 }
 
-void ContactListViewDelegate::Private::updateAnim()
+void ContactListViewDelegate::Private::collectRects(QSet<QPersistentModelIndex> &indexes, QRegion *region) const
 {
-    animPhase = !animPhase;
-
-    // Q_ASSERT(!alertingIndexes_.isEmpty());
-
-    if (!contactList->isVisible())
-        return; // needed?
-
-    // prepare ranges for updating to reduce 'dataChanged' invoking
-    QHash<QModelIndex, QPair<int, int>> ranges;
+    const QRect viewportRect = contactList->viewport()->rect();
 
-    // Remove invalid indexes
-    QMutableSetIterator<QPersistentModelIndex> it(animIndexes);
+    QMutableSetIterator<QPersistentModelIndex> it(indexes);
     while (it.hasNext()) {
         QModelIndex index = it.next();
 
@@ -395,34 +374,17 @@ void ContactListViewDelegate::Private::updateAnim()
             continue;
         }
 
-        QModelIndex parent = index.parent();
-        int         row    = index.row();
-        if (ranges.contains(parent)) {
-            if (index.row() < ranges.value(parent).first)
-                ranges[parent].first = row;
-            else if (index.row() > ranges.value(parent).second)
-                ranges[parent].second = row;
-        } else {
-            ranges.insert(parent, QPair<int, int>(row, row));
-        }
-    }
-
-    QHashIterator<QModelIndex, QPair<int, int>> it2(ranges);
-    while (it2.hasNext()) {
-        it2.next();
-        int         row1  = it2.value().first;
-        int         row2  = it2.value().second;
-        QModelIndex index = it2.key();
-
-        // update contacts
-        contactList->dataChanged(contactList->model()->index(row1, 0, index),
-                                 contactList->model()->index(row2, 0, index));
+        // collapsed and scrolled out rows give nothing to repaint
+        QRect r = contactList->visualRect(index);
+        if (r.intersects(viewportRect))
+            *region += r;
     }
 }
 
 void ContactListViewDelegate::Private::rosterIconsSizeChanged(int size)
 {
     statusIconSize_ = size;
+    pixmapCache_.clear();
     recomputeGeometry();
     contactList->viewport()->update();
 }
@@ -464,7 +426,22 @@ QPixmap ContactListViewDelegate::Private::statusPixmap(const QModelIndex &index,
             s = STATUS_NOAUTH;
     }
 
-    return PsiIconset::instance()->statusPtr(index.data(ContactListModel::JidRole).toString(), s)->pixmap(desiredSize);
+    PsiIcon *icon = PsiIconset::instance()->statusPtr(index.data(ContactListModel::JidRole).toString(), s);
+    if (icon->isAnimated())
+        return icon->pixmap(desiredSize);
+
+    // iconsets are reloaded only on options.iconsets.* changes, and these clear the cache
+    QPixmap       pix;
+    const QString key = QString("status/%1/%2/%3x%4")
+                            .arg(icon->name())
+                            .arg(quintptr(icon), 0, 16)
+                            .arg(desiredSize.width())
+                            .arg(desiredSize.height());
+    if (!findPixmap(key, &pix)) {
+        pix = icon->pixmap(desiredSize);
+        insertPixmap(key, pix);
+    }
+    return pix;
 }
 
 QList<QPixmap> ContactListViewDelegate::Private::clientPixmap(const QModelIndex &index)
@@ -489,29 +466,82 @@ QList<QPixmap> ContactListViewDelegate::Private::clientPixmap(const QModelIndex
 
 QPixmap ContactListViewDelegate::Private::avatarIcon(const QModelIndex &index)
 {
-    int     avSize = showAvatars_ ? avatarRect_.height() : 0;
-    QPixmap av;
-    auto    v = index.data(ContactListModel::AvatarRole);
-    if (!v.isNull())
-        av = v.value<QPixmap>();
+    int              avSize = showAvatars_ ? avatarRect_.height() : 0;
+    ContactListItem *item   = qvariant_cast<ContactListItem *>(index.data(ContactListModel::ContactListItemRole));
+    if (item && item->type() == ContactListItem::Type::ContactType && item->contact()->account()) {
+        // rendered in background by the factory, the contact gets updated when it's ready
+        PsiContact *  contact = item->contact();
+        const QPixmap av      = contact->account()->avatarFactory()->avatarVariant(
+            contact->jid(), avSize, avatarRadius_, contactList->devicePixelRatioF(), contact->isPrivate());
+        if (!av.isNull())
+            return av;
+    }
 
-    if (av.isNull() && useDefaultAvatar_)
+    QPixmap av;
+    if (useDefaultAvatar_)
         av = IconsetFactory::iconPixmap("psi/default_avatar", avSize);
 
-    return AvatarFactory::roundedAvatar(av, avatarRadius_, avSize);
+    if (av.isNull())
+        return QPixmap();
+
+    QPixmap       rounded;
+    const QString key = QString("avatar/%1/%2/%3/%4")
+                            .arg(av.cacheKey())
+                            .arg(avSize)
+                            .arg(avatarRadius_)
+                            .arg(contactList->devicePixelRatioF());
+    if (!findPixmap(key, &rounded)) {
+        rounded = AvatarFactory::roundedAvatar(av, avatarRadius_, avSize);
+        insertPixmap(key, rounded);
+    }
+    return rounded;
 }
 
 QPixmap ContactListViewDelegate::Private::rosterIndicator(const QString iconName)
 {
-    auto    iconHeight  = pepIconsRect_.height();
-    auto    desiredSize = QSize(iconHeight, iconHeight);
-    QPixmap pix         = IconsetFactory::iconPixmap(iconName, desiredSize);
+    auto          iconHeight = pepIconsRect_.height();
+    QPixmap       pix;
+    const QString key = QString("indicator/%1/%2").arg(iconName).arg(iconHeight);
+    if (findPixmap(key, &pix))
+        return pix;
+
+    pix = IconsetFactory::iconPixmap(iconName, QSize(iconHeight, iconHeight));
     if (pix.height() > iconHeight * HugeIconRosterK) {
         pix = pix.scaledToHeight(iconHeight, Qt::SmoothTransformation);
     }
+    insertPixmap(key, pix);
     return pix;
 }
 
+bool ContactListViewDelegate::Private::findPixmap(const QString &key, QPixmap *pix) const
+{
+    QPixmap *cached = pixmapCache_.object(key);
+    if (!cached)
+        return false;
+    *pix = *cached;
+    return true;
+}
+
+void ContactListViewDelegate::Private::insertPixmap(const QString &key, const QPixmap &pix)
+{
+    int cost = int(qint64(pix.width()) * pix.height() * pix.depth() / 8 / 1024);
+    pixmapCache_.insert(key, new QPixmap(pix), qMax(cost, 1));
+}
+
+QPixmap ContactListViewDelegate::Private::scaledPixmap(const QPixmap &pix, const QSize &size)
+{
+    if (pix.isNull() || pix.size() == size)
+        return pix;
+
+    QPixmap       scaled;
+    const QString key = QString("scaled/%1/%2x%3").arg(pix.cacheKey()).arg(size.width()).arg(size.height());
+    if (!findPixmap(key, &scaled)) {
+        scaled = pix.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        insertPixmap(key, scaled);
+    }
+    return scaled;
+}
+
 void ContactListViewDelegate::Private::drawContact(QPainter *painter, const QModelIndex &index)
 {
     /* We have a few possible ways to draw contact
@@ -596,11 +626,14 @@ void ContactListViewDelegate::Private::drawContact(QPainter *painter, const QMod
     QPixmap statusPixmap = this->statusPixmap(index, statusIconRect.size());
     if (!statusPixmap.isNull()) {
         if (statusIconsOverAvatars_ && showAvatars_) {
-            statusPixmap = statusPixmap.scaled(statusIconRect.size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            statusPixmap = scaledPixmap(statusPixmap,
+                                        statusPixmap.size().scaled(statusIconRect.size(), Qt::KeepAspectRatio));
         } else {
             auto fs = QFontInfo(font_).pixelSize();
-            if (statusPixmap.height() > fs * HugeIconRosterK)
-                statusPixmap = statusPixmap.scaledToHeight(int(fs * EqTextIconK + .5), Qt::SmoothTransformation);
+            if (statusPixmap.height() > fs * HugeIconRosterK) {
+                int h        = int(fs * EqTextIconK + .5);
+                statusPixmap = scaledPixmap(statusPixmap, QSize(statusPixmap.width() * h / statusPixmap.height(), h));
+            }
             if (opt.direction == Qt::RightToLeft) {
                 statusIconRect.moveRight(firstLineRect.right());
                 nickRect.setRight(statusIconRect.left() - StatusIconToNickHMargin * PSI_HIDPI);
@@ -1183,14 +1216,10 @@ void ContactListViewDelegate::Private::setAlertEnabled(const QModelIndex &index,
 {
     if (enable && !alertingIndexes.contains(index)) {
         alertingIndexes << index;
-        if (!alertTimer_->isActive()) {
-            alertTimer_->start();
-        }
+        updateAnimClock();
     } else if (!enable && alertingIndexes.contains(index)) {
         alertingIndexes.remove(index);
-        if (alertingIndexes.isEmpty()) {
-            alertTimer_->stop();
-        }
+        updateAnimClock();
     }
 }
 
@@ -1198,17 +1227,22 @@ void ContactListViewDelegate::Private::setAnimEnabled(const QModelIndex &index,
 {
     if (enable && !animIndexes.contains(index)) {
         animIndexes << index;
-        if (!animTimer->isActive()) {
-            animTimer->start();
-        }
+        updateAnimClock();
     } else if (!enable && animIndexes.contains(index)) {
         animIndexes.remove(index);
-        if (alertingIndexes.isEmpty()) {
-            animTimer->stop();
-        }
+        updateAnimClock();
     }
 }
 
+// keeps the shared clock ticking only while something is alerting or animating here
+void ContactListViewDelegate::Private::updateAnimClock()
+{
+    if (alertingIndexes.isEmpty() && animIndexes.isEmpty())
+        AnimClock::instance()->removeClient(this);
+    else
+        AnimClock::instance()->addClient(this);
+}
+
 /***************************/
 /* ContactListViewDelegate */
 /***************************/
@@ -1276,10 +1310,7 @@ void ContactListViewDelegate::contactAlert(const QModelIndex &index)
     else
         d->alertingIndexes.remove(index);
 
-    if (d->alertingIndexes.isEmpty())
-        d->alertTimer_->stop();
-    else
-        d->alertTimer_->start();
+    d->updateAnimClock();
 }
 
 void ContactListViewDelegate::animateContacts(const QModelIndexList &indexes, bool started)
@@ -1292,16 +1323,13 @@ void ContactListViewDelegate::animateContacts(const QModelIndexList &indexes, bo
         }
     }
 
-    if (d->animIndexes.isEmpty())
-        d->animTimer->stop();
-    else if (!d->animTimer->isActive())
-        d->animTimer->start();
+    d->updateAnimClock();
 }
 
 void ContactListViewDelegate::clearAlerts()
 {
     d->alertingIndexes.clear();
-    d->alertTimer_->stop();
+    d->updateAnimClock();
 }
 
 void ContactListViewDelegate::updateEditorGeometry(QWidget *editor, const QStyleOptionViewItem &option,
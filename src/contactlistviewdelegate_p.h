@@ -3,6 +3,7 @@
 #include "contactlistview.h"
 #include "contactlistviewdelegate.h"
 
+#include <QCache>
 #include <QColor>
 #include <QFont>
 #include <QFontMetrics>
@@ -11,8 +12,8 @@
 #include <QModelIndex>
 #include <QPersistentModelIndex>
 #include <QPixmap>
+#include <QRegion>
 #include <QSet>
-#include <QTimer>
 
 class ContactListViewDelegate::Private : public QObject {
     Q_OBJECT
@@ -27,8 +28,7 @@ signals:
 public slots:
     void optionChanged(const QString &option);
     void colorOptionChanged(const QString &option);
-    void updateAlerts();
-    void updateAnim();
+    void animFrame(qint64 elapsed);
     void rosterIconsSizeChanged(int size);
 
 public:
@@ -41,6 +41,10 @@ public:
     virtual QList<QPixmap> clientPixmap(const QModelIndex &index);
     virtual QPixmap        avatarIcon(const QModelIndex &index);
 
+    bool    findPixmap(const QString &key, QPixmap *pix) const;
+    void    insertPixmap(const QString &key, const QPixmap &pix);
+    QPixmap scaledPixmap(const QPixmap &pix, const QSize &size);
+
     void drawContact(QPainter *painter, const QModelIndex &index);
     void drawGroup(QPainter *painter, const QModelIndex &index);
     void drawAccount(QPainter *painter, const QModelIndex &index);
@@ -56,6 +60,8 @@ public:
 
     void setAlertEnabled(const QModelIndex &index, bool enable);
     void setAnimEnabled(const QModelIndex &index, bool enable);
+    void updateAnimClock();
+    void collectRects(QSet<QPersistentModelIndex> &indexes, QRegion *region) const;
 
 public:
     static const int ContactVMargin           = 2;
@@ -77,8 +83,7 @@ public:
     int statusIconSize_;
     int avatarRadius_;
 
-    QTimer *     alertTimer_;
-    QTimer *     animTimer;
+    qint64       lastAlertFrame_, lastAnimFrame_;
     QFont        font_, statusFont_;
     QFontMetrics fontMetrics_, statusFontMetrics_;
     bool         statusSingle_;
@@ -90,6 +95,9 @@ public:
     mutable QSet<QPersistentModelIndex> alertingIndexes;
     mutable QSet<QPersistentModelIndex> animIndexes;
 
+    // rounded avatars and scaled icons, cost is in kilobytes
+    QCache<QString, QPixmap> pixmapCache_;
+
     // Colors
     QColor _awayColor;
     QColor _dndColor;
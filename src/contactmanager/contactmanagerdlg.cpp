@@ -33,6 +33,14 @@
 #include <QItemSelectionModel>
 #include <QMessageBox>
 #include <QScrollArea>
+#include <QTimer>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
+
+// roster changes sent at once during a bulk action, and the pause before the next ones in ms.
+// thousands of them at a time make the server throttle the account
+#define BULK_OPS_PER_ROUND 10
+#define BULK_ROUND_INTERVAL 1000
 
 ContactManagerDlg::ContactManagerDlg(PsiAccount *pa) : QDialog(nullptr, Qt::Window), pa_(pa), um(nullptr)
 {
@@ -65,6 +73,13 @@ ContactManagerDlg::ContactManagerDlg(PsiAccount *pa) : QDialog(nullptr, Qt::Wind
     connect(ui_.btnExecute, SIGNAL(clicked()), this, SLOT(executeCurrent()));
     connect(ui_.btnSelect, SIGNAL(clicked()), this, SLOT(doSelect()));
 
+    bulkTimer_ = new QTimer(this);
+    bulkTimer_->setInterval(BULK_ROUND_INTERVAL);
+    connect(bulkTimer_, &QTimer::timeout, this, &ContactManagerDlg::bulkRound);
+    connect(ui_.btnCancel, &QPushButton::clicked, this, &ContactManagerDlg::stopBulk);
+    ui_.pbBulk->hide();
+    ui_.btnCancel->hide();
+
     connect(pa_->client(), SIGNAL(rosterRequestFinished(bool, int, QString)), this,
             SLOT(client_rosterUpdated(bool, int, QString)));
     connect(ui_.usersView, &ContactManagerView::doubleClicked, this, [this](const QModelIndex &index) {
@@ -122,30 +137,37 @@ void ContactManagerDlg::executeCurrent()
             != QMessageBox::Yes) {
             return;
         }
-        um->startBatch();
+        // the roster pushes take the contacts out of the list
+        QList<BulkOp> ops;
         for (UserListItem *u : users) {
-            if (u->isTransport() && !Jid(pa_->client()->host()).compare(u->jid())) {
-                JT_UnRegister *ju = new JT_UnRegister(pa_->client()->rootTask());
-                ju->unreg(u->jid());
-                ju->go(true);
-            }
-            JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-            r->remove(u->jid());
-            r->go(true);
+            const Jid  jid         = u->jid();
+            const bool unsubscribe = u->isTransport() && !Jid(pa_->client()->host()).compare(jid);
+            ops += [this, jid, unsubscribe]() {
+                if (unsubscribe) {
+                    JT_UnRegister *ju = new JT_UnRegister(pa_->client()->rootTask());
+                    ju->unreg(jid);
+                    ju->go(true);
+                }
+                JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
+                r->remove(jid);
+                r->go(true);
+            };
         }
-        um->clear();
-        pa_->client()->rosterRequest();
+        startBulk(ops);
     } break;
     case 3: // Auth request
-        for (UserListItem *u : users) {
-            pa_->dj_authReq(u->jid());
-        }
-        break;
     case 4: // Auth grant
+    {
+        QList<BulkOp> ops;
         for (UserListItem *u : users) {
-            pa_->dj_auth(u->jid());
+            const Jid jid = u->jid();
+            if (action == 3)
+                ops += [this, jid]() { pa_->dj_authReq(jid); };
+            else
+                ops += [this, jid]() { pa_->dj_auth(jid); };
         }
-        break;
+        startBulk(ops);
+    } break;
     case 5: // change domain
         changeDomain(users);
         break;
@@ -185,21 +207,73 @@ void ContactManagerDlg::showParamField(int index)
     }
 }
 
+/**
+ * \brief Sends \a ops a few at a time, so the server doesn't throttle the account.
+ */
+void ContactManagerDlg::startBulk(const QList<BulkOp> &ops)
+{
+    if (ops.isEmpty()) {
+        return;
+    }
+    bulkOps_ += ops;
+    ui_.pbBulk->setMaximum(ui_.pbBulk->isVisible() ? ui_.pbBulk->maximum() + ops.size() : ops.size());
+    if (!ui_.pbBulk->isVisible()) {
+        ui_.pbBulk->setValue(0);
+    }
+    ui_.pbBulk->show();
+    ui_.btnCancel->show();
+    ui_.btnExecute->setEnabled(false);
+    bulkRound();
+    if (!bulkOps_.isEmpty()) {
+        bulkTimer_->start();
+    }
+}
+
+void ContactManagerDlg::bulkRound()
+{
+    if (!pa_->isAvailable()) {
+        stopBulk();
+        return;
+    }
+    for (int n = 0; n < BULK_OPS_PER_ROUND && !bulkOps_.isEmpty(); ++n) {
+        bulkOps_.takeFirst()();
+        ui_.pbBulk->setValue(ui_.pbBulk->value() + 1);
+    }
+    if (bulkOps_.isEmpty()) {
+        stopBulk();
+    }
+}
+
+// what was sent stays, the rest is dropped
+void ContactManagerDlg::stopBulk()
+{
+    bulkTimer_->stop();
+    bulkOps_.clear();
+    ui_.pbBulk->hide();
+    ui_.btnCancel->hide();
+    ui_.btnExecute->setEnabled(true);
+}
+
 void ContactManagerDlg::changeDomain(QList<UserListItem *> &users)
 {
     QString domain = ui_.edtActionParam->text();
     if (domain.size()) {
-        um->startBatch();
-        um->clear();
+        QList<BulkOp> ops;
         for (UserListItem *u : users) {
-            JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-            if (!u->jid().node().isEmpty()) {
-                r->set(u->jid().withDomain(domain), u->name(), u->groups());
-                r->remove(u->jid());
+            if (u->jid().node().isEmpty()) {
+                continue;
             }
-            r->go(true);
+            const Jid         jid    = u->jid();
+            const QString     name   = u->name();
+            const QStringList groups = u->groups();
+            ops += [this, jid, domain, name, groups]() {
+                JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
+                r->set(jid.withDomain(domain), name, groups);
+                r->remove(jid);
+                r->go(true);
+            };
         }
-        pa_->client()->rosterRequest();
+        startBulk(ops);
     } else {
         QMessageBox::warning(this, tr("Invalid"), tr("Please fill parameter field with new domain name"));
     }
@@ -209,11 +283,17 @@ void ContactManagerDlg::changeGroup(QList<UserListItem *> &users)
 {
     QStringList groups(ui_.cmbActionParam->currentText());
 
+    QList<BulkOp> ops;
     for (UserListItem *u : users) {
-        JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-        r->set(u->jid(), u->name(), groups);
-        r->go(true);
+        const Jid     jid  = u->jid();
+        const QString name = u->name();
+        ops += [this, jid, name, groups]() {
+            JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
+            r->set(jid, name, groups);
+            r->go(true);
+        };
     }
+    startBulk(ops);
 }
 
 void ContactManagerDlg::client_rosterUpdated(bool success, int statusCode, QString statusString)
@@ -224,35 +304,38 @@ void ContactManagerDlg::client_rosterUpdated(bool success, int statusCode, QStri
     ui_.usersView->viewport()->update();
     Q_UNUSED(statusCode);
     Q_UNUSED(statusString);
-    um->stopBatch();
 }
 
 void ContactManagerDlg::exportRoster(QList<UserListItem *> &users)
 {
     QString fileName = QFileDialog::getSaveFileName(this, tr("Roster file"), QDir::homePath());
     if (!fileName.isEmpty()) {
-        QDomDocument doc;
-        QString      nick;
-        QDomElement  root = doc.createElement("roster");
-        doc.appendChild(root);
+        QFile file(fileName);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            QMessageBox::critical(this, tr("Save error!"), tr("Can't open file %1 for writing").arg(fileName));
+            return;
+        }
+        // written as it goes, the roster isn't copied into a document first
+        QXmlStreamWriter writer(&file);
+        writer.setAutoFormatting(true);
+        writer.writeStartDocument();
+        writer.writeStartElement("roster");
         for (UserListItem *u : users) {
-            QDomElement contact = root.appendChild(doc.createElement("contact")).toElement();
-            contact.setAttribute("jid", u->jid().bare());
+            writer.writeStartElement("contact");
+            writer.writeAttribute("jid", u->jid().bare());
             for (const QString &group : u->groups()) {
-                contact.appendChild(doc.createElement("group")).appendChild(doc.createTextNode(group));
+                writer.writeTextElement("group", group);
             }
-            nick = u->name();
-            if (!nick.isEmpty()) {
-                contact.appendChild(doc.createElement("nick")).appendChild(doc.createTextNode(nick));
+            if (!u->name().isEmpty()) {
+                writer.writeTextElement("nick", u->name());
             }
+            writer.writeEndElement();
         }
-        QFile file(fileName);
-        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-            QMessageBox::critical(this, tr("Save error!"), tr("Can't open file %1 for writing").arg(fileName));
-            return;
+        writer.writeEndElement();
+        writer.writeEndDocument();
+        if (writer.hasError()) {
+            QMessageBox::critical(this, tr("Save error!"), tr("Can't write file %1").arg(fileName));
         }
-        file.write(doc.toString().toLocal8Bit());
-        file.close();
     }
 }
 
@@ -265,55 +348,88 @@ void ContactManagerDlg::importRoster()
             QMessageBox::critical(this, tr("Open error!"), tr("Can't open file %1 for reading").arg(fileName));
             return;
         }
-        QDomDocument doc;
-        if (!doc.setContent(&file)) {
+
+        struct Entry {
+            QString     nick;
+            QStringList groups;
+        };
+        QHash<QString, Entry> entries;
+        QStringList           jids; // file order, each once
+        QXmlStreamReader      reader(&file);
+        while (!reader.atEnd()) {
+            reader.readNext();
+            if (!reader.isStartElement() || reader.name() != QLatin1String("contact")) {
+                continue;
+            }
+            const QString jid = Jid(reader.attributes().value("jid").toString()).bare();
+            Entry         entry;
+            while (reader.readNextStartElement()) {
+                if (reader.name() == QLatin1String("nick")) {
+                    entry.nick = reader.readElementText();
+                } else if (reader.name() == QLatin1String("group")) {
+                    entry.groups.append(reader.readElementText());
+                } else {
+                    reader.skipCurrentElement();
+                }
+            }
+            if (jid.isEmpty()) {
+                continue;
+            }
+            if (!entries.contains(jid)) {
+                jids.append(jid);
+            }
+            entries.insert(jid, entry);
+        }
+        file.close();
+        if (reader.hasError()) {
             QMessageBox::critical(this, tr("Open error!"), tr("File %1 is not xml file").arg(fileName));
             return;
         }
-        QDomNodeList domContacts = doc.documentElement().elementsByTagName("contact");
-        if (domContacts.isEmpty()) {
+        if (jids.isEmpty()) {
             QMessageBox::warning(this, tr("Nothing to do.."), tr("No contacts found in file %1").arg(fileName));
+            return;
         }
 
-        QHash<QString, QString>     nicks;
-        QHash<QString, QStringList> groups;
-        [[maybe_unused]] QString    jid, nick;
-        QStringList                 jids;
-        QStringList                 labelContent;
-        for (int i = 0; i < static_cast<int>(domContacts.length()); i++) {
-            QDomElement contact = domContacts.item(i).toElement();
-            jid                 = contact.attribute("jid");
-            jids.append(jid);
-            QDomNodeList props = contact.childNodes();
-            for (int j = 0; j < static_cast<int>(props.length()); j++) {
-                if (!props.item(j).isElement()) {
+        // only what differs from the roster is sent. an import that was cancelled or cut off
+        // by a disconnect picks up where it stopped when run again
+        QStringList changed;
+        QStringList labelContent;
+        for (const QString &jid : qAsConst(jids)) {
+            const Entry & entry = entries[jid];
+            UserListItem *u     = pa_->find(Jid(jid));
+            if (u && u->inList() && u->name() == entry.nick) {
+                QStringList current  = u->groups();
+                QStringList imported = entry.groups;
+                current.sort();
+                imported.sort();
+                if (current == imported) {
                     continue;
                 }
-                QDomElement el = props.item(j).toElement();
-                if (el.tagName() == "nick") {
-                    nicks[jid] = el.text();
-                }
-                if (el.tagName() == "group") {
-                    groups[jid].append(el.text());
-                }
             }
-            labelContent.append(QString("%1 (%2)").arg(jid, nicks[jid]));
+            changed.append(jid);
+            labelContent.append(QString("%1 (%2)").arg(jid, entry.nick));
+        }
+        if (changed.isEmpty()) {
+            QMessageBox::information(this, tr("Nothing to do.."),
+                                     tr("All contacts from file %1 are already in the roster").arg(fileName));
+            return;
         }
 
         QMessageBox confirmDlg(QMessageBox::Question, tr("Confirm contacts importing"),
-                               tr("Do you really want to import these contacts?"),
+                               tr("Do you really want to import these contacts?") + "\n"
+                                   + tr("%1 of %2 contacts are new or changed.").arg(changed.size()).arg(jids.size()),
                                QMessageBox::Cancel | QMessageBox::Yes);
         confirmDlg.setDetailedText(labelContent.join("\n"));
         if (confirmDlg.exec() == QMessageBox::Yes) {
-            um->startBatch();
-            um->clear();
-            for (const QString &jid : jids) {
-                JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
-                r->set(Jid(jid), nicks[jid], groups[jid]);
-                r->go(true);
+            QList<BulkOp> ops;
+            for (const QString &jid : qAsConst(changed)) {
+                ops += [this, jid, entry = entries[jid]]() {
+                    JT_Roster *r = new JT_Roster(pa_->client()->rootTask());
+                    r->set(Jid(jid), entry.nick, entry.groups);
+                    r->go(true);
+                };
             }
-            pa_->client()->rosterRequest(); // через ж.., но пускай пока так.
+            startBulk(ops);
         }
-        file.close();
     }
 }
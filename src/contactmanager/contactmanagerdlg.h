@@ -24,8 +24,10 @@
 #include "ui_contactmanagerdlg.h"
 
 #include <QDialog>
+#include <functional>
 
 class PsiAccount;
+class QTimer;
 
 namespace Ui {
 class ContactManagerDlg;
@@ -42,6 +44,11 @@ protected:
     void changeEvent(QEvent *e) override;
 
 private:
+    typedef std::function<void()> BulkOp;
+
+    void startBulk(const QList<BulkOp> &ops);
+    void bulkRound();
+    void stopBulk();
     void changeDomain(QList<UserListItem *> &users);
     void changeGroup(QList<UserListItem *> &users);
     void exportRoster(QList<UserListItem *> &users);
@@ -50,6 +57,8 @@ private:
     Ui::ContactManagerDlg ui_;
     PsiAccount *          pa_;
     ContactManagerModel * um;
+    QList<BulkOp>         bulkOps_; // not sent yet
+    QTimer *              bulkTimer_;
 
 private slots:
     void doSelect();
@@ -30,8 +30,12 @@ ContactManagerModel::ContactManagerModel(QObject *parent, PsiAccount *pa) : QAbs
     columnNames << "" << tr("Nick") << tr("Group") << tr("Node") << tr("Domain") << tr("Subscription");
     roles << CheckRole << NickRole << GroupRole << NodeRole << DomainRole << SubscriptionRole;
     connect(pa_, SIGNAL(updateContact(UserListItem)), this, SLOT(view_contactUpdated(UserListItem)));
+    connect(pa_->client(), SIGNAL(rosterItemAdded(const RosterItem &)), this,
+            SLOT(client_rosterItemAdded(const RosterItem &)));
     connect(pa_->client(), SIGNAL(rosterItemUpdated(const RosterItem &)), this,
             SLOT(client_rosterItemUpdated(const RosterItem &)));
+    connect(pa_->client(), SIGNAL(rosterItemRemoved(const RosterItem &)), this,
+            SLOT(client_rosterItemRemoved(const RosterItem &)));
 }
 
 void ContactManagerModel::reloadUsers()
@@ -50,9 +54,19 @@ void ContactManagerModel::reloadUsers()
 void ContactManagerModel::clear()
 {
     _userList.clear();
+    rows.clear();
     checks.clear();
 }
 
+void ContactManagerModel::reindex()
+{
+    rows.clear();
+    rows.reserve(_userList.size());
+    for (int i = 0; i < _userList.size(); ++i) {
+        rows.insert(_userList.at(i)->jid().full(), i);
+    }
+}
+
 int ContactManagerModel::rowCount(const QModelIndex &parent) const
 {
     if (parent.isValid())
@@ -135,7 +149,11 @@ QStringList ContactManagerModel::manageableFields()
     return ret;
 }
 
-void ContactManagerModel::addContact(UserListItem *u) { _userList.append(u); }
+void ContactManagerModel::addContact(UserListItem *u)
+{
+    rows.insert(u->jid().full(), _userList.size());
+    _userList.append(u);
+}
 
 Qt::ItemFlags ContactManagerModel::flags(const QModelIndex &index) const
 {
@@ -192,6 +210,7 @@ void ContactManagerModel::sort(int column, Qt::SortOrder order = Qt::AscendingOr
     if (columnRole != CheckRole) {
         emit layoutAboutToBeChanged();
         std::sort(_userList.begin(), _userList.end(), ContactManagerModel::sortLessThan);
+        reindex();
         emit layoutChanged();
     }
 }
@@ -265,15 +284,40 @@ void ContactManagerModel::invertByMatch(int columnIndex, int matchType, const QS
 
 void ContactManagerModel::view_contactUpdated(const UserListItem &u) { contactUpdated(u.jid()); }
 
+// the account has already added the item to its list
+void ContactManagerModel::client_rosterItemAdded(const RosterItem &item)
+{
+    UserListItem *u = pa_->find(item.jid());
+    if (!u || !u->inList() || rows.contains(u->jid().full())) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), _userList.size(), _userList.size());
+    addContact(u);
+    endInsertRows();
+}
+
 void ContactManagerModel::client_rosterItemUpdated(const RosterItem &item) { contactUpdated(item.jid()); }
 
+// the account may have deleted the item by now, so only the jid is used
+void ContactManagerModel::client_rosterItemRemoved(const RosterItem &item)
+{
+    const QString jid = item.jid().full();
+    auto          it  = rows.constFind(jid);
+    if (it == rows.constEnd()) {
+        return;
+    }
+    const int row = it.value();
+    beginRemoveRows(QModelIndex(), row, row);
+    _userList.removeAt(row);
+    checks.remove(jid);
+    reindex();
+    endRemoveRows();
+}
+
 void ContactManagerModel::contactUpdated(const Jid &jid)
 {
-    int i = 0;
-    for (UserListItem *lu : qAsConst(_userList)) {
-        if (lu->jid() == jid) {
-            emit dataChanged(index(i, 1), index(i, columnNames.count() - 1));
-        }
-        i++;
+    auto it = rows.constFind(jid.full());
+    if (it != rows.constEnd()) {
+        emit dataChanged(index(it.value(), 1), index(it.value(), columnNames.count() - 1));
     }
 }
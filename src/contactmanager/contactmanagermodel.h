@@ -21,6 +21,7 @@
 #define CONTACTMANAGERMODEL_H
 
 #include <QAbstractTableModel>
+#include <QHash>
 #include <QSet>
 #include <QStringList>
 
@@ -67,22 +68,23 @@ public:
     QList<UserListItem *> checkedUsers();
     void                  invertByMatch(int columnIndex, int matchType, const QString &str);
 
-    void startBatch() { emit layoutAboutToBeChanged(); }
-    void stopBatch() { emit layoutChanged(); }
-
 private:
     PsiAccount *          pa_;
     QList<UserListItem *> _userList;
+    QHash<QString, int>   rows; // full jid -> row in _userList
     QStringList           columnNames;
     QList<Role>           roles;
     QSet<QString>         checks;
 
     QString userFieldString(UserListItem *u, ContactManagerModel::Role columnRole) const;
     void    contactUpdated(const Jid &);
+    void    reindex();
 
 private slots:
     void view_contactUpdated(const UserListItem &);
+    void client_rosterItemAdded(const RosterItem &);
     void client_rosterItemUpdated(const RosterItem &);
+    void client_rosterItemRemoved(const RosterItem &);
 };
 
 #endif // CONTACTMANAGERMODEL_H
@@ -19,24 +19,196 @@
 
 #include "debug.h"
 
+#include <QCoreApplication>
 #include <QDir>
+#include <QHash>
+#include <QMutex>
+#include <QSaveFile>
+#include <QThread>
 #include <config.h>
 
-SlowTimer::SlowTimer(const QString &path, int line, int maxTime, const QString &message) :
-    _path(QDir::fromNativeSeparators(path)), _line(line), _message(message), _maxTime(maxTime)
+// events per allocation of a thread's trace buffer
+#define TRACE_CHUNK_SIZE 4096
+// chunks per thread, events beyond TRACE_CHUNK_SIZE * TRACE_MAX_CHUNKS are dropped
+#define TRACE_MAX_CHUNKS 256
+
+// strips the source tree prefix of __FILE__
+static QString relativePath(const char *path)
+{
+    const int     stripSz = int(sizeof(__FILE__) - sizeof("src/debug.cpp"));
+    const QString p       = QDir::fromNativeSeparators(QString::fromUtf8(path));
+    return p.size() > stripSz ? p.mid(stripSz) : p;
+}
+
+//----------------------------------------------------------------------------
+// Trace
+//----------------------------------------------------------------------------
+namespace {
+struct TraceEvent {
+    const char *name;
+    int         line;
+    qint64      start;
+    qint64      duration;
+};
+
+// written only by its thread. the chunk pointers are set before count publishes their events
+class TraceBuffer {
+public:
+    quint64          threadId;
+    QString          threadName;
+    std::atomic<int> count { 0 };
+    TraceEvent *     chunks[TRACE_MAX_CHUNKS] = {};
+};
+
+QMutex               traceMutex; // guards traceBuffers, taken once per thread and on export
+QList<TraceBuffer *> traceBuffers;
+thread_local TraceBuffer *traceBuffer = nullptr;
+}
+
+std::atomic<bool> Trace::_enabled { false };
+
+void Trace::setEnabled(bool enabled)
+{
+    now(); // start the clock
+    _enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 Trace::now()
+{
+    static QElapsedTimer clock = [] {
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, int line, qint64 start, qint64 duration)
+{
+    TraceBuffer *b = traceBuffer;
+    if (!b) {
+        // buffers outlive their threads, the export may come later
+        b           = new TraceBuffer;
+        b->threadId = quint64(quintptr(QThread::currentThreadId()));
+        if (QThread::currentThread())
+            b->threadName = QThread::currentThread()->objectName();
+        if (b->threadName.isEmpty() && QCoreApplication::instance()
+            && QThread::currentThread() == QCoreApplication::instance()->thread())
+            b->threadName = QLatin1String("main");
+        traceBuffer = b;
+        QMutexLocker locker(&traceMutex);
+        traceBuffers += b;
+    }
+
+    const int n     = b->count.load(std::memory_order_relaxed);
+    const int chunk = n / TRACE_CHUNK_SIZE;
+    if (chunk >= TRACE_MAX_CHUNKS)
+        return;
+    if (!b->chunks[chunk])
+        b->chunks[chunk] = new TraceEvent[TRACE_CHUNK_SIZE];
+    b->chunks[chunk][n % TRACE_CHUNK_SIZE] = { name, line, start, duration };
+    b->count.store(n + 1, std::memory_order_release);
+}
+
+bool Trace::writeChromeJson(const QString &fileName)
 {
+    QMutexLocker locker(&traceMutex);
+
+    int total = 0;
+    for (TraceBuffer *b : qAsConst(traceBuffers))
+        total += b->count.load(std::memory_order_acquire);
+    if (!total)
+        return false;
+
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+
+    auto escaped = [](QString s) {
+        return s.replace(QLatin1Char('\\'), QLatin1String("\\\\")).replace(QLatin1Char('"'), QLatin1String("\\\""));
+    };
+
+    // the same file's name is converted only once
+    QHash<const char *, QString> names;
+    const QByteArray             pid   = QByteArray::number(QCoreApplication::applicationPid());
+    bool                         first = true;
+    f.write("{\"traceEvents\":[\n");
+    for (TraceBuffer *b : qAsConst(traceBuffers)) {
+        const QByteArray tid = QByteArray::number(b->threadId);
+        if (!b->threadName.isEmpty()) {
+            f.write(first ? "" : ",\n");
+            f.write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                    + ",\"args\":{\"name\":\"" + escaped(b->threadName).toUtf8() + "\"}}");
+            first = false;
+        }
+
+        const int count = b->count.load(std::memory_order_acquire);
+        for (int n = 0; n < count; ++n) {
+            const TraceEvent &e = b->chunks[n / TRACE_CHUNK_SIZE][n % TRACE_CHUNK_SIZE];
+            auto              it = names.find(e.name);
+            if (it == names.end())
+                it = names.insert(e.name, escaped(e.line > 0 ? relativePath(e.name) : QString::fromUtf8(e.name)));
+            QByteArray name = it->toUtf8();
+            if (e.line > 0)
+                name += ':' + QByteArray::number(e.line);
+
+            // microseconds with fractions, chrome sorts spans of the same start by duration
+            f.write(first ? "" : ",\n");
+            f.write("{\"name\":\"" + name + "\",\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + tid
+                    + ",\"ts\":" + QByteArray::number(double(e.start) / 1000, 'f', 3)
+                    + ",\"dur\":" + QByteArray::number(double(e.duration) / 1000, 'f', 3) + "}");
+            first = false;
+        }
+    }
+    f.write("\n]}\n");
+    return f.commit();
+}
+
+//----------------------------------------------------------------------------
+// SlowTimer
+//----------------------------------------------------------------------------
+static std::atomic<const char *> guiScopePath { nullptr };
+static std::atomic<int>          guiScopeLine { 0 };
+
+SlowTimer::SlowTimer(const char *path, int line, int maxTime, const QString &message) :
+    _path(path), _line(line), _message(message), _maxTime(maxTime), _traceStart(Trace::isEnabled() ? Trace::now() : -1),
+    _gui(QCoreApplication::instance() && QThread::currentThread() == QCoreApplication::instance()->thread())
+{
+    if (_gui) {
+        _outerPath = guiScopePath.load(std::memory_order_relaxed);
+        _outerLine = guiScopeLine.load(std::memory_order_relaxed);
+        guiScopeLine.store(line, std::memory_order_relaxed);
+        guiScopePath.store(path, std::memory_order_release);
+    }
     _timer.start();
 }
 
 SlowTimer::~SlowTimer()
 {
+    if (_gui) {
+        guiScopeLine.store(_outerLine, std::memory_order_relaxed);
+        guiScopePath.store(_outerPath, std::memory_order_release);
+    }
+    if (_traceStart >= 0)
+        Trace::record(_path, _line, _traceStart, Trace::now() - _traceStart);
+
     int t = int(_timer.elapsed());
     if (t >= _maxTime) {
-        const int stripSz = int(sizeof(__FILE__) - sizeof("src/debug.cpp"));
-        QString   relPath = _path.size() > stripSz ? _path.mid(stripSz) : _path;
+        QString relPath = relativePath(_path);
         if (_message.isEmpty())
             WARNING() << "[slow]" << QString("%1:%2 %3 milliseconds").arg(relPath).arg(_line).arg(t);
         else
             WARNING() << "[slow]" << QString("%1:%2 %3 %4 milliseconds").arg(relPath).arg(_line).arg(_message).arg(t);
     }
 }
+
+void SlowTimer::guiScope(const char **path, int *line)
+{
+    *path = guiScopePath.load(std::memory_order_acquire);
+    *line = guiScopeLine.load(std::memory_order_relaxed);
+}
+
+QString SlowTimer::relativeScope(const char *path, int line)
+{
+    return path ? QString("%1:%2").arg(relativePath(path)).arg(line) : QString();
+}
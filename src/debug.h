@@ -21,6 +21,7 @@
 
 #include <QDebug>
 #include <QElapsedTimer>
+#include <atomic>
 
 // history
 #define EDB_DEBUG() qDebug().noquote() << "[edb]"
@@ -40,17 +41,66 @@
 #define WARNING() qWarning().noquote()
 #define FATAL() QDebug(QtMsgType::QtFatalMsg).noquote()
 
+// Span tracing. While enabled, timed scopes go to per-thread buffers without locking and can be
+// written out as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev)
+class Trace {
+public:
+    static inline bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+    static void        setEnabled(bool enabled);
+
+    // nanoseconds since the first call
+    static qint64 now();
+    // name must outlive the process, a string literal or __FILE__ (with line > 0)
+    static void record(const char *name, int line, qint64 start, qint64 duration);
+    // false if nothing was recorded or the file couldn't be written
+    static bool writeChromeJson(const QString &fileName);
+
+private:
+    static std::atomic<bool> _enabled;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, int line = 0) :
+        _name(Trace::isEnabled() ? name : nullptr), _line(line), _start(_name ? Trace::now() : 0)
+    {
+    }
+    ~TraceScope()
+    {
+        if (_name)
+            Trace::record(_name, _line, _start, Trace::now() - _start);
+    }
+
+private:
+    const char *_name;
+    int         _line;
+    qint64      _start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+// warns about scopes taking maxTime milliseconds or more, and traces them like TRACE_SCOPE
 class SlowTimer {
 public:
-    SlowTimer(const QString &path, int line, int maxTime = 0, const QString &message = QString());
+    SlowTimer(const char *path, int line, int maxTime = 0, const QString &message = QString());
     ~SlowTimer();
 
+    // innermost scope of the gui thread, path is null outside of any. safe to call from any thread
+    static void    guiScope(const char **path, int *line);
+    static QString relativeScope(const char *path, int line); // "src/file.cpp:123"
+
 private:
     QElapsedTimer _timer;
-    QString       _path;
+    const char *  _path;
     int           _line;
     QString       _message;
     int           _maxTime;
+    qint64        _traceStart;
+    bool          _gui;       // constructed in the gui thread
+    const char *  _outerPath; // gui scope to restore on exit
+    int           _outerLine;
 };
 
 #define SLOW_TIMER(...) SlowTimer slowTimer(__FILE__, __LINE__, __VA_ARGS__)
@@ -27,6 +27,7 @@
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psiiconset.h"
+#include "psicapsregsitry.h"
 #include "psioptions.h"
 #include "psitooltip.h"
 #include "stretchwidget.h"
@@ -38,6 +39,7 @@
 #include <QCheckBox>
 #include <QComboBox>
 #include <QContextMenuEvent>
+#include <QDateTime>
 #include <QEvent>
 #include <QHeaderView>
 #include <QList>
@@ -47,6 +49,7 @@
 #include <QPushButton>
 #include <QScrollBar>
 #include <QSignalMapper>
+#include <QTimer>
 #include <QToolBar>
 #include <QToolButton>
 #include <QTreeWidget>
@@ -55,6 +58,12 @@
 
 #define MoreItemsType QTreeWidgetItem::UserType
 
+// seconds a disco result is reused by the dialogs of an account
+#define DISCO_CACHE_TTL 300
+
+// milliseconds the filter waits for more typing
+#define DISCO_FILTER_DELAY 200
+
 PsiIcon category2icon(PsiAccount *acc, const Jid &jid, const QString &category, const QString &type,
                       int status = STATUS_ONLINE)
 {
@@ -171,6 +180,78 @@ struct DiscoData {
     DiscoConnector *d;
 };
 
+//----------------------------------------------------------------------------
+// DiscoCache -- disco results of an account, shared by all its dialogs
+//----------------------------------------------------------------------------
+
+class DiscoCache : public QObject {
+    Q_OBJECT
+public:
+    static DiscoCache *instance(PsiAccount *pa)
+    {
+        DiscoCache *cache = pa->findChild<DiscoCache *>(QString(), Qt::FindDirectChildrenOnly);
+        if (!cache)
+            cache = new DiscoCache(pa);
+        return cache;
+    }
+
+    bool items(const QString &key, DiscoList *list) const
+    {
+        auto it = items_.constFind(key);
+        if (it == items_.constEnd() || it->stamp < expired())
+            return false;
+        *list = it->value;
+        return true;
+    }
+
+    bool info(const QString &key, const DiscoItem &di, DiscoItem *item) const
+    {
+        auto it = info_.constFind(key);
+        if (it != info_.constEnd() && it->stamp >= expired()) {
+            *item = it->value;
+            return true;
+        }
+        // clients announce their info with caps, no need to ask them again. services are
+        // always asked, transports are known to announce wrong caps
+        if (di.node().isEmpty() && !di.jid().resource().isEmpty()) {
+            *item = PsiCapsRegistry::discoInfo(pa_->client()->capsManager(), di.jid());
+            return !item->features().list().isEmpty() || !item->identities().isEmpty();
+        }
+        return false;
+    }
+
+    void setItems(const QString &key, const DiscoList &list) { items_.insert(key, { list, now() }); }
+    void setInfo(const QString &key, const DiscoItem &item) { info_.insert(key, { item, now() }); }
+
+    void forget(const QString &key)
+    {
+        items_.remove(key);
+        info_.remove(key);
+    }
+
+private:
+    DiscoCache(PsiAccount *pa) : QObject(pa), pa_(pa)
+    {
+        // what the server offers may change with the next session
+        connect(pa, &PsiAccount::disconnected, this, [this]() {
+            items_.clear();
+            info_.clear();
+        });
+    }
+
+    template <typename T> struct Entry {
+        T      value;
+        qint64 stamp;
+    };
+
+    static qint64 now() { return QDateTime::currentSecsSinceEpoch(); }
+    static qint64 expired() { return now() - DISCO_CACHE_TTL; }
+
+    PsiAccount *                     pa_;
+    QHash<QString, Entry<DiscoList>> items_; // complete listings only, pages aren't kept
+    QHash<QString, Entry<DiscoItem>> info_;
+};
+
 //----------------------------------------------------------------------------
 // DiscoBaseItem
 //----------------------------------------------------------------------------
@@ -240,11 +321,15 @@ public:
 
     void itemSelected();
 
-public slots: // the two are used internally by class, and also called by DiscoDlg::Private::refresh()
+public slots: // the two are used internally by class, and also called by refresh()
     void    updateInfo();
     void    updateItems(bool parentAutoItems = false, bool more = false);
     QString getErrorInfo() const;
 
+public:
+    // asks again, ignoring the cached results
+    void refresh();
+
 private slots:
     void discoItemsFinished();
     void discoInfoFinished();
@@ -254,6 +339,7 @@ private:
     DiscoData *          d;
     bool                 isRoot;
     bool                 alreadyItems, alreadyInfo;
+    bool                 fetchingMore;
     bool                 autoItems; // used in updateItemsFinished
     bool                 autoInfo;
     QString              errorInfo;
@@ -301,6 +387,7 @@ void DiscoListItem::init(DiscoItem _item, DiscoData *_d)
     copyItem(_item);
 
     alreadyItems = alreadyInfo = false;
+    fetchingMore = false;
 
     if (!autoItemsEnabled())
         setChildIndicatorPolicy(ShowIndicator);
@@ -414,8 +501,19 @@ void DiscoListItem::itemSelected()
         updateInfo();
 }
 
+void DiscoListItem::refresh()
+{
+    DiscoCache::instance(d->pa)->forget(hash());
+    updateItems();
+    updateInfo();
+}
+
 void DiscoListItem::updateItems(bool parentAutoItems, bool more)
 {
+    // scrolling to the "more items" row asks for the next page, once
+    if (more && fetchingMore)
+        return;
+
     if (parentAutoItems) {
         // save traffic
         if (alreadyItems)
@@ -437,6 +535,15 @@ void DiscoListItem::updateItems(bool parentAutoItems, bool more)
     if (!autoItemsEnabled())
         autoItems = false;
 
+    DiscoList cached;
+    if (!more && DiscoCache::instance(d->pa)->items(hash(), &cached)) {
+        alreadyItems = true;
+        updateItemsFinished(cached);
+        return;
+    }
+
+    fetchingMore = more;
+
     JT_DiscoItems *jt = new JT_DiscoItems(d->pa->client()->rootTask());
     connect(jt, SIGNAL(finished()), SLOT(discoItemsFinished()));
     int max = itemsPerPage();
@@ -457,8 +564,12 @@ void DiscoListItem::discoItemsFinished()
 {
     JT_DiscoItems *jt = static_cast<JT_DiscoItems *>(sender());
 
+    fetchingMore = false;
+
     if (jt->success()) {
         jt->extractSubsetInfo(subsets);
+        if (!subsets.isValid())
+            DiscoCache::instance(d->pa)->setItems(hash(), jt->items());
         updateItemsFinished(jt->items());
     } else if (!autoItems) {
         QString error = jt->statusString();
@@ -554,6 +665,14 @@ void DiscoListItem::autoItemsChildren() const
 
 void DiscoListItem::updateInfo()
 {
+    DiscoItem cached;
+    if (DiscoCache::instance(d->pa)->info(hash(), di, &cached)) {
+        updateInfo(cached);
+        alreadyInfo = true;
+        autoInfo    = false;
+        return;
+    }
+
     JT_DiscoInfo *jt = new JT_DiscoInfo(d->pa->client()->rootTask());
     jt->setAllowCache(
         false); // Workaround for a bug https://github.com/hanzz/spectrum2/issues/205 (invalid caps from transport)
@@ -568,6 +687,7 @@ void DiscoListItem::discoInfoFinished()
     JT_DiscoInfo *jt = static_cast<JT_DiscoInfo *>(sender());
 
     if (jt->success()) {
+        DiscoCache::instance(d->pa)->setInfo(hash(), jt->item());
         updateInfo(jt->item());
     } else {
         QString error_str  = jt->statusString();
@@ -648,6 +768,8 @@ class DiscoListView : public QTreeWidget {
     Q_OBJECT
 
     DiscoDlg *dlg;
+    QTimer *  filterTimer;
+    QString   filter;
 
 public:
     DiscoListView(DiscoDlg *parent);
@@ -655,6 +777,10 @@ public:
 public slots:
     void updateItemsVisibility(const QString &filter);
 
+private slots:
+    void applyFilter();
+    void fetchVisibleMore();
+
 protected:
     bool maybeTip(const QPoint &);
 
@@ -675,6 +801,14 @@ DiscoListView::DiscoListView(DiscoDlg *parent) : QTreeWidget(parent)
     setRootIsDecorated(false);
     setSortingEnabled(true);
     sortByColumn(1, Qt::AscendingOrder);
+    setUniformRowHeights(true);
+
+    filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    filterTimer->setInterval(DISCO_FILTER_DELAY);
+    connect(filterTimer, SIGNAL(timeout()), SLOT(applyFilter()));
+
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(fetchVisibleMore()));
 }
 
 void DiscoListView::resizeEvent(QResizeEvent *e)
@@ -795,8 +929,10 @@ static bool updateItemsRecursively(QTreeWidgetItem *parent, const QString &filte
     bool hidden = true;
     for (int j = 0; j < parent->childCount(); j++) {
         QTreeWidgetItem *i = parent->child(j);
+        // every setHidden() relayouts the view, most items keep their state
         if (filter.isEmpty()) {
-            i->setHidden(false);
+            if (i->isHidden())
+                i->setHidden(false);
             updateItemsRecursively(i, filter);
         } else {
             bool v = true;
@@ -805,7 +941,8 @@ static bool updateItemsRecursively(QTreeWidgetItem *parent, const QString &filte
             }
             v &= !(i->text(0).contains(filter, Qt::CaseInsensitive)
                    || i->text(1).contains(filter, Qt::CaseInsensitive));
-            i->setHidden(v);
+            if (i->isHidden() != v)
+                i->setHidden(v);
             hidden &= v;
         }
     }
@@ -814,10 +951,34 @@ static bool updateItemsRecursively(QTreeWidgetItem *parent, const QString &filte
 
 void DiscoListView::updateItemsVisibility(const QString &filter)
 {
+    this->filter = filter;
+    // a cleared filter shows everything at once
+    if (filter.isEmpty()) {
+        filterTimer->stop();
+        applyFilter();
+    } else
+        filterTimer->start();
+}
+
+void DiscoListView::applyFilter()
+{
+    setUpdatesEnabled(false);
     for (int n = 0; n < topLevelItemCount(); n++) {
         QTreeWidgetItem *it = topLevelItem(n);
         updateItemsRecursively(it, filter);
     }
+    setUpdatesEnabled(true);
+}
+
+void DiscoListView::fetchVisibleMore()
+{
+    // the next page is asked for as soon as its row is scrolled into view
+    if (verticalScrollBar()->value() < verticalScrollBar()->maximum())
+        return;
+
+    QTreeWidgetItem *twi = itemAt(QPoint(1, viewport()->height() - 1));
+    if (twi && twi->type() == MoreItemsType)
+        static_cast<DiscoBaseItem *>(twi)->itemClicked();
 }
 
 //----------------------------------------------------------------------------
@@ -1079,8 +1240,7 @@ void DiscoDlg::Private::actionRefresh()
     if (!it)
         return;
 
-    it->updateItems();
-    it->updateInfo();
+    it->refresh();
 }
 
 void DiscoDlg::Private::actionBrowse()
@@ -27,34 +27,45 @@
 #include "psicontactlist.h"
 #include "xmpp_jid.h"
 
+#include <QDataStream>
 #include <QDateTime>
 #include <QDir>
 #include <QFileInfo>
+#include <QSaveFile>
 #include <QTextStream>
 #include <QTimer>
 #include <QVector>
 
+#include <cstring>
+
 #define FAKEDELAY 0
 
 static const int MAX_FILES = 50;
 
+// line index sidecar: magic, version, history file size and mtime, count, then the offsets
+static const quint32 INDEX_MAGIC       = 0x50534958; // "PSIX"
+static const quint32 INDEX_VERSION     = 1;
+static const qint64  INDEX_HEADER_SIZE = 4 + 4 + 8 + 8 + 4;
+
 using namespace XMPP;
 
 //----------------------------------------------------------------------------
 // EDBFlatFile
 //----------------------------------------------------------------------------
 struct item_file_req {
-    Jid           j;
-    int           type; // 0 = latest, 1 = oldest, 2 = random, 3 = write
-    int           start;
-    int           len;
-    int           dir;
-    int           id;
-    QDateTime     date;
-    QString       findStr;
-    PsiEvent::Ptr event;
-
-    enum Type { Type_get, Type_append, Type_find, Type_erase };
+    Jid            j;
+    int            type; // 0 = latest, 1 = oldest, 2 = random, 3 = write
+    int            start;
+    int            fromId = -1; // line number for Type_get with a cursor
+    int            len;
+    int            dir;
+    int            id;
+    QDateTime      date;
+    QString        findStr;
+    PsiEvent::Ptr  event;
+    EDBAppendBatch batch;
+
+    enum Type { Type_get, Type_append, Type_appendBatch, Type_find, Type_erase };
 };
 
 class EDBFlatFile::Private {
@@ -94,6 +105,22 @@ int EDBFlatFile::get(const QString & /*accId*/, const Jid &j, const QDateTime da
     return r->id;
 }
 
+int EDBFlatFile::getFrom(const QString & /*accId*/, const Jid &j, const QString &fromId, int direction, int len)
+{
+    item_file_req *r = new item_file_req;
+    r->j             = j;
+    r->type          = item_file_req::Type_get;
+    r->start         = 0;
+    r->fromId        = fromId.toInt();
+    r->len           = len < 1 ? 1 : len;
+    r->dir           = direction;
+    r->id            = genUniqueId();
+    d->rlist.append(r);
+
+    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    return r->id;
+}
+
 int EDBFlatFile::find(const QString & /*accId*/, const QString &str, const Jid &j, const QDateTime date, int direction)
 {
     item_file_req *r = new item_file_req;
@@ -130,6 +157,21 @@ int EDBFlatFile::append(const QString & /*accId*/, const Jid &j, const PsiEvent:
     return r->id;
 }
 
+int EDBFlatFile::appendBatch(const QString & /*accId*/, const EDBAppendBatch &items)
+{
+    item_file_req *r = new item_file_req;
+    r->type          = item_file_req::Type_appendBatch;
+    for (const EDBAppendItem &item : items) {
+        if (item.type == EDB::Contact && item.event)
+            r->batch.append(item);
+    }
+    r->id = genUniqueId();
+    d->rlist.append(r);
+
+    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    return r->id;
+}
+
 int EDBFlatFile::erase(const QString & /*accId*/, const Jid &j)
 {
     item_file_req *r = new item_file_req;
@@ -206,6 +248,7 @@ bool EDBFlatFile::deleteFile(const Jid &j)
     } else {
         fname = File::jidToFileName(j);
     }
+    QFile::remove(fname + ".idx");
 
     QFileInfo fi(fname);
     if (fi.exists()) {
@@ -222,13 +265,28 @@ void EDBFlatFile::performRequests()
 
     item_file_req *r = d->rlist.takeFirst();
 
+    if (r->type == item_file_req::Type_appendBatch) {
+        bool b = true;
+        for (const EDBAppendItem &item : qAsConst(r->batch))
+            b = ensureFile(item.jid)->append(item.event) && b;
+        writeFinished(r->id, b);
+        delete r;
+        return;
+    }
+
     File *f    = ensureFile(r->j);
     int   type = r->type;
     if (type == item_file_req::Type_get) {
         EDBResult result;
         int       startId   = 0;
         int       direction = r->dir;
-        int       id        = f->getId(r->date, direction, r->start);
+        int       id;
+        if (r->fromId >= 0) {
+            id = r->fromId + ((direction == Forward) ? 1 : -1);
+            if (id < 0 || id >= f->total())
+                id = -1;
+        } else
+            id = f->getId(r->date, direction, r->start);
         if (id != -1) {
             int len;
             if (direction == Forward) {
@@ -367,32 +425,10 @@ void EDBFlatFile::File::ensureIndex()
             return;
         }
 
-        f.reset(); // go to beginning
-        d->index.clear();
-
-        // printf(" file: %s\n", fname.latin1());
-        // build index
-        while (1) {
-            quint64 at = quint64(f.pos());
-
-            // locate a newline
-            bool found = false;
-            char c;
-            while (f.getChar(&c)) {
-                if (c == '\n') {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found)
-                break;
-
-            int oldsize = d->index.size();
-            d->index.resize(oldsize + 1);
-            d->index[oldsize] = at;
+        if (!loadIndex()) {
+            scanIndex();
+            saveIndex();
         }
-
         d->indexed = true;
     } else {
         // printf(" file: can't open\n");
@@ -401,6 +437,109 @@ void EDBFlatFile::File::ensureIndex()
     // printf(" messages: %d\n\n", d->index.size());
 }
 
+void EDBFlatFile::File::scanIndex()
+{
+    d->index.clear();
+
+    const qint64 size = f.size();
+    if (size == 0)
+        return;
+
+    // an index entry is the start of every line terminated by a newline
+    // memchr() is vectorized by the C library, much faster than going through QFile::getChar()
+    quint64 lineStart = 0;
+    auto    scan      = [this, &lineStart](const char *data, qint64 len, quint64 base) {
+        const char *p   = data;
+        const char *end = data + len;
+        while (p < end) {
+            const char *nl = static_cast<const char *>(memchr(p, '\n', size_t(end - p)));
+            if (!nl)
+                break;
+            d->index.append(lineStart);
+            lineStart = base + quint64(nl - data) + 1;
+            p         = nl + 1;
+        }
+    };
+
+    uchar *map = f.map(0, size);
+    if (map) {
+        scan(reinterpret_cast<const char *>(map), size, 0);
+        f.unmap(map);
+        return;
+    }
+
+    // mapping may fail (e.g. on some network filesystems), then read it in blocks
+    f.reset();
+    QByteArray block;
+    quint64    base = 0;
+    while (!(block = f.read(1024 * 1024)).isEmpty()) {
+        scan(block.constData(), block.size(), base);
+        base += quint64(block.size());
+    }
+}
+
+QString EDBFlatFile::File::indexFileName() const { return fname + ".idx"; }
+
+bool EDBFlatFile::File::loadIndex()
+{
+    QFile idx(indexFileName());
+    if (!idx.open(QIODevice::ReadOnly))
+        return false;
+
+    QFileInfo   fi(fname);
+    QDataStream in(&idx);
+    quint32     magic, version, count;
+    qint64      size, mtime;
+    in >> magic >> version >> size >> mtime >> count;
+    if (in.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION || size != fi.size()
+        || mtime != fi.lastModified().toMSecsSinceEpoch() || idx.size() != INDEX_HEADER_SIZE + qint64(count) * 8)
+        return false;
+
+    d->index.resize(int(count));
+    for (quint32 n = 0; n < count; ++n)
+        in >> d->index[int(n)];
+    if (in.status() != QDataStream::Ok) {
+        d->index.clear();
+        return false;
+    }
+    return true;
+}
+
+void EDBFlatFile::File::saveIndex()
+{
+    QSaveFile idx(indexFileName());
+    if (!idx.open(QIODevice::WriteOnly))
+        return;
+
+    QFileInfo   fi(fname);
+    QDataStream out(&idx);
+    out << INDEX_MAGIC << INDEX_VERSION << qint64(fi.size()) << qint64(fi.lastModified().toMSecsSinceEpoch())
+        << quint32(d->index.size());
+    for (quint64 at : qAsConst(d->index))
+        out << at;
+    idx.commit();
+}
+
+void EDBFlatFile::File::appendIndex(quint64 at)
+{
+    d->index.append(at);
+
+    // the sidecar is extended in place, only the header and the new offset are written
+    QFile idx(indexFileName());
+    if (!idx.open(QIODevice::ReadWrite) || idx.size() != INDEX_HEADER_SIZE + qint64(d->index.size() - 1) * 8) {
+        idx.close();
+        saveIndex();
+        return;
+    }
+    QFileInfo   fi(fname);
+    QDataStream out(&idx);
+    idx.seek(idx.size());
+    out << at;
+    idx.seek(0);
+    out << INDEX_MAGIC << INDEX_VERSION << qint64(fi.size()) << qint64(fi.lastModified().toMSecsSinceEpoch())
+        << quint32(d->index.size());
+}
+
 int EDBFlatFile::File::total() const
 {
     const_cast<EDBFlatFile::File *>(this)->ensureIndex();
@@ -531,16 +670,13 @@ bool EDBFlatFile::File::append(const PsiEvent::Ptr &e)
 #endif
     f.flush();
 
-    if (d->indexed) {
-        int oldsize = d->index.size();
-        d->index.resize(oldsize + 1);
-        d->index[oldsize] = at;
-    }
+    if (d->indexed)
+        appendIndex(at);
 
     return true;
 }
 
-PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
+bool EDBFlatFile::File::lineToRecord(const QString &line, Record *rec)
 {
     // -- parse the line --
     enum { Time = 0, Type = 1, Origin = 2, Flags = 3, Subj = 4, UrlAddr = 5, UrlDesc = 6 };
@@ -581,7 +717,7 @@ PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
     }
 
     if (x1 == -1)
-        return PsiEvent::Ptr();
+        return false;
 
     // body text is last
     QString sText = line.mid(x1);
@@ -589,35 +725,20 @@ PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
     // -- read end --
 
     int type = strData.at(Type).toInt();
+    rec->date = QDateTime::fromString(strData.at(Time), Qt::ISODate);
+    rec->type = type;
     if (type == 0 || type == 1 || type == 4 || type == 5) {
-        Message m;
-        m.setTimeStamp(QDateTime::fromString(strData.at(Time), Qt::ISODate));
-        if (type == 1)
-            m.setType("chat");
-        else if (type == 4)
-            m.setType("error");
-        else if (type == 5)
-            m.setType("headline");
-        else
-            m.setType("");
-
-        bool originLocal = strData.at(Origin) == "to";
-        m.setFrom(j);
+        rec->originLocal = strData.at(Origin) == "to";
         if (strData.at(Flags).at(0) == 'N')
-            m.setBody(logdecode(sText));
+            rec->text = logdecode(sText);
         else
-            m.setBody(logdecode(QString::fromUtf8(sText.toLatin1())));
-        m.setSubject(logdecode(strData.at(Subj)));
-
-        QString url = logdecode(strData.at(UrlAddr));
-        if (!url.isEmpty())
-            m.urlAdd(Url(url, logdecode(strData.at(UrlDesc))));
-        m.setSpooled(true);
-
-        MessageEvent::Ptr me(new MessageEvent(m, nullptr));
-        me->setOriginLocal(originLocal);
-
-        return me.staticCast<PsiEvent>();
+            rec->text = logdecode(QString::fromUtf8(sText.toLatin1()));
+        rec->subject = logdecode(strData.at(Subj));
+        rec->url     = logdecode(strData.at(UrlAddr));
+        if (!rec->url.isEmpty())
+            rec->urlDesc = logdecode(strData.at(UrlDesc));
+        rec->authType.clear();
+        return true;
     } else if (type == 2 || type == 3 || type == 6 || type == 7 || type == 8) {
         QString subType = "subscribe";
         if (type == 2) {
@@ -636,12 +757,74 @@ PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
         else if (type == 8)
             subType = "unsubscribed";
 
-        AuthEvent::Ptr ae(new AuthEvent(j, subType, nullptr));
-        ae->setTimeStamp(QDateTime::fromString(strData.at(Time), Qt::ISODate));
+        rec->originLocal = false;
+        rec->authType    = subType;
+        return true;
+    }
+
+    return false;
+}
+
+PsiEvent::Ptr EDBFlatFile::File::lineToEvent(const QString &line)
+{
+    Record rec;
+    if (!lineToRecord(line, &rec))
+        return PsiEvent::Ptr();
+
+    if (!rec.authType.isEmpty()) {
+        AuthEvent::Ptr ae(new AuthEvent(j, rec.authType, nullptr));
+        ae->setTimeStamp(rec.date);
         return ae.staticCast<PsiEvent>();
     }
 
-    return PsiEvent::Ptr();
+    Message m;
+    m.setTimeStamp(rec.date);
+    if (rec.type == 1)
+        m.setType("chat");
+    else if (rec.type == 4)
+        m.setType("error");
+    else if (rec.type == 5)
+        m.setType("headline");
+    else
+        m.setType("");
+
+    m.setFrom(j);
+    m.setBody(rec.text);
+    m.setSubject(rec.subject);
+    if (!rec.url.isEmpty())
+        m.urlAdd(Url(rec.url, rec.urlDesc));
+    m.setSpooled(true);
+
+    MessageEvent::Ptr me(new MessageEvent(m, nullptr));
+    me->setOriginLocal(rec.originLocal);
+
+    return me.staticCast<PsiEvent>();
+}
+
+QList<EDBFlatFile::Record> EDBFlatFile::File::readRecords(const XMPP::Jid &j)
+{
+    QList<Record> records;
+    QFile         file(jidToFileName(j));
+    if (!file.open(QIODevice::ReadOnly))
+        return records;
+
+    // one sequential pass, no index needed
+    QTextStream t(&file);
+    t.setCodec("UTF-8");
+    Record rec;
+    int    n = 0;
+    while (!t.atEnd()) {
+        QString line = t.readLine();
+        ++n;
+        if (line.isEmpty())
+            continue;
+        if (lineToRecord(line, &rec))
+            records.append(rec);
+        else
+            qWarning("EDBFlatFile::File::readRecords() Failed to parse file %s, line %d",
+                     file.fileName().toLatin1().data(), n);
+    }
+    return records;
 }
 
 QString EDBFlatFile::File::eventToLine(const PsiEvent::Ptr &e)
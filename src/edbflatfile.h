@@ -37,14 +37,28 @@ public:
 
     int features() const;
     int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len);
+    int getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len);
     int find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
     int append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    int appendBatch(const QString &accId, const EDBAppendBatch &items);
     int erase(const QString &accId, const XMPP::Jid &);
     QList<EDB::ContactItem> contacts(const QString &accId, int type);
     quint64                 eventsCount(const QString &accId, const XMPP::Jid &jid);
     QString                 getStorageParam(const QString &) { return QString(); }
     void                    setStorageParam(const QString &, const QString &) { }
 
+    // a history line decoded into plain values, without building a PsiEvent
+    struct Record {
+        QDateTime date;
+        int       type        = 0;
+        bool      originLocal = false;
+        QString   subject;
+        QString   text;
+        QString   url;
+        QString   urlDesc;
+        QString   authType; // set for auth events only
+    };
+
     class File;
 
 private slots:
@@ -75,6 +89,8 @@ public:
     static QString                 jidToFileName(const XMPP::Jid &);
     static QString                 strToFileName(const QString &s);
     static QList<EDB::ContactItem> contacts(const QString &accId, int type);
+    static QList<Record>           readRecords(const XMPP::Jid &);
+    static bool                    lineToRecord(const QString &, Record *);
 
 signals:
     void timeout();
@@ -96,6 +112,11 @@ private:
     PsiEvent::Ptr lineToEvent(const QString &);
     QString       eventToLine(const PsiEvent::Ptr &);
     void          ensureIndex();
+    void          scanIndex();
+    QString       indexFileName() const;
+    bool          loadIndex();
+    void          saveIndex();
+    void          appendIndex(quint64 at);
     QString       getLine(int id);
     QDateTime     getDate(int id);
 };
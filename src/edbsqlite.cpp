@@ -19,30 +19,728 @@
 
 #include "applicationinfo.h"
 //#include "common.h"
+#include "debug.h"
 #include "edbsqlite.h"
 #include "historyimp.h"
 #include "jidutil.h"
 #include "psicontactlist.h"
+#include "psioptions.h"
 
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QMutex>
 #include <QSqlDriver>
 #include <QSqlError>
-
-#define FAKEDELAY 0
+#include <QThread>
+
+// the trigram tokenizer can't match anything shorter than this
+#define FTS_MIN_QUERY_LENGTH 3
+// seconds between the archive timestamp of a message and the one it was logged with live
+#define ARCHIVE_DATE_SLACK 120
+// events deleted per retention transaction, other requests get their turn between the chunks
+#define RETENTION_CHUNK 500
+// free pages given back to the file system per incremental vacuum step
+#define VACUUM_CHUNK 1024
+// msecs from the start to the first retention pass, and between the passes
+#define RETENTION_FIRST_DELAY (5 * 60 * 1000)
+#define RETENTION_INTERVAL (6 * 60 * 60 * 1000)
 
 using namespace XMPP;
 
+Q_DECLARE_METATYPE(QList<QSqlRecord>)
+
+//----------------------------------------------------------------------------
+// EDBSqLiteWorker
+//----------------------------------------------------------------------------
+
+// Runs all history requests in its own thread, using its own database connection.
+// Results go back to EDBSqLite as raw records, events are built in the GUI thread.
+class EDBSqLiteWorker : public QObject {
+    Q_OBJECT
+public:
+    EDBSqLiteWorker(bool fts);
+
+    void enqueue(EDBSqLite::item_query_req *r);
+    int  queued();
+
+public slots:
+    void open(const QString &path);
+    void close();
+    void setInsertingMode(int mode);
+    void performRequests();
+
+signals:
+    void resultReady(int id, const QList<QSqlRecord> &records, int beginRow);
+    void writeFinished(int id, bool success);
+
+private slots:
+    bool commit();
+
+private:
+    enum { NotActive, NotCommited, Commited };
+    int                                status;
+    unsigned int                       transactionsCounter;
+    QDateTime                          lastCommitTime;
+    unsigned int                       maxUncommitedRecs;
+    int                                maxUncommitedSecs;
+    unsigned int                       commitByTimeoutSecs;
+    QTimer *                           commitTimer;
+    bool                               ftsEnabled;
+    QMutex                             mutex;
+    QList<EDBSqLite::item_query_req *> rlist;
+    QHash<QString, qint64>             jidsCache;
+    QHash<QString, int>                rowCountCache;
+    EDBSqLite::QueryStorage            queryes;
+    QList<QPair<qint64, QDateTime>>    retentionList; // contact id, the oldest date kept
+    bool                               retentionActive;
+
+    void   processRequest(const EDBSqLite::item_query_req *r);
+    bool   appendEvent(const QString &accId, const XMPP::Jid &, const EDBSqLite::item_event_row &row, int);
+    bool   appendEvents(const QString &accId, const QList<EDBSqLite::item_append_row> &rows);
+    bool   insertEvent(const QString &accId, const XMPP::Jid &, const EDBSqLite::item_event_row &row, int);
+    bool   isStored(qint64 contactId, const EDBSqLite::item_event_row &row);
+    qint64 findJidRowId(const QString &accId, const QString &sJid);
+    qint64 ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type);
+    void   bindContact(EDBSqLite::PreparedQuery *query, const QString &accId, const XMPP::Jid &jid);
+    int    rowCount(const QString &accId, const XMPP::Jid &jid, const QDateTime before);
+    bool   eraseHistory(const QString &accId, const XMPP::Jid &);
+    bool   setLifetime(const QString &accId, const XMPP::Jid &, int type, int days);
+    void   planRetention(int chatDays, int mucDays);
+    bool   retentionStep();
+    bool   vacuumStep();
+    bool   transaction(bool now);
+    bool   rollback();
+    void   startAutocommitTimer();
+    void   stopAutocommitTimer();
+};
+
+EDBSqLiteWorker::EDBSqLiteWorker(bool fts) :
+    QObject(nullptr), status(NotActive), transactionsCounter(0), lastCommitTime(QDateTime::currentDateTime()),
+    commitTimer(nullptr), ftsEnabled(fts), queryes("history_worker"), retentionActive(false)
+{
+    setInsertingMode(EDBSqLite::Normal);
+}
+
+void EDBSqLiteWorker::enqueue(EDBSqLite::item_query_req *r)
+{
+    mutex.lock();
+    rlist.append(r);
+    mutex.unlock();
+    QMetaObject::invokeMethod(this, "performRequests", Qt::QueuedConnection);
+}
+
+int EDBSqLiteWorker::queued()
+{
+    QMutexLocker locker(&mutex);
+    return rlist.size();
+}
+
+void EDBSqLiteWorker::open(const QString &path)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "history_worker");
+    db.setDatabaseName(path);
+    if (!db.open()) {
+        qWarning("%s\n%s", "EDBSqLiteWorker::open(): Can't open base.", qUtf8Printable(db.lastError().text()));
+        return;
+    }
+    QSqlQuery query(db);
+    query.exec("PRAGMA foreign_keys = ON;");
+    // with WAL a commit no longer needs a full sync, a power loss may only drop the last transactions
+    query.exec("PRAGMA synchronous = NORMAL;");
+    status = Commited;
+}
+
+void EDBSqLiteWorker::close()
+{
+    commit();
+    queryes.clear();
+    {
+        QSqlDatabase db = QSqlDatabase::database("history_worker", false);
+        if (db.isOpen())
+            db.close();
+    }
+    QSqlDatabase::removeDatabase("history_worker");
+    status = NotActive;
+}
+
+void EDBSqLiteWorker::setInsertingMode(int mode)
+{
+    // in the case of a flow of new records
+    if (mode == EDBSqLite::Import) {
+        // Commit after 10000 inserts and every 5 seconds
+        maxUncommitedRecs = 10000;
+        maxUncommitedSecs = 5;
+    } else {
+        // Commit after 3 inserts and every 1 second
+        maxUncommitedRecs = 3;
+        maxUncommitedSecs = 1;
+    }
+    // Commit if there were no new additions for 1 second
+    commitByTimeoutSecs = 1;
+    //--
+    commit();
+}
+
+void EDBSqLiteWorker::performRequests()
+{
+    forever {
+        mutex.lock();
+        EDBSqLite::item_query_req *r = rlist.isEmpty() ? nullptr : rlist.takeFirst();
+        mutex.unlock();
+        if (!r)
+            break;
+        processRequest(r);
+        delete r;
+    }
+}
+
+void EDBSqLiteWorker::processRequest(const EDBSqLite::item_query_req *r)
+{
+    // in the order of item_query_req::Type
+    static const char *traceNames[] = { "EDBSqLite::get", "EDBSqLite::append", "EDBSqLite::appendBatch",
+                                        "EDBSqLite::find", "EDBSqLite::erase", "EDBSqLite::setLifetime",
+                                        "EDBSqLite::retention" };
+    const int          type         = r->type;
+    TraceScope         traceScope(traceNames[type]);
+
+    if (type == EDBSqLite::item_query_req::Type_append) {
+        bool b = appendEvent(r->accId, r->j, r->row, r->jidType);
+        emit writeFinished(r->id, b);
+    }
+
+    else if (type == EDBSqLite::item_query_req::Type_appendBatch) {
+        emit writeFinished(r->id, appendEvents(r->accId, r->batch));
+    }
+
+    else if (type == EDBSqLite::item_query_req::Type_get) {
+        commit();
+        bool      fContAll = r->j.isEmpty();
+        bool      fAccAll  = r->accId.isEmpty();
+        QueryType queryType;
+        if (r->fromId != 0) {
+            if (r->dir == EDB::Backward)
+                queryType = QuerySeekBackward;
+            else
+                queryType = QuerySeekForward;
+        } else if (r->date.isNull()) {
+            if (r->dir == EDB::Forward)
+                queryType = QueryOldest;
+            else
+                queryType = QueryLatest;
+        } else {
+            if (r->dir == EDB::Backward)
+                queryType = QueryDateBackward;
+            else
+                queryType = QueryDateForward;
+        }
+        EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(queryType, fAccAll, fContAll);
+        bindContact(query, r->accId, r->j);
+        if (r->fromId != 0)
+            query->bindValue(":id", r->fromId);
+        else {
+            if (!r->date.isNull())
+                query->bindValue(":date", r->date);
+            query->bindValue(":start", r->start);
+        }
+        query->bindValue(":cnt", r->len);
+        QList<QSqlRecord> result;
+        if (query->exec()) {
+            while (query->next())
+                result.append(query->record());
+            query->freeResult();
+        }
+        // cursor requests don't count rows, that's the point of them
+        int beginRow = 0;
+        if (r->fromId == 0) {
+            if (r->dir == EDB::Forward && r->date.isNull()) {
+                beginRow = r->start;
+            } else {
+                int cnt = rowCount(r->accId, r->j, r->date);
+                if (r->dir == EDB::Backward) {
+                    beginRow = cnt - r->len + 1;
+                    if (beginRow < 0)
+                        beginRow = 0;
+                } else {
+                    beginRow = cnt + 1;
+                }
+            }
+        }
+        emit resultReady(r->id, result, beginRow);
+
+    } else if (type == EDBSqLite::item_query_req::Type_find) {
+        commit();
+        bool fContAll = r->j.isEmpty();
+        bool fAccAll  = r->accId.isEmpty();
+        // the full-text index only narrows down the candidates, the exact match check is below
+        bool                      fUseFts = ftsEnabled && r->findStr.length() >= FTS_MIN_QUERY_LENGTH;
+        EDBSqLite::PreparedQuery *query
+            = queryes.getPreparedQuery(fUseFts ? QueryFindTextFts : QueryFindText, fAccAll, fContAll);
+        bindContact(query, r->accId, r->j);
+        if (fUseFts)
+            query->bindValue(":match", QString("\"%1\"").arg(QString(r->findStr).replace('"', "\"\"")));
+        QList<QSqlRecord> result;
+        if (query->exec()) {
+            QString str = r->findStr.toLower();
+            while (query->next()) {
+                const QSqlRecord rec = query->record();
+                if (!rec.value("m_text").toString().toLower().contains(str, Qt::CaseSensitive))
+                    continue;
+                result.append(rec);
+            }
+            query->freeResult();
+        }
+        emit resultReady(r->id, result, 0);
+
+    } else if (type == EDBSqLite::item_query_req::Type_erase) {
+        emit writeFinished(r->id, eraseHistory(r->accId, r->j));
+
+    } else if (type == EDBSqLite::item_query_req::Type_lifetime) {
+        emit writeFinished(r->id, setLifetime(r->accId, r->j, r->jidType, r->lifetime));
+
+    } else if (type == EDBSqLite::item_query_req::Type_retention) {
+        // a new pass while the previous one still runs is dropped, start = 1 continues a pass
+        if (r->start == 0) {
+            if (retentionActive)
+                return;
+            planRetention(r->chatDays, r->mucDays);
+        }
+        // one chunk per request, the next one is queued behind whatever came in meanwhile
+        if (retentionStep()) {
+            EDBSqLite::item_query_req *next = new EDBSqLite::item_query_req;
+            next->type                      = EDBSqLite::item_query_req::Type_retention;
+            next->start                     = 1;
+            next->id                        = 0;
+            enqueue(next);
+        }
+    }
+}
+
+bool EDBSqLiteWorker::appendEvent(const QString &accId, const XMPP::Jid &jid, const EDBSqLite::item_event_row &row,
+                                  int jidType)
+{
+    if (!row.valid || !transaction(false))
+        return false;
+    return insertEvent(accId, jid, row, jidType);
+}
+
+bool EDBSqLiteWorker::appendEvents(const QString &accId, const QList<EDBSqLite::item_append_row> &rows)
+{
+    // the whole batch is a single transaction, so it costs one commit
+    if (!transaction(true))
+        return false;
+    for (const EDBSqLite::item_append_row &r : rows) {
+        if (r.row.valid && !insertEvent(accId, r.j, r.row, r.jidType)) {
+            rollback();
+            return false;
+        }
+    }
+    return commit();
+}
+
+bool EDBSqLiteWorker::insertEvent(const QString &accId, const XMPP::Jid &jid, const EDBSqLite::item_event_row &row,
+                                  int jidType)
+{
+    const qint64 contactId = ensureJidRowId(accId, jid, jidType);
+    if (contactId == 0)
+        return false;
+
+    if (!row.stanzaId.isNull() && isStored(contactId, row))
+        return true;
+
+    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryInsertEvent, false, false);
+    query->bindValue(":contact_id", contactId);
+    query->bindValue(":resource", (jidType != EDB::GroupChatContact) ? jid.resource() : "");
+    query->bindValue(":date", row.date);
+    query->bindValue(":type", row.type);
+    query->bindValue(":direction", row.direction);
+    query->bindValue(":subject", row.subject);
+    query->bindValue(":m_text", row.text);
+    query->bindValue(":lang", row.lang);
+    query->bindValue(":extra_data", row.extraData);
+    query->bindValue(":stanza_id", row.stanzaId);
+    bool res = query->exec();
+    if (res) {
+        // the same keys rowCount() uses for this contact and for the "all" variants
+        const QString sJid = (jidType == EDB::GroupChatContact) ? jid.full() : jid.bare();
+        rowCountCache.remove(accId + "|" + sJid);
+        rowCountCache.remove("|" + sJid);
+        rowCountCache.remove(accId + "|");
+        rowCountCache.remove("|");
+    }
+    return res;
+}
+
+bool EDBSqLiteWorker::isStored(qint64 contactId, const EDBSqLite::item_event_row &row)
+{
+    // by the archive id, or as logged from the live stream, which has no id and a local timestamp
+    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryStoredEvent, false, false);
+    query->bindValue(":contact_id", contactId);
+    query->bindValue(":stanza_id", row.stanzaId);
+    query->bindValue(":date_from", row.date.addSecs(-ARCHIVE_DATE_SLACK));
+    query->bindValue(":date_to", row.date.addSecs(ARCHIVE_DATE_SLACK));
+    query->bindValue(":direction", row.direction);
+    query->bindValue(":m_text", row.text);
+    bool found = false;
+    if (query->exec()) {
+        found = query->first();
+        query->freeResult();
+    }
+    return found;
+}
+
+qint64 EDBSqLiteWorker::findJidRowId(const QString &accId, const QString &sJid)
+{
+    QString sKey = accId + "|" + sJid;
+    qint64  id   = jidsCache.value(sKey, 0);
+    if (id != 0)
+        return id;
+
+    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
+    query->bindValue(":jid", sJid);
+    query->bindValue(":acc_id", accId);
+    if (query->exec()) {
+        if (query->first())
+            id = query->record().value("id").toLongLong();
+        query->freeResult();
+        if (id != 0)
+            jidsCache[sKey] = id;
+    }
+    return id;
+}
+
+qint64 EDBSqLiteWorker::ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type)
+{
+    if (jid.isEmpty())
+        return 0;
+    QString sJid = (type == EDB::GroupChatContact) ? jid.full() : jid.bare();
+    qint64  id   = findJidRowId(accId, sJid);
+    if (id != 0)
+        return id;
+
+    QSqlQuery queryIns(QSqlDatabase::database("history_worker"));
+    queryIns.prepare("INSERT INTO `contacts` (`acc_id`, `type`, `jid`, `lifetime`)"
+                     " VALUES (:acc_id, :type, :jid, -1);");
+    queryIns.bindValue(":acc_id", accId);
+    queryIns.bindValue(":type", type);
+    queryIns.bindValue(":jid", sJid);
+    if (queryIns.exec()) {
+        id = queryIns.lastInsertId().toLongLong();
+        if (id != 0)
+            jidsCache[accId + "|" + sJid] = id;
+    }
+    return id;
+}
+
+void EDBSqLiteWorker::bindContact(EDBSqLite::PreparedQuery *query, const QString &accId, const XMPP::Jid &jid)
+{
+    bool fAccAll  = accId.isEmpty();
+    bool fContAll = jid.isEmpty();
+    if (!fAccAll && !fContAll) {
+        // an unknown contact gets id 0, which matches no events
+        query->bindValue(":contact_id", findJidRowId(accId, jid.full()));
+        return;
+    }
+    if (!fContAll)
+        query->bindValue(":jid", jid.full());
+    if (!fAccAll)
+        query->bindValue(":acc_id", accId);
+}
+
+int EDBSqLiteWorker::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime before)
+{
+    const QString sKey = accId + "|" + jid.full();
+    if (before.isNull()) {
+        auto it = rowCountCache.constFind(sKey);
+        if (it != rowCountCache.constEnd())
+            return it.value();
+    }
+
+    bool      fAccAll  = accId.isEmpty();
+    bool      fContAll = jid.isEmpty();
+    QueryType type;
+    if (before.isNull())
+        type = QueryRowCount;
+    else
+        type = QueryRowCountBefore;
+    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(type, fAccAll, fContAll);
+    bindContact(query, accId, jid);
+    if (!before.isNull())
+        query->bindValue(":date", before);
+    int res = 0;
+    if (query->exec()) {
+        if (query->next()) {
+            res = query->record().value("count").toInt();
+        }
+        query->freeResult();
+        if (before.isNull())
+            rowCountCache.insert(sKey, res);
+    }
+    return res;
+}
+
+bool EDBSqLiteWorker::eraseHistory(const QString &accId, const XMPP::Jid &jid)
+{
+    rowCountCache.clear();
+    bool res = false;
+    if (!transaction(true))
+        return false;
+
+    if (accId.isEmpty() && jid.isEmpty()) {
+        QSqlQuery query(QSqlDatabase::database("history_worker"));
+        // if (query.exec("DELETE FROM `events`;"))
+        if (query.exec("DELETE FROM `contacts`;")) {
+            jidsCache.clear();
+            res = true;
+        }
+    } else {
+        EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
+        query->bindValue(":jid", jid.full());
+        query->bindValue(":acc_id", accId);
+        if (query->exec()) {
+            if (query->next()) {
+                const qint64 id = query->record().value("id").toLongLong();
+                QSqlQuery    query2(QSqlDatabase::database("history_worker"));
+                query2.prepare("DELETE FROM `events` WHERE `contact_id` = :id;");
+                query2.bindValue(":id", id);
+                if (query2.exec()) {
+                    res = true;
+                    query2.prepare("DELETE FROM `contacts` WHERE `id` = :id AND `lifetime` = -1;");
+                    query2.bindValue(":id", id);
+                    if (query2.exec()) {
+                        if (query2.numRowsAffected() > 0)
+                            jidsCache.clear();
+                    } else
+                        res = false;
+                }
+            }
+            query->freeResult();
+        }
+    }
+    if (res)
+        res = commit();
+    else
+        rollback();
+    return res;
+}
+
+bool EDBSqLiteWorker::setLifetime(const QString &accId, const XMPP::Jid &jid, int type, int days)
+{
+    if (!transaction(true))
+        return false;
+    QSqlQuery query(QSqlDatabase::database("history_worker"));
+    bool      res;
+    if (jid.isEmpty()) {
+        query.prepare("DELETE FROM `accounts` WHERE `id` = :id;");
+        query.bindValue(":id", accId);
+        res = query.exec();
+        if (res && days != -1) {
+            query.prepare("INSERT INTO `accounts` (`id`, `lifetime`) VALUES (:id, :lifetime);");
+            query.bindValue(":id", accId);
+            query.bindValue(":lifetime", days);
+            res = query.exec();
+        }
+    } else {
+        const qint64 id = ensureJidRowId(accId, jid, type);
+        query.prepare("UPDATE `contacts` SET `lifetime` = :lifetime WHERE `id` = :id;");
+        query.bindValue(":lifetime", days);
+        query.bindValue(":id", id);
+        res = id != 0 && query.exec();
+    }
+    if (res)
+        res = commit();
+    else
+        rollback();
+    return res;
+}
+
+void EDBSqLiteWorker::planRetention(int chatDays, int mucDays)
+{
+    struct Row {
+        qint64  id;
+        int     type;
+        QString accId;
+        QString jid;
+        int     lifetime;
+        int     accLifetime;
+    };
+    commit();
+    QList<Row>          rows;
+    QHash<QString, int> rooms;
+    QSqlQuery           query(QSqlDatabase::database("history_worker"));
+    if (!query.exec("SELECT `contacts`.`id`, `contacts`.`type`, `contacts`.`acc_id`, `contacts`.`jid`, "
+                    "`contacts`.`lifetime`, `accounts`.`lifetime` FROM `contacts` "
+                    "LEFT JOIN `accounts` ON `accounts`.`id` = `contacts`.`acc_id`;"))
+        return;
+    while (query.next()) {
+        Row row { query.value(0).toLongLong(),
+                  query.value(1).toInt(),
+                  query.value(2).toString(),
+                  query.value(3).toString(),
+                  query.value(4).isNull() ? -1 : query.value(4).toInt(),
+                  query.value(5).isNull() ? -1 : query.value(5).toInt() };
+        // a room's own row carries the lifetime of its private chats
+        if (row.type == EDB::GroupChatContact && row.lifetime != -1)
+            rooms.insert(row.accId + "|" + row.jid, row.lifetime);
+        rows.append(row);
+    }
+    query.finish();
+
+    const QDateTime now = QDateTime::currentDateTime();
+    for (const Row &row : qAsConst(rows)) {
+        int days = row.lifetime;
+        if (days == -1 && row.type == EDB::GroupChatContact)
+            days = rooms.value(row.accId + "|" + XMPP::Jid(row.jid).bare(), -1);
+        if (days == -1)
+            days = row.accLifetime;
+        if (days == -1)
+            days = (row.type == EDB::GroupChatContact) ? mucDays : chatDays;
+        if (days > 0)
+            retentionList.append({ row.id, now.addDays(-days) });
+    }
+    retentionActive = true;
+}
+
+bool EDBSqLiteWorker::retentionStep()
+{
+    if (!retentionActive)
+        return false;
+    if (retentionList.isEmpty())
+        return vacuumStep();
+
+    const QPair<qint64, QDateTime> item = retentionList.first();
+    if (!transaction(true)) {
+        retentionList.clear();
+        retentionActive = false;
+        return false;
+    }
+    QSqlQuery query(QSqlDatabase::database("history_worker"));
+    query.prepare("DELETE FROM `events` WHERE `id` IN (SELECT `id` FROM `events` "
+                  "WHERE `contact_id` = :id AND `date` < :date ORDER BY `date` LIMIT :cnt);");
+    query.bindValue(":id", item.first);
+    query.bindValue(":date", item.second);
+    query.bindValue(":cnt", RETENTION_CHUNK);
+    const bool res     = query.exec();
+    const int  deleted = res ? query.numRowsAffected() : 0;
+    if (!res || !commit()) {
+        qWarning("%s\n%s", "EDBSqLiteWorker::retentionStep(): Can't delete expired events.",
+                 qUtf8Printable(query.lastError().text()));
+        rollback();
+        retentionList.clear();
+        retentionActive = false;
+        return false;
+    }
+    if (deleted > 0)
+        rowCountCache.clear();
+    if (deleted < RETENTION_CHUNK)
+        retentionList.removeFirst();
+    return true;
+}
+
+bool EDBSqLiteWorker::vacuumStep()
+{
+    // pages can only be given back outside of a transaction
+    commit();
+    QSqlQuery query(QSqlDatabase::database("history_worker"));
+    int       autoVacuum = 0, pages = 0, freePages = 0;
+    if (query.exec("PRAGMA auto_vacuum;") && query.next())
+        autoVacuum = query.value(0).toInt();
+    if (query.exec("PRAGMA page_count;") && query.next())
+        pages = query.value(0).toInt();
+    if (query.exec("PRAGMA freelist_count;") && query.next())
+        freePages = query.value(0).toInt();
+    query.finish();
+    bool more = false;
+    if (autoVacuum == 2) {
+        if (freePages > 0 && query.exec(QString("PRAGMA incremental_vacuum(%1);").arg(VACUUM_CHUNK))) {
+            // every step of the statement frees a page
+            while (query.next()) { }
+            more = freePages > VACUUM_CHUNK;
+        }
+    } else if (freePages * 4 > pages) {
+        // databases made before incremental vacuum was enabled are rebuilt once, when it pays off
+        query.exec("PRAGMA auto_vacuum = INCREMENTAL;");
+        if (!query.exec("VACUUM;"))
+            qWarning("%s\n%s", "EDBSqLiteWorker::vacuumStep(): Can't vacuum.",
+                     qUtf8Printable(query.lastError().text()));
+    }
+    if (!more)
+        retentionActive = false;
+    return more;
+}
+
+bool EDBSqLiteWorker::transaction(bool now)
+{
+    if (status == NotActive)
+        return false;
+    if (now || transactionsCounter >= maxUncommitedRecs
+        || lastCommitTime.secsTo(QDateTime::currentDateTime()) >= maxUncommitedSecs)
+        if (!commit())
+            return false;
+
+    if (status == Commited) {
+        if (!QSqlDatabase::database("history_worker").transaction())
+            return false;
+        status = NotCommited;
+    }
+    ++transactionsCounter;
+
+    startAutocommitTimer();
+
+    return true;
+}
+
+bool EDBSqLiteWorker::commit()
+{
+    if (status != NotActive) {
+        if (status == Commited || QSqlDatabase::database("history_worker").commit()) {
+            transactionsCounter = 0;
+            lastCommitTime      = QDateTime::currentDateTime();
+            status              = Commited;
+            stopAutocommitTimer();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EDBSqLiteWorker::rollback()
+{
+    if (status == NotCommited && QSqlDatabase::database("history_worker").rollback()) {
+        transactionsCounter = 0;
+        lastCommitTime      = QDateTime::currentDateTime();
+        status              = Commited;
+        stopAutocommitTimer();
+        return true;
+    }
+    return false;
+}
+
+void EDBSqLiteWorker::startAutocommitTimer()
+{
+    if (!commitTimer) {
+        commitTimer = new QTimer(this);
+        connect(commitTimer, SIGNAL(timeout()), this, SLOT(commit()));
+        commitTimer->setSingleShot(true);
+        commitTimer->setInterval(int(commitByTimeoutSecs) * 1000);
+    }
+    commitTimer->start();
+}
+
+void EDBSqLiteWorker::stopAutocommitTimer()
+{
+    if (commitTimer && commitTimer->isActive())
+        commitTimer->stop();
+}
+
 //----------------------------------------------------------------------------
 // EDBSqLite
 //----------------------------------------------------------------------------
 
 EDBSqLite::EDBSqLite(PsiCon *psi) :
-    EDB(psi), transactionsCounter(0), lastCommitTime(QDateTime::currentDateTime()), commitTimer(nullptr),
-    mirror_(nullptr)
+    EDB(psi), active(false), mirror_(nullptr), queryes("history"), ftsEnabled(false), workerThread(nullptr),
+    worker(nullptr), retentionTimer(nullptr)
 {
-    status            = NotActive;
     QString      path = ApplicationInfo::historyDir() + "/history.db";
     QSqlDatabase db   = QSqlDatabase::addDatabase("QSQLITE", "history");
     db.setDatabaseName(path);
@@ -52,9 +750,12 @@ EDBSqLite::EDBSqLite(PsiCon *psi) :
     }
     QSqlQuery query(db);
     query.exec("PRAGMA foreign_keys = ON;");
-    setInsertingMode(Normal);
+    // lets the worker thread write while this connection reads
+    query.exec("PRAGMA journal_mode = WAL;");
     if (db.tables(QSql::Tables).size() == 0) {
         // no tables found.
+        // has to be set before the first table, freed pages are then given back without a full VACUUM
+        query.exec("PRAGMA auto_vacuum = INCREMENTAL;");
         if (db.transaction()) {
             query.exec("CREATE TABLE `system` ("
                        "`key` TEXT, "
@@ -81,25 +782,55 @@ EDBSqLite::EDBSqLite(PsiCon *psi) :
                        "`subject` TEXT, "
                        "`m_text` TEXT, "
                        "`lang` TEXT, "
-                       "`extra_data` TEXT"
+                       "`extra_data` TEXT, "
+                       "`stanza_id` TEXT"
                        ");");
             query.exec("CREATE INDEX `key` ON `system` (`key`);");
             query.exec("CREATE INDEX `jid` ON `contacts` (`jid`);");
-            query.exec("CREATE INDEX `contact_id` ON `events` (`contact_id`);");
+            query.exec("CREATE INDEX `contact_date` ON `events` (`contact_id`, `date`, `id`);");
             query.exec("CREATE INDEX `date` ON `events` (`date`);");
+            query.exec("CREATE INDEX `contact_stanza` ON `events` (`contact_id`, `stanza_id`);");
             if (db.commit()) {
-                status = Commited;
-                setStorageParam("version", "0.1");
+                active = true;
+                setStorageParam("version", "0.3");
                 setStorageParam("import_start", "yes");
             }
         }
     } else
-        status = Commited;
+        active = true;
+
+    if (!active || !upgradeSchema()) {
+        active = false;
+        return;
+    }
+
+    ftsEnabled = ensureFullTextIndex();
+
+    qRegisterMetaType<QList<QSqlRecord>>();
+    workerThread = new QThread(this);
+    worker       = new EDBSqLiteWorker(ftsEnabled);
+    worker->moveToThread(workerThread);
+    connect(worker, &EDBSqLiteWorker::resultReady, this, &EDBSqLite::worker_resultReady, Qt::QueuedConnection);
+    connect(worker, &EDBSqLiteWorker::writeFinished, this, &EDBSqLite::worker_writeFinished, Qt::QueuedConnection);
+    workerThread->start();
+    QMetaObject::invokeMethod(worker, "open", Qt::QueuedConnection, Q_ARG(QString, path));
+
+    retentionTimer = new QTimer(this);
+    retentionTimer->setSingleShot(true);
+    retentionTimer->setInterval(RETENTION_FIRST_DELAY);
+    connect(retentionTimer, &QTimer::timeout, this, &EDBSqLite::startRetention);
+    retentionTimer->start();
 }
 
 EDBSqLite::~EDBSqLite()
 {
-    commit();
+    if (worker) {
+        QMetaObject::invokeMethod(worker, "close", Qt::BlockingQueuedConnection);
+        workerThread->quit();
+        workerThread->wait();
+        delete worker;
+    }
+    queryes.clear();
     {
         QSqlDatabase db = QSqlDatabase::database("history", false);
         if (db.isOpen())
@@ -111,12 +842,12 @@ EDBSqLite::~EDBSqLite()
 
 bool EDBSqLite::init()
 {
-    if (status == NotActive)
+    if (!active)
         return false;
 
     if (!getStorageParam("import_start").isEmpty()) {
         if (!importExecute()) {
-            status = NotActive;
+            active = false;
             return false;
         }
     }
@@ -125,7 +856,10 @@ bool EDBSqLite::init()
     return true;
 }
 
-int EDBSqLite::features() const { return SeparateAccounts | PrivateContacts | AllContacts | AllAccounts; }
+int EDBSqLite::features() const
+{
+    return SeparateAccounts | PrivateContacts | AllContacts | AllAccounts | ArchiveIds;
+}
 
 int EDBSqLite::get(const QString &accId, const XMPP::Jid &jid, QDateTime date, int direction, int start, int len)
 {
@@ -138,10 +872,25 @@ int EDBSqLite::get(const QString &accId, const XMPP::Jid &jid, QDateTime date, i
     r->dir            = direction;
     r->date           = date;
     r->id             = genUniqueId();
-    rlist.append(r);
+    const int id      = r->id;
+    queueRequest(r);
+    return id;
+}
 
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
-    return r->id;
+int EDBSqLite::getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len)
+{
+    item_query_req *r = new item_query_req;
+    r->accId          = accId;
+    r->j              = jid;
+    r->type           = item_query_req::Type_get;
+    r->start          = 0;
+    r->len            = len < 1 ? 1 : len;
+    r->dir            = direction;
+    r->fromId         = fromId.toLongLong();
+    r->id             = genUniqueId();
+    const int id      = r->id;
+    queueRequest(r);
+    return id;
 }
 
 int EDBSqLite::find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date, int direction)
@@ -155,34 +904,73 @@ int EDBSqLite::find(const QString &accId, const QString &str, const XMPP::Jid &j
     r->findStr        = str;
     r->date           = date;
     r->id             = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
-    return r->id;
+    const int id      = r->id;
+    queueRequest(r);
+    return id;
 }
 
 int EDBSqLite::append(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int type)
 {
+    if (!e) {
+        qWarning("EDBSqLite::append(): Attempted to append incompatible type.");
+        return 0;
+    }
     item_query_req *r = new item_query_req;
     r->accId          = accId;
     r->j              = jid;
     r->jidType        = type;
     r->type           = item_query_req::Type_append;
-    r->event          = e;
-    if (!r->event) {
-        qWarning("EDBSqLite::append(): Attempted to append incompatible type.");
-        delete r;
-        return 0;
-    }
-    r->id = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    r->row            = eventRow(e);
+    r->id             = genUniqueId();
+    const int id      = r->id;
+    queueRequest(r);
 
     if (mirror_)
         mirror_->append(accId, jid, e, type);
 
-    return r->id;
+    return id;
+}
+
+int EDBSqLite::appendBatch(const QString &accId, const EDBAppendBatch &items)
+{
+    item_query_req *r = new item_query_req;
+    r->accId          = accId;
+    r->type           = item_query_req::Type_appendBatch;
+    EDBAppendBatch  mirrored;
+    for (const EDBAppendItem &item : items) {
+        if (!item.event)
+            continue;
+        item_event_row row = eventRow(item.event);
+        if (!item.stanzaId.isEmpty())
+            row.stanzaId = item.stanzaId;
+        else if (mirror_)
+            mirrored += item;
+        r->batch.append({ item.jid, item.type, row });
+    }
+    r->id        = genUniqueId();
+    const int id = r->id;
+    queueRequest(r);
+
+    // the flat file can't tell an archived message it has already
+    if (mirror_ && !mirrored.isEmpty())
+        mirror_->appendBatch(accId, mirrored);
+
+    return id;
+}
+
+int EDBSqLite::importRecords(const QString &accId, const XMPP::Jid &jid, const QList<EDBFlatFile::Record> &records)
+{
+    item_query_req *r = new item_query_req;
+    r->accId          = accId;
+    r->type           = item_query_req::Type_appendBatch;
+    r->batch.reserve(records.size());
+    for (const EDBFlatFile::Record &rec : records)
+        r->batch.append({ jid, EDB::Contact, recordRow(rec) });
+    r->id        = genUniqueId();
+    const int id = r->id;
+    importIds.insert(id);
+    queueRequest(r);
+    return id;
 }
 
 int EDBSqLite::erase(const QString &accId, const XMPP::Jid &jid)
@@ -192,14 +980,27 @@ int EDBSqLite::erase(const QString &accId, const XMPP::Jid &jid)
     r->j              = jid;
     r->type           = item_query_req::Type_erase;
     r->id             = genUniqueId();
-    rlist.append(r);
-
-    QTimer::singleShot(FAKEDELAY, this, SLOT(performRequests()));
+    const int id      = r->id;
+    queueRequest(r);
 
     if (mirror_)
         mirror_->erase(accId, jid);
 
-    return r->id;
+    return id;
+}
+
+int EDBSqLite::setLifetime(const QString &accId, const XMPP::Jid &jid, int type, int days)
+{
+    item_query_req *r = new item_query_req;
+    r->accId          = accId;
+    r->j              = jid;
+    r->jidType        = type;
+    r->lifetime       = days < 0 ? -1 : days;
+    r->type           = item_query_req::Type_lifetime;
+    r->id             = genUniqueId();
+    const int id      = r->id;
+    queueRequest(r);
+    return id;
 }
 
 QList<EDB::ContactItem> EDBSqLite::contacts(const QString &accId, int type)
@@ -225,9 +1026,11 @@ quint64 EDBSqLite::eventsCount(const QString &accId, const XMPP::Jid &jid)
     bool                      fAccAll  = accId.isEmpty();
     bool                      fContAll = jid.isEmpty();
     EDBSqLite::PreparedQuery *query    = queryes.getPreparedQuery(QueryRowCount, fAccAll, fContAll);
-    if (!fAccAll)
+    if (!fAccAll && !fContAll)
+        query->bindValue(":contact_id", jidRowId(accId, jid));
+    else if (!fAccAll)
         query->bindValue(":acc_id", accId);
-    if (!fContAll)
+    else if (!fContAll)
         query->bindValue(":jid", jid.full());
     if (query->exec()) {
         if (query->next())
@@ -237,9 +1040,36 @@ quint64 EDBSqLite::eventsCount(const QString &accId, const XMPP::Jid &jid)
     return res;
 }
 
+qint64 EDBSqLite::jidRowId(const QString &accId, const XMPP::Jid &jid)
+{
+    qint64                    id    = 0;
+    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
+    query->bindValue(":jid", jid.full());
+    query->bindValue(":acc_id", accId);
+    if (query->exec()) {
+        if (query->first())
+            id = query->record().value("id").toLongLong();
+        query->freeResult();
+    }
+    return id;
+}
+
 QString EDBSqLite::getStorageParam(const QString &key)
 {
+    // statistics are computed, everything else comes from the `system` table
+    static const QHash<QString, QString> stats {
+        { "db_size", "SELECT `page_count` * `page_size` FROM pragma_page_count(), pragma_page_size();" },
+        { "db_free", "SELECT `freelist_count` * `page_size` FROM pragma_freelist_count(), pragma_page_size();" },
+        { "events_count", "SELECT COUNT(*) FROM `events`;" },
+        { "contacts_count", "SELECT COUNT(*) FROM `contacts`;" }
+    };
     QSqlQuery query(QSqlDatabase::database("history"));
+    auto      it = stats.constFind(key);
+    if (it != stats.constEnd()) {
+        if (query.exec(it.value()) && query.next())
+            return query.value(0).toString();
+        return QString();
+    }
     query.prepare("SELECT `value` FROM `system` WHERE `key` = :key;");
     query.bindValue(":key", key);
     if (query.exec() && query.next())
@@ -249,8 +1079,10 @@ QString EDBSqLite::getStorageParam(const QString &key)
 
 void EDBSqLite::setStorageParam(const QString &key, const QString &val)
 {
-    transaction(true);
-    QSqlQuery query(QSqlDatabase::database("history"));
+    QSqlDatabase db = QSqlDatabase::database("history");
+    if (!db.transaction())
+        return;
+    QSqlQuery query(db);
     if (val.isEmpty()) {
         query.prepare("DELETE FROM `system` WHERE `key` = :key;");
         query.bindValue(":key", key);
@@ -270,25 +1102,15 @@ void EDBSqLite::setStorageParam(const QString &key, const QString &val)
             query.exec();
         }
     }
-    commit();
+    db.commit();
 }
 
+int EDBSqLite::queuedRequests() const { return worker ? worker->queued() : 0; }
+
 void EDBSqLite::setInsertingMode(InsertMode mode)
 {
-    // in the case of a flow of new records
-    if (mode == Import) {
-        // Commit after 10000 inserts and every 5 seconds
-        maxUncommitedRecs = 10000;
-        maxUncommitedSecs = 5;
-    } else {
-        // Commit after 3 inserts and every 1 second
-        maxUncommitedRecs = 3;
-        maxUncommitedSecs = 1;
-    }
-    // Commit if there were no new additions for 1 second
-    commitByTimeoutSecs = 1;
-    //--
-    commit();
+    if (worker)
+        QMetaObject::invokeMethod(worker, "setInsertingMode", Qt::QueuedConnection, Q_ARG(int, mode));
 }
 
 void EDBSqLite::setMirror(EDBFlatFile *mirr)
@@ -302,118 +1124,79 @@ void EDBSqLite::setMirror(EDBFlatFile *mirr)
 
 EDBFlatFile *EDBSqLite::mirror() const { return mirror_; }
 
-void EDBSqLite::performRequests()
+void EDBSqLite::startRetention()
 {
-    if (rlist.isEmpty())
-        return;
+    static const auto chatDays = PsiOptions::handle<int>("options.history.retention.chat-days");
+    static const auto mucDays  = PsiOptions::handle<int>("options.history.retention.muc-days");
 
-    item_query_req *r    = rlist.takeFirst();
-    const int       type = r->type;
+    item_query_req *r = new item_query_req;
+    r->type           = item_query_req::Type_retention;
+    r->start          = 0;
+    r->id             = 0;
+    r->chatDays       = qMax(0, chatDays.value());
+    r->mucDays        = qMax(0, mucDays.value());
+    queueRequest(r);
+
+    retentionTimer->setInterval(RETENTION_INTERVAL);
+    retentionTimer->start();
+}
 
-    if (type == item_query_req::Type_append) {
-        bool b = appendEvent(r->accId, r->j, r->event, r->jidType);
-        writeFinished(r->id, b);
+void EDBSqLite::queueRequest(item_query_req *r)
+{
+    if (worker) {
+        worker->enqueue(r);
+        return;
     }
+    // the database couldn't be opened, so answer asynchronously like the worker would
+    const int id   = r->id;
+    const int type = r->type;
+    delete r;
+    QTimer::singleShot(0, this, [this, id, type]() {
+        if (type == item_query_req::Type_get || type == item_query_req::Type_find)
+            resultReady(id, EDBResult(), 0);
+        else
+            writeFinished(id, false);
+    });
+}
 
-    else if (type == item_query_req::Type_get) {
-        commit();
-        bool      fContAll = r->j.isEmpty();
-        bool      fAccAll  = r->accId.isEmpty();
-        QueryType queryType;
-        if (r->date.isNull()) {
-            if (r->dir == Forward)
-                queryType = QueryOldest;
-            else
-                queryType = QueryLatest;
-        } else {
-            if (r->dir == Backward)
-                queryType = QueryDateBackward;
-            else
-                queryType = QueryDateForward;
-        }
-        EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(queryType, fAccAll, fContAll);
-        if (!fContAll)
-            query->bindValue(":jid", r->j.full());
-        if (!fAccAll)
-            query->bindValue(":acc_id", r->accId);
-        if (!r->date.isNull())
-            query->bindValue(":date", r->date);
-        query->bindValue(":start", r->start);
-        query->bindValue(":cnt", r->len);
-        EDBResult result;
-        if (query->exec()) {
-            while (query->next()) {
-                PsiEvent::Ptr e(getEvent(query->record()));
-                if (e) {
-                    QString id = query->record().value("id").toString();
-                    result.append(EDBItemPtr(new EDBItem(e, id)));
-                }
-            }
-            query->freeResult();
-        }
-        int beginRow;
-        if (r->dir == Forward && r->date.isNull()) {
-            beginRow = r->start;
-        } else {
-            int cnt = rowCount(r->accId, r->j, r->date);
-            if (r->dir == Backward) {
-                beginRow = cnt - r->len + 1;
-                if (beginRow < 0)
-                    beginRow = 0;
-            } else {
-                beginRow = cnt + 1;
-            }
-        }
-        resultReady(r->id, result, beginRow);
-
-    } else if (type == item_query_req::Type_find) {
-        commit();
-        bool                      fContAll = r->j.isEmpty();
-        bool                      fAccAll  = r->accId.isEmpty();
-        EDBSqLite::PreparedQuery *query    = queryes.getPreparedQuery(QueryFindText, fAccAll, fContAll);
-        if (!fContAll)
-            query->bindValue(":jid", r->j.full());
-        if (!fAccAll)
-            query->bindValue(":acc_id", r->accId);
-        EDBResult result;
-        if (query->exec()) {
-            QString str = r->findStr.toLower();
-            while (query->next()) {
-                const QSqlRecord rec = query->record();
-                if (!rec.value("m_text").toString().toLower().contains(str, Qt::CaseSensitive))
-                    continue;
-                PsiEvent::Ptr e(getEvent(rec));
-                if (e) {
-                    QString    id  = rec.value("id").toString();
-                    EDBItemPtr eip = EDBItemPtr(new EDBItem(e, id));
-                    result.append(eip);
-                }
-            }
-            query->freeResult();
+void EDBSqLite::worker_resultReady(int id, const QList<QSqlRecord> &records, int beginRow)
+{
+    EDBResult result;
+    if (!records.isEmpty()) {
+        // every record of a result comes from the same query, so the layout is resolved once
+        const EventColumns          cols(records.first());
+        QHash<QString, PsiAccount *> accounts;
+        result.reserve(records.size());
+        for (const QSqlRecord &rec : records) {
+            const QString accId = rec.value(cols.accId).toString();
+            auto          it    = accounts.constFind(accId);
+            if (it == accounts.constEnd())
+                it = accounts.insert(accId, psi() ? psi()->contactList()->getAccount(accId) : nullptr);
+            PsiEvent::Ptr e(getEvent(rec, cols, it.value()));
+            if (e)
+                result.append(EDBItemPtr(new EDBItem(e, rec.value(cols.id).toString())));
         }
-        resultReady(r->id, result, 0);
-
-    } else if (type == item_query_req::Type_erase) {
-        writeFinished(r->id, eraseHistory(r->accId, r->j));
     }
-
-    delete r;
+    resultReady(id, result, beginRow);
 }
 
-bool EDBSqLite::appendEvent(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int jidType)
+void EDBSqLite::worker_writeFinished(int id, bool success)
 {
-    QSqlDatabase db        = QSqlDatabase::database("history");
-    const qint64 contactId = ensureJidRowId(accId, jid, jidType);
-    if (contactId == 0)
-        return false;
+    if (importIds.remove(id))
+        emit recordsImported(id, success);
+    else
+        writeFinished(id, success);
+}
 
-    QDateTime dTime;
-    int       nType = 0;
+EDBSqLite::item_event_row EDBSqLite::eventRow(const PsiEvent::Ptr &e)
+{
+    item_event_row row;
+    int            nType = 0;
 
     if (e->type() == PsiEvent::Message) {
         MessageEvent::Ptr me = e.staticCast<MessageEvent>();
         const Message &   m  = me->message();
-        dTime                = m.timeStamp();
+        row.date             = m.timeStamp();
         if (m.type() == "chat")
             nType = 1;
         else if (m.type() == "error")
@@ -423,7 +1206,7 @@ bool EDBSqLite::appendEvent(const QString &accId, const XMPP::Jid &jid, const Ps
 
     } else if (e->type() == PsiEvent::Auth) {
         AuthEvent::Ptr ae = e.staticCast<AuthEvent>();
-        dTime             = ae->timeStamp();
+        row.date          = ae->timeStamp();
         QString subType   = ae->authType();
         if (subType == "subscribe")
             nType = 3;
@@ -434,62 +1217,96 @@ bool EDBSqLite::appendEvent(const QString &accId, const XMPP::Jid &jid, const Ps
         else if (subType == "unsubscribed")
             nType = 8;
     } else
-        return false;
-
-    int nDirection = e->originLocal() ? 1 : 2;
-    if (!transaction(false))
-        return false;
+        return row;
 
-    PreparedQuery *query = queryes.getPreparedQuery(QueryInsertEvent, false, false);
-    query->bindValue(":contact_id", contactId);
-    query->bindValue(":resource", (jidType != GroupChatContact) ? jid.resource() : "");
-    query->bindValue(":date", dTime);
-    query->bindValue(":type", nType);
-    query->bindValue(":direction", nDirection);
+    row.valid     = true;
+    row.type      = nType;
+    row.direction = e->originLocal() ? 1 : 2;
     if (nType == 0 || nType == 1 || nType == 4 || nType == 5) {
         MessageEvent::Ptr me   = e.staticCast<MessageEvent>();
         const Message &   m    = me->message();
         QString           lang = m.lang();
-        query->bindValue(":subject", m.subject(lang));
-        query->bindValue(":m_text", m.body(lang));
-        query->bindValue(":lang", lang);
-        QString        extraData;
-        const UrlList &urls = m.urlList();
-        if (!urls.isEmpty()) {
-            QVariantMap  xepList;
-            QVariantList urlList;
-            for (const Url &url : urls)
-                if (!url.url().isEmpty()) {
-                    QVariantList urlItem;
-                    urlItem.append(QVariant(url.url()));
-                    if (!url.desc().isEmpty())
-                        urlItem.append(QVariant(url.desc()));
-                    urlList.append(QVariant(urlItem));
-                }
-            xepList["jabber:x:oob"] = QVariant(urlList);
-            QJsonDocument doc(QJsonObject::fromVariantMap(xepList));
-            extraData = QString::fromUtf8(doc.toJson());
-        }
-        query->bindValue(":extra_data", extraData);
+        row.subject            = m.subject(lang);
+        row.text               = m.body(lang);
+        row.lang               = lang;
+        row.extraData          = extraData(m.urlList());
     } else {
-        query->bindValue(":subject", QVariant(QVariant::String));
-        query->bindValue(":m_text", QVariant(QVariant::String));
-        query->bindValue(":lang", QVariant(QVariant::String));
-        query->bindValue(":extra_data", QVariant(QVariant::String));
+        row.subject   = QVariant(QVariant::String);
+        row.text      = QVariant(QVariant::String);
+        row.lang      = QVariant(QVariant::String);
+        row.extraData = QVariant(QVariant::String);
+    }
+    return row;
+}
+
+EDBSqLite::item_event_row EDBSqLite::recordRow(const EDBFlatFile::Record &rec)
+{
+    item_event_row row;
+    row.valid     = true;
+    row.date      = rec.date;
+    row.direction = rec.originLocal ? 1 : 2;
+    if (rec.authType.isEmpty()) {
+        row.type    = rec.type;
+        row.subject = rec.subject;
+        row.text    = rec.text;
+        row.lang    = QString();
+        UrlList urls;
+        if (!rec.url.isEmpty())
+            urls.append(Url(rec.url, rec.urlDesc));
+        row.extraData = extraData(urls);
+    } else {
+        if (rec.authType == "subscribe")
+            row.type = 3;
+        else if (rec.authType == "subscribed")
+            row.type = 6;
+        else if (rec.authType == "unsubscribe")
+            row.type = 7;
+        else if (rec.authType == "unsubscribed")
+            row.type = 8;
+        row.subject   = QVariant(QVariant::String);
+        row.text      = QVariant(QVariant::String);
+        row.lang      = QVariant(QVariant::String);
+        row.extraData = QVariant(QVariant::String);
+    }
+    return row;
+}
+
+QString EDBSqLite::extraData(const UrlList &urls)
+{
+    QString res;
+    if (!urls.isEmpty()) {
+        QVariantMap  xepList;
+        QVariantList urlList;
+        for (const Url &url : urls)
+            if (!url.url().isEmpty()) {
+                QVariantList urlItem;
+                urlItem.append(QVariant(url.url()));
+                if (!url.desc().isEmpty())
+                    urlItem.append(QVariant(url.desc()));
+                urlList.append(QVariant(urlItem));
+            }
+        xepList["jabber:x:oob"] = QVariant(urlList);
+        QJsonDocument doc(QJsonObject::fromVariantMap(xepList));
+        res = QString::fromUtf8(doc.toJson());
     }
-    bool res = query->exec();
     return res;
 }
 
-PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record)
+EDBSqLite::EventColumns::EventColumns(const QSqlRecord &record) :
+    id(record.indexOf("id")), accId(record.indexOf("acc_id")), type(record.indexOf("type")),
+    date(record.indexOf("date")), jid(record.indexOf("jid")), direction(record.indexOf("direction")),
+    subject(record.indexOf("subject")), text(record.indexOf("m_text")), lang(record.indexOf("lang")),
+    extraData(record.indexOf("extra_data"))
 {
-    PsiAccount *pa = psi()->contactList()->getAccount(record.value("acc_id").toString());
+}
 
-    int type = record.value("type").toInt();
+PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record, const EventColumns &cols, PsiAccount *pa)
+{
+    int type = record.value(cols.type).toInt();
 
     if (type == 0 || type == 1 || type == 4 || type == 5) {
         Message m;
-        m.setTimeStamp(record.value("date").toDateTime());
+        m.setTimeStamp(record.value(cols.date).toDateTime());
         if (type == 1)
             m.setType("chat");
         else if (type == 4)
@@ -498,37 +1315,27 @@ PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record)
             m.setType("headline");
         else
             m.setType("");
-        m.setFrom(Jid(record.value("jid").toString()));
-        QVariant text = record.value("m_text");
+        m.setFrom(Jid(record.value(cols.jid).toString()));
+        QVariant text = record.value(cols.text);
         if (!text.isNull()) {
             m.setBody(text.toString());
-            m.setLang(record.value("lang").toString());
-            m.setSubject(record.value("subject").toString());
+            m.setLang(record.value(cols.lang).toString());
+            m.setSubject(record.value(cols.subject).toString());
         }
         m.setSpooled(true);
-        QString extraStr = record.value("extra_data").toString();
-        if (!extraStr.isEmpty()) {
-            bool          fOk;
-            QJsonDocument doc     = QJsonDocument::fromJson(extraStr.toUtf8());
-            fOk                   = !doc.isNull();
-            QVariantMap extraData = doc.object().toVariantMap();
-
-            if (fOk) {
-                const auto urls = extraData["jabber:x:oob"].toList();
-                for (const QVariant &urlItem : urls) {
-                    QVariantList itemList = urlItem.toList();
-                    if (!itemList.isEmpty()) {
-                        QString url = itemList.at(0).toString();
-                        QString desc;
-                        if (itemList.size() > 1)
-                            desc = itemList.at(1).toString();
-                        m.urlAdd(Url(url, desc));
-                    }
-                }
+        // extra_data is empty for almost every row, don't touch the json parser for those
+        const QString extraStr = record.value(cols.extraData).toString();
+        if (!extraStr.isEmpty() && extraStr.contains(QLatin1String("jabber:x:oob"))) {
+            const QJsonDocument doc  = QJsonDocument::fromJson(extraStr.toUtf8());
+            const QJsonArray    urls = doc.object().value("jabber:x:oob").toArray();
+            for (const QJsonValue &urlItem : urls) {
+                const QJsonArray itemList = urlItem.toArray();
+                if (!itemList.isEmpty())
+                    m.urlAdd(Url(itemList.at(0).toString(), itemList.at(1).toString()));
             }
         }
         MessageEvent::Ptr me(new MessageEvent(m, pa));
-        me->setOriginLocal((record.value("direction").toInt() == 1));
+        me->setOriginLocal((record.value(cols.direction).toInt() == 1));
         return me.staticCast<PsiEvent>();
     }
 
@@ -544,206 +1351,115 @@ PsiEvent::Ptr EDBSqLite::getEvent(const QSqlRecord &record)
         else if (type == 8)
             subType = "unsubscribed";
 
-        AuthEvent::Ptr ae(new AuthEvent(Jid(record.value("jid").toString()), subType, pa));
-        ae->setTimeStamp(record.value("date").toDateTime());
+        AuthEvent::Ptr ae(new AuthEvent(Jid(record.value(cols.jid).toString()), subType, pa));
+        ae->setTimeStamp(record.value(cols.date).toDateTime());
         return ae.staticCast<PsiEvent>();
     }
     return PsiEvent::Ptr();
 }
 
-qint64 EDBSqLite::ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type)
-{
-    if (jid.isEmpty())
-        return 0;
-    QString sJid = (type == GroupChatContact) ? jid.full() : jid.bare();
-    QString sKey = accId + "|" + sJid;
-    qint64  id   = jidsCache.value(sKey, 0);
-    if (id != 0)
-        return id;
-
-    EDBSqLite::PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
-    query->bindValue(":jid", sJid);
-    query->bindValue(":acc_id", accId);
-    if (query->exec()) {
-        if (query->first()) {
-            id = query->record().value("id").toLongLong();
-        } else {
-            //
-            QSqlQuery queryIns(QSqlDatabase::database("history"));
-            queryIns.prepare("INSERT INTO `contacts` (`acc_id`, `type`, `jid`, `lifetime`)"
-                             " VALUES (:acc_id, :type, :jid, -1);");
-            queryIns.bindValue(":acc_id", accId);
-            queryIns.bindValue(":type", type);
-            queryIns.bindValue(":jid", sJid);
-            if (queryIns.exec()) {
-                id = queryIns.lastInsertId().toLongLong();
-            }
-        }
-        query->freeResult();
-        if (id != 0)
-            jidsCache[sKey] = id;
-    }
-    return id;
-}
-
-int EDBSqLite::rowCount(const QString &accId, const XMPP::Jid &jid, QDateTime before)
+bool EDBSqLite::importExecute()
 {
-    bool      fAccAll  = accId.isEmpty();
-    bool      fContAll = jid.isEmpty();
-    QueryType type;
-    if (before.isNull())
-        type = QueryRowCount;
-    else
-        type = QueryRowCountBefore;
-    PreparedQuery *query = queryes.getPreparedQuery(type, fAccAll, fContAll);
-    if (!fContAll)
-        query->bindValue(":jid", jid.full());
-    if (!fAccAll)
-        query->bindValue(":acc_id", accId);
-    if (!before.isNull())
-        query->bindValue(":date", before);
-    int res = 0;
-    if (query->exec()) {
-        if (query->next()) {
-            res = query->record().value("count").toInt();
+    bool           res = true;
+    HistoryImport *imp = new HistoryImport(psi());
+    if (imp->isNeeded()) {
+        if (imp->exec() != HistoryImport::ResultNormal) {
+            res = false;
         }
-        query->freeResult();
     }
+    delete imp;
     return res;
 }
 
-bool EDBSqLite::eraseHistory(const QString &accId, const XMPP::Jid &jid)
+bool EDBSqLite::upgradeSchema()
 {
-    bool res = false;
-    if (!transaction(true))
-        return false;
-
-    if (accId.isEmpty() && jid.isEmpty()) {
-        QSqlQuery query(QSqlDatabase::database("history"));
-        // if (query.exec("DELETE FROM `events`;"))
-        if (query.exec("DELETE FROM `contacts`;")) {
-            jidsCache.clear();
-            res = true;
-        }
-    } else {
-        PreparedQuery *query = queryes.getPreparedQuery(QueryJidRowId, false, false);
-        query->bindValue(":jid", jid.full());
-        query->bindValue(":acc_id", accId);
-        if (query->exec()) {
-            if (query->next()) {
-                const qint64 id = query->record().value("id").toLongLong();
-                QSqlQuery    query2(QSqlDatabase::database("history"));
-                query2.prepare("DELETE FROM `events` WHERE `contact_id` = :id;");
-                query2.bindValue(":id", id);
-                if (query2.exec()) {
-                    res = true;
-                    query2.prepare("DELETE FROM `contacts` WHERE `id` = :id AND `lifetime` = -1;");
-                    query2.bindValue(":id", id);
-                    if (query2.exec()) {
-                        if (query2.numRowsAffected() > 0)
-                            jidsCache.clear();
-                    } else
-                        res = false;
-                }
-            }
-            query->freeResult();
+    QSqlDatabase db = QSqlDatabase::database("history");
+    QSqlQuery    query(db);
+    if (getStorageParam("version") == "0.1") {
+        // per-contact reads are ordered by date, the index hands them out without sorting.
+        // it also serves the foreign key, so the plain contact_id index isn't needed anymore
+        if (!db.transaction())
+            return false;
+        if (!query.exec("CREATE INDEX `contact_date` ON `events` (`contact_id`, `date`, `id`);")
+            || !query.exec("DROP INDEX IF EXISTS `contact_id`;")) {
+            qWarning("%s\n%s", "EDBSqLite::upgradeSchema(): Can't upgrade to 0.2.",
+                     qUtf8Printable(query.lastError().text()));
+            db.rollback();
+            return false;
         }
+        if (!db.commit())
+            return false;
+        setStorageParam("version", "0.2");
     }
-    if (res)
-        res = commit();
-    else
-        rollback();
-    return res;
-}
-
-bool EDBSqLite::transaction(bool now)
-{
-    if (status == NotActive)
-        return false;
-    if (now || transactionsCounter >= maxUncommitedRecs
-        || lastCommitTime.secsTo(QDateTime::currentDateTime()) >= maxUncommitedSecs)
-        if (!commit())
+    if (getStorageParam("version") == "0.2") {
+        // server archive ids, to store each archived message once
+        if (!db.transaction())
             return false;
-
-    if (status == Commited) {
-        if (!QSqlDatabase::database("history").transaction())
+        if (!query.exec("ALTER TABLE `events` ADD COLUMN `stanza_id` TEXT;")
+            || !query.exec("CREATE INDEX `contact_stanza` ON `events` (`contact_id`, `stanza_id`);")) {
+            qWarning("%s\n%s", "EDBSqLite::upgradeSchema(): Can't upgrade to 0.3.",
+                     qUtf8Printable(query.lastError().text()));
+            db.rollback();
             return false;
-        status = NotCommited;
-    }
-    ++transactionsCounter;
-
-    startAutocommitTimer();
-
-    return true;
-}
-
-bool EDBSqLite::commit()
-{
-    if (status != NotActive) {
-        if (status == Commited || QSqlDatabase::database("history").commit()) {
-            transactionsCounter = 0;
-            lastCommitTime      = QDateTime::currentDateTime();
-            status              = Commited;
-            stopAutocommitTimer();
-            return true;
         }
+        if (!db.commit())
+            return false;
+        setStorageParam("version", "0.3");
     }
-    return false;
+    return true;
 }
 
-bool EDBSqLite::rollback()
+bool EDBSqLite::ensureFullTextIndex()
 {
-    if (status == NotCommited && QSqlDatabase::database("history").rollback()) {
-        transactionsCounter = 0;
-        lastCommitTime      = QDateTime::currentDateTime();
-        status              = Commited;
-        stopAutocommitTimer();
+    if (getStorageParam("fts_index") == "yes")
         return true;
-    }
-    return false;
-}
 
-void EDBSqLite::startAutocommitTimer()
-{
-    if (!commitTimer) {
-        commitTimer = new QTimer(this);
-        connect(commitTimer, SIGNAL(timeout()), this, SLOT(commit()));
-        commitTimer->setSingleShot(true);
-        commitTimer->setInterval(int(commitByTimeoutSecs) * 1000);
-    }
-    commitTimer->start();
-}
-
-void EDBSqLite::stopAutocommitTimer()
-{
-    if (commitTimer && commitTimer->isActive())
-        commitTimer->stop();
-}
-
-bool EDBSqLite::importExecute()
-{
-    bool           res = true;
-    HistoryImport *imp = new HistoryImport(psi());
-    if (imp->isNeeded()) {
-        if (imp->exec() != HistoryImport::ResultNormal) {
-            res = false;
-        }
+    // external content table, so the text itself is stored only once in `events`
+    QSqlDatabase db = QSqlDatabase::database("history");
+    if (!db.transaction())
+        return false;
+    QSqlQuery query(db);
+    bool      res = query.exec("CREATE VIRTUAL TABLE `events_fts` USING fts5("
+                          "`subject`, `m_text`, content='events', content_rowid='id', tokenize='trigram'"
+                          ");");
+    if (res)
+        res = query.exec("CREATE TRIGGER `events_fts_insert` AFTER INSERT ON `events` BEGIN "
+                         "INSERT INTO `events_fts` (`rowid`, `subject`, `m_text`) "
+                         "VALUES (new.`id`, new.`subject`, new.`m_text`); "
+                         "END;");
+    if (res)
+        res = query.exec("CREATE TRIGGER `events_fts_delete` AFTER DELETE ON `events` BEGIN "
+                         "INSERT INTO `events_fts` (`events_fts`, `rowid`, `subject`, `m_text`) "
+                         "VALUES ('delete', old.`id`, old.`subject`, old.`m_text`); "
+                         "END;");
+    if (res)
+        res = query.exec("INSERT INTO `events_fts` (`events_fts`) VALUES ('rebuild');");
+    if (!res) {
+        qWarning("%s\n%s", "EDBSqLite::ensureFullTextIndex(): Full-text search is not available.",
+                 qUtf8Printable(query.lastError().text()));
+        db.rollback();
+        return false;
     }
-    delete imp;
-    return res;
+    if (!db.commit())
+        return false;
+    setStorageParam("fts_index", "yes");
+    return true;
 }
 
 // ****************** class PreparedQueryes ********************
 
-EDBSqLite::QueryStorage::QueryStorage() { }
+EDBSqLite::QueryStorage::QueryStorage(const QString &connectionName) : connName(connectionName) { }
+
+EDBSqLite::QueryStorage::~QueryStorage() { clear(); }
 
-EDBSqLite::QueryStorage::~QueryStorage()
+void EDBSqLite::QueryStorage::clear()
 {
     const auto &qList = queryList.values();
     for (EDBSqLite::PreparedQuery *q : qList) {
         if (q)
             delete q;
     }
+    queryList.clear();
 }
 
 EDBSqLite::PreparedQuery *EDBSqLite::QueryStorage::getPreparedQuery(QueryType type, bool allAccounts, bool allContacts)
@@ -753,7 +1469,7 @@ EDBSqLite::PreparedQuery *EDBSqLite::QueryStorage::getPreparedQuery(QueryType ty
     if (q != nullptr)
         return q;
 
-    q = new EDBSqLite::PreparedQuery(QSqlDatabase::database("history"));
+    q = new EDBSqLite::PreparedQuery(QSqlDatabase::database(connName));
     q->setForwardOnly(true);
     q->prepare(getQueryString(type, allAccounts, allContacts));
     queryList[queryProp] = q;
@@ -762,6 +1478,19 @@ EDBSqLite::PreparedQuery *EDBSqLite::QueryStorage::getPreparedQuery(QueryType ty
 
 EDBSqLite::PreparedQuery::PreparedQuery(QSqlDatabase db) : QSqlQuery(db) { }
 
+static QString contactCondition(bool allAccounts, bool allContacts)
+{
+    // a single contact is looked up by its row id, this lets SQLite use the `contact_date` index
+    if (!allAccounts && !allContacts)
+        return " AND `events`.`contact_id` = :contact_id";
+    QString cond;
+    if (!allContacts)
+        cond.append(" AND `jid` = :jid");
+    if (!allAccounts)
+        cond.append(" AND `acc_id` = :acc_id");
+    return cond;
+}
+
 QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts, bool allContacts)
 {
     QString queryStr;
@@ -776,33 +1505,37 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
     case QueryOldest:
     case QueryDateBackward:
     case QueryDateForward:
+    case QuerySeekBackward:
+    case QuerySeekForward:
         queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `subject`, `m_text`, "
                    "`lang`, `extra_data`"
                    " FROM `events`, `contacts`"
                    " WHERE `contacts`.`id` = `contact_id`";
-        if (!allContacts)
-            queryStr.append(" AND `jid` = :jid");
-        if (!allAccounts)
-            queryStr.append(" AND `acc_id` = :acc_id");
+        queryStr.append(contactCondition(allAccounts, allContacts));
         if (type == QueryDateBackward)
             queryStr.append(" AND `date` < :date");
         else if (type == QueryDateForward)
             queryStr.append(" AND `date` >= :date");
-        if (type == QueryLatest || type == QueryDateBackward)
-            queryStr.append(" ORDER BY `date` DESC");
+        else if (type == QuerySeekBackward)
+            queryStr.append(" AND (`date`, `events`.`id`) < (SELECT `date`, `id` FROM `events` WHERE `id` = :id)");
+        else if (type == QuerySeekForward)
+            queryStr.append(" AND (`date`, `events`.`id`) > (SELECT `date`, `id` FROM `events` WHERE `id` = :id)");
+        // the id makes the order stable for messages with the same timestamp
+        if (type == QueryLatest || type == QueryDateBackward || type == QuerySeekBackward)
+            queryStr.append(" ORDER BY `date` DESC, `events`.`id` DESC");
+        else
+            queryStr.append(" ORDER BY `date` ASC, `events`.`id` ASC");
+        if (type == QuerySeekBackward || type == QuerySeekForward)
+            queryStr.append(" LIMIT :cnt;");
         else
-            queryStr.append(" ORDER BY `date` ASC");
-        queryStr.append(" LIMIT :start, :cnt;");
+            queryStr.append(" LIMIT :start, :cnt;");
         break;
     case QueryRowCount:
     case QueryRowCountBefore:
         queryStr = "SELECT count(*) AS `count`"
                    " FROM `events`, `contacts`"
                    " WHERE `contacts`.`id` = `contact_id`";
-        if (!allContacts)
-            queryStr.append(" AND `jid` = :jid");
-        if (!allAccounts)
-            queryStr.append(" AND `acc_id` = :acc_id");
+        queryStr.append(contactCondition(allAccounts, allContacts));
         if (type == QueryRowCountBefore)
             queryStr.append(" AND `date` < :date");
         queryStr.append(";");
@@ -815,18 +1548,34 @@ QString EDBSqLite::QueryStorage::getQueryString(QueryType type, bool allAccounts
                    "`lang`, `extra_data`"
                    " FROM `events`, `contacts`"
                    " WHERE `contacts`.`id` = `contact_id`";
-        if (!allContacts)
-            queryStr.append(" AND `jid` = :jid");
-        if (!allAccounts)
-            queryStr.append(" AND `acc_id` = :acc_id");
+        queryStr.append(contactCondition(allAccounts, allContacts));
         queryStr.append(" AND `m_text` IS NOT NULL");
         queryStr.append(" ORDER BY `date`;");
         break;
+    case QueryFindTextFts:
+        queryStr = "SELECT `acc_id`, `events`.`id`, `jid`, `date`, `events`.`type`, `direction`, `events`.`subject`, "
+                   "`events`.`m_text`, `lang`, `extra_data`"
+                   " FROM `events_fts`, `events`, `contacts`"
+                   " WHERE `events_fts` MATCH :match"
+                   " AND `events`.`id` = `events_fts`.`rowid`"
+                   " AND `contacts`.`id` = `contact_id`";
+        queryStr.append(contactCondition(allAccounts, allContacts));
+        queryStr.append(" AND `events`.`m_text` IS NOT NULL");
+        queryStr.append(" ORDER BY `date`;");
+        break;
+    case QueryStoredEvent:
+        queryStr = "SELECT `id` FROM `events` WHERE `contact_id` = :contact_id"
+                   " AND (`stanza_id` = :stanza_id"
+                   " OR (`date` BETWEEN :date_from AND :date_to AND `direction` = :direction AND `m_text` = :m_text))"
+                   " LIMIT 1;";
+        break;
     case QueryInsertEvent:
         queryStr = "INSERT INTO `events` ("
-                   "`contact_id`, `resource`, `date`, `type`, `direction`, `subject`, `m_text`, `lang`, `extra_data`"
+                   "`contact_id`, `resource`, `date`, `type`, `direction`, `subject`, `m_text`, `lang`, `extra_data`, "
+                   "`stanza_id`"
                    ") VALUES ("
-                   ":contact_id, :resource, :date, :type, :direction, :subject, :m_text, :lang, :extra_data"
+                   ":contact_id, :resource, :date, :type, :direction, :subject, :m_text, :lang, :extra_data, "
+                   ":stanza_id"
                    ");";
         break;
     }
@@ -842,3 +1591,5 @@ uint qHash(const QueryProperty &struc)
     res |= struc.allContacts ? 1 : 0;
     return res;
 }
+
+#include "edbsqlite.moc"
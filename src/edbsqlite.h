@@ -27,7 +27,9 @@
 
 #include <QDateTime>
 #include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlRecord>
@@ -40,10 +42,14 @@ enum QueryType {
     QueryOldest,
     QueryDateForward,
     QueryDateBackward,
+    QuerySeekForward,
+    QuerySeekBackward,
     QueryFindText,
+    QueryFindTextFts,
     QueryRowCount,
     QueryRowCountBefore,
     QueryJidRowId,
+    QueryStoredEvent,
     QueryInsertEvent
 };
 
@@ -64,6 +70,9 @@ struct QueryProperty {
 };
 uint qHash(const QueryProperty &struc);
 
+class EDBSqLiteWorker;
+class QThread;
+
 class EDBSqLite : public EDB {
     Q_OBJECT
 
@@ -85,14 +94,16 @@ class EDBSqLite : public EDB {
     //--------
     class QueryStorage {
     public:
-        QueryStorage();
+        QueryStorage(const QString &connectionName);
         ~QueryStorage();
         PreparedQuery *getPreparedQuery(QueryType type, bool allAccounts, bool allContacts);
+        void           clear();
 
     private:
         QString getQueryString(QueryType type, bool allAccounts, bool allContacts);
 
     private:
+        QString                               connName;
         QHash<QueryProperty, PreparedQuery *> queryList;
     };
     //--------
@@ -106,62 +117,100 @@ public:
 
     int features() const;
     int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len);
+    int getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len);
     int find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date, int direction);
     int append(const QString &accId, const XMPP::Jid &jid, const PsiEvent::Ptr &e, int type);
+    int appendBatch(const QString &accId, const EDBAppendBatch &items);
     int erase(const QString &accId, const XMPP::Jid &jid);
     QList<ContactItem> contacts(const QString &accId, int type);
     quint64            eventsCount(const QString &accId, const XMPP::Jid &jid);
     QString            getStorageParam(const QString &key);
     void               setStorageParam(const QString &key, const QString &val);
 
+    // days of history kept for a contact, a room (its bare jid with GroupChatContact) or a whole account
+    // (empty jid): -1 falls back to the next level and in the end to the options, 0 keeps everything
+    int setLifetime(const QString &accId, const XMPP::Jid &jid, int type, int days);
+
+    // bulk path for HistoryImport: all records go to the worker as one transaction
+    int importRecords(const QString &accId, const XMPP::Jid &jid, const QList<EDBFlatFile::Record> &records);
+
+    int          queuedRequests() const; // waiting for the worker thread
     void         setInsertingMode(InsertMode mode);
     void         setMirror(EDBFlatFile *mirr);
     EDBFlatFile *mirror() const;
 
 private:
-    enum { NotActive, NotCommited, Commited };
+    friend class EDBSqLiteWorker;
+
+    // the event as it is stored in the `events` table
+    struct item_event_row {
+        bool      valid = false;
+        QDateTime date;
+        int       type      = 0;
+        int       direction = 0;
+        QVariant  subject;
+        QVariant  text;
+        QVariant  lang;
+        QVariant  extraData;
+        QVariant  stanzaId; // null for what wasn't fetched from the server archive
+    };
+    struct item_append_row {
+        XMPP::Jid      j;
+        int            jidType;
+        item_event_row row;
+    };
     struct item_query_req {
-        QString       accId;
-        XMPP::Jid     j;
-        int           jidType;
-        int           type; // 0 = latest, 1 = oldest, 2 = random, 3 = write
-        int           start;
-        int           len;
-        int           dir;
-        int           id;
-        QDateTime     date;
-        QString       findStr;
-        PsiEvent::Ptr event;
-
-        enum Type { Type_get, Type_append, Type_find, Type_erase };
+        QString                accId;
+        XMPP::Jid              j;
+        int                    jidType;
+        int                    type; // 0 = latest, 1 = oldest, 2 = random, 3 = write
+        int                    start;
+        int                    len;
+        int                    dir;
+        int                    id;
+        QDateTime              date;
+        qint64                 fromId = 0; // events.id of the page boundary for cursor requests
+        QString                findStr;
+        item_event_row         row;
+        QList<item_append_row> batch;
+        int                    lifetime = -1; // days, for Type_lifetime
+        int                    chatDays = 0;  // retention defaults, 0 keeps everything
+        int                    mucDays  = 0;
+
+        enum Type { Type_get, Type_append, Type_appendBatch, Type_find, Type_erase, Type_lifetime, Type_retention };
+    };
+    // column positions of an events result, looked up once per result instead of once per value
+    struct EventColumns {
+        EventColumns(const QSqlRecord &record);
+        int id, accId, type, date, jid, direction, subject, text, lang, extraData;
     };
-    int                     status;
-    unsigned int            transactionsCounter;
-    QDateTime               lastCommitTime;
-    unsigned int            maxUncommitedRecs;
-    int                     maxUncommitedSecs;
-    unsigned int            commitByTimeoutSecs;
-    QTimer *                commitTimer;
-    EDBFlatFile *           mirror_;
-    QList<item_query_req *> rlist;
-    QHash<QString, qint64>  jidsCache;
-    QueryStorage            queryes;
+    bool             active;
+    EDBFlatFile *    mirror_;
+    QueryStorage     queryes;
+    bool             ftsEnabled;
+    QThread *        workerThread;
+    EDBSqLiteWorker *worker;
+    QSet<int>        importIds;
+    QTimer *         retentionTimer;
 
 private:
-    bool          appendEvent(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
-    PsiEvent::Ptr getEvent(const QSqlRecord &record);
-    qint64        ensureJidRowId(const QString &accId, const XMPP::Jid &jid, int type);
-    int           rowCount(const QString &accId, const XMPP::Jid &jid, const QDateTime before);
-    bool          eraseHistory(const QString &accId, const XMPP::Jid &);
-    bool          transaction(bool now);
-    bool          rollback();
-    void          startAutocommitTimer();
-    void          stopAutocommitTimer();
-    bool          importExecute();
+    void                  queueRequest(item_query_req *r);
+    static item_event_row eventRow(const PsiEvent::Ptr &e);
+    static item_event_row recordRow(const EDBFlatFile::Record &rec);
+    static QString        extraData(const XMPP::UrlList &urls);
+    PsiEvent::Ptr         getEvent(const QSqlRecord &record, const EventColumns &cols, PsiAccount *pa);
+    qint64                jidRowId(const QString &accId, const XMPP::Jid &jid);
+    bool                  upgradeSchema();
+    bool                  importExecute();
+    bool                  ensureFullTextIndex();
+
+signals:
+    void recordsImported(int id, bool success);
 
 private slots:
-    void performRequests();
-    bool commit();
+    void worker_resultReady(int id, const QList<QSqlRecord> &records, int beginRow);
+    void worker_writeFinished(int id, bool success);
+    void startRetention();
 };
 
 #endif // EDBSQLITE_H
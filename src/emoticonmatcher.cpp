@@ -0,0 +1,137 @@
+/*
+ * emoticonmatcher.cpp - finds emoticon texts in a single pass
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "emoticonmatcher.h"
+
+#include "iconset.h"
+
+#include <QQueue>
+
+// there must be whitespace at least on one side of the emoticon
+static bool isBounded(const QString &str, int pos, int length)
+{
+    const int end = pos + length;
+    return pos == 0 || str[pos - 1].isSpace() || end == str.length() || str[end].isSpace();
+}
+
+void EmoticonMatcher::clear() { nodes_.clear(); }
+
+void EmoticonMatcher::build(const QList<Iconset *> &iconsets)
+{
+    nodes_.clear();
+    nodes_.append(Node()); // root
+
+    for (const Iconset *iconset : iconsets) {
+        QListIterator<PsiIcon *> it = iconset->iterator();
+        while (it.hasNext()) {
+            PsiIcon *icon = it.next();
+            for (const PsiIcon::IconText &t : icon->text()) {
+                addText(t.text, icon);
+            }
+        }
+    }
+
+    // breadth-first, so fail targets are always done before the nodes using them
+    QQueue<int> queue;
+    for (int child : qAsConst(nodes_[0].next)) {
+        queue.enqueue(child);
+    }
+    while (!queue.isEmpty()) {
+        const int n = queue.dequeue();
+        for (auto it = nodes_[n].next.constBegin(); it != nodes_[n].next.constEnd(); ++it) {
+            const int child = it.value();
+            int       f     = nodes_[n].fail;
+            while (f && !nodes_[f].next.contains(it.key())) {
+                f = nodes_[f].fail;
+            }
+            f                  = nodes_[f].next.value(it.key(), 0);
+            nodes_[child].fail = f;
+            nodes_[child].dict = nodes_[f].length ? f : nodes_[f].dict;
+            queue.enqueue(child);
+        }
+    }
+}
+
+void EmoticonMatcher::addText(const QString &text, PsiIcon *icon)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    int n = 0;
+    for (const QChar &c : text) {
+        int next = nodes_[n].next.value(c, -1);
+        if (next == -1) {
+            next = nodes_.size();
+            nodes_[n].next.insert(c, next);
+            nodes_.append(Node());
+        }
+        n = next;
+    }
+    // the first icon having the text wins
+    if (!nodes_[n].icon) {
+        nodes_[n].length = text.length();
+        nodes_[n].icon   = icon;
+    }
+}
+
+QList<EmoticonMatcher::Match> EmoticonMatcher::match(const QString &str) const
+{
+    QList<Match> found;
+    if (isEmpty()) {
+        return found;
+    }
+
+    const int len = str.length();
+
+    // longest bounded text starting at each position
+    QVector<Match> best;
+    int            n = 0;
+    for (int i = 0; i < len; ++i) {
+        const QChar c = str[i];
+        while (n && !nodes_[n].next.contains(c)) {
+            n = nodes_[n].fail;
+        }
+        n = nodes_[n].next.value(c, 0);
+        for (int m = nodes_[n].length ? n : nodes_[n].dict; m != -1; m = nodes_[m].dict) {
+            const int pos = i + 1 - nodes_[m].length;
+            if (!isBounded(str, pos, nodes_[m].length)) {
+                continue;
+            }
+            if (best.isEmpty()) {
+                best.resize(len);
+            }
+            if (nodes_[m].length > best[pos].length) {
+                best[pos] = { pos, nodes_[m].length, nodes_[m].icon };
+            }
+        }
+    }
+    if (best.isEmpty()) {
+        return found;
+    }
+
+    for (int pos = 0; pos < len;) {
+        if (best[pos].icon) {
+            found.append(best[pos]);
+            pos += best[pos].length;
+        } else {
+            ++pos;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,61 @@
+/*
+ * emoticonmatcher.h - finds emoticon texts in a single pass
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EMOTICONMATCHER_H
+#define EMOTICONMATCHER_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+class Iconset;
+class PsiIcon;
+
+// Aho-Corasick automaton over the texts of all emoticons
+class EmoticonMatcher {
+public:
+    struct Match {
+        int      pos    = 0;
+        int      length = 0;
+        PsiIcon *icon   = nullptr;
+    };
+
+    void clear();
+    void build(const QList<Iconset *> &iconsets);
+    bool isEmpty() const { return nodes_.size() <= 1; }
+
+    // non-overlapping leftmost-longest matches, each with whitespace on at least one side
+    QList<Match> match(const QString &str) const;
+
+private:
+    struct Node {
+        QHash<QChar, int> next;
+        int               fail   = 0;
+        int               dict   = -1; // nearest node on the fail chain ending a text
+        int               length = 0;  // of the text ending here, 0 if none
+        PsiIcon *         icon   = nullptr;
+    };
+
+    void addText(const QString &text, PsiIcon *icon);
+
+    QVector<Node> nodes_;
+};
+
+#endif // EMOTICONMATCHER_H
@@ -89,6 +89,13 @@ void EDBHandle::get(const QString &accId, const XMPP::Jid &jid, const QDateTime
     d->listeningFor    = d->edb->op_get(accId, jid, date, direction, begin, len);
 }
 
+void EDBHandle::getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len)
+{
+    d->busy            = true;
+    d->lastRequestType = Read;
+    d->listeningFor    = d->edb->op_getFrom(accId, jid, fromId, direction, len);
+}
+
 void EDBHandle::find(const QString &accId, const QString &str, const XMPP::Jid &jid, const QDateTime date,
                      int direction)
 {
@@ -104,6 +111,13 @@ void EDBHandle::append(const QString &accId, const Jid &j, const PsiEvent::Ptr &
     d->listeningFor    = d->edb->op_append(accId, j, e, type);
 }
 
+void EDBHandle::append(const QString &accId, const EDBAppendBatch &items)
+{
+    d->busy            = true;
+    d->lastRequestType = Write;
+    d->listeningFor    = d->edb->op_appendBatch(accId, items);
+}
+
 void EDBHandle::erase(const QString &accId, const Jid &j)
 {
     d->busy            = true;
@@ -176,6 +190,11 @@ int EDB::op_get(const QString &accId, const Jid &jid, const QDateTime date, int
     return get(accId, jid, date, direction, start, len);
 }
 
+int EDB::op_getFrom(const QString &accId, const Jid &jid, const QString &fromId, int direction, int len)
+{
+    return getFrom(accId, jid, fromId, direction, len);
+}
+
 int EDB::op_find(const QString &accId, const QString &str, const Jid &j, const QDateTime date, int direction)
 {
     return find(accId, str, j, date, direction);
@@ -186,7 +205,13 @@ int EDB::op_append(const QString &accId, const Jid &j, const PsiEvent::Ptr &e, i
     return append(accId, j, e, type);
 }
 
-int EDB::op_erase(const QString &accId, const Jid &j) { return erase(accId, j); }
+int EDB::op_appendBatch(const QString &accId, const EDBAppendBatch &items) { return appendBatch(accId, items); }
+
+int EDB::op_erase(const QString &accId, const Jid &j)
+{
+    emit erasing(accId, j);
+    return erase(accId, j);
+}
 
 void EDB::resultReady(int req, EDBResult r, int begin_row)
 {
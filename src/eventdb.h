@@ -46,6 +46,14 @@ private:
 typedef QSharedPointer<EDBItem> EDBItemPtr;
 typedef QList<EDBItemPtr>       EDBResult;
 
+struct EDBAppendItem {
+    XMPP::Jid     jid;
+    PsiEvent::Ptr event;
+    int           type;
+    QString       stanzaId; // server archive id, see EDB::ArchiveIds
+};
+typedef QList<EDBAppendItem> EDBAppendBatch;
+
 class EDB;
 class EDBHandle : public QObject {
     Q_OBJECT
@@ -56,8 +64,12 @@ public:
 
     // operations
     void get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int begin, int len);
+    // up to len items next to the item with the given id (exclusive), cost doesn't depend on the position
+    void getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len);
     void find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
     void append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    // writes all the events at once, finished() is emitted once for the whole batch
+    void append(const QString &accId, const EDBAppendBatch &items);
     void erase(const QString &accId, const XMPP::Jid &);
 
     bool            busy() const;
@@ -84,7 +96,8 @@ class EDB : public QObject {
 public:
     enum { Forward, Backward };
     enum { Contact = 1, GroupChatContact = 2 };
-    enum { SeparateAccounts = 1, PrivateContacts = 2, AllContacts = 4, AllAccounts = 8 };
+    // ArchiveIds: an appended item with a stanza id is skipped when the same message is stored already
+    enum { SeparateAccounts = 1, PrivateContacts = 2, AllContacts = 4, AllAccounts = 8, ArchiveIds = 16 };
     struct ContactItem {
         QString   accId;
         XMPP::Jid jid;
@@ -103,11 +116,17 @@ public:
     virtual QString            getStorageParam(const QString &key)                     = 0;
     virtual void               setStorageParam(const QString &key, const QString &val) = 0;
 
+signals:
+    // before the history of jid is erased, all of it if accId or jid is empty
+    void erasing(const QString &accId, const XMPP::Jid &jid);
+
 protected:
     int         genUniqueId() const;
     virtual int get(const QString &accId, const XMPP::Jid &jid, const QDateTime date, int direction, int start, int len)
         = 0;
+    virtual int getFrom(const QString &accId, const XMPP::Jid &jid, const QString &fromId, int direction, int len) = 0;
     virtual int append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int)                         = 0;
+    virtual int appendBatch(const QString &accId, const EDBAppendBatch &items)                                      = 0;
     virtual int find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction) = 0;
     virtual int erase(const QString &accId, const XMPP::Jid &)                                                      = 0;
     void        resultReady(int, EDBResult, int);
@@ -123,8 +142,10 @@ private:
     void unreg(EDBHandle *);
 
     int op_get(const QString &accId, const XMPP::Jid &, const QDateTime date, int direction, int start, int len);
+    int op_getFrom(const QString &accId, const XMPP::Jid &, const QString &fromId, int direction, int len);
     int op_find(const QString &accId, const QString &, const XMPP::Jid &, const QDateTime date, int direction);
     int op_append(const QString &accId, const XMPP::Jid &, const PsiEvent::Ptr &, int);
+    int op_appendBatch(const QString &accId, const EDBAppendBatch &items);
     int op_erase(const QString &accId, const XMPP::Jid &);
 };
 
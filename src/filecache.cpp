@@ -20,16 +20,84 @@
 #include "filecache.h"
 
 #include "applicationinfo.h"
+#include "blobstore.h"
 #include "fileutil.h"
+#include "memorytrimmer.h"
 #include "optionstree.h"
 #include "xmpp_hash.h"
 
+#include <QDataStream>
 #include <QDebug>
 #include <QDir>
+#include <QFutureWatcher>
+#include <QSaveFile>
 #include <QTimer>
+#include <QtConcurrentRun>
 
 #define FC_META_PERSISTENT QStringLiteral("fc_persistent")
 
+// the registry is a journal of put/remove records, appended on sync and rewritten when
+// there are too many dead records in it
+static const quint32 FC_REGISTRY_MAGIC   = 0x50534643; // "PSFC"
+static const quint32 FC_REGISTRY_VERSION = 1;
+static const int     FC_REGISTRY_STREAM  = QDataStream::Qt_5_6;
+
+static const int FC_REGISTRY_MIN_COMPACT = 256; // don't bother compacting smaller journals
+
+// files this big are copied from a mapping rather than through read()
+#define FC_MMAP_THRESHOLD (64 * 1024)
+
+#define FC_REGISTRY_FILE QStringLiteral("cache.idx")
+#define FC_XML_REGISTRY_FILE QStringLiteral("cache.xml")
+
+enum { RegistryPut = 1, RegistryRemove = 2 };
+
+namespace {
+struct RegistryRecord {
+    QString     ha;
+    QVariantMap metadata;
+    QDateTime   ctime;
+    quint32     maxAge = 0;
+    quint64     size   = 0;
+    QStringList aliases;
+};
+}
+
+static QByteArray readCacheFile(const QString &fileName)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning("Can't open file %s for reading", qPrintable(fileName));
+        return QByteArray();
+    }
+    if (f.size() >= FC_MMAP_THRESHOLD) {
+        uchar *map = f.map(0, f.size());
+        if (map) {
+            QByteArray ret(reinterpret_cast<const char *>(map), int(f.size()));
+            f.unmap(map);
+            return ret;
+        }
+    }
+    return f.readAll();
+}
+
+static QStringList itemAliases(const FileCacheItem *item)
+{
+    QStringList aliases;
+    auto        it = item->sums().cbegin() + 1;
+    while (it != item->sums().cend()) {
+        aliases.append(QString("%1+%2").arg(it->stringType(), QString::fromLatin1(it->toHex())));
+        ++it;
+    }
+    return aliases;
+}
+
+static void writePutRecord(QDataStream &out, const FileCacheItem *item)
+{
+    out << quint8(RegistryPut) << item->id().stringType() << item->id().data() << item->metadata() << item->created()
+        << quint32(item->maxAge()) << quint64(item->size()) << itemAliases(item);
+}
+
 FileCacheItem::FileCacheItem(FileCache *parent, const QList<XMPP::Hash> &sums, const QVariantMap &metadata,
                              const QDateTime &dt, unsigned int maxAge, quint64 size, const QByteArray &data) :
     QObject(parent),
@@ -49,19 +117,13 @@ bool FileCacheItem::inMemory() const { return _data.size() > 0; }
 
 void FileCacheItem::flushToDisk()
 {
-    if (_flags & OnDisk) {
+    if ((_flags & OnDisk) || !_writing.isNull()) {
         return;
     }
 
     if (_data.size()) {
-        QFile f(parentCache()->cacheDir() + "/" + _fileName);
-        if (f.open(QIODevice::WriteOnly)) {
-            f.write(_data);
-            f.close();
-            _flags |= OnDisk;
-        } else {
-            qWarning("Can't open file %s for writing", qPrintable(_fileName));
-        }
+        _writing = _data; // OnDisk is set when it's written
+        parentCache()->writeBehind(this);
     } else {
         _flags |= OnDisk;
     }
@@ -69,11 +131,8 @@ void FileCacheItem::flushToDisk()
 
 bool FileCacheItem::remove() const
 {
-    if ((_flags & OnDisk) && _size) {
-        QFile f(parentCache()->cacheDir() + "/" + _fileName);
-        if (!f.remove()) {
-            return !f.exists();
-        }
+    if (((_flags & OnDisk) || !_writing.isNull()) && _size) {
+        parentCache()->removeBehind(parentCache()->cacheDir() + "/" + _fileName);
     }
     return true;
 }
@@ -82,6 +141,7 @@ void FileCacheItem::unload()
 {
     flushToDisk();
     _data = QByteArray();
+    parentCache()->trackMemory(this, false);
 }
 
 bool FileCacheItem::isExpired(bool finishSession) const
@@ -97,33 +157,56 @@ QByteArray FileCacheItem::data()
         return QByteArray();
     }
     if (!_data.size()) {
-        QFile f(parentCache()->cacheDir() + "/" + _fileName);
-        if (f.open(QIODevice::ReadOnly)) {
-            _data = f.readAll();
-            // TODO check if filesize differs
-            // TODO notify FileCache to check memory restrictions
-            f.close();
-        } else {
-            qWarning("Can't open file %s for reading", qPrintable(_fileName));
+        // TODO check if filesize differs
+        _data = _writing.isNull()
+            ? BlobStore::instance()->intern(readCacheFile(parentCache()->cacheDir() + "/" + _fileName))
+            : _writing;
+        if (_data.size()) {
+            parentCache()->trackMemory(this, true);
         }
     }
+    parentCache()->touch(this);
     return _data;
 }
 
+/**
+ * @brief Calls \a callback with the data once it's in memory. If it's loaded already, the callback
+ *  is called right away, otherwise the file is read in background. Nothing is called if \a context is
+ *  destroyed meanwhile.
+ */
+void FileCacheItem::loadData(QObject *context, DataCallback &&callback)
+{
+    if (!_size || _data.size() || !_writing.isNull()) {
+        callback(data());
+        return;
+    }
+    _loadCallbacks.append(qMakePair(QPointer<QObject>(context), std::move(callback)));
+    if (_loadCallbacks.size() == 1) {
+        parentCache()->loadBehind(this);
+    }
+}
+
 void FileCacheItem::setUndeletable(bool state)
 {
     if (state) {
         if (_metadata.contains(FC_META_PERSISTENT)) {
             _metadata.insert(FC_META_PERSISTENT, true);
-            _flags &= ~Registered; // we have to update registry eventually
+            markChanged();
         }
     } else {
         if (_metadata.remove(FC_META_PERSISTENT) > 0) {
-            _flags &= ~Registered; // we have to update registry eventually
+            markChanged();
         }
     }
 }
 
+void FileCacheItem::markChanged()
+{
+    _flags &= ~Registered;
+    parentCache()->_pendingRegisterItems.insert(id(), this);
+    parentCache()->_syncTimer->start();
+}
+
 bool FileCacheItem::isDeletable() const
 {
     return !(_flags & SessionUndeletable) && !_metadata.contains(FC_META_PERSISTENT);
@@ -132,61 +215,153 @@ bool FileCacheItem::isDeletable() const
 //------------------------------------------------------------------------------
 // FileCache
 //------------------------------------------------------------------------------
+static bool ctimeLessThan(FileCacheItem *a, FileCacheItem *b) { return a->created() < b->created(); }
+
 FileCache::FileCache(const QString &cacheDir, QObject *parent) :
     QObject(parent), _cacheDir(cacheDir), _memoryCacheSize(FileCache::DefaultMemoryCacheSize),
     _fileCacheSize(FileCache::DefaultFileCacheSize), _defaultMaxAge(Forever), _syncPolicy(InstantFLush),
-    _registryChanged(false)
+    _registrySize(0), _registryPending(0), _registryChanged(false), _registryCompact(false)
 {
-    _registry  = new OptionsTree(this);
+    _io.setMaxThreadCount(1);
+    BlobStore::instance(); // created on the gui thread, the writers use it from _io
     _syncTimer = new QTimer(this);
     _syncTimer->setSingleShot(true);
     _syncTimer->setInterval(1000);
     connect(_syncTimer, SIGNAL(timeout()), SLOT(sync()));
 
-    _registry->loadOptions(_cacheDir + "/cache.xml", "items", ApplicationInfo::fileCacheNS());
+    MemoryTrimmer::instance()->add(
+        this, [this]() { return qint64(_stats.memoryUsed); },
+        [this](MemoryTrimmer::Level level) {
+            // what is needed again is read back from disk
+            trimMemory(level == MemoryTrimmer::Critical ? 0 : _memoryCacheSize / 4);
+        });
+
+    if (!loadRegistry()) {
+        _registryCompact = true; // whatever is there can't be appended to
+        if (importXmlRegistry() && writeRegistry()) {
+            // converted from the old xml registry, it's not needed anymore
+            QFile::remove(_cacheDir + "/" + FC_XML_REGISTRY_FILE);
+        }
+    }
+
+    // nothing is known about the usage yet, so the oldest go first
+    _diskItems.sort(ctimeLessThan);
+
+    if (_registryChanged) {
+        _syncTimer->start();
+    }
+}
+
+/**
+ * Reads the binary registry. A torn record at the end (e.g. after a crash) drops only that record.
+ * Returns false if there is no usable registry file.
+ */
+bool FileCache::loadRegistry()
+{
+    QFile f(_cacheDir + "/" + FC_REGISTRY_FILE);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&f);
+    in.setVersion(FC_REGISTRY_STREAM);
+    quint32 magic = 0, version = 0;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != FC_REGISTRY_MAGIC || version != FC_REGISTRY_VERSION) {
+        return false;
+    }
+
+    QHash<QByteArray, RegistryRecord> records;
+    int                               count = 0;
+    while (!in.atEnd()) {
+        quint8         op = 0;
+        QByteArray     id;
+        RegistryRecord r;
+        in >> op >> r.ha >> id;
+        if (op == RegistryPut) {
+            in >> r.metadata >> r.ctime >> r.maxAge >> r.size >> r.aliases;
+        }
+        if (in.status() != QDataStream::Ok || (op != RegistryPut && op != RegistryRemove)) {
+            _registryCompact = true; // write a clean one on next sync
+            _registryChanged = true;
+            break;
+        }
+        ++count;
+        if (op == RegistryPut) {
+            records.insert(id, r);
+        } else {
+            records.remove(id);
+        }
+    }
+    _registrySize = count;
+
+    for (auto it = records.constBegin(); it != records.constEnd(); ++it) {
+        auto hash = XMPP::Hash(QStringRef(&it->ha));
+        if (!hash.isValid() || it.key().isEmpty()) {
+            continue;
+        }
+        hash.setData(it.key());
+        restoreItem(hash, it->metadata, it->ctime, it->maxAge, it->size, it->aliases);
+    }
+    return true;
+}
+
+/**
+ * Reads the registry in the old OptionsTree format. Returns false if there is none.
+ */
+bool FileCache::importXmlRegistry()
+{
+    const QString fileName = _cacheDir + "/" + FC_XML_REGISTRY_FILE;
+    if (!QFile::exists(fileName)) {
+        return false;
+    }
+
+    OptionsTree registry;
+    registry.loadOptions(fileName, "items", ApplicationInfo::fileCacheNS());
 
-    bool        needCleanup = false;
-    const auto &prefixes    = _registry->getChildOptionNames("", true, true);
+    const auto &prefixes = registry.getChildOptionNames("", true, true);
     for (const QString &prefix : prefixes) {
         QByteArray id = QByteArray::fromHex(prefix.section('.', -1).midRef(1).toLatin1());
         if (id.isEmpty())
             continue;
-        auto hAlgo = _registry->getOption(prefix + ".ha", QString()).toString();
+        auto hAlgo = registry.getOption(prefix + ".ha", QString()).toString();
         auto hash  = XMPP::Hash(QStringRef(&hAlgo));
         if (!hash.isValid()) {
-            needCleanup = true;
             continue;
         }
         hash.setData(id);
 
-        auto item = new FileCacheItem(
-            this, hash, _registry->getOption(prefix + ".metadata", QVariantMap()).toMap(),
-            QDateTime::fromString(_registry->getOption(prefix + ".ctime").toString(), Qt::ISODate),
-            _registry->getOption(prefix + ".max-age").toUInt(), _registry->getOption(prefix + ".size").toULongLong());
-
-        const auto aliases = _registry->getOption(prefix + ".aliases").toStringList();
-        for (const auto &s : aliases) {
-            auto ind = s.indexOf('+');
-            if (ind == -1)
-                continue;
-            auto       type = XMPP::Hash::parseType(s.leftRef(ind));
-            auto       ba   = QByteArray::fromHex(s.midRef(ind + 1).toLatin1());
-            XMPP::Hash hash(type, ba);
-            if (hash.isValid() && ba.size()) {
-                item->addHashSum(hash);
-            }
-        }
+        restoreItem(hash, registry.getOption(prefix + ".metadata", QVariantMap()).toMap(),
+                    QDateTime::fromString(registry.getOption(prefix + ".ctime").toString(), Qt::ISODate),
+                    registry.getOption(prefix + ".max-age").toUInt(),
+                    registry.getOption(prefix + ".size").toULongLong(),
+                    registry.getOption(prefix + ".aliases").toStringList());
+    }
+    return true;
+}
 
-        item->_flags |= (FileCacheItem::OnDisk | FileCacheItem::Registered);
-        _items.insert(hash, item);
-        if (item->isExpired()) {
-            remove(item->id());
+void FileCache::restoreItem(const XMPP::Hash &hash, const QVariantMap &metadata, const QDateTime &ctime,
+                            unsigned int maxAge, quint64 size, const QStringList &aliases)
+{
+    auto item = new FileCacheItem(this, hash, metadata, ctime, maxAge, size);
+
+    for (const auto &s : aliases) {
+        auto ind = s.indexOf('+');
+        if (ind == -1)
+            continue;
+        auto       type = XMPP::Hash::parseType(s.leftRef(ind));
+        auto       ba   = QByteArray::fromHex(s.midRef(ind + 1).toLatin1());
+        XMPP::Hash hash(type, ba);
+        if (hash.isValid() && ba.size()) {
+            item->_sums += hash;
         }
     }
 
-    if (needCleanup) {
-        _registryChanged = true;
-        _syncTimer->start();
+    item->_flags |= (FileCacheItem::OnDisk | FileCacheItem::Registered);
+    _items.insert(hash, item);
+    trackDisk(item, true);
+    if (item->isExpired()) {
+        remove(item->id());
     }
 }
 
@@ -194,6 +369,7 @@ FileCache::~FileCache()
 {
     gc();
     sync(true);
+    _io.waitForDone(); // let the queued writes reach the disk
 }
 
 void FileCache::gc()
@@ -219,10 +395,11 @@ FileCacheItem *FileCache::append(const QList<XMPP::Hash> &sums, const QByteArray
 {
     Q_ASSERT(sums.size() > 0);
 
-    FileCacheItem *item
-        = new FileCacheItem(this, sums, metadata, QDateTime::currentDateTime(), maxAge, qint64(data.size()), data);
+    FileCacheItem *item = new FileCacheItem(this, sums, metadata, QDateTime::currentDateTime(), maxAge,
+                                            qint64(data.size()), BlobStore::instance()->intern(data));
     for (auto const &s : sums)
         _items.insert(s, item);
+    trackMemory(item, true);
     _pendingRegisterItems.insert(sums[0], item);
     _syncTimer->start();
     return item;
@@ -246,6 +423,7 @@ FileCacheItem *FileCache::moveToCache(const QList<XMPP::Hash> &sums, const QFile
     item->_flags |= FileCacheItem::OnDisk;
     for (auto const &s : sums)
         _items.insert(s, item);
+    trackDisk(item, true);
     _pendingRegisterItems.insert(sums[0], item);
     _syncTimer->start();
 
@@ -263,10 +441,15 @@ void FileCache::remove(const XMPP::Hash &id, bool needSync)
 void FileCache::removeItem(FileCacheItem *item, bool needSync)
 {
     if (item->isOnDisk()) {
-        _registry->removeOption("h" + item->id().toHex(), true);
+        QDataStream out(&_registryRecords, QIODevice::WriteOnly | QIODevice::Append);
+        out.setVersion(FC_REGISTRY_STREAM);
+        out << quint8(RegistryRemove) << item->id().stringType() << item->id().data();
+        ++_registryPending;
         _registryChanged = true;
     }
     item->remove();
+    trackMemory(item, false);
+    trackDisk(item, false);
     for (auto const &a : item->sums()) {
         _items.remove(a);
     }
@@ -290,10 +473,13 @@ FileCacheItem *FileCache::get(const XMPP::Hash &id, bool reborn)
                 item->reborn();
                 toRegistry(item);
             }
+            ++_stats.hits;
+            touch(item);
             return item;
         }
         remove(id);
     }
+    ++_stats.misses;
     return nullptr;
 }
 
@@ -303,113 +489,235 @@ QByteArray FileCache::getData(const XMPP::Hash &id, bool reborn)
     return item ? item->data() : QByteArray();
 }
 
-bool ctimeLessThan(FileCacheItem *a, FileCacheItem *b) { return a->created() < b->created(); }
-
 void FileCache::sync() { sync(false); }
 
 void FileCache::sync(bool finishSession)
 {
-    QList<FileCacheItem *> loadedItems;
-    QList<FileCacheItem *> onDiskItems;
-    qint64                 sumMemorySize = 0;
-    qint64                 sumFileSize   = 0;
-    FileCacheItem *        item;
-
-    QHashIterator<XMPP::Hash, FileCacheItem *> it(_items);
-    while (it.hasNext()) {
-        it.next();
-        item = it.value();
-        item->flushToDisk(); /* even if we are going to remove it. it's quite rare to worry about */
-        if (item->isExpired(finishSession)) {
-            removeItem(item, false); // even if virtual method stopped removing, we don't touch this item below.
-            continue;
-        }
-        if (item->size()) {
-            if (item->inMemory()) {
-                loadedItems.append(item);
-                sumMemorySize += item->size();
-            }
-            if (item->isOnDisk()) {
-                sumFileSize += item->size();
-                onDiskItems.append(item);
+    if (finishSession) {
+        QList<FileCacheItem *> items;
+        for (auto it = _items.constBegin(); it != _items.constEnd(); ++it) {
+            if (it.key() == it.value()->id()) { // skip aliases
+                items.append(it.value());
             }
-        } else if (!item->isRegistered()) { // just put to registry item without data and stop reviewing it
-            toRegistry(item);               // save item to registry if not yet
         }
-    }
-
-    // if (sumDataSize > _fileCacheSize || sumMemorySize > _memoryCacheSize) {
-
-    // flush overflowed in-memory data to disk
-    if (sumMemorySize > _memoryCacheSize) {
-        std::sort(loadedItems.begin(), loadedItems.end(), ctimeLessThan); // by create time from oldest to newest
-        while (sumMemorySize > _memoryCacheSize && loadedItems.size()) {
-            item = loadedItems.takeFirst();
-            if (!item->isOnDisk()) { // was kept in memory only. unload() will flush to disk
-                sumFileSize += item->size();
-                onDiskItems.append(item);
-            }
-            item->unload(); // will flush data to disk if necesary
-            sumMemorySize -= item->size();
-            if (!item->isRegistered()) {
-                toRegistry(item); // save item to registry if not yet
+        for (FileCacheItem *item : qAsConst(items)) {
+            if (item->isExpired(true)) {
+                removeItem(item, false);
+            } else {
+                item->flushToDisk();
             }
         }
     }
 
     // register pending items and flush them if necessary
-    it = QHashIterator<XMPP::Hash, FileCacheItem *>(_pendingRegisterItems);
+    QHashIterator<XMPP::Hash, FileCacheItem *> it(_pendingRegisterItems);
     while (it.hasNext()) {
-        item = it.next().value();
+        FileCacheItem *item = it.next().value();
         toRegistry(item); // FIXME do this only after we have a file on disk (or data size = 0)
         if (_syncPolicy == InstantFLush) {
             item->flushToDisk();
         }
     }
 
-    // remove overflowed disk data
-    if (sumFileSize > _fileCacheSize) {
-        std::sort(onDiskItems.begin(), onDiskItems.end(), ctimeLessThan);
-        while (sumFileSize > _fileCacheSize && onDiskItems.size()) {
-            item = onDiskItems.takeFirst();
-            if (!item->isDeletable()) {
-                continue;
-            }
-            auto id = item->id();
-            auto sz = item->size();
-            removeItem(item, false);
-            if (!_items.value(id)) { // really removed
-                sumFileSize -= sz;
-            }
+    // flush overflowed in-memory data to disk, least recently used first
+    while (_stats.memoryUsed > _memoryCacheSize && !_memoryItems.empty()) {
+        FileCacheItem *item = _memoryItems.front();
+        item->unload(); // will flush data to disk if necesary
+        ++_stats.memoryEvictions;
+    }
+    BlobStore::instance()->sweep();
+
+    // remove overflowed disk data. undeletable items are moved to the end, so each one is looked at once
+    auto left = _diskItems.size();
+    while (_stats.diskUsed > _fileCacheSize && left--) {
+        FileCacheItem *item = _diskItems.front();
+        if (!item->isDeletable()) {
+            _diskItems.splice(_diskItems.end(), _diskItems, item->_diskPos);
+            continue;
+        }
+        auto id = item->id();
+        removeItem(item, false);
+        item = _items.value(id);
+        if (item && item->_inDiskList) { // virtual method stopped removing
+            _diskItems.splice(_diskItems.end(), _diskItems, item->_diskPos);
+        } else {
+            ++_stats.diskEvictions;
         }
     }
 
     if (_registryChanged) {
-        _registry->saveOptions(_cacheDir + "/cache.xml", "items", ApplicationInfo::fileCacheNS(),
-                               ApplicationInfo::version());
-        _registryChanged = false;
+        writeRegistry();
     }
 }
 
-void FileCache::toRegistry(FileCacheItem *item)
+void FileCache::trimMemory(quint64 keep)
 {
-    // TODO build Map/Hash instead and insert it to options
-    QString prefix = QString("h") + QString::fromLatin1(item->id().toHex());
-    _registry->setOption(prefix + ".ha", item->id().stringType());
-    _registry->setOption(prefix + ".metadata", item->metadata());
-    _registry->setOption(prefix + ".ctime", item->created().toString(Qt::ISODate));
-    _registry->setOption(prefix + ".max-age", int(item->maxAge()));
-    _registry->setOption(prefix + ".size", qulonglong(item->size()));
+    while (_stats.memoryUsed > keep && !_memoryItems.empty()) {
+        _memoryItems.front()->unload(); // will flush data to disk if necesary
+        ++_stats.memoryEvictions;
+    }
+}
 
-    QStringList aliases;
-    auto        it = item->sums().cbegin() + 1;
-    while (it != item->sums().cend()) {
-        aliases.append(QString("%1+%2").arg(it->stringType(), QString::fromLatin1(it->toHex())));
-        ++it;
+void FileCache::writeBehind(FileCacheItem *item)
+{
+    const QString           fileName = _cacheDir + "/" + item->fileName();
+    const QByteArray        data     = item->_writing;
+    QPointer<FileCacheItem> guard(item);
+
+    auto watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, guard]() {
+        bool written = watcher->result();
+        watcher->deleteLater();
+        if (!guard) {
+            return; // removed meanwhile, the file removal was queued after the write
+        }
+        guard->_writing = QByteArray();
+        if (written) {
+            guard->_flags |= FileCacheItem::OnDisk;
+            trackDisk(guard, true);
+        }
+    });
+    watcher->setFuture(
+        QtConcurrent::run(&_io, [fileName, data]() { return BlobStore::instance()->write(data, fileName); }));
+}
+
+void FileCache::removeBehind(const QString &fileName)
+{
+    QtConcurrent::run(&_io, [fileName]() { QFile::remove(fileName); });
+}
+
+void FileCache::loadBehind(FileCacheItem *item)
+{
+    const QString           fileName = _cacheDir + "/" + item->fileName();
+    QPointer<FileCacheItem> guard(item);
+
+    auto watcher = new QFutureWatcher<QByteArray>(this);
+    connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, guard]() {
+        QByteArray data = watcher->result();
+        watcher->deleteLater();
+        if (!guard) {
+            return;
+        }
+        if (!guard->_data.size() && data.size()) {
+            guard->_data = BlobStore::instance()->intern(data);
+            trackMemory(guard, true);
+        }
+        touch(guard);
+        const auto callbacks = std::move(guard->_loadCallbacks);
+        guard->_loadCallbacks.clear();
+        for (const auto &cb : callbacks) {
+            if (cb.first) {
+                cb.second(guard->_data);
+            }
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&_io, [fileName]() { return readCacheFile(fileName); }));
+}
+
+void FileCache::touch(FileCacheItem *item)
+{
+    if (item->_inMemoryList) {
+        _memoryItems.splice(_memoryItems.end(), _memoryItems, item->_memoryPos);
+    }
+    if (item->_inDiskList) {
+        _diskItems.splice(_diskItems.end(), _diskItems, item->_diskPos);
+    }
+}
+
+void FileCache::trackMemory(FileCacheItem *item, bool loaded)
+{
+    if (loaded == item->_inMemoryList || (loaded && !item->size())) {
+        return;
+    }
+    if (loaded) {
+        item->_memoryPos = _memoryItems.insert(_memoryItems.end(), item);
+        _stats.memoryUsed += item->size();
+    } else {
+        _memoryItems.erase(item->_memoryPos);
+        _stats.memoryUsed -= item->size();
+    }
+    item->_inMemoryList = loaded;
+}
+
+void FileCache::trackDisk(FileCacheItem *item, bool onDisk)
+{
+    if (onDisk == item->_inDiskList || (onDisk && !item->size())) {
+        return;
+    }
+    if (onDisk) {
+        item->_diskPos = _diskItems.insert(_diskItems.end(), item);
+        _stats.diskUsed += item->size();
+    } else {
+        _diskItems.erase(item->_diskPos);
+        _stats.diskUsed -= item->size();
+    }
+    item->_inDiskList = onDisk;
+}
+
+/**
+ * Appends pending records to the registry file, or rewrites it with live items only
+ * when most of its records are dead.
+ */
+bool FileCache::writeRegistry()
+{
+    QList<FileCacheItem *> live;
+    for (auto it = _items.constBegin(); it != _items.constEnd(); ++it) {
+        if (it.key() == it.value()->id()) {
+            live.append(it.value());
+        }
+    }
+
+    const QString fileName = _cacheDir + "/" + FC_REGISTRY_FILE;
+    if (!_registryCompact && _registrySize > FC_REGISTRY_MIN_COMPACT && _registrySize > live.size() * 2) {
+        _registryCompact = true;
+    }
+
+    if (!_registryCompact) {
+        QFile f(fileName);
+        if (f.exists() && f.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            f.write(_registryRecords);
+            if (f.error() == QFileDevice::NoError) {
+                _registrySize += _registryPending;
+                _registryRecords.clear();
+                _registryPending = 0;
+                _registryChanged = false;
+                return true;
+            }
+        }
+        _registryCompact = true; // no file yet or it's broken, write it from scratch
     }
-    _registry->setOption(prefix + ".aliases", aliases);
 
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        qWarning("Can't open file %s for writing", qPrintable(fileName));
+        return false;
+    }
+    QDataStream out(&f);
+    out.setVersion(FC_REGISTRY_STREAM);
+    out << FC_REGISTRY_MAGIC << FC_REGISTRY_VERSION;
+    for (const FileCacheItem *item : qAsConst(live)) {
+        writePutRecord(out, item);
+    }
+    if (!f.commit()) {
+        return false;
+    }
+    _registrySize    = live.size();
+    _registryPending = 0;
+    _registryRecords.clear();
+    _registryChanged = false;
+    _registryCompact = false;
+    return true;
+}
+
+void FileCache::toRegistry(FileCacheItem *item)
+{
     item->_flags |= FileCacheItem::Registered;
+
+    QDataStream out(&_registryRecords, QIODevice::WriteOnly | QIODevice::Append);
+    out.setVersion(FC_REGISTRY_STREAM);
+    writePutRecord(out, item);
+    ++_registryPending;
+
     _pendingRegisterItems.remove(item->id());
     _registryChanged = true;
 }
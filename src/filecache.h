@@ -27,17 +27,21 @@
 #include <QFileInfo>
 #include <QHash>
 #include <QObject>
+#include <QPointer>
+#include <QThreadPool>
 #include <QVariantMap>
+#include <functional>
+#include <list>
 #include <memory>
 
 class FileCache;
-class OptionsTree;
 class QTimer;
 
 class FileCacheItem : public QObject {
     Q_OBJECT
 public:
-    using Ptr = std::shared_ptr<FileCacheItem>;
+    using Ptr          = std::shared_ptr<FileCacheItem>;
+    using DataCallback = std::function<void(const QByteArray &)>;
 
     enum Flags {
         OnDisk             = 0x1,
@@ -67,20 +71,22 @@ public:
     inline void       addHashSum(const XMPP::Hash &id)
     {
         _sums += id;
-        _flags &= ~Registered;
+        markChanged();
     }
     inline const QList<XMPP::Hash> &sums() const { return _sums; }
     inline QVariantMap              metadata() const { return _metadata; }
     inline void                     setMetadata(const QVariantMap &md)
     {
         _metadata = md;
-        _flags &= ~Registered;
+        markChanged();
     } // we have to update registry eventually
     inline QDateTime    created() const { return _ctime; }
     inline void         reborn() { _ctime = QDateTime::currentDateTime(); }
     inline unsigned int maxAge() const { return _maxAge; }
     inline quint64      size() const { return _size; }
     QByteArray          data();
+    // like data() but reads the file in background if it's not in memory
+    void                loadData(QObject *context, DataCallback &&callback);
     inline QString      fileName() const { return _fileName; }
 
     inline void setSessionUndeletable(bool state = true)
@@ -96,6 +102,8 @@ public:
 private:
     friend class FileCache;
 
+    void markChanged(); // schedules registry update
+
     QList<XMPP::Hash> _sums;
     QVariantMap       _metadata;
     QDateTime         _ctime;
@@ -103,8 +111,17 @@ private:
     quint64           _size;
     QByteArray        _data;
 
-    quint16 _flags;
-    QString _fileName;
+    quint16    _flags;
+    QString    _fileName;
+    QByteArray _writing; // data being written to disk in background
+
+    QList<QPair<QPointer<QObject>, DataCallback>> _loadCallbacks; // waiting for data being read in background
+
+    // positions in the recently used lists of FileCache
+    std::list<FileCacheItem *>::iterator _memoryPos;
+    std::list<FileCacheItem *>::iterator _diskPos;
+    bool                                 _inMemoryList = false;
+    bool                                 _inDiskList   = false;
 };
 
 class FileCache : public QObject {
@@ -121,6 +138,15 @@ public:
         FlushOverflow // flush to disk only when memory cache limit is exceeded
     };
 
+    struct Stats {
+        quint64 hits            = 0;
+        quint64 misses          = 0;
+        quint64 memoryEvictions = 0; // unloaded to fit into memory cache size
+        quint64 diskEvictions   = 0; // removed to fit into file cache size
+        quint64 memoryUsed      = 0; // bytes of data in memory
+        quint64 diskUsed        = 0; // bytes of data on disk
+    };
+
     FileCache(const QString &cacheDir, QObject *parent = nullptr);
     ~FileCache();
 
@@ -140,6 +166,8 @@ public:
     inline void       setSyncPolicy(SyncPolicy sp) { _syncPolicy = sp; }
     inline SyncPolicy syncPolicy() const { return _syncPolicy; }
 
+    inline const Stats &stats() const { return _stats; }
+
     /**
      * @brief Add data to cache
      * @param sums - hash sums of the data (at least 1)
@@ -175,6 +203,8 @@ public:
     FileCacheItem *get(const XMPP::Hash &id, bool reborn = false);
     QByteArray     getData(const XMPP::Hash &id, bool reborn = false);
     void           sync(bool finishSession);
+    // unloads least recently used data until no more than keep bytes are in memory
+    void           trimMemory(quint64 keep);
 
 protected:
     /**
@@ -189,7 +219,20 @@ public slots:
     void sync();
 
 private:
+    friend class FileCacheItem;
+
     void toRegistry(FileCacheItem *);
+    void writeBehind(FileCacheItem *item);
+    void removeBehind(const QString &fileName);
+    void loadBehind(FileCacheItem *item);
+    void touch(FileCacheItem *item);
+    void trackMemory(FileCacheItem *item, bool loaded);
+    void trackDisk(FileCacheItem *item, bool onDisk);
+    bool loadRegistry();
+    bool importXmlRegistry();
+    void restoreItem(const XMPP::Hash &hash, const QVariantMap &metadata, const QDateTime &ctime, unsigned int maxAge,
+                     quint64 size, const QStringList &aliases);
+    bool writeRegistry();
 
 protected:
     QHash<XMPP::Hash, FileCacheItem *> _items;
@@ -201,10 +244,17 @@ private:
     unsigned int                       _defaultMaxAge;
     SyncPolicy                         _syncPolicy;
     QTimer *                           _syncTimer;
-    OptionsTree *                      _registry;
     QHash<XMPP::Hash, FileCacheItem *> _pendingRegisterItems;
+    std::list<FileCacheItem *>         _memoryItems; // loaded items, least recently used first
+    std::list<FileCacheItem *>         _diskItems;   // items with data on disk, least recently used first
+    Stats                              _stats;
+    QThreadPool                        _io; // one thread, so writes and removals of a file keep their order
+    QByteArray                         _registryRecords; // not yet appended to the registry file
+    int                                _registrySize;    // records in the registry file, live or not
+    int                                _registryPending; // records in _registryRecords
 
     bool _registryChanged;
+    bool _registryCompact; // rewrite the registry file instead of appending to it
 };
 
 #endif // FILECACHE_H
@@ -0,0 +1,114 @@
+/*
+ * filehasher.cpp - off-thread checksums of local files
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "filehasher.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QtConcurrent>
+
+// files remembered with their sums
+#define HASHED_FILES_CACHE_SIZE 1024
+// read by this many bytes
+#define HASH_READ_BLOCK (1024 * 1024)
+// progress is reported after every this many bytes
+#define HASH_PROGRESS_STEP (16 * 1024 * 1024)
+
+FileHasher *FileHasher::instance_ = nullptr;
+
+FileHasher *FileHasher::instance()
+{
+    if (!instance_)
+        instance_ = new FileHasher;
+    return instance_;
+}
+
+FileHasher::FileHasher() : QObject(QCoreApplication::instance()), sums_(HASHED_FILES_CACHE_SIZE)
+{
+    pool_.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+FileHasher::~FileHasher()
+{
+    pool_.clear();
+    pool_.waitForDone();
+    instance_ = nullptr;
+}
+
+QList<XMPP::Hash> FileHasher::cached(const QFileInfo &fi) const
+{
+    QMutexLocker locker(&mutex_);
+    auto         e = sums_.object(fi.absoluteFilePath());
+    if (e && e->size == fi.size() && e->modifyTime == fi.lastModified().toUTC())
+        return e->sums;
+    return QList<XMPP::Hash>();
+}
+
+void FileHasher::hash(const QFileInfo &fi)
+{
+    const QString fileName = fi.absoluteFilePath();
+    {
+        QMutexLocker locker(&mutex_);
+        if (running_.contains(fileName))
+            return; // finished() will come for all of them
+        running_.insert(fileName);
+    }
+    QtConcurrent::run(&pool_, this, &FileHasher::run, fileName, fi.size(), fi.lastModified().toUTC());
+}
+
+void FileHasher::run(const QString &fileName, qint64 size, const QDateTime &modifyTime)
+{
+    // sha1 is what everyone understands, sha256 is what newer clients prefer
+    QCryptographicHash sha1(QCryptographicHash::Sha1);
+    QCryptographicHash sha256(QCryptographicHash::Sha256);
+
+    QFile file(fileName);
+    bool  ok = file.open(QIODevice::ReadOnly);
+    if (ok) {
+        QByteArray buf(HASH_READ_BLOCK, Qt::Uninitialized);
+        qint64     done = 0, reported = 0;
+        qint64     bytesRead;
+        while ((bytesRead = file.read(buf.data(), buf.size())) > 0) {
+            sha1.addData(buf.constData(), int(bytesRead));
+            sha256.addData(buf.constData(), int(bytesRead));
+            done += bytesRead;
+            if (done - reported >= HASH_PROGRESS_STEP) {
+                reported = done;
+                emit progress(fileName, done, size);
+            }
+        }
+        ok = bytesRead == 0;
+    }
+
+    {
+        QMutexLocker locker(&mutex_);
+        running_.remove(fileName);
+        if (ok) {
+            auto e        = new Entry;
+            e->size       = size;
+            e->modifyTime = modifyTime;
+            e->sums << XMPP::Hash(XMPP::Hash::Sha1, sha1.result()) << XMPP::Hash(XMPP::Hash::Sha256, sha256.result());
+            sums_.insert(fileName, e);
+        }
+    }
+    emit finished(fileName, ok);
+}
@@ -0,0 +1,71 @@
+/*
+ * filehasher.h - off-thread checksums of local files
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FILEHASHER_H
+#define FILEHASHER_H
+
+#include "xmpp_hash.h"
+
+#include <QCache>
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QThreadPool>
+
+class QFileInfo;
+
+// Computes all the sums of a file in one read pass in a worker thread. Files are hashed in parallel,
+// each one by its own thread. Results are remembered by path, size and modification time, so sharing
+// the same file again doesn't read it.
+class FileHasher : public QObject {
+    Q_OBJECT
+
+public:
+    static FileHasher *instance();
+
+    // returns the sums right away if the file didn't change since it was hashed
+    QList<XMPP::Hash> cached(const QFileInfo &fi) const;
+    // result comes with finished(), progress() is reported while reading
+    void hash(const QFileInfo &fi);
+
+signals:
+    void progress(const QString &fileName, qint64 done, qint64 total);
+    void finished(const QString &fileName, bool success);
+
+private:
+    struct Entry {
+        qint64            size;
+        QDateTime         modifyTime;
+        QList<XMPP::Hash> sums;
+    };
+
+    FileHasher();
+    ~FileHasher();
+
+    void run(const QString &fileName, qint64 size, const QDateTime &modifyTime);
+
+    static FileHasher *    instance_;
+    mutable QMutex         mutex_; // guards sums_ and running_
+    QCache<QString, Entry> sums_;  // absolute file path -> sums
+    QSet<QString>          running_;
+    QThreadPool            pool_;
+};
+
+#endif // FILEHASHER_H
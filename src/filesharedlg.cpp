@@ -70,7 +70,22 @@ FileShareDlg::FileShareDlg(PsiAccount *acc, const XMPP::Jid &myJid, const QList<
             tr->setState(MultiFileTransferModel::Done);
         }
         tr->setProperty("publisher", QVariant::fromValue<FileSharingItem *>(pi));
+        if (pi->isHashing()) {
+            hashingCount++;
+            tr->setState(MultiFileTransferModel::Pending, FileShareDlg::tr("Computing checksum"));
+            connect(pi, &FileSharingItem::hashProgress, tr, [tr](qint64 done) { tr->setCurrentSize(quint64(done)); });
+            connect(pi, &FileSharingItem::hashFinished, this, [this, pi, tr]() {
+                tr->setCurrentSize(0);
+                if (pi->sums().isEmpty())
+                    tr->setState(MultiFileTransferModel::Failed, FileShareDlg::tr("Failed to read the file"));
+                else
+                    tr->setState(MultiFileTransferModel::Pending);
+                if (!--hashingCount)
+                    ui->buttonBox->button(QDialogButtonBox::Apply)->setEnabled(true);
+            });
+        }
     }
+    shareBtn->setEnabled(!hashingCount); // nothing to publish before the sums are known
 
     QImage preview;
     if (items.count() > 1
@@ -104,6 +119,10 @@ void FileShareDlg::publish()
     QList<FileSharingItem *> toPublish;
     filesModel->forEachTransfer([this, &toPublish](MultiFileTransferItem *item) {
         auto publisher = item->property("publisher").value<FileSharingItem *>();
+        if (publisher->sums().isEmpty()) {
+            hasFailures = true; // unreadable file
+            return;
+        }
         if (publisher->isPublished()) {
             item->setState(MultiFileTransferModel::Done);
             item->setCurrentSize(item->fullSize());
@@ -66,6 +66,7 @@ private:
     QList<FileSharingItem *> readyPublishers;
     Callback                 publishedCallback;
     int                      inProgressCount = 0;
+    int                      hashingCount    = 0; // items still computing their sums
     bool                     hasFailures     = false;
 };
 
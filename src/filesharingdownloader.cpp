@@ -33,12 +33,43 @@
 #include "xmpp_jid.h"
 
 #include <QByteArray>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkReply>
+#include <QSaveFile>
 #include <QTimer>
 #include <QUrlQuery>
 #include <QVariant>
+#include <QVector>
+
+// files of known size from this size up are fetched in segments from all the sources at once
+#define SEGMENTED_MIN_SIZE (8 * 1024 * 1024)
+#define SEGMENT_SIZE (4 * 1024 * 1024)
+// segments downloaded at the same time, one per source
+#define MAX_SEGMENT_DOWNLOADS 4
+// the frontier is hashed by this many bytes per event loop iteration
+#define FRONTIER_HASH_STEP (16 * 1024 * 1024)
+
+static bool hashAlgorithm(XMPP::Hash::Type type, QCryptographicHash::Algorithm *algo)
+{
+    switch (type) {
+    case XMPP::Hash::Sha1:
+        *algo = QCryptographicHash::Sha1;
+        return true;
+    case XMPP::Hash::Sha256:
+        *algo = QCryptographicHash::Sha256;
+        return true;
+    case XMPP::Hash::Sha512:
+        *algo = QCryptographicHash::Sha512;
+        return true;
+    default:
+        return false;
+    }
+}
 
 class AbstractFileShareDownloader : public QObject {
     Q_OBJECT
@@ -114,6 +145,7 @@ class JingleFileShareDownloader : public AbstractFileShareDownloader {
     Jingle::FileTransfer::Application *app = nullptr;
     XMPP::Jingle::FileTransfer::File   file;
     QList<Jid>                         jids;
+    Jid                                sourceJid; // use just this peer
 
 public:
     JingleFileShareDownloader(PsiAccount *acc_, const QString &uri, const XMPP::Jingle::FileTransfer::File &file,
@@ -123,6 +155,8 @@ public:
     {
     }
 
+    inline void setSourceJid(const Jid &jid) { sourceJid = jid; }
+
     void start()
     {
         QUrl    uriToOpen(sourceUri);
@@ -132,7 +166,9 @@ public:
         }
         Jid  entity     = JIDUtil::fromString(path);
         auto sourceJids = jids;
-        if (entity.isValid() && !entity.node().isEmpty())
+        if (sourceJid.isValid())
+            sourceJids = QList<Jid>() << sourceJid;
+        else if (entity.isValid() && !entity.node().isEmpty())
             sourceJids.prepend(entity);
         Jid dataSource = selectOnlineJid(sourceJids);
         if (!dataSource.isValid()) {
@@ -400,7 +436,8 @@ public:
     QList<XMPP::Hash>            sums;
     Jingle::FileTransfer::File   file;
     QList<Jid>                   jids;
-    QStringList                  uris; // sorted from low priority to high.
+    QStringList                  uris;    // sorted from low priority to high.
+    QStringList                  allUris; // uris are taken one by one, this one stays for the resume state
     QScopedPointer<QFile>        tmpFile;
     QString                      dstFileName;
     QString                      lastError;
@@ -414,16 +451,46 @@ public:
     bool                         selfDelete  = false;
     FileSharingItem::SourceType  currentType = FileSharingItem::SourceType::None;
 
-    void finishWithError(const QString &errStr)
+    // segmented mode. segments are written to tmpFile as they come and read back in order
+    struct Segment {
+        qint64                       start;
+        qint64                       size;
+        qint64                       done       = 0;
+        int                          source     = -1; // index in segSources
+        AbstractFileShareDownloader *downloader = nullptr;
+    };
+    struct Source {
+        QString uri;
+        Jid     jid; // jingle sources are split by peer
+        bool    busy   = false;
+        bool    failed = false;
+    };
+    bool                               segmented = false;
+    QVector<Segment>                   segments; // sorted by start
+    QVector<Source>                    segSources;
+    QScopedPointer<QCryptographicHash> segHash;
+    qint64                             segFrontier = 0; // everything before it is written and hashed
+    qint64                             readPos     = 0;
+    bool                               verified    = false;
+    bool                               hashPending = false; // more of the frontier is to be hashed
+
+    // the partial file is kept for the next attempt unless it's discarded as broken
+    void finishWithError(const QString &errStr, bool discard = false)
     {
         Q_ASSERT(!finished);
+        abortSegments();
         finished  = true;
         success   = false;
         lastError = errStr;
         if (tmpFile) {
-            tmpFile->close();
-            tmpFile->remove();
-
+            if (discard) {
+                tmpFile->close();
+                tmpFile->remove();
+                QFile::remove(stateFileName());
+            } else {
+                saveState();
+                tmpFile->close();
+            }
             tmpFile.reset();
         }
         dstFileName.clear();
@@ -439,6 +506,7 @@ public:
             if (tmpFile) {
                 tmpFile->close();
                 tmpFile.reset();
+                QFile::remove(stateFileName());
                 emit q->cacheReady();
             }
             finished = true;
@@ -451,6 +519,375 @@ public:
         }
     }
 
+    inline QString stateFileName() const { return dstFileName + QLatin1String(".state"); }
+
+    // remembers what is already in the partial file, so the next attempt asks only for the rest
+    void saveState()
+    {
+        if (dstFileName.isEmpty() || success || !file.hasSize() || !tmpFile)
+            return;
+
+        QJsonArray ranges;
+        if (segmented) {
+            for (const Segment &seg : qAsConst(segments)) {
+                if (seg.done)
+                    ranges.append(QJsonArray { seg.start, seg.done });
+            }
+        } else {
+            tmpFile->flush();
+            if (tmpFile->size())
+                ranges.append(QJsonArray { 0, tmpFile->size() });
+        }
+        if (ranges.isEmpty()) {
+            QFile::remove(stateFileName());
+            return;
+        }
+
+        QJsonArray jsums;
+        for (const auto &h : qAsConst(sums)) {
+            jsums.append(QJsonObject { { "type", int(h.type()) }, { "data", QString::fromLatin1(h.data().toHex()) } });
+        }
+        QJsonObject state { { "size", qint64(file.size()) },
+                            { "sums", jsums },
+                            { "uris", QJsonArray::fromStringList(allUris) },
+                            { "ranges", ranges } };
+
+        QSaveFile f(stateFileName());
+        if (f.open(QIODevice::WriteOnly)) {
+            f.write(QJsonDocument(state).toJson(QJsonDocument::Compact));
+            f.commit();
+        }
+    }
+
+    // ranges of the partial file left by an earlier attempt, as start and size
+    QList<QPair<qint64, qint64>> loadState()
+    {
+        QList<QPair<qint64, qint64>> ret;
+        QFile                        f(stateFileName());
+        if (!f.open(QIODevice::ReadOnly))
+            return ret;
+        auto state = QJsonDocument::fromJson(f.readAll()).object();
+        f.close();
+
+        bool sumsMatch = false;
+        for (const auto &v : state.value("sums").toArray()) {
+            auto jh   = v.toObject();
+            sumsMatch = sumsMatch
+                || (jh.value("type").toInt() == int(sums[0].type())
+                    && QByteArray::fromHex(jh.value("data").toString().toLatin1()) == sums[0].data());
+        }
+        const qint64 partSize = QFileInfo(dstFileName).size();
+        if (!sumsMatch || state.value("size").toVariant().toLongLong() != qint64(file.size())) {
+            QFile::remove(stateFileName());
+            return ret;
+        }
+        for (const auto &v : state.value("ranges").toArray()) {
+            auto   r     = v.toArray();
+            qint64 start = r.at(0).toVariant().toLongLong();
+            qint64 size  = r.at(1).toVariant().toLongLong();
+            if (start >= 0 && size > 0 && start + size <= partSize)
+                ret.append(qMakePair(start, size));
+        }
+        // sources known back then are still worth a try
+        for (const auto &v : state.value("uris").toArray()) {
+            if (!uris.contains(v.toString())) {
+                uris.prepend(v.toString());
+                allUris.prepend(v.toString());
+            }
+        }
+        return ret;
+    }
+
+    bool startSegmented()
+    {
+        if (rangeStart || rangeSize || !file.hasSize())
+            return false;
+        QCryptographicHash::Algorithm algo;
+        if (sums.isEmpty() || !hashAlgorithm(sums[0].type(), &algo))
+            return false; // segments couldn't be verified
+
+        auto partDir = QDir(acc->psi()->fileSharingManager()->cacheDir() + "/partial");
+        dstFileName  = partDir.absoluteFilePath(QString::fromLatin1(sums.value(0).data().toHex()));
+        auto resumed = loadState();
+        if (resumed.isEmpty() && qint64(file.size()) < SEGMENTED_MIN_SIZE) {
+            dstFileName.clear();
+            return false;
+        }
+
+        bool jingleAdded = false;
+        for (int i = uris.size() - 1; i >= 0; --i) { // high priority first
+            switch (FileSharingItem::sourceType(uris[i])) {
+            case FileSharingItem::SourceType::HTTP:
+            case FileSharingItem::SourceType::FTP:
+                segSources.append({ uris[i], Jid() });
+                break;
+            case FileSharingItem::SourceType::Jingle:
+                if (jingleAdded)
+                    break;
+                jingleAdded = true;
+                for (const Jid &j : qAsConst(jids)) {
+                    if (j != acc->client()->jid())
+                        segSources.append({ uris[i], j });
+                }
+                break;
+            default:
+                break; // bob has no ranges
+            }
+        }
+        if (segSources.size() < (resumed.isEmpty() ? 2 : 1)) { // a single source is fine to resume with
+            segSources.clear();
+            dstFileName.clear();
+            return false;
+        }
+
+        const qint64 size = qint64(file.size());
+        partDir.mkpath(".");
+        tmpFile.reset(new QFile(dstFileName));
+        auto mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+        if (!tmpFile->open(resumed.isEmpty() ? mode | QIODevice::Truncate : mode)) {
+            tmpFile.reset();
+            dstFileName.clear();
+            segSources.clear();
+            return false;
+        }
+        tmpFile->resize(size);
+
+        for (qint64 start = 0; start < size; start += SEGMENT_SIZE) {
+            Segment seg;
+            seg.start = start;
+            seg.size  = qMin(qint64(SEGMENT_SIZE), size - start);
+            for (const auto &r : qAsConst(resumed)) {
+                if (r.first <= seg.start && r.first + r.second > seg.start)
+                    seg.done = qMax(seg.done, qMin(r.first + r.second - seg.start, seg.size));
+            }
+            segments.append(seg);
+        }
+        if (resumed.size())
+            qDebug("resuming download of %s", qPrintable(dstFileName));
+        segHash.reset(new QCryptographicHash(algo));
+        segmented = true;
+        metaReady = true;
+        bytesLeft = size;
+        emit q->metaDataChanged();
+        advanceFrontier(); // whatever is already there
+        scheduleSegments();
+        return true;
+    }
+
+    void scheduleSegments()
+    {
+        if (finished)
+            return;
+        int running = 0;
+        for (const Segment &seg : qAsConst(segments)) {
+            if (seg.downloader)
+                ++running;
+        }
+        for (int i = 0; i < segments.size() && running < MAX_SEGMENT_DOWNLOADS; ++i) {
+            if (segments[i].downloader || segments[i].done == segments[i].size)
+                continue;
+            int src = 0;
+            while (src < segSources.size() && (segSources[src].busy || segSources[src].failed))
+                ++src;
+            if (src == segSources.size())
+                break;
+            startSegment(i, src);
+            ++running;
+        }
+        bool gotData = false, complete = true;
+        for (const Segment &seg : qAsConst(segments)) {
+            gotData  = gotData || seg.done;
+            complete = complete && seg.done == seg.size;
+        }
+        if (running || complete)
+            return;
+
+        // every source has failed
+        if (gotData) {
+            finishWithError(lastError.isEmpty() ? tr("All download sources failed") : lastError);
+            return;
+        }
+        qDebug("segmented download failed, trying sources one by one");
+        saveState();
+        segmented = false;
+        segments.clear();
+        segSources.clear();
+        segHash.reset();
+        tmpFile.reset();
+        dstFileName.clear();
+        metaReady = false;
+        startNextDownloader();
+    }
+
+    void startSegment(int i, int src)
+    {
+        Segment &     seg    = segments[i];
+        const Source &source = segSources[src];
+        seg.source           = src;
+        segSources[src].busy = true;
+        if (FileSharingItem::sourceType(source.uri) == FileSharingItem::SourceType::Jingle) {
+            auto jdl = new JingleFileShareDownloader(acc, source.uri, file, jids, q);
+            jdl->setSourceJid(source.jid);
+            seg.downloader = jdl;
+        } else {
+            seg.downloader = new NAMFileShareDownloader(acc, source.uri, q);
+        }
+        seg.downloader->setRange(seg.start + seg.done, seg.size - seg.done);
+
+        connect(seg.downloader, &AbstractFileShareDownloader::failed, q, [this, i]() { releaseSegment(i, true); });
+        connect(seg.downloader, &AbstractFileShareDownloader::metaDataChanged, q, [this, i]() {
+            const Segment &seg = segments[i];
+            qint64         start, size;
+            std::tie(start, size) = seg.downloader->range();
+            if (start != seg.start + seg.done || size != seg.size - seg.done) {
+                lastError = tr("Download source doesn't support ranges");
+                releaseSegment(i, true);
+            }
+        });
+        connect(seg.downloader, &AbstractFileShareDownloader::readyRead, q, [this, i]() { readSegment(i); });
+        connect(seg.downloader, &AbstractFileShareDownloader::disconnected, q, [this, i]() {
+            readSegment(i);
+            releaseSegment(i, segments[i].done < segments[i].size); // closed too early
+        });
+        seg.downloader->start();
+    }
+
+    void releaseSegment(int i, bool sourceFailed)
+    {
+        Segment &seg = segments[i];
+        if (!seg.downloader)
+            return;
+        if (sourceFailed) {
+            if (!seg.downloader->lastError().isEmpty())
+                lastError = seg.downloader->lastError();
+            seg.downloader->abort(true);
+        } else {
+            seg.downloader->close();
+        }
+        seg.downloader->disconnect(q);
+        seg.downloader->deleteLater();
+        seg.downloader = nullptr;
+
+        segSources[seg.source].busy   = false;
+        segSources[seg.source].failed = segSources[seg.source].failed || sourceFailed;
+        seg.source                    = -1;
+        saveState();
+        scheduleSegments();
+    }
+
+    void readSegment(int i)
+    {
+        Segment &seg = segments[i];
+        if (!seg.downloader)
+            return;
+        qint64 avail = qMin(seg.downloader->bytesAvailable(), seg.size - seg.done);
+        if (avail <= 0)
+            return;
+
+        QByteArray buf(int(avail), Qt::Uninitialized);
+        qint64     bytesRead = seg.downloader->read(buf.data(), avail);
+        if (bytesRead <= 0)
+            return;
+        if (!tmpFile->seek(seg.start + seg.done) || tmpFile->write(buf.constData(), bytesRead) != bytesRead) {
+            finishWithError(tmpFile->errorString());
+            return;
+        }
+        seg.done += bytesRead;
+        advanceFrontier();
+        if (!finished && seg.done == seg.size)
+            releaseSegment(i, false);
+    }
+
+    // moves the frontier over the newly completed data and hashes it in file order
+    void advanceFrontier()
+    {
+        if (finished || hashPending)
+            return;
+        qint64 frontier = segFrontier;
+        for (const Segment &seg : qAsConst(segments)) {
+            if (seg.start + seg.size <= frontier)
+                continue;
+            frontier = seg.start + seg.done;
+            if (seg.done < seg.size)
+                break;
+        }
+        if (frontier == segFrontier)
+            return;
+        if (frontier - segFrontier > FRONTIER_HASH_STEP) {
+            // a resumed file may have gigabytes to hash, don't block the gui with it
+            frontier    = segFrontier + FRONTIER_HASH_STEP;
+            hashPending = true;
+            QTimer::singleShot(0, q, [this]() {
+                hashPending = false;
+                advanceFrontier();
+            });
+        }
+
+        QByteArray buf;
+        tmpFile->seek(segFrontier);
+        while (segFrontier < frontier) {
+            buf = tmpFile->read(qMin(frontier - segFrontier, qint64(64 * 1024)));
+            if (buf.isEmpty()) {
+                finishWithError(tmpFile->errorString());
+                return;
+            }
+            segHash->addData(buf);
+            segFrontier += buf.size();
+        }
+
+        if (segFrontier == qint64(file.size())) {
+            if (segHash->result() != sums[0].data()) {
+                finishWithError(tr("Downloaded file doesn't match its checksum"), true);
+                return;
+            }
+            verified = true;
+            success  = true;
+        }
+        emit q->readyRead();
+        checkSegmentedDone();
+    }
+
+    qint64 readSegmented(char *data, qint64 maxSize)
+    {
+        qint64 toRead = qMin(maxSize, segFrontier - readPos);
+        if (toRead <= 0 || !tmpFile || !tmpFile->seek(readPos))
+            return 0;
+        qint64 bytesRead = tmpFile->read(data, toRead);
+        if (bytesRead > 0) {
+            readPos += bytesRead;
+            bytesLeft = qint64(file.size()) - readPos;
+        }
+        QTimer::singleShot(0, q, [this]() { checkSegmentedDone(); }); // not from inside read()
+        return bytesRead;
+    }
+
+    // everything is downloaded, verified and read
+    void checkSegmentedDone()
+    {
+        if (!verified || readPos != qint64(file.size()) || !tmpFile)
+            return;
+        tmpFile->close();
+        tmpFile.reset();
+        QFile::remove(stateFileName());
+        finished = true;
+        emit q->cacheReady();
+        emit q->disconnected();
+        if (selfDelete)
+            q->deleteLater();
+    }
+
+    void abortSegments()
+    {
+        for (Segment &seg : segments) {
+            if (seg.downloader) {
+                seg.downloader->disconnect(q);
+                seg.downloader->abort();
+                seg.downloader->deleteLater();
+                seg.downloader = nullptr;
+            }
+        }
+    }
+
     void startNextDownloader()
     {
         if (downloader) {
@@ -506,8 +943,9 @@ public:
                 partDir.mkpath(".");
                 dstFileName = partDir.absoluteFilePath(QString::fromLatin1(sums.value(0).data().toHex()));
 
+                QFile::remove(stateFileName()); // nothing to resume with these sources
                 tmpFile.reset(new QFile(dstFileName));
-                if (!tmpFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) { // TODO complete unfinished downloads
+                if (!tmpFile->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
                     downloader->abort();
                     finishWithError(tmpFile->errorString());
                     return;
@@ -533,23 +971,31 @@ FileShareDownloader::FileShareDownloader(PsiAccount *acc, const QList<XMPP::Hash
     QIODevice(parent),
     d(new Private)
 {
-    d->q    = this;
-    d->acc  = acc;
-    d->sums = sums;
-    d->file = file;
-    d->jids = jids;
-    d->uris = FileSharingItem::sortSourcesByPriority(uris);
+    d->q       = this;
+    d->acc     = acc;
+    d->sums    = sums;
+    d->file    = file;
+    d->jids    = jids;
+    d->uris    = FileSharingItem::sortSourcesByPriority(uris);
+    d->allUris = d->uris;
 }
 
 FileShareDownloader::~FileShareDownloader()
 {
     abort();
+    if (!d->finished)
+        d->saveState(); // interrupted, may continue next time
     qDebug("downloader deleted");
 }
 
 bool FileShareDownloader::isSuccess() const { return d->success; }
 
-bool FileShareDownloader::isConnected() const { return d->downloader ? d->downloader->isConnected() : false; }
+bool FileShareDownloader::isConnected() const
+{
+    if (d->segmented)
+        return !(d->finished && !d->success) && d->readPos < qint64(d->file.size());
+    return d->downloader ? d->downloader->isConnected() : false;
+}
 
 bool FileShareDownloader::open(QIODevice::OpenMode mode)
 {
@@ -561,13 +1007,15 @@ bool FileShareDownloader::open(QIODevice::OpenMode mode)
         return true;
 
     QIODevice::open(mode);
-    d->startNextDownloader();
+    if (!d->startSegmented())
+        d->startNextDownloader();
 
     return true;
 }
 
 void FileShareDownloader::abort()
 {
+    d->abortSegments();
     if (d->downloader) {
         d->downloader->abort();
     }
@@ -600,6 +1048,9 @@ const Jingle::FileTransfer::File &FileShareDownloader::jingleFile() const { retu
 
 qint64 FileShareDownloader::readData(char *data, qint64 maxSize)
 {
+    if (d->segmented)
+        return d->readSegmented(data, maxSize);
+
     if (!maxSize || !d->downloader) // wtf?
         return 0;
 
@@ -627,7 +1078,12 @@ qint64 FileShareDownloader::writeData(const char *, qint64)
 
 bool FileShareDownloader::isSequential() const { return true; }
 
-qint64 FileShareDownloader::bytesAvailable() const { return d->downloader ? d->downloader->bytesAvailable() : 0; }
+qint64 FileShareDownloader::bytesAvailable() const
+{
+    if (d->segmented)
+        return d->segFrontier - d->readPos;
+    return d->downloader ? d->downloader->bytesAvailable() : 0;
+}
 
 void FileShareDownloader::setSelfDelete(bool enable) { d->selfDelete = enable; }
 
@@ -18,7 +18,7 @@
  */
 
 #include "filesharinghttpproxy.h"
-#include "filecache.h"
+#include "filesharingdownloader.h"
 #include "filesharingitem.h"
 #include "filesharingmanager.h"
 #include "psiaccount.h"
@@ -28,65 +28,184 @@
 #include "qhttpserverresponse.hpp"
 #include "webserver.h"
 
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QPointer>
 #include <QTcpSocket>
 #include <cinttypes>
 #include <tuple>
 
-#define HTTP_CHUNK (512 * 1024 * 1024)
+// data is sent in pieces of this size, the next one when the socket has written the previous
+#define HTTP_CHUNK (1024 * 1024)
 
-FileSharingHttpProxy::FileSharingHttpProxy(PsiAccount *acc, const QString &sourceIdHex,
-                                           qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) :
-    QObject(res),
-    item(acc->psi()->fileSharingManager()->item(XMPP::Hash::from(QStringRef(&sourceIdHex)))), acc(acc), request(req),
-    response(res)
+// rfc7231 IMF-fixdate
+static QByteArray httpDate(const QDateTime &dt)
 {
-    auto baseUrl = acc->psi()->webServer()->serverUrl().toString();
-    qDebug("FSP %s %s%s range: %s", qPrintable(req->methodString()), qPrintable(baseUrl),
-           qPrintable(req->url().toString()), qPrintable(req->headers().value("range")));
+    return QLocale::c().toString(dt.toUTC(), QLatin1String("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1();
+}
 
-    if (!item) {
-        res->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
-        emit req->end();
-        return;
+//----------------------------------------------------------------------------
+// FileSharingHttpRelay
+//----------------------------------------------------------------------------
+
+// The gui thread side of a proxied request. Deleted when its proxy is gone.
+class FileSharingHttpRelay : public QObject {
+    Q_OBJECT
+public:
+    FileSharingHttpRelay(PsiCon *psi) : psi(psi) { }
+
+public slots:
+    void lookup(const QString &path)
+    {
+        PsiAccount *acc;
+        QString     sourceIdHex;
+        std::tie(acc, sourceIdHex) = psi->uriToShareSource(path);
+        if (acc)
+            item = acc->psi()->fileSharingManager()->item(XMPP::Hash::from(QStringRef(&sourceIdHex)));
+        if (!item) {
+            emit itemNotFound();
+            return;
+        }
+        emit itemFound(sourceIdHex, item->fileName(), item->mimeType(),
+                       item->isSizeKnown() ? qint64(item->fileSize()) : -1, item->isCached());
+    }
+
+    void download(bool isRanged, qint64 start, qint64 size)
+    {
+        if (!item) {
+            emit failed();
+            return;
+        }
+        downloader = item->download(isRanged, start, quint64(size));
+        Q_ASSERT(downloader);
+        downloader->setParent(this);
+
+        connect(downloader, &FileShareDownloader::metaDataChanged, this, [this]() {
+            qint64  start;
+            quint64 size;
+            std::tie(start, size) = downloader->range();
+            auto const &file      = downloader->jingleFile();
+            emit metaDataChanged(start, qint64(size), downloader->isRanged(), file.hasSize() ? qint64(file.size()) : -1,
+                                 file.mediaType(), file.date());
+        });
+        connect(downloader, &FileShareDownloader::failed, this, &FileSharingHttpRelay::failed);
+        connect(downloader, &FileShareDownloader::readyRead, this, &FileSharingHttpRelay::pump);
+        connect(downloader, &FileShareDownloader::disconnected, this, &FileSharingHttpRelay::pump);
+        downloader->open();
+    }
+
+    // the proxy asks for the next piece when its socket is done with the previous one
+    void request(qint64 size)
+    {
+        wanted = size;
+        pump();
+    }
+
+signals:
+    void itemFound(const QString &sourceIdHex, const QString &fileName, const QString &mimeType, qint64 fileSize,
+                   bool cached);
+    void itemNotFound();
+    void metaDataChanged(qint64 start, qint64 size, bool isRanged, qint64 fileSize, const QString &mediaType,
+                         const QDateTime &date);
+    void failed();
+    void data(const QByteArray &data, bool last);
+
+private:
+    void pump()
+    {
+        if (!downloader || !wanted)
+            return;
+        qint64 bytesAvail = downloader->bytesAvailable();
+        if (downloader->isConnected()) {
+            if (!bytesAvail) {
+                qDebug("FSP we have to wait for readyRead or disconnected");
+                return;
+            }
+            wanted = 0;
+            emit data(downloader->read(qMin(bytesAvail, qint64(HTTP_CHUNK))), false);
+            return;
+        }
+        // so we are not connected
+        wanted = 0;
+        emit data(bytesAvail ? downloader->read(bytesAvail) : QByteArray(), true);
+        downloader->disconnect(this);
     }
 
+    PsiCon *                      psi;
+    QPointer<FileSharingItem>     item;
+    QPointer<FileShareDownloader> downloader;
+    qint64                        wanted = 0;
+};
+
+//----------------------------------------------------------------------------
+// FileSharingHttpProxy
+//----------------------------------------------------------------------------
+
+FileSharingHttpProxy::FileSharingHttpProxy(PsiCon *psi, qhttp::server::QHttpRequest *req,
+                                           qhttp::server::QHttpResponse *res) :
+    QObject(res),
+    relay(new FileSharingHttpRelay(psi)), request(req), response(res)
+{
+    qDebug("FSP %s %s%s range: %s", qPrintable(req->methodString()),
+           qPrintable(psi->shareServer()->serverUrl().toString()), qPrintable(req->url().toString()),
+           qPrintable(req->headers().value("range")));
+
+    relay->moveToThread(psi->thread());
+    connect(this, &QObject::destroyed, relay, &QObject::deleteLater);
+    connect(relay, &FileSharingHttpRelay::itemFound, this, &FileSharingHttpProxy::onItemFound);
+    connect(relay, &FileSharingHttpRelay::itemNotFound, this, &FileSharingHttpProxy::onItemNotFound);
+    connect(relay, &FileSharingHttpRelay::metaDataChanged, this, &FileSharingHttpProxy::onMetadataChanged);
+    connect(relay, &FileSharingHttpRelay::failed, this, &FileSharingHttpProxy::onDownloadFailed);
+    connect(relay, &FileSharingHttpRelay::data, this, &FileSharingHttpProxy::onData);
+    QMetaObject::invokeMethod(relay, "lookup", Qt::QueuedConnection, Q_ARG(QString, req->url().path()));
+}
+
+FileSharingHttpProxy::~FileSharingHttpProxy() { qDebug("FSP deleted"); }
+
+void FileSharingHttpProxy::onItemNotFound()
+{
+    response->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
+    response->end();
+}
+
+void FileSharingHttpProxy::onItemFound(const QString &sourceIdHex, const QString &fileName, const QString &mimeType,
+                                       qint64 fileSize, bool cached)
+{
+    itemSize = fileSize;
+    etag     = '"' + sourceIdHex.toLatin1() + '"';
+
     auto status = qhttp::TStatusCode(parseHttpRangeRequest());
     if (status != qhttp::ESTATUS_OK) {
-        res->setStatusCode(status);
+        response->setStatusCode(status);
         qWarning("http range parse failed: %d", status);
-        emit req->end();
+        response->end();
         return; // handled with error
     }
 
-    if (isRanged && item->isSizeKnown()) {
-        if (requestedStart == 0 && requestedSize == item->fileSize())
+    if (isRanged && itemSize != -1) {
+        if (requestedStart == 0 && requestedSize == itemSize)
             isRanged = false;
-        else if (quint64(requestedStart) + requestedSize > item->fileSize())
-            requestedSize = item->fileSize() - requestedStart; // don't request more than declared in share
+        else if (requestedStart + requestedSize > itemSize)
+            requestedSize = itemSize - requestedStart; // don't request more than declared in share
     }
 
-    auto cache = item->cache();
-    if (cache) {
-        proxyCache();
+    if (cached) {
+        proxyCache(fileName, mimeType);
         return; // handled with success
     }
 
-    downloader = item->download(isRanged, requestedStart, requestedSize);
-    Q_ASSERT(downloader);
-    downloader->setParent(this);
-
-    connect(downloader, &FileShareDownloader::metaDataChanged, this, &FileSharingHttpProxy::onMetadataChanged);
-    connect(downloader, &FileShareDownloader::failed, this, [this]() {
-        if (!headersSent) {
-            response->setStatusCode(qhttp::ESTATUS_BAD_GATEWAY); // something finnished with errors quite early
-            response->end();
-        }
-    });
-
-    downloader->open();
+    QMetaObject::invokeMethod(relay, "download", Qt::QueuedConnection, Q_ARG(bool, isRanged),
+                              Q_ARG(qint64, requestedStart), Q_ARG(qint64, requestedSize));
 }
 
-FileSharingHttpProxy::~FileSharingHttpProxy() { qDebug("FSP deleted"); }
+void FileSharingHttpProxy::onDownloadFailed()
+{
+    if (!headersSent) {
+        response->setStatusCode(qhttp::ESTATUS_BAD_GATEWAY); // something finnished with errors quite early
+        response->end();
+    }
+}
 
 // returns <parsed,list of start/size>
 int FileSharingHttpProxy::parseHttpRangeRequest()
@@ -95,7 +214,7 @@ int FileSharingHttpProxy::parseHttpRangeRequest()
     if (!rangesBa.size())
         return qhttp::ESTATUS_OK;
 
-    if ((item->isSizeKnown() && !item->fileSize()) || !rangesBa.startsWith("bytes=")) {
+    if ((itemSize == 0) || !rangesBa.startsWith("bytes=")) {
         return qhttp::ESTATUS_REQUESTED_RANGE_NOT_SATISFIABLE;
     }
 
@@ -128,21 +247,21 @@ int FileSharingHttpProxy::parseHttpRangeRequest()
             return qhttp::ESTATUS_BAD_REQUEST;
         }
 
-        if (!item->isSizeKnown() || start < item->fileSize()) {
+        if (itemSize == -1 || start < quint64(itemSize)) {
             isRanged       = true;
             requestedStart = start;
             requestedSize  = end - start + 1;
         }
     } else { // no end. all the remaining
-        if (!item->isSizeKnown() || start < item->fileSize()) {
+        if (itemSize == -1 || start < quint64(itemSize)) {
             isRanged       = true;
             requestedStart = start;
             requestedSize  = 0;
         }
     }
 
-    if (item->isSizeKnown() && !isRanged) { // isRanged is not set. So it doesn't fit
-        response->addHeader("Content-Range", QByteArray("bytes */") + QByteArray::number(item->fileSize()));
+    if (itemSize != -1 && !isRanged) { // isRanged is not set. So it doesn't fit
+        response->addHeader("Content-Range", QByteArray("bytes */") + QByteArray::number(itemSize));
         return qhttp::ESTATUS_REQUESTED_RANGE_NOT_SATISFIABLE;
     }
 
@@ -153,7 +272,7 @@ void FileSharingHttpProxy::setupHeaders(qint64 fileSize, QString contentType, QD
                                         qint64 rangeStart, qint64 rangeSize)
 {
     if (lastModified.isValid())
-        response->addHeader("Last-Modified", lastModified.toString(Qt::RFC2822Date).toLatin1());
+        response->addHeader("Last-Modified", httpDate(lastModified));
     if (contentType.count())
         response->addHeader("Content-Type", contentType.toLatin1());
 
@@ -179,132 +298,167 @@ void FileSharingHttpProxy::setupHeaders(qint64 fileSize, QString contentType, QD
     }
 }
 
-void FileSharingHttpProxy::proxyCache()
+void FileSharingHttpProxy::proxyCache(const QString &fileName, const QString &mimeType)
 {
-    auto status = qhttp::TStatusCode(parseHttpRangeRequest());
-    if (status != qhttp::ESTATUS_OK) {
-        response->setStatusCode(status);
-        qWarning("http range parse failed: %d", status);
-        emit request->end();
-        return; // handled with error
-    }
-    QFile *   file = new QFile(item->fileName(), response);
-    QFileInfo fi(*file);
-    if (!file->open(QIODevice::ReadOnly)) {
+    cacheFile = new QFile(fileName, response);
+    QFileInfo fi(*cacheFile);
+    if (!cacheFile->open(QIODevice::ReadOnly)) {
         response->setStatusCode(qhttp::ESTATUS_NOT_FOUND);
-        qWarning("FSP failed to open cached file: %s", qPrintable(file->errorString()));
-        emit request->end();
+        qWarning("FSP failed to open cached file: %s", qPrintable(cacheFile->errorString()));
+        response->end();
         return; // handled with error
     }
+    if (isNotModified(fi.lastModified())) {
+        response->setStatusCode(qhttp::ESTATUS_NOT_MODIFIED);
+        response->addHeader("ETag", etag);
+        response->addHeader("Last-Modified", httpDate(fi.lastModified()));
+        response->end();
+        return;
+    }
     qint64 size = fi.size();
     if (isRanged) {
         if (requestedSize)
             size = (requestedStart + requestedSize) > fi.size() ? fi.size() - requestedStart : requestedSize;
         else // remaining part
             size = fi.size() - requestedStart;
-        file->seek(requestedStart);
     }
-    // TODO If-Modified-Since
-    setupHeaders(fi.size(), item->mimeType(), fi.lastModified(), isRanged, requestedStart, size);
-    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, file, [this, file, size]() {
-        qint64 toWrite = requestedStart + size - file->pos();
-        if (!toWrite) {
+    setupHeaders(fi.size(), mimeType, fi.lastModified(), isRanged, requestedStart, size);
+    response->addHeader("ETag", etag);
+
+    // the socket takes the data straight from the page cache. read() is left for files which can't be mapped
+    qint64 start = isRanged ? requestedStart : 0;
+    if (size)
+        cacheMap = reinterpret_cast<const char *>(cacheFile->map(start, size));
+    if (!cacheMap)
+        cacheFile->seek(start);
+    cacheLeft = size;
+
+    if (!cacheLeft) {
+        response->end();
+        return;
+    }
+    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, this, &FileSharingHttpProxy::sendCache);
+    sendCache();
+}
+
+void FileSharingHttpProxy::sendCache()
+{
+    // keep about one chunk queued in the socket and not the whole file
+    while (cacheLeft && response->connection()->tcpSocket()->bytesToWrite() < HTTP_CHUNK) {
+        int        chunk = int(qMin<qint64>(cacheLeft, HTTP_CHUNK));
+        QByteArray data  = cacheMap ? QByteArray::fromRawData(cacheMap, chunk) : cacheFile->read(chunk);
+        if (data.size() != chunk) {
+            qWarning("FSP failed to read cached file: %s", qPrintable(cacheFile->errorString()));
+            cacheLeft = 0;
+            response->end();
             return;
         }
-        if (toWrite > HTTP_CHUNK)
-            response->write(file->read(HTTP_CHUNK));
+        if (cacheMap)
+            cacheMap += chunk;
+        cacheLeft -= chunk;
+        if (cacheLeft)
+            response->write(data);
         else
-            response->end(file->read(toWrite));
-    });
-
-    if (size < HTTP_CHUNK) {
-        response->end(file->read(size));
+            response->end(data);
     }
 }
 
-void FileSharingHttpProxy::onMetadataChanged()
+// rfc7232: If-None-Match takes precedence over If-Modified-Since
+bool FileSharingHttpProxy::isNotModified(const QDateTime &lastModified) const
 {
-    qint64  start;
-    quint64 size;
-    std::tie(start, size) = downloader->range();
-    auto const file       = downloader->jingleFile();
+    QByteArray noneMatch = request->headers().value("if-none-match");
+    if (!noneMatch.isEmpty()) {
+        const auto tags = noneMatch.split(',');
+        for (QByteArray tag : tags) {
+            tag = tag.trimmed();
+            if (tag.startsWith("W/"))
+                tag = tag.mid(2); // weak comparison is fine for GET
+            if (tag == etag || tag == "*")
+                return true;
+        }
+        return false;
+    }
+
+    QByteArray modifiedSince = request->headers().value("if-modified-since");
+    if (modifiedSince.isEmpty() || !lastModified.isValid())
+        return false;
+    QDateTime since = QDateTime::fromString(QString::fromLatin1(modifiedSince), Qt::RFC2822Date);
+    return since.isValid() && lastModified.toSecsSinceEpoch() <= since.toSecsSinceEpoch();
+}
 
-    if (downloader->isRanged())
+void FileSharingHttpProxy::onMetadataChanged(qint64 start, qint64 size, bool isRanged, qint64 fileSize,
+                                             const QString &mediaType, const QDateTime &date)
+{
+    if (isRanged)
         qDebug("FSP metaDataChanged: rangeStart=%lld rangeSize=%lld", start, size);
-    else if (downloader->jingleFile().hasSize())
-        qDebug("FSP metaDataChanged: size=%" PRIu64, downloader->jingleFile().size());
+    else if (fileSize != -1)
+        qDebug("FSP metaDataChanged: size=%lld", fileSize);
     else
         qDebug("FSP metaDataChanged: unknown size or range");
 
     // check range satisfaction
-    if (isRanged && downloader->isRanged() && !file.hasSize() && !size) { // size unknown for ranged response.
+    if (this->isRanged && isRanged && fileSize == -1 && !size) { // size unknown for ranged response.
         qWarning("Unknown size for ranged response");
-        downloader->disconnect(this);
-        downloader->deleteLater();
+        relay->disconnect(this);
         response->setStatusCode(qhttp::ESTATUS_BAD_GATEWAY);
         response->end();
         return;
     }
 
-    if (isRanged && !downloader->isRanged()) {
+    if (this->isRanged && !isRanged) {
         qWarning("FSP: remote doesn't support ranged. transfer everything");
-        isRanged = false;
-        start    = 0;
-        size     = file.size();
+        this->isRanged = false;
+        start          = 0;
+        size           = fileSize;
     }
 
-    if (isRanged && !size) {
-        size = file.size() - start;
+    if (this->isRanged && !size) {
+        size = fileSize - start;
     }
-    bytesLeft = isRanged ? size : (file.hasSize() ? file.size() : -1);
+    bytesLeft = this->isRanged ? size : fileSize;
 
-    setupHeaders(file.hasSize() ? qint64(file.size()) : -1, file.mediaType(), file.date(), downloader->isRanged(),
-                 start, size);
+    setupHeaders(fileSize, mediaType, date, isRanged, start, size);
     headersSent = true;
+    if (!bytesLeft) {
+        response->end();
+        return;
+    }
 
-    connect(downloader, &FileShareDownloader::readyRead, this, &FileSharingHttpProxy::transfer);
-    connect(downloader, &FileShareDownloader::disconnected, this, &FileSharingHttpProxy::transfer);
-    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, this, &FileSharingHttpProxy::transfer);
+    connect(response, &qhttp::server::QHttpResponse::allBytesWritten, this, &FileSharingHttpProxy::requestData);
+    requestData();
 }
 
-void FileSharingHttpProxy::transfer()
+void FileSharingHttpProxy::requestData()
 {
-    qint64 bytesAvail  = downloader ? downloader->bytesAvailable() : 0;
-    bool   isConnected = downloader ? downloader->isConnected() : false;
-    if (response->connection()->tcpSocket()->bytesToWrite() >= HTTP_CHUNK) {
-        qDebug("FSP available=%lld wait till previous chunk is wrtten", bytesAvail);
+    if (dataRequested || !bytesLeft || response->connection()->tcpSocket()->bytesToWrite() >= HTTP_CHUNK)
         return;
-    }
+    dataRequested = true;
+    QMetaObject::invokeMethod(relay, "request", Qt::QueuedConnection, Q_ARG(qint64, HTTP_CHUNK));
+}
 
-    if (isConnected) {
-        if (bytesAvail) {
-            qint64 toTransfer = bytesAvail > HTTP_CHUNK ? HTTP_CHUNK : bytesAvail;
-            auto   data       = downloader->read(toTransfer);
-            if (bytesLeft != -1) {
-                if (data.size() < bytesLeft)
-                    response->write(data);
-                else {
-                    // if (data.size() > bytesLeft)
-                    //    data.resize(bytesLeft);
-                    response->end(data);
-                }
-                bytesLeft -= data.size();
-            } else {
-                response->write(data);
-            }
-            qDebug("FSP transferred %d bytes of %lld bytes", data.size(), toTransfer);
-        } else {
-            qDebug("FSP we have to wait for readyRead or disconnected");
-        }
+void FileSharingHttpProxy::onData(const QByteArray &data, bool last)
+{
+    dataRequested = false;
+    if (last) {
+        response->end(data);
+        qDebug("FSP transferred final %d bytes", data.size());
         return;
     }
-
-    // so we are not connected
-    if (bytesAvail) {
-        response->end(downloader->read(bytesAvail));
-        qDebug("FSP transferred final %lld bytes", bytesAvail);
+    if (bytesLeft != -1) {
+        if (data.size() < bytesLeft)
+            response->write(data);
+        else {
+            // if (data.size() > bytesLeft)
+            //    data.resize(bytesLeft);
+            response->end(data);
+            relay->disconnect(this);
+        }
+        bytesLeft = qMax(qint64(0), bytesLeft - data.size());
     } else {
-        response->end();
-        qDebug("FSP ended with no additional data");
+        response->write(data);
     }
+    qDebug("FSP transferred %d bytes", data.size());
+    requestData(); // if the socket took it at once
 }
+
+#include "filesharinghttpproxy.moc"
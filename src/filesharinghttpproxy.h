@@ -20,50 +20,61 @@
 #ifndef FILESHARINGHTTPPROXY_H
 #define FILESHARINGHTTPPROXY_H
 
+#include <QByteArray>
+#include <QDateTime>
 #include <QObject>
-#include <QPointer>
 
-class FileCacheItem;
-class FileSharingItem;
-class FileShareDownloader;
-class PsiAccount;
+class FileSharingHttpRelay;
+class PsiCon;
+class QFile;
 
 namespace qhttp { namespace server {
     class QHttpRequest;
     class QHttpResponse;
 }}
 
+// Lives in the share server thread. Everything about the share itself (account, item, jingle downloader)
+// stays in the gui thread and is reached through FileSharingHttpRelay with queued calls.
 class FileSharingHttpProxy : public QObject {
     Q_OBJECT
 public:
-    explicit FileSharingHttpProxy(PsiAccount *acc, const QString &sourceIdHex, qhttp::server::QHttpRequest *request,
+    explicit FileSharingHttpProxy(PsiCon *psi, qhttp::server::QHttpRequest *request,
                                   qhttp::server::QHttpResponse *response);
     ~FileSharingHttpProxy();
 
-signals:
-
-public slots:
 private slots:
-    void onMetadataChanged();
-    void transfer();
+    void onItemFound(const QString &sourceIdHex, const QString &fileName, const QString &mimeType, qint64 fileSize,
+                     bool cached);
+    void onItemNotFound();
+    void onMetadataChanged(qint64 start, qint64 size, bool isRanged, qint64 fileSize, const QString &mediaType,
+                           const QDateTime &date);
+    void onDownloadFailed();
+    void onData(const QByteArray &data, bool last);
+    void requestData();
+    void sendCache();
 
 private:
     int  parseHttpRangeRequest();
     void setupHeaders(qint64 fileSize, QString contentType, QDateTime lastModified, bool isRanged, qint64 rangeStart,
                       qint64 rangeSize);
-    void proxyCache();
+    void proxyCache(const QString &fileName, const QString &mimeType);
+    bool isNotModified(const QDateTime &lastModified) const;
 
 private:
-    FileSharingItem *             item = nullptr;
-    PsiAccount *                  acc;
+    FileSharingHttpRelay *        relay;
     qhttp::server::QHttpRequest * request;
     qhttp::server::QHttpResponse *response;
-    QPointer<FileShareDownloader> downloader;
+    qint64                        itemSize       = -1; // -1 - unknown
     qint64                        requestedStart = 0;
     qint64                        requestedSize  = 0;  // if == 0 then all the remaining
     qint64                        bytesLeft      = -1; // -1 - unknown
     bool                          isRanged       = false;
     bool                          headersSent    = false;
+    bool                          dataRequested  = false;   // waiting for the relay to send the next piece
+    QFile *                       cacheFile      = nullptr; // local copy when it's cached
+    const char *                  cacheMap       = nullptr; // mapped requested range of cacheFile
+    qint64                        cacheLeft      = 0;
+    QByteArray                    etag; // the share is addressed by its hash, so is the etag
 };
 
 #endif // FILESHARINGHTTPPROXY_H
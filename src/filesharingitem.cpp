@@ -19,10 +19,14 @@
 
 #include "filesharingitem.h"
 #include "filecache.h"
+#include "filehasher.h"
 #include "filesharingmanager.h"
 #include "fileutil.h"
 #include "httpfileupload.h"
+#include "imagepreviewcache.h"
 #include "psiaccount.h"
+#include "psicon.h"
+#include "transferscheduler.h"
 #include "userlist.h"
 #include "xmpp_client.h"
 #include "xmpp_reference.h"
@@ -35,6 +39,7 @@
 #include <QImageReader>
 #include <QMimeDatabase>
 #include <QPainter>
+#include <QPointer>
 #include <QTemporaryFile>
 
 #define TEMP_TTL (7 * 24 * 3600)
@@ -45,6 +50,28 @@ using namespace XMPP;
 // ======================================================================
 // FileSharingItem
 // ======================================================================
+// writes to the target device and hashes the data on the way
+class HashingWriter : public QIODevice {
+public:
+    HashingWriter(QIODevice *target) : target(target), hash(QCryptographicHash::Sha1) { open(QIODevice::WriteOnly); }
+
+    inline QByteArray result() const { return hash.result(); }
+
+protected:
+    qint64 readData(char *, qint64) override { return -1; }
+    qint64 writeData(const char *data, qint64 size) override
+    {
+        qint64 written = target->write(data, size);
+        if (written > 0)
+            hash.addData(data, int(written));
+        return written;
+    }
+
+private:
+    QIODevice *        target;
+    QCryptographicHash hash;
+};
+
 FileSharingItem::FileSharingItem(FileCacheItem *cache, PsiAccount *acc, FileSharingManager *manager) :
     QObject(manager), _acc(acc), _manager(manager)
 {
@@ -89,42 +116,70 @@ FileSharingItem::FileSharingItem(const MediaSharing &ms, const Jid &from, PsiAcc
 FileSharingItem::FileSharingItem(const QImage &image, PsiAccount *acc, FileSharingManager *manager) :
     QObject(manager), _acc(acc), _manager(manager), _fileType(FileType::TempFile), _flags(SizeKnown)
 {
-    QByteArray ba;
-    QBuffer    buffer(&ba);
-    buffer.open(QIODevice::WriteOnly);
-    image.save(&buffer, "PNG", 0);
-    _sums.append(Hash::from(Hash::Sha1, ba));
+    // encoded and hashed in one pass right into the file, the png is never kept in memory
+    QTemporaryFile file(QDir::tempPath() + QString::fromLatin1("/psishare-XXXXXX.png"));
+    if (!file.open())
+        return;
+    HashingWriter writer(&file);
+    if (!image.save(&writer, "PNG", 0))
+        return;
+    _sums.append(Hash(Hash::Sha1, writer.result()));
 
     if (!initFromCache()) {
         _mimeType = QString::fromLatin1("image/png");
-        _fileSize = quint64(ba.size());
-        QTemporaryFile file(QDir::tempPath() + QString::fromLatin1("/psishare-XXXXXX.png"));
-        file.open();
-        file.write(ba);
+        _fileSize = quint64(file.size());
         file.setAutoRemove(false);
         _fileName = file.fileName();
-        file.close();
     }
+    file.close(); // and removed if it was cached already
 }
 
 FileSharingItem::FileSharingItem(const QString &fileName, PsiAccount *acc, FileSharingManager *manager) :
     QObject(manager), _acc(acc), _manager(manager), _fileType(FileType::LocalLink), _flags(SizeKnown),
     _fileName(fileName)
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly))
+    QFileInfo fi(fileName);
+    if (!fi.isReadable())
         return;
 
-    auto h = Hash::from(Hash::Sha1, &file);
-    if (!h.isValid())
+    _sums = FileHasher::instance()->cached(fi);
+    if (_sums.size()) {
+        initLocalFile();
         return;
+    }
 
-    _sums.append(h);
+    // big files take a while, so hash them in background
+    _flags |= Hashing;
+    _fileSize = quint64(fi.size());
 
+    auto hasher = FileHasher::instance();
+    connect(hasher, &FileHasher::progress, this, [this](const QString &fileName, qint64 done, qint64 total) {
+        if (fileName == QFileInfo(_fileName).absoluteFilePath())
+            emit hashProgress(done, total);
+    });
+    connect(hasher, &FileHasher::finished, this, [this](const QString &fileName, bool success) {
+        QFileInfo fi(_fileName);
+        if (fileName != fi.absoluteFilePath())
+            return;
+        FileHasher::instance()->disconnect(this);
+        _flags &= ~Hashing;
+        if (success) {
+            _sums = FileHasher::instance()->cached(fi);
+            if (_sums.size())
+                initLocalFile();
+        }
+        emit hashFinished();
+    });
+    hasher->hash(fi);
+}
+
+void FileSharingItem::initLocalFile()
+{
     if (!initFromCache()) {
-        file.seek(0);
-        _fileSize = quint64(file.size());
-        _mimeType = QMimeDatabase().mimeTypeForFileNameAndData(fileName, &file).name();
+        QFile file(_fileName);
+        _fileSize = quint64(QFileInfo(_fileName).size());
+        if (file.open(QIODevice::ReadOnly))
+            _mimeType = QMimeDatabase().mimeTypeForFileNameAndData(_fileName, &file).name();
     }
 }
 
@@ -260,9 +315,9 @@ QIcon FileSharingItem::thumbnail(const QSize &size) const
     if (_fileType == FileType::RemoteFile)
         return QIcon();
 
-    QImage image;
-    if (_mimeType.startsWith(QLatin1String("image")) && image.load(_fileName)) {
-        auto   img = image.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    QImage img;
+    if (_mimeType.startsWith(QLatin1String("image"))
+        && !(img = ImagePreviewCache::instance()->preview(previewKey(), _fileName, size)).isNull()) {
         QImage back(64, 64, QImage::Format_ARGB32_Premultiplied);
         back.fill(Qt::transparent);
         QPainter painter(&back);
@@ -276,14 +331,12 @@ QIcon FileSharingItem::thumbnail(const QSize &size) const
 
 QImage FileSharingItem::preview(const QSize &maxSize) const
 {
-    QImage image;
-    if (image.load(_fileName)) {
-        auto s = image.size().boundedTo(maxSize);
-        return image.scaled(s, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    }
-    return image;
+    return ImagePreviewCache::instance()->preview(previewKey(), _fileName, maxSize);
 }
 
+// the same content shared several times gets one preview
+QByteArray FileSharingItem::previewKey() const { return _sums.isEmpty() ? _fileName.toUtf8() : _sums[0].toHex(); }
+
 QString FileSharingItem::displayName() const
 {
     if (_fileName.isEmpty()) {
@@ -345,23 +398,44 @@ void FileSharingItem::publish(const XMPP::Jid &myJid)
             _flags |= HttpFinished;
             checkFinished();
         } else {
-            auto hfu = hm->upload(_fileName, displayName(), _mimeType);
-            hfu->setParent(this);
-            connect(hfu, &HttpFileUpload::progress, this, [this](qint64 bytesReceived, qint64 bytesTotal) {
-                Q_UNUSED(bytesTotal)
-                emit publishProgress(size_t(bytesReceived));
-            });
-            connect(hfu, &HttpFileUpload::finished, this, [hfu, this, checkFinished]() {
-                _flags |= HttpFinished;
-                if (hfu->success()) {
-                    _log.append(tr("Published on HttpUpload service"));
-                    _uris.append(hfu->getHttpSlot().get.url);
-                } else {
-                    _log.append(
-                        QString("%1: %2").arg(tr("Failed to publish on HttpUpload service"), hfu->statusString()));
+            // uploads wait for a free slot and share the upload rate with other transfers
+            auto                      scheduler = _acc->psi()->transferScheduler();
+            QPointer<FileSharingItem> self(this);
+            scheduler->schedule(_acc, TransferScheduler::Normal, [self, hm, scheduler, checkFinished]() -> QObject * {
+                if (!self)
+                    return nullptr;
+                auto f = new QFile(self->_fileName);
+                if (!f->open(QIODevice::ReadOnly)) {
+                    self->_flags |= HttpFinished;
+                    self->_log.append(QString("%1: %2").arg(tr("Failed to publish on HttpUpload service"),
+                                                            f->errorString()));
+                    delete f;
+                    emit self->logChanged();
+                    checkFinished();
+                    return nullptr;
                 }
-                emit logChanged();
-                checkFinished();
+                auto dev = scheduler->throttle(f, self->_acc, TransferScheduler::Normal);
+                auto hfu = hm->upload(dev, size_t(f->size()), self->displayName(), self->_mimeType);
+                hfu->setParent(self);
+                dev->setParent(hfu);
+                connect(hfu, &HttpFileUpload::progress, self, [self](qint64 bytesReceived, qint64 bytesTotal) {
+                    Q_UNUSED(bytesTotal)
+                    emit self->publishProgress(size_t(bytesReceived));
+                });
+                connect(hfu, &HttpFileUpload::finished, self, [hfu, self, scheduler, checkFinished]() {
+                    scheduler->release(hfu);
+                    self->_flags |= HttpFinished;
+                    if (hfu->success()) {
+                        self->_log.append(tr("Published on HttpUpload service"));
+                        self->_uris.append(hfu->getHttpSlot().get.url);
+                    } else {
+                        self->_log.append(QString("%1: %2").arg(tr("Failed to publish on HttpUpload service"),
+                                                                hfu->statusString()));
+                    }
+                    emit self->logChanged();
+                    checkFinished();
+                });
+                return hfu;
             });
         }
     }
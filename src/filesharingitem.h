@@ -60,6 +60,7 @@ public:
         JingleFinished  = 0x2,
         PublishNotified = 0x4,
         SizeKnown       = 0x8,
+        Hashing         = 0x10, // sums are not ready yet
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
@@ -75,6 +76,7 @@ public:
 
     QIcon                     thumbnail(const QSize &size) const;
     QImage                    preview(const QSize &maxSize) const;
+    QByteArray                previewKey() const;
     QString                   displayName() const;
     QString                   fileName() const;
     inline const QString &    mimeType() const { return _mimeType; }
@@ -82,6 +84,7 @@ public:
     inline QVariantMap        metaData() const { return _metaData; }
     inline quint64            fileSize() const { return _fileSize; }
     inline bool               isSizeKnown() const { return bool(_flags & SizeKnown); }
+    inline bool               isHashing() const { return bool(_flags & Hashing); }
     inline const QStringList &uris() const { return _uris; }
 
     // reborn flag updates ttl for the item
@@ -113,8 +116,11 @@ public:
 
 private:
     bool initFromCache(FileCacheItem *cache = nullptr);
+    void initLocalFile();
 
 signals:
+    void hashProgress(qint64 done, qint64 total);
+    void hashFinished(); // sums are empty if the file couldn't be read
     void publishFinished();
     void publishProgress(size_t transferredBytes);
     void downloadFinished();
@@ -38,8 +38,6 @@
 #include "xmpp_reference.h"
 #include "xmpp_vcard.h"
 #ifdef HAVE_WEBSERVER
-#include "filesharinghttpproxy.h"
-#include "qhttpserverconnection.hpp"
 #include "webserver.h"
 #endif
 #include "messageview.h"
@@ -62,6 +60,19 @@ public:
         for (auto const &v : item->sums())
             items.insert(v, item); // TODO ensure we don't overwrite
     }
+
+    // files are hashed in background, they are known by their sums only after that
+    void rememberWhenHashed(FileSharingItem *item)
+    {
+        if (!item->isHashing()) {
+            rememberItem(item);
+            return;
+        }
+        QObject::connect(item, &FileSharingItem::hashFinished, item, [this, item]() {
+            if (item->sums().size())
+                rememberItem(item);
+        });
+    }
 };
 
 FileSharingManager::FileSharingManager(QObject *parent) : QObject(parent), d(new Private)
@@ -172,6 +183,10 @@ QList<FileSharingItem *> FileSharingManager::fromMimeData(const QMimeData *data,
             qDebug() << img;
             item = new FileSharingItem(img, acc, this);
         }
+        if (item && item->sums().isEmpty()) { // failed to write the temporary file
+            delete item;
+            item = nullptr;
+        }
         if (item) {
             d->rememberItem(item);
             ret.append(item);
@@ -179,9 +194,9 @@ QList<FileSharingItem *> FileSharingManager::fromMimeData(const QMimeData *data,
     } else {
         for (auto const &f : files) {
             auto item = new FileSharingItem(f, acc, this);
-            if (!item->sums().count())
+            if (!item->isHashing() && !item->sums().count())
                 continue; // failed to calculate checksum. permissions problem?
-            d->rememberItem(item);
+            d->rememberWhenHashed(item);
             ret.append(item);
         }
     }
@@ -198,7 +213,7 @@ QList<FileSharingItem *> FileSharingManager::fromFilesList(const QStringList &fi
         QFileInfo fi(file);
         if (fi.isFile() && fi.isReadable()) {
             auto item = new FileSharingItem(file, acc, this);
-            d->rememberItem(item);
+            d->rememberWhenHashed(item);
             ret << item;
         }
     }
@@ -302,16 +317,6 @@ bool FileSharingManager::jingleAutoAcceptIncomingDownloadRequest(Jingle::Session
     return true;
 }
 
-#ifdef HAVE_WEBSERVER
-// returns true if request handled. false if we need to find another hander
-bool FileSharingManager::downloadHttpRequest(PsiAccount *acc, const QString &sourceIdHex,
-                                             qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res)
-{
-    new FileSharingHttpProxy(acc, sourceIdHex, req, res);
-    return true;
-}
-#endif
-
 XMPP::Hash FileSharingDeviceOpener::urlToSourceId(const QUrl &url)
 {
     if (url.scheme() != QLatin1String("share"))
@@ -341,7 +346,7 @@ QIODevice *FileSharingDeviceOpener::open(QUrl &url)
     }
 
 #ifdef HAVE_WEBSERVER
-    QUrl    localServerUrl = acc->psi()->webServer()->serverUrl();
+    QUrl    localServerUrl = acc->psi()->shareServer()->serverUrl();
     QString path           = localServerUrl.path();
     path.reserve(128);
     if (!path.endsWith('/'))
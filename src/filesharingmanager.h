@@ -36,11 +36,6 @@ class QFileInfo;
 class QImage;
 class QMimeData;
 
-namespace qhttp { namespace server {
-    class QHttpRequest;
-    class QHttpResponse;
-}}
-
 namespace XMPP {
 class Message;
 namespace Jingle {
@@ -88,10 +83,6 @@ public:
     // returns false if unable to accept automatically
     bool jingleAutoAcceptIncomingDownloadRequest(XMPP::Jingle::Session *session);
 
-#ifdef HAVE_WEBSERVER
-    bool downloadHttpRequest(PsiAccount *acc, const QString &sourceIdHex, qhttp::server::QHttpRequest *req,
-                             qhttp::server::QHttpResponse *res);
-#endif
 signals:
 
 public slots:
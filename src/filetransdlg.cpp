@@ -22,11 +22,14 @@
 #include <QDesktopServices>
 #include <QFileDialog>
 #include <QFileIconProvider>
+#include <QFutureWatcher>
 #include <QKeyEvent>
 #include <QMenu>
 #include <QMessageBox>
 #include <QPainter>
+#include <QThreadPool>
 #include <QTimer>
+#include <QtConcurrent>
 
 typedef quint64 LARGE_TYPE;
 
@@ -64,6 +67,16 @@ static int calcTotalSteps(qlonglong big, int shift)
 
 static int calcProgressStep(qlonglong big, int complement, int shift) { return int((big + complement) >> shift); }
 
+// the file is read and written by this many bytes
+#define FT_IO_BLOCK_SIZE (1024 * 1024)
+// how far the reading may go ahead of the sent data
+#define FT_READ_AHEAD_SIZE (4 * FT_IO_BLOCK_SIZE)
+
+struct FileBlock {
+    QByteArray data;
+    bool       ok = true;
+};
+
 static QStringList *activeFiles = nullptr;
 
 static void active_file_add(const QString &s)
@@ -107,6 +120,78 @@ public:
     int           shift;
     int           complement;
     QString       activeFile;
+
+    // disk access goes to the io thread, reading ahead of the sender and writing behind the receiver
+    QThreadPool               io;
+    QFutureWatcher<FileBlock> readWatcher;
+    QFutureWatcher<QString>   writeWatcher; // error string, empty on success
+    QList<QByteArray>         readAhead;
+    qint64                    readAheadSize = 0;
+    bool                      readEof       = false;
+    bool                      sendWaiting   = false; // trySend found nothing to send
+    QByteArray                writeBehind;
+
+    Private() { io.setMaxThreadCount(1); }
+
+    void readNext()
+    {
+        if (readWatcher.isRunning() || readEof || readAheadSize >= FT_READ_AHEAD_SIZE)
+            return;
+        QFile *file = &f;
+        readWatcher.setFuture(QtConcurrent::run(&io, [file]() {
+            FileBlock b;
+            b.data.resize(FT_IO_BLOCK_SIZE);
+            qint64 r = file->read(b.data.data(), b.data.size());
+            b.ok     = r >= 0;
+            b.data.resize(int(qMax(r, qint64(0))));
+            return b;
+        }));
+    }
+
+    void writeNext()
+    {
+        if (writeWatcher.isRunning() || writeBehind.isEmpty())
+            return;
+        QFile *    file = &f;
+        QByteArray data = writeBehind;
+        writeBehind.clear();
+        writeWatcher.setFuture(QtConcurrent::run(&io, [file, data]() {
+            return file->write(data) == data.size() ? QString() : file->errorString();
+        }));
+    }
+
+    // takes up to size bytes of what was read ahead
+    QByteArray takeRead(int size)
+    {
+        QByteArray ret;
+        while (size > 0 && !readAhead.isEmpty()) {
+            QByteArray &block = readAhead.first();
+            if (block.size() <= size) {
+                size -= block.size();
+                if (ret.isEmpty())
+                    ret = block; // no copy
+                else
+                    ret += block;
+                readAhead.removeFirst();
+            } else {
+                ret += block.left(size);
+                block.remove(0, size);
+                size = 0;
+            }
+        }
+        readAheadSize -= ret.size();
+        return ret;
+    }
+
+    void closeFile()
+    {
+        io.waitForDone();
+        readAhead.clear();
+        readAheadSize = 0;
+        writeBehind.clear();
+        if (f.isOpen())
+            f.close();
+    }
 };
 
 FileTransferHandler::FileTransferHandler(PsiAccount *pa, FileTransfer *ft)
@@ -115,6 +200,9 @@ FileTransferHandler::FileTransferHandler(PsiAccount *pa, FileTransfer *ft)
     d->pa = pa;
     d->c  = nullptr;
 
+    connect(&d->readWatcher, &QFutureWatcherBase::finished, this, &FileTransferHandler::io_readFinished);
+    connect(&d->writeWatcher, &QFutureWatcherBase::finished, this, &FileTransferHandler::io_writeFinished);
+
     if (ft) {
         d->sending    = false;
         d->peer       = ft->peer();
@@ -143,6 +231,7 @@ FileTransferHandler::~FileTransferHandler()
         d->ft->close();
         delete d->ft;
     }
+    d->closeFile();
     delete d;
 }
 
@@ -301,10 +390,13 @@ void FileTransferHandler::ft_connected()
             return;
         }
 
+        d->readEof = false;
         if (d->sent == d->fileSize)
             QTimer::singleShot(0, this, SLOT(doFinish()));
-        else
-            QTimer::singleShot(0, this, SLOT(trySend()));
+        else {
+            d->sendWaiting = true; // sent as soon as the first block is read
+            d->readNext();
+        }
     } else {
         // open the file, truncating if offset is zero, otherwise set the correct offset
         QIODevice::OpenMode m = QIODevice::ReadWrite;
@@ -340,17 +432,13 @@ void FileTransferHandler::ft_connected()
 void FileTransferHandler::ft_readyRead(const QByteArray &a)
 {
     if (!d->sending) {
-        // printf("%d bytes read\n", a.size());
-        int r = int(d->f.write(a.data(), a.size()));
-        if (r < 0) {
-            d->f.close();
-            delete d->ft;
-            d->ft = nullptr;
-            emit error(ErrFile, 0, d->f.errorString());
-            return;
-        }
+        d->writeBehind += a;
         d->sent += a.size();
-        doFinish();
+        if (d->writeBehind.size() >= FT_IO_BLOCK_SIZE || d->sent == d->fileSize)
+            d->writeNext();
+        // the last progress comes from doFinish() when everything is on the disk
+        if (d->sent != d->fileSize)
+            emit progress(calcProgressStep(d->sent, d->complement, d->shift), d->sent);
     }
 }
 
@@ -360,7 +448,7 @@ void FileTransferHandler::ft_bytesWritten(qint64 x)
         // printf("%d bytes written\n", x);
         d->sent += x;
         if (d->sent == d->fileSize) {
-            d->f.close();
+            d->closeFile();
             delete d->ft;
             d->ft = nullptr;
         } else
@@ -371,8 +459,7 @@ void FileTransferHandler::ft_bytesWritten(qint64 x)
 
 void FileTransferHandler::ft_error(int x)
 {
-    if (d->f.isOpen())
-        d->f.close();
+    d->closeFile();
     delete d->ft;
     d->ft = nullptr;
 
@@ -407,27 +494,63 @@ void FileTransferHandler::trySend()
     if (!d->ft->bsConnection())
         return;
 
-    int        blockSize = d->ft->dataSizeNeeded();
-    QByteArray a(blockSize, 0);
-    int        r = 0;
-    if (blockSize > 0)
-        r = int(d->f.read(a.data(), a.size()));
-    if (r < 0) {
-        d->f.close();
+    int blockSize = d->ft->dataSizeNeeded();
+    if (blockSize > 0 && d->readAhead.isEmpty() && !d->readEof) {
+        d->sendWaiting = true; // the disk is behind, continue when the block is read
+        d->readNext();
+        return;
+    }
+    d->ft->writeFileData(d->takeRead(blockSize));
+    d->readNext();
+}
+
+void FileTransferHandler::io_readFinished()
+{
+    FileBlock b = d->readWatcher.result();
+    if (!d->ft || !d->f.isOpen())
+        return;
+    if (!b.ok) {
+        d->closeFile();
         delete d->ft;
         d->ft = nullptr;
         emit error(ErrFile, 0, d->f.errorString());
         return;
     }
-    if (r < int(a.size()))
-        a.resize(r);
-    d->ft->writeFileData(a);
+    if (b.data.isEmpty())
+        d->readEof = true;
+    else {
+        d->readAhead.append(b.data);
+        d->readAheadSize += b.data.size();
+    }
+    d->readNext();
+    if (d->sendWaiting) {
+        d->sendWaiting = false;
+        trySend();
+    }
+}
+
+void FileTransferHandler::io_writeFinished()
+{
+    const QString err = d->writeWatcher.result();
+    if (!d->f.isOpen())
+        return;
+    if (!err.isEmpty()) {
+        d->closeFile();
+        delete d->ft;
+        d->ft = nullptr;
+        emit error(ErrFile, 0, err);
+        return;
+    }
+    if (d->sent == d->fileSize && d->writeBehind.isEmpty())
+        doFinish();
+    else if (d->writeBehind.size() >= FT_IO_BLOCK_SIZE || d->sent == d->fileSize)
+        d->writeNext();
 }
 
 void FileTransferHandler::doFinish()
 {
     if (d->sent == d->fileSize) {
-        d->f.close();
+        d->closeFile();
         delete d->ft;
         d->ft = nullptr;
     }
@@ -68,6 +68,8 @@ private slots:
     void ft_error(int);
     void trySend();
     void doFinish();
+    void io_readFinished();
+    void io_writeFinished();
 
 private:
     class Private;
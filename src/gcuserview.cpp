@@ -24,6 +24,7 @@
 #include "coloropt.h"
 #include "common.h"
 #include "groupchatdlg.h"
+#include "psicapsregsitry.h"
 #include "psiaccount.h"
 #include "psiiconset.h"
 #include "psioptions.h"
@@ -32,11 +33,18 @@
 #include "xmpp_caps.h"
 #include "xmpp_muc.h"
 
+#include <QCryptographicHash>
 #include <QItemDelegate>
 #include <QMenu>
 #include <QMimeData>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPixmapCache>
+#include <QTimer>
+#include <QtConcurrentRun>
+#include <algorithm>
+
+#define MUC_AVATAR_CACHE_SIZE 2048 /* kilobytes per room */
 
 // static bool caseInsensitiveLessThan(const QString &s1, const QString &s2)
 //{
@@ -161,7 +169,14 @@ public:
             if (ava.isNull()) {
                 ava = IconsetFactory::iconPixmap("psi/default_avatar", avatarSize_);
             }
-            ava = AvatarFactory::roundedAvatar(ava, avatarRadius_, avatarSize_);
+            // rounded once per avatar and size, a new avatar comes as a new pixmap
+            const QString key = QString("gcavatar/%1/%2/%3").arg(ava.cacheKey()).arg(avatarSize_).arg(avatarRadius_);
+            QPixmap       rounded;
+            if (!QPixmapCache::find(key, &rounded)) {
+                rounded = AvatarFactory::roundedAvatar(ava, avatarRadius_, avatarSize_);
+                QPixmapCache::insert(key, rounded);
+            }
+            ava = rounded;
             QRect avaRect(rect);
             avaRect.setWidth(ava.width());
             avaRect.setHeight(ava.height());
@@ -307,9 +322,21 @@ private:
 // GCUserModel
 //----------------------------------------------------------------------------
 
+static const QString sortStyleOption = QStringLiteral("options.ui.muc.userlist.contact-sort-style");
+
 GCUserModel::GCUserModel(PsiAccount *account, const Jid selfJid, QObject *parent) :
     QAbstractItemModel(parent), _account(account), _selfJid(selfJid), _selfContact(nullptr)
 {
+    _statusSort = PsiOptions::instance()->getOption(sortStyleOption).toString() == QLatin1String("status");
+    PsiOptions::watch(sortStyleOption, this, [this](const QString &option) { optionChanged(option); });
+
+    _avatars.setMaxCost(MUC_AVATAR_CACHE_SIZE);
+    _avatarTimer = new QTimer(this);
+    _avatarTimer->setSingleShot(true);
+    _avatarTimer->setInterval(0);
+    connect(_avatarTimer, &QTimer::timeout, this, &GCUserModel::decodeAvatars);
+    _avatarWatcher = new QFutureWatcher<DecodedAvatars>(this);
+    connect(_avatarWatcher, &QFutureWatcher<DecodedAvatars>::finished, this, &GCUserModel::avatarsDecoded);
 }
 
 QModelIndex GCUserModel::index(int row, int column, const QModelIndex &parent) const
@@ -353,18 +380,22 @@ QVariant GCUserModel::data(const QModelIndex &index, int role) const
         case StatusRole:
             return QVariant::fromValue<Status>(contact.status);
         case AvatarRole:
-            return contact.avatar;
+            // only painted rows ask for it, so only those get decoded
+            if (auto pix = _avatars.object(contact.name)) {
+                return *pix;
+            }
+            _avatarQueue.insert(contact.name);
+            _avatarTimer->start();
+            return QPixmap();
         case ClientIconRole: {
             UserListItem u;
             Jid          jid = _selfJid.withResource(contact.name);
             Jid          caps_jid(
                 /*s.mucItem().jid().isEmpty() ? */ jid /* : s.mucItem().jid()*/); // TODO review caching of such caps
-            CapsManager *cm             = _account->client()->capsManager();
-            QString      client_name    = cm->clientName(caps_jid);
-            QString      client_version = (client_name.isEmpty() ? QString() : cm->clientVersion(caps_jid));
+            const auto   client = PsiCapsRegistry::clientInfo(_account->client()->capsManager(), caps_jid);
             UserResource ur;
             ur.setStatus(contact.status);
-            ur.setClient(client_name, client_version, "");
+            ur.setClient(client.name, client.version, "");
             u.userResourceList().append(ur);
             QStringList clients = u.clients();
             if (!clients.isEmpty())
@@ -408,12 +439,120 @@ void GCUserModel::updateAvatar(const QString &nick)
 {
     QModelIndex index = findIndex(nick);
     if (index.isValid()) {
-        contacts[index.parent().row()][index.row()]->avatar
-            = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
+        _avatars.remove(nick);
+        if (_avatarWatcher->isRunning()) {
+            _avatarStale.insert(nick);
+        }
         emit dataChanged(index, index);
     }
 }
 
+static QImage squareAvatar(const QImage &original)
+{
+    if (original.isNull() || original.width() == original.height())
+        return original;
+
+    int    size = qMax(original.width(), original.height());
+    QImage square(size, size, QImage::Format_ARGB32_Premultiplied);
+    square.fill(Qt::transparent);
+
+    QPainter p(&square);
+    p.drawImage((size - original.width()) / 2, (size - original.height()) / 2, original);
+
+    return square;
+}
+
+void GCUserModel::decodeAvatars()
+{
+    if (_avatarWatcher->isRunning()) {
+        return; // restarted when the current batch is done
+    }
+
+    AvatarFactory *                      factory = _account->avatarFactory();
+    QList<QPair<QByteArray, QByteArray>> batch;
+    for (const QString &nick : qAsConst(_avatarQueue)) {
+        if (!_nickIndex.contains(nick)) {
+            continue;
+        }
+        const Jid  jid  = _selfJid.withResource(nick);
+        QByteArray hash = factory->mucAvatarHash(jid);
+        QByteArray data;
+        if (hash.isEmpty()) {
+            data = factory->mucAvatarData(jid);
+            if (data.isEmpty()) {
+                _avatars.insert(nick, new QPixmap(), 1); // don't ask again until it's updated
+                continue;
+            }
+            hash = factory->mucAvatarHash(jid);
+            if (hash.isEmpty()) {
+                hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+            }
+        }
+
+        QPixmap pix = AvatarFactory::mucAvatarPixmap(hash);
+        if (!pix.isNull()) {
+            setAvatar(nick, pix); // already decoded for another occupant or room
+            continue;
+        }
+        auto &nicks = _avatarNicks[hash];
+        nicks.append(nick);
+        if (nicks.size() > 1) {
+            continue; // same avatar is in this batch already
+        }
+        if (data.isEmpty()) {
+            data = factory->mucAvatarData(jid);
+        }
+        if (data.isEmpty()) {
+            _avatarNicks.remove(hash);
+            _avatars.insert(nick, new QPixmap(), 1);
+        } else {
+            batch.append(qMakePair(hash, data));
+        }
+    }
+    _avatarQueue.clear();
+
+    if (!batch.isEmpty()) {
+        _avatarWatcher->setFuture(QtConcurrent::run([batch]() {
+            DecodedAvatars ret;
+            for (const auto &item : batch) {
+                ret.append(qMakePair(item.first, squareAvatar(QImage::fromData(item.second))));
+            }
+            return ret;
+        }));
+    }
+}
+
+void GCUserModel::avatarsDecoded()
+{
+    const DecodedAvatars result = _avatarWatcher->result();
+    for (const auto &item : result) {
+        const QPixmap pix = QPixmap::fromImage(item.second);
+        AvatarFactory::cacheMucAvatarPixmap(item.first, pix);
+        for (const QString &nick : _avatarNicks.value(item.first)) {
+            if (!_avatarStale.contains(nick)) {
+                setAvatar(nick, pix);
+            }
+        }
+    }
+    _avatarNicks.clear();
+    _avatarStale.clear();
+
+    if (!_avatarQueue.isEmpty()) {
+        _avatarTimer->start();
+    }
+}
+
+void GCUserModel::setAvatar(const QString &nick, const QPixmap &pix)
+{
+    QModelIndex index = findIndex(nick);
+    if (!index.isValid()) {
+        return;
+    }
+    // pixmaps are implicitly shared, the per room cost keeps the room's share of the global cache bounded
+    _avatars.insert(nick, new QPixmap(pix), qMax(1, pix.width() * pix.height() * pix.depth() / 8 / 1024));
+    emit dataChanged(index, index, QVector<int>() << AvatarRole);
+}
+
 QString GCUserModel::makeToolTip(const MUCContact &contact) const
 {
     const QString &nick = contact.name;
@@ -424,16 +563,14 @@ QString GCUserModel::makeToolTip(const MUCContact &contact) const
     u.setName(nick);
 
     // Find out capabilities info
-    Jid          caps_jid(contactJid);
-    CapsManager *cm             = _account->client()->capsManager();
-    QString      client_name    = cm->clientName(caps_jid);
-    QString      client_version = (client_name.isEmpty() ? QString() : cm->clientVersion(caps_jid));
+    Jid        caps_jid(contactJid);
+    const auto client = PsiCapsRegistry::clientInfo(_account->client()->capsManager(), caps_jid);
 
     // make a resource so the contact appears online
     UserResource ur;
     ur.setName(nick);
     ur.setStatus(contact.status);
-    ur.setClient(client_name, client_version, "");
+    ur.setClient(client.name, client.version, "");
     // ur.setClient(QString(),QString(),"");
     u.userResourceList().append(ur);
     u.setPrivate(true);
@@ -486,10 +623,16 @@ int GCUserModel::columnCount(const QModelIndex &parent) const
 
 void GCUserModel::removeEntry(const QString &nick)
 {
-    QModelIndex index = findIndex(nick);
-    if (index.isValid()) {
-        beginRemoveRows(index.parent(), index.row(), index.row());
-        contacts[index.parent().row()].removeAt(index.row());
+    auto contact = _nickIndex.value(nick);
+    if (contact) {
+        Role gr  = groupRole(contact->status);
+        int  row = rowOf(contact);
+        beginRemoveRows(index(gr, 0), row, row);
+        contacts[gr].removeAt(row);
+        _nickIndex.remove(nick);
+        _foldedIndex.remove(nick.toCaseFolded(), nick);
+        _avatars.remove(nick);
+        indexJid(*contact, -1);
         endRemoveRows();
     }
     // TODO don't remove groups. just set display text to "" in data() (ex GCUserViewGroupItem::updateText)
@@ -510,80 +653,156 @@ GCUserModel::Role GCUserModel::groupRole(const Status &s)
     return newGroupRole;
 }
 
+int GCUserModel::sortRank(const Status &s) const { return _statusSort ? rankStatus(s.type()) : 0; }
+
+// contacts are ordered by status rank (when sorted by status) and then by collated lower cased nick
+bool GCUserModel::lessThan(const MUCContact &a, int rank, const QCollatorSortKey &key) const
+{
+    int r = sortRank(a.status) - rank;
+    if (r == 0)
+        r = a.sortKey->compare(key);
+    return r < 0;
+}
+
+int GCUserModel::lowerBound(Role gr, int rank, const QCollatorSortKey &key) const
+{
+    const auto &cs   = contacts[gr];
+    int         left = 0, right = cs.size();
+    while (right - left > 0) {
+        int mid = (right + left) >> 1;
+        if (lessThan(*cs[mid], rank, key)) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+int GCUserModel::rowOf(const MUCContact::Ptr &contact) const
+{
+    Role        gr = groupRole(contact->status);
+    const auto &cs = contacts[gr];
+    // different nicks may have equal keys (e.g. case only differs), so walk through them
+    for (int row = lowerBound(gr, sortRank(contact->status), *contact->sortKey); row < cs.size(); row++) {
+        if (cs[row] == contact) {
+            return row;
+        }
+    }
+    return cs.indexOf(contact);
+}
+
+void GCUserModel::indexJid(const MUCContact &contact, int delta)
+{
+    const Jid &jid = contact.status.mucItem().jid();
+    if (jid.isEmpty()) {
+        return;
+    }
+    int &count = _jidIndex[jid.bare()];
+    count += delta;
+    if (count <= 0) {
+        _jidIndex.remove(jid.bare());
+    }
+}
+
 void GCUserModel::updateEntry(const QString &nick, const Status &s)
 {
     if (nick.isEmpty()) { // MUC self-presence? It should not come here
         return;
     }
-    QModelIndex contactIndex = findIndex(nick);
-
-    Role newGroupRole = groupRole(s);
-
-    if (!contactIndex.isValid() || newGroupRole != contactIndex.parent().row()) {
-        // either new contact or move between groups. we need to find destination position
-
-        bool doStatusSort = PsiOptions::instance()->getOption("options.ui.muc.userlist.contact-sort-style").toString()
-            == QLatin1String("status");
-        int insertRowNum = 0;
-        if (contacts[newGroupRole].size()) {
-            // TODO use sorting filter model instad of code below.
-            QString lowerNick = QLocale().toLower(nick);
-            int     left = 0, right = contacts[newGroupRole].size();
-            while (right - left > 0) { // std::lower_bound doesn't work here since we need index and not iterator
-                int mid = (right + left) >> 1;
-
-                int               rank;
-                const MUCContact &contact = *(contacts[newGroupRole][mid]);
-                if (doStatusSort) {
-                    rank = rankStatus(s.type()) - rankStatus(contact.status.type());
-                    if (rank == 0)
-                        rank = QString::localeAwareCompare(lowerNick, QLocale().toLower(contact.name));
-                } else {
-                    rank = QString::localeAwareCompare(lowerNick, QLocale().toLower(contact.name));
-                }
-
-                if (rank <= 0) {
-                    right = mid;
-                } else {
-                    left = mid + 1;
-                }
-            }
-            insertRowNum = left;
-        }
-
-        QModelIndex newParentIndex = index(newGroupRole, 0);
-        if (contactIndex.isValid()) { // move between group
-            beginMoveRows(contactIndex.parent(), contactIndex.row(), contactIndex.row(), newParentIndex, insertRowNum);
-            auto contact    = contacts[contactIndex.parent().row()].takeAt(contactIndex.row());
-            contact->status = s;
-            contacts[newGroupRole].insert(insertRowNum, contact);
-            endMoveRows();
-            // now report we want to change text of groups
-            emit dataChanged(contactIndex.parent(), contactIndex.parent(),
-                             QVector<int>() << Qt::DisplayRole); // TODO check if necessary
-            emit dataChanged(newParentIndex, newParentIndex,
-                             QVector<int>() << Qt::DisplayRole); // TODO check if necessary
-        } else {                                                 // new contact
-            beginInsertRows(newParentIndex, insertRowNum, insertRowNum);
-            auto contact    = MUCContact::Ptr(new MUCContact);
-            contact->name   = nick;
-            contact->status = s;
-            contact->avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
-            contacts[newGroupRole].insert(insertRowNum, contact);
-            if (nick == _selfJid.resource()) {
-                _selfContact = contact;
-            }
-            endInsertRows();
+    auto        contact        = _nickIndex.value(nick);
+    Role        newGroupRole   = groupRole(s);
+    QModelIndex newParentIndex = index(newGroupRole, 0);
+
+    if (!contact) { // new contact
+        contact          = MUCContact::Ptr(new MUCContact);
+        contact->name    = nick;
+        contact->status  = s;
+        contact->sortKey = _collator.sortKey(QLocale().toLower(nick));
+
+        int insertRowNum = lowerBound(newGroupRole, sortRank(s), *contact->sortKey);
+        beginInsertRows(newParentIndex, insertRowNum, insertRowNum);
+        contacts[newGroupRole].insert(insertRowNum, contact);
+        _nickIndex.insert(nick, contact);
+        _foldedIndex.insert(nick.toCaseFolded(), nick);
+        indexJid(*contact, 1);
+        if (nick == _selfJid.resource()) {
+            _selfContact = contact;
         }
-    } else {
+        endInsertRows();
+        return;
+    }
+
+    Role        oldGroupRole   = groupRole(contact->status);
+    QModelIndex oldParentIndex = index(oldGroupRole, 0);
+    int         row            = rowOf(contact);
+    int         insertRowNum   = row;
+    if (newGroupRole != oldGroupRole || sortRank(s) != sortRank(contact->status)) {
+        insertRowNum = lowerBound(newGroupRole, sortRank(s), *contact->sortKey);
+    }
+
+    indexJid(*contact, -1);
+    if (newGroupRole == oldGroupRole && (insertRowNum == row || insertRowNum == row + 1)) {
         // just changed status. delegate will decide how to redraw properly
-        auto contact    = contacts[contactIndex.parent().row()].at(contactIndex.row());
         contact->status = s;
-        contact->avatar = _account->avatarFactory()->getMucAvatar(_selfJid.withResource(nick));
-        emit dataChanged(contactIndex, contactIndex);
+        indexJid(*contact, 1);
+        emit dataChanged(index(row, 0, oldParentIndex), index(row, 0, oldParentIndex));
+        return;
+    }
+
+    beginMoveRows(oldParentIndex, row, row, newParentIndex, insertRowNum);
+    contacts[oldGroupRole].removeAt(row);
+    if (newGroupRole == oldGroupRole && insertRowNum > row) {
+        insertRowNum--;
+    }
+    contact->status = s;
+    contacts[newGroupRole].insert(insertRowNum, contact);
+    indexJid(*contact, 1);
+    endMoveRows();
+    if (newGroupRole != oldGroupRole) {
+        // now report we want to change text of groups
+        emit dataChanged(oldParentIndex, oldParentIndex,
+                         QVector<int>() << Qt::DisplayRole); // TODO check if necessary
+        emit dataChanged(newParentIndex, newParentIndex,
+                         QVector<int>() << Qt::DisplayRole); // TODO check if necessary
+    } else {
+        emit dataChanged(index(insertRowNum, 0, newParentIndex), index(insertRowNum, 0, newParentIndex));
     }
 }
 
+// loads the whole room roster at once, e.g. the initial presences of a room we've just joined
+void GCUserModel::resetEntries(const QHash<QString, Status> &entries)
+{
+    beginResetModel();
+    for (auto &cs : contacts) {
+        cs.clear();
+    }
+    _nickIndex.clear();
+    _foldedIndex.clear();
+    _jidIndex.clear();
+    _avatars.clear();
+    _selfContact.reset();
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        auto contact     = MUCContact::Ptr(new MUCContact);
+        contact->name    = it.key();
+        contact->status  = it.value();
+        contact->sortKey = _collator.sortKey(QLocale().toLower(it.key()));
+        contacts[groupRole(it.value())].append(contact);
+        _nickIndex.insert(it.key(), contact);
+        _foldedIndex.insert(it.key().toCaseFolded(), it.key());
+        indexJid(*contact, 1);
+        if (it.key() == _selfJid.resource()) {
+            _selfContact = contact;
+        }
+    }
+    for (auto &cs : contacts) {
+        std::sort(cs.begin(), cs.end(), [this](const MUCContact::Ptr &a, const MUCContact::Ptr &b) {
+            return lessThan(*a, sortRank(b->status), *b->sortKey);
+        });
+    }
+    endResetModel();
+}
+
 void GCUserModel::clear()
 {
     for (int i = LastGroupRole - 1; i >= 0; i--) {
@@ -593,6 +812,10 @@ void GCUserModel::clear()
             endRemoveRows();
         }
     }
+    _nickIndex.clear();
+    _foldedIndex.clear();
+    _jidIndex.clear();
+    _avatars.clear();
 }
 
 void GCUserModel::updateAll()
@@ -602,43 +825,49 @@ void GCUserModel::updateAll()
     emit layoutChanged();
 }
 
-bool GCUserModel::hasJid(const Jid &jid)
+void GCUserModel::optionChanged(const QString &option)
 {
-    for (int gr = 0; gr < LastGroupRole; gr++) {
-        const auto &cts = contacts[gr];
-        for (auto const &c : cts) {
-            auto const &cj = c->status.mucItem().jid();
-            if (!cj.isEmpty() && cj.compare(jid, false)) {
-                return true;
-            }
-        }
+    if (option != sortStyleOption) {
+        return;
+    }
+    bool statusSort = PsiOptions::instance()->getOption(sortStyleOption).toString() == QLatin1String("status");
+    if (statusSort != _statusSort) {
+        _statusSort = statusSort;
+        sortContacts();
     }
-    return false;
 }
 
-QModelIndex GCUserModel::findIndex(const QString &nick) const
+void GCUserModel::sortContacts()
 {
-    for (int gr = 0; gr < LastGroupRole; gr++) {
-        const QList<MUCContact::Ptr> &cs = contacts[gr];
-        // it's possible to use binary search here since contacts are sorted by default.
-        // but sorting algo is going to change to QString::localeAwareCompare and for binary search it's
-        // quite heavy operation until we have really many contacts (maybe 200+).
-        // so let's try plain search.
-        for (int ci = 0; ci < cs.size(); ci++) {
-            if (cs[ci]->name == nick) {
-                return index(ci, 0, index(gr, 0));
-            }
-        }
+    emit layoutAboutToBeChanged();
+    const QModelIndexList oldIndexes = persistentIndexList();
+    for (auto &cs : contacts) {
+        std::stable_sort(cs.begin(), cs.end(), [this](const MUCContact::Ptr &a, const MUCContact::Ptr &b) {
+            return lessThan(*a, sortRank(b->status), *b->sortKey);
+        });
     }
-
-    return QModelIndex();
+    QModelIndexList newIndexes;
+    for (const QModelIndex &i : oldIndexes) {
+        auto c = static_cast<MUCContact *>(i.internalPointer());
+        newIndexes << (c ? findIndex(c->name) : i);
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+    emit layoutChanged();
 }
 
-GCUserModel::MUCContact *GCUserModel::findEntry(const QString &nick) const
+bool GCUserModel::hasJid(const Jid &jid) { return !jid.isEmpty() && _jidIndex.contains(jid.bare()); }
+
+QModelIndex GCUserModel::findIndex(const QString &nick) const
 {
-    return static_cast<GCUserModel::MUCContact *>(findIndex(nick).internalPointer());
+    auto contact = _nickIndex.value(nick);
+    if (!contact) {
+        return QModelIndex();
+    }
+    return index(rowOf(contact), 0, index(groupRole(contact->status), 0));
 }
 
+GCUserModel::MUCContact *GCUserModel::findEntry(const QString &nick) const { return _nickIndex.value(nick).data(); }
+
 QStringList GCUserModel::nickList() const
 {
     QStringList nicks;
@@ -651,6 +880,18 @@ QStringList GCUserModel::nickList() const
     return nicks;
 }
 
+// a range of the case folded index, so no need to look at every occupant
+QStringList GCUserModel::nicksStartingWith(const QString &prefix) const
+{
+    const QString folded = prefix.toCaseFolded();
+    QStringList   nicks;
+    for (auto it = _foldedIndex.lowerBound(folded); it != _foldedIndex.constEnd() && it.key().startsWith(folded);
+         ++it) {
+        nicks << it.value();
+    }
+    return nicks;
+}
+
 //----------------------------------------------------------------------------
 // GCUserView
 //----------------------------------------------------------------------------
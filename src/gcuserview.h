@@ -24,10 +24,19 @@
 #include "xmpp_status.h"
 
 #include <QAbstractItemModel>
+#include <QCache>
+#include <QCollator>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QImage>
+#include <QMultiMap>
+#include <QSet>
 #include <QTreeView>
+#include <optional>
 
 class GCUserView;
 class PsiAccount;
+class QTimer;
 
 namespace XMPP {
 class Jid;
@@ -52,7 +61,7 @@ public:
         typedef QSharedPointer<MUCContact> Ptr;
         QString                            name;
         Status                             status;
-        QPixmap                            avatar;
+        std::optional<QCollatorSortKey>    sortKey; // of the lower cased name
     };
 
     GCUserModel(PsiAccount *account, const Jid selfJid, QObject *parent);
@@ -61,10 +70,12 @@ public:
     void                     removeEntry(const QString &nick);
     void                     updateEntry(const QString &nick, const Status &);
     GCUserModel::MUCContact *findEntry(const QString &) const;
+    void                     resetEntries(const QHash<QString, Status> &entries); // nick -> status
 
     void        clear();
     bool        hasJid(const Jid &);
     QStringList nickList() const;
+    QStringList nicksStartingWith(const QString &prefix) const; // case insensitive
     MUCContact *selfContact() const;
     void        updateAvatar(const QString &nick);
 
@@ -80,13 +91,41 @@ public:
 public slots:
     void updateAll();
 
+private slots:
+    void optionChanged(const QString &option);
+    void decodeAvatars();
+    void avatarsDecoded();
+
 private:
     QModelIndex findIndex(const QString &nick) const;
+    void        setAvatar(const QString &nick, const QPixmap &pix);
     QString     makeToolTip(const MUCContact &contact) const;
     static Role groupRole(const Status &s);
+    int         sortRank(const Status &s) const;
+    bool        lessThan(const MUCContact &a, int rank, const QCollatorSortKey &key) const;
+    int         lowerBound(Role gr, int rank, const QCollatorSortKey &key) const;
+    int         rowOf(const MUCContact::Ptr &contact) const;
+    void        indexJid(const MUCContact &contact, int delta);
+    void        sortContacts();
 
 private:
-    QList<MUCContact::Ptr> contacts[LastGroupRole]; // splitted into groups
+    QList<MUCContact::Ptr> contacts[LastGroupRole]; // splitted into groups, each one kept sorted
+
+    QHash<QString, MUCContact::Ptr> _nickIndex;   // nick -> contact
+    QHash<QString, int>             _jidIndex;    // bare real jid -> occupants count
+    QMultiMap<QString, QString>     _foldedIndex; // case folded nick -> nick, for completion
+    QCollator                       _collator;
+    bool                            _statusSort;
+
+    // avatars are decoded in a thread pool when their rows are painted
+    // and shared by hash through AvatarFactory, so each avatar is decoded once for all rooms
+    typedef QList<QPair<QByteArray, QImage>> DecodedAvatars;
+    mutable QCache<QString, QPixmap>         _avatars;     // nick -> avatar
+    mutable QSet<QString>                    _avatarQueue; // waiting for the next batch
+    QSet<QString>                            _avatarStale; // changed while being decoded
+    QHash<QByteArray, QStringList>           _avatarNicks; // hash -> nicks waiting for it to be decoded
+    QTimer *                                 _avatarTimer;
+    QFutureWatcher<DecodedAvatars> *         _avatarWatcher;
 
     PsiAccount *    _account;
     Jid             _selfJid;
@@ -30,27 +30,28 @@ GlobalEventQueue *GlobalEventQueue::instance()
 
 int GlobalEventQueue::count() const { return items_.count(); }
 
-const QList<int> &GlobalEventQueue::ids() const { return ids_; }
+int GlobalEventQueue::count(PsiAccount *account) const { return accountCounts_.value(account); }
+
+QList<int> GlobalEventQueue::ids() const { return QList<int>(order_.begin(), order_.end()); }
 
 PsiEvent::Ptr GlobalEventQueue::peek(int id) const
 {
-    Q_ASSERT(ids_.contains(id));
-    for (EventItem *item : items_)
-        if (item->id() == id)
-            return item->event();
-    return PsiEvent::Ptr();
+    Q_ASSERT(items_.contains(id));
+    auto it = items_.constFind(id);
+    return it == items_.constEnd() ? PsiEvent::Ptr() : it->item->event();
 }
 
 void GlobalEventQueue::enqueue(EventItem *item)
 {
     Q_ASSERT(item);
-    Q_ASSERT(!ids_.contains(item->id()));
-    if (!item || ids_.contains(item->id()))
+    if (!item || items_.contains(item->id())) {
+        Q_ASSERT(false);
         return;
+    }
 
-    ids_.append(item->id());
-    items_.append(item);
-    Q_ASSERT(ids_.contains(item->id()));
+    order_.push_back(item->id());
+    items_.insert(item->id(), { item, std::prev(order_.end()) });
+    ++accountCounts_[item->event()->account()];
 
     emit queueChanged();
 }
@@ -58,13 +59,17 @@ void GlobalEventQueue::enqueue(EventItem *item)
 void GlobalEventQueue::dequeue(EventItem *item)
 {
     Q_ASSERT(item);
-    Q_ASSERT(ids_.contains(item->id()));
-    if (!item || !ids_.contains(item->id()))
+    auto it = item ? items_.find(item->id()) : items_.end();
+    if (it == items_.end()) {
+        Q_ASSERT(false);
         return;
+    }
 
-    ids_.removeAll(item->id());
-    items_.removeAll(item);
-    Q_ASSERT(!ids_.contains(item->id()));
+    order_.erase(it->pos);
+    items_.erase(it);
+    PsiAccount *account = item->event()->account();
+    if (--accountCounts_[account] <= 0)
+        accountCounts_.remove(account);
 
     emit queueChanged();
 }
@@ -22,7 +22,9 @@
 
 #include "psievent.h"
 
+#include <QHash>
 #include <QObject>
+#include <list>
 
 class GlobalEventQueue : public QObject {
     Q_OBJECT
@@ -31,9 +33,10 @@ public:
     static GlobalEventQueue *instance();
 
     int count() const;
+    int count(PsiAccount *account) const; // without walking the queue
 
-    const QList<int> &ids() const;
-    PsiEvent::Ptr     peek(int id) const;
+    QList<int>    ids() const; // in the order they were queued
+    PsiEvent::Ptr peek(int id) const;
 
 protected:
     void enqueue(EventItem *item);
@@ -45,9 +48,15 @@ signals:
 private:
     GlobalEventQueue();
 
+    struct Entry {
+        EventItem *              item;
+        std::list<int>::iterator pos; // in order_
+    };
+
     static GlobalEventQueue *instance_;
-    QList<int>               ids_;
-    QList<EventItem *>       items_;
+    std::list<int>           order_; // ids, oldest first
+    QHash<int, Entry>        items_;
+    QHash<PsiAccount *, int> accountCounts_;
     friend class EventQueue;
 };
 
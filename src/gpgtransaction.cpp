@@ -23,8 +23,16 @@
  */
 
 #include "gpgtransaction.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QFile>
+#include <QTimer>
+
+// gpg processes running at a time, a presence flood at login shouldn't fork them all at once
+#define GPG_MAX_PROCESSES 4
+// signature verifications remembered, presences repeat the same signed status
+#define GPG_VERIFY_CACHE_SIZE 512
 
 int GpgTransaction::m_idCounter = 0;
 
@@ -65,9 +73,16 @@ GpgTransaction::GpgTransaction(const Type type, const QString &keyID, QObject *p
 
     // TODO: update after stopping support of Ubuntu Xenial and WinXP:
     connect(this, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(processFinished()));
+    // there is no finished() then
+    connect(this, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
+            processFinished();
+    });
 }
 
-void GpgTransaction::start()
+void GpgTransaction::start() { GpgTransactionQueue::instance()->enqueue(this); }
+
+void GpgTransaction::launch()
 {
     // TODO: rewrite without usage of temporary file!
     if (m_type == Type::Verify) {
@@ -83,6 +98,17 @@ void GpgTransaction::start()
 
 int GpgTransaction::id() const { return m_id; }
 
+bool GpgTransaction::success() const { return m_success; }
+
+QByteArray GpgTransaction::verifyKey() const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_stdInString.toUtf8());
+    hash.addData("\n", 1);
+    hash.addData(m_data);
+    return hash.result();
+}
+
 void GpgTransaction::setGpgArguments(const QStringList &arguments)
 {
     m_arguments.clear();
@@ -117,6 +143,7 @@ void GpgTransaction::processStarted()
 
 void GpgTransaction::processFinished()
 {
+    m_success = error() != QProcess::FailedToStart && exitStatus() == QProcess::NormalExit && exitCode() == 0;
     m_stdOutString = QString::fromUtf8(readAllStandardOutput());
     m_stdErrString = QString::fromUtf8(readAllStandardError());
 #ifdef Q_OS_WIN
@@ -127,5 +154,136 @@ void GpgTransaction::processFinished()
     if (m_type == Type::Verify) {
         QFile::remove(m_tempFile);
     }
-    emit transactionFinished();
+    GpgTransactionQueue::instance()->finished(this);
+}
+
+//----------------------------------------------------------------------------
+// GpgTransactionQueue
+//----------------------------------------------------------------------------
+
+GpgTransactionQueue *GpgTransactionQueue::m_instance = nullptr;
+
+GpgTransactionQueue *GpgTransactionQueue::instance()
+{
+    if (!m_instance) {
+        m_instance = new GpgTransactionQueue();
+    }
+    return m_instance;
+}
+
+GpgTransactionQueue::GpgTransactionQueue() :
+    QObject(QCoreApplication::instance()), m_verified(GPG_VERIFY_CACHE_SIZE)
+{
+}
+
+void GpgTransactionQueue::enqueue(GpgTransaction *transaction)
+{
+    QByteArray key;
+    if (transaction->m_type == GpgTransaction::Type::Verify) {
+        key = transaction->verifyKey();
+        if (Verified *cached = m_verified.object(key)) {
+            // still reported from the event loop, as if gpg ran
+            const Verified result = *cached;
+            QTimer::singleShot(0, transaction, [this, transaction, result]() { adopt(transaction, result); });
+            return;
+        }
+        auto it = m_sameVerify.find(key);
+        if (it != m_sameVerify.end()) {
+            it->append(transaction);
+            return;
+        }
+        m_sameVerify.insert(key, {});
+    } else if (transaction->m_type == GpgTransaction::Type::Encrypt) {
+        m_encryptions += transaction;
+    }
+
+    m_waiting.enqueue({ transaction, key });
+    startNext();
+}
+
+void GpgTransactionQueue::clearVerified() { m_verified.clear(); }
+
+void GpgTransactionQueue::startNext()
+{
+    while (m_running.size() < GPG_MAX_PROCESSES && !m_waiting.isEmpty()) {
+        const Entry entry = m_waiting.dequeue();
+        if (!entry.transaction) {
+            // deleted before it ran, the same verifications still need a run
+            if (!entry.verifyKey.isEmpty())
+                promote(entry.verifyKey);
+            continue;
+        }
+
+        GpgTransaction * transaction = entry.transaction;
+        const QByteArray key         = entry.verifyKey;
+        m_running.insert(transaction);
+        connect(transaction, &QObject::destroyed, this, [this, transaction, key]() {
+            if (!m_running.remove(transaction))
+                return; // finished before
+            if (!key.isEmpty())
+                promote(key);
+            reportEncryptions();
+            startNext();
+        });
+        transaction->launch();
+    }
+}
+
+void GpgTransactionQueue::promote(const QByteArray &verifyKey)
+{
+    QList<QPointer<GpgTransaction>> same = m_sameVerify.take(verifyKey);
+    while (!same.isEmpty()) {
+        QPointer<GpgTransaction> transaction = same.takeFirst();
+        if (transaction) {
+            m_sameVerify.insert(verifyKey, same);
+            m_waiting.prepend({ transaction, verifyKey });
+            return;
+        }
+    }
+}
+
+void GpgTransactionQueue::finished(GpgTransaction *transaction)
+{
+    m_running.remove(transaction);
+    transaction->m_finished = true;
+
+    if (transaction->m_type == GpgTransaction::Type::Verify) {
+        const QByteArray key = transaction->verifyKey();
+        const Verified   result { transaction->m_success, transaction->m_stdOutString, transaction->m_stdErrString };
+        // a gpg that couldn't be started says nothing about the signature
+        if (transaction->error() != QProcess::FailedToStart)
+            m_verified.insert(key, new Verified(result));
+        const QList<QPointer<GpgTransaction>> same = m_sameVerify.take(key);
+
+        emit transaction->transactionFinished();
+        for (const QPointer<GpgTransaction> &t : same) {
+            if (t)
+                adopt(t, result);
+        }
+    } else if (transaction->m_type == GpgTransaction::Type::Encrypt) {
+        reportEncryptions();
+    } else {
+        emit transaction->transactionFinished();
+    }
+
+    startNext();
+}
+
+void GpgTransactionQueue::reportEncryptions()
+{
+    // in the order the messages were sent
+    while (!m_encryptions.isEmpty() && (!m_encryptions.first() || m_encryptions.first()->m_finished)) {
+        QPointer<GpgTransaction> transaction = m_encryptions.takeFirst();
+        if (transaction)
+            emit transaction->transactionFinished();
+    }
+}
+
+void GpgTransactionQueue::adopt(GpgTransaction *transaction, const Verified &result)
+{
+    transaction->m_success      = result.success;
+    transaction->m_stdOutString = result.stdOut;
+    transaction->m_stdErrString = result.stdErr;
+    transaction->m_finished     = true;
+    emit transaction->transactionFinished();
 }
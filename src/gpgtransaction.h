@@ -28,8 +28,15 @@
 #include "xmpp_jid.h"
 #include "xmpp_message.h"
 #include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
 #include <QStringList>
 
+class GpgTransactionQueue;
+
 class GpgTransaction : public GpgProcess {
     Q_OBJECT
 
@@ -39,8 +46,11 @@ public:
     explicit GpgTransaction(const Type type, const QString &keyID, QObject *parent = nullptr);
     ~GpgTransaction() = default;
 
+    // queued, see GpgTransactionQueue
     void start();
     int  id() const;
+    // gpg ran and exited with 0
+    bool success() const;
 
     void setGpgArguments(const QStringList &arguments);
     void setStdInString(const QString &str);
@@ -63,9 +73,16 @@ private slots:
     void processFinished();
 
 private:
+    friend class GpgTransactionQueue;
+
+    void       launch();
+    QByteArray verifyKey() const;
+
     static int m_idCounter;
     int        m_id;
     Type       m_type;
+    bool       m_success  = false;
+    bool       m_finished = false; // gpg is done, the report may still be held back
 
     QStringList   m_arguments;
     QString       m_stdInString;
@@ -76,3 +93,46 @@ private:
     QByteArray    m_data;
     QString       m_tempFile;
 };
+
+// Runs the gpg processes of all transactions, a few at a time and in the order they were started.
+// Encryptions report back in that order too, so outgoing messages keep it. A verification of
+// signed data that is being verified already, or was lately, doesn't run gpg again
+class GpgTransactionQueue : public QObject {
+    Q_OBJECT
+
+public:
+    static GpgTransactionQueue *instance();
+
+    void enqueue(GpgTransaction *transaction);
+    // the keyring changed, signatures are checked again
+    void clearVerified();
+
+private:
+    GpgTransactionQueue();
+
+    struct Entry {
+        QPointer<GpgTransaction> transaction;
+        QByteArray               verifyKey;
+    };
+    struct Verified {
+        bool    success;
+        QString stdOut;
+        QString stdErr;
+    };
+
+    void startNext();
+    void finished(GpgTransaction *transaction);
+    void reportEncryptions();
+    void adopt(GpgTransaction *transaction, const Verified &result);
+    void promote(const QByteArray &verifyKey);
+
+    friend class GpgTransaction;
+
+    static GpgTransactionQueue *m_instance;
+
+    QQueue<Entry>                                      m_waiting;
+    QSet<GpgTransaction *>                             m_running;
+    QList<QPointer<GpgTransaction>>                    m_encryptions; // in start order, until reported
+    QHash<QByteArray, QList<QPointer<GpgTransaction>>> m_sameVerify;  // verify key => waiting for the one queued
+    QCache<QByteArray, Verified>                       m_verified;
+};
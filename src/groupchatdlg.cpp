@@ -92,8 +92,10 @@
 #include <QMimeData>
 #include <QPointer>
 #include <QPushButton>
+#include <QQueue>
 #include <QResizeEvent>
 #include <QScrollBar>
+#include <QSet>
 #include <QSplitter>
 #include <QTextCursor>
 #include <QTextDocument> // for TextUtil::escape()
@@ -103,6 +105,7 @@
 #include <QToolTip>
 #include <QVBoxLayout>
 #include <functional>
+#include <utility>
 #ifdef Q_OS_WIN
 #include <windows.h>
 #endif
@@ -193,6 +196,10 @@ private:
 //----------------------------------------------------------------------------
 // GCMainDlg
 //----------------------------------------------------------------------------
+
+#define REPLAY_FLUSH_DELAY 100 // ms without replayed messages to consider the replay done
+#define SHOWN_MESSAGES_MAX 500 // recent messages remembered to skip them in a replay
+
 class GCMainDlg::Private : public QObject, public MCmdProviderIface {
     Q_OBJECT
 public:
@@ -245,6 +252,23 @@ public:
     bool   gcSelfPresenceSupported = false;
     bool   gcSelfAvatarRequested   = false; // when self presence is not supported
 
+    // initial room roster, collected until our own presence arrives and loaded at once
+    bool                   snapshot = false;
+    QHash<QString, Status> snapshotPresences;
+
+    // history the room replays while we join, shown at once
+    QList<QPair<Message, bool>> replay; // message, alert
+    QTimer                      replayTimer;
+    bool                        replaying = false;
+    QSet<QString>               shownMessages;
+    QQueue<QString>             shownOrder;
+
+    // a tab hidden for long doesn't render. messages wait here until it's shown
+    QTimer             hibernateTimer;
+    bool               hibernated = false;
+    QList<MessageView> hibernatedLog;
+    bool               usersExpanded[GCUserModel::LastGroupRole];
+
     QStringList hist;
     int         histAt;
 
@@ -607,17 +631,20 @@ public:
             if (p_->mCmdSite.isActive()) {
                 return mCmdList_;
             }
-            QStringList suggestedNicks;
-            QStringList nicks = allNicks();
+            QStringList nicks = p_->dlg->d->usersModel->nicksStartingWith(toComplete_);
 
-            QString postAdd = atStart_ ? nickSeparator + " " : "";
+            // whoever addressed us last is the likely one to answer
+            int referrer = nicks.indexOf(p_->lastReferrer);
+            if (referrer > 0) {
+                nicks.move(referrer, 0);
+            }
 
-            for (const QString &nick : nicks) {
-                if (nick.left(toComplete_.length()).toLower() == toComplete_.toLower()) {
-                    suggestedNicks << nick + postAdd;
+            if (atStart_) {
+                for (QString &nick : nicks) {
+                    nick += nickSeparator + " ";
                 }
             }
-            return suggestedNicks;
+            return nicks;
         };
 
         virtual QStringList allChoices(QString &guess)
@@ -1072,6 +1099,12 @@ GCMainDlg::GCMainDlg(PsiAccount *pa, const Jid &j, TabManager *tabManager) : Tab
     invalidateTab();
     setConnecting();
 
+    d->replayTimer.setSingleShot(true);
+    d->replayTimer.setInterval(REPLAY_FLUSH_DELAY);
+    connect(&d->replayTimer, &QTimer::timeout, this, &GCMainDlg::flushReplay);
+    d->hibernateTimer.setSingleShot(true);
+    connect(&d->hibernateTimer, &QTimer::timeout, this, &GCMainDlg::hibernate);
+
     connect(ui_.log, &ChatView::quote, ui_.mle->chatEdit(), &ChatEdit::insertAsQuote);
     connect(pa->avatarFactory(), &AvatarFactory::avatarChanged, this, &GCMainDlg::avatarUpdated);
 
@@ -1200,12 +1233,20 @@ void GCMainDlg::deactivated()
     TabbableWidget::deactivated();
 
     d->trackBar = true;
+
+    int minutes = PsiOptions::instance()->getOption("options.ui.muc.hibernate-after").toInt();
+    if (minutes > 0) {
+        d->hibernateTimer.start(minutes * 60 * 1000);
+    }
 }
 
 void GCMainDlg::activated()
 {
     TabbableWidget::activated();
 
+    d->hibernateTimer.stop();
+    wakeUp();
+
     if (d->pending > 0) {
         d->pending      = 0;
         d->hPending     = 0;
@@ -1256,6 +1297,9 @@ void GCMainDlg::logSelectionChanged()
 void GCMainDlg::setConnecting()
 {
     d->connecting = true;
+    // initial joins are shown one by one if asked to
+    d->snapshot = !PsiOptions::instance()->getOption("options.ui.muc.show-initial-joins").toBool();
+    d->snapshotPresences.clear();
     QTimer::singleShot(5000, this, SLOT(unsetConnecting()));
 }
 
@@ -1282,7 +1326,31 @@ void GCMainDlg::updateBookmarkIcon()
 void GCMainDlg::openWhiteboard() { account()->actionOpenWhiteboardSpecific(jid(), jid().withResource(d->self), true); }
 #endif
 
-void GCMainDlg::unsetConnecting() { d->connecting = false; }
+void GCMainDlg::unsetConnecting()
+{
+    d->connecting = false;
+    flushSnapshot(); // our presence never came
+    flushReplay();
+}
+
+void GCMainDlg::flushSnapshot()
+{
+    if (!d->snapshot) {
+        return;
+    }
+    d->snapshot = false;
+
+    // a reset collapses everything in the view
+    bool expanded[GCUserModel::LastGroupRole];
+    for (int i = 0; i < GCUserModel::LastGroupRole; i++) {
+        expanded[i] = ui_.lv_users->isExpanded(d->usersModel->index(i, 0));
+    }
+    d->usersModel->resetEntries(d->snapshotPresences);
+    d->snapshotPresences.clear();
+    for (int i = 0; i < GCUserModel::LastGroupRole; i++) {
+        ui_.lv_users->setExpanded(d->usersModel->index(i, 0), expanded[i]);
+    }
+}
 
 void GCMainDlg::action_error(MUCManager::Action, int, const QString &err) { appendSysMsg(err, false); }
 
@@ -1504,7 +1572,51 @@ void GCMainDlg::doShowInfo()
     dlg->show();
 }
 
-void GCMainDlg::doClear() { ui_.log->clear(); }
+void GCMainDlg::doClear()
+{
+    d->hibernatedLog.clear();
+    ui_.log->clear();
+}
+
+void GCMainDlg::logMessage(const MessageView &mv)
+{
+    if (d->hibernated)
+        d->hibernatedLog.append(mv);
+    else
+        ui_.log->dispatchMessage(mv);
+}
+
+void GCMainDlg::hibernate()
+{
+    if (d->hibernated || isActiveTab())
+        return;
+    d->hibernated = true;
+
+    // the model goes on without a view to notify
+    for (int i = 0; i < GCUserModel::LastGroupRole; i++) {
+        d->usersExpanded[i] = ui_.lv_users->isExpanded(d->usersModel->index(i, 0));
+    }
+    ui_.lv_users->setModel(nullptr);
+}
+
+void GCMainDlg::wakeUp()
+{
+    if (!d->hibernated)
+        return;
+    d->hibernated = false;
+
+    ui_.lv_users->setModel(d->usersModel);
+    for (int i = 0; i < GCUserModel::LastGroupRole; i++) {
+        ui_.lv_users->setExpanded(d->usersModel->index(i, 0), d->usersExpanded[i]);
+    }
+
+    ui_.log->beginMessageBatch();
+    for (const MessageView &mv : qAsConst(d->hibernatedLog)) {
+        ui_.log->dispatchMessage(mv);
+    }
+    ui_.log->endMessageBatch();
+    d->hibernatedLog.clear();
+}
 
 void GCMainDlg::doClearButton()
 {
@@ -1701,9 +1813,7 @@ void GCMainDlg::pa_updatedActivity()
         if (d->state == Private::Idle) {
             goConn();
         } else if (d->state == Private::Connected) {
-            Status s = account()->status();
-            s.setXSigned("");
-            account()->groupChatSetStatus(jid().domain(), jid().node(), s);
+            account()->groupChatQueueStatus(jid());
         }
     }
 }
@@ -1773,6 +1883,20 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
     }
 
     bool isSelf = (nick == d->self);
+    if (d->snapshot) {
+        if (isSelf) {
+            flushSnapshot();
+        } else {
+            // no join lines for those who were in the room before us
+            if (s.isAvailable()) {
+                d->snapshotPresences.insert(nick, s);
+            } else {
+                d->snapshotPresences.remove(nick);
+            }
+            occupantUpdated(nick, s);
+            return;
+        }
+    }
     if (isSelf) {
         if (!d->gcSelfPresenceSupported && !d->gcSelfAvatarRequested) {
             d->gcSelfAvatarRequested = true;
@@ -1800,6 +1924,13 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
 
     PsiOptions *options_ = PsiOptions::instance();
 
+    // read for every occupant presence, a big room floods them on join
+    static const auto showJoins          = PsiOptions::handle<bool>("options.muc.show-joins");
+    static const auto showInitialJoins   = PsiOptions::handle<bool>("options.ui.muc.show-initial-joins");
+    static const auto showRoleAff        = PsiOptions::handle<bool>("options.muc.show-role-affiliation");
+    static const auto showStatus         = PsiOptions::handle<bool>("options.muc.show-status-changes");
+    static const auto statusWithPriority = PsiOptions::handle<bool>("options.ui.muc.status-with-priority");
+
     if (s.isAvailable()) {
         // Available
         if (s.getMUCStatuses().contains(201)) {
@@ -1818,10 +1949,9 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
             // ChatViewCommon::Participant);
 
             MessageView mv(MessageView::MUCJoin);
-            if ((!d->connecting || options_->getOption("options.ui.muc.show-initial-joins").toBool())
-                && options_->getOption("options.muc.show-joins").toBool()) {
+            if ((!d->connecting || showInitialJoins) && showJoins) {
                 QString message = tr("%1 has joined the room");
-                if (options_->getOption("options.muc.show-role-affiliation").toBool()) {
+                if (showRoleAff) {
                     if (s.mucItem().role() != MUCItem::NoRole) {
                         if (s.mucItem().affiliation() != MUCItem::NoAffiliation) {
                             message = tr("%3 has joined the room as %1 and %2")
@@ -1842,7 +1972,7 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
                     message = message.arg(nick);
                 }
 
-                bool showStatusChanges = options_->getOption("options.muc.show-status-changes").toBool();
+                bool showStatusChanges = showStatus;
                 if (showStatusChanges) {
                     message += tr(" and now is %1").arg(status2txt(s.type()));
                 }
@@ -1858,7 +1988,7 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
             dispatchMessage(mv);
         } else {
             // Status change
-            if (!d->connecting && options_->getOption("options.muc.show-role-affiliation").toBool()) {
+            if (!d->connecting && showRoleAff) {
                 QString message;
                 QString reason;
                 if (contact->status.mucItem().role() != s.mucItem().role() && s.mucItem().role() != MUCItem::NoRole) {
@@ -1884,11 +2014,10 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
                     appendSysMsg(message);
                 }
             }
-            if (!d->connecting && options_->getOption("options.muc.show-status-changes").toBool()) {
-                bool statusWithPriority = options_->getOption("options.ui.muc.status-with-priority").toBool();
+            if (!d->connecting && showStatus) {
                 if (s.status() != contact->status.status() || s.show() != contact->status.show()
                     || (statusWithPriority && s.priority() != contact->status.priority())) {
-                    ui_.log->dispatchMessage(MessageView::statusMessage(nick, int(s.type()), s.status(), s.priority()));
+                    logMessage(MessageView::statusMessage(nick, int(s.type()), s.status(), s.priority()));
                 }
             }
         }
@@ -1973,7 +2102,7 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
             suppressDefault = true;
         }
 
-        if (!d->connecting && !suppressDefault && options_->getOption("options.muc.show-joins").toBool()) {
+        if (!d->connecting && !suppressDefault && showJoins) {
             if (s.getMUCStatuses().contains(303)) {
                 message = tr("%1 is now known as %2").arg(nick, s.mucItem().nick());
                 d->usersModel->updateEntry(s.mucItem().nick(), s);
@@ -1994,6 +2123,11 @@ void GCMainDlg::presence(const QString &nick, const Status &s)
         d->usersModel->removeEntry(nick);
     }
 
+    occupantUpdated(nick, s);
+}
+
+void GCMainDlg::occupantUpdated(const QString &nick, const Status &s)
+{
     if (s.caps().isValid()) {
         Jid caps_jid(s.mucItem().jid().isEmpty() || !d->nonAnonymous ? Jid(jid()).withResource(nick)
                                                                      : s.mucItem().jid());
@@ -2069,11 +2203,11 @@ void GCMainDlg::message(const Message &_m, const PsiEvent::Ptr &e)
     }
 
     if (!topic.isNull()) {
-        QString subjectTooltip = TextUtil::plain2rich(topic);
-        subjectTooltip         = TextUtil::linkify(subjectTooltip);
+        int flags = TextUtil::FormatLinks;
         if (options->getOption("options.ui.emoticons.use-emoticons").toBool()) {
-            subjectTooltip = TextUtil::emoticonify(subjectTooltip);
+            flags |= TextUtil::FormatEmoticons;
         }
+        QString subjectTooltip = TextUtil::formatPlain(topic, flags);
 
         QString sysMsg;
         if (from.isEmpty()) {
@@ -2142,8 +2276,48 @@ void GCMainDlg::message(const Message &_m, const PsiEvent::Ptr &e)
         auto mv = MessageView::systemMessage(m.body());
         mv.setDateTime(m.timeStamp());
         dispatchMessage(mv);
-    } else
+    } else if (m.spooled() && d->connecting) {
+        d->replay.append(qMakePair(m, d->alert));
+        d->replayTimer.start();
+    } else {
+        rememberMessage(m);
         appendMessage(m, d->alert);
+    }
+}
+
+// returns false if the message was shown already
+bool GCMainDlg::rememberMessage(const Message &m)
+{
+    QString key = m.from().resource() + QLatin1Char('\n') + m.id() + QLatin1Char('\n') + m.body();
+    if (d->shownMessages.contains(key))
+        return false;
+    d->shownMessages.insert(key);
+    d->shownOrder.enqueue(key);
+    if (d->shownOrder.size() > SHOWN_MESSAGES_MAX)
+        d->shownMessages.remove(d->shownOrder.dequeue());
+    return true;
+}
+
+void GCMainDlg::flushReplay()
+{
+    d->replayTimer.stop();
+    if (d->replay.isEmpty())
+        return;
+    const auto replay = std::move(d->replay);
+    d->replay.clear();
+
+    // on rejoin the room replays what we've got before disconnect
+    int pending  = d->pending;
+    d->replaying = true;
+    ui_.log->beginMessageBatch();
+    for (const auto &r : replay) {
+        if (rememberMessage(r.first))
+            appendMessage(r.first, r.second);
+    }
+    ui_.log->endMessageBatch();
+    d->replaying = false;
+    if (d->pending != pending)
+        updatePending();
 }
 
 void GCMainDlg::joined()
@@ -2177,10 +2351,12 @@ void GCMainDlg::appendSysMsg(const QString &str, bool alert)
 
 void GCMainDlg::dispatchMessage(const MessageView &mv)
 {
+    if (!d->replaying)
+        flushReplay(); // keep the order
     if (d->trackBar && !mv.isLocal() && !mv.isSpooled())
         d->doTrackBar();
 
-    ui_.log->dispatchMessage(mv);
+    logMessage(mv);
     if (mv.isAlert())
         doAlert();
 }
@@ -2237,12 +2413,8 @@ void GCMainDlg::appendMessage(const Message &m, bool alert)
         ++d->pending;
         if (alert)
             ++d->hPending;
-        UserListItem *u = account()->find(d->dlg->jid().bare());
-        if (u) {
-            u->setPending(d->pending, d->hPending);
-            account()->updateEntry(*u);
-        }
-        invalidateTab();
+        if (!d->replaying)
+            updatePending();
     }
 
     // if the message spoke to us, alert the user before closing this window
@@ -2254,6 +2426,16 @@ void GCMainDlg::appendMessage(const Message &m, bool alert)
     emit messageAppended(m.body(), ui_.log->textWidget());
 }
 
+void GCMainDlg::updatePending()
+{
+    UserListItem *u = account()->find(d->dlg->jid().bare());
+    if (u) {
+        u->setPending(d->pending, d->hPending);
+        account()->updateEntry(*u);
+    }
+    invalidateTab();
+}
+
 void GCMainDlg::doAlert()
 {
     if (!isActiveTab())
@@ -167,6 +167,15 @@ private:
 
     inline XMPP::Jid jidForNick(const QString &nick) const;
 
+    void occupantUpdated(const QString &nick, const Status &s);
+    void flushSnapshot();
+    bool rememberMessage(const Message &m);
+    void flushReplay();
+    void updatePending();
+    void logMessage(const MessageView &mv);
+    void hibernate();
+    void wakeUp();
+
     void setMucSelfAvatar();
 };
 
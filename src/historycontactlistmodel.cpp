@@ -25,10 +25,26 @@
 #include "psicontact.h"
 #include "psiiconset.h"
 
+#include <QTimer>
+
+// contacts found in the history, by account and type, kept for the next opening of the dialog
+static QHash<QString, QList<EDB::ContactItem>> &historyContactsCache()
+{
+    static QHash<QString, QList<EDB::ContactItem>> cache;
+    return cache;
+}
+
+static QString historyContactsKey(const QString &accId, int type) { return QString::number(type) + '|' + accId; }
+
 HistoryContactListModel::HistoryContactListModel(QObject *parent) :
     QAbstractItemModel(parent), rootItem(nullptr), generalGroup(nullptr), notInList(nullptr), confPrivate(nullptr),
-    dispPrivateContacts(false), dispAllContacts(false)
+    dispPrivateContacts(false), dispAllContacts(false), psi_(nullptr)
 {
+    // after the dialog is shown, the history queries take long on a big database
+    historyTimer_ = new QTimer(this);
+    historyTimer_->setSingleShot(true);
+    historyTimer_->setInterval(0);
+    connect(historyTimer_, &QTimer::timeout, this, &HistoryContactListModel::loadHistoryContacts);
 }
 
 HistoryContactListModel::~HistoryContactListModel() { delete rootItem; }
@@ -40,6 +56,7 @@ void HistoryContactListModel::clear()
     generalGroup = nullptr;
     notInList    = nullptr;
     confPrivate  = nullptr;
+    ids_.clear();
 }
 
 void HistoryContactListModel::updateContacts(PsiCon *psi, const QString &id)
@@ -73,10 +90,15 @@ QVariant HistoryContactListModel::data(const QModelIndex &index, int role) const
     TreeItem *item = static_cast<TreeItem *>(index.internalPointer());
     switch (role) {
     case Qt::DisplayRole:
+        if (item->type() == Group)
+            return QString("%1 (%2)").arg(item->text()).arg(item->childCount());
+        return item->text();
     case Qt::ToolTipRole:
         if (item->type() == Group)
-            return QString("%1 (%2)").arg(item->text(false)).arg(item->childCount());
-        return item->text(role == Qt::ToolTipRole);
+            return QString("%1 (%2)").arg(item->text()).arg(item->childCount());
+        if (item->type() == Other)
+            return item->text();
+        return makeContactToolTip(item);
     case Qt::DecorationRole:
         if (item->type() == RosterContact)
             return PsiIconset::instance()->statusPtr(item->id().section('|', 1, 1), Status::Online)->icon();
@@ -136,6 +158,14 @@ QModelIndex HistoryContactListModel::parent(const QModelIndex &child) const
 
 void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
 {
+    psi_   = psi;
+    accId_ = acc_id;
+    if (!psi->edb()->property("historyContactsWatched").toBool()) {
+        // erased history takes its contacts along, the cache is filled again on the next opening
+        connect(psi->edb(), &EDB::erasing, psi->edb(), []() { historyContactsCache().clear(); });
+        psi->edb()->setProperty("historyContactsWatched", true);
+    }
+
     rootItem     = new TreeItem(Root, QString());
     generalGroup = new TreeItem(Group, tr("General"), "general", -1);
     rootItem->appendChild(generalGroup);
@@ -145,14 +175,13 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
         contactList = psi->contactList()->contacts();
     else
         contactList = psi->contactList()->getAccount(acc_id)->contactList();
-    QHash<QString, bool>       c_list;
     QHash<QString, TreeItem *> groups;
     // Roster contacts
     for (PsiContact *contact : qAsConst(contactList)) {
         if (contact->isConference() || contact->isPrivate())
             continue;
         QString cId = contact->account()->id() + "|" + contact->jid().bare();
-        if (c_list.value(cId))
+        if (ids_.contains(cId))
             continue;
 
         TreeItem *groupItem = nullptr;
@@ -169,57 +198,76 @@ void HistoryContactListModel::loadContacts(PsiCon *psi, const QString &acc_id)
             if (!groupItem)
                 groupItem = generalGroup;
         }
-        QString tooltipStr = makeContactToolTip(psi, acc_id, contact->jid(), true);
         if (groupItem)
-            groupItem->appendChild(new TreeItem(RosterContact, contact->name(), tooltipStr, cId));
-        c_list[cId] = true;
+            groupItem->appendChild(new TreeItem(RosterContact, contact->name(), cId));
+        ids_.insert(cId);
     }
     // Self contact
     for (PsiAccount *pa : psi->contactList()->accounts()) {
         if (acc_id.isEmpty() || pa->id() == acc_id) {
             PsiContact *self = pa->selfContact();
             QString     cId  = pa->id() + "|" + self->jid().bare();
-            if (c_list.value(cId))
+            if (ids_.contains(cId))
                 continue;
 
-            QString tooltipStr = makeContactToolTip(psi, acc_id, self->jid(), true);
-            generalGroup->appendChild(new TreeItem(RosterContact, self->name(), tooltipStr, cId));
-            c_list[cId] = true;
+            generalGroup->appendChild(new TreeItem(RosterContact, self->name(), cId));
+            ids_.insert(cId);
             if (!acc_id.isEmpty())
                 break;
         }
     }
-    // Not in roster list
-    const auto &cis = psi->edb()->contacts(acc_id, EDB::Contact);
-    for (const EDB::ContactItem &ci : cis) {
-        QString cId = ci.accId + "|" + ci.jid.bare();
-        if (c_list.value(cId))
-            continue;
+    // Not in roster list and private messages, as found last time. the history is asked again later
+    mergeHistoryContacts(historyContactsCache().value(historyContactsKey(acc_id, EDB::Contact)), EDB::Contact, false);
+    if (dispPrivateContacts)
+        mergeHistoryContacts(historyContactsCache().value(historyContactsKey(acc_id, EDB::GroupChatContact)),
+                             EDB::GroupChatContact, false);
+    if (dispAllContacts) {
+        QString s = tr("All contacts");
+        rootItem->appendChild(new TreeItem(Other, s, "*all", 12));
+    }
+    historyTimer_->start();
+}
 
-        if (!notInList) {
-            notInList = new TreeItem(Group, tr("Not in list"), "not-in-list", 10);
-            rootItem->appendChild(notInList);
-        }
-        QString tooltipStr = makeContactToolTip(psi, acc_id, ci.jid, true);
-        notInList->appendChild(new TreeItem(NotInRosterContact, ci.jid.bare(), tooltipStr, cId));
-        c_list[cId] = true;
+void HistoryContactListModel::loadHistoryContacts()
+{
+    if (!rootItem || !psi_)
+        return;
+    QList<int> types { EDB::Contact };
+    if (dispPrivateContacts)
+        types += EDB::GroupChatContact;
+    for (int type : types) {
+        const QList<EDB::ContactItem> items = psi_->edb()->contacts(accId_, type);
+        historyContactsCache().insert(historyContactsKey(accId_, type), items);
+        mergeHistoryContacts(items, type, true);
     }
-    // Private messages
-    if (dispPrivateContacts) {
-        const auto &cis = psi->edb()->contacts(acc_id, EDB::GroupChatContact);
-        for (const EDB::ContactItem &ci : cis) {
-            if (!confPrivate) {
-                confPrivate = new TreeItem(Group, tr("Private messages"), "conf-private", 11);
-                rootItem->appendChild(confPrivate);
-            }
-            QString cId        = ci.accId + "|" + ci.jid.full();
-            QString tooltipStr = makeContactToolTip(psi, acc_id, ci.jid, false);
-            confPrivate->appendChild(new TreeItem(NotInRosterContact, ci.jid.resource(), tooltipStr, cId));
+    emit historyContactsLoaded();
+}
+
+// adds the contacts not in the tree yet, \a notify when the model is shown already
+void HistoryContactListModel::mergeHistoryContacts(const QList<EDB::ContactItem> &items, int type, bool notify)
+{
+    const bool priv  = type == EDB::GroupChatContact;
+    TreeItem *&group = priv ? confPrivate : notInList;
+    for (const EDB::ContactItem &ci : items) {
+        QString cId = ci.accId + "|" + (priv ? ci.jid.full() : ci.jid.bare());
+        if (ids_.contains(cId))
+            continue;
+
+        if (!group) {
+            group = priv ? new TreeItem(Group, tr("Private messages"), "conf-private", 11)
+                         : new TreeItem(Group, tr("Not in list"), "not-in-list", 10);
+            if (notify)
+                beginInsertRows(QModelIndex(), rootItem->childCount(), rootItem->childCount());
+            rootItem->appendChild(group);
+            if (notify)
+                endInsertRows();
         }
-    }
-    if (dispAllContacts) {
-        QString s = tr("All contacts");
-        rootItem->appendChild(new TreeItem(Other, s, s, "*all", 12));
+        if (notify)
+            beginInsertRows(createIndex(group->row(), 0, group), group->childCount(), group->childCount());
+        group->appendChild(new TreeItem(NotInRosterContact, priv ? ci.jid.resource() : ci.jid.bare(), cId));
+        if (notify)
+            endInsertRows();
+        ids_.insert(cId);
     }
 }
 
@@ -247,11 +295,12 @@ bool HistoryContactListModel::removeRows(int row, int count, const QModelIndex &
     return true;
 }
 
-QString HistoryContactListModel::makeContactToolTip(PsiCon *psi, const QString &accId, const XMPP::Jid &jid,
-                                                    bool bare) const
+// built when the view asks, most of them are never shown
+QString HistoryContactListModel::makeContactToolTip(const TreeItem *item) const
 {
-    PsiAccount *pa = psi->contactList()->getAccount(accId);
-    return QString("%1 [%2]").arg(JIDUtil::toString(jid, !bare), (pa) ? pa->name() : tr("deleted"));
+    const XMPP::Jid jid(item->id().section('|', 1));
+    PsiAccount *    pa = psi_ ? psi_->contactList()->getAccount(accId_) : nullptr;
+    return QString("%1 [%2]").arg(JIDUtil::toString(jid, !jid.resource().isEmpty()), (pa) ? pa->name() : tr("deleted"));
 }
 
 HistoryContactListModel::TreeItem::TreeItem(ItemType type, const QString &text, const QString &id, int pos) :
@@ -259,13 +308,6 @@ HistoryContactListModel::TreeItem::TreeItem(ItemType type, const QString &text,
 {
 }
 
-HistoryContactListModel::TreeItem::TreeItem(ItemType type, const QString &text, const QString &tooltip,
-                                            const QString &id, int pos) :
-    _parent(nullptr),
-    _type(type), _text(text), _tooltip(tooltip), _id(id), _position(pos)
-{
-}
-
 HistoryContactListModel::TreeItem::~TreeItem() { qDeleteAll(child_items); }
 
 void HistoryContactListModel::TreeItem::appendChild(TreeItem *item)
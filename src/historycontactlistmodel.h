@@ -20,11 +20,15 @@
 #ifndef HISTORYCONTACTLISTMODEL_H
 #define HISTORYCONTACTLISTMODEL_H
 
+#include "eventdb.h"
 #include "psicon.h"
 
 #include <QAbstractItemModel>
+#include <QSet>
 #include <QSortFilterProxyModel>
 
+class QTimer;
+
 class HistoryContactListModel : public QAbstractItemModel {
     Q_OBJECT
 
@@ -47,11 +51,14 @@ public:
     QModelIndex   parent(const QModelIndex &child) const;
     bool          removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
 
+signals:
+    // the contacts known only from the history were merged in
+    void historyContactsLoaded();
+
 private:
     class TreeItem {
     public:
         TreeItem(ItemType type, const QString &text, const QString &id = QString(), int pos = 0);
-        TreeItem(ItemType type, const QString &text, const QString &tooltip, const QString &id, int pos = 0);
         ~TreeItem();
         void      appendChild(TreeItem *item);
         void      removeChild(int row);
@@ -62,13 +69,12 @@ private:
         ItemType  type() const { return _type; }
         QString   id() const { return _id; }
         int       position() const { return _position; }
-        QString   text(bool tooltip = false) const { return tooltip ? _tooltip : _text; }
+        QString   text() const { return _text; }
 
     private:
         TreeItem *        _parent;
         ItemType          _type;
         QString           _text;
-        QString           _tooltip;
         QString           _id;
         int               _position;
         QList<TreeItem *> child_items;
@@ -76,13 +82,20 @@ private:
 
 private:
     void      loadContacts(PsiCon *psi, const QString &acc_id);
-    QString   makeContactToolTip(PsiCon *psi, const QString &accId, const Jid &jid, bool bare) const;
+    void      loadHistoryContacts();
+    void      mergeHistoryContacts(const QList<EDB::ContactItem> &items, int type, bool notify);
+    QString   makeContactToolTip(const TreeItem *item) const;
     TreeItem *rootItem;
     TreeItem *generalGroup;
     TreeItem *notInList;
     TreeItem *confPrivate;
     bool      dispPrivateContacts;
     bool      dispAllContacts;
+
+    PsiCon *      psi_;
+    QString       accId_;
+    QSet<QString> ids_; // contacts in the tree
+    QTimer *      historyTimer_;
 };
 
 class HistoryContactListProxyModel : public QSortFilterProxyModel {
@@ -22,6 +22,7 @@
 #include "coloropt.h"
 #include "common.h"
 #include "fileutil.h"
+#include "historyexport.h"
 #include "jidutil.h"
 #include "psiaccount.h"
 #include "psicon.h"
@@ -37,68 +38,19 @@
 #include <QMessageBox>
 #include <QProgressDialog>
 #include <QScrollBar>
+#include <QStringMatcher>
 #include <QTextBlock>
+#include <QTimer>
 
 #define SEARCH_PADDING_SIZE 20
 #define DISPLAY_PAGE_SIZE 200
+// typing pause before the search text is highlighted, milliseconds
+#define HIGHLIGHT_DELAY 150
+// highlights shown at most, the visible ones first
+#define HIGHLIGHT_MAX_HITS 1000
 
 static const QString geometryOption = "options.ui.history.size";
 
-static QString getNext(QString *str)
-{
-    int n = 0;
-    // skip leading spaces (but *do* return them later!)
-    while (n < int(str->length()) && str->at(n).isSpace()) {
-        ++n;
-    }
-    if (n == int(str->length())) {
-        return QString();
-    }
-    // find end or next space
-    while (n < int(str->length()) && !str->at(n).isSpace()) {
-        ++n;
-    }
-    QString result = str->mid(0, n);
-    *str           = str->mid(n);
-    return result;
-}
-
-// wraps a string against a fixed width
-static QStringList wrapString(const QString &str, int wid)
-{
-    QStringList lines;
-    QString     cur;
-    QString     tmp = str;
-    // printf("parsing: [%s]\n", tmp.latin1());
-    while (1) {
-        QString word = getNext(&tmp);
-        if (word == QString()) {
-            lines += cur;
-            break;
-        }
-        // printf("word:[%s]\n", word.latin1());
-        if (!cur.isEmpty()) {
-            if (int(cur.length()) + int(word.length()) > wid) {
-                lines += cur;
-                cur = "";
-            }
-        }
-        if (cur.isEmpty()) {
-            // trim the whitespace in front
-            for (int n = 0; n < int(word.length()); ++n) {
-                if (!word.at(n).isSpace()) {
-                    if (n > 0) {
-                        word = word.mid(n);
-                    }
-                    break;
-                }
-            }
-        }
-        cur += word;
-    }
-    return lines;
-}
-
 SearchProxy::SearchProxy(PsiCon *p, DisplayProxy *d) : QObject(nullptr), active(false)
 {
     psi = p;
@@ -287,6 +239,8 @@ void DisplayProxy::displayEarliest(const QString &acc_id, const Jid &jid)
 {
     acc_ = acc_id;
     jid_ = jid;
+    pageIds.first.clear();
+    pageIds.last.clear();
     resetSearch();
     updateQueryParams(EDB::Forward, 0);
     reqType = ReqEarliest;
@@ -297,6 +251,8 @@ void DisplayProxy::displayLatest(const QString &acc_id, const Jid &jid)
 {
     acc_ = acc_id;
     jid_ = jid;
+    pageIds.first.clear();
+    pageIds.last.clear();
     resetSearch();
     updateQueryParams(EDB::Backward, 0);
     reqType = ReqLatest;
@@ -307,6 +263,8 @@ void DisplayProxy::displayFromDate(const QString &acc_id, const Jid &jid, const
 {
     acc_ = acc_id;
     jid_ = jid;
+    pageIds.first.clear();
+    pageIds.last.clear();
     resetSearch();
     updateQueryParams(EDB::Forward, 0, date);
     reqType = ReqDate;
@@ -318,7 +276,11 @@ void DisplayProxy::displayNext()
     resetSearch();
     updateQueryParams(EDB::Forward, DISPLAY_PAGE_SIZE);
     reqType = ReqNext;
-    getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset, DISPLAY_PAGE_SIZE);
+    if (!pageIds.last.isEmpty())
+        getEDBHandle()->getFrom(acc_, jid_, pageIds.last, EDB::Forward, DISPLAY_PAGE_SIZE);
+    else
+        getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset,
+                            DISPLAY_PAGE_SIZE);
 }
 
 void DisplayProxy::displayPrevious()
@@ -326,7 +288,11 @@ void DisplayProxy::displayPrevious()
     resetSearch();
     updateQueryParams(EDB::Backward, DISPLAY_PAGE_SIZE);
     reqType = ReqPrevious;
-    getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset, DISPLAY_PAGE_SIZE);
+    if (!pageIds.first.isEmpty())
+        getEDBHandle()->getFrom(acc_, jid_, pageIds.first, EDB::Backward, DISPLAY_PAGE_SIZE);
+    else
+        getEDBHandle()->get(acc_, jid_, queryParams.date, queryParams.direction, queryParams.offset,
+                            DISPLAY_PAGE_SIZE);
 }
 
 bool DisplayProxy::moveSearchCursor(int dir, int n)
@@ -385,6 +351,8 @@ void DisplayProxy::displayWithSearchCursor(const QString &acc_id, const Jid &jid
 {
     acc_ = acc_id;
     jid_ = jid;
+    pageIds.first.clear();
+    pageIds.last.clear();
 
     searchParams.searchDir    = dir;
     searchParams.searchPos    = num;
@@ -520,6 +488,8 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
         i = r.count() - 1;
         d = -1;
     }
+    pageIds.first = r.value(i)->id();
+    pageIds.last  = r.value(r.count() - 1 - i)->id();
 
     PsiAccount *acc = nullptr;
     if ((psi->edb()->features() & EDB::SeparateAccounts) == 0) {
@@ -527,6 +497,12 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
         Q_ASSERT(acc);
     }
 
+    int formatFlags = TextUtil::FormatLinks;
+    if (emoticons)
+        formatFlags |= TextUtil::FormatEmoticons;
+    if (formatting)
+        formatFlags |= TextUtil::FormatLegacy;
+
     bool fAllContacts = jid_.isEmpty();
     while (i >= 0 && i < r.count()) {
         EDBItemPtr    item = r.value(i);
@@ -535,13 +511,7 @@ void DisplayProxy::displayResult(const EDBResult &r, int dir)
             PsiAccount *      pa   = (acc) ? acc : e->account();
             QString           from = getNick(e->account(), e->from());
             MessageEvent::Ptr me   = e.staticCast<MessageEvent>();
-            QString           msg  = me->message().body();
-            msg                    = TextUtil::linkify(TextUtil::plain2rich(msg));
-
-            if (emoticons)
-                msg = TextUtil::emoticonify(msg);
-            if (formatting)
-                msg = TextUtil::legacyFormat(msg);
+            QString           msg  = TextUtil::formatPlain(me->message().body(), formatFlags);
 
             if (me->originLocal()) {
                 QString nick = (pa) ? TextUtil::plain2rich(pa->nick()) : tr("deleted");
@@ -578,9 +548,11 @@ QString DisplayProxy::getNick(PsiAccount *pa, const Jid &jid) const
 
 class HistoryDlg::Private {
 public:
-    Jid         jid;
-    PsiAccount *pa;
-    PsiCon *    psi;
+    Jid            jid;
+    PsiAccount *   pa;
+    PsiCon *       psi;
+    HistoryExport *exporter       = nullptr;
+    QTimer *       highlightTimer = nullptr;
 #ifndef Q_OS_LINUX
     bool autoCopyText;
 #endif
@@ -628,7 +600,11 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa) :
     ui_.calendar->setFirstDayOfWeek(QLocale().firstDayOfWeek());
 
     connect(ui_.searchField, SIGNAL(returnPressed()), SLOT(findMessages()));
-    connect(ui_.searchField, SIGNAL(textChanged(const QString)), SLOT(highlightBlocks()));
+    d->highlightTimer = new QTimer(this);
+    d->highlightTimer->setSingleShot(true);
+    d->highlightTimer->setInterval(HIGHLIGHT_DELAY);
+    connect(d->highlightTimer, SIGNAL(timeout()), SLOT(highlightBlocks()));
+    connect(ui_.searchField, SIGNAL(textChanged(const QString)), d->highlightTimer, SLOT(start()));
     connect(ui_.buttonPrevious, SIGNAL(released()), SLOT(getPrevious()));
     connect(ui_.buttonNext, SIGNAL(released()), SLOT(getNext()));
     connect(ui_.buttonRefresh, SIGNAL(released()), SLOT(refresh()));
@@ -664,6 +640,8 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa) :
         _contactListModel->displayPrivateContacts((f & EDB::PrivateContacts) != 0);
         _contactListModel->displayAllContacts((f & EDB::AllContacts) != 0);
     }
+    connect(_contactListModel, &HistoryContactListModel::historyContactsLoaded, this,
+            &HistoryDlg::historyContactsLoaded);
     _contactListModel->updateContacts(pa->psi(), getCurrentAccountId());
     selectContact(d->pa->id(), d->jid);
     openSelectedContact();
@@ -679,6 +657,7 @@ HistoryDlg::HistoryDlg(const Jid &jid, PsiAccount *pa) :
 
 HistoryDlg::~HistoryDlg()
 {
+    delete d->exporter;
     delete d;
     delete searchProxy;
     delete displayProxy;
@@ -861,33 +840,50 @@ void HistoryDlg::openSelectedContact()
 
 void HistoryDlg::highlightBlocks()
 {
-    const QString text   = ui_.searchField->text();
-    QTextCursor   cur    = ui_.msgLog->textCursor();
-    QTextCursor   old    = cur;
-    int           sc_pos = 0;
-    if (ui_.msgLog->verticalScrollBar())
-        sc_pos = ui_.msgLog->verticalScrollBar()->value();
-    cur.clearSelection();
-    cur.movePosition(QTextCursor::Start);
-    ui_.msgLog->setTextCursor(cur);
+    d->highlightTimer->stop();
 
     QList<QTextEdit::ExtraSelection> extras;
-    QTextEdit::ExtraSelection        highlight;
+    const QString                    text = ui_.searchField->text();
+    if (text.isEmpty()) {
+        ui_.msgLog->setExtraSelections(extras);
+        return;
+    }
+
+    QTextEdit::ExtraSelection highlight;
     highlight.format.setBackground(Qt::yellow);
-    highlight.cursor = ui_.msgLog->textCursor();
-
-    bool found = ui_.msgLog->find(text);
-    while (found) {
-        highlight.cursor = ui_.msgLog->textCursor();
-        if (displayProxy->isMessage(highlight.cursor))
-            extras << highlight;
-        found = ui_.msgLog->find(text);
+    const QStringMatcher matcher(text, Qt::CaseInsensitive);
+
+    auto markBlock = [&](const QTextBlock &block) {
+        const QString blockText = block.text();
+        // like DisplayProxy::isMessage(), hits in the timestamp and the nickname don't count
+        const int nickEnd = blockText.indexOf("> ");
+        if (nickEnd == -1)
+            return;
+        int pos = matcher.indexIn(blockText, 0);
+        while (pos != -1 && extras.size() < HIGHLIGHT_MAX_HITS) {
+            const int end = pos + text.length();
+            if (end > 22 && nickEnd + 2 <= end - 1) {
+                highlight.cursor = QTextCursor(block);
+                highlight.cursor.setPosition(block.position() + pos);
+                highlight.cursor.setPosition(block.position() + end, QTextCursor::KeepAnchor);
+                extras << highlight;
+            }
+            pos = matcher.indexIn(blockText, end);
+        }
+    };
+
+    // the visible blocks first, so the cap never hides what's on the screen
+    QTextDocument *  doc   = ui_.msgLog->document();
+    const QTextBlock first = ui_.msgLog->cursorForPosition(QPoint(0, 0)).block();
+    const QTextBlock last  = ui_.msgLog->cursorForPosition(QPoint(0, ui_.msgLog->viewport()->height() - 1)).block();
+    for (QTextBlock b = first; b.isValid() && b.blockNumber() <= last.blockNumber(); b = b.next())
+        markBlock(b);
+    for (QTextBlock b = doc->begin(); b.isValid() && extras.size() < HIGHLIGHT_MAX_HITS; b = b.next()) {
+        if (b.blockNumber() < first.blockNumber() || b.blockNumber() > last.blockNumber())
+            markBlock(b);
     }
 
     ui_.msgLog->setExtraSelections(extras);
-    ui_.msgLog->setTextCursor(old);
-    if (ui_.msgLog->verticalScrollBar())
-        ui_.msgLog->verticalScrollBar()->setValue(sc_pos);
 }
 
 void HistoryDlg::findMessages()
@@ -927,124 +923,71 @@ void HistoryDlg::openChat()
 
 void HistoryDlg::exportHistory()
 {
+    if (d->exporter && d->exporter->isActive())
+        return;
+
     QString       them;
     UserListItem *u = currentUserListItem();
     if (u)
         them = JIDUtil::nickOrJid(u->name(), u->jid().full());
     else
         them = d->jid.full();
-    QString s     = (!them.isEmpty()) ? JIDUtil::encode(them).toLower() : "all_contacts";
-    QString fname = FileUtil::getSaveFileName(this, tr("Export message history"), s + ".txt",
-                                              tr("Text files (*.txt);;All files (*.*)"));
+    const QString textFilter = tr("Text files (*.txt)");
+    const QString jsonFilter = tr("JSON lines (*.jsonl)");
+    const QString xmlFilter  = tr("XML archive (*.xml)");
+    QString       filter;
+    QString       s     = (!them.isEmpty()) ? JIDUtil::encode(them).toLower() : "all_contacts";
+    QString       fname = FileUtil::getSaveFileName(
+        this, tr("Export message history"), s + ".txt",
+        QStringList({ textFilter, jsonFilter, xmlFilter, tr("All files (*.*)") }).join(";;"), &filter);
     if (fname.isEmpty())
         return;
 
-    QFile f(fname);
-    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
-        QMessageBox::information(this, tr("Error"), tr("Error writing to file."));
-        return;
-    }
-    QTextStream stream(&f);
-
-    EDB *   edb = nullptr;
-    QString us;
-    // PsiAccount *pa = nullptr;
-    if (d->pa) {
-        edb = d->pa->edb();
-        us  = d->pa->nick();
-    } else {
-        edb = d->psi->edb();
-        us  = d->psi->contactList()->defaultAccount()->nick();
-    }
-
-    EDBHandle *h;
-    int        start = 0;
-    startRequest();
-    QString paId = getCurrentAccountId();
-    int     max  = 0;
-    {
-        quint64 edbCnt = d->psi->edb()->eventsCount(paId, d->jid);
-        if (edbCnt > 1000) {
-            max = int(edbCnt / 1000);
-            if ((edbCnt % 1000) != 0)
-                ++max;
-            showProgress(max);
-        }
-    }
-    PsiAccount *acc = nullptr;
+    HistoryExport::Params params;
+    params.accId     = getCurrentAccountId();
+    params.jid       = d->jid;
+    params.fileName  = fname;
+    params.theirNick = them;
+    if (filter == jsonFilter)
+        params.format = HistoryExport::JsonLines;
+    else if (filter == xmlFilter)
+        params.format = HistoryExport::XmlArchive;
+    else if (filter == textFilter)
+        params.format = HistoryExport::PlainText;
+    else
+        params.format = HistoryExport::formatForFileName(fname);
     if ((d->psi->edb()->features() & EDB::SeparateAccounts) == 0) {
         Q_ASSERT(d->pa);
-        acc = d->pa;
+        params.ourNick = d->pa->nick();
+    } else {
+        for (PsiAccount *acc : d->psi->contactList()->accounts())
+            params.accountNicks.insert(acc->id(), acc->nick());
+        params.ourNick = tr("deleted");
     }
-    while (1) {
-        h = new EDBHandle(edb);
-        h->get(paId, d->jid, QDateTime(), EDB::Forward, start, 1000);
-        while (h->busy()) {
-            qApp->processEvents();
-        }
-
-        const EDBResult r   = h->result();
-        int             cnt = r.count();
 
-        // events are in forward order
-        for (int i = 0; i < cnt; ++i) {
-            EDBItemPtr    item = r.value(i);
-            PsiEvent::Ptr e(item->event());
-            QString       txt;
-
-            QString ts = QLocale().toString(e->timeStamp(), QLocale::ShortFormat);
-
-            QString nick;
-            if (e->originLocal()) {
-                if (acc)
-                    nick = acc->nick();
-                else if (e->account())
-                    nick = e->account()->nick();
-                else
-                    nick = tr("deleted");
-            } else {
-                if (!them.isEmpty())
-                    nick = them;
-                else
-                    nick = e->from().full();
-            }
-
-            if (e->type() == PsiEvent::Message) {
-                MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-                stream << QString("[%1] <%2>: ").arg(ts, nick) /* << endl*/;
-#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
-                QStringList lines = me->message().body().split('\n', Qt::KeepEmptyParts);
-#else
-                QStringList lines = me->message().body().split('\n', QString::KeepEmptyParts);
-#endif
-                for (const QString &str : lines) {
-                    QStringList sub = wrapString(str, 72);
-                    for (const QString &str2 : sub) {
-                        txt += str2 + "\n" + QString("    ");
-                    }
-                }
-            } else {
-                continue;
-            }
-#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
-            stream << txt << Qt::endl;
-#else
-            stream << txt << endl;
-#endif
-        }
-        delete h;
-
-        if (max > 0)
-            incrementProgress();
+    if (!d->exporter) {
+        d->exporter = new HistoryExport;
+        connect(d->exporter, &HistoryExport::progress, this, &HistoryDlg::exportProgress);
+        connect(d->exporter, &HistoryExport::finished, this, &HistoryDlg::exportFinished);
+    }
+    startRequest();
+    d->exporter->start(params);
+}
 
-        // done!
-        if (cnt == 0)
-            break;
+void HistoryDlg::exportProgress(int done, int total)
+{
+    if (total <= 0)
+        return;
+    if (!ui_.progressBar->isVisible())
+        showProgress(total);
+    ui_.progressBar->setValue(done);
+}
 
-        start += 1000;
-    }
-    f.close();
+void HistoryDlg::exportFinished(bool success)
+{
     stopRequest();
+    if (!success)
+        QMessageBox::information(this, tr("Error"), tr("Error writing to file."));
 }
 
 void HistoryDlg::doMenu()
@@ -1160,6 +1103,14 @@ void HistoryDlg::removedContact(PsiContact *pc)
         resetWidgets();
 }
 
+void HistoryDlg::historyContactsLoaded()
+{
+    ui_.contactList->expandAll();
+    // a contact known only from the history wasn't in the list when the dialog opened
+    if (!ui_.contactList->selectionModel()->currentIndex().isValid() && d->pa && selectContact(d->pa->id(), d->jid))
+        openSelectedContact();
+}
+
 void HistoryDlg::optionUpdated(const QString &option)
 {
 #ifndef Q_OS_LINUX
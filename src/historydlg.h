@@ -130,6 +130,10 @@ private:
         int     searchDir;
         QString searchString;
     } searchParams;
+    struct {
+        QString first;
+        QString last;
+    } pageIds; // ids of the oldest and the newest displayed items
     enum RequestType { ReqNone, ReqDate, ReqEarliest, ReqLatest, ReqNext, ReqPrevious };
     RequestType  reqType;
     PsiCon *     psi;
@@ -163,9 +167,12 @@ private slots:
     void changeAccount(const QString accountName);
     void removeHistory();
     void exportHistory();
+    void exportProgress(int done, int total);
+    void exportFinished(bool success);
     void openChat();
     void doMenu();
     void removedContact(PsiContact *);
+    void historyContactsLoaded();
     void optionUpdated(const QString &option);
     void autoCopy();
     void viewUpdated();
@@ -0,0 +1,372 @@
+/*
+ * historyexport.cpp - streaming export of the SQLite history
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "historyexport.h"
+
+#include "applicationinfo.h"
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLocale>
+#include <QSaveFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTextStream>
+#include <QThread>
+#include <QXmlStreamWriter>
+
+// progress is reported once per this many rows
+#define EXPORT_PROGRESS_STEP 1000
+
+enum { ColDate, ColType, ColDirection, ColSubject, ColText, ColExtraData, ColResource, ColJid, ColAccId, ColContactId };
+
+static QString getNext(QString *str)
+{
+    int n = 0;
+    // skip leading spaces (but *do* return them later!)
+    while (n < int(str->length()) && str->at(n).isSpace()) {
+        ++n;
+    }
+    if (n == int(str->length())) {
+        return QString();
+    }
+    // find end or next space
+    while (n < int(str->length()) && !str->at(n).isSpace()) {
+        ++n;
+    }
+    QString result = str->mid(0, n);
+    *str           = str->mid(n);
+    return result;
+}
+
+// wraps a string against a fixed width
+static QStringList wrapString(const QString &str, int wid)
+{
+    QStringList lines;
+    QString     cur;
+    QString     tmp = str;
+    while (1) {
+        QString word = getNext(&tmp);
+        if (word == QString()) {
+            lines += cur;
+            break;
+        }
+        if (!cur.isEmpty()) {
+            if (int(cur.length()) + int(word.length()) > wid) {
+                lines += cur;
+                cur = "";
+            }
+        }
+        if (cur.isEmpty()) {
+            // trim the whitespace in front
+            for (int n = 0; n < int(word.length()); ++n) {
+                if (!word.at(n).isSpace()) {
+                    if (n > 0) {
+                        word = word.mid(n);
+                    }
+                    break;
+                }
+            }
+        }
+        cur += word;
+    }
+    return lines;
+}
+
+static const char *messageType(int type)
+{
+    switch (type) {
+    case 1:
+        return "chat";
+    case 4:
+        return "error";
+    case 5:
+        return "headline";
+    default:
+        return "normal";
+    }
+}
+
+//----------------------------------------------------------------------------
+// HistoryExportWorker
+//----------------------------------------------------------------------------
+
+class HistoryExportWorker : public QObject {
+    Q_OBJECT
+public:
+    HistoryExportWorker() : QObject(nullptr) { }
+
+    HistoryExport::Params params;
+    QAtomicInt            canceled;
+
+public slots:
+    void run();
+
+signals:
+    void progress(int done, int total);
+    void finished(bool success);
+
+private:
+    bool    exportRows(QSqlDatabase &db);
+    QString nick(const QSqlQuery &q) const;
+    QString contactJid(const QSqlQuery &q) const;
+    void    writeText(QTextStream &out, const QSqlQuery &q) const;
+    void    writeJson(QTextStream &out, const QSqlQuery &q) const;
+};
+
+void HistoryExportWorker::run()
+{
+    bool res = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "history_export");
+        db.setDatabaseName(ApplicationInfo::historyDir() + "/history.db");
+        db.setConnectOptions("QSQLITE_OPEN_READONLY");
+        if (db.open())
+            res = exportRows(db);
+        else
+            qWarning("%s\n%s", "HistoryExport: Can't open base.", qUtf8Printable(db.lastError().text()));
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("history_export");
+    emit finished(res);
+}
+
+bool HistoryExportWorker::exportRows(QSqlDatabase &db)
+{
+    const bool xml = params.format == HistoryExport::XmlArchive;
+
+    QString where = " WHERE `events`.`type` IN (0, 1, 4, 5)";
+    if (!params.accId.isEmpty())
+        where += " AND `contacts`.`acc_id` = :acc_id";
+    if (!params.jid.isEmpty())
+        where += " AND `contacts`.`jid` = :jid";
+    const QString from = " FROM `events` INNER JOIN `contacts` ON `contacts`.`id` = `events`.`contact_id`";
+
+    QSqlQuery q(db);
+    q.setForwardOnly(true);
+
+    int total = 0;
+    q.prepare("SELECT count(*)" + from + where + ";");
+    if (!params.accId.isEmpty())
+        q.bindValue(":acc_id", params.accId);
+    if (!params.jid.isEmpty())
+        q.bindValue(":jid", params.jid.full());
+    if (q.exec() && q.next())
+        total = q.value(0).toInt();
+    q.finish();
+    emit progress(0, total);
+
+    // the xml archive has one collection per contact, so keep contacts together there
+    q.prepare("SELECT `events`.`date`, `events`.`type`, `events`.`direction`, `events`.`subject`, `events`.`m_text`, "
+              "`events`.`extra_data`, `events`.`resource`, `contacts`.`jid`, `contacts`.`acc_id`, "
+              "`events`.`contact_id`"
+              + from + where
+              + (xml ? " ORDER BY `events`.`contact_id`, `events`.`date`, `events`.`id`;"
+                     : " ORDER BY `events`.`date`, `events`.`id`;"));
+    if (!params.accId.isEmpty())
+        q.bindValue(":acc_id", params.accId);
+    if (!params.jid.isEmpty())
+        q.bindValue(":jid", params.jid.full());
+    if (!q.exec()) {
+        qWarning("%s", qUtf8Printable(q.lastError().text()));
+        return false;
+    }
+
+    // written to a temporary file, a failed or canceled export leaves nothing behind
+    QSaveFile f(params.fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    QTextStream      out;
+    QXmlStreamWriter xw;
+    if (xml) {
+        xw.setDevice(&f);
+        xw.setAutoFormatting(true);
+        xw.writeStartDocument();
+        xw.writeStartElement("chats");
+        xw.writeDefaultNamespace("urn:xmpp:archive");
+    } else {
+        out.setDevice(&f);
+        out.setCodec("UTF-8");
+    }
+
+    int       done      = 0;
+    qint64    contactId = -1;
+    QDateTime chatStart;
+    while (q.next()) {
+        if (canceled.loadAcquire())
+            return false;
+
+        if (xml) {
+            const QDateTime date = QDateTime::fromString(q.value(ColDate).toString(), Qt::ISODate);
+            if (q.value(ColContactId).toLongLong() != contactId) {
+                if (contactId != -1)
+                    xw.writeEndElement();
+                contactId = q.value(ColContactId).toLongLong();
+                chatStart = date;
+                xw.writeStartElement("chat");
+                xw.writeAttribute("with", q.value(ColJid).toString());
+                xw.writeAttribute("start", chatStart.toUTC().toString(Qt::ISODate));
+            }
+            // secs count from the start of the collection
+            xw.writeStartElement(q.value(ColDirection).toInt() == 1 ? "to" : "from");
+            xw.writeAttribute("secs", QString::number(chatStart.secsTo(date)));
+            xw.writeAttribute("utc", date.toUTC().toString(Qt::ISODate));
+            if (!q.value(ColSubject).toString().isEmpty())
+                xw.writeTextElement("subject", q.value(ColSubject).toString());
+            xw.writeTextElement("body", q.value(ColText).toString());
+            xw.writeEndElement();
+        } else if (params.format == HistoryExport::JsonLines)
+            writeJson(out, q);
+        else
+            writeText(out, q);
+
+        if (++done % EXPORT_PROGRESS_STEP == 0)
+            emit progress(done, total);
+    }
+
+    if (xml) {
+        if (contactId != -1)
+            xw.writeEndElement();
+        xw.writeEndDocument();
+        if (xw.hasError())
+            return false;
+    } else {
+        out.flush();
+        if (out.status() != QTextStream::Ok)
+            return false;
+    }
+    emit progress(done, total);
+    return f.commit();
+}
+
+QString HistoryExportWorker::nick(const QSqlQuery &q) const
+{
+    if (q.value(ColDirection).toInt() == 1)
+        return params.accountNicks.value(q.value(ColAccId).toString(), params.ourNick);
+    if (!params.theirNick.isEmpty())
+        return params.theirNick;
+    return contactJid(q);
+}
+
+QString HistoryExportWorker::contactJid(const QSqlQuery &q) const
+{
+    const QString resource = q.value(ColResource).toString();
+    if (resource.isEmpty())
+        return q.value(ColJid).toString();
+    return q.value(ColJid).toString() + "/" + resource;
+}
+
+void HistoryExportWorker::writeText(QTextStream &out, const QSqlQuery &q) const
+{
+    const QDateTime date = QDateTime::fromString(q.value(ColDate).toString(), Qt::ISODate);
+    out << QString("[%1] <%2>: ").arg(QLocale().toString(date, QLocale::ShortFormat), nick(q));
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    const QStringList lines = q.value(ColText).toString().split('\n', Qt::KeepEmptyParts);
+#else
+    const QStringList lines = q.value(ColText).toString().split('\n', QString::KeepEmptyParts);
+#endif
+    for (const QString &str : lines) {
+        const QStringList sub = wrapString(str, 72);
+        for (const QString &str2 : sub)
+            out << str2 << "\n    ";
+    }
+    out << "\n";
+}
+
+void HistoryExportWorker::writeJson(QTextStream &out, const QSqlQuery &q) const
+{
+    QJsonObject obj;
+    obj.insert("date", QDateTime::fromString(q.value(ColDate).toString(), Qt::ISODate).toUTC().toString(Qt::ISODate));
+    obj.insert("account", q.value(ColAccId).toString());
+    obj.insert("jid", contactJid(q));
+    obj.insert("direction", q.value(ColDirection).toInt() == 1 ? "out" : "in");
+    obj.insert("type", messageType(q.value(ColType).toInt()));
+    obj.insert("nick", nick(q));
+    if (!q.value(ColSubject).toString().isEmpty())
+        obj.insert("subject", q.value(ColSubject).toString());
+    obj.insert("body", q.value(ColText).toString());
+    const QString extra = q.value(ColExtraData).toString();
+    if (!extra.isEmpty())
+        obj.insert("extra", QJsonDocument::fromJson(extra.toUtf8()).object());
+    out << QString::fromUtf8(QJsonDocument(obj).toJson(QJsonDocument::Compact)) << "\n";
+}
+
+//----------------------------------------------------------------------------
+// HistoryExport
+//----------------------------------------------------------------------------
+
+HistoryExport::HistoryExport(QObject *parent) : QObject(parent), thread(nullptr), worker(nullptr) { }
+
+HistoryExport::~HistoryExport()
+{
+    cancel();
+    if (thread) {
+        thread->quit();
+        thread->wait();
+        delete worker;
+        delete thread;
+    }
+}
+
+bool HistoryExport::isActive() const { return thread && thread->isRunning(); }
+
+void HistoryExport::start(const Params &params)
+{
+    if (isActive())
+        return;
+    if (!thread) {
+        thread = new QThread(this);
+        worker = new HistoryExportWorker;
+        worker->moveToThread(thread);
+        connect(worker, &HistoryExportWorker::progress, this, &HistoryExport::progress, Qt::QueuedConnection);
+        connect(worker, &HistoryExportWorker::finished, this, &HistoryExport::worker_finished, Qt::QueuedConnection);
+    }
+    worker->params = params;
+    worker->canceled.storeRelease(0);
+    thread->start();
+    QMetaObject::invokeMethod(worker, "run", Qt::QueuedConnection);
+}
+
+void HistoryExport::cancel()
+{
+    if (worker)
+        worker->canceled.storeRelease(1);
+}
+
+void HistoryExport::worker_finished(bool success)
+{
+    thread->quit();
+    thread->wait();
+    emit finished(success);
+}
+
+HistoryExport::Format HistoryExport::formatForFileName(const QString &fileName)
+{
+    if (fileName.endsWith(".jsonl", Qt::CaseInsensitive) || fileName.endsWith(".json", Qt::CaseInsensitive))
+        return JsonLines;
+    if (fileName.endsWith(".xml", Qt::CaseInsensitive))
+        return XmlArchive;
+    return PlainText;
+}
+
+#include "historyexport.moc"
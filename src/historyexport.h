@@ -0,0 +1,69 @@
+/*
+ * historyexport.h - streaming export of the SQLite history
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HISTORYEXPORT_H
+#define HISTORYEXPORT_H
+
+#include "xmpp_jid.h"
+
+#include <QHash>
+#include <QObject>
+
+class HistoryExportWorker;
+class QThread;
+
+// Reads history.db through its own connection in a worker thread and writes rows
+// straight to the file, no PsiEvents are created on the way
+class HistoryExport : public QObject {
+    Q_OBJECT
+public:
+    enum Format { PlainText, JsonLines, XmlArchive };
+
+    struct Params {
+        QString                 accId; // empty for all accounts
+        XMPP::Jid               jid;   // empty for all contacts
+        QString                 fileName;
+        Format                  format = PlainText;
+        QHash<QString, QString> accountNicks; // acc_id -> our nick
+        QString                 ourNick;      // used when acc_id has no nick
+        QString                 theirNick;    // empty to use the contact jid
+    };
+
+    HistoryExport(QObject *parent = nullptr);
+    ~HistoryExport();
+
+    bool isActive() const;
+    void start(const Params &params);
+    void cancel();
+
+    static Format formatForFileName(const QString &fileName);
+
+signals:
+    void progress(int done, int total);
+    void finished(bool success);
+
+private slots:
+    void worker_finished(bool success);
+
+private:
+    QThread *            thread;
+    HistoryExportWorker *worker;
+};
+
+#endif // HISTORYEXPORT_H
@@ -27,13 +27,25 @@
 #include "psicontactlist.h"
 
 #include <QDir>
+#include <QEventLoop>
 #include <QLayout>
 #include <QMessageBox>
-#include <QTimer>
+#include <QtConcurrentMap>
+
+// parsed files wait in memory until the writer catches up; pause the parser past this many records
+static const int MaxRowsInFlight = 200000;
+
+static ImportFile readImportFile(const ImportItem &item)
+{
+    ImportFile f;
+    f.item    = item;
+    f.records = EDBFlatFile::File::readRecords(item.jid);
+    return f;
+}
 
 HistoryImport::HistoryImport(PsiCon *psi) :
-    QObject(), psi_(psi), srcEdb(nullptr), dstEdb(nullptr), hErase(nullptr), hRead(nullptr), hWrite(nullptr),
-    active(false), result_(ResultNone), recordsCount(0), dlg(nullptr)
+    QObject(), psi_(psi), srcEdb(nullptr), dstEdb(nullptr), hErase(nullptr), active(false), result_(ResultNone),
+    parser(nullptr), rowsInFlight(0), filesLeft(0), dlg(nullptr)
 {
 }
 
@@ -60,7 +72,14 @@ bool HistoryImport::isNeeded()
 
 void HistoryImport::clear()
 {
+    if (parser) {
+        parser->cancel();
+        parser->waitForFinished();
+        delete parser;
+        parser = nullptr;
+    }
     if (dstEdb) {
+        disconnect(dstEdb, nullptr, this, nullptr);
         static_cast<EDBSqLite *>(dstEdb)->setInsertingMode(EDBSqLite::Normal);
         static_cast<EDBSqLite *>(dstEdb)->setMirror(new EDBFlatFile(psi_));
     }
@@ -68,18 +87,10 @@ void HistoryImport::clear()
         delete hErase;
         hErase = nullptr;
     }
-    if (hRead) {
-        delete hRead;
-        hRead = nullptr;
-    }
     if (srcEdb) {
         delete srcEdb;
         srcEdb = nullptr;
     }
-    if (hWrite) {
-        delete hWrite;
-        hWrite = nullptr;
-    }
     if (dlg) {
         delete dlg;
         dlg = nullptr;
@@ -99,9 +110,18 @@ int HistoryImport::exec()
     if (!srcEdb)
         srcEdb = new EDBFlatFile(psi_);
 
+    // files already committed by an interrupted import are skipped
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    doneFiles = dstEdb->getStorageParam("import_done").split('\n', Qt::SkipEmptyParts);
+#else
+    doneFiles = dstEdb->getStorageParam("import_done").split('\n', QString::SkipEmptyParts);
+#endif
+
     const auto &cis = srcEdb->contacts(QString(), EDB::Contact);
     for (const EDB::ContactItem &ci : cis) {
         const XMPP::Jid &jid = ci.jid;
+        if (doneFiles.contains(jid.full()))
+            continue;
         QStringList      accIds;
         for (PsiAccount *acc : psi_->contactList()->accounts()) {
             for (PsiContact *contact : acc->contactList()) {
@@ -131,8 +151,11 @@ void HistoryImport::stop(int reason)
 {
     stopTime = QDateTime::currentDateTime();
     result_  = reason;
+    if (parser)
+        parser->cancel();
     if (reason == ResultNormal) {
         dstEdb->setStorageParam("import_start", QString());
+        dstEdb->setStorageParam("import_done", QString());
         int sec = importDuration();
         int min = sec / 60;
         sec     = sec % 60;
@@ -149,62 +172,56 @@ void HistoryImport::stop(int reason)
 
 int HistoryImport::importDuration() { return int(startTime.secsTo(stopTime)); }
 
-void HistoryImport::readFromFiles()
+void HistoryImport::eraseFinished()
 {
-    if (!active)
-        return;
-    if (hWrite != nullptr) {
-        if (!hWrite->writeSuccess()) {
-            stop(ResultError); // Write error
-            return;
-        }
-    } else if (hErase != nullptr && !hErase->writeSuccess()) {
+    if (active && !hErase->writeSuccess())
         stop(ResultError);
+}
+
+void HistoryImport::fileParsed(int index)
+{
+    if (!active)
         return;
-    }
-    if (importList.isEmpty()) {
-        stop(ResultNormal);
-        return;
-    }
-    if (hRead == nullptr) {
-        hRead = new EDBHandle(srcEdb);
-        connect(hRead, SIGNAL(finished()), this, SLOT(writeToSqlite()));
-    }
 
-    const ImportItem &item  = importList.first();
-    int               start = item.startNum;
-    if (start == 0)
-        qWarning("%s", QString("Importing %1").arg(JIDUtil::toString(item.jid, true)).toUtf8().constData());
-    --recordsCount;
-    if (dlg && (recordsCount % 100) == 0)
-        progressBar->setValue(progressBar->value() + 1);
-    hRead->get(item.accIds.first(), item.jid, QDateTime(), EDB::Forward, start, 1);
+    const ImportFile f   = parser->resultAt(index);
+    const QString    key = f.item.jid.full();
+    qWarning("%s", QString("Importing %1").arg(JIDUtil::toString(f.item.jid, true)).toUtf8().constData());
+    EDBSqLite *stor = static_cast<EDBSqLite *>(dstEdb);
+    for (const QString &accId : f.item.accIds) {
+        int id        = stor->importRecords(accId, f.item.jid, f.records);
+        writes[id]    = key;
+        writeRows[id] = f.records.size();
+        ++fileWrites[key];
+        rowsInFlight += f.records.size();
+    }
+    if (rowsInFlight > MaxRowsInFlight && !parser->isPaused())
+        parser->pause();
 }
 
-void HistoryImport::writeToSqlite()
+void HistoryImport::recordsImported(int id, bool success)
 {
+    if (!writes.contains(id))
+        return;
+    const QString key = writes.take(id);
+    rowsInFlight -= writeRows.take(id);
     if (!active)
         return;
-    const EDBResult r = hRead->result();
-    if (hRead->lastRequestType() != EDBHandle::Read || r.size() > 1) {
+    if (!success) {
         stop(ResultError);
         return;
     }
-    if (r.isEmpty()) {
-        importList.first().accIds.removeFirst();
-        if (importList.first().accIds.isEmpty())
-            importList.removeFirst();
-        QTimer::singleShot(0, this, SLOT(readFromFiles()));
-        return;
-    }
-    if (hWrite == nullptr) {
-        hWrite = new EDBHandle(dstEdb);
-        connect(hWrite, SIGNAL(finished()), this, SLOT(readFromFiles()));
+
+    if (--fileWrites[key] == 0) {
+        fileWrites.remove(key);
+        doneFiles.append(key);
+        dstEdb->setStorageParam("import_done", doneFiles.join('\n'));
+        progressBar->setValue(progressBar->value() + 1);
+        --filesLeft;
     }
-    EDBItemPtr  it   = r.first();
-    ImportItem &item = importList.first();
-    hWrite->append(item.accIds.first(), item.jid, it->event(), EDB::Contact);
-    item.startNum += 1;
+    if (parser->isPaused() && rowsInFlight < MaxRowsInFlight / 2)
+        parser->resume();
+    if (filesLeft == 0)
+        stop(ResultNormal);
 }
 
 void HistoryImport::showDialog()
@@ -262,21 +279,33 @@ void HistoryImport::start()
     btnOk->setEnabled(false);
     stackedWidget->setCurrentIndex(1);
 
-    lbStatus->setText(tr("Counting records"));
-    qApp->processEvents();
-    recordsCount = srcEdb->eventsCount(QString(), XMPP::Jid());
-    int max      = int(recordsCount / 100);
-    if ((recordsCount % 100) != 0)
-        ++max;
-    progressBar->setMaximum(max);
+    lbStatus->setText(tr("Import"));
+    progressBar->setMaximum(importList.size());
     progressBar->setValue(0);
 
-    lbStatus->setText(tr("Import"));
-    hErase = new EDBHandle(dstEdb);
-    connect(hErase, SIGNAL(finished()), this, SLOT(readFromFiles()));
-    hErase->erase(QString(), QString());
-    while (active)
-        qApp->processEvents();
+    EDBSqLite *stor = static_cast<EDBSqLite *>(dstEdb);
+    connect(stor, &EDBSqLite::recordsImported, this, &HistoryImport::recordsImported);
+    if (doneFiles.isEmpty()) {
+        hErase = new EDBHandle(dstEdb);
+        connect(hErase, SIGNAL(finished()), this, SLOT(eraseFinished()));
+        hErase->erase(QString(), QString());
+    } else {
+        // every file goes in as one transaction, but the last commit before an interruption
+        // may have missed import_done. clear what is left of pending contacts first
+        for (const ImportItem &item : importList)
+            for (const QString &accId : item.accIds)
+                stor->erase(accId, item.jid);
+    }
+
+    filesLeft = importList.size();
+    parser    = new QFutureWatcher<ImportFile>(this);
+    connect(parser, &QFutureWatcher<ImportFile>::resultReadyAt, this, &HistoryImport::fileParsed);
+    parser->setFuture(QtConcurrent::mapped(importList, readImportFile));
+
+    QEventLoop loop;
+    connect(this, &HistoryImport::finished, &loop, &QEventLoop::quit);
+    if (active)
+        loop.exec();
     if (result_ == ResultNormal)
         dlg->accept();
     else
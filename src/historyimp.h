@@ -20,12 +20,15 @@
 #ifndef HISTORYIMP_H
 #define HISTORYIMP_H
 
+#include "edbflatfile.h"
 #include "eventdb.h"
 #include "jidutil.h"
 #include "psicon.h"
 #include "xmpp/jid/jid.h"
 
 #include <QDialog>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QLabel>
 #include <QObject>
 #include <QProgressBar>
@@ -35,15 +38,20 @@
 struct ImportItem {
     QStringList accIds;
     XMPP::Jid   jid;
-    int         startNum;
+    ImportItem() { }
     ImportItem(const QStringList &ids, const XMPP::Jid &j)
     {
-        accIds   = ids;
-        jid      = j;
-        startNum = 0;
+        accIds = ids;
+        jid    = j;
     }
 };
 
+// one flat file parsed in the thread pool
+struct ImportFile {
+    ImportItem                 item;
+    QList<EDBFlatFile::Record> records;
+};
+
 class HistoryImport : public QObject {
     Q_OBJECT
 
@@ -61,13 +69,18 @@ private:
     EDB *             srcEdb;
     EDB *             dstEdb;
     EDBHandle *       hErase;
-    EDBHandle *       hRead;
-    EDBHandle *       hWrite;
     QDateTime         startTime;
     QDateTime         stopTime;
     bool              active;
     int               result_;
-    quint64           recordsCount;
+
+    QFutureWatcher<ImportFile> *parser;
+    QHash<int, QString>         writes;      // request id -> file jid
+    QHash<QString, int>         fileWrites;  // file jid -> pending requests
+    QHash<int, int>             writeRows;   // request id -> records in flight
+    int                         rowsInFlight;
+    int                         filesLeft;
+    QStringList                 doneFiles;
     QDialog *         dlg;
     QLabel *          lbStatus;
     QProgressBar *    progressBar;
@@ -79,8 +92,9 @@ private:
     void showDialog();
 
 private slots:
-    void readFromFiles();
-    void writeToSqlite();
+    void eraseFinished();
+    void fileParsed(int index);
+    void recordsImported(int id, bool success);
     void start();
     void stop(int reason = ResultCancel);
     void cancel();
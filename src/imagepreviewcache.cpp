@@ -0,0 +1,119 @@
+/*
+ * imagepreviewcache.cpp - scaled previews of local images decoded off the gui thread
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "imagepreviewcache.h"
+
+#include <QCoreApplication>
+#include <QFutureWatcher>
+#include <QImageReader>
+#include <QtConcurrent>
+
+// memory for decoded previews
+#define PREVIEW_CACHE_SIZE (32 * 1024) // KiB
+
+ImagePreviewCache::ImagePreviewCache() : QObject(QCoreApplication::instance())
+{
+    cache_.setMaxCost(PREVIEW_CACHE_SIZE);
+}
+
+ImagePreviewCache *ImagePreviewCache::instance()
+{
+    static ImagePreviewCache *instance_ = nullptr;
+    if (!instance_) {
+        instance_ = new ImagePreviewCache;
+    }
+    return instance_;
+}
+
+QSize ImagePreviewCache::previewSize(const QString &fileName, const QSize &maxSize)
+{
+    QImageReader reader(fileName);
+    QSize        size = reader.size();
+    if (!size.isValid()) {
+        return size;
+    }
+    return size.scaled(size.boundedTo(maxSize), Qt::KeepAspectRatio);
+}
+
+QString ImagePreviewCache::cacheKey(const QByteArray &key, const QSize &maxSize)
+{
+    return QString::fromUtf8(key) + QString("/%1x%2").arg(maxSize.width()).arg(maxSize.height());
+}
+
+// large pictures are scaled while decoding, so they are never unpacked at full size
+QImage ImagePreviewCache::decode(const QString &fileName, const QSize &maxSize)
+{
+    QImageReader reader(fileName);
+    QSize size = reader.size();
+    if (size.isValid() && (size.width() > maxSize.width() || size.height() > maxSize.height())) {
+        reader.setScaledSize(size.scaled(maxSize, Qt::KeepAspectRatio));
+    }
+    return reader.read();
+}
+
+void ImagePreviewCache::insert(const QString &cacheKey, const QImage &image)
+{
+    cache_.insert(cacheKey, new QImage(image), qMax(1, image.width() * image.height() * image.depth() / 8 / 1024));
+}
+
+QImage ImagePreviewCache::cached(const QByteArray &key, const QSize &maxSize) const
+{
+    QImage *image = cache_.object(cacheKey(key, maxSize));
+    return image ? *image : QImage();
+}
+
+QImage ImagePreviewCache::preview(const QByteArray &key, const QString &fileName, const QSize &maxSize)
+{
+    const QString ck    = cacheKey(key, maxSize);
+    QImage *      image = cache_.object(ck);
+    if (image) {
+        return *image;
+    }
+    QImage ret = decode(fileName, maxSize);
+    if (!ret.isNull()) {
+        insert(ck, ret);
+    }
+    return ret;
+}
+
+void ImagePreviewCache::request(const QByteArray &key, const QString &fileName, const QSize &maxSize)
+{
+    const QString ck = cacheKey(key, maxSize);
+    if (pending_.contains(ck)) {
+        return; // the running decode will answer for all of them
+    }
+    QImage *image = cache_.object(ck);
+    if (image) {
+        emit ready(key, maxSize, *image);
+        return;
+    }
+
+    pending_.insert(ck);
+    auto watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, key, ck, maxSize]() {
+        const QImage image = watcher->result();
+        watcher->deleteLater();
+        pending_.remove(ck);
+        if (!image.isNull()) {
+            insert(ck, image);
+        }
+        emit ready(key, maxSize, image);
+    });
+    watcher->setFuture(QtConcurrent::run([fileName, maxSize]() { return decode(fileName, maxSize); }));
+}
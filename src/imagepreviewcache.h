@@ -0,0 +1,56 @@
+/*
+ * imagepreviewcache.h - scaled previews of local images decoded off the gui thread
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef IMAGEPREVIEWCACHE_H
+#define IMAGEPREVIEWCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+
+// Previews are keyed by content (usually a hash sum of the file) and the bounding size,
+// so the same picture shared in several chats is decoded once.
+class ImagePreviewCache : public QObject {
+    Q_OBJECT
+public:
+    static ImagePreviewCache *instance();
+
+    // size of the preview, read from the image header only. invalid if it's not an image
+    static QSize previewSize(const QString &fileName, const QSize &maxSize);
+
+    QImage cached(const QByteArray &key, const QSize &maxSize) const;
+    QImage preview(const QByteArray &key, const QString &fileName, const QSize &maxSize); // decodes right away
+    void   request(const QByteArray &key, const QString &fileName, const QSize &maxSize); // ready() follows
+
+signals:
+    void ready(const QByteArray &key, const QSize &maxSize, const QImage &image);
+
+private:
+    ImagePreviewCache();
+
+    static QString cacheKey(const QByteArray &key, const QSize &maxSize);
+    static QImage  decode(const QString &fileName, const QSize &maxSize);
+    void           insert(const QString &cacheKey, const QImage &image);
+
+    QCache<QString, QImage> cache_;
+    QSet<QString>           pending_; // decodes in progress
+};
+
+#endif // IMAGEPREVIEWCACHE_H
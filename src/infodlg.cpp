@@ -21,12 +21,12 @@
 
 #include "busywidget.h"
 #include "common.h"
+#include "contactinfocache.h"
 #include "desktoputil.h"
 #include "discodlg.h"
 #include "fileutil.h"
 #include "iconset.h"
 #include "iconwidget.h"
-#include "lastactivitytask.h"
 #include "msgmle.h"
 #include "psiaccount.h"
 #include "psioptions.h"
@@ -314,6 +314,7 @@ InfoWidget::InfoWidget(int type, const Jid &j, const VCard &vcard, PsiAccount *p
     connect(d->pa->client(), SIGNAL(resourceUnavailable(const Jid &, const Resource &)),
             SLOT(contactUnavailable(const Jid &, const Resource &)));
     connect(d->pa, SIGNAL(updateContact(const Jid &)), SLOT(contactUpdated(const Jid &)));
+    connect(d->pa->contactInfo(), &ContactInfoCache::updated, this, &InfoWidget::contactInfoUpdated);
     m_ui.te_status->setReadOnly(true);
     m_ui.te_status->setAcceptRichText(true);
     PsiRichText::install(m_ui.te_status->document());
@@ -678,7 +679,8 @@ void InfoWidget::doRefresh()
     emit busy();
 
     d->jt = VCardFactory::instance()->getVCard(
-        d->jid, d->pa->client()->rootTask(), this, [this]() { jt_finished(); }, d->cacheVCard, d->type == MucContact);
+        d->jid, d->pa->client()->rootTask(), this, [this]() { jt_finished(); }, d->cacheVCard, d->type == MucContact,
+        true, VCardFactory::InteractivePriority);
 }
 
 void InfoWidget::publish()
@@ -925,74 +927,25 @@ void InfoWidget::setStatusVisibility(bool visible)
 void InfoWidget::requestResourceInfo(const Jid &j)
 {
     d->infoRequested += j.full();
-
-    JT_ClientVersion *jcv = new JT_ClientVersion(d->pa->client()->rootTask());
-    connect(jcv, SIGNAL(finished()), SLOT(clientVersionFinished()));
-    jcv->get(j);
-    jcv->go(true);
-
-    JT_EntityTime *jet = new JT_EntityTime(d->pa->client()->rootTask());
-    connect(jet, SIGNAL(finished()), SLOT(entityTimeFinished()));
-    jet->get(j);
-    jet->go(true);
-}
-
-void InfoWidget::clientVersionFinished()
-{
-    JT_ClientVersion *j = static_cast<JT_ClientVersion *>(sender());
-    if (j->success()) {
-        const auto &uList = d->findRelevant(j->jid());
-        for (UserListItem *u : uList) {
-            UserResourceList::Iterator rit   = u->userResourceList().find(j->jid().resource());
-            bool                       found = !(rit == u->userResourceList().end());
-            if (!found) {
-                continue;
-            }
-
-            (*rit).setClient(j->name(), j->version(), j->os());
-            d->updateEntry(*u);
-            updateStatus();
-        }
-    }
-}
-
-void InfoWidget::entityTimeFinished()
-{
-    JT_EntityTime *j = static_cast<JT_EntityTime *>(sender());
-    if (j->success()) {
-        const auto uList = d->findRelevant(j->jid());
-        for (UserListItem *u : uList) {
-            UserResourceList::Iterator rit   = u->userResourceList().find(j->jid().resource());
-            bool                       found = !(rit == u->userResourceList().end());
-            if (!found)
-                continue;
-
-            (*rit).setTimezone(j->timezoneOffset());
-            d->updateEntry(*u);
-            updateStatus();
-        }
-    }
+    d->pa->contactInfo()->request(j, ContactInfoCache::Version | ContactInfoCache::Time);
 }
 
 void InfoWidget::requestLastActivity()
 {
-    LastActivityTask *jla = new LastActivityTask(d->jid.bare(), d->pa->client()->rootTask());
-    connect(jla, SIGNAL(finished()), SLOT(requestLastActivityFinished()));
-    jla->go(true);
+    d->pa->contactInfo()->request(d->jid.bare(), ContactInfoCache::LastActivity);
 }
 
-void InfoWidget::requestLastActivityFinished()
+void InfoWidget::contactInfoUpdated(const Jid &j)
 {
-    LastActivityTask *j = static_cast<LastActivityTask *>(sender());
-    if (j->success()) {
-        const auto &uList = d->findRelevant(d->jid);
-        for (UserListItem *u : uList) {
-            u->setLastUnavailableStatus(makeStatus(STATUS_OFFLINE, j->status()));
-            u->setLastAvailable(j->time());
-            d->updateEntry(*u);
-            updateStatus();
-        }
+    if (!d->jid.compare(j, false)) {
+        return;
     }
+    // roster items have it already, the groupchat one is ours
+    const auto &uList = d->findRelevant(j);
+    for (UserListItem *u : uList) {
+        d->pa->contactInfo()->apply(j, u);
+    }
+    updateStatus();
 }
 
 void InfoWidget::contactAvailable(const Jid &j, const Resource &r)
@@ -59,9 +59,7 @@ private slots:
     void contactAvailable(const Jid &, const Resource &);
     void contactUnavailable(const Jid &, const Resource &);
     void contactUpdated(const Jid &);
-    void clientVersionFinished();
-    void entityTimeFinished();
-    void requestLastActivityFinished();
+    void contactInfoUpdated(const Jid &);
     void jt_finished();
     void doShowCal();
     void doUpdateFromCalendar(const QDate &);
@@ -22,6 +22,12 @@
 #include "psioptions.h"
 #include "xmpp_jid.h"
 
+#include <QCache>
+#include <QMutex>
+
+// parsed jids kept by intern(), least recently used go first
+#define JID_INTERN_SIZE 8192
+
 using namespace XMPP;
 
 QString JIDUtil::defaultDomain() { return PsiOptions::instance()->getOption("options.account.domain").toString(); }
@@ -113,7 +119,25 @@ Jid JIDUtil::accountFromString(const QString &s)
 
 QString JIDUtil::toString(const Jid &j, bool withResource) { return (withResource ? j.full() : j.bare()); }
 
-Jid JIDUtil::fromString(const QString &s) { return Jid(s); }
+Jid JIDUtil::fromString(const QString &s) { return intern(s); }
+
+/**
+ * Parses \param s once for the whole process. Stringprep is the expensive part of parsing
+ * and the same few jids come up everywhere. Copies of a cached Jid share its strings, so
+ * comparing two of them stops at the string pointers.
+ */
+Jid JIDUtil::intern(const QString &s)
+{
+    static QMutex               mutex;
+    static QCache<QString, Jid> cache(JID_INTERN_SIZE);
+
+    QMutexLocker locker(&mutex);
+    if (const Jid *jid = cache.object(s))
+        return *jid;
+    Jid jid(s);
+    cache.insert(s, new Jid(jid));
+    return jid;
+}
 
 QString JIDUtil::encode822(const QString &s)
 {
@@ -35,6 +35,7 @@ public:
     static XMPP::Jid accountFromString(const QString &);
     static QString   toString(const XMPP::Jid &, bool withResource);
     static XMPP::Jid fromString(const QString &);
+    static XMPP::Jid intern(const QString &);
     static QString   encode(const QString &jid);
     static QString   decode(const QString &jid);
     static QString   nickOrJid(const QString &, const QString &);
@@ -0,0 +1,324 @@
+/*
+ * mamsync.cpp - fetches the messages of the server archive into the local history
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "mamsync.h"
+
+#include "chathistoryprefetch.h"
+#include "edbsqlite.h"
+#include "psiaccount.h"
+#include "psievent.h"
+#include "psioptions.h"
+#include "xmpp_client.h"
+#include "xmpp_message.h"
+#include "xmpp_task.h"
+#include "xmpp_xmlcommon.h"
+
+#include <QDomElement>
+#include <QTimer>
+#include <functional>
+
+#define MAM_NS "urn:xmpp:mam:2"
+#define RSM_NS "http://jabber.org/protocol/rsm"
+// messages asked for at once
+#define MAM_SYNC_PAGE_SIZE 50
+// pause between two pages of a backfill, milliseconds
+#define MAM_SYNC_PAGE_DELAY 2000
+// wait after login before the first page, milliseconds
+#define MAM_SYNC_START_DELAY 10000
+// retry interval while the history database has writes queued, milliseconds
+#define MAM_SYNC_BUSY_DELAY 1000
+
+using namespace XMPP;
+
+// one page of the archive, the messages arrive before the result through MamResultTask
+class MamQueryTask : public Task {
+public:
+    MamQueryTask(Task *parent, const Jid &with, const QString &after) : Task(parent)
+    {
+        iq_               = createIQ(doc(), "set", QString(), id());
+        QDomElement query = doc()->createElementNS(MAM_NS, "query");
+        query.setAttribute("queryid", id());
+
+        QDomElement form = doc()->createElementNS("jabber:x:data", "x");
+        form.setAttribute("type", "submit");
+        form.appendChild(field("FORM_TYPE", MAM_NS));
+        if (!with.isEmpty())
+            form.appendChild(field("with", with.bare()));
+        query.appendChild(form);
+
+        QDomElement set = doc()->createElementNS(RSM_NS, "set");
+        set.appendChild(textTag(doc(), "max", QString::number(MAM_SYNC_PAGE_SIZE)));
+        if (!after.isEmpty())
+            set.appendChild(textTag(doc(), "after", after));
+        query.appendChild(set);
+        iq_.appendChild(query);
+    }
+
+    void onGo() { send(iq_); }
+
+    bool take(const QDomElement &x)
+    {
+        if (!iqVerify(x, Jid(), id()))
+            return false;
+
+        if (x.attribute("type") == "result") {
+            QDomElement fin = x.firstChildElement("fin");
+            complete_       = fin.attribute("complete") == "true";
+            last_           = fin.firstChildElement("set").firstChildElement("last").text();
+            setSuccess();
+        } else {
+            setError(x);
+        }
+        return true;
+    }
+
+    bool           complete() const { return complete_; }
+    const QString &last() const { return last_; }
+
+private:
+    QDomElement field(const QString &var, const QString &value)
+    {
+        QDomElement f = doc()->createElement("field");
+        f.setAttribute("var", var);
+        f.appendChild(textTag(doc(), "value", value));
+        return f;
+    }
+
+    QDomElement iq_;
+    bool        complete_ = false;
+    QString     last_;
+};
+
+// lives as long as the client, so the archived messages don't reach the live message handling
+class MamResultTask : public Task {
+public:
+    using Handler = std::function<void(const QDomElement &)>;
+
+    MamResultTask(Task *parent, Handler handler) : Task(parent), handler_(std::move(handler)) { }
+
+    void setQueryId(const QString &id) { queryId_ = id; }
+
+    bool take(const QDomElement &e)
+    {
+        if (queryId_.isEmpty() || e.tagName() != "message")
+            return false;
+        QDomElement result = e.firstChildElement("result");
+        if (result.namespaceURI() != MAM_NS || result.attribute("queryid") != queryId_)
+            return false;
+
+        // only the own archive answers, anything else is dropped
+        Jid from(e.attribute("from"));
+        if (from.isEmpty() || from.compare(client()->jid(), false))
+            handler_(result);
+        return true;
+    }
+
+private:
+    Handler handler_;
+    QString queryId_;
+};
+
+MamSync::MamSync(PsiAccount *account) : QObject(account), account_(account)
+{
+    timer_ = new QTimer(this);
+    timer_->setSingleShot(true);
+    connect(timer_, &QTimer::timeout, this, &MamSync::next);
+
+    listener_ = new MamResultTask(account_->client()->rootTask(), [this](const QDomElement &r) { takeResult(r); });
+}
+
+MamSync::~MamSync() { delete listener_; }
+
+void MamSync::start()
+{
+    unsupported_ = false;
+    if (!jobs_.contains(Jid()))
+        jobs_.prepend(Jid());
+    schedule(MAM_SYNC_START_DELAY);
+}
+
+void MamSync::stop()
+{
+    timer_->stop();
+    jobs_.clear();
+    // a write in progress still moves its cursor
+    if (query_) {
+        disconnect(query_, nullptr, this, nullptr);
+        query_ = nullptr;
+        busy_  = false;
+    }
+    if (listener_)
+        listener_->setQueryId(QString());
+}
+
+void MamSync::sync(const Jid &jid)
+{
+    const Jid with = jid.bare();
+    if (with.isEmpty() || !isEnabled() || jobs_.contains(with) || (busy_ && job_ == with))
+        return;
+    // the chat is open, it goes before the rest of a backfill
+    jobs_.prepend(with);
+    schedule(MAM_SYNC_PAGE_DELAY);
+}
+
+bool MamSync::isEnabled() const
+{
+    static const auto archiveSync = PsiOptions::handle<bool>("options.history.archive-sync");
+
+    EDB *edb = account_->edb();
+    return archiveSync.value() && !unsupported_ && account_->isAvailable() && account_->userAccount().opt_log && edb
+        && (edb->features() & EDB::ArchiveIds);
+}
+
+QString MamSync::cursorKey(const Jid &with) const
+{
+    QString key = QLatin1String("mam.last.") + account_->id();
+    if (!with.isEmpty())
+        key += '.' + with.bare();
+    return key;
+}
+
+void MamSync::schedule(int delay)
+{
+    if (!timer_->isActive())
+        timer_->start(delay);
+}
+
+void MamSync::next()
+{
+    if (busy_ || jobs_.isEmpty() || !isEnabled())
+        return;
+
+    // the writes of the live session go first
+    EDBSqLite *sqlite = qobject_cast<EDBSqLite *>(account_->edb());
+    if (sqlite && sqlite->queuedRequests() > 0) {
+        schedule(MAM_SYNC_BUSY_DELAY);
+        return;
+    }
+
+    job_  = jobs_.takeFirst();
+    busy_ = true;
+    items_.clear();
+    lastId_.clear();
+
+    query_ = new MamQueryTask(account_->client()->rootTask(), job_, account_->edb()->getStorageParam(cursorKey(job_)));
+    listener_->setQueryId(query_->id());
+    connect(query_, &Task::finished, this, &MamSync::queryFinished);
+    query_->go(true);
+}
+
+void MamSync::takeResult(const QDomElement &result)
+{
+    const QDomElement forwarded = result.firstChildElement("forwarded");
+    const QDomElement msg       = forwarded.firstChildElement("message");
+    const QString     archiveId = result.attribute("id");
+    if (archiveId.isEmpty() || msg.isNull())
+        return;
+    // the cursor moves over what isn't stored as well
+    lastId_ = archiveId;
+
+    Client *client = account_->client();
+    Stanza  stanza = client->stream().createStanza(addCorrectNS(msg));
+    Message m;
+    if (!m.fromStanza(stanza, client->manualTimeZoneOffset(), client->timeZoneOffset()))
+        return;
+    // as PsiAccount::logEvent() would have stored it
+    if (m.body().isEmpty() || m.type() == "groupchat" || m.type() == "headline" || m.type() == "error"
+        || !m.xencrypted().isEmpty())
+        return;
+
+    // the archive has the time in <forwarded/>, not in the message
+    const QDateTime stamp
+        = QDateTime::fromString(forwarded.firstChildElement("delay").attribute("stamp"), Qt::ISODate);
+    if (stamp.isValid())
+        m.setTimeStamp(stamp.toLocalTime());
+
+    const bool outgoing = m.from().isEmpty() || m.from().compare(account_->jid(), false);
+    const Jid  with     = outgoing ? m.to() : m.from();
+    if (with.isEmpty() || account_->findGCContact(with) || (!job_.isEmpty() && !with.compare(job_, false)))
+        return;
+
+    MessageEvent::Ptr me(new MessageEvent(m, account_));
+    me->setOriginLocal(outgoing);
+    me->setTimeStamp(m.timeStamp());
+    items_ += EDBAppendItem { with, me, EDB::Contact, archiveId };
+}
+
+void MamSync::queryFinished()
+{
+    MamQueryTask *q = query_;
+    query_          = nullptr;
+    listener_->setQueryId(QString());
+
+    if (!q->success()) {
+        busy_ = false;
+        items_.clear();
+        if (!account_->isAvailable()) {
+            // disconnected, the next login asks again
+            jobs_.prepend(job_);
+        } else if (q->statusCode() == 404) {
+            // the cursor has expired from the archive, the overlap is skipped when written
+            account_->edb()->setStorageParam(cursorKey(job_), QString());
+            jobs_.prepend(job_);
+            schedule(MAM_SYNC_PAGE_DELAY);
+        } else if (q->statusCode() == 501 || q->statusCode() == 503) {
+            unsupported_ = true;
+            jobs_.clear();
+        } else {
+            schedule(MAM_SYNC_PAGE_DELAY);
+        }
+        return;
+    }
+
+    if (!q->last().isEmpty())
+        lastId_ = q->last();
+    const bool complete = q->complete() || lastId_.isEmpty();
+    if (items_.isEmpty()) {
+        writeFinished(true, complete);
+        return;
+    }
+
+    EDBHandle *h = new EDBHandle(account_->edb());
+    connect(h, &EDBHandle::finished, this, [this, h, complete]() {
+        const bool success = h->writeSuccess();
+        delete h;
+        writeFinished(success, complete);
+    });
+    h->append(account_->id(), items_);
+}
+
+void MamSync::writeFinished(bool success, bool complete)
+{
+    busy_ = false;
+    if (success && !lastId_.isEmpty()) {
+        account_->edb()->setStorageParam(cursorKey(job_), lastId_);
+        // pages loaded before miss what was written
+        if (ChatHistoryPrefetch *prefetch = account_->historyPrefetch())
+            for (const EDBAppendItem &item : qAsConst(items_))
+                prefetch->invalidate(item.jid);
+    }
+    items_.clear();
+
+    if (success && !complete) {
+        jobs_.prepend(job_);
+        schedule(MAM_SYNC_PAGE_DELAY);
+    } else if (!jobs_.isEmpty()) {
+        schedule(MAM_SYNC_PAGE_DELAY);
+    }
+}
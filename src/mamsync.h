@@ -0,0 +1,73 @@
+/*
+ * mamsync.h - fetches the messages of the server archive into the local history
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MAMSYNC_H
+#define MAMSYNC_H
+
+#include "eventdb.h"
+#include "xmpp_jid.h"
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+
+class MamQueryTask;
+class MamResultTask;
+class PsiAccount;
+class QDomElement;
+class QTimer;
+
+// Pages through the XEP-0313 archive of the account, from where the last sync of the account
+// or of a contact stopped, and writes what the live stream didn't bring into the history.
+// One page is in flight at a time, with a pause between pages and while the database is busy
+class MamSync : public QObject {
+    Q_OBJECT
+public:
+    MamSync(PsiAccount *account);
+    ~MamSync();
+
+    // catches up with the whole archive, once the account is logged in
+    void start();
+    void stop();
+
+    // everything the archive has with jid, e.g. when its chat is opened
+    void sync(const XMPP::Jid &jid);
+
+private:
+    bool    isEnabled() const;
+    QString cursorKey(const XMPP::Jid &with) const;
+    void    schedule(int delay);
+    void    next();
+    void    takeResult(const QDomElement &result);
+    void    queryFinished();
+    void    writeFinished(bool success, bool complete);
+
+    PsiAccount *            account_;
+    QPointer<MamResultTask> listener_;
+    QPointer<MamQueryTask>  query_;
+    QTimer *                timer_;
+    QList<XMPP::Jid>        jobs_; // an empty jid is the whole archive
+    XMPP::Jid               job_;  // of the query or the write in progress
+    bool                    busy_        = false;
+    bool                    unsupported_ = false; // the server has no archive, until the next login
+    EDBAppendBatch          items_;
+    QString                 lastId_;
+};
+
+#endif // MAMSYNC_H
@@ -0,0 +1,183 @@
+/*
+ * memorytrimmer.cpp - drops cached data while the client isn't used
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "memorytrimmer.h"
+
+#include "idle/idle.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QGuiApplication>
+#include <QTimer>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+#ifdef Q_OS_MAC
+#include <dispatch/dispatch.h>
+#endif
+
+// user idle time before a moderate trim, seconds
+#define TRIM_IDLE_SECONDS 600
+// time in the background before a moderate trim, milliseconds
+#define TRIM_INACTIVE_DELAY (5 * 60 * 1000)
+// how often the system memory is looked at, milliseconds
+#define TRIM_PRESSURE_INTERVAL 30000
+// available memory, in percent of the total, below which the system is short of it
+#define TRIM_LOW_MEMORY_PERCENT 5
+
+MemoryTrimmer *MemoryTrimmer::instance_ = nullptr;
+
+MemoryTrimmer *MemoryTrimmer::instance()
+{
+    if (!instance_)
+        instance_ = new MemoryTrimmer();
+    return instance_;
+}
+
+#ifdef Q_OS_MAC
+static void memoryPressureEvent(void *context)
+{
+    static_cast<MemoryTrimmer *>(context)->trim(MemoryTrimmer::Critical);
+}
+#endif
+
+MemoryTrimmer::MemoryTrimmer() : QObject(QCoreApplication::instance())
+{
+    idle_ = new Idle;
+    connect(idle_, SIGNAL(secondsIdle(int)), SLOT(secondsIdle(int)));
+    idle_->start();
+
+    inactiveTimer_ = new QTimer(this);
+    inactiveTimer_->setSingleShot(true);
+    inactiveTimer_->setInterval(TRIM_INACTIVE_DELAY);
+    connect(inactiveTimer_, &QTimer::timeout, this, [this]() { trim(Moderate); });
+    if (qobject_cast<QGuiApplication *>(QCoreApplication::instance()))
+        connect(qApp, &QGuiApplication::applicationStateChanged, this, &MemoryTrimmer::applicationStateChanged);
+
+#if defined(Q_OS_MAC)
+    // the system tells, nothing to poll
+    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                      DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                      dispatch_get_main_queue());
+    dispatch_set_context(source, this);
+    dispatch_source_set_event_handler_f(source, memoryPressureEvent);
+    dispatch_resume(source);
+    pressureSource_ = source;
+#else
+#ifdef Q_OS_WIN
+    lowMemoryNotification_ = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+#endif
+    pressureTimer_ = new QTimer(this);
+    pressureTimer_->setInterval(TRIM_PRESSURE_INTERVAL);
+    connect(pressureTimer_, &QTimer::timeout, this, &MemoryTrimmer::checkPressure);
+    pressureTimer_->start();
+#endif
+}
+
+MemoryTrimmer::~MemoryTrimmer()
+{
+    delete idle_;
+#ifdef Q_OS_WIN
+    if (lowMemoryNotification_)
+        CloseHandle(lowMemoryNotification_);
+#endif
+#ifdef Q_OS_MAC
+    dispatch_source_cancel(static_cast<dispatch_source_t>(pressureSource_));
+    dispatch_release(static_cast<dispatch_source_t>(pressureSource_));
+#endif
+    instance_ = nullptr;
+}
+
+void MemoryTrimmer::add(QObject *owner, CostFunc cost, TrimFunc trim)
+{
+    clients_ += Client { owner, std::move(cost), std::move(trim) };
+    connect(owner, &QObject::destroyed, this, [this]() {
+        clients_.erase(std::remove_if(clients_.begin(), clients_.end(), [](const Client &c) { return !c.owner; }),
+                       clients_.end());
+    });
+}
+
+qint64 MemoryTrimmer::cost() const
+{
+    qint64 total = 0;
+    for (const Client &c : clients_)
+        total += c.cost();
+    return total;
+}
+
+void MemoryTrimmer::trim(MemoryTrimmer::Level level)
+{
+    // biggest first, a callback may release memory held by the ones after it
+    QList<QPair<qint64, int>> order;
+    for (int n = 0; n < clients_.size(); ++n)
+        order += qMakePair(clients_[n].cost(), n);
+    std::sort(order.begin(), order.end(), [](const QPair<qint64, int> &a, const QPair<qint64, int> &b) {
+        return a.first > b.first;
+    });
+
+    const QList<Client> clients = clients_; // a callback may delete an owner
+    for (const auto &o : qAsConst(order))
+        if (o.first > 0 && clients[o.second].owner)
+            clients[o.second].trim(level);
+}
+
+void MemoryTrimmer::secondsIdle(int sec)
+{
+    if (sec < TRIM_IDLE_SECONDS) {
+        idleTrimmed_ = false;
+        return;
+    }
+    if (!idleTrimmed_) {
+        idleTrimmed_ = true;
+        trim(Moderate);
+    }
+}
+
+void MemoryTrimmer::applicationStateChanged(Qt::ApplicationState state)
+{
+    if (state == Qt::ApplicationActive)
+        inactiveTimer_->stop();
+    else if (!inactiveTimer_->isActive())
+        inactiveTimer_->start();
+}
+
+void MemoryTrimmer::checkPressure()
+{
+    bool low = false;
+#if defined(Q_OS_WIN)
+    BOOL state = FALSE;
+    low        = lowMemoryNotification_ && QueryMemoryResourceNotification(lowMemoryNotification_, &state) && state;
+#elif defined(Q_OS_LINUX)
+    QFile f("/proc/meminfo");
+    if (f.open(QIODevice::ReadOnly)) {
+        qint64 total = 0, available = -1;
+        for (const QByteArray &line : f.readAll().split('\n')) {
+            if (line.startsWith("MemTotal:"))
+                total = line.mid(9).trimmed().split(' ').value(0).toLongLong();
+            else if (line.startsWith("MemAvailable:"))
+                available = line.mid(13).trimmed().split(' ').value(0).toLongLong();
+        }
+        low = total > 0 && available >= 0 && available * 100 < total * TRIM_LOW_MEMORY_PERCENT;
+    }
+#endif
+    if (low && !lowMemory_)
+        trim(Critical);
+    lowMemory_ = low;
+}
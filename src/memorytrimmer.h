@@ -0,0 +1,86 @@
+/*
+ * memorytrimmer.h - drops cached data while the client isn't used
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEMORYTRIMMER_H
+#define MEMORYTRIMMER_H
+
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <functional>
+
+class Idle;
+class QTimer;
+
+// Caches register here with what they hold and how to give it back. They are trimmed
+// when the user is idle or the application is in the background for a while (Moderate),
+// and when the system runs low on memory (Critical)
+class MemoryTrimmer : public QObject {
+    Q_OBJECT
+public:
+    enum Level {
+        Moderate, // drop what is cheap to get again, keep what is on screen
+        Critical  // drop everything that can be rebuilt
+    };
+
+    using CostFunc = std::function<qint64()>; // bytes held at the moment
+    using TrimFunc = std::function<void(Level)>;
+
+    static MemoryTrimmer *instance();
+    ~MemoryTrimmer();
+
+    // the callbacks are forgotten when owner is destroyed
+    void add(QObject *owner, CostFunc cost, TrimFunc trim);
+
+    qint64 cost() const;
+
+public slots:
+    void trim(MemoryTrimmer::Level level);
+
+private slots:
+    void secondsIdle(int sec);
+    void applicationStateChanged(Qt::ApplicationState state);
+    void checkPressure();
+
+private:
+    MemoryTrimmer();
+
+    struct Client {
+        QPointer<QObject> owner;
+        CostFunc          cost;
+        TrimFunc          trim;
+    };
+
+    static MemoryTrimmer *instance_;
+
+    QList<Client> clients_;
+    Idle *        idle_;
+    bool          idleTrimmed_   = false;   // once per idle period
+    bool          lowMemory_     = false;   // once per low memory period
+    QTimer *      inactiveTimer_;           // application in the background
+    QTimer *      pressureTimer_ = nullptr; // polls the system where it can't tell
+#ifdef Q_OS_WIN
+    void *lowMemoryNotification_ = nullptr;
+#endif
+#ifdef Q_OS_MAC
+    void *pressureSource_ = nullptr;
+#endif
+};
+
+#endif // MEMORYTRIMMER_H
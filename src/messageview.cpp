@@ -112,10 +112,8 @@ void MessageView::setPlainText(const QString &text)
         if (_type == Message) {
             setEmote(text.startsWith(me_cmd));
         }
-        _text = TextUtil::plain2rich(text);
-        if (_type == Message) {
-            _text = TextUtil::linkify(_text);
-        }
+        _plainText = text;
+        _text      = TextUtil::formatPlain(text, _type == Message ? TextUtil::FormatLinks : 0);
     }
 }
 
@@ -130,10 +128,23 @@ void MessageView::setHtml(const QString &text)
         }
     }
     _text = text;
+    _plainText.clear();
 }
 
 QString MessageView::formattedText() const
 {
+    if (!_plainText.isEmpty()) {
+        QString plain = _plainText;
+        if (isEmote() && _type == Message)
+            plain.remove(plain.indexOf(me_cmd), me_cmd.length());
+        int flags = _type == Message ? TextUtil::FormatLinks : 0;
+        if (PsiOptions::instance()->getOption("options.ui.emoticons.use-emoticons").toBool())
+            flags |= TextUtil::FormatEmoticons;
+        if (PsiOptions::instance()->getOption("options.ui.chat.legacy-formatting").toBool())
+            flags |= TextUtil::FormatLegacy;
+        return TextUtil::formatPlain(plain, flags);
+    }
+
     QString txt = _text;
 
     if (isEmote() && _type == Message) {
@@ -151,13 +162,12 @@ QString MessageView::formattedText() const
 QString MessageView::formattedUserText() const
 {
     if (!_userText.isEmpty()) {
-        QString text = TextUtil::plain2rich(_userText);
-        text         = TextUtil::linkify(text);
+        int flags = TextUtil::FormatLinks;
         if (PsiOptions::instance()->getOption("options.ui.emoticons.use-emoticons").toBool())
-            text = TextUtil::emoticonify(text);
+            flags |= TextUtil::FormatEmoticons;
         if (PsiOptions::instance()->getOption("options.ui.chat.legacy-formatting").toBool())
-            text = TextUtil::legacyFormat(text);
-        return text;
+            flags |= TextUtil::FormatLegacy;
+        return TextUtil::formatPlain(_userText, flags);
     }
     return "";
 }
@@ -84,7 +84,11 @@ public:
 
     inline Type           type() const { return _type; }
     inline const QString &text() const { return _text; }
-    inline void           setText(const QString &text) { _text = text; }
+    inline void           setText(const QString &text)
+    {
+        _text = text;
+        _plainText.clear();
+    }
     inline const QString &userText() const { return _userText; }
     inline void           setUserText(const QString &text) { _userText = text; }
 
@@ -142,8 +146,9 @@ private:
     QString                  _messageId;
     QString                  _userId;   // TODO: convert to XMPP::Jid, only used in message corrections as of now
     QString                  _nick;     // rich / as is
-    QString                  _text;     // always rich (plain text converted to rich)
-    QString                  _userText; // rich
+    QString                  _text;      // always rich (plain text converted to rich)
+    QString                  _plainText; // what _text was made of if set as plain text
+    QString                  _userText;  // rich
     QDateTime                _dateTime;
     QMap<QString, QString>   _urls;
     QString                  _replaceId;
@@ -24,8 +24,8 @@
 #include "psioptions.h"
 #include "qiteaudiorecorder.h"
 #include "shortcutmanager.h"
+#include "spellcheckservice.h"
 #include "spellchecker/spellchecker.h"
-#include "spellchecker/spellhighlighter.h"
 #include "textutil.h"
 
 #include <QAbstractTextDocumentLayout>
@@ -87,6 +87,33 @@ private:
         cur.insertText(c);
     }
 
+    // true if the character at pos follows "!", "?", or a period ending a word of at least two
+    // characters (or the one character at the very start), and whitespace. only looks back
+    // from pos, so typing at the end of a long message stays cheap
+    bool startsSentence(int pos) const
+    {
+        QTextDocument *doc = te_->document();
+        int            i   = pos - 1;
+        while (i >= 0 && doc->characterAt(i).isSpace()) {
+            --i;
+        }
+        if (i < 0 || i == pos - 1) {
+            return false;
+        }
+        const QChar ch = doc->characterAt(i);
+        if (ch == '!' || ch == '?') {
+            return true;
+        }
+        if (ch != '.') {
+            return false;
+        }
+        while (i >= 0 && doc->characterAt(i) == '.') {
+            --i;
+        }
+        // i is the last character before the dots now
+        return i == 0 || (i > 0 && doc->characterAt(i - 1) != '.');
+    }
+
 public slots:
     void textChanged(int pos, int /*charsRemoved*/, int charsAdded)
     {
@@ -104,11 +131,7 @@ public slots:
             } else if (charsAdded > 1) { // Insert a piece of text
                 return;
             } else {
-                QRegExp capitalizeAfter("(?:^[^.][.]+\\s+)|(?:\\s*[^.]{2,}[.]+\\s+)|(?:[!?]\\s+)");
-                int     index = te_->toPlainText().lastIndexOf(capitalizeAfter);
-                if (index != -1 && index == pos - capitalizeAfter.matchedLength()) {
-                    capitalizeNext_ = true;
-                }
+                capitalizeNext_ = startsSentence(pos);
             }
 
             if (capitalizeNext_) {
@@ -175,7 +198,8 @@ ChatEdit::ChatEdit(QWidget *parent) :
 
     previous_position_ = 0;
     setCheckSpelling(checkSpellingGloballyEnabled());
-    connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, &ChatEdit::optionsChanged);
+    for (const QLatin1String &name : { spellOption, capOption, audioMessage })
+        PsiOptions::watch(name, this, [this](const QString &option) { optionsChanged(option); });
     typedMsgsIndex = 0;
     initActions();
     setShortcuts();
@@ -260,7 +284,7 @@ void ChatEdit::setCheckSpelling(bool b)
     check_spelling_ = b;
     if (check_spelling_) {
         if (!spellhighlighter_)
-            spellhighlighter_.reset(new SpellHighlighter(document()));
+            spellhighlighter_.reset(new SpellCheckHighlighter(document()));
     } else {
         spellhighlighter_.reset();
     }
@@ -331,8 +355,8 @@ void ChatEdit::contextMenuEvent(QContextMenuEvent *e)
         tc.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
         QString selected_word = tc.selectedText();
         if (!selected_word.isEmpty() && !QRegExp("\\d+").exactMatch(selected_word)
-            && !SpellChecker::instance()->isCorrect(selected_word)) {
-            QList<QString> suggestions = SpellChecker::instance()->suggestions(selected_word);
+            && !SpellCheckService::instance()->isCorrect(selected_word)) {
+            QList<QString> suggestions = SpellCheckService::instance()->suggestions(selected_word);
             if (!suggestions.isEmpty() || SpellChecker::instance()->writable()) {
                 QMenu spell_menu;
                 if (!suggestions.isEmpty()) {
@@ -402,7 +426,8 @@ void ChatEdit::addToDictionary()
     // Get the selected word
     tc.movePosition(QTextCursor::StartOfWord, QTextCursor::MoveAnchor);
     tc.movePosition(QTextCursor::EndOfWord, QTextCursor::KeepAnchor);
-    SpellChecker::instance()->add(tc.selectedText());
+    if (SpellCheckService::instance()->add(tc.selectedText()) && spellhighlighter_)
+        spellhighlighter_->rehighlight();
 
     // Put the cursor where it belongs
     tc.clearSelection();
@@ -19,8 +19,11 @@
 
 #include "mucaffiliationsmodel.h"
 
+#include "jidutil.h"
+
 #include <QFont>
 #include <QMimeData>
+#include <QSet>
 #include <QVariant>
 
 using namespace XMPP;
@@ -79,7 +82,7 @@ bool MUCAffiliationsModel::dropMimeData(const QMimeData *data, Qt::DropAction ac
         }
     } else if (data->hasFormat("text/plain")) {
         QString item(data->data("text/plain"));
-        if (Jid(item).isValid()) {
+        if (JIDUtil::intern(item).isValid()) {
             newItems += item;
             nb_rows++;
         }
@@ -203,65 +206,77 @@ MUCAffiliationsModel::AffiliationListIndex MUCAffiliationsModel::affiliationToIn
 
 void MUCAffiliationsModel::addItems(const QList<MUCItem> &items)
 {
-    bool dirty = false;
+    // grouped per list, each list then takes all its rows in one insertion
+    QMap<AffiliationListIndex, QList<MUCItem>> lists;
     for (const MUCItem &item : items) {
-        QModelIndex list = affiliationListIndex(item.affiliation());
-        if (list.isValid() && !item.jid().isEmpty()) {
-            if (!dirty) {
-                emit layoutAboutToBeChanged();
-            }
-            int row = rowCount(list);
-            if (row == 0) {
-                enabled_[AffiliationListIndex(list.row())] = true;
-            }
-            insertRows(row, 1, list);
+        AffiliationListIndex i = affiliationToIndex(item.affiliation());
+        if (i != Unknown && !item.jid().isEmpty()) {
+            lists[i] += item;
+        } else {
+            qDebug("Unexpected item");
+        }
+    }
+    if (lists.isEmpty())
+        return;
+
+    emit layoutAboutToBeChanged();
+    for (auto it = lists.constBegin(); it != lists.constEnd(); ++it) {
+        QModelIndex list = index(it.key(), 0, QModelIndex());
+        int         row  = rowCount(list);
+        if (row == 0) {
+            enabled_[it.key()] = true;
+        }
+        insertRows(row, it.value().size(), list);
+        for (const MUCItem &item : it.value()) {
             setData(index(row, 0, list), QVariant(item.jid().full()));
             setData(index(row, 1, list), QVariant(item.reason()));
             MUCItem i(MUCItem::UnknownRole, item.affiliation());
             i.setJid(item.jid());
             items_ += i;
-            dirty = true;
-        } else {
-            qDebug("Unexpected item");
+            ++row;
         }
     }
-    if (dirty)
-        emit layoutChanged();
+    emit layoutChanged();
 }
 
 QList<MUCItem> MUCAffiliationsModel::changes() const
 {
-    QList<MUCItem> items_old = items_;
+    // an item is the same when both affiliation and full jid match
+    auto key = [](MUCItem::Affiliation a, const Jid &jid) { return QString::number(a) + ' ' + jid.full(); };
+
+    QSet<QString> items_orig;
+    items_orig.reserve(items_.size());
+    for (const MUCItem &item : items_)
+        items_orig.insert(key(item.affiliation(), item.jid()));
+
     QList<MUCItem> items_delta;
+    QSet<QString>  items_kept;
+    QSet<QString>  delta_bare;
 
     // Add all new items
     for (int i = 0; i < rowCount(QModelIndex()); i++) {
         QModelIndex list = index(i, 0, QModelIndex());
         for (int j = 0; j < rowCount(list); j++) {
-            Jid     jid(data(index(j, 0, list)).toString());
-            MUCItem item(MUCItem::UnknownRole, indexToAffiliation(i));
-            item.setJid(jid);
-            if (!items_.contains(item)) {
+            const Jid     jid = JIDUtil::intern(data(index(j, 0, list)).toString());
+            const QString k = key(indexToAffiliation(i), jid);
+            if (!items_orig.contains(k)) {
+                MUCItem item(MUCItem::UnknownRole, indexToAffiliation(i));
+                item.setJid(jid);
                 items_delta += item;
+                delta_bare.insert(jid.bare());
             } else
-                items_old.removeAll(item);
+                items_kept.insert(k);
         }
     }
 
     // Remove all old items not present in the delta
-    for (const MUCItem &item_old : items_old) {
-        bool found = false;
-        for (const MUCItem &item_new : qAsConst(items_delta)) {
-            if (item_new.jid().compare(item_old.jid(), false)) {
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            MUCItem item(MUCItem::UnknownRole, MUCItem::NoAffiliation);
-            item.setJid(item_old.jid());
-            items_delta += item;
-        }
+    for (const MUCItem &item_old : items_) {
+        if (items_kept.contains(key(item_old.affiliation(), item_old.jid()))
+            || delta_bare.contains(item_old.jid().bare()))
+            continue;
+        MUCItem item(MUCItem::UnknownRole, MUCItem::NoAffiliation);
+        item.setJid(item_old.jid());
+        items_delta += item;
     }
 
     return items_delta;
@@ -26,6 +26,8 @@
 MUCAffiliationsView::MUCAffiliationsView(QWidget *parent) : QTreeView(parent)
 {
     setRootIsDecorated(false);
+    // lists of big rooms have thousands of rows, only the visible ones get laid out then
+    setUniformRowHeights(true);
     header()->setSectionResizeMode(QHeaderView::ResizeToContents);
     setItemsExpandable(false);
     setDragEnabled(true);
@@ -32,6 +32,7 @@
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psicontact.h"
+#include "transferscheduler.h"
 #include "ui_multifiletransferdlg.h"
 #include "userlist.h"
 #include "xmpp/jid/jid.h"
@@ -44,21 +45,71 @@
 #include <QFileDialog>
 #include <QFileIconProvider>
 #include <QFileInfo>
+#include <QFutureWatcher>
+#include <QImageReader>
 #include <QMimeData>
 #include <QMimeDatabase>
 #include <QNetworkReply>
 #include <QPainter>
+#include <QThreadPool>
+#include <QtConcurrent>
 #include <xmpp_tasks.h>
 
 using namespace XMPP;
 
+// side of the thumbnail shown in the list
+#define MFT_ICON_SIZE 64
+
+struct MFTThumbnail {
+    QImage     icon;
+    QByteArray png; // protocol thumbnail
+    QSize      pngSize;
+};
+
+// runs in thumbnailer threads. images are decoded right at the reduced size where the format allows it
+static MFTThumbnail makeThumbnail(const QString &fileName, int pngSide)
+{
+    MFTThumbnail ret;
+    QImageReader reader(fileName);
+    QSize        size = reader.size();
+    int          side = qMax(MFT_ICON_SIZE, pngSide);
+    if (size.isValid() && (size.width() > side || size.height() > side))
+        reader.setScaledSize(size.scaled(side, side, Qt::KeepAspectRatio));
+    QImage img = reader.read();
+    if (img.isNull())
+        return ret;
+
+    auto   scaled = img.scaled(MFT_ICON_SIZE, MFT_ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    QImage back(MFT_ICON_SIZE, MFT_ICON_SIZE, QImage::Format_ARGB32_Premultiplied);
+    back.fill(Qt::transparent);
+    {
+        QPainter painter(&back);
+        auto     imgRect = scaled.rect();
+        imgRect.moveCenter(back.rect().center());
+        painter.drawImage(imgRect, scaled);
+    }
+    ret.icon = std::move(back);
+
+    auto    thumb = ret.icon.scaled(pngSide, pngSide, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    QBuffer buffer(&ret.png);
+    buffer.open(QIODevice::WriteOnly);
+    thumb.save(&buffer, "PNG");
+    ret.pngSize = thumb.size();
+    return ret;
+}
+
 class MultiFileTransferDlg::Private {
 public:
-    PsiAccount *                    account;
-    Jid                             peer;
-    QPointer<XMPP::Jingle::Session> session;
-    MultiFileTransferModel *        model      = nullptr;
-    bool                            isOutgoing = false;
+    PsiAccount *                                    account;
+    Jid                                             peer;
+    QPointer<XMPP::Jingle::Session>                 session;
+    MultiFileTransferModel *                        model      = nullptr;
+    bool                                            isOutgoing = false;
+    QThreadPool                                     thumbnailer;
+    QHash<MultiFileTransferItem *, XMPP::Thumbnail> thumbnails;     // made by the thumbnailer
+    QSet<MultiFileTransferItem *>                   pendingThumbs;  // being made
+    QSet<MultiFileTransferItem *>                   addWhenThumbed; // appended to a started session
+    bool                                            sendWhenThumbed = false;
 };
 
 MultiFileTransferDlg::MultiFileTransferDlg(PsiAccount *acc, QWidget *parent) :
@@ -167,20 +218,10 @@ void MultiFileTransferDlg::initOutgoing(const XMPP::Jid &jid, const QStringList
 
     connect(ui->buttonBox->button(QDialogButtonBox::Apply), &QPushButton::clicked, this, [this]() {
         ui->buttonBox->button(QDialogButtonBox::Apply)->setEnabled(false);
-        d->session = d->account->client()->jingleManager()->newSession(d->peer);
-        setupSessionSignals();
-
-        for (int i = 0; i < d->model->rowCount() - 1; ++i) {
-            auto      index = d->model->index(i, 0, QModelIndex());
-            auto      item  = reinterpret_cast<MultiFileTransferItem *>(index.internalPointer());
-            QFileInfo fi(item->filePath());
-            if (!fi.isReadable()) {
-                delete item;
-                continue;
-            }
-            addTransferContent(item);
-        }
-        d->session->initiate();
+        if (d->pendingThumbs.isEmpty())
+            startOutgoingSession();
+        else
+            d->sendWhenThumbed = true; // thumbnails go with the offer
     });
 
     ui->lblPeerAvatar->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -350,6 +391,24 @@ void MultiFileTransferDlg::accept()
     QDialog::accept();
 }
 
+void MultiFileTransferDlg::startOutgoingSession()
+{
+    d->session = d->account->client()->jingleManager()->newSession(d->peer);
+    setupSessionSignals();
+
+    for (int i = 0; i < d->model->rowCount() - 1; ++i) {
+        auto      index = d->model->index(i, 0, QModelIndex());
+        auto      item  = reinterpret_cast<MultiFileTransferItem *>(index.internalPointer());
+        QFileInfo fi(item->filePath());
+        if (!fi.isReadable()) {
+            delete item;
+            continue;
+        }
+        addTransferContent(item);
+    }
+    d->session->initiate();
+}
+
 void MultiFileTransferDlg::addTransferContent(MultiFileTransferItem *item)
 {
     QMimeDatabase mimeDb;
@@ -360,19 +419,35 @@ void MultiFileTransferDlg::addTransferContent(MultiFileTransferItem *item)
         return;
     }
 
-    connect(app, &Jingle::FileTransfer::Application::deviceRequested, item, [app, item](quint64 offset, quint64 size) {
-        auto f = new QFile(item->filePath(), app);
-        f->open(QIODevice::ReadOnly);
-        f->seek(qint64(offset));
-        app->setDevice(f);
-        Q_UNUSED(size);
-    });
+    connect(app, &Jingle::FileTransfer::Application::deviceRequested, item,
+            [this, app, item](quint64 offset, quint64 size) {
+                Q_UNUSED(size);
+                // the data starts to flow when the scheduler has a free slot
+                QPointer<Jingle::FileTransfer::Application> guard(app);
+                auto                                        scheduler = d->account->psi()->transferScheduler();
+                auto                                        account   = d->account;
+                QString                                     filePath  = item->filePath();
+                scheduler->schedule(account, TransferScheduler::Normal, [=]() -> QObject * {
+                    if (!guard || guard->state() >= Jingle::State::Finishing)
+                        return nullptr;
+                    auto f = new QFile(filePath, guard);
+                    f->open(QIODevice::ReadOnly);
+                    f->seek(qint64(offset));
+                    guard->setDevice(scheduler->throttle(f, account, TransferScheduler::Normal));
+                    connect(guard, &Jingle::FileTransfer::Application::stateChanged, scheduler,
+                            [=](Jingle::State state) {
+                                if (state >= Jingle::State::Finishing)
+                                    scheduler->release(guard);
+                            });
+                    return guard;
+                });
+            });
     setupCommonSignals(app, item);
 
     // take thumbnail
-    XMPP::Thumbnail thumb;
-    auto            icon = item->thumbnail();
-    if (!icon.isNull()) {
+    XMPP::Thumbnail thumb = d->thumbnails.value(item);
+    auto            icon  = item->thumbnail();
+    if (!d->thumbnails.contains(item) && !icon.isNull()) { // not an image, send the file type icon
         auto       sz = QFontInfo(font()).pixelSize() * 4;
         QPixmap    p  = icon.pixmap(QSize(sz, sz));
         QByteArray ba;
@@ -392,23 +467,14 @@ void MultiFileTransferDlg::appendOutgoing(const QStringList &fileList)
         QFileInfo fi(fname);
         if (fi.isFile() && fi.isReadable()) {
             auto mftItem = d->model->addTransfer(MultiFileTransferModel::Outgoing, fi.fileName(), quint64(fi.size()));
-
-            QImage img(fi.filePath());
-            if (!img.isNull()) {
-                img = img.scaled(64, 64, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-                QImage back(64, 64, QImage::Format_ARGB32_Premultiplied);
-                back.fill(Qt::transparent);
-                QPainter painter(&back);
-                auto     imgRect = img.rect();
-                imgRect.moveCenter(back.rect().center());
-                painter.drawImage(imgRect, img);
-                mftItem->setThumbnail(QIcon(QPixmap::fromImage(std::move(back))));
-            } else {
-                mftItem->setThumbnail(QFileIconProvider().icon(fi));
-            }
-
+            mftItem->setThumbnail(QFileIconProvider().icon(fi)); // until the image thumbnail is ready
             mftItem->setFileName(fname);
-            if (d->session) {
+
+            if (QMimeDatabase().mimeTypeForFile(fi, QMimeDatabase::MatchExtension).name().startsWith("image/")) {
+                makeThumbnailAsync(mftItem);
+                if (d->session)
+                    d->addWhenThumbed.insert(mftItem);
+            } else if (d->session) {
                 addTransferContent(mftItem);
             }
         }
@@ -416,6 +482,43 @@ void MultiFileTransferDlg::appendOutgoing(const QStringList &fileList)
     updateComonVisuals();
 }
 
+void MultiFileTransferDlg::makeThumbnailAsync(MultiFileTransferItem *item)
+{
+    d->pendingThumbs.insert(item);
+    connect(item, &QObject::destroyed, this, [this, item]() {
+        d->pendingThumbs.remove(item);
+        d->addWhenThumbed.remove(item);
+        d->thumbnails.remove(item);
+        if (d->sendWhenThumbed && d->pendingThumbs.isEmpty()) {
+            d->sendWhenThumbed = false;
+            startOutgoingSession();
+        }
+    });
+
+    QPointer<MultiFileTransferItem> guard(item);
+    auto                            watcher = new QFutureWatcher<MFTThumbnail>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, guard]() {
+        watcher->deleteLater();
+        MultiFileTransferItem *item = guard.data();
+        if (!item || !d->pendingThumbs.remove(item))
+            return;
+        auto t = watcher->result();
+        if (!t.icon.isNull()) {
+            item->setThumbnail(QIcon(QPixmap::fromImage(t.icon)));
+            d->thumbnails.insert(item, XMPP::Thumbnail(t.png, "image/png", quint32(t.pngSize.width()),
+                                                       quint32(t.pngSize.height())));
+        }
+        if (d->addWhenThumbed.remove(item) && d->session)
+            addTransferContent(item);
+        if (d->sendWhenThumbed && d->pendingThumbs.isEmpty()) {
+            d->sendWhenThumbed = false;
+            startOutgoingSession();
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&d->thumbnailer, makeThumbnail, item->filePath(),
+                                         QFontInfo(font()).pixelSize() * 4));
+}
+
 void MultiFileTransferDlg::setupSessionSignals()
 {
     if (!d->session) {
@@ -75,8 +75,10 @@ private:
     void updatePeerVisuals();
     void updateMyVisuals();
     void updateComonVisuals();
+    void startOutgoingSession();
     void addTransferContent(MultiFileTransferItem *item);
     void appendOutgoing(const QStringList &fileList);
+    void makeThumbnailAsync(MultiFileTransferItem *item);
     void setupSessionSignals();
     void setupCommonSignals(XMPP::Jingle::FileTransfer::Application *app, MultiFileTransferItem *item);
 
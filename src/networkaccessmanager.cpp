@@ -23,6 +23,9 @@
 #include "bytearrayreply.h"
 
 #include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
 #include <QTimer>
 
 NetworkAccessManager::NetworkAccessManager(QObject *parent) : QNetworkAccessManager(parent), _handlerSeed(0) { }
@@ -34,23 +37,17 @@ QNetworkReply *NetworkAccessManager::createRequest(Operation op, const QNetworkR
         return QNetworkAccessManager::createRequest(op, req, outgoingData);
     }
 
-    QNetworkReply *reply = nullptr;
-    QByteArray     data;
-    QByteArray     mime;
-
-    QString path = req.url().path();
-    for (auto &h : _streamHandlers) {
-        if (path.startsWith(h.first)) {
-            reply = h.second(req);
-            if (reply) {
-                reply->setParent(this);
-                return reply;
-            } else {
-                return new NAMNotFoundReply(this);
-            }
-        }
+    bool           matched = false;
+    QNetworkReply *reply   = routedReply(req, &matched);
+    if (matched) {
+        if (!reply)
+            return new NAMNotFoundReply(this);
+        connect(reply, SIGNAL(finished()), SLOT(callFinished()));
+        return reply;
     }
 
+    QByteArray data;
+    QByteArray mime;
     for (auto &handler : _pathHandlers) {
         if (handler(req, data, mime)) {
             reply = new ByteArrayReply(req, data, mime, this);
@@ -74,6 +71,45 @@ QNetworkReply *NetworkAccessManager::createRequest(Operation op, const QNetworkR
     return reply;
 }
 
+// the path itself first, then the directories it is in from the deepest up
+QNetworkReply *NetworkAccessManager::routedReply(const QNetworkRequest &req, bool *matched)
+{
+    if (_routes.isEmpty())
+        return nullptr;
+
+    const QString path = req.url().path();
+    for (int len = path.size(); len > 0; len = len > 1 ? path.lastIndexOf('/', len - 2) + 1 : 0) {
+        auto it = _routes.constFind(path.left(len));
+        if (it == _routes.constEnd())
+            continue;
+
+        if (it->stream) {
+            *matched             = true;
+            QNetworkReply *reply = it->stream(req);
+            if (reply)
+                reply->setParent(this);
+            return reply;
+        }
+        QByteArray mime;
+        if (it->device) {
+            QIODevice *dev = it->device(req, mime);
+            if (dev) {
+                *matched = true;
+                return new NAMDeviceReply(req, dev, mime, this);
+            }
+        }
+        QByteArray data;
+        for (const Handler &handler : it->paths) {
+            if (handler(req, data, mime)) {
+                *matched = true;
+                return new ByteArrayReply(req, data, mime, this);
+            }
+        }
+        // not here, maybe a shorter prefix has it
+    }
+    return nullptr;
+}
+
 void NetworkAccessManager::callFinished()
 {
     QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
@@ -96,12 +132,17 @@ void NetworkAccessManager::unregisterSessionHandler(const QString &id) { _sessio
 
 void NetworkAccessManager::route(const QString &path, const NetworkAccessManager::StreamHandler &handler)
 {
-    auto it = _streamHandlers.begin();
-    while (it != _streamHandlers.end()) {
-        if (path.startsWith(it->first))
-            break;
-    }
-    _streamHandlers.insert(it, std::make_pair(path, handler));
+    _routes[path].stream = handler;
+}
+
+void NetworkAccessManager::registerPathHandler(const QString &prefix, const Handler &handler)
+{
+    _routes[prefix].paths.append(handler);
+}
+
+void NetworkAccessManager::registerDeviceHandler(const QString &prefix, const DeviceHandler &handler)
+{
+    _routes[prefix].device = handler;
 }
 
 NAMNotFoundReply::NAMNotFoundReply(QObject *parent) : QNetworkReply(parent)
@@ -120,3 +161,41 @@ NAMNotFoundReply::NAMNotFoundReply(QObject *parent) : QNetworkReply(parent)
 qint64 NAMNotFoundReply::readData(char *, qint64) { return 0; }
 
 void NAMNotFoundReply::abort() { }
+
+NAMDeviceReply::NAMDeviceReply(const QNetworkRequest &request, QIODevice *device, const QByteArray &mime,
+                               QObject *parent) :
+    QNetworkReply(parent),
+    device_(device)
+{
+    setRequest(request);
+    setOpenMode(QIODevice::ReadOnly);
+    device->setParent(this);
+    connect(device, &QIODevice::readyRead, this, &NAMDeviceReply::readyRead);
+
+    setHeader(QNetworkRequest::ContentTypeHeader, mime.isEmpty() ? QByteArray("application/octet-stream") : mime);
+    if (!device->isSequential())
+        setHeader(QNetworkRequest::ContentLengthHeader, device->size());
+    // a file is the same as long as its time and size are
+    if (auto f = qobject_cast<QFile *>(device)) {
+        QFileInfo fi(*f);
+        setRawHeader("ETag",
+                     '"' + QByteArray::number(fi.lastModified().toMSecsSinceEpoch(), 16) + '-'
+                         + QByteArray::number(fi.size(), 16) + '"');
+    }
+    QTimer::singleShot(0, this, &NAMDeviceReply::metaDataChanged);
+    QTimer::singleShot(0, this, &NAMDeviceReply::readyRead);
+}
+
+void NAMDeviceReply::abort() { }
+
+qint64 NAMDeviceReply::bytesAvailable() const { return device_->bytesAvailable() + QNetworkReply::bytesAvailable(); }
+
+qint64 NAMDeviceReply::readData(char *data, qint64 maxlen)
+{
+    qint64 len = device_->read(data, maxlen);
+    if (device_->atEnd() && !finished_) {
+        finished_ = true;
+        QTimer::singleShot(0, this, &NAMDeviceReply::finished);
+    }
+    return len;
+}
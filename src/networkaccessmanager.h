@@ -39,17 +39,44 @@ public:
     void   abort() override;
 };
 
+// Reads the body from a device as the view asks for it, instead of copying all of it into the reply first
+class NAMDeviceReply : public QNetworkReply {
+    Q_OBJECT
+public:
+    // takes the opened device
+    NAMDeviceReply(const QNetworkRequest &request, QIODevice *device, const QByteArray &mime, QObject *parent);
+
+    void   abort() override;
+    bool   isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+
+private:
+    QIODevice *device_;
+    bool       finished_ = false;
+};
+
 class NetworkAccessManager : public QNetworkAccessManager {
 
     Q_OBJECT
 public:
     using Handler       = std::function<bool(const QNetworkRequest &req, QByteArray &data, QByteArray &mime)>;
     using StreamHandler = std::function<QNetworkReply *(const QNetworkRequest &req)>;
+    // returns an opened device with the body or nullptr
+    using DeviceHandler = std::function<QIODevice *(const QNetworkRequest &req, QByteArray &mime)>;
 
     NetworkAccessManager(QObject *parent = nullptr);
 
+    // asked for every path nothing is routed for
     inline void registerPathHandler(const Handler &&handler) { _pathHandlers.append(std::move(handler)); }
 
+    // prefix is a path ending with a slash for everything below it, or a full path. the deepest one matching
+    // a request is asked first
+    void registerPathHandler(const QString &prefix, const Handler &handler);
+    void registerDeviceHandler(const QString &prefix, const DeviceHandler &handler);
+
     QString registerSessionHandler(const Handler &&handler);
     void    unregisterSessionHandler(const QString &id);
 
@@ -58,6 +85,7 @@ public:
     void releaseHandlers()
     {
         _pathHandlers.clear();
+        _routes.clear();
         _sessionHandlers.clear();
     }
 
@@ -74,10 +102,18 @@ protected:
     QNetworkReply *createRequest(Operation op, const QNetworkRequest &req, QIODevice *outgoingData);
 
 private:
-    int                                      _handlerSeed;
-    QList<std::pair<QString, StreamHandler>> _streamHandlers;
-    QList<Handler>                           _pathHandlers;
-    QHash<QString, Handler>                  _sessionHandlers;
+    struct Route {
+        StreamHandler  stream;
+        QList<Handler> paths;
+        DeviceHandler  device;
+    };
+
+    QNetworkReply *routedReply(const QNetworkRequest &req, bool *matched);
+
+    int                     _handlerSeed;
+    QHash<QString, Route>   _routes; // prefix -> its handlers
+    QList<Handler>          _pathHandlers;
+    QHash<QString, Handler> _sessionHandlers;
 };
 
 #endif // NETWORKACCESSMANAGER_H
@@ -1,6 +1,7 @@
 #include "opt_input.h"
 
 #include "psioptions.h"
+#include "spellcheckservice.h"
 #include "spellchecker/spellchecker.h"
 #include "ui_opt_input.h"
 
@@ -61,9 +62,9 @@ void OptionsTabInput::applyOptions()
         return;
     }
 
-    OptInputUI *  d = static_cast<OptInputUI *>(w_);
-    PsiOptions *  o = PsiOptions::instance();
-    SpellChecker *s = SpellChecker::instance();
+    OptInputUI *       d = static_cast<OptInputUI *>(w_);
+    PsiOptions *       o = PsiOptions::instance();
+    SpellCheckService *s = SpellCheckService::instance();
 
     bool isEnabled = d->isSpellCheck->isChecked();
     o->setOption(ENABLED_OPTION, isEnabled);
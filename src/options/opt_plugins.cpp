@@ -125,6 +125,16 @@ void OptionsTabPlugins::listPlugins()
         item->setText(C_NAME, truncatedPluginName);
         item->setText(C_VERSION, pm->version(shortName));
         item->setTextAlignment(C_VERSION, Qt::AlignHCenter);
+        const PluginHookStats stats = pm->hookStats(shortName);
+        if (stats.calls > 0) {
+            auto ms = [](qint64 ns) { return QString::number(ns / 1000000.0, 'f', 2); };
+            item->setText(C_CPU, tr("%1 ms").arg(ms(stats.total)));
+            item->setToolTip(C_CPU,
+                             tr("%1 calls, %2 ms in total\np99 %3 ms, max %4 ms")
+                                 .arg(stats.calls)
+                                 .arg(ms(stats.total), ms(stats.p99), ms(stats.max)));
+        }
+        item->setTextAlignment(C_CPU, Qt::AlignHCenter);
         item->setToolTip(C_NAME, toolTip);
         item->setCheckState(C_NAME, state);
         if (!enabled && !icon.isNull()) {
@@ -154,6 +164,7 @@ void OptionsTabPlugins::listPlugins()
         d->tw_Plugins->sortItems(C_NAME, Qt::AscendingOrder);
         d->tw_Plugins->header()->setSectionResizeMode(C_NAME, QHeaderView::Stretch);
         d->tw_Plugins->resizeColumnToContents(C_VERSION);
+        d->tw_Plugins->resizeColumnToContents(C_CPU);
         d->tw_Plugins->resizeColumnToContents(C_ABOUT);
         d->tw_Plugins->resizeColumnToContents(C_SETTS);
     }
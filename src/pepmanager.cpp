@@ -26,10 +26,17 @@
 #include "xmpp_tasks.h"
 #include "xmpp_xmlcommon.h"
 
+#include <QTextStream>
+#include <QTimer>
 #include <QtDebug>
 
 using namespace XMPP;
 
+// publishes made within this window go out together, the latest per node, milliseconds
+#define PEP_PUBLISH_DELAY 200
+// notifications heard within this window are delivered together, milliseconds
+#define PEP_NOTIFY_DELAY 250
+
 // TODO: Get affiliations upon startup, and only create nodes based on that.
 // (subscriptions is not accurate, since one doesn't subscribe to the
 // avatar data node)
@@ -418,6 +425,17 @@ private:
 PEPManager::PEPManager(Client *client, ServerInfoManager *serverInfo) : client_(client), serverInfo_(serverInfo)
 {
     connect(client_, SIGNAL(messageReceived(const Message &)), SLOT(messageReceived(const Message &)));
+    connect(client_, SIGNAL(disconnected()), SLOT(clientDisconnected()));
+
+    // not restarted by later items, so nothing waits longer than the window
+    publishTimer_ = new QTimer(this);
+    publishTimer_->setSingleShot(true);
+    publishTimer_->setInterval(PEP_PUBLISH_DELAY);
+    connect(publishTimer_, SIGNAL(timeout()), SLOT(flushPublish()));
+    notifyTimer_ = new QTimer(this);
+    notifyTimer_->setSingleShot(true);
+    notifyTimer_->setInterval(PEP_NOTIFY_DELAY);
+    connect(notifyTimer_, SIGNAL(timeout()), SLOT(flushNotify()));
 }
 
 /*void PEPManager::setAvailable(bool a)
@@ -532,9 +550,75 @@ void PEPManager::publish(const QString &node, const PubSubItem &it, Access acces
     if (!serverInfo_->hasPEP())
         return;
 
-    PEPPublishTask *tp = new PEPPublishTask(client_->rootTask(), node, it, access);
-    connect(tp, SIGNAL(finished()), SLOT(publishFinished()));
-    tp->go(true);
+    // a status change publishes mood, activity, tune.. at once, and often the same as before
+    if (!publishQueue_.contains(node))
+        publishOrder_ += node;
+    publishQueue_.insert(node, { it, access });
+    if (!publishTimer_->isActive())
+        publishTimer_->start();
+}
+
+void PEPManager::flushPublish()
+{
+    const QStringList nodes = publishOrder_;
+    publishOrder_.clear();
+    for (const QString &node : nodes) {
+        const Publish p   = publishQueue_.take(node);
+        const QString key = payloadKey(p.item);
+        if (published_.value(node) == key) {
+            // the server has it already
+            emit publish_success(node, p.item);
+            continue;
+        }
+        published_.insert(node, key);
+        PEPPublishTask *tp = new PEPPublishTask(client_->rootTask(), node, p.item, p.access);
+        connect(tp, SIGNAL(finished()), SLOT(publishFinished()));
+        tp->go(true);
+    }
+}
+
+// what is in the element, however it was built or parsed
+static void canonicalize(QTextStream &ts, const QDomElement &e)
+{
+    ts << '<' << e.localName() << ' ' << e.namespaceURI();
+    QStringList            attrs;
+    const QDomNamedNodeMap map = e.attributes();
+    for (int n = 0; n < map.count(); ++n) {
+        const QDomAttr a = map.item(n).toAttr();
+        if (a.name() != "xmlns" && !a.name().startsWith("xmlns:"))
+            attrs += a.name() + '=' + a.value();
+    }
+    attrs.sort();
+    ts << ' ' << attrs.join(' ') << '>';
+    for (QDomNode n = e.firstChild(); !n.isNull(); n = n.nextSibling()) {
+        if (n.isElement())
+            canonicalize(ts, n.toElement());
+        else if (n.isText())
+            ts << n.toText().data();
+    }
+    ts << "</>";
+}
+
+QString PEPManager::payloadKey(const PubSubItem &item)
+{
+    QString     key;
+    QTextStream ts(&key);
+    ts << item.id() << ' ';
+    canonicalize(ts, item.payload());
+    ts.flush();
+    return key;
+}
+
+void PEPManager::clientDisconnected()
+{
+    // things may change on the server while we are away
+    publishTimer_->stop();
+    publishOrder_.clear();
+    publishQueue_.clear();
+    published_.clear();
+    notifyTimer_->stop();
+    notifyOrder_.clear();
+    notifyQueue_.clear();
 }
 
 void PEPManager::retract(const QString &node, const QString &id)
@@ -563,29 +647,74 @@ void PEPManager::publishFinished()
     } else {
         qWarning() << QString("[%3] PEP Publish failed: '%1' (%2)")
                           .arg(task->statusString(), QString::number(task->statusCode()), client_->jid().full());
+        published_.remove(task->node());
         emit publish_error(task->node(), task->item());
     }
 }
 
-void PEPManager::get(const Jid &jid, const QString &node, const QString &id)
+Task *PEPManager::get(const Jid &jid, const QString &node, const QString &id)
 {
     PEPGetTask *g = new PEPGetTask(client_->rootTask(), jid.bare(), node, id);
     connect(g, SIGNAL(finished()), SLOT(getFinished()));
     g->go(true);
+    return g; // itemPublished is emitted before finished() reaches later connections
 }
 
 void PEPManager::messageReceived(const Message &m)
 {
     if (m.type() != "error") {
         const auto &psrItems = m.pubsubRetractions();
-        for (const PubSubRetraction &i : psrItems) {
-            emit itemRetracted(m.from(), m.pubsubNode(), i);
+        const auto &psItems  = m.pubsubItems();
+        if (psrItems.isEmpty() && psItems.isEmpty())
+            return;
+
+        if (m.from().compare(client_->jid(), false)) {
+            // another of our resources may have published something else
+            for (const PubSubItem &i : psItems)
+                if (published_.value(m.pubsubNode()) != payloadKey(i))
+                    published_.remove(m.pubsubNode());
+            if (!psrItems.isEmpty())
+                published_.remove(m.pubsubNode());
         }
-        const auto &psItems = m.pubsubItems();
-        for (const PubSubItem &i : psItems) {
-            emit itemPublished(m.from(), m.pubsubNode(), i);
+
+        // at login every contact sends its tune, mood.. and contacts keep changing them,
+        // only the latest of each node matters and a contact is updated once for the lot
+        const QString  key   = m.from().full();
+        QList<Notify> &queue = notifyQueue_[key];
+        if (queue.isEmpty())
+            notifyOrder_ += key;
+        auto enqueue = [&queue](const Notify &n) {
+            for (Notify &q : queue) {
+                if (q.node == n.node) {
+                    q = n;
+                    return;
+                }
+            }
+            queue += n;
+        };
+        for (const PubSubRetraction &i : psrItems)
+            enqueue({ m.from(), m.pubsubNode(), PubSubItem(), i, true });
+        for (const PubSubItem &i : psItems)
+            enqueue({ m.from(), m.pubsubNode(), i, PubSubRetraction(), false });
+        if (!notifyTimer_->isActive())
+            notifyTimer_->start();
+    }
+}
+
+void PEPManager::flushNotify()
+{
+    const QStringList jids = notifyOrder_;
+    notifyOrder_.clear();
+    for (const QString &jid : jids) {
+        const QList<Notify> queue = notifyQueue_.take(jid);
+        for (const Notify &n : queue) {
+            if (n.retracted)
+                emit itemRetracted(n.jid, n.node, n.retraction);
+            else
+                emit itemPublished(n.jid, n.node, n.item);
         }
     }
+    emit itemsDelivered();
 }
 
 /*void PEPManager::serverFeaturesChanged()
@@ -609,6 +738,7 @@ void PEPManager::getFinished()
         // implementation, probably should be changed later.
         if (!task->items().isEmpty()) {
             emit itemPublished(task->jid(), task->node(), task->items().first());
+            emit itemsDelivered();
         }
     } else {
         qWarning() << QString("[%3] PEP Get failed: '%1' (%2)")
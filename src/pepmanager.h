@@ -20,18 +20,24 @@
 #ifndef PEPMANAGER_H
 #define PEPMANAGER_H
 
+#include "xmpp_jid.h"
+#include "xmpp_pubsubitem.h"
+#include "xmpp_pubsubretraction.h"
+
+#include <QHash>
 #include <QObject>
+#include <QStringList>
 
 class PubSubSubscription;
 class QString;
+class QTimer;
 
 namespace XMPP {
 class Client;
 class Jid;
 class Message;
-class PubSubItem;
-class PubSubRetraction;
 class ServerInfoManager;
+class Task;
 }
 using namespace XMPP;
 
@@ -53,7 +59,7 @@ public:
     void publish(const QString &node, const PubSubItem &, Access = DefaultAccess);
     void retract(const QString &node, const QString &id);
     void disable(const QString &tagName, const QString &node, const QString &id);
-    void get(const Jid &jid, const QString &node, const QString &id);
+    Task *get(const Jid &jid, const QString &node, const QString &id);
 
     // void getSubscriptions(const Jid& jid);
 
@@ -62,6 +68,8 @@ signals:
     void publish_error(const QString &, const PubSubItem &);
     void itemPublished(const Jid &jid, const QString &node, const PubSubItem &);
     void itemRetracted(const Jid &jid, const QString &node, const PubSubRetraction &);
+    // a run of itemPublished/itemRetracted is over, e.g. to update the contacts that got them once
+    void itemsDelivered();
     // void ready(const QString& node);
     // void getSubscriptions_success(const Jid& jid, const QList<PubSubSubscription>& subscriptions);
     // void getSubscriptions_error(const Jid&, int, const QString&);
@@ -74,6 +82,9 @@ protected slots:
     // void getSelfSubscriptionsTaskFinished();
     // void getSubscriptionsTaskFinished();
     void publishFinished();
+    void flushPublish();
+    void flushNotify();
+    void clientDisconnected();
     // void subscribeFinished();
     // void unsubscribeFinished();
     // void createFinished();
@@ -83,9 +94,31 @@ protected:
     // void saveSubscriptions();
 
 private:
+    struct Publish {
+        PubSubItem item;
+        Access     access;
+    };
+    struct Notify {
+        Jid              jid;
+        QString          node;
+        PubSubItem       item;
+        PubSubRetraction retraction;
+        bool             retracted;
+    };
+
+    static QString payloadKey(const PubSubItem &item);
+
     XMPP::Client *     client_;
     ServerInfoManager *serverInfo_;
 
+    QStringList                   publishOrder_; // nodes in the order they were first queued
+    QHash<QString, Publish>       publishQueue_; // node -> latest item
+    QHash<QString, QString>       published_;    // node -> payloadKey() of what the server has, as we know
+    QTimer *                      publishTimer_;
+    QStringList                   notifyOrder_; // full jids in the order they were first heard of
+    QHash<QString, QList<Notify>> notifyQueue_; // full jid -> one entry per node, the latest one
+    QTimer *                      notifyTimer_;
+
     // QStringList nodes_, ensured_nodes_;
 };
 
@@ -0,0 +1,212 @@
+/*
+ * performancedlg.cpp - live runtime counters of an account
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "performancedlg.h"
+
+#include "avatars.h"
+#include "bobfilecache.h"
+#include "edbsqlite.h"
+#include "iconset.h"
+#include "psiaccount.h"
+#include "psicon.h"
+#include "psicontactlist.h"
+#include "psievent.h"
+#include "vcardfactory.h"
+
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QPainter>
+#include <QPushButton>
+#include <QTimer>
+#include <QVBoxLayout>
+
+// event loop lag probe, milliseconds
+#define PERF_PROBE_INTERVAL 5
+// counters are read and graphed this often, milliseconds
+#define PERF_SAMPLE_INTERVAL 1000
+// samples kept in a graph
+#define PERF_GRAPH_SAMPLES 180
+
+//----------------------------------------------------------------------------
+// PerformanceGraph
+//----------------------------------------------------------------------------
+// Line graph of the latest samples, scaled to the largest one shown
+class PerformanceGraph : public QWidget {
+public:
+    PerformanceGraph(const QString &title, QWidget *parent) : QWidget(parent), title_(title)
+    {
+        setMinimumSize(PERF_GRAPH_SAMPLES, 60);
+        setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding);
+    }
+
+    void addSample(double value)
+    {
+        samples_ += value;
+        if (samples_.size() > PERF_GRAPH_SAMPLES)
+            samples_.removeFirst();
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter p(this);
+        p.fillRect(rect(), palette().base());
+        double top = 1;
+        for (double v : qAsConst(samples_))
+            top = qMax(top, v);
+
+        const qreal step = qreal(width()) / (PERF_GRAPH_SAMPLES - 1);
+        QPolygonF   line;
+        for (int n = 0; n < samples_.size(); ++n)
+            line << QPointF(width() - (samples_.size() - 1 - n) * step,
+                            height() - 1 - samples_[n] / top * (height() - fontMetrics().height() - 2));
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setPen(palette().color(QPalette::Highlight));
+        p.drawPolyline(line);
+
+        p.setPen(palette().color(QPalette::Text));
+        p.drawText(rect().adjusted(2, 0, -2, 0), Qt::AlignTop | Qt::AlignLeft, title_);
+        p.drawText(rect().adjusted(2, 0, -2, 0), Qt::AlignTop | Qt::AlignRight, QString::number(top, 'g', 3));
+    }
+
+private:
+    QString         title_;
+    QVector<double> samples_;
+};
+
+//----------------------------------------------------------------------------
+// PerformanceDlg
+//----------------------------------------------------------------------------
+static QString hitRate(quint64 hits, quint64 misses)
+{
+    if (!hits && !misses)
+        return PerformanceDlg::tr("no lookups");
+    return PerformanceDlg::tr("%1% of %2 lookups").arg(hits * 100 / (hits + misses)).arg(hits + misses);
+}
+
+PerformanceDlg::PerformanceDlg(PsiAccount *_pa) : QWidget()
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowIcon(IconsetFactory::icon("psi/xml").icon());
+    pa = _pa;
+    pa->dialogRegister(this);
+    connect(pa, SIGNAL(updatedAccount()), SLOT(updateCaption()));
+    updateCaption();
+
+    QVBoxLayout *vb = new QVBoxLayout(this);
+    lagGraph_       = new PerformanceGraph(tr("Event loop lag, ms"), this);
+    stanzaGraph_    = new PerformanceGraph(tr("Stanzas per second"), this);
+    vb->addWidget(lagGraph_);
+    vb->addWidget(stanzaGraph_);
+
+    QFormLayout *fl = new QFormLayout;
+    vb->addLayout(fl);
+    lb_lag     = new QLabel(this);
+    lb_stanzas = new QLabel(this);
+    lb_edb     = new QLabel(this);
+    lb_events  = new QLabel(this);
+    lb_roster  = new QLabel(this);
+    lb_avatars = new QLabel(this);
+    lb_vcards  = new QLabel(this);
+    lb_bob     = new QLabel(this);
+    fl->addRow(tr("Event loop lag:"), lb_lag);
+    fl->addRow(tr("Stanzas:"), lb_stanzas);
+    fl->addRow(tr("History queue:"), lb_edb);
+    fl->addRow(tr("Pending events:"), lb_events);
+    fl->addRow(tr("Roster contacts:"), lb_roster);
+    fl->addRow(tr("Avatar cache:"), lb_avatars);
+    fl->addRow(tr("vCard cache:"), lb_vcards);
+    fl->addRow(tr("BoB cache:"), lb_bob);
+
+    QPushButton *pb_close = new QPushButton(tr("&Close"), this);
+    connect(pb_close, SIGNAL(clicked()), SLOT(close()));
+    QHBoxLayout *hb = new QHBoxLayout;
+    hb->addStretch(1);
+    hb->addWidget(pb_close);
+    vb->addLayout(hb);
+
+    lastReceived_ = pa->stanzasReceived();
+    lastSent_     = pa->stanzasSent();
+
+    probeTimer_ = new QTimer(this);
+    probeTimer_->setTimerType(Qt::PreciseTimer);
+    probeTimer_->setInterval(PERF_PROBE_INTERVAL);
+    connect(probeTimer_, SIGNAL(timeout()), SLOT(probe()));
+    sampleTimer_ = new QTimer(this);
+    sampleTimer_->setInterval(PERF_SAMPLE_INTERVAL);
+    connect(sampleTimer_, SIGNAL(timeout()), SLOT(sample()));
+
+    clock_.start();
+    probeTimer_->start();
+    sampleTimer_->start();
+    sample();
+
+    resize(420, 480);
+}
+
+PerformanceDlg::~PerformanceDlg() { pa->dialogUnregister(this); }
+
+void PerformanceDlg::updateCaption()
+{
+    if (pa->psi()->contactList()->enabledAccounts().count() > 1)
+        setWindowTitle(pa->name() + ": " + tr("Performance"));
+    else
+        setWindowTitle(tr("Performance"));
+}
+
+// how late the probe timer fires is how long the event loop was busy with something else
+void PerformanceDlg::probe()
+{
+    const qint64 now = clock_.nsecsElapsed() / 1000;
+    if (lastProbe_)
+        maxLag_ = qMax(maxLag_, now - lastProbe_ - PERF_PROBE_INTERVAL * 1000);
+    lastProbe_ = now;
+}
+
+void PerformanceDlg::sample()
+{
+    const double lag = maxLag_ / 1000.0;
+    maxLag_          = 0;
+    lagGraph_->addSample(lag);
+    lb_lag->setText(tr("%1 ms at most in the last second").arg(lag, 0, 'f', 1));
+
+    const quint64 received = pa->stanzasReceived();
+    const quint64 sent     = pa->stanzasSent();
+    const double  secs     = PERF_SAMPLE_INTERVAL / 1000.0;
+    stanzaGraph_->addSample((received - lastReceived_ + sent - lastSent_) / secs);
+    lb_stanzas->setText(tr("%1/s in, %2/s out").arg((received - lastReceived_) / secs).arg((sent - lastSent_) / secs));
+    lastReceived_ = received;
+    lastSent_     = sent;
+
+    EDBSqLite *edb = qobject_cast<EDBSqLite *>(pa->psi()->edb());
+    lb_edb->setText(edb ? tr("%1 requests").arg(edb->queuedRequests()) : tr("n/a"));
+    lb_events->setText(QString::number(pa->eventQueue()->count()));
+    lb_roster->setText(QString::number(pa->contactList().count()));
+
+    const FileCache::Stats avatars = AvatarFactory::cacheStats();
+    lb_avatars->setText(tr("%1, %2 KiB in memory")
+                            .arg(hitRate(avatars.hits, avatars.misses))
+                            .arg(avatars.memoryUsed / 1024));
+    const VCardFactory::Stats &vcards = VCardFactory::instance()->stats();
+    lb_vcards->setText(hitRate(vcards.hits, vcards.misses));
+    const FileCache::Stats &bob = BoBFileCache::instance()->stats();
+    lb_bob->setText(hitRate(bob.hits, bob.misses));
+}
@@ -0,0 +1,65 @@
+/*
+ * performancedlg.h - live runtime counters of an account
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PERFORMANCEDLG_H
+#define PERFORMANCEDLG_H
+
+#include <QElapsedTimer>
+#include <QWidget>
+
+class PerformanceGraph;
+class PsiAccount;
+class QLabel;
+class QTimer;
+
+// Developer window sampling event loop lag and the counters exported by the account, the history
+// database and the caches, graphed over the last minutes
+class PerformanceDlg : public QWidget {
+    Q_OBJECT
+public:
+    PerformanceDlg(PsiAccount *pa);
+    ~PerformanceDlg();
+
+private slots:
+    void probe();
+    void sample();
+    void updateCaption();
+
+private:
+    PsiAccount *      pa;
+    QTimer *          probeTimer_;
+    QTimer *          sampleTimer_;
+    QElapsedTimer     clock_;
+    qint64            lastProbe_ = 0;
+    qint64            maxLag_    = 0; // microseconds, since the last sample
+    quint64           lastReceived_;
+    quint64           lastSent_;
+    PerformanceGraph *lagGraph_;
+    PerformanceGraph *stanzaGraph_;
+    QLabel *          lb_lag;
+    QLabel *          lb_stanzas;
+    QLabel *          lb_edb;
+    QLabel *          lb_events;
+    QLabel *          lb_roster;
+    QLabel *          lb_avatars;
+    QLabel *          lb_vcards;
+    QLabel *          lb_bob;
+};
+
+#endif // PERFORMANCEDLG_H
@@ -26,17 +26,82 @@
 #include "pgputil.h"
 
 #include "gpgprocess.h"
+#include "gpgtransaction.h"
 #include "showtextdlg.h"
 
 #include <QDialog>
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QMessageBox>
 #include <QPushButton>
 #include <QStringList>
+#include <QTimer>
 #include <QtCore>
 
+// gpg writes the keyring in several steps, they are listed again once it's quiet, milliseconds
+#define PGP_RELIST_DELAY 1000
+
 PGPUtil *PGPUtil::m_instance = nullptr;
 
-PGPUtil::PGPUtil() { connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), SLOT(deleteLater())); }
+static QString gnupgHome()
+{
+    const QString home = QString::fromLocal8Bit(qgetenv("GNUPGHOME"));
+    if (!home.isEmpty())
+        return home;
+#ifdef Q_OS_WIN
+    return QString::fromLocal8Bit(qgetenv("APPDATA")) + "/gnupg";
+#else
+    return QDir::homePath() + "/.gnupg";
+#endif
+}
+
+// the public keyrings of the gpg versions around
+static QStringList keyringFiles()
+{
+    const QString home = gnupgHome();
+    return { home + "/pubring.kbx", home + "/pubring.gpg", home + "/public-keys.d/pubring.db" };
+}
+
+// changes with the keyrings but not with lock files or the trustdb
+static QString keyringStamp()
+{
+    QString stamp;
+    for (const QString &file : keyringFiles()) {
+        const QFileInfo fi(file);
+        if (fi.exists())
+            stamp += QString("%1:%2;").arg(fi.lastModified().toMSecsSinceEpoch()).arg(fi.size());
+    }
+    return stamp;
+}
+
+static QString formatFingerprint(QString fingerprint)
+{
+    if (fingerprint.size() != 40)
+        return QString();
+    for (int k = fingerprint.size() - 4; k >= 3; k -= 4) {
+        fingerprint.insert(k, ' ');
+    }
+    fingerprint.insert(24, ' ');
+    return fingerprint;
+}
+
+PGPUtil::PGPUtil()
+{
+    connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), SLOT(deleteLater()));
+
+    m_relistTimer = new QTimer(this);
+    m_relistTimer->setSingleShot(true);
+    m_relistTimer->setInterval(PGP_RELIST_DELAY);
+    connect(m_relistTimer, SIGNAL(timeout()), SLOT(listKeys()));
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, SIGNAL(directoryChanged(QString)), SLOT(keyringChanged()));
+    connect(m_watcher, SIGNAL(fileChanged(QString)), SLOT(keyringChanged()));
+    watchKeyring();
+
+    listKeys();
+}
 
 PGPUtil &PGPUtil::instance()
 {
@@ -48,9 +113,132 @@ PGPUtil &PGPUtil::instance()
 
 bool PGPUtil::pgpAvailable()
 {
-    QString    message;
-    GpgProcess gpg;
-    return gpg.info(message);
+    if (m_available < 0) {
+        // asked before the keyring listing is done
+        QString    message;
+        GpgProcess gpg;
+        m_available = gpg.info(message) ? 1 : 0;
+    }
+    return m_available == 1;
+}
+
+void PGPUtil::watchKeyring()
+{
+    // a keyring replaced by a new file drops out of the watcher, so this is done after each change
+    const QString home  = gnupgHome();
+    QStringList   paths = keyringFiles();
+    paths << home << home + "/public-keys.d";
+    for (const QString &path : qAsConst(paths)) {
+        if (QFileInfo::exists(path) && !m_watcher->files().contains(path)
+            && !m_watcher->directories().contains(path))
+            m_watcher->addPath(path);
+    }
+}
+
+void PGPUtil::keyringChanged()
+{
+    watchKeyring();
+    m_relistTimer->start();
+}
+
+void PGPUtil::listKeys()
+{
+    if (m_lister) {
+        m_relistTimer->start(); // once this one is done
+        return;
+    }
+    const QString stamp = keyringStamp();
+    if (m_keysLoaded && stamp == m_keyringStamp)
+        return;
+    m_keyringStamp = stamp;
+
+    const QStringList &&arguments
+        = { "--list-public-keys", "--with-colons", "--fixed-list-mode", "--with-fingerprint" };
+
+    m_lister = new GpgProcess(this);
+    connect(m_lister, SIGNAL(finished(int, QProcess::ExitStatus)), SLOT(keysListed()));
+    connect(m_lister, &QProcess::errorOccurred, this, [this](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
+            keysListed();
+    });
+    m_lister->start(arguments);
+}
+
+void PGPUtil::keysListed()
+{
+    GpgProcess *gpg = m_lister;
+    if (!gpg)
+        return;
+    m_lister = nullptr;
+
+    m_available = gpg->error() == QProcess::FailedToStart ? 0 : 1;
+    if (m_available && gpg->exitStatus() == QProcess::NormalExit && gpg->success()) {
+        QList<KeyInfo>      keys;
+        QHash<QString, int> index;
+        auto                addAlias = [&index, &keys](const QString &id) {
+            if (!id.isEmpty() && !index.contains(id))
+                index.insert(id, keys.size() - 1);
+        };
+
+        bool                primary = false; // fpr follows both pub and sub records
+        const QStringList &&lines   = QString::fromUtf8(gpg->readAllStandardOutput()).split("\n");
+        for (const QString &line : lines) {
+            const QString &&type = line.section(':', 0, 0);
+            if (type == "pub") {
+                keys += KeyInfo();
+                primary = true;
+            } else if (keys.isEmpty()) {
+                continue;
+            } else if (type == "sub") {
+                primary = false;
+            }
+
+            if (type == "pub" || type == "sub") {
+                const QString &&id = line.section(':', 4, 4).toUpper();
+                addAlias(id);
+                addAlias(id.right(8));
+            } else if (type == "fpr") {
+                const QString &&fingerprint = line.section(':', 9, 9).toUpper();
+                addAlias(fingerprint);
+                if (primary && keys.last().fingerprint.isEmpty())
+                    keys.last().fingerprint = formatFingerprint(fingerprint);
+            } else if (type == "uid" && keys.last().ownerName.isEmpty()) {
+                keys.last().ownerName = line.section(':', 9, 9); // Name
+            }
+        }
+        m_keys     = keys;
+        m_keyIndex = index;
+        // a signature of a key imported meanwhile verifies now
+        GpgTransactionQueue::instance()->clearVerified();
+    }
+    gpg->deleteLater();
+
+    m_keysLoaded = true;
+    const auto waiters = m_keyWaiters;
+    m_keyWaiters.clear();
+    for (const auto &w : waiters) {
+        if (w.first)
+            w.second();
+    }
+}
+
+const PGPUtil::KeyInfo *PGPUtil::findKey(const QString &key) const
+{
+    QString id = key.toUpper().remove(' ');
+    if (id.startsWith("0X"))
+        id.remove(0, 2);
+    auto it = m_keyIndex.constFind(id);
+    if (it == m_keyIndex.constEnd() && id.size() > 16)
+        it = m_keyIndex.constFind(id.right(16));
+    return it == m_keyIndex.constEnd() ? nullptr : &m_keys.at(it.value());
+}
+
+void PGPUtil::whenKeysLoaded(QObject *context, const std::function<void()> &f)
+{
+    if (m_keysLoaded)
+        f();
+    else
+        m_keyWaiters += qMakePair(QPointer<QObject>(context), f);
 }
 
 QString PGPUtil::stripHeaderFooter(const QString &str)
@@ -126,82 +314,46 @@ QString PGPUtil::getKeyOwnerName(const QString &key)
     if (key.isEmpty())
         return QString();
 
-    const QStringList &&arguments = { "--list-public-keys", "--with-colons", "--fixed-list-mode", "0x" + key };
-
-    GpgProcess gpg;
-    gpg.start(arguments);
-    gpg.waitForFinished();
-
-    if (!gpg.success())
-        return QString();
-
-    const QString &&rawData = QString::fromUtf8(gpg.readAllStandardOutput());
-    if (rawData.isEmpty())
-        return QString();
-
-    QString             name;
-    const QStringList &&stringsList = rawData.split("\n");
-    for (const QString &line : stringsList) {
-        const QString &&type = line.section(':', 0, 0);
-        if (type == "uid") {
-            name = line.section(':', 9, 9); // Name
-            break;
-        }
-    }
-    return name;
+    const KeyInfo *info = instance().findKey(key);
+    return info ? info->ownerName : QString();
 }
 
-QString PGPUtil::getPublicKeyData(const QString &key)
+QString PGPUtil::getFingerprint(const QString &key)
 {
     if (key.isEmpty())
         return QString();
 
-    const QStringList &&arguments = { "--armor", "--export", "0x" + key };
-
-    GpgProcess gpg;
-    gpg.start(arguments);
-    gpg.waitForFinished();
-
-    if (!gpg.success())
-        return QString();
-
-#ifdef Q_OS_WIN
-    QString keyData = QString::fromUtf8(gpg.readAllStandardOutput());
-    keyData.replace("\r", "");
-#else
-    const QString &&keyData = QString::fromUtf8(gpg.readAllStandardOutput());
-#endif
-    return keyData;
+    const KeyInfo *info = instance().findKey(key);
+    return info ? info->fingerprint : QString();
 }
 
-QString PGPUtil::getFingerprint(const QString &key)
+void PGPUtil::exportPublicKey(const QString &key, QObject *context,
+                              const std::function<void(const QString &)> &callback)
 {
-    const QStringList &&arguments = { "--with-colons", "--fingerprint", "0x" + key };
-
-    GpgProcess gpg;
-    gpg.start(arguments);
-    gpg.waitForFinished();
-
-    QString             fingerprint;
-    const QString &&    out   = QString::fromUtf8(gpg.readAllStandardOutput());
-    const QStringList &&lines = out.split("\n");
-    for (const QString &line : lines) {
-        const QString &&type = line.section(':', 0, 0);
-        if (type == "fpr") {
-            fingerprint = line.section(':', 9, 9);
-            break;
-        }
+    if (key.isEmpty()) {
+        callback(QString());
+        return;
     }
 
-    if (fingerprint.size() == 40) {
-        for (int k = fingerprint.size() - 4; k >= 3; k -= 4) {
-            fingerprint.insert(k, ' ');
-        }
-        fingerprint.insert(24, ' ');
-        return fingerprint;
-    }
+    const QStringList &&arguments = { "--armor", "--export", "0x" + key };
 
-    return QString();
+    // goes away with the context
+    GpgProcess *gpg = new GpgProcess(context);
+    connect(gpg, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), context, [gpg, callback]() {
+        QString keyData = gpg->success() ? QString::fromUtf8(gpg->readAllStandardOutput()) : QString();
+#ifdef Q_OS_WIN
+        keyData.replace("\r", "");
+#endif
+        gpg->deleteLater();
+        callback(keyData);
+    });
+    connect(gpg, &QProcess::errorOccurred, context, [gpg, callback](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart)
+            return;
+        gpg->deleteLater();
+        callback(QString());
+    });
+    gpg->start(arguments);
 }
 
 QString PGPUtil::chooseKey(PGPKeyDlg::Type type, const QString &key, const QString &title)
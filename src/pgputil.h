@@ -26,10 +26,17 @@
 #pragma once
 
 #include "pgpkeydlg.h"
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QPointer>
 #include <QSet>
 #include <QString>
+#include <functional>
+
+class GpgProcess;
+class QFileSystemWatcher;
+class QTimer;
 
 class PGPUtil : public QObject {
     Q_OBJECT
@@ -46,11 +53,17 @@ public:
 
     bool equals(const QString &, const QString &);
 
+    // served from the keyring listing, empty if the key isn't known or the listing isn't ready yet
     static QString getKeyOwnerName(const QString &key);
-    static QString getPublicKeyData(const QString &key);
     static QString getFingerprint(const QString &key);
     static QString chooseKey(PGPKeyDlg::Type type, const QString &key, const QString &title);
 
+    // calls f once the keyring was listed, right away if it was already
+    void        whenKeysLoaded(QObject *context, const std::function<void()> &f);
+    // armored public key, empty if gpg failed
+    static void exportPublicKey(const QString &key, QObject *context,
+                                const std::function<void(const QString &)> &callback);
+
     struct SecureMessageSignature {
         enum {
             Valid = 0,        //< indentity is verified, matches signature
@@ -71,6 +84,29 @@ protected:
     PGPUtil();
     ~PGPUtil() = default;
 
+private slots:
+    void listKeys();
+    void keysListed();
+    void keyringChanged();
+
 private:
+    struct KeyInfo {
+        QString fingerprint; // grouped as gpg prints it
+        QString ownerName;   // of the first user id
+    };
+
+    const KeyInfo *findKey(const QString &key) const;
+    void           watchKeyring();
+
     static PGPUtil *m_instance;
+
+    QList<KeyInfo>      m_keys;
+    QHash<QString, int> m_keyIndex; // long and short ids of the key and its subkeys, fingerprint => m_keys
+    bool                m_keysLoaded = false;
+    int                 m_available  = -1; // gpg could be started, -1 until known
+    GpgProcess *        m_lister     = nullptr;
+    QTimer *            m_relistTimer;
+    QFileSystemWatcher *m_watcher;
+    QString             m_keyringStamp; // of the keyrings listed last
+    QList<QPair<QPointer<QObject>, std::function<void()>>> m_keyWaiters;
 };
@@ -53,6 +53,7 @@
 #include <QAction>
 #include <QByteArray>
 #include <QDomElement>
+#include <QElapsedTimer>
 #include <QKeySequence>
 #include <QObject>
 #include <QPluginLoader>
@@ -61,7 +62,29 @@
 #include <QString>
 #include <QStringList>
 #include <QTextEdit>
+#include <QTimer>
 #include <QWidget>
+#include <algorithm>
+
+// recent hook calls kept for the p99
+#define PLUGIN_HOOK_SAMPLES 1000
+// consecutive stanza hooks over budget before the plugin is warned about
+#define PLUGIN_BUDGET_STRIKES 20
+
+#define PLUGIN_BUDGET_OPTION "options.plugins.stanza-budget"
+#define PLUGIN_AUTO_DISABLE_OPTION "options.plugins.stanza-budget-auto-disable"
+
+// times one call into the plugin
+class PluginHost::HookTimer {
+public:
+    HookTimer(PluginHost *host, bool stanzaPath) : host_(host), stanzaPath_(stanzaPath) { timer_.start(); }
+    ~HookTimer() { host_->hookFinished(timer_.nsecsElapsed(), stanzaPath_); }
+
+private:
+    PluginHost *  host_;
+    bool          stanzaPath_;
+    QElapsedTimer timer_;
+};
 
 /**
  * \brief Constructs a host/wrapper for a plugin.
@@ -80,6 +103,7 @@ PluginHost::PluginHost(PluginManager *manager, const QString &pluginFile) :
     iconset_(nullptr), valid_(false), connected_(false), enabled_(false), hasInfo_(false), infoString_(QString())
 {
     updateMetadata();
+    readBudget();
 }
 
 /**
@@ -517,9 +541,16 @@ bool PluginHost::enable()
 
         enableHandler = new QObject(this);
         enabled_      = qobject_cast<PsiPlugin *>(plugin_)->enable();
-        if (enabled_)
+        if (enabled_) {
+            StanzaWatcher *sw = qobject_cast<StanzaWatcher *>(plugin_);
+            if (sw) {
+                watches_ = sw->watchedStanzas();
+            }
+            hookCalls_  = hookTotal_ = hookMax_ = 0;
+            hookSample_ = overruns_ = 0;
+            hookSamples_.clear();
             emit enabled();
-        else
+        } else
             delete enableHandler;
     }
 
@@ -540,6 +571,7 @@ bool PluginHost::disable()
         enabled_ = !qobject_cast<PsiPlugin *>(plugin_)->disable();
         if (!enabled_) {
             delete enableHandler;
+            watches_.clear();
             emit disabled();
         }
     }
@@ -553,6 +585,49 @@ bool PluginHost::isEnabled() const { return enabled_; }
 
 //-- for StanzaFilter and IqNamespaceFilter -------------------------
 
+/**
+ * \brief Returns true if the hosted plugin implements StanzaFilter.
+ */
+bool PluginHost::isStanzaFilter() const { return qobject_cast<StanzaFilter *>(plugin_) != nullptr; }
+
+/**
+ * \brief Returns true if the plugin has registered any iq namespace filter.
+ */
+bool PluginHost::hasIqFilters() const { return !iqNsFilters_.isEmpty() || !iqNsxFilters_.isEmpty(); }
+
+/**
+ * \brief Returns the IqNamespaceFilter method handling iq of given \a type
+ *
+ * nullptr is returned for an unknown type.
+ */
+PluginHost::IqHandler PluginHost::iqHandler(const QString &type)
+{
+    if (type == "get") {
+        return &IqNamespaceFilter::iqGet;
+    } else if (type == "set") {
+        return &IqNamespaceFilter::iqSet;
+    } else if (type == "result") {
+        return &IqNamespaceFilter::iqResult;
+    } else if (type == "error") {
+        return &IqNamespaceFilter::iqError;
+    }
+    return nullptr;
+}
+
+/**
+ * \brief Returns namespace of the first namespaced child of iq stanza \a e
+ */
+QString PluginHost::iqNamespace(const QDomElement &e)
+{
+    for (QDomNode n = e.firstChild(); !n.isNull(); n = n.nextSibling()) {
+        QDomElement i = n.toElement();
+        if (!i.isNull() && !i.namespaceURI().isNull()) {
+            return i.namespaceURI();
+        }
+    }
+    return QString();
+}
+
 /**
  * \brief Give plugin the opportunity to process incoming xml
  *
@@ -563,67 +638,57 @@ bool PluginHost::isEnabled() const { return enabled_; }
  *
  * \param account Identifier of the PsiAccount responsible
  * \param xml Incoming XML (may be modified)
+ * \param iqNs Namespace of the iq stanza, see iqNamespace()
+ * \param handler Iq filter method for the iq type, nullptr if \a xml isn't iq
  * \return Continue processing the XML stanza; true if the stanza should be silently discarded.
  */
-bool PluginHost::incomingXml(int account, const QDomElement &e)
+bool PluginHost::incomingXml(int account, const QDomElement &e, const QString &iqNs, IqHandler handler)
 {
-    bool handled = false;
+    HookTimer timer(this, true);
 
     // try stanza filter first
     StanzaFilter *sf = qobject_cast<StanzaFilter *>(plugin_);
     if (sf && sf->incomingStanza(account, e)) {
-        handled = true;
+        return true;
+    }
+    if (!handler) {
+        return false;
     }
-    // try iq filters
-    else if (e.tagName() == "iq") {
-        // get iq namespace
-        QString ns;
-        for (QDomNode n = e.firstChild(); !n.isNull(); n = n.nextSibling()) {
-            QDomElement i = n.toElement();
-            if (!i.isNull() && !i.namespaceURI().isNull()) {
-                ns = i.namespaceURI();
-                break;
-            }
-        }
 
-        // choose handler function depending on iq type
-        bool (IqNamespaceFilter::*handler)(int account, const QDomElement &xml) = nullptr;
-        const QString type                                                      = e.attribute("type");
-        if (type == "get") {
-            handler = &IqNamespaceFilter::iqGet;
-        } else if (type == "set") {
-            handler = &IqNamespaceFilter::iqSet;
-        } else if (type == "result") {
-            handler = &IqNamespaceFilter::iqResult;
-        } else if (type == "error") {
-            handler = &IqNamespaceFilter::iqError;
+    // normal filters
+    for (auto it = iqNsFilters_.constFind(iqNs); it != iqNsFilters_.constEnd() && it.key() == iqNs; ++it) {
+        if ((it.value()->*handler)(account, e)) {
+            return true;
         }
+    }
 
-        if (handler) {
-            // normal filters
-            const auto &items = iqNsFilters_.values(ns);
-            for (IqNamespaceFilter *f : items) {
-                if ((f->*handler)(account, e)) {
-                    handled = true;
-                    break;
-                }
-            }
-
-            // regex filters
-            QMapIterator<QRegExp, IqNamespaceFilter *> i(iqNsxFilters_);
-            while (!handled && i.hasNext()) {
-                if (i.key().indexIn(ns) >= 0 && (i.value()->*handler)(account, e)) {
-                    handled = true;
-                }
+    // regex filters
+    if (iqNsxFilters_.isEmpty()) {
+        return false;
+    }
+    auto match = iqNsxMatches_.find(iqNs);
+    if (match == iqNsxMatches_.end()) {
+        QList<IqNamespaceFilter *> filters;
+        for (auto it = iqNsxFilters_.constBegin(); it != iqNsxFilters_.constEnd(); ++it) {
+            if (it.key().indexIn(iqNs) >= 0) {
+                filters.append(it.value());
             }
         }
+        match = iqNsxMatches_.insert(iqNs, filters);
     }
-
-    return handled;
+    // a copy, the handler may unregister filters
+    const QList<IqNamespaceFilter *> filters = match.value();
+    for (IqNamespaceFilter *f : filters) {
+        if ((f->*handler)(account, e)) {
+            return true;
+        }
+    }
+    return false;
 }
 
 bool PluginHost::outgoingXml(int account, QDomElement &e)
 {
+    HookTimer     timer(this, true);
     bool          handled = false;
     StanzaFilter *ef      = qobject_cast<StanzaFilter *>(plugin_);
     if (ef && ef->outgoingStanza(account, e)) {
@@ -632,8 +697,58 @@ bool PluginHost::outgoingXml(int account, QDomElement &e)
     return handled;
 }
 
+//-- for StanzaWatcher ----------------------------------------------
+
+/**
+ * \brief Returns true if the plugin watches any stanzas.
+ */
+bool PluginHost::isStanzaWatcher() const { return !watches_.isEmpty(); }
+
+/**
+ * \brief Checks whether a stanza matches any of the plugin's watches
+ *
+ * \param direction Whether the stanza is incoming or outgoing
+ * \param tagName Stanza element name
+ * \param childNs Namespaces of the stanza's child elements
+ * \param modify Only consider watches that want to modify the stanza
+ */
+bool PluginHost::watches(StanzaWatcher::Direction direction, const QString &tagName, const QStringList &childNs,
+                         bool modify) const
+{
+    for (const StanzaWatcher::Watch &w : watches_) {
+        if (!(w.directions & direction) || (modify && !w.modify)) {
+            continue;
+        }
+        if ((w.tagName.isEmpty() || w.tagName == tagName) && (w.ns.isEmpty() || childNs.contains(w.ns))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PluginHost::stanzaWatched(int account, StanzaWatcher::Direction direction, const QDomElement &e)
+{
+    StanzaWatcher *sw = qobject_cast<StanzaWatcher *>(plugin_);
+    if (sw) {
+        HookTimer timer(this, true);
+        sw->stanzaWatched(account, direction, e);
+    }
+}
+
+bool PluginHost::modifyOutgoingStanza(int account, QDomElement &e)
+{
+    StanzaWatcher *sw = qobject_cast<StanzaWatcher *>(plugin_);
+    if (!sw) {
+        return false;
+    }
+    HookTimer timer(this, true);
+    return sw->modifyOutgoingStanza(account, e);
+}
+
 //-- for EventFilter ------------------------------------------------
 
+bool PluginHost::isEventFilter() const { return qobject_cast<EventFilter *>(plugin_) != nullptr; }
+
 /**
  * \brief Give plugin the opportunity to process incoming event.
  *
@@ -648,6 +763,7 @@ bool PluginHost::outgoingXml(int account, QDomElement &e)
  */
 bool PluginHost::processEvent(int account, QDomElement &e)
 {
+    HookTimer    timer(this, false);
     bool         handled = false;
     EventFilter *ef      = qobject_cast<EventFilter *>(plugin_);
     if (ef && ef->processEvent(account, e)) {
@@ -673,6 +789,7 @@ bool PluginHost::processEvent(int account, QDomElement &e)
  */
 bool PluginHost::processMessage(int account, const QString &jidFrom, const QString &body, const QString &subject)
 {
+    HookTimer    timer(this, false);
     bool         handled = false;
     EventFilter *ef      = qobject_cast<EventFilter *>(plugin_);
     if (ef && ef->processMessage(account, jidFrom, body, subject)) {
@@ -684,6 +801,7 @@ bool PluginHost::processMessage(int account, const QString &jidFrom, const QStri
 bool PluginHost::processOutgoingMessage(int account, const QString &jidTo, QString &body, const QString &type,
                                         QString &subject)
 {
+    HookTimer    timer(this, false);
     bool         handled = false;
     EventFilter *ef      = qobject_cast<EventFilter *>(plugin_);
     if (ef && ef->processOutgoingMessage(account, jidTo, body, type, subject)) {
@@ -692,6 +810,63 @@ bool PluginHost::processOutgoingMessage(int account, const QString &jidTo, QStri
     return handled;
 }
 
+/**
+ * \brief Returns the time spent in the stanza and event hooks since the plugin was enabled.
+ */
+PluginHookStats PluginHost::hookStats() const
+{
+    PluginHookStats stats;
+    stats.calls = hookCalls_;
+    stats.total = hookTotal_;
+    stats.max   = hookMax_;
+    if (!hookSamples_.isEmpty()) {
+        QVector<qint64> samples = hookSamples_;
+        auto            p99     = samples.begin() + samples.size() * 99 / 100;
+        std::nth_element(samples.begin(), p99, samples.end());
+        stats.p99 = *p99;
+    }
+    return stats;
+}
+
+void PluginHost::hookFinished(qint64 nsecs, bool stanzaPath)
+{
+    ++hookCalls_;
+    hookTotal_ += nsecs;
+    if (nsecs > hookMax_) {
+        hookMax_ = nsecs;
+    }
+    if (hookSamples_.size() < PLUGIN_HOOK_SAMPLES) {
+        hookSamples_.append(nsecs);
+    } else {
+        hookSamples_[hookSample_] = nsecs;
+        hookSample_               = (hookSample_ + 1) % PLUGIN_HOOK_SAMPLES;
+    }
+
+    if (!stanzaPath || budget_ <= 0) {
+        return;
+    }
+    if (nsecs <= budget_) {
+        overruns_ = 0;
+        return;
+    }
+    if (++overruns_ != PLUGIN_BUDGET_STRIKES) {
+        return;
+    }
+    qWarning("Plugin %s exceeded its stanza budget of %lld ms %d times in a row, the last call took %.1f ms",
+             qPrintable(shortName_), budget_ / 1000000, PLUGIN_BUDGET_STRIKES, nsecs / 1000000.0);
+    if (autoDisable_) {
+        // not from inside the hook, the manager is still iterating its plugins
+        const QString option = QString("%1.%2").arg(PluginManager::loadOptionPrefix, shortName_);
+        QTimer::singleShot(0, this, [option]() { PsiOptions::instance()->setOption(option, false); });
+    }
+}
+
+void PluginHost::readBudget()
+{
+    budget_      = qint64(PsiOptions::instance()->getOption(PLUGIN_BUDGET_OPTION, 0).toInt()) * 1000000;
+    autoDisable_ = PsiOptions::instance()->getOption(PLUGIN_AUTO_DISABLE_OPTION, false).toBool();
+}
+
 void PluginHost::logout(int account)
 {
     EventFilter *ef = qobject_cast<EventFilter *>(plugin_);
@@ -789,6 +964,7 @@ void PluginHost::addIqNamespaceFilter(const QString &ns, IqNamespaceFilter *filt
 #endif
     } else {
         iqNsFilters_.insert(ns, filter);
+        manager_->updateDispatchLists();
     }
 }
 
@@ -820,6 +996,8 @@ void PluginHost::addIqNamespaceFilter(const QRegExp &ns, IqNamespaceFilter *filt
 #endif
     } else {
         iqNsxFilters_.insert(ns, filter);
+        iqNsxMatches_.clear();
+        manager_->updateDispatchLists();
     }
 }
 
@@ -832,6 +1010,7 @@ void PluginHost::addIqNamespaceFilter(const QRegExp &ns, IqNamespaceFilter *filt
 void PluginHost::removeIqNamespaceFilter(const QString &ns, IqNamespaceFilter *filter)
 {
     iqNsFilters_.remove(ns, filter);
+    manager_->updateDispatchLists();
 }
 
 /**
@@ -843,6 +1022,8 @@ void PluginHost::removeIqNamespaceFilter(const QString &ns, IqNamespaceFilter *f
 void PluginHost::removeIqNamespaceFilter(const QRegExp &ns, IqNamespaceFilter *filter)
 {
     iqNsxFilters_.remove(ns, filter);
+    iqNsxMatches_.clear();
+    manager_->updateDispatchLists();
 }
 
 //-- OptionAccessor -------------------------------------------------
@@ -915,6 +1096,8 @@ QVariant PluginHost::getGlobalOption(const QString &option) { return PsiOptions:
 
 void PluginHost::optionChanged(const QString &option)
 {
+    if (option == PLUGIN_BUDGET_OPTION || option == PLUGIN_AUTO_DISABLE_OPTION)
+        readBudget();
     OptionAccessor *oa = qobject_cast<OptionAccessor *>(plugin_);
     if (oa)
         oa->optionChanged(option);
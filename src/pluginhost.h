@@ -19,26 +19,29 @@
 #include "iqfilteringhost.h"
 #include "optionaccessinghost.h"
 #include "pluginaccessinghost.h"
+#include "pluginmanager.h"
 #include "popupaccessinghost.h"
 #include "psiaccountcontrollinghost.h"
 #include "psimediahost.h"
 #include "shortcutaccessinghost.h"
 #include "soundaccessinghost.h"
 #include "stanzasendinghost.h"
+#include "stanzawatcher.h"
 #include "tabbablewidget.h"
 #include "tabdlg.h"
 #include "userlist.h"
 #include "webkitaccessinghost.h"
 
 #include <QDomElement>
+#include <QHash>
 #include <QMultiMap>
 #include <QPointer>
 #include <QRegExp>
 #include <QTextEdit>
 #include <QVariant>
+#include <QVector>
 
 class IqNamespaceFilter;
-class PluginManager;
 class QPluginLoader;
 class QWidget;
 namespace PsiMedia {
@@ -104,16 +107,33 @@ public:
     bool isEnabled() const;
 
     // for StanzaFilter and IqNamespaceFilter
-    bool incomingXml(int account, const QDomElement &e);
+    typedef bool (IqNamespaceFilter::*IqHandler)(int account, const QDomElement &xml);
+    static IqHandler iqHandler(const QString &type);
+    static QString   iqNamespace(const QDomElement &e);
+
+    bool isStanzaFilter() const;
+    bool hasIqFilters() const;
+    bool incomingXml(int account, const QDomElement &e, const QString &iqNs, IqHandler handler);
     bool outgoingXml(int account, QDomElement &e);
 
+    // for StanzaWatcher
+    bool isStanzaWatcher() const;
+    bool watches(StanzaWatcher::Direction direction, const QString &tagName, const QStringList &childNs,
+                 bool modify) const;
+    void stanzaWatched(int account, StanzaWatcher::Direction direction, const QDomElement &e);
+    bool modifyOutgoingStanza(int account, QDomElement &e);
+
     // for EventFilter
+    bool isEventFilter() const;
     bool processEvent(int account, QDomElement &e);
     bool processMessage(int account, const QString &jidFrom, const QString &body, const QString &subject);
     bool processOutgoingMessage(int account, const QString &jidTo, QString &body, const QString &type,
                                 QString &subject);
     void logout(int account);
 
+    // time spent in the hooks above
+    PluginHookStats hookStats() const;
+
     // StanzaSendingHost
     void    sendStanza(int account, const QDomElement &xml) override;
     void    sendStanza(int account, const QString &xml) override;
@@ -272,7 +292,11 @@ public:
     void setMediaProvider(PsiMedia::Provider *provider) override;
 
 private:
+    class HookTimer;
+
     bool loadPlugin(QObject *pluginObject);
+    void hookFinished(qint64 nsecs, bool stanzaPath);
+    void readBudget();
 
 signals:
     void enabled();
@@ -304,11 +328,23 @@ private:
 
     QMultiMap<QString, IqNamespaceFilter *> iqNsFilters_;
     QMultiMap<QRegExp, IqNamespaceFilter *> iqNsxFilters_;
+    // ns -> regex filters matching it, filled on first use
+    QHash<QString, QList<IqNamespaceFilter *>> iqNsxMatches_;
+    QList<StanzaWatcher::Watch>                watches_;
     QList<QVariantHash>                     buttons_;
     QList<QVariantHash>                     gcbuttons_;
 
     QList<QVariantHash> accMenu_;
     QList<QVariantHash> contactMenu_;
+
+    qint64          hookCalls_   = 0;
+    qint64          hookTotal_   = 0; // nanoseconds
+    qint64          hookMax_     = 0; // nanoseconds
+    int             hookSample_  = 0; // next slot in hookSamples_
+    qint64          budget_      = 0; // nanoseconds per stanza hook, 0 for no budget
+    bool            autoDisable_ = false;
+    int             overruns_    = 0; // consecutive stanza hooks over budget
+    QVector<qint64> hookSamples_;     // ring of the recent calls, for p99
 };
 
 #endif // PLUGINHOST_H
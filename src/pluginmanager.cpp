@@ -109,7 +109,6 @@ void PluginManager::initNewSession(PsiCon *psi)
     psi_ = psi;
     clients_.clear();
     accountIds_.clear();
-    loadEnabledPlugins();
 }
 
 /**
@@ -132,10 +131,14 @@ QList<PluginHost *> PluginManager::updatePluginsList()
 #endif
                 if (!pluginByFile_.contains(file)) {
                     PluginHost *host = new PluginHost(this, file);
-                    connect(host, &PluginHost::enabled, this,
-                            [this, shortName = host->shortName()]() { emit pluginEnabled(shortName); });
-                    connect(host, &PluginHost::disabled, this,
-                            [this, shortName = host->shortName()]() { emit pluginDisabled(shortName); });
+                    connect(host, &PluginHost::enabled, this, [this, shortName = host->shortName()]() {
+                        updateDispatchLists();
+                        emit pluginEnabled(shortName);
+                    });
+                    connect(host, &PluginHost::disabled, this, [this, shortName = host->shortName()]() {
+                        updateDispatchLists();
+                        emit pluginDisabled(shortName);
+                    });
                     if (host->isValid() && !hosts_.contains(host->shortName())) {
                         hosts_[host->shortName()] = host;
                         pluginByFile_[file]       = host;
@@ -163,6 +166,36 @@ QList<PluginHost *> PluginManager::updatePluginsList()
     return newPlugins;
 }
 
+/**
+ * Rebuilds the per-interface lists of enabled plugins, so stanzas and events
+ * are only offered to plugins which can handle them.
+ */
+void PluginManager::updateDispatchLists()
+{
+    eventFilters_.clear();
+    stanzaFilters_.clear();
+    incomingXmlHosts_.clear();
+    stanzaWatchers_.clear();
+    for (PluginHost *host : qAsConst(pluginsByPriority_)) {
+        if (!host->isEnabled()) {
+            continue;
+        }
+        if (host->isEventFilter()) {
+            eventFilters_.append(host);
+        }
+        const bool stanzaFilter = host->isStanzaFilter();
+        if (stanzaFilter) {
+            stanzaFilters_.append(host);
+        }
+        if (stanzaFilter || host->hasIqFilters()) {
+            incomingXmlHosts_.append(host);
+        }
+        if (host->isStanzaWatcher()) {
+            stanzaWatchers_.append(host);
+        }
+    }
+}
+
 /**
  * This slot is executed when the contents of a plugin directory changes
  * It causes the available plugin list to be refreshed.
@@ -298,6 +331,18 @@ bool PluginManager::isEnabled(const QString &plugin) const
     return enabled;
 }
 
+/**
+ * Hook timings of the named plugin, empty if the plugin is not known.
+ */
+PluginHookStats PluginManager::hookStats(const QString &plugin) const
+{
+    PluginHookStats stats;
+    if (hosts_.contains(plugin)) {
+        stats = hosts_[plugin]->hookStats();
+    }
+    return stats;
+}
+
 /**
  * Find the file which provides the named plugin. If the named plugin is not
  * known, an empty string is provided.
@@ -411,7 +456,7 @@ bool PluginManager::processMessage(PsiAccount *account, const QString &jidFrom,
                                    const QString &subject)
 {
     bool handled = false;
-    for (PluginHost *host : qAsConst(pluginsByPriority_)) {
+    for (PluginHost *host : qAsConst(eventFilters_)) {
         if (host->processMessage(accountIds_.id(account), jidFrom, body, subject)) {
             handled = true;
             break;
@@ -420,6 +465,13 @@ bool PluginManager::processMessage(PsiAccount *account, const QString &jidFrom,
     return handled;
 }
 
+/**
+ * \brief Whether any enabled plugin filters events
+ *
+ * Lets callers skip preparing the event for processEvent() at all.
+ */
+bool PluginManager::hasEventFilters() const { return !eventFilters_.isEmpty(); }
+
 /**
  * \brief Give each plugin the opportunity to process the incoming event
  *
@@ -434,7 +486,7 @@ bool PluginManager::processEvent(PsiAccount *account, QDomElement &event)
 {
     bool      handled = false;
     const int acc_id  = accountIds_.id(account);
-    for (PluginHost *host : qAsConst(pluginsByPriority_)) {
+    for (PluginHost *host : qAsConst(eventFilters_)) {
         if (host->processEvent(acc_id, event)) {
             handled = true;
             break;
@@ -451,7 +503,7 @@ bool PluginManager::processOutgoingMessage(PsiAccount *account, const QString &j
 {
     bool      handled = false;
     const int acc_id  = accountIds_.id(account);
-    for (PluginHost *host : qAsConst(pluginByFile_)) {
+    for (PluginHost *host : qAsConst(eventFilters_)) {
         if (host->processOutgoingMessage(acc_id, jidTo, body, type, subject)) {
             handled = true;
             break;
@@ -460,14 +512,63 @@ bool PluginManager::processOutgoingMessage(PsiAccount *account, const QString &j
     return handled;
 }
 
+/**
+ * Give plugins the opportunity to modify and watch an outgoing stanza.
+ * Watchers wanting to modify it go first, then stanza filters, and
+ * read-only watchers get the final stanza.
+ */
 void PluginManager::processOutgoingStanza(PsiAccount *account, QDomElement &stanza)
 {
-    const int acc_id = accountIds_.id(account);
-    for (PluginHost *host : qAsConst(pluginByFile_)) {
-        if (host->outgoingXml(acc_id, stanza)) {
+    if (stanzaFilters_.isEmpty() && stanzaWatchers_.isEmpty()) {
+        return;
+    }
+
+    const int         acc_id  = accountIds_.id(account);
+    const QStringList childNs = stanzaWatchers_.isEmpty() ? QStringList() : childNamespaces(stanza);
+    bool              handled = false;
+    for (PluginHost *host : qAsConst(stanzaWatchers_)) {
+        if (host->watches(StanzaWatcher::Outgoing, stanza.tagName(), childNs, true)
+            && host->modifyOutgoingStanza(acc_id, stanza)) {
+            handled = true;
             break;
         }
     }
+    if (!handled) {
+        for (PluginHost *host : qAsConst(stanzaFilters_)) {
+            if (host->outgoingXml(acc_id, stanza)) {
+                break;
+            }
+        }
+    }
+    watchStanza(acc_id, StanzaWatcher::Outgoing, stanza);
+}
+
+/**
+ * Passes a stanza to the watchers interested in it, read-only.
+ */
+void PluginManager::watchStanza(int account, StanzaWatcher::Direction direction, const QDomElement &stanza)
+{
+    if (stanzaWatchers_.isEmpty()) {
+        return;
+    }
+    const QString     tagName = stanza.tagName();
+    const QStringList childNs = childNamespaces(stanza);
+    for (PluginHost *host : qAsConst(stanzaWatchers_)) {
+        if (host->watches(direction, tagName, childNs, false)) {
+            host->stanzaWatched(account, direction, stanza);
+        }
+    }
+}
+
+QStringList PluginManager::childNamespaces(const QDomElement &stanza)
+{
+    QStringList ns;
+    for (QDomElement e = stanza.firstChildElement(); !e.isNull(); e = e.nextSiblingElement()) {
+        if (!e.namespaceURI().isEmpty() && !ns.contains(e.namespaceURI())) {
+            ns.append(e.namespaceURI());
+        }
+    }
+    return ns;
 }
 
 /**
@@ -528,13 +629,31 @@ QList<OAH_PluginOptionsTab *> PluginManager::settingsPages() const { return sett
  */
 bool PluginManager::incomingXml(int account, const QDomElement &xml)
 {
+    if (incomingXmlHosts_.isEmpty()) {
+        watchStanza(account, StanzaWatcher::Incoming, xml);
+        return false;
+    }
+
+    // iq namespace and handler are the same for all plugins
+    QString               ns;
+    PluginHost::IqHandler handler = nullptr;
+    if (xml.tagName() == "iq") {
+        handler = PluginHost::iqHandler(xml.attribute("type"));
+        if (handler) {
+            ns = PluginHost::iqNamespace(xml);
+        }
+    }
+
     bool handled = false;
-    for (PluginHost *host : qAsConst(pluginsByPriority_)) {
-        if (host->incomingXml(account, xml)) {
+    // a copy, plugins may register filters while handling
+    const QList<PluginHost *> hosts = incomingXmlHosts_;
+    for (PluginHost *host : hosts) {
+        if (host->incomingXml(account, xml, ns, handler)) {
             handled = true;
             break;
         }
     }
+    watchStanza(account, StanzaWatcher::Incoming, xml);
     return handled;
 }
 
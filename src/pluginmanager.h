@@ -7,6 +7,7 @@
 #define PLUGINMANAGER_H
 
 #include "psiplugin.h"
+#include "stanzawatcher.h"
 
 #include <QDomElement>
 #include <QHash>
@@ -33,6 +34,14 @@ namespace XMPP {
 class Client;
 }
 
+// time spent in the hooks of one plugin since it was enabled
+struct PluginHookStats {
+    qint64 calls = 0;
+    qint64 total = 0; // nanoseconds
+    qint64 p99   = 0; // nanoseconds, of the recent calls
+    qint64 max   = 0; // nanoseconds
+};
+
 namespace PsiMedia {
 class Provider;
 }
@@ -65,9 +74,10 @@ public:
     void loadEnabledPlugins();
     bool unloadAllPlugins();
 
-    bool    isAvailable(const QString &plugin) const;
-    bool    isEnabled(const QString &plugin) const;
-    QString pathToPlugin(const QString &plugin) const;
+    bool            isAvailable(const QString &plugin) const;
+    bool            isEnabled(const QString &plugin) const;
+    QString         pathToPlugin(const QString &plugin) const;
+    PluginHookStats hookStats(const QString &plugin) const;
     // QString  shortName(const QString &plugin) const;
     QString  pluginName(const QString &shortName) const;
     QString  version(const QString &plugin) const;
@@ -77,6 +87,7 @@ public:
 
     void setShortcuts();
 
+    bool hasEventFilters() const;
     bool processEvent(PsiAccount *account, QDomElement &eventXml);
     bool processMessage(PsiAccount *account, const QString &jidFrom, const QString &body, const QString &subject);
     bool processOutgoingMessage(PsiAccount *account, const QString &jidTo, QString &body, const QString &type,
@@ -133,6 +144,9 @@ private:
     bool                verifyStanza(const QString &stanza);
     QList<PluginHost *> updatePluginsList();
     void                loadPluginIfEnabled(PluginHost *plugin);
+    void                updateDispatchLists();
+    void                watchStanza(int account, StanzaWatcher::Direction direction, const QDomElement &stanza);
+    static QStringList  childNamespaces(const QDomElement &stanza);
 
     static PluginManager *instance_;
 
@@ -148,6 +162,14 @@ private:
     QMap<QString, PluginHost *> pluginByFile_;
     // sorted by priority
     QList<PluginHost *> pluginsByPriority_;
+    // enabled ones implementing EventFilter, sorted by priority
+    QList<PluginHost *> eventFilters_;
+    // enabled ones implementing StanzaFilter, sorted by priority
+    QList<PluginHost *> stanzaFilters_;
+    // enabled ones implementing StanzaFilter or having iq filters, sorted by priority
+    QList<PluginHost *> incomingXmlHosts_;
+    // enabled ones implementing StanzaWatcher, sorted by priority
+    QList<PluginHost *> stanzaWatchers_;
 
     QList<QCA::DirWatch *> dirWatchers_;
 
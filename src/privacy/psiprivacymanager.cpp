@@ -19,20 +19,24 @@
 #include "psiprivacymanager.h"
 
 #include "contactupdatesmanager.h"
+#include "jidutil.h"
 #include "privacylist.h"
 #include "privacymanager.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "userlist.h"
 #include "xmpp_jid.h"
+#include "xmpp_serverinfomanager.h"
 #include "xmpp_task.h"
 #include "xmpp_tasks.h"
 #include "xmpp_xmlcommon.h"
 
 #include <QDebug>
 #include <QObject>
+#include <QSet>
 
 #define PRIVACY_NS "jabber:iq:privacy"
+#define BLOCKING_NS "urn:xmpp:blocking"
 
 using namespace XMPP;
 
@@ -40,10 +44,7 @@ static const QString BLOCKED_LIST_NAME = "blocked";
 
 static XMPP::Jid processJid(const XMPP::Jid &jid) { return jid.withResource(""); }
 
-static bool privacyListItemForJid(const PrivacyListItem &item, const Jid &jid)
-{
-    return item.type() == PrivacyListItem::JidType && processJid(item.value()) == processJid(jid);
-}
+static XMPP::Jid processJid(const QString &jid) { return processJid(JIDUtil::intern(jid)); }
 
 // -----------------------------------------------------------------------------
 //
@@ -266,17 +267,137 @@ public:
     const PrivacyList &list() { return list_; }
 };
 
+// -----------------------------------------------------------------------------
+// XEP-0191: Blocking Command
+
+class BlockingListener : public Task {
+    Q_OBJECT
+
+public:
+    BlockingListener(Task *parent) : Task(parent) { }
+
+    bool take(const QDomElement &e)
+    {
+        if (e.tagName() != "iq" || e.attribute("type") != "set")
+            return false;
+
+        QDomElement cmd = e.firstChildElement();
+        if (cmd.namespaceURI() != BLOCKING_NS || (cmd.tagName() != "block" && cmd.tagName() != "unblock"))
+            return false;
+
+        // pushes come from our own server only
+        Jid from(e.attribute("from"));
+        if (!from.isEmpty() && !from.compare(client()->jid(), false))
+            return false;
+
+        QStringList jids;
+        for (QDomElement item = cmd.firstChildElement("item"); !item.isNull(); item = item.nextSiblingElement("item"))
+            jids += processJid(item.attribute("jid")).full();
+
+        // an unblock without items clears the whole blocklist
+        if (cmd.tagName() == "block")
+            emit blocked(jids);
+        else
+            emit unblocked(jids);
+
+        send(createIQ(doc(), "result", e.attribute("from"), e.attribute("id")));
+        return true;
+    }
+
+signals:
+    void blocked(const QStringList &jids);
+    void unblocked(const QStringList &jids);
+};
+
+class GetBlocklistTask : public Task {
+    Q_OBJECT
+
+private:
+    QStringList jids_;
+
+public:
+    GetBlocklistTask(Task *parent) : Task(parent) { }
+
+    void onGo()
+    {
+        QDomElement iq = createIQ(doc(), "get", "", id());
+        iq.appendChild(doc()->createElementNS(BLOCKING_NS, "blocklist"));
+        send(iq);
+    }
+
+    bool take(const QDomElement &x)
+    {
+        if (!iqVerify(x, "", id()))
+            return false;
+
+        if (x.attribute("type") == "result") {
+            QDomElement list = x.firstChildElement("blocklist");
+            for (QDomElement i = list.firstChildElement("item"); !i.isNull(); i = i.nextSiblingElement("item"))
+                jids_ += processJid(i.attribute("jid")).full();
+            setSuccess();
+        } else {
+            setError(x);
+        }
+        return true;
+    }
+
+    const QStringList &jids() { return jids_; }
+};
+
+class SetBlockingTask : public Task {
+    Q_OBJECT
+
+private:
+    bool        block_;
+    QStringList jids_;
+
+public:
+    SetBlockingTask(Task *parent, bool block, const QStringList &jids) : Task(parent), block_(block), jids_(jids) { }
+
+    void onGo()
+    {
+        QDomElement iq  = createIQ(doc(), "set", "", id());
+        QDomElement cmd = doc()->createElementNS(BLOCKING_NS, block_ ? "block" : "unblock");
+        for (const QString &jid : qAsConst(jids_)) {
+            QDomElement item = doc()->createElement("item");
+            item.setAttribute("jid", jid);
+            cmd.appendChild(item);
+        }
+        iq.appendChild(cmd);
+        send(iq);
+    }
+
+    bool take(const QDomElement &x)
+    {
+        if (!iqVerify(x, "", id()))
+            return false;
+
+        if (x.attribute("type") == "result") {
+            setSuccess();
+        } else {
+            qWarning("privacy.cpp: Got error reply for blocking command.");
+            setError(x);
+        }
+        return true;
+    }
+};
+
 // -----------------------------------------------------------------------------
 
 PsiPrivacyManager::PsiPrivacyManager(PsiAccount *account, XMPP::Task *rootTask) :
     rootTask_(rootTask), getDefault_waiting_(false), block_waiting_(false), account_(account), accountAvailable_(false),
-    isAvailable_(false)
+    isAvailable_(false), blockingCommand_(false)
 {
     blockedListName_ = BLOCKED_LIST_NAME;
     listener_        = new PrivacyListListener(rootTask_);
     connect(listener_, SIGNAL(privacyListChanged(const QString &)), SLOT(privacyListChanged(const QString &)));
+    blockingListener_ = new BlockingListener(rootTask_);
+    connect(blockingListener_, SIGNAL(blocked(const QStringList &)), SLOT(blockingPush_blocked(const QStringList &)));
+    connect(blockingListener_, SIGNAL(unblocked(const QStringList &)),
+            SLOT(blockingPush_unblocked(const QStringList &)));
 
     connect(account, SIGNAL(updatedActivity()), SLOT(accountStateChanged()));
+    connect(account->serverInfoManager(), SIGNAL(featuresChanged()), SLOT(serverFeaturesChanged()));
 
     connect(this, SIGNAL(listReceived(const PrivacyList &)), SLOT(newListReceived(const PrivacyList &)));
     connect(this, SIGNAL(listsReceived(const QString &, const QString &, const QStringList &)),
@@ -292,6 +413,7 @@ PsiPrivacyManager::PsiPrivacyManager(PsiAccount *account, XMPP::Task *rootTask)
 PsiPrivacyManager::~PsiPrivacyManager()
 {
     delete listener_;
+    delete blockingListener_;
 
     qDeleteAll(lists_);
 }
@@ -512,41 +634,121 @@ void PsiPrivacyManager::accountStateChanged()
 {
     if (!account_->isAvailable()) {
         setIsAvailable(false);
+        blockingCommand_ = false;
     }
 
     if (account_->isAvailable() && !accountAvailable_) {
-        requestListNames();
+        if (serverSupportsBlocking())
+            requestBlocklist();
+        else
+            requestListNames();
     }
 
     accountAvailable_ = account_->isAvailable();
 }
 
-static QStringList findDifferences(QStringList previous, QStringList current)
+void PsiPrivacyManager::serverFeaturesChanged()
+{
+    // the server disco may finish after the account went online
+    if (accountAvailable_ && !blockingCommand_ && serverSupportsBlocking())
+        requestBlocklist();
+}
+
+bool PsiPrivacyManager::serverSupportsBlocking() const
+{
+    return account_->serverInfoManager()->features().test(QStringList() << BLOCKING_NS);
+}
+
+void PsiPrivacyManager::requestBlocklist()
 {
-    QStringList result;
-    for (const QString &i : previous) {
-        if (!current.contains(i))
-            result += i;
+    GetBlocklistTask *t = new GetBlocklistTask(rootTask_);
+    connect(t, SIGNAL(finished()), SLOT(receiveBlocklist()));
+    t->go(true);
+}
+
+void PsiPrivacyManager::receiveBlocklist()
+{
+    GetBlocklistTask *t = static_cast<GetBlocklistTask *>(sender());
+    if (!t) {
+        qWarning("privacy.cpp:receiveBlocklist(): Unexpected sender.");
+        return;
     }
-    return result;
+
+    if (!t->success()) {
+        qDebug("privacy.cpp: Error in blocklist receiving, using privacy lists.");
+        if (!blockingCommand_)
+            requestListNames();
+        return;
+    }
+
+    // from now on the blocklist is the only source of isBlocked_
+    blockingCommand_ = true;
+
+    QSet<QString> current;
+    for (const QString &jid : t->jids())
+        current.insert(jid);
+    setBlockedContacts(current);
+    setIsAvailable(true);
 }
 
-void PsiPrivacyManager::newListReceived(const PrivacyList &list)
+void PsiPrivacyManager::blockingPush_blocked(const QStringList &jids)
 {
-    QStringList previouslyBlockedContacts = blockedContacts();
+    if (!blockingCommand_)
+        return;
+
+    QSet<QString> current = isBlocked_;
+    for (const QString &jid : jids)
+        current.insert(jid);
+    setBlockedContacts(current);
+}
 
+void PsiPrivacyManager::blockingPush_unblocked(const QStringList &jids)
+{
+    if (!blockingCommand_)
+        return;
+
+    QSet<QString> current;
+    if (!jids.isEmpty()) {
+        current = isBlocked_;
+        for (const QString &jid : jids)
+            current.remove(jid);
+    }
+    setBlockedContacts(current);
+}
+
+void PsiPrivacyManager::setBlocking_finished()
+{
+    SetBlockingTask *t = static_cast<SetBlockingTask *>(sender());
+    if (t && !t->success())
+        emit changeList_error();
+}
+
+void PsiPrivacyManager::newListReceived(const PrivacyList &list)
+{
     if (lists_.contains(list.name()))
         *lists_[list.name()] = list;
     else
         lists_[list.name()] = new PrivacyList(list);
 
-    if (list.name() == blockedListName_)
+    if (list.name() == blockedListName_ && !blockingCommand_)
         invalidateBlockedListCache();
+}
 
-    QStringList currentlyBlockedContacts = blockedContacts();
+void PsiPrivacyManager::setBlockedContacts(const QSet<QString> &current)
+{
     QStringList updatedContacts;
-    updatedContacts += findDifferences(previouslyBlockedContacts, currentlyBlockedContacts);
-    updatedContacts += findDifferences(currentlyBlockedContacts, previouslyBlockedContacts);
+    for (const QString &contact : qAsConst(isBlocked_)) {
+        if (!current.contains(contact))
+            updatedContacts += contact;
+    }
+    for (const QString &contact : current) {
+        if (!isBlocked_.contains(contact))
+            updatedContacts += contact;
+    }
+
+    isBlocked_ = current;
+    if (updatedContacts.isEmpty())
+        return;
 
     for (const QString &contact : qAsConst(updatedContacts)) {
         // emit simulateContactOffline(contact);
@@ -619,31 +821,17 @@ PrivacyList *PsiPrivacyManager::blockedList() const
     return nullptr;
 }
 
-QStringList PsiPrivacyManager::blockedContacts() const
+void PsiPrivacyManager::invalidateBlockedListCache()
 {
-    QStringList result;
+    QSet<QString> current;
     if (blockedList()) {
         for (const PrivacyListItem &item : blockedList()->items()) {
             if (item.type() == PrivacyListItem::JidType && item.action() == PrivacyListItem::Deny) {
-                result << processJid(item.value()).full();
+                current.insert(processJid(item.value()).full());
             }
         }
     }
-    return result;
-}
-
-void PsiPrivacyManager::invalidateBlockedListCache()
-{
-    isBlocked_.clear();
-
-    if (!blockedList())
-        return;
-
-    for (const PrivacyListItem &item : blockedList()->items()) {
-        if (item.type() == PrivacyListItem::JidType && item.action() == PrivacyListItem::Deny) {
-            isBlocked_[processJid(item.value()).full()] = true;
-        }
-    }
+    setBlockedContacts(current);
 }
 
 bool PsiPrivacyManager::isContactBlocked(const XMPP::Jid &jid) const
@@ -662,38 +850,65 @@ PrivacyListItem PsiPrivacyManager::blockItemFor(const XMPP::Jid &jid) const
 }
 
 void PsiPrivacyManager::setContactBlocked(const XMPP::Jid &jid, bool blocked)
+{
+    setContactsBlocked(QList<XMPP::Jid>() << jid, blocked);
+}
+
+void PsiPrivacyManager::setContactsBlocked(const QList<XMPP::Jid> &jids, bool blocked)
 {
     if (blocked) {
-        account_->psi()->contactUpdatesManager()->contactBlocked(account_, jid);
+        for (const XMPP::Jid &jid : jids)
+            account_->psi()->contactUpdatesManager()->contactBlocked(account_, jid);
     }
 
-    if (!blockedList()) {
+    if (!blockingCommand_ && !blockedList()) {
         createBlockedList();
         return;
     }
 
-    if (isContactBlocked(jid) == blocked)
+    QStringList   targets;
+    QSet<QString> changed;
+    for (const XMPP::Jid &jid : jids) {
+        const QString target = processJid(jid).full();
+        if (isContactBlocked(jid) == blocked || changed.contains(target))
+            continue;
+
+        changed.insert(target);
+        targets += target;
+        if (blocked && isAuthorized(jid)) {
+            JT_Presence *p = new JT_Presence(account_->client()->rootTask());
+            p->pres(processJid(jid), account_->loggedOutStatus());
+            p->go(true);
+        }
+    }
+
+    if (targets.isEmpty())
         return;
 
-    if (blocked && isAuthorized(jid)) {
-        JT_Presence *p = new JT_Presence(account_->client()->rootTask());
-        p->pres(processJid(jid), account_->loggedOutStatus());
-        p->go(true);
+    // the server pushes the change back, that updates isBlocked_
+    if (blockingCommand_) {
+        SetBlockingTask *t = new SetBlockingTask(rootTask_, blocked, targets);
+        connect(t, SIGNAL(finished()), SLOT(setBlocking_finished()));
+        t->go(true);
+        return;
     }
 
+    // one diff of the blocked list, sent as one update
     PrivacyList newList(*blockedList());
     newList.clear();
 
+    if (blocked) {
+        for (const QString &target : qAsConst(targets))
+            newList.appendItem(blockItemFor(target));
+    }
+
     for (const PrivacyListItem &item : blockedList()->items()) {
-        if (privacyListItemForJid(item, jid))
+        if (item.type() == PrivacyListItem::JidType && changed.contains(processJid(item.value()).full()))
             continue;
 
         newList.appendItem(item);
     }
 
-    if (blocked)
-        newList.insertItem(0, blockItemFor(jid));
-
     changeList(newList);
 }
 
@@ -25,8 +25,10 @@
 
 #include <QHash>
 #include <QObject>
+#include <QSet>
 #include <QStringList>
 
+class BlockingListener;
 class PrivacyList;
 class PrivacyListItem;
 class PrivacyListListener;
@@ -88,6 +90,8 @@ public:
 
     bool isContactBlocked(const XMPP::Jid &jid) const;
     void setContactBlocked(const XMPP::Jid &jid, bool blocked);
+    // applies all of them as one change, unchanged jids are skipped
+    void setContactsBlocked(const QList<XMPP::Jid> &jids, bool blocked);
 
 signals:
     void availabilityChanged();
@@ -101,6 +105,12 @@ private slots:
     void newListsError();
 
     void accountStateChanged();
+    void serverFeaturesChanged();
+
+    void receiveBlocklist();
+    void blockingPush_blocked(const QStringList &jids);
+    void blockingPush_unblocked(const QStringList &jids);
+    void setBlocking_finished();
 
     void newChangeDefaultList_success();
     void newChangeDefaultList_error();
@@ -115,17 +125,21 @@ private:
     bool                          accountAvailable_;
     bool                          isAvailable_;
     QHash<QString, PrivacyList *> lists_;
-    QHash<QString, bool>          isBlocked_;
+    QSet<QString>                 isBlocked_;
+    BlockingListener *            blockingListener_;
+    bool                          blockingCommand_; // XEP-0191 is used instead of the blocked list
 
     void invalidateBlockedListCache();
+    void setBlockedContacts(const QSet<QString> &current);
     void setIsAvailable(bool available);
 
+    bool serverSupportsBlocking() const;
+    void requestBlocklist();
+
     void            createBlockedList();
     PrivacyList *   blockedList() const;
     PrivacyListItem blockItemFor(const XMPP::Jid &jid) const;
 
-    QStringList blockedContacts() const;
-
     QString blockedListName_, tmpActiveListName_;
     bool    isAuthorized(const XMPP::Jid &jid) const;
 };
@@ -50,7 +50,11 @@
 #include "captchadlg.h"
 #include "changepwdlg.h"
 #include "chatdlg.h"
+#include "chathistoryprefetch.h"
+#include "chatstatesender.h"
+#include "contactinfocache.h"
 #include "contactupdatesmanager.h"
+#include "debug.h"
 #include "discodlg.h"
 #include "eventdb.h"
 #include "eventdlg.h"
@@ -73,11 +77,14 @@
 #include "jinglevoicecaller.h"
 #endif
 #include "jingle-session.h"
+#include "mamsync.h"
+#include "memorytrimmer.h"
 #include "mood.h"
 #include "mooddlg.h"
 #include "networkaccessmanager.h"
 #include "passdialog.h"
 #include "pepmanager.h"
+#include "performancedlg.h"
 //#include "physicallocation.h"
 #ifdef PSI_PLUGINS
 #include "pluginmanager.h"
@@ -85,6 +92,7 @@
 #include "popupmanager.h"
 #include "profiles.h"
 #include "proxy.h"
+#include "psicapsregsitry.h"
 #include "psicon.h"
 #include "psicontact.h"
 #include "psicontactlist.h"
@@ -97,6 +105,8 @@
 #include "qwextend.h"
 //#include "qssl.h"
 #include "rc.h"
+#include "receiptscheduler.h"
+#include "reconnectscheduler.h"
 #include "registrationdlg.h"
 #include "rosteritemexchangetask.h"
 #include "s5b.h"
@@ -106,6 +116,7 @@
 #include "tabdlg.h"
 #include "tabmanager.h"
 #include "textutil.h"
+#include "transferscheduler.h"
 #include "translationmanager.h"
 #include "tune.h"
 #include "userlist.h"
@@ -139,9 +150,14 @@
 #endif
 
 #include <QApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QFrame>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QHostInfo>
 #include <QIcon>
 #include <QInputDialog>
@@ -154,10 +170,15 @@
 #include <QPointer>
 #include <QPushButton>
 #include <QQueue>
+#include <QSaveFile>
+#include <QTemporaryFile>
 #include <QTimer>
 #include <QUrl>
+#include <QtConcurrentRun>
 #include <QtCrypto>
 #include <qca.h>
+
+#include <algorithm>
 #ifdef HAVE_KEYCHAIN
 #include <qt5keychain/keychain.h>
 #endif
@@ -172,6 +193,23 @@ typedef int socklen_t;
 
 using namespace XMPP;
 
+// roster snapshot file header, bump the format on any layout change
+#define ROSTER_SNAPSHOT_MAGIC 0x50735273
+#define ROSTER_SNAPSHOT_FORMAT 2
+
+// roster sets of an accepted roster item exchange waiting for their result at once
+#define ROSTER_EXCHANGE_WINDOW 8
+
+// rooms given a status change at once, and the pause before the next ones, milliseconds
+#define MUC_STATUS_BURST 10
+#define MUC_STATUS_INTERVAL 500
+
+// what a room sees of a status
+static QString mucStatusKey(const Status &s)
+{
+    return s.show() + '\n' + QString::number(s.priority()) + '\n' + s.status();
+}
+
 static AdvancedConnector::Proxy convert_proxy(const UserAccount &acc, const Jid &jid)
 {
     bool    useHost = false;
@@ -329,47 +367,294 @@ private:
 };
 
 //----------------------------------------------------------------------------
-// PsiAccount
+// RosterVersionTask -- roster request with XEP-0237 versioning
 //----------------------------------------------------------------------------
+class RosterVersionTask : public XMPP::Task {
+    Q_OBJECT
+public:
+    RosterVersionTask(Task *parent, const QString &version) : Task(parent), version_(version) { }
+
+    void onGo()
+    {
+        QDomElement iq    = createIQ(doc(), "get", "", id());
+        QDomElement query = doc()->createElementNS("jabber:iq:roster", "query");
+        // an empty version asks for the full roster along with its version
+        query.setAttribute("ver", version_);
+        iq.appendChild(query);
+        send(iq);
+    }
+
+    bool take(const QDomElement &x)
+    {
+        if (!iqVerify(x, "", id()))
+            return false;
+
+        if (x.attribute("type") == "result") {
+            // no query: the roster is still at our version, pushes bring what changed since
+            QDomElement q = queryTag(x);
+            unchanged_    = q.isNull();
+            if (!unchanged_) {
+                version_ = q.attribute("ver");
+                for (QDomElement i = q.firstChildElement("item"); !i.isNull(); i = i.nextSiblingElement("item")) {
+                    RosterItem item;
+                    if (item.fromXml(i))
+                        roster_ += item;
+                }
+            }
+            setSuccess();
+        } else {
+            setError(x);
+        }
+        return true;
+    }
+
+    bool           unchanged() const { return unchanged_; }
+    const Roster & roster() const { return roster_; }
+    const QString &version() const { return version_; }
+
+private:
+    QString version_;
+    bool    unchanged_ = false;
+    Roster  roster_;
+};
+
+// Notes the roster version of each push, the push itself is left to iris
+class RosterPushWatcher : public XMPP::Task {
+    Q_OBJECT
+public:
+    RosterPushWatcher(Task *parent) : Task(parent) { }
+
+    bool take(const QDomElement &e)
+    {
+        if (e.tagName() != "iq" || e.attribute("type") != "set" || queryNS(e) != "jabber:iq:roster")
+            return false;
+
+        Jid from(e.attribute("from"));
+        if (from.isEmpty() || from.compare(client()->jid(), false)) {
+            QDomElement q = queryTag(e);
+            if (q.hasAttribute("ver"))
+                emit versionChanged(q.attribute("ver"));
+        }
+        return false;
+    }
+
+    void onDisconnect()
+    {
+        // lives as long as the account, the pushes of every session pass here
+    }
+
+signals:
+    void versionChanged(const QString &version);
+};
+
+//----------------------------------------------------------------------------
+// AutoJoinQueue -- autojoined rooms, a few at a time
+//----------------------------------------------------------------------------
+// milliseconds the history lookups for the order may take
+#define AUTOJOIN_LOOKUP_TIMEOUT 2000
+// milliseconds without any room answering before the next ones are joined anyway
+#define AUTOJOIN_JOIN_TIMEOUT 20000
+
+// Joins the most recently active rooms first and only a few at once, so the roster, the presences and the
+// history of the rooms don't all come in the same second. The last message of each room in the history also
+// tells the server what history to send.
+class AutoJoinQueue : public QObject {
+    Q_OBJECT
+public:
+    AutoJoinQueue(PsiAccount *pa) : QObject(pa), pa_(pa)
+    {
+        timer_.setSingleShot(true);
+        connect(&timer_, &QTimer::timeout, this, &AutoJoinQueue::timeout);
+        connect(pa, &PsiAccount::disconnected, this, &AutoJoinQueue::clear);
+    }
+
+    // replaces whatever still waited, rooms being joined already aren't joined again
+    void start(const QList<ConferenceBookmark> &rooms)
+    {
+        ++generation_;
+        timer_.stop();
+        queue_.clear();
+        for (const ConferenceBookmark &c : rooms) {
+            if (!joining_.contains(c.jid().bare()))
+                queue_ += c;
+        }
+        lookups_ = queue_.size();
+
+        const int gen = generation_;
+        for (const ConferenceBookmark &c : qAsConst(queue_)) {
+            const QString room = c.jid().bare();
+            EDBHandle *   h    = new EDBHandle(pa_->edb());
+            connect(h, &EDBHandle::finished, this, [this, h, room, gen]() {
+                h->deleteLater();
+                if (gen != generation_)
+                    return;
+                if (!h->result().isEmpty())
+                    lastSeen_.insert(room, h->result().first()->event()->timeStamp());
+                if (--lookups_ == 0)
+                    sortAndJoin();
+            });
+            h->get(pa_->id(), room, QDateTime(), EDB::Backward, 0, 1);
+        }
+        if (lookups_)
+            timer_.start(AUTOJOIN_LOOKUP_TIMEOUT);
+        else
+            sortAndJoin();
+    }
+
+    // the room answered the join, either way
+    void done(const Jid &room)
+    {
+        if (joining_.remove(room.bare()))
+            joinNext();
+    }
+
+    QDateTime lastSeen(const Jid &room) const { return lastSeen_.value(room.bare()); }
+
+public slots:
+    void clear()
+    {
+        ++generation_;
+        timer_.stop();
+        queue_.clear();
+        joining_.clear();
+        lookups_ = 0;
+    }
+
+private slots:
+    void timeout()
+    {
+        if (lookups_) {
+            // order by what is known by now
+            ++generation_;
+            lookups_ = 0;
+            sortAndJoin();
+        } else {
+            joining_.clear();
+            joinNext();
+        }
+    }
+
+private:
+    void sortAndJoin()
+    {
+        // rooms without history go last
+        auto recent = [this](const ConferenceBookmark &a, const ConferenceBookmark &b) {
+            return lastSeen_.value(a.jid().bare()) > lastSeen_.value(b.jid().bare());
+        };
+        std::stable_sort(queue_.begin(), queue_.end(), recent);
+        joinNext();
+    }
+
+    void joinNext()
+    {
+        const int max = PsiOptions::instance()->getOption("options.muc.bookmarks.max-parallel-joins").toInt();
+        while (!queue_.isEmpty() && (max <= 0 || joining_.size() < max)) {
+            const ConferenceBookmark c = queue_.takeFirst();
+            joining_.insert(c.jid().bare());
+            pa_->actionJoin(c, true, false);
+        }
+        if (joining_.isEmpty())
+            timer_.stop();
+        else
+            timer_.start(AUTOJOIN_JOIN_TIMEOUT);
+    }
 
-struct ReconnectData {
-    ReconnectData(int _delay, int _timeout) : delay(_delay), timeout(_timeout) { }
-    int delay;
-    int timeout;
+    PsiAccount *              pa_;
+    QList<ConferenceBookmark> queue_;
+    QSet<QString>             joining_;
+    QHash<QString, QDateTime> lastSeen_; // room -> time of its last message in the history
+    int                       lookups_    = 0; // history lookups still running
+    int                       generation_ = 0; // of the lookups that still count
+    QTimer                    timer_;
 };
 
+//----------------------------------------------------------------------------
+// PsiAccount
+//----------------------------------------------------------------------------
+
 static const int RECONNECT_TIMEOUT_ERROR = -10;
+// seconds a login started by a reconnect gets
+static const int RECONNECT_TIMEOUT = 5 * 60;
+// seconds a stream resuming its session (XEP-0198) gets before it counts as lost
+static const int RESUME_TIMEOUT = 30;
+// seconds a server address that worked is used again without resolving the domain
+static const int SERVER_CACHE_TTL = 30 * 60;
+
+// what the last login to a server domain found out, shared by all accounts on it
+struct ServerCacheEntry {
+    QHostAddress    address;
+    quint16         port = 0;
+    QDateTime       expires;
+    QCA::TLSSession tlsSession; // resumed by the next handshake
+    bool            carbons = false;
+};
 
-static QList<ReconnectData> reconnectData()
+static QHash<QString, ServerCacheEntry> &serverCache()
 {
-    static QList<ReconnectData> data;
-    static const int            max_timeout = 5 * 60;
-    if (data.isEmpty()) {
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
+    static QHash<QString, ServerCacheEntry> cache;
+    return cache;
+}
 
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
-        data << ReconnectData(15, max_timeout);
+// byte budget of the stanza ring shown by "Dump Ringbuf" in the XML console
+#define XML_RINGBUF_BUDGET_OPTION QLatin1String("options.xml-console.ringbuf-bytes")
+// stanzas of at least this many bytes are kept compressed
+#define XML_RINGBUF_COMPRESS_SIZE 256
+// stanzas waiting for the encoder at most, the oldest go first
+#define XML_RINGBUF_MAX_PENDING 10000
 
-        data << ReconnectData(2 * 60, max_timeout);
-    }
+struct PendingRingElem {
+    int       type;
+    QDateTime time;
+    QString   xml;
+};
 
-    return data;
+// utf-8 and zlib for a burst of stanzas, on a pool thread
+static QList<PsiAccount::xmlRingElem> encodeRingElems(const QVector<PendingRingElem> &batch)
+{
+    QList<PsiAccount::xmlRingElem> res;
+    res.reserve(batch.size());
+    for (const PendingRingElem &p : batch) {
+        PsiAccount::xmlRingElem el;
+        el.type = p.type;
+        el.time = p.time;
+        el.data = p.xml.toUtf8();
+        // short stanzas and whitespace pings don't shrink
+        if (el.data.size() >= XML_RINGBUF_COMPRESS_SIZE) {
+            el.data       = qCompress(el.data, 1);
+            el.compressed = true;
+        }
+        res += el;
+    }
+    return res;
 }
 
 class PsiAccount::Private : public Alertable {
     Q_OBJECT
 public:
-    Private(PsiAccount *parent) : Alertable(parent), account(parent), xmlRingbuf(1000)
+    Private(PsiAccount *parent) : Alertable(parent), account(parent)
     {
+        xmlRingbufBudget = PsiOptions::instance()->getOption(XML_RINGBUF_BUDGET_OPTION).toInt();
+        connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, [this](const QString &option) {
+            if (option == XML_RINGBUF_BUDGET_OPTION) {
+                xmlRingbufBudget = PsiOptions::instance()->getOption(option).toInt();
+                trimRingbuf();
+            }
+        });
+
         reconnectTimeoutTimer_ = new QTimer(this);
         reconnectTimeoutTimer_->setSingleShot(true);
         connect(reconnectTimeoutTimer_, SIGNAL(timeout()), SLOT(reconnectTimerTimeout()));
 
+        ringEncoder = new QFutureWatcher<QList<xmlRingElem>>(this);
+        connect(ringEncoder, &QFutureWatcher<QList<xmlRingElem>>::finished, this, [this]() { ringEncoded(); });
+        // a debugging aid, given up when memory is short unless the console is open
+        MemoryTrimmer::instance()->add(
+            this, [this]() { return qint64(xmlRingbufBytes); },
+            [this](MemoryTrimmer::Level level) {
+                if (level == MemoryTrimmer::Critical && !xmlConsole)
+                    clearRingbuf();
+            });
+
         updateOnlineContactsCountTimer_ = new QTimer(this);
         updateOnlineContactsCountTimer_->setInterval(500);
         updateOnlineContactsCountTimer_->setSingleShot(true);
@@ -382,6 +667,41 @@ public:
             client->close(true);
             finishLogout();
         });
+
+        // collects the events of a burst (e.g. MUC history on join) into one history write
+        logFlushTimer = new QTimer(this);
+        logFlushTimer->setInterval(100);
+        logFlushTimer->setSingleShot(true);
+        connect(logFlushTimer, &QTimer::timeout, account, &PsiAccount::flushLog);
+
+        // status changes go to the joined rooms in rounds, see groupChatQueueStatus()
+        mucStatusTimer = new QTimer(this);
+        mucStatusTimer->setSingleShot(true);
+        connect(mucStatusTimer, &QTimer::timeout, account, &PsiAccount::flushGroupChatStatus);
+
+        // the whole queue is rewritten on save, so changes of a burst are saved once
+        queueSaveTimer = new QTimer(this);
+        queueSaveTimer->setInterval(1000);
+        queueSaveTimer->setSingleShot(true);
+        connect(queueSaveTimer, &QTimer::timeout, this, &Private::saveQueue);
+
+        // roster pushes and presences come in bursts, the snapshot is rewritten once per burst
+        rosterSaveTimer = new QTimer(this);
+        rosterSaveTimer->setInterval(5000);
+        rosterSaveTimer->setSingleShot(true);
+        connect(rosterSaveTimer, &QTimer::timeout, this, &Private::saveRosterSnapshot);
+
+        // presences of one event loop pass are applied together, see flushPresenceQueue()
+        presenceTimer = new QTimer(this);
+        presenceTimer->setInterval(0);
+        presenceTimer->setSingleShot(true);
+        connect(presenceTimer, &QTimer::timeout, account, &PsiAccount::flushPresenceQueue);
+
+        // resolved caps of one event loop pass, see flushCapsQueue()
+        capsTimer = new QTimer(this);
+        capsTimer->setInterval(0);
+        capsTimer->setSingleShot(true);
+        connect(capsTimer, &QTimer::timeout, account, &PsiAccount::flushCapsQueue);
     }
 
     PsiContactList *         contactList = nullptr;
@@ -403,6 +723,7 @@ public:
     EventQueue *             eventQueue    = nullptr;
     XmlConsole *             xmlConsole    = nullptr;
     UserList                 userList;
+    QHash<QString, UserList> userIndex; // bare jid -> items of userList
     UserListItem             self;
     QString                  cur_pgpSecretKey;
     QList<Message>           messageQueue;
@@ -414,6 +735,40 @@ public:
     int                      currentConnectionErrorCondition = -1;
     QTimer *                 updateOnlineContactsCountTimer_ = nullptr;
     QTimer *                 logoutTimer                     = nullptr;
+    QTimer *                 logFlushTimer                   = nullptr;
+    QTimer *                 mucStatusTimer                  = nullptr;
+    QTimer *                 queueSaveTimer                  = nullptr;
+    QTimer *                 rosterSaveTimer                 = nullptr;
+    bool                     loadingQueue                    = false;
+    bool                     loadingRoster                   = false;
+    QString                  rosterVersion; // XEP-0237, of the roster in userList
+    EDBAppendBatch           logQueue;
+    QStringList              mucStatusQueue; // bare room jids
+    QHash<QString, QString>  mucStatusSent;  // bare room jid -> mucStatusKey() of the last presence
+
+    struct QueuedPresence {
+        Jid      jid;
+        Resource resource;
+        bool     available;
+    };
+    QList<QueuedPresence> presenceQueue;
+    QHash<QString, int>   presenceQueueIndex; // full jid -> position in presenceQueue
+    QTimer *              presenceTimer = nullptr;
+    bool                  presenceBatch = false;
+    QList<int>            batchSounds;
+    QHash<QString, Jid>   capsQueue; // full jid -> jid, resources with new client info
+    QTimer *              capsTimer = nullptr;
+
+    // XEP-0144 items the user accepted, see sendRosterExchangeSets()
+    struct RosterExchangeSet {
+        Jid         jid;
+        QString     name;
+        QStringList groups;
+        bool        remove;
+        bool        subscribe;
+    };
+    QList<RosterExchangeSet>    rosterExchangeQueue;
+    QList<QPointer<JT_Roster>> rosterExchangeTasks; // sent, waiting for the result
 
     // Tune
     Tune lastTune;
@@ -429,6 +784,12 @@ public:
     AvatarFactory *avatarFactory = nullptr;
     QByteArray     photoHash;
 
+    ChatHistoryPrefetch *historyPrefetch = nullptr;
+    MamSync *            mamSync         = nullptr;
+    ReceiptScheduler *   receipts        = nullptr;
+    ContactInfoCache *   contactInfo     = nullptr;
+    ChatStateSender *    chatStates      = nullptr;
+
     // Voice Call
     VoiceCaller *voiceCaller = nullptr;
 
@@ -449,30 +810,57 @@ public:
 #endif
 
     // PubSub
-    PEPManager *pepManager = nullptr;
+    PEPManager *          pepManager = nullptr;
+    QList<UserListItem *> pepUpdated; // changed by the pep items being delivered, updated once for all
 
     // Bookmarks
     BookmarkManager *bookmarkManager = nullptr;
+    AutoJoinQueue *  autoJoinQueue   = nullptr;
 
     // HttpAuth
     HttpAuthManager *httpAuthManager = nullptr;
 
-    QList<GCContact *> gcbank;
-    QStringList        groupchats;
+    // the managers above are created by PsiAccount::createManagers() once the account gets enabled
+    bool managersCreated = false;
+
+    QList<GCContact *>          gcbank;
+    QHash<QString, GCContact *> gcIndex; // full jid -> item of gcbank
+    QStringList                 groupchats;
 
     QPointer<AdvancedConnector> conn;
     QPointer<ClientStream>      stream;
     QPointer<QCA::TLS>          tls;
     QPointer<QCATLSHandler>     tlsHandler;
-    bool                        usingSSL = false;
-
-    QVector<xmlRingElem> xmlRingbuf;
-    int                  xmlRingbufWrite = 0;
+    bool                        usingSSL           = false;
+    bool                        cacheServerAddress = false; // resolved by the connector, no proxy
+    bool                        usingCachedAddress = false;
+    bool                        carbonsEnabled     = false;
+
+    // server certificates that passed or were let through, so reconnects don't ask again
+    CertificateHelpers::AcceptedCertificates acceptedCerts;
+
+    QElapsedTimer         bootstrapClock; // since login(), invalid once the account is usable
+    QMap<QString, qint64> bootstrapSteps; // step -> milliseconds since login()
+    qint64                timeToUsable = -1;
+
+    QQueue<xmlRingElem> xmlRingbuf;
+    int                 xmlRingbufBytes  = 0; // compressed sizes of the entries
+    int                 xmlRingbufBudget = 0;
+    quint64             stanzasReceived  = 0;
+    quint64             stanzasSent      = 0;
+
+    // a burst of megabytes would be encoded stanza by stanza on the gui thread otherwise
+    QVector<PendingRingElem>            xmlRingPending; // not encoded yet, shares the strings of the stream
+    QFutureWatcher<QList<xmlRingElem>> *ringEncoder;
+    bool                                ringEncoding        = false;
+    int                                 ringGeneration      = 0; // a clear drops the batch being encoded
+    int                                 ringBatchGeneration = 0;
 
     QHostAddress localAddress;
 
-    QList<PsiContact *> contacts;
-    int                 onlineContactsCount = 0;
+    QList<PsiContact *>          contacts;
+    QHash<QString, PsiContact *> contactIndex; // full jid -> item of contacts
+    int                          onlineContactsCount = 0;
 
 private:
     bool doPopups_ = true;
@@ -525,6 +913,7 @@ private slots:
     {
         Q_ASSERT(contacts.contains(contact));
         contacts.removeAll(contact);
+        contactIndex.remove(contact->jid().full());
         emit account->removedContact(contact);
     }
 
@@ -538,21 +927,59 @@ private slots:
         // PsiContactGroup* parent = groupsForUserListItem(u).first();
         PsiContact *contact = new PsiContact(u, account);
         contacts.append(contact);
+        contactIndex.insert(contact->jid().full(), contact);
         connect(contact, SIGNAL(destroyed(PsiContact *)), SLOT(removeContact(PsiContact *)));
         emit account->addedContact(contact);
         return contact;
     }
 
 public:
-    PsiContact *findContact(const Jid &jid) const
+    PsiContact *findContact(const Jid &jid) const { return contactIndex.value(jid.full()); }
+
+    // userList is indexed by bare jid, so it's changed only through these
+    void addUser(UserListItem *u)
     {
-        for (PsiContact *contact : contacts)
-            if (contact->find(jid))
-                return contact;
+        userList.append(u);
+        userIndex[u->jid().bare()].append(u);
+    }
 
+    void unindexUser(UserListItem *u)
+    {
+        auto it = userIndex.find(u->jid().bare());
+        if (it != userIndex.end()) {
+            it->removeAll(u);
+            if (it->isEmpty())
+                userIndex.erase(it);
+        }
+    }
+
+    void removeUser(UserListItem *u)
+    {
+        unindexUser(u);
+        userList.removeAll(u);
+    }
+
+    UserListItem *findUser(const Jid &jid) const
+    {
+        const UserList &items = userIndex.value(jid.bare());
+        for (UserListItem *u : items)
+            if (u->jid().compare(jid))
+                return u;
         return nullptr;
     }
 
+    // receipts and markers tell that the user is around, only those who see the presence get them
+    bool acknowledges(const Jid &j) const
+    {
+        if (j.compare(self.jid(), false) || account->groupchats().contains(j.bare()))
+            return true;
+        if (loginStatus.isInvisible())
+            return false;
+        UserListItem *u = findUser(j);
+        return u
+            && (u->subscription().type() == Subscription::To || u->subscription().type() == Subscription::Both);
+    }
+
     PsiContact *findContactOrSelf(const Jid &jid) const
     {
         PsiContact *contact = findContact(jid);
@@ -585,6 +1012,12 @@ public:
             + JIDUtil::encode(acc.id).toLower() + ".xml";
     }
 
+    static QString pathToRosterSnapshot(const QString &id)
+    {
+        return pathToProfile(activeProfile, ApplicationInfo::CacheLocation) + "/roster-" + JIDUtil::encode(id).toLower()
+            + ".bin";
+    }
+
 private slots:
     void updateOnlineContactsCountTimeout()
     {
@@ -665,7 +1098,96 @@ public:
     }
 
 public slots:
-    void queueChanged() { eventQueue->toFile(pathToProfileEvents()); }
+    void queueChanged()
+    {
+        if (!loadingQueue && !queueSaveTimer->isActive())
+            queueSaveTimer->start();
+    }
+
+    void saveQueue()
+    {
+        queueSaveTimer->stop();
+        eventQueue->toFile(pathToProfileEvents());
+    }
+
+    void rosterChanged()
+    {
+        if (!loadingRoster && !rosterSaveTimer->isActive())
+            rosterSaveTimer->start();
+    }
+
+    // the roster as of the last session, in a binary form which is cheap to read at startup
+    void saveRosterSnapshot()
+    {
+        rosterSaveTimer->stop();
+
+        QDir().mkpath(pathToProfile(activeProfile, ApplicationInfo::CacheLocation));
+        QSaveFile f(pathToRosterSnapshot(acc.id));
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+
+        QDataStream out(&f);
+        out.setVersion(QDataStream::Qt_5_6);
+        out << quint32(ROSTER_SNAPSHOT_MAGIC) << quint32(ROSTER_SNAPSHOT_FORMAT) << acc.jid << rosterVersion;
+
+        QList<const UserListItem *> items;
+        for (const UserListItem *u : qAsConst(userList)) {
+            if (u->inList())
+                items += u;
+        }
+        out << quint32(items.size());
+        for (const UserListItem *u : qAsConst(items)) {
+            out << u->jid().full() << u->name() << u->groups() << qint32(u->subscription().type()) << u->ask()
+                << u->lastAvailable() << u->lastUnavailableStatus().status();
+        }
+        if (out.status() == QDataStream::Ok)
+            f.commit();
+    }
+
+    // false if there is no usable snapshot for the account, its roster from accounts.xml is used then
+    bool loadRosterSnapshot(const UserAccount &ua)
+    {
+        QFile f(pathToRosterSnapshot(ua.id));
+        if (!f.open(QIODevice::ReadOnly))
+            return false;
+
+        QDataStream in(&f);
+        in.setVersion(QDataStream::Qt_5_6);
+        quint32 magic = 0, format = 0, count = 0;
+        QString snapshotJid, version;
+        in >> magic >> format >> snapshotJid >> version >> count;
+        if (in.status() != QDataStream::Ok || magic != ROSTER_SNAPSHOT_MAGIC || format != ROSTER_SNAPSHOT_FORMAT
+            || snapshotJid != ua.jid)
+            return false;
+
+        rosterVersion = version;
+
+        loadingRoster = true;
+        for (quint32 n = 0; n < count && in.status() == QDataStream::Ok; ++n) {
+            QString     jid, name, ask, statusText;
+            QStringList groups;
+            qint32      sub = 0;
+            QDateTime   lastAvailable;
+            in >> jid >> name >> groups >> sub >> ask >> lastAvailable >> statusText;
+            if (in.status() != QDataStream::Ok)
+                break;
+
+            RosterItem r(Jid(jid));
+            r.setName(name);
+            r.setGroups(groups);
+            r.setSubscription(Subscription(Subscription::SubType(sub)));
+            r.setAsk(ask);
+            account->client_rosterItemUpdated(r);
+
+            UserListItem *u = findUser(r.jid());
+            if (u) {
+                u->setLastAvailable(lastAvailable);
+                u->setLastUnavailableStatus(Status(Status::Offline, statusText));
+            }
+        }
+        loadingRoster = false;
+        return true;
+    }
 
     void loadQueue()
     {
@@ -674,9 +1196,14 @@ public slots:
                                           false); // disable the sound and popups
         doPopups_ = false;
 
+        // each loaded event is queued again, don't write the file back for every one
         QFileInfo fi(pathToProfileEvents());
-        if (fi.exists())
+        if (fi.exists()) {
+            loadingQueue = true;
             eventQueue->fromFile(pathToProfileEvents());
+            loadingQueue = false;
+            queueChanged(); // some could be filtered out on the way
+        }
 
         PsiOptions::instance()->setOption("options.ui.notifications.sounds.enable", soundEnabled);
         doPopups_ = true;
@@ -685,6 +1212,8 @@ public slots:
     void setEnabled(bool e)
     {
         acc.opt_enabled = e;
+        if (e)
+            account->createManagers(); // disabled accounts go without them
         account->cpUpdate(self);
         // account->updateParent();
 
@@ -703,19 +1232,81 @@ public slots:
         emit account->disconnected();
     }
 
+    void addToRingbuf(int type, const QString &s)
+    {
+        if (xmlRingbufBudget <= 0 || s.isEmpty())
+            return;
+        if (xmlRingPending.size() >= XML_RINGBUF_MAX_PENDING)
+            xmlRingPending.removeFirst();
+        xmlRingPending += PendingRingElem { type, QDateTime::currentDateTime(), s };
+        if (!ringEncoding)
+            encodeRing();
+    }
+    void encodeRing()
+    {
+        ringEncoding        = true;
+        ringBatchGeneration = ringGeneration;
+
+        const QVector<PendingRingElem> batch = xmlRingPending;
+        xmlRingPending.clear();
+        ringEncoder->setFuture(QtConcurrent::run(encodeRingElems, batch));
+    }
+    void ringEncoded()
+    {
+        if (!ringEncoding)
+            return; // taken by flushRingbuf() already
+        ringEncoding = false;
+        appendRing(ringEncoder->result());
+        // what came meanwhile goes as one batch
+        if (!xmlRingPending.isEmpty())
+            encodeRing();
+    }
+    void appendRing(const QList<xmlRingElem> &elems)
+    {
+        if (ringBatchGeneration != ringGeneration)
+            return;
+        for (const xmlRingElem &el : elems) {
+            xmlRingbufBytes += el.data.size();
+            xmlRingbuf.enqueue(el);
+        }
+        trimRingbuf();
+    }
+    // everything added so far is in xmlRingbuf after this
+    void flushRingbuf()
+    {
+        if (ringEncoding) {
+            ringEncoder->waitForFinished();
+            ringEncoding = false;
+            appendRing(ringEncoder->result());
+        }
+        ringBatchGeneration = ringGeneration;
+        appendRing(encodeRingElems(xmlRingPending));
+        xmlRingPending.clear();
+    }
+    void clearRingbuf()
+    {
+        ++ringGeneration;
+        xmlRingPending.clear();
+        xmlRingbuf.clear();
+        xmlRingbufBytes = 0;
+    }
+    void trimRingbuf()
+    {
+        while (!xmlRingbuf.isEmpty() && xmlRingbufBytes > xmlRingbufBudget)
+            xmlRingbufBytes -= xmlRingbuf.dequeue().data.size();
+    }
+
     void client_xmlIncoming(const QString &s)
     {
-        xmlRingbuf[xmlRingbufWrite].type = RingXmlIn;
-        xmlRingbuf[xmlRingbufWrite].xml  = s;
-        xmlRingbuf[xmlRingbufWrite].time = QDateTime::currentDateTime();
-        xmlRingbufWrite                  = (xmlRingbufWrite + 1) % xmlRingbuf.count();
+        if (smResuming_)
+            resumed();
+        ++stanzasReceived;
+        addToRingbuf(RingXmlIn, s);
     }
     void client_xmlOutgoing(const QString &s)
     {
-        xmlRingbuf[xmlRingbufWrite].type = RingXmlOut;
-        xmlRingbuf[xmlRingbufWrite].xml  = s;
-        xmlRingbuf[xmlRingbufWrite].time = QDateTime::currentDateTime();
-        xmlRingbufWrite                  = (xmlRingbufWrite + 1) % xmlRingbuf.count();
+        ++stanzasSent;
+        addToRingbuf(RingXmlOut, s);
     }
 
     void client_stanzaElementOutgoing(QDomElement &s)
@@ -762,7 +1353,8 @@ private:
         Jid      jid;
     };
 
-    QList<item_dialog2 *> dialogList;
+    QList<item_dialog2 *>                 dialogList;   // in the order of registration
+    QHash<QString, QList<item_dialog2 *>> dialogsByJid; // bare jid => its part of dialogList, same order
 
     bool compareJids(const Jid &j1, const Jid &j2, bool compareResource) const
     {
@@ -773,19 +1365,17 @@ public:
     // implementation for QList<PsiAccount::xmlRingElem> PsiAccount::dumpRingbuf()
     QList<xmlRingElem> dumpRingbuf()
     {
-        xmlRingElem        el;
-        QList<xmlRingElem> ret;
-        for (int i = 0; i < xmlRingbuf.count(); i++) {
-            el = xmlRingbuf[(xmlRingbufWrite + i) % xmlRingbuf.count()];
-            if (!el.xml.isEmpty()) {
-                ret += el;
-            }
-        }
-        return ret;
+        flushRingbuf();
+        return xmlRingbuf;
     }
+    // only the dialogs of the bare jid get looked at, there are a few at most
     QWidget *findDialog(const QMetaObject &mo, const Jid &jid, bool compareResource) const
     {
-        for (item_dialog2 *i : dialogList) {
+        auto it = dialogsByJid.constFind(jid.bare());
+        if (it == dialogsByJid.constEnd()) {
+            return nullptr;
+        }
+        for (item_dialog2 *i : *it) {
             if (mo.cast(i->widget) && compareJids(i->jid, jid, compareResource)) {
                 return i->widget;
             }
@@ -795,7 +1385,11 @@ public:
 
     void findDialogs(const QMetaObject &mo, const Jid &jid, bool compareResource, QList<void *> *list) const
     {
-        for (item_dialog2 *i : dialogList) {
+        auto it = dialogsByJid.constFind(jid.bare());
+        if (it == dialogsByJid.constEnd()) {
+            return;
+        }
+        for (item_dialog2 *i : *it) {
             if (mo.cast(i->widget) && compareJids(i->jid, jid, compareResource)) {
                 list->append(i->widget);
             }
@@ -817,6 +1411,7 @@ public:
         i->widget       = w;
         i->jid          = jid;
         dialogList.append(i);
+        dialogsByJid[jid.bare()].append(i);
     }
 
     void dialogUnregister(QWidget *w)
@@ -824,16 +1419,29 @@ public:
         for (item_dialog2 *i : qAsConst(dialogList)) {
             if (i->widget == w) {
                 dialogList.removeAll(i);
+                unindexDialog(i);
                 delete i;
                 return;
             }
         }
     }
 
+    void unindexDialog(item_dialog2 *i)
+    {
+        auto it = dialogsByJid.find(i->jid.bare());
+        if (it != dialogsByJid.end()) {
+            it->removeOne(i);
+            if (it->isEmpty()) {
+                dialogsByJid.erase(it);
+            }
+        }
+    }
+
     void deleteDialogList()
     {
         while (!dialogList.isEmpty()) {
             item_dialog2 *i = dialogList.takeFirst();
+            unindexDialog(i);
 
             delete i->widget;
             delete i;
@@ -961,22 +1569,42 @@ private:
         return lastManualStatus();
     }
 
+    void bootstrapDone(const QString &step)
+    {
+        if (!bootstrapClock.isValid() || bootstrapSteps.contains(step))
+            return;
+        bootstrapSteps.insert(step, bootstrapClock.elapsed());
+
+        // contacts, own presence, server features and rooms
+        static const QStringList usable { "roster", "presence", "features", "bookmarks" };
+        for (const QString &s : usable) {
+            if (!bootstrapSteps.contains(s))
+                return;
+        }
+        timeToUsable = bootstrapClock.elapsed();
+        bootstrapClock.invalidate();
+
+        QStringList steps;
+        for (auto it = bootstrapSteps.cbegin(); it != bootstrapSteps.cend(); ++it)
+            steps += QString("%1 %2").arg(it.key()).arg(it.value());
+        qDebug("%s: usable %lld ms after login (%s)", qUtf8Printable(account->name()), timeToUsable,
+               qUtf8Printable(steps.join(", ")));
+    }
+
 public slots:
     void startReconnect()
     {
-        reconnectData_++;
-        Q_ASSERT(::reconnectData().count());
-        reconnectData_     = qMax(0, qMin(reconnectData_, ::reconnectData().count() - 1));
-        ReconnectData data = ::reconnectData().at(reconnectData_);
-
-        int delay = data.delay * 1000;
+        smResuming_ = false;
         reconnectTimeoutTimer_->stop();
-        reconnectTimeoutTimer_->setInterval(data.timeout * 1000);
+        reconnectTimeoutTimer_->setInterval(RECONNECT_TIMEOUT * 1000);
         account->doReconnect = true;
 
+        // when is up to the scheduler, it spreads the logins of all accounts
+        const QString server = acc.opt_host ? acc.host : jid.domain();
+        const int     delay  = psi->reconnectScheduler()->schedule(account, server, [this]() { account->reconnect(); });
+
         reconnectScheduledAt_ = QDateTime::currentDateTime();
-        reconnectScheduledAt_ = reconnectScheduledAt_.addSecs(data.delay);
-        QTimer::singleShot(delay, account, SLOT(reconnect()));
+        reconnectScheduledAt_ = reconnectScheduledAt_.addMSecs(delay);
         account->stateChanged();
     }
 
@@ -990,14 +1618,40 @@ public slots:
     void stopReconnect()
     {
         reconnectScheduledAt_ = QDateTime();
-        reconnectData_        = -1;
+        smResuming_           = false;
         account->doReconnect  = false;
         reconnectTimeoutTimer_->stop();
+        psi->reconnectScheduler()->cancel(account);
+    }
+
+    // the stream lost its connection and resumes the session itself, nothing else is torn down
+    void startResume()
+    {
+        smResuming_ = true;
+        reconnectTimeoutTimer_->stop();
+        reconnectTimeoutTimer_->setInterval(RESUME_TIMEOUT * 1000);
+        reconnectTimeoutTimer_->start();
+        emit account->reconnecting();
+        account->stateChanged();
+    }
+
+    void resumed()
+    {
+        if (!smResuming_)
+            return;
+        stopReconnect();
+        account->stateChanged();
     }
 
 private slots:
     void reconnectTimerTimeout()
     {
+        // a resumed stream may just have had nothing to say yet
+        if (smResuming_ && account->isConnected()) {
+            resumed();
+            return;
+        }
+        smResuming_           = false;
         reconnectScheduledAt_ = QDateTime();
         account->v_isActive   = true;
         account->cs_error(RECONNECT_TIMEOUT_ERROR);
@@ -1006,8 +1660,8 @@ private slots:
 public:
     QDateTime reconnectScheduledAt_;
     QTimer *  reconnectTimeoutTimer_ = nullptr;
-    int       reconnectData_         = -1;
     bool      reconnectInfrequently_ = false;
+    bool      smResuming_            = false;
 };
 
 PsiAccount *PsiAccount::create(const UserAccount &acc, PsiContactList *parent, TabManager *tabManager)
@@ -1090,9 +1744,9 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
     connect(d->client, SIGNAL(rosterItemRemoved(const RosterItem &)),
             SLOT(client_rosterItemRemoved(const RosterItem &)));
     connect(d->client, SIGNAL(resourceAvailable(const Jid &, const Resource &)),
-            SLOT(client_resourceAvailable(const Jid &, const Resource &)));
+            SLOT(queueResourceAvailable(const Jid &, const Resource &)));
     connect(d->client, SIGNAL(resourceUnavailable(const Jid &, const Resource &)),
-            SLOT(client_resourceUnavailable(const Jid &, const Resource &)));
+            SLOT(queueResourceUnavailable(const Jid &, const Resource &)));
     connect(d->client, SIGNAL(presenceError(const Jid &, int, const QString &)),
             SLOT(client_presenceError(const Jid &, int, const QString &)));
     connect(d->client, SIGNAL(messageReceived(const Message &)), SLOT(client_messageReceived(const Message &)));
@@ -1112,9 +1766,6 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
     connect(d->client, SIGNAL(stanzaElementOutgoing(QDomElement &)), d,
             SLOT(client_stanzaElementOutgoing(QDomElement &)));
 
-    // Privacy manager
-    d->privacyManager = new PsiPrivacyManager(d->account, d->client->rootTask());
-
     // Caps manager
     d->client->capsManager()->setEnabled(
         PsiOptions::instance()->getOption("options.service-discovery.enable-entity-capabilities").toBool());
@@ -1126,47 +1777,119 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
         d->client->jingleICEManager()->setBasePort(quint16(ftPort));
     }
 
-    // Roster item exchange task
-    d->rosterItemExchangeTask = new RosterItemExchangeTask(d->client->rootTask());
-    connect(d->rosterItemExchangeTask, SIGNAL(rosterItemExchange(const Jid &, const RosterExchangeItems &)),
-            SLOT(actionRecvRosterExchange(const Jid &, const RosterExchangeItems &)));
-
     // Initialize server info stuff
     connect(d->client->serverInfoManager(), SIGNAL(featuresChanged()), SLOT(serverFeaturesChanged()));
 
     d->client->setNetworkAccessManager(d->psi->networkAccessManager());
 
+    // Avatars
+    d->avatarFactory = new AvatarFactory(this);
+    d->self.setAvatarFactory(avatarFactory());
+    d->historyPrefetch = new ChatHistoryPrefetch(this);
+    d->mamSync         = new MamSync(this);
+    d->receipts        = new ReceiptScheduler(this);
+    d->contactInfo     = new ContactInfoCache(this);
+    d->chatStates      = new ChatStateSender(this);
+
+    connect(VCardFactory::instance(), SIGNAL(vcardChanged(const Jid &)), d, SLOT(vcardChanged(const Jid &)));
+
+#ifdef USE_PEP
+    // Tune Controller
+    connect(d->psi->tuneManager(), SIGNAL(stopped()), SLOT(tuneStopped()));
+    connect(d->psi->tuneManager(), SIGNAL(playing(const Tune &)), SLOT(tunePlaying(const Tune &)));
+#endif
+
+    d->fileSharingDeviceOpener = new FileSharingDeviceOpener(this);
+
+    d->selfContact = new PsiContact(d->self, this, true);
+
+    // restore cached roster, the contact list isn't linked yet and picks it up in one pass
+    if (!d->loadRosterSnapshot(acc)) {
+        for (const auto &it : qAsConst(acc.roster))
+            client_rosterItemUpdated(it);
+    }
+
+    // restore pgp key bindings
+    setKnownPgpKeys(acc.pgpKnownKeys);
+
+    setUserAccount(acc);
+    connect(ProxyManager::instance(), SIGNAL(proxyRemoved(QString)), d, SLOT(pm_proxyRemoved(QString)));
+
+    connect(d->psi, SIGNAL(emitOptionsUpdate()), SLOT(optionsUpdate()));
+
+    d->setEnabled(enabled());
+
+    // Listen to the capabilities manager
+    connect(d->client->capsManager(), SIGNAL(capsChanged(const Jid &)), SLOT(capsChanged(const Jid &)));
+
+    // printf("PsiAccount: [%s] loaded\n", name().latin1());
+
+    if (PsiOptions::instance()->getOption("options.xml-console.enable-at-login").toBool() && enabled()) {
+        this->showXmlConsole();
+        d->xmlConsole->enable();
+    }
+
+    // TIP OF THE DAY: You cannot change content of caps extension.
+    // You have to rename it. If you just change what's inside, some people
+    // will cache one set of features and some people will cache other set.
+    // And this of course is a Bad Thing.
+
+#ifdef FILETRANSFER
+    reconfigureFTManager();
+    connect(d->client->fileTransferManager(), SIGNAL(incomingReady()), SLOT(client_incomingFileTransfer()));
+    connect(d->client->jingleManager(), &Jingle::Manager::incomingSession, this, &PsiAccount::client_incomingJingle);
+#endif
+
+    // load event queue from disk
+    QTimer::singleShot(0, d, SLOT(loadQueue()));
+
+    d->contactList->link(this);
+
+    d->updateContacts(); // update always visible contacts state
+}
+
+/**
+ * Creates the managers needed only while the account is enabled. Disabled accounts
+ * are mostly kept for their settings and cached roster, so they go without these.
+ */
+void PsiAccount::createManagers()
+{
+    if (d->managersCreated)
+        return;
+    d->managersCreated = true;
+
+    // Privacy manager
+    d->privacyManager = new PsiPrivacyManager(d->account, d->client->rootTask());
+
+    // Roster item exchange task
+    d->rosterItemExchangeTask = new RosterItemExchangeTask(d->client->rootTask());
+    connect(d->rosterItemExchangeTask, SIGNAL(rosterItemExchange(const Jid &, const RosterExchangeItems &)),
+            SLOT(actionRecvRosterExchange(const Jid &, const RosterExchangeItems &)));
+    d->rosterItemExchangeTask->setIgnoreNonRoster(
+        PsiOptions::instance()->getOption("options.messages.ignore-non-roster-contacts").toBool());
+
     // Initialize PubSub stuff
     d->pepManager = new PEPManager(d->client, d->client->serverInfoManager());
     connect(d->pepManager, SIGNAL(itemPublished(const Jid &, const QString &, const PubSubItem &)),
             SLOT(itemPublished(const Jid &, const QString &, const PubSubItem &)));
     connect(d->pepManager, SIGNAL(itemRetracted(const Jid &, const QString &, const PubSubRetraction &)),
             SLOT(itemRetracted(const Jid &, const QString &, const PubSubRetraction &)));
+    connect(d->pepManager, SIGNAL(itemsDelivered()), SLOT(pepItemsDelivered()));
     d->pepAvailable = false;
 
 #ifdef WHITEBOARDING
     // Initialize SXE manager
     d->sxeManager = new SxeManager(d->client, this);
     // Initialize Whiteboard manager
-    d->wbManager = new WbManager(d->client, this, d->sxeManager);
-    connect(d->wbManager, SIGNAL(wbRequest(Jid, int)), SLOT(wbRequest(Jid, int)));
-#endif
-
-    // Avatars
-    d->avatarFactory = new AvatarFactory(this);
-    d->self.setAvatarFactory(avatarFactory());
-
-    connect(VCardFactory::instance(), SIGNAL(vcardChanged(const Jid &)), d, SLOT(vcardChanged(const Jid &)));
+    d->wbManager = new WbManager(d->client, this, d->sxeManager);
+    connect(d->wbManager, SIGNAL(wbRequest(Jid, int)), SLOT(wbRequest(Jid, int)));
+#endif
 
     // Bookmarks
     d->bookmarkManager = new BookmarkManager(this);
+    d->autoJoinQueue   = new AutoJoinQueue(this);
     connect(d->bookmarkManager, SIGNAL(availabilityChanged()), SLOT(bookmarksAvailabilityChanged()));
-
-#ifdef USE_PEP
-    // Tune Controller
-    connect(d->psi->tuneManager(), SIGNAL(stopped()), SLOT(tuneStopped()));
-    connect(d->psi->tuneManager(), SIGNAL(playing(const Tune &)), SLOT(tunePlaying(const Tune &)));
-#endif
+    connect(d->bookmarkManager, SIGNAL(fetched()), SLOT(bookmarksFetched()));
 
     // HttpAuth
     d->httpAuthManager = new HttpAuthManager(d->client->rootTask());
@@ -1182,38 +1905,12 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
         new IdleServer(this, d->client->rootTask());
     }
 
-    d->fileSharingDeviceOpener = new FileSharingDeviceOpener(this);
-
-    d->selfContact = new PsiContact(d->self, this, true);
-
-    // restore cached roster
-    for (const auto &it : qAsConst(acc.roster))
-        client_rosterItemUpdated(it);
-
-    // restore pgp key bindings
-    setKnownPgpKeys(acc.pgpKnownKeys);
-
-    setUserAccount(acc);
-    connect(ProxyManager::instance(), SIGNAL(proxyRemoved(QString)), d, SLOT(pm_proxyRemoved(QString)));
-
-    connect(d->psi, SIGNAL(emitOptionsUpdate()), SLOT(optionsUpdate()));
-
-    d->setEnabled(enabled());
-
-    // Listen to the capabilities manager
-    connect(d->client->capsManager(), SIGNAL(capsChanged(const Jid &)), SLOT(capsChanged(const Jid &)));
-
-    // printf("PsiAccount: [%s] loaded\n", name().latin1());
-
-    if (PsiOptions::instance()->getOption("options.xml-console.enable-at-login").toBool() && enabled()) {
-        this->showXmlConsole();
-        d->xmlConsole->enable();
-    }
-
-    // TIP OF THE DAY: You cannot change content of caps extension.
-    // You have to rename it. If you just change what's inside, some people
-    // will cache one set of features and some people will cache other set.
-    // And this of course is a Bad Thing.
+    // roster versions come with the pushes
+    RosterPushWatcher *rosterPushWatcher = new RosterPushWatcher(d->client->rootTask());
+    connect(rosterPushWatcher, &RosterPushWatcher::versionChanged, this, [this](const QString &version) {
+        d->rosterVersion = version;
+        d->rosterChanged();
+    });
 
     // Voice Calling
 #ifdef HAVE_JINGLE
@@ -1223,11 +1920,6 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
         connect(d->voiceCaller, SIGNAL(incoming(const Jid &)), SLOT(incomingVoiceCall(const Jid &)));
     }
 
-#ifdef FILETRANSFER
-    reconfigureFTManager();
-    connect(d->client->fileTransferManager(), SIGNAL(incomingReady()), SLOT(client_incomingFileTransfer()));
-    connect(d->client->jingleManager(), &Jingle::Manager::incomingSession, this, &PsiAccount::client_incomingJingle);
-#endif
 #ifdef GOOGLE_FT
     d->googleFTManager = new GoogleFTManager(client());
     d->client->addExtension("share-v1", Features(QString("http://www.google.com/xmpp/protocol/share/v1")));
@@ -1237,28 +1929,38 @@ PsiAccount::PsiAccount(const UserAccount &acc, PsiContactList *parent, TabManage
 
     d->avCallManager = new AvCallManager(this);
     connect(d->avCallManager, SIGNAL(incomingReady()), d, SLOT(incoming_call()));
-    d->updateAvCallSettings(acc);
+    d->updateAvCallSettings(d->acc);
     d->client->jingleManager()->addExternalManager("urn:xmpp:jingle:apps:rtp:1");
 
-    // load event queue from disk
-    QTimer::singleShot(0, d, SLOT(loadQueue()));
-
-    d->contactList->link(this);
-
-    d->updateContacts(); // update always visible contacts state
+    updateFeatures();
 }
 
 PsiAccount::~PsiAccount()
 {
     logout(true, loggedOutStatus());
+    flushLog();
 
     setRCEnabled(false);
 
     emit accountDestroyed();
     // nuke all related dialogs
     deleteAllDialogs();
+    delete d->mamSync;
+    d->mamSync = nullptr;
+    delete d->receipts;
+    d->receipts = nullptr;
+    delete d->contactInfo;
+    d->contactInfo = nullptr;
+    delete d->chatStates;
+    d->chatStates = nullptr;
+    delete d->historyPrefetch;
+    d->historyPrefetch = nullptr;
 
     d->messageQueue.clear();
+    if (d->queueSaveTimer->isActive())
+        d->saveQueue();
+    if (d->rosterSaveTimer->isActive())
+        d->saveRosterSnapshot();
 
 #ifdef FILETRANSFER
     d->psi->ftdlg()->killTransfers(this);
@@ -1286,6 +1988,7 @@ PsiAccount::~PsiAccount()
 
     qDeleteAll(d->userList);
     d->userList.clear();
+    d->userIndex.clear();
 
     d->contactList->unlink(this);
     delete d;
@@ -1367,11 +2070,13 @@ const QString &PsiAccount::id() const { return d->acc.id; }
 // FIXME: we should move all PsiAccount::userAccount() users to PsiAccount::accountOptions()
 const UserAccount &PsiAccount::userAccount() const
 {
-    // save the roster and pgp key bindings
+    // save the roster and pgp key bindings.
+    // the roster has its own snapshot file, accounts.xml keeps a copy only until that one is written
+    const bool keepRoster = !QFile::exists(Private::pathToRosterSnapshot(d->acc.id));
     d->acc.roster.clear();
     d->acc.pgpKnownKeys.clear();
     for (UserListItem *u : qAsConst(d->userList)) {
-        if (u->inList())
+        if (keepRoster && u->inList())
             d->acc.roster += *u;
 
         if (!u->publicKeyID().isEmpty())
@@ -1395,11 +2100,31 @@ PsiCon *PsiAccount::psi() const { return d->psi; }
 
 AvatarFactory *PsiAccount::avatarFactory() const { return d->avatarFactory; }
 
-VoiceCaller *PsiAccount::voiceCaller() const { return d->voiceCaller; }
+ChatHistoryPrefetch *PsiAccount::historyPrefetch() const { return d->historyPrefetch; }
+
+MamSync *PsiAccount::mamSync() const { return d->mamSync; }
+
+ContactInfoCache *PsiAccount::contactInfo() const { return d->contactInfo; }
+
+ChatStateSender *PsiAccount::chatStates() const { return d->chatStates; }
+
+VoiceCaller *PsiAccount::voiceCaller() const
+{
+    const_cast<PsiAccount *>(this)->createManagers();
+    return d->voiceCaller;
+}
 #ifdef WHITEBOARDING
-WbManager *PsiAccount::wbManager() const { return d->wbManager; }
+WbManager *PsiAccount::wbManager() const
+{
+    const_cast<PsiAccount *>(this)->createManagers();
+    return d->wbManager;
+}
 #endif
-PrivacyManager *PsiAccount::privacyManager() const { return d->privacyManager; }
+PrivacyManager *PsiAccount::privacyManager() const
+{
+    const_cast<PsiAccount *>(this)->createManagers();
+    return d->privacyManager;
+}
 
 bool PsiAccount::hasPgp() const { return !d->cur_pgpSecretKey.isEmpty(); }
 
@@ -1417,7 +2142,7 @@ void PsiAccount::setKnownPgpKeys(const VarList &list)
 {
     for (const auto &kit : list) {
         const VarListItem &i = kit;
-        UserListItem *     u = find(Jid(i.key()));
+        UserListItem *     u = find(JIDUtil::intern(i.key()));
         if (u) {
             u->setPublicKeyID(i.data());
             cpUpdate(*u);
@@ -1427,7 +2152,7 @@ void PsiAccount::setKnownPgpKeys(const VarList &list)
 
 void PsiAccount::removeKnownPgpKey(const QString &jid)
 {
-    UserListItem *u = find(Jid(jid));
+    UserListItem *u = find(JIDUtil::intern(jid));
     if (u) {
         u->setPublicKeyID(QString());
         cpUpdate(*u);
@@ -1658,6 +2383,15 @@ void PsiAccount::login()
 
     d->jid = d->nextJid;
 
+    d->bootstrapClock.start();
+    d->bootstrapSteps.clear();
+    d->timeToUsable   = -1;
+    d->carbonsEnabled = false;
+    d->mucStatusQueue.clear();
+    d->mucStatusSent.clear();
+    d->receipts->clear();
+    d->chatStates->clear();
+
     v_isActive      = true;
     isDisconnecting = false;
     notifyOnlineOk  = false;
@@ -1680,11 +2414,15 @@ void PsiAccount::login()
 
     AdvancedConnector::Proxy p = convert_proxy(d->acc, d->jid);
 
+    const ServerCacheEntry cached = serverCache().value(d->jid.domain());
+
     // stream
     d->conn = new AdvancedConnector;
     if (d->acc.ssl != UserAccount::SSL_No && tlsSupported && keyStoreManagerAvailable) {
         d->tls = new QCA::TLS;
         d->tls->setTrustedCertificates(CertificateHelpers::allCertificates(ApplicationInfo::getCertificateStoreDirs()));
+        if (!cached.tlsSession.isNull())
+            d->tls->setSession(cached.tlsSession);
         d->tlsHandler = new QCATLSHandler(d->tls);
         d->tlsHandler->setXMPPCertCheck(true);
         connect(d->tlsHandler, SIGNAL(tlsHandshaken()), SLOT(tls_handshaken()));
@@ -1696,6 +2434,13 @@ void PsiAccount::login()
         d->conn->setOptSSL(d->acc.ssl == UserAccount::SSL_Legacy);
     }
 
+    // a server that worked a moment ago is connected to again without the SRV and address lookups
+    d->cacheServerAddress = !useHost && p.type() == AdvancedConnector::Proxy::None;
+    d->usingCachedAddress = d->cacheServerAddress && !cached.address.isNull()
+        && cached.expires > QDateTime::currentDateTimeUtc();
+    if (d->usingCachedAddress)
+        d->conn->setOptHostPort(cached.address.toString(), cached.port);
+
     d->stream = new ClientStream(d->conn, d->tlsHandler);
     d->stream->setRequireMutualAuth(d->acc.req_mutual_auth);
     d->stream->setSSFRange(d->acc.security_level, 256);
@@ -1737,6 +2482,7 @@ void PsiAccount::logout(bool fast, const Status &s)
     clearCurrentConnectionError();
 
     d->stopReconnect();
+    d->mamSync->stop();
 
     bool waitForLogout = false;
     if (loggedIn()) {
@@ -1763,6 +2509,7 @@ void PsiAccount::logout(bool fast, const Status &s)
     else {
         qDeleteAll(d->gcbank);
         d->gcbank.clear();
+        d->gcIndex.clear();
     }
 
     v_isActive     = false;
@@ -1783,12 +2530,16 @@ bool PsiAccount::loggedIn() const { return (v_isActive && presenceSent); }
 
 void PsiAccount::tls_handshaken()
 {
-    bool certificateOk = CertificateHelpers::checkCertificate(
-        d->tls, d->tlsHandler, d->acc.tlsOverrideDomain, d->acc.tlsOverrideCert, this,
-        (d->psi->contactList()->enabledAccounts().count() > 1 ? QString("%1: ").arg(name()) : "")
-            + tr("Server Authentication"),
-        d->jid.domain());
+    // a resumed session had its certificate checked when it was established, and the backend
+    // may not even have the chain of it anymore
+    bool certificateOk = d->tls->isSessionReused()
+        || CertificateHelpers::checkCertificate(
+            d->tls, d->tlsHandler, d->acc.tlsOverrideDomain, d->acc.tlsOverrideCert, this,
+            (d->psi->contactList()->enabledAccounts().count() > 1 ? QString("%1: ").arg(name()) : "")
+                + tr("Server Authentication"),
+            d->jid.domain(), &d->acceptedCerts);
     if (certificateOk && !d->tlsHandler.isNull()) {
+        serverCache()[d->jid.domain()].tlsSession = d->tls->session();
         d->tlsHandler->continueAfterHandshake();
     } else {
         logout(false, loggedOutStatus());
@@ -1935,6 +2686,21 @@ void PsiAccount::cs_authenticated()
 
     d->reconnectConnection = QMetaObject::Connection();
 
+    // an address from the cache keeps its expiry, so the domain is resolved again now and then
+    if (d->cacheServerAddress && !d->usingCachedAddress && d->conn->havePeerAddress()) {
+        ServerCacheEntry &e = serverCache()[d->jid.domain()];
+        e.address           = d->conn->peerAddress();
+        e.port              = d->conn->peerPort();
+        e.expires           = QDateTime::currentDateTimeUtc().addSecs(SERVER_CACHE_TTL);
+    }
+
+    if (d->smResuming_) {
+        // same session, roster, presences and rooms are all still valid
+        d->resumed();
+        return;
+    }
+    d->bootstrapDone("authenticated");
+
     // printf("PsiAccount: [%s] authenticated\n", name().latin1());
     d->conn->changePollInterval(10); // for http poll, slow down after login
 
@@ -1972,14 +2738,71 @@ void PsiAccount::sessionStarted()
     if (d->voiceCaller)
         d->voiceCaller->initialize();
 
-    // flag roster for delete
-    for (UserListItem *u : qAsConst(d->userList)) {
-        if (u->inList())
-            u->setFlagForDelete(true);
+    // ask for roster, only what changed since the cached one if the server keeps versions
+    RosterVersionTask *t = new RosterVersionTask(d->client->rootTask(), d->rosterVersion);
+    connect(t, SIGNAL(finished()), SLOT(rosterVersion_finished()));
+    t->go(true);
+
+    // what doesn't need the roster goes along with it, instead of after it and the server disco
+    checkOwnVCard();
+    d->bookmarkManager->prefetch();
+    if (serverCache().value(d->jid.domain()).carbons)
+        enableCarbons();
+}
+
+void PsiAccount::rosterVersion_finished()
+{
+    RosterVersionTask *t = static_cast<RosterVersionTask *>(sender());
+    if (!t->success()) {
+        if (t->statusCode() == Task::ErrDisc)
+            return;
+
+        // ask the plain way, without any version
+        d->rosterVersion.clear();
+        for (UserListItem *u : qAsConst(d->userList)) {
+            if (u->inList())
+                u->setFlagForDelete(true);
+        }
+        d->client->rosterRequest();
+        return;
+    }
+
+    Roster roster;
+    if (t->unchanged()) {
+        // after a restart iris knows no roster yet, it gets the cached one
+        if (d->client->roster().isEmpty()) {
+            for (const UserListItem *u : qAsConst(d->userList)) {
+                if (u->inList())
+                    roster += RosterItem(*u);
+            }
+        }
+    } else {
+        // a full roster, what isn't in it is gone
+        QSet<QString> jids;
+        for (const RosterItem &item : t->roster())
+            jids.insert(item.jid().bare());
+        for (UserListItem *u : qAsConst(d->userList)) {
+            if (u->inList())
+                u->setFlagForDelete(true);
+        }
+        roster = t->roster();
+        for (const LiveRosterItem &i : d->client->roster()) {
+            if (!jids.contains(i.jid().bare())) {
+                RosterItem gone(i.jid());
+                gone.setSubscription(Subscription(Subscription::Remove));
+                roster += gone;
+            }
+        }
+        d->rosterVersion = t->version();
     }
 
-    // ask for roster
-    d->client->rosterRequest();
+    // iris has no public import, its own roster pushes go through prRoster()
+    if (!roster.isEmpty())
+        QMetaObject::invokeMethod(d->client, "prRoster", Qt::DirectConnection, Q_ARG(Roster, roster));
+
+    // as if iris had fetched it, its server info manager starts the server disco on this
+    QMetaObject::invokeMethod(d->client, "rosterRequestFinished", Qt::DirectConnection, Q_ARG(bool, true),
+                              Q_ARG(int, 0), Q_ARG(QString, QString()));
 }
 
 void PsiAccount::cs_connectionClosed()
@@ -1997,8 +2820,10 @@ void PsiAccount::cs_delayedCloseFinished()
 
 void PsiAccount::cs_warning(int w)
 {
-    if (w == ClientStream::WarnSMReconnection)
+    if (w == ClientStream::WarnSMReconnection) {
+        d->startResume();
         return;
+    }
 
     bool showNoTlsWarning = w == ClientStream::WarnNoTLS && d->acc.ssl == UserAccount::SSL_Yes;
     bool doCleanupStream  = !d->stream || showNoTlsWarning;
@@ -2233,6 +3058,10 @@ void PsiAccount::cs_error(int err)
         d->currentConnectionErrorCondition = d->stream->errorCondition();
     }
 
+    // whatever was cached may be what failed, the next login starts from scratch
+    if (!isConnected())
+        serverCache().remove(d->jid.domain());
+
     d->client->close();
     cleanupStream();
 
@@ -2255,6 +3084,7 @@ void PsiAccount::cs_error(int err)
     }
 
     v_isActive = false;
+    d->psi->reconnectScheduler()->cancel(this);
 
     // If a password failure, prompt for correct password
     if (badPass) {
@@ -2293,6 +3123,8 @@ QString PsiAccount::currentConnectionError() const { return d->currentConnection
 
 int PsiAccount::currentConnectionErrorCondition() const { return d->currentConnectionErrorCondition; }
 
+qint64 PsiAccount::timeToUsable() const { return d->timeToUsable; }
+
 void PsiAccount::client_rosterRequestFinished(bool success, int, const QString &)
 {
     if (success) {
@@ -2309,12 +3141,16 @@ void PsiAccount::client_rosterRequestFinished(bool success, int, const QString &
                 updateReadNext(u->jid());
 
                 profileRemoveEntry(u->jid());
+                d->unindexUser(u);
                 it.remove();
                 delete u;
             }
         }
 
+        d->psi->reconnectScheduler()->loggedIn(this);
         d->stopReconnect();
+        d->rosterChanged();
+        d->bootstrapDone("roster");
     } else {
         // printf("PsiAccount: [%s] error retrieving roster: [%d, %s]\n", name().latin1(), code, str.latin1());
     }
@@ -2330,12 +3166,18 @@ void PsiAccount::client_rosterRequestFinished(bool success, int, const QString &
     d->vcardChanged(jid());
     setStatusDirect(d->loginStatus, d->loginWithPriority);
 
+    // bookmarks fetched along with the roster wait for the presence to join rooms
+    if (d->bookmarkManager->isAvailable())
+        bookmarksAvailabilityChanged();
+
     emit rosterRequestFinished();
 }
 
 void PsiAccount::resolveContactName(const Jid &j)
 {
-    VCardFactory::instance()->getVCard(j, client()->rootTask(), this, [this]() { jt_resolveContactName(); });
+    VCardFactory::instance()->getVCard(
+        j, client()->rootTask(), this, [this]() { jt_resolveContactName(); }, true, false, true,
+        VCardFactory::BackgroundPriority);
 }
 
 void PsiAccount::setClientVersionInfoMap(const QVariantMap &info)
@@ -2366,20 +3208,39 @@ void PsiAccount::serverFeaturesChanged()
         return;
     }
 
-    if (d->client->serverInfoManager()->canMessageCarbons()) {
-        JT_MessageCarbons *j = new JT_MessageCarbons(d->client->rootTask());
-        j->enable();
-        j->go(true);
-    }
+    // the next login enables them right away
+    serverCache()[d->jid.domain()].carbons = d->client->serverInfoManager()->canMessageCarbons();
+    if (d->client->serverInfoManager()->canMessageCarbons())
+        enableCarbons();
+
+    // what other clients of the account saw while this one was away
+    d->mamSync->start();
+
+    d->bootstrapDone("features");
+}
+
+void PsiAccount::enableCarbons()
+{
+    if (d->carbonsEnabled)
+        return;
+    d->carbonsEnabled    = true;
+    JT_MessageCarbons *j = new JT_MessageCarbons(d->client->rootTask());
+    j->enable();
+    j->go(true);
+}
 
-    if (d->client->serverInfoManager()->features().hasVCard() && !d->vcardChecked) {
-        // Get the vcard
+// asked at session start, without waiting for the server disco: a server without vcard-temp just answers
+// with an error
+void PsiAccount::checkOwnVCard()
+{
+    if (!d->vcardChecked) {
         const VCard vcard = VCardFactory::instance()->vcard(d->jid);
         if (PsiOptions::instance()->getOption("options.vcard.query-own-vcard-on-login").toBool() || vcard.isEmpty()
             || (vcard.nickName().isEmpty() && vcard.fullName().isEmpty())) {
             VCardFactory::instance()->getVCard(d->jid, d->client->rootTask(), this, [this]() {
                 if (!isConnected() || !isActive())
                     return;
+                d->bootstrapDone("vcard");
 
                 QString   nick  = d->jid.node();
                 JT_VCard *j     = static_cast<JT_VCard *>(sender());
@@ -2440,25 +3301,29 @@ void PsiAccount::setPEPAvailable(bool b)
 
 void PsiAccount::bookmarksAvailabilityChanged()
 {
-    if (!d->bookmarkManager->isAvailable()
+    if (!d->bookmarkManager->isAvailable() || !loggedIn()
         || !PsiOptions::instance()->getOption("options.muc.bookmarks.auto-join").toBool()) {
         return;
     }
 
 #ifdef GROUPCHAT
+    QList<ConferenceBookmark> rooms;
     for (const ConferenceBookmark &c : d->bookmarkManager->conferences()) {
         Jid cj = c.jid().withResource(QString());
         if (!findDialog<GCMainDlg *>(cj) && c.needJoin()) {
             auto ul = findRelevant(Jid(QString(), cj.domain()));
             if (ul.isEmpty() || !ul[0]->isTransport()
                 || !ul[0]->resourceList().isEmpty()) { // don't join to MUCs on disconnected transports
-                actionJoin(c, true, false);
+                rooms += c;
             }
         }
     }
+    d->autoJoinQueue->start(rooms);
 #endif
 }
 
+void PsiAccount::bookmarksFetched() { d->bootstrapDone("bookmarks"); }
+
 void PsiAccount::incomingHttpAuthRequest(const PsiHttpAuthRequest &req)
 {
     HttpAuthEvent::Ptr e(new HttpAuthEvent(req, this));
@@ -2477,7 +3342,7 @@ void PsiAccount::client_rosterItemAdded(const RosterItem &r)
 void PsiAccount::client_rosterItemUpdated(const RosterItem &r)
 {
     // see if the item added is already in our local list
-    UserListItem *u = d->userList.find(r.jid());
+    UserListItem *u = d->findUser(r.jid());
     if (u) {
         u->setFlagForDelete(false);
         u->setRosterItem(r);
@@ -2486,16 +3351,17 @@ void PsiAccount::client_rosterItemUpdated(const RosterItem &r)
         u = new UserListItem;
         u->setRosterItem(r);
         u->setAvatarFactory(avatarFactory());
-        d->userList.append(u);
+        d->addUser(u);
     }
     u->setInList(true);
 
     profileUpdateEntry(*u);
+    d->rosterChanged();
 }
 
 void PsiAccount::client_rosterItemRemoved(const RosterItem &r)
 {
-    UserListItem *u = d->userList.find(r.jid());
+    UserListItem *u = d->findUser(r.jid());
     if (!u)
         return;
 
@@ -2510,9 +3376,10 @@ void PsiAccount::client_rosterItemRemoved(const RosterItem &r)
     // else remove them for good!
     else {
         profileRemoveEntry(u->jid());
-        d->userList.removeAll(u);
+        d->removeUser(u);
         delete u;
     }
+    d->rosterChanged();
 }
 
 void PsiAccount::tryVerify(UserListItem *u, UserResource *ur)
@@ -2530,6 +3397,65 @@ void PsiAccount::incomingVoiceCall(const Jid &j)
     vc->incoming();
 }
 
+void PsiAccount::queueResourceAvailable(const Jid &j, const Resource &r) { queuePresence(j, r, true); }
+
+void PsiAccount::queueResourceUnavailable(const Jid &j, const Resource &r) { queuePresence(j, r, false); }
+
+void PsiAccount::queuePresence(const Jid &j, const Resource &r, bool available)
+{
+    // only the last presence of a resource within a batch matters
+    auto it = d->presenceQueueIndex.constFind(j.full());
+    if (it != d->presenceQueueIndex.constEnd()) {
+        Private::QueuedPresence &p = d->presenceQueue[it.value()];
+        p.resource                 = r;
+        p.available                = available;
+        return;
+    }
+    d->presenceQueueIndex.insert(j.full(), d->presenceQueue.size());
+    d->presenceQueue.append({ j, r, available });
+    if (!d->presenceTimer->isActive())
+        d->presenceTimer->start();
+}
+
+void PsiAccount::flushPresenceQueue()
+{
+    d->presenceTimer->stop();
+    if (d->presenceQueue.isEmpty())
+        return;
+
+    const QList<Private::QueuedPresence> queue = d->presenceQueue;
+    d->presenceQueue.clear();
+    d->presenceQueueIndex.clear();
+
+    const bool bulk = queue.size() > 1;
+    if (bulk)
+        emit beginBulkContactUpdate();
+    d->presenceBatch = true;
+    for (const Private::QueuedPresence &p : queue) {
+        if (p.available)
+            client_resourceAvailable(p.jid, p.resource);
+        else
+            client_resourceUnavailable(p.jid, p.resource);
+    }
+    d->presenceBatch = false;
+    if (bulk)
+        emit endBulkContactUpdate();
+
+    // one sound per kind for the whole batch
+    const QList<int> sounds = d->batchSounds;
+    d->batchSounds.clear();
+    for (int sound : sounds)
+        playSound(SoundType(sound));
+}
+
+void PsiAccount::presenceSound(SoundType sound)
+{
+    if (!d->presenceBatch)
+        playSound(sound);
+    else if (!d->batchSounds.contains(sound))
+        d->batchSounds.append(sound);
+}
+
 void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
 {
     // Notification
@@ -2562,8 +3488,8 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
                 // TODO populate caps manager with this too
                 ur.setClient(ApplicationInfo::name(), ApplicationInfo::version(), SystemInfo::instance()->os());
             } else {
-                CapsManager *cm = d->client->capsManager();
-                ur.setClient(cm->clientName(j), cm->clientVersion(j), cm->osVersion(j));
+                const auto client = PsiCapsRegistry::clientInfo(d->client->capsManager(), j);
+                ur.setClient(client.name, client.version, client.os);
             }
 
             u->userResourceList().append(ur);
@@ -2597,7 +3523,9 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
         u->setPresenceError("");
         cpUpdate(*u, r.name(), true);
 
-        if (doAnim && PsiOptions::instance()->getOption("options.ui.contactlist.use-status-change-animation").toBool())
+        static const auto animate
+            = PsiOptions::handle<bool>("options.ui.contactlist.use-status-change-animation");
+        if (doAnim && animate.value())
             profileAnimateNick(u->jid());
 
 #ifdef GROUPCHAT
@@ -2614,15 +3542,14 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
     }
 
     if (doSound)
-        playSound(eOnline);
+        presenceSound(eOnline);
 
     // Do the popup test earlier (to avoid needless JID lookups)
-    if ((popupType == PopupOnline
-         && PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.status.online").toBool())
-        || (popupType == PopupStatusChange
-            && PsiOptions::instance()
-                   ->getOption("options.ui.notifications.passive-popups.status.other-changes")
-                   .toBool())) {
+    static const auto popupOnline = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.status.online");
+    static const auto popupChanges
+        = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.status.other-changes");
+    if ((popupType == PopupOnline && popupOnline.value())
+        || (popupType == PopupStatusChange && popupChanges.value())) {
         if (notifyOnlineOk && doPopup && !d->blockTransportPopupList->find(j, popupType == PopupOnline)
             && !d->noPopup(IncomingStanza)) {
             UserListItem *          u  = findFirstRelevant(j);
@@ -2632,12 +3559,8 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
             else if (popupType == PopupStatusChange)
                 pt = PopupManager::AlertStatusChange;
 
-            if ((popupType == PopupOnline
-                 && PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.status.online").toBool())
-                || (popupType == PopupStatusChange
-                    && PsiOptions::instance()
-                           ->getOption("options.ui.notifications.passive-popups.status.other-changes")
-                           .toBool())) {
+            if ((popupType == PopupOnline && popupOnline.value())
+                || (popupType == PopupStatusChange && popupChanges.value())) {
                 psi()->popupManager()->doPopup(this, pt, j, r, u, PsiEvent::Ptr(), false);
             }
         } else if (!notifyOnlineOk) {
@@ -2656,8 +3579,9 @@ void PsiAccount::client_resourceAvailable(const Jid &j, const Resource &r)
             UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
             if (rit != u->userResourceList().end()) {
                 if (cm->capsSpec(j).isValid()) {
-                    (*rit).setClient(cm->clientName(j), cm->clientVersion(j),
-                                     cm->osVersion(j)); // FIXME it seems it's impossible if not in cache
+                    const auto client = PsiCapsRegistry::clientInfo(cm, j);
+                    (*rit).setClient(client.name, client.version,
+                                     client.os); // FIXME it seems it's impossible if not in cache
                 }
                 cpUpdate(*u, (*rit).name());
             }
@@ -2685,8 +3609,11 @@ void PsiAccount::userListItemUnavailable(UserListItem *u, const Jid &j, const Re
             u->removeResource(j.resource());
         }
 
-        if (!u->isAvailable())
+        if (!u->isAvailable()) {
             u->setLastAvailable(QDateTime::currentDateTime());
+            if (u->inList())
+                d->rosterChanged();
+        }
 
         if (!u->isAvailable() || u->isSelf()) {
             // don't sound for our own resource
@@ -2719,6 +3646,8 @@ void PsiAccount::userListItemUnavailable(UserListItem *u, const Jid &j, const Re
 
 void PsiAccount::client_resourceUnavailable(const Jid &j, const Resource &r)
 {
+    static const auto popupOffline = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.status.offline");
+
     bool doSound = false;
     bool doPopup = false;
 
@@ -2730,14 +3659,13 @@ void PsiAccount::client_resourceUnavailable(const Jid &j, const Resource &r)
         userListItemUnavailable(u, j, r, &doSound, &doPopup);
     }
     if (doSound)
-        playSound(eOffline);
+        presenceSound(eOffline);
 
     // Do the popup test earlier (to avoid needless JID lookups)
-    if (PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.status.offline").toBool() && doPopup
-        && !d->blockTransportPopupList->find(j) && !d->noPopup(IncomingStanza)) {
+    if (popupOffline.value() && doPopup && !d->blockTransportPopupList->find(j) && !d->noPopup(IncomingStanza)) {
         UserListItem *u = findFirstRelevant(j);
 
-        if (PsiOptions::instance()->getOption("options.ui.notifications.passive-popups.status.offline").toBool()) {
+        if (popupOffline.value()) {
             psi()->popupManager()->doPopup(this, PopupManager::AlertOffline, j, r, u, PsiEvent::Ptr(), false);
         }
     }
@@ -2755,6 +3683,9 @@ void PsiAccount::client_presenceError(const Jid &j, int, const QString &str)
 
 void PsiAccount::client_messageReceived(const Message &m)
 {
+    // the sender's presence may still be waiting in the queue
+    flushPresenceQueue();
+
     // check if it's a server message without a from, and set the from appropriately
     Message _m(m);
     if (_m.from().isEmpty()) {
@@ -2816,6 +3747,11 @@ void PsiAccount::wbRequest(const Jid &j, int id)
  */
 void PsiAccount::processIncomingMessage(const Message &_m)
 {
+    static const auto ignoreHeadlines      = PsiOptions::handle<bool>("options.messages.ignore-headlines");
+    static const auto ignoreNonRoster      = PsiOptions::handle<bool>("options.messages.ignore-non-roster-contacts");
+    static const auto excludeMucFromIgnore = PsiOptions::handle<bool>("options.messages.exclude-muc-from-ignore");
+    static const auto sendReceipts         = PsiOptions::handle<bool>("options.ui.notifications.send-receipts");
+
     // skip empty messages, but not if the message contains a data form
     if (_m.body().isEmpty() && _m.urlList().isEmpty() && _m.invite().isEmpty() && !_m.containsEvents()
         && _m.chatState() == StateNone && _m.subject().isNull() && _m.rosterExchangeItems().isEmpty()
@@ -2824,7 +3760,7 @@ void PsiAccount::processIncomingMessage(const Message &_m)
         return;
 
     // skip headlines?
-    if (_m.type() == "headline" && PsiOptions::instance()->getOption("options.messages.ignore-headlines").toBool())
+    if (_m.type() == QLatin1String("headline") && ignoreHeadlines.value())
         return;
 
     if (_m.getForm().registrarType() == "urn:xmpp:captcha") {
@@ -2854,7 +3790,7 @@ void PsiAccount::processIncomingMessage(const Message &_m)
     }
 
 #ifdef GROUPCHAT
-    if (_m.type() == "groupchat") {
+    if (_m.type() == QLatin1String("groupchat")) {
         MessageEvent::Ptr me(new MessageEvent(_m, this));
         me->setOriginLocal(false);
         handleEvent(me, IncomingStanza);
@@ -2864,7 +3800,7 @@ void PsiAccount::processIncomingMessage(const Message &_m)
 
     UserListItem *u = findFirstRelevant(_m.from());
     if (u) {
-        if (_m.type() == "chat")
+        if (_m.type() == QLatin1String("chat"))
             u->setLastMessageType(1);
         else
             u->setLastMessageType(0);
@@ -2879,8 +3815,8 @@ void PsiAccount::processIncomingMessage(const Message &_m)
     QList<UserListItem *> ul = findRelevant(m.from());
 
     // ignore events from non-roster JIDs?
-    if (ul.isEmpty() && PsiOptions::instance()->getOption("options.messages.ignore-non-roster-contacts").toBool()) {
-        if (PsiOptions::instance()->getOption("options.messages.exclude-muc-from-ignore").toBool()) {
+    if (ul.isEmpty() && ignoreNonRoster.value()) {
+        if (excludeMucFromIgnore.value()) {
 #ifdef GROUPCHAT
             GCMainDlg *w = findDialog<GCMainDlg *>(Jid(_m.from().bare()));
             if (!w) {
@@ -2901,7 +3837,7 @@ void PsiAccount::processIncomingMessage(const Message &_m)
     if(!c)
         c = findChatDialog(m.from().full());*/
 
-    if (m.type() == "error") {
+    if (m.type() == QLatin1String("error")) {
         Stanza::Error           err  = m.error();
         QPair<QString, QString> desc = err.description();
         QString                 msg  = desc.first + ".\n" + desc.second;
@@ -2923,7 +3859,7 @@ void PsiAccount::processIncomingMessage(const Message &_m)
         }
 
         // change the type?
-        if (m.type() != "headline" && m.invite().isEmpty() && m.mucInvites().isEmpty()) {
+        if (m.type() != QLatin1String("headline") && m.invite().isEmpty() && m.mucInvites().isEmpty()) {
             const QString type
                 = PsiOptions::instance()->getOption("options.messages.force-incoming-message-type").toString();
             if (type == "message")
@@ -2951,19 +3887,9 @@ void PsiAccount::processIncomingMessage(const Message &_m)
         // if(m.type() == "chat" && (!m.urlList().isEmpty() || !m.subject().isEmpty()))
         //    m.setType("");
 
-        if (m.messageReceipt() == ReceiptRequest && !m.id().isEmpty()
-            && PsiOptions::instance()->getOption("options.ui.notifications.send-receipts").toBool()) {
-            UserListItem *u;
-            if (j.compare(d->self.jid(), false) || groupchats().contains(j.bare())
-                || (!d->loginStatus.isInvisible() && (u = d->userList.find(j))
-                    && (u->subscription().type() == Subscription::To
-                        || u->subscription().type() == Subscription::Both))) {
-                Message tm(m.from());
-                tm.setMessageReceiptId(m.id());
-                tm.setMessageReceipt(ReceiptReceived);
-                dj_sendMessage(tm, false);
-            }
-        }
+        // sent with the others of a burst, e.g. the offline messages after login
+        if (m.messageReceipt() == ReceiptRequest && !m.id().isEmpty() && sendReceipts.value() && d->acknowledges(j))
+            d->receipts->receipt(m.from(), m.id());
     }
 
     MessageEvent::Ptr me(new MessageEvent(m, this));
@@ -2975,7 +3901,7 @@ void PsiAccount::client_subscription(const Jid &j, const QString &str, const QSt
 {
     // if they remove our subscription, then we lost presence
     if (str == "unsubscribed") {
-        UserListItem *u = d->userList.find(j);
+        UserListItem *u = d->findUser(j);
         if (u)
             simulateContactOffline(u);
     }
@@ -3096,12 +4022,14 @@ void PsiAccount::setStatus(const Status &_s, bool withPriority, bool isManualSta
 
     // Block all transports' contacts' status change popups from popping
     {
-        for (const auto &i : qAsConst(d->acc.roster)) {
-            if (i.jid()
+        for (const UserListItem *i : qAsConst(d->userList)) {
+            if (!i->inList())
+                continue;
+            if (i->jid()
                     .node()
                     .isEmpty() /*&& i.jid().resource() == "registered"*/) // it is very likely then, that it's transport
                 new BlockTransportPopup(d->blockTransportPopupList,
-                                        i.jid()); // FIXME this code looks like a source for memory leak
+                                        i->jid()); // FIXME this code looks like a source for memory leak
         }
     }
 
@@ -3267,6 +4195,7 @@ void PsiAccount::setStatusActual(const Status &_s)
         stateChanged();
     } else {
         presenceSent = true;
+        d->bootstrapDone("presence");
         stateChanged();
         sentInitialPresence();
 
@@ -3283,25 +4212,50 @@ void PsiAccount::capsChanged(const Jid &j)
     if (!loggedIn())
         return;
 
-    CapsManager *cm      = d->client->capsManager();
-    QString      name    = cm->clientName(j);
-    QString      version = (name.isEmpty() ? QString() : cm->clientVersion(j));
-    QString      os;
+    // caps of a whole roster get resolved at login, the contacts are updated once per pass
+    d->capsQueue.insert(j.full(), j);
+    if (!d->capsTimer->isActive())
+        d->capsTimer->start();
+}
+
+void PsiAccount::flushCapsQueue()
+{
+    d->capsTimer->stop();
+    const QList<Jid> queue = d->capsQueue.values();
+    d->capsQueue.clear();
+    if (queue.isEmpty() || !loggedIn())
+        return;
+
+    CapsManager *         cm = d->client->capsManager();
+    QList<UserListItem *> dirty;
+    QSet<UserListItem *>  dirtySet;
+    for (const Jid &j : queue) {
+        // worked out once per caps node, see PsiCapsRegistry::clientInfo()
+        const auto client = PsiCapsRegistry::clientInfo(cm, j);
 
-    if (!name.isEmpty()) {
-        version = cm->clientVersion(j);
-        os      = cm->osVersion(j);
+        const auto &items = findRelevant(j);
+        for (UserListItem *u : items) {
+            UserResourceList::Iterator rit = u->userResourceList().find(j.resource());
+            if (rit == u->userResourceList().end())
+                continue;
+            UserResource &r = *rit;
+            if (r.clientName() == client.name && r.clientVersion() == client.version && r.clientOS() == client.os)
+                continue;
+            r.setClient(client.name, client.version, client.os);
+            if (!dirtySet.contains(u)) {
+                dirtySet.insert(u);
+                dirty += u;
+            }
+        }
     }
 
-    const auto &items = findRelevant(j);
-    for (UserListItem *u : items) {
-        UserResourceList::Iterator rit   = u->userResourceList().find(j.resource());
-        bool                       found = !(rit == u->userResourceList().end());
-        if (!found)
-            continue;
-        (*rit).setClient(name, version, os);
+    const bool bulk = dirty.size() > 1;
+    if (bulk)
+        emit beginBulkContactUpdate();
+    for (UserListItem *u : qAsConst(dirty))
         cpUpdate(*u);
-    }
+    if (bulk)
+        emit endBulkContactUpdate();
 }
 
 void PsiAccount::tuneStopped()
@@ -3415,21 +4369,31 @@ QString PsiAccount::localHostName()
 
 bool PsiAccount::validRosterExchangeItem(const RosterExchangeItem &item)
 {
+    // through the user index, exchanges can carry thousands of items
+    const UserListItem *u = d->findUser(item.jid().withResource(QString()));
+    if (u && !u->inList())
+        u = nullptr;
+
     if (item.action() == RosterExchangeItem::Add) {
-        return (d->client->roster().find(item.jid(), true) == d->client->roster().end());
+        return !u;
     } else if (item.action() == RosterExchangeItem::Delete) {
-        LiveRoster::ConstIterator i = d->client->roster().find(item.jid(), true);
-        if (i == d->client->roster().end())
+        if (!u)
             return false;
 
         for (const QString &group : item.groups()) {
-            if (!(*i).groups().contains(group))
+            if (!u->groups().contains(group))
                 return false;
         }
         return true;
     } else if (item.action() == RosterExchangeItem::Modify) {
-        // TODO
-        return false;
+        if (!u)
+            return false;
+
+        QStringList g1 = item.groups();
+        g1.sort();
+        QStringList g2 = u->groups();
+        g2.sort();
+        return item.name() != u->name() || g1 != g2;
     }
     return false;
 }
@@ -3464,11 +4428,22 @@ QList<ChatDlg *> PsiAccount::findChatDialogs(const Jid &jid, bool compareResourc
     return findDialogs<ChatDlg *>(jid, compareResource);
 }
 
+/**
+ * \brief Contacts with an open chat, in the order the chats were opened.
+ *
+ * Taken from the registered chat dialogs, so it costs as much as there are chats, not contacts.
+ */
 QList<PsiContact *> PsiAccount::activeContacts() const
 {
     QList<PsiContact *> ret;
-    for (PsiContact *pc : contactList()) {
-        if (pc->isActiveContact()) {
+    const auto &        chats = findAllDialogs<ChatDlg *>();
+    for (ChatDlg *chat : chats) {
+        // a chat with a roster contact may be locked to one of its resources
+        PsiContact *pc = d->findContact(chat->jid());
+        if (!pc) {
+            pc = d->findContact(Jid(chat->jid().bare()));
+        }
+        if (pc && !ret.contains(pc) && pc->isActiveContact()) {
             ret.append(pc);
         }
     }
@@ -3544,6 +4519,15 @@ void PsiAccount::showXmlConsole()
     bringToFront(d->xmlConsole);
 }
 
+void PsiAccount::showPerformanceDlg()
+{
+    PerformanceDlg *w = findDialog<PerformanceDlg *>();
+    if (w)
+        bringToFront(w);
+    else
+        (new PerformanceDlg(this))->show();
+}
+
 void PsiAccount::openAddUserDlg() { openAddUserDlg(QString(), QString(), QString()); }
 
 void PsiAccount::openAddUserDlg(const Jid &jid, const QString &nick, const QString &group)
@@ -3716,8 +4700,16 @@ void PsiAccount::simulateContactOffline(UserListItem *u)
 
 void PsiAccount::simulateRosterOffline()
 {
+    abortRosterExchange();
     emit beginBulkContactUpdate();
 
+    // presences of the old session
+    d->presenceTimer->stop();
+    d->presenceQueue.clear();
+    d->presenceQueueIndex.clear();
+    d->capsTimer->stop();
+    d->capsQueue.clear();
+
     notifyOnlineOk = false;
     for (UserListItem *u : qAsConst(d->userList))
         simulateContactOffline(u);
@@ -3738,6 +4730,7 @@ void PsiAccount::simulateRosterOffline()
 
     qDeleteAll(d->gcbank);
     d->gcbank.clear();
+    d->gcIndex.clear();
     emit endBulkContactUpdate();
 }
 
@@ -3766,19 +4759,19 @@ void PsiAccount::itemRetracted(const Jid &j, const QString &n, const PubSubRetra
             // if(found)
             //    (*rit).setTune(tune);
             u->setTune(QString());
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/mood") {
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setMood(Mood());
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/activity") {
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setActivity(Activity());
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/geoloc") {
         // FIXME: try to find the right resource using XEP-33 'replyto'
@@ -3786,7 +4779,7 @@ void PsiAccount::itemRetracted(const Jid &j, const QString &n, const PubSubRetra
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setGeoLocation(GeoLocation());
-            cpUpdate(*u);
+            pepChanged(u);
         }
     }
 }
@@ -3816,21 +4809,21 @@ void PsiAccount::itemPublished(const Jid &j, const QString &n, const PubSubItem
             // if(found)
             //    (*rit).setTune(tune);
             u->setTune(tune);
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/mood") {
         Mood        mood(item.payload());
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setMood(mood);
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/activity") {
         Activity    activity(item.payload());
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setActivity(activity);
-            cpUpdate(*u);
+            pepChanged(u);
         }
     } else if (n == "http://jabber.org/protocol/geoloc") {
         // FIXME: try to find the right resource using XEP-33 'replyto'
@@ -3839,11 +4832,26 @@ void PsiAccount::itemPublished(const Jid &j, const QString &n, const PubSubItem
         const auto &items = findRelevant(j);
         for (UserListItem *u : items) {
             u->setGeoLocation(geoloc);
-            cpUpdate(*u);
+            pepChanged(u);
         }
     }
 }
 
+void PsiAccount::pepChanged(UserListItem *u)
+{
+    if (!d->pepUpdated.contains(u))
+        d->pepUpdated += u;
+}
+
+void PsiAccount::pepItemsDelivered()
+{
+    // a contact that sent its tune, mood and activity is redrawn once
+    const QList<UserListItem *> items = d->pepUpdated;
+    d->pepUpdated.clear();
+    for (UserListItem *u : items)
+        cpUpdate(*u);
+}
+
 Jid PsiAccount::realJid(const Jid &j) const
 {
     GCContact *c = findGCContact(j);
@@ -3866,10 +4874,8 @@ QList<UserListItem *> PsiAccount::findRelevant(const Jid &j) const
     if (j.compare(d->self.jid(), false))
         list.append(&d->self);
     else {
-        for (UserListItem *u : qAsConst(d->userList)) {
-            if (!u->jid().compare(j, false))
-                continue;
-
+        const UserList &items = d->userIndex.value(j.bare());
+        for (UserListItem *u : items) {
             if (!u->jid().resource().isEmpty()) {
                 if (u->jid().resource() != j.resource())
                     continue;
@@ -3909,7 +4915,7 @@ UserListItem *PsiAccount::find(const Jid &j) const
     if (j.compare(d->self.jid()))
         u = &d->self;
     else
-        u = d->userList.find(j);
+        u = d->findUser(j);
 
     return u;
 }
@@ -4391,7 +5397,7 @@ void PsiAccount::actionOpenChat2(const Jid &_j)
             j = j.withResource(QString());
             u->setJid(j);
             u->setInList(false);
-            d->userList.append(u);
+            d->addUser(u);
             cpUpdate(*u);
         }
     }
@@ -4499,7 +5505,7 @@ void PsiAccount::actionAdd(const Jid &j) { dj_addAuth(j); }
 
 void PsiAccount::actionGroupAdd(const Jid &j, const QString &g)
 {
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (!u)
         return;
 
@@ -4514,7 +5520,7 @@ void PsiAccount::actionGroupAdd(const Jid &j, const QString &g)
 
 void PsiAccount::actionGroupRemove(const Jid &j, const QString &g)
 {
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (!u)
         return;
 
@@ -4529,7 +5535,7 @@ void PsiAccount::actionGroupRemove(const Jid &j, const QString &g)
 
 void PsiAccount::actionGroupsSet(const Jid &j, const QStringList &g)
 {
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (!u)
         return;
 
@@ -4809,7 +5815,7 @@ void PsiAccount::dj_addAuth(const Jid &j, const QString &nick)
 {
     QString       name;
     QStringList   groups;
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (u) {
         name   = u->name();
         groups = u->groups();
@@ -4873,7 +5879,7 @@ void PsiAccount::dj_deny(const Jid &j)
 
 void PsiAccount::dj_rename(const Jid &j, const QString &name)
 {
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (!u)
         return;
 
@@ -4907,7 +5913,7 @@ void PsiAccount::dj_remove(const Jid &j)
 {
     psi()->contactUpdatesManager()->contactRemoved(this, j);
 
-    UserListItem *u = d->userList.find(j);
+    UserListItem *u = d->findUser(j);
     if (!u)
         return;
 
@@ -4920,7 +5926,7 @@ void PsiAccount::dj_remove(const Jid &j)
     // to delete a contact
     if (!u->inList()) {
         profileRemoveEntry(u->jid());
-        d->userList.removeAll(u);
+        d->removeUser(u);
         delete u;
     } else {
         JT_Roster *r = new JT_Roster(d->client->rootTask());
@@ -4936,20 +5942,84 @@ void PsiAccount::dj_remove(const Jid &j)
 
 void PsiAccount::dj_rosterExchange(const RosterExchangeItems &items)
 {
+    // one roster set per contact, the last item for it wins
+    QList<Private::RosterExchangeSet> sets;
+    QHash<QString, int>               index; // bare jid -> position in sets
     for (const RosterExchangeItem &item : items) {
         if (!validRosterExchangeItem(item))
             continue;
 
+        Private::RosterExchangeSet set { item.jid(), item.name(), item.groups(), false, false };
         if (item.action() == RosterExchangeItem::Add) {
-            if (d->client->roster().find(item.jid(), true) == d->client->roster().end()) {
-                dj_add(item.jid(), item.name(), item.groups(), true);
-            }
+            set.subscribe = true;
         } else if (item.action() == RosterExchangeItem::Delete) {
-            // dj_remove(item.jid());
-        } else if (item.action() == RosterExchangeItem::Modify) {
-            // TODO
+            // from the groups listed, or from the roster when there are none
+            if (item.groups().isEmpty()) {
+                set.remove = true;
+            } else {
+                const UserListItem *u = d->findUser(item.jid().withResource(QString()));
+                set.name              = u->name();
+                set.groups            = u->groups();
+                for (const QString &group : item.groups())
+                    set.groups.removeAll(group);
+            }
         }
+
+        auto it = index.constFind(item.jid().bare());
+        if (it != index.constEnd()) {
+            sets[it.value()] = set;
+        } else {
+            index.insert(item.jid().bare(), sets.size());
+            sets += set;
+        }
+    }
+    if (sets.isEmpty())
+        return;
+
+    // the pushes coming back are applied to the contact list as one update
+    if (d->rosterExchangeQueue.isEmpty() && d->rosterExchangeTasks.isEmpty())
+        emit beginBulkContactUpdate();
+    d->rosterExchangeQueue += sets;
+    sendRosterExchangeSets();
+}
+
+// RFC 6121 allows one item per roster set, so instead of one huge request the sets
+// go out a window at a time and the next one leaves when a result comes back
+void PsiAccount::sendRosterExchangeSets()
+{
+    while (d->rosterExchangeTasks.size() < ROSTER_EXCHANGE_WINDOW && !d->rosterExchangeQueue.isEmpty()) {
+        const Private::RosterExchangeSet set = d->rosterExchangeQueue.takeFirst();
+
+        JT_Roster *r = new JT_Roster(d->client->rootTask());
+        if (set.remove)
+            r->remove(set.jid);
+        else
+            r->set(set.jid, set.name, set.groups);
+        connect(r, &Task::finished, this, [this, r, set]() {
+            d->rosterExchangeTasks.removeAll(r);
+            if (set.subscribe && r->success())
+                dj_authReq(set.jid);
+            sendRosterExchangeSets();
+        });
+        d->rosterExchangeTasks += r;
+        r->go(true);
+    }
+    if (d->rosterExchangeTasks.isEmpty())
+        emit endBulkContactUpdate();
+}
+
+void PsiAccount::abortRosterExchange()
+{
+    if (d->rosterExchangeQueue.isEmpty() && d->rosterExchangeTasks.isEmpty())
+        return;
+
+    for (JT_Roster *r : qAsConst(d->rosterExchangeTasks)) {
+        if (r)
+            disconnect(r, nullptr, this, nullptr);
     }
+    d->rosterExchangeTasks.clear();
+    d->rosterExchangeQueue.clear();
+    emit endBulkContactUpdate();
 }
 
 void PsiAccount::eventFromXml(const PsiEvent::Ptr &e) { handleEvent(e, FromXml); }
@@ -4976,6 +6046,20 @@ void PsiAccount::createNewMessageEvent(const QDomElement &element)
 // handle an incoming event
 void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationType)
 {
+    TRACE_SCOPE("PsiAccount::handleEvent");
+    static const auto requestReceipts = PsiOptions::handle<bool>("options.ui.notifications.request-receipts");
+    static const auto sendComposing   = PsiOptions::handle<bool>("options.messages.send-composing-events");
+    static const auto alertOpenChats  = PsiOptions::handle<bool>("options.ui.chat.alert-for-already-open-chats");
+    static const auto mucHighlights   = PsiOptions::handle<bool>("options.ui.muc.allow-highlight-events");
+    static const auto popupChat = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.incoming-chat");
+    static const auto popupMessage
+        = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.incoming-message");
+    static const auto popupHeadline
+        = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.incoming-headline");
+    static const auto popupFile
+        = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.incoming-file-transfer");
+    static const auto popupComposing = PsiOptions::handle<bool>("options.ui.notifications.passive-popups.composing");
+
     PsiOptions *o = PsiOptions::instance();
     if (e && activationType != FromXml) {
         setEnabled();
@@ -5016,12 +6100,16 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
     e->setJid(j);
 
 #if defined(PSI_PLUGINS) && defined(DEPRECATED_EVENT_FILTER)
-    QDomDocument doc;
-    QDomElement  eXml = e->toXml(&doc);
-    if (PluginManager::instance()->processEvent(this, eXml)) {
-        return;
-    } else {
-        e->fromXml(psi(), this, &eXml);
+    if (PluginManager::instance()->hasEventFilters()) {
+        QDomDocument doc;
+        QDomElement  eXml = e->toXml(&doc);
+        doc.appendChild(eXml);
+        const QString orig = doc.toString(-1);
+        if (PluginManager::instance()->processEvent(this, eXml)) {
+            return;
+        } else if (doc.toString(-1) != orig) { // a plugin changed it
+            e->fromXml(psi(), this, &eXml);
+        }
     }
 #endif
 
@@ -5040,7 +6128,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
 #ifdef GROUPCHAT
                 if (e->type() == PsiEvent::Message) {
                     MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-                    if (me->message().type() == "groupchat")
+                    if (me->message().type() == QLatin1String("groupchat"))
                         isMuc = true;
                 }
 #endif
@@ -5076,7 +6164,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         // PluginManager::instance()->message(this,e->from(),ulItem,((MessageEvent*)e)->message().body());
 #endif
         if (m.messageReceipt() == ReceiptReceived) {
-            if (o->getOption("options.ui.notifications.request-receipts").toBool()) {
+            if (requestReceipts.value()) {
                 const auto &dialogs = findChatDialogs(e->from(), false);
                 for (ChatDlg *c : dialogs) {
                     if (c->autoSelectContact() || c->jid().resource().isEmpty()
@@ -5089,11 +6177,12 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         }
 
         // Pass message events to chat window
-        if ((m.containsEvents() || m.chatState() != StateNone) && m.body().isEmpty() && m.type() != "groupchat") {
+        if ((m.containsEvents() || m.chatState() != StateNone) && m.body().isEmpty()
+            && m.type() != QLatin1String("groupchat")) {
             if (m.carbonDirection() == Message::Sent) {
                 return; // ignore own composing for carbon. TODO should we?
             }
-            if (o->getOption("options.messages.send-composing-events").toBool()) {
+            if (sendComposing.value()) {
                 ChatDlg *c = findChatDialogEx(e->from());
                 if (c) {
                     c->setJid(e->from());
@@ -5110,7 +6199,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         }
 
         // pass chat messages directly to a chat window if possible (and deal with sound)
-        else if (m.type() == "chat") {
+        else if (m.type() == QLatin1String("chat")) {
             Jid chatJid = m.carbonDirection() == Message::Sent ? m.to() : m.from();
 
             if (m.carbonDirection() == Message::Sent) {
@@ -5132,7 +6221,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
                 c->incomingMessage(m);
                 soundType = eChat2;
                 if (m.carbonDirection() != Message::Sent
-                    && ((o->getOption("options.ui.chat.alert-for-already-open-chats").toBool() && !c->isActiveTab())
+                    && ((alertOpenChats.value() && !c->isActiveTab())
                         || (c->isTabbed() && c->getManagingTabDlg()->isHidden()))) {
 
                     // to alert the chat also, we put it in the queue
@@ -5150,15 +6239,15 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
                 popupType = PopupManager::AlertChat;
             }
         } // /chat
-        else if (m.type() == "headline") {
+        else if (m.type() == QLatin1String("headline")) {
             soundType = eHeadline;
             doPopup   = true;
             popupType = PopupManager::AlertHeadline;
         } // /headline
 #ifdef GROUPCHAT
-        else if (m.type() == "groupchat") {
+        else if (m.type() == QLatin1String("groupchat")) {
             putToQueue          = false;
-            bool allowMucEvents = o->getOption("options.ui.muc.allow-highlight-events").toBool();
+            bool allowMucEvents = mucHighlights.value();
             if (activationType != FromXml) {
                 GCMainDlg *c = findDialog<GCMainDlg *>(e->from());
                 if (c) {
@@ -5184,7 +6273,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
             soundType  = eNone;
             putToQueue = false;
         }
-        if (m.type() == "error") {
+        if (m.type() == QLatin1String("error")) {
             // FIXME: handle message errors
             // msg.text = QString(tr("<big>[Error Message]</big><br>%1").arg(plain2rich(msg.text)));
         }
@@ -5225,7 +6314,7 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
         if (ae->authType() == "subscribe") {
             if (o->getOption("options.subscriptions.automatically-allow-authorization").toBool()) {
                 // Check if we want to request auth as well
-                UserListItem *u = d->userList.find(ae->from());
+                UserListItem *u = d->findUser(ae->from());
                 if (!u
                     || (u->subscription().type() != Subscription::Both
                         && u->subscription().type() != Subscription::To)) {
@@ -5261,18 +6350,12 @@ void PsiAccount::handleEvent(const PsiEvent::Ptr &e, ActivationType activationTy
             r = *(u->priority());
         }
 
-        if ((popupType == PopupManager::AlertChat
-             && o->getOption("options.ui.notifications.passive-popups.incoming-chat").toBool())
-            || (popupType == PopupManager::AlertMessage
-                && o->getOption("options.ui.notifications.passive-popups.incoming-message").toBool())
-            || (popupType == PopupManager::AlertHeadline
-                && o->getOption("options.ui.notifications.passive-popups.incoming-headline").toBool())
-            || (popupType == PopupManager::AlertFile
-                && o->getOption("options.ui.notifications.passive-popups.incoming-file-transfer").toBool())
-            || (popupType == PopupManager::AlertAvCall
-                && o->getOption("options.ui.notifications.passive-popups.incoming-message").toBool())
-            || (popupType == PopupManager::AlertComposing
-                && o->getOption("options.ui.notifications.passive-popups.composing").toBool())) {
+        if ((popupType == PopupManager::AlertChat && popupChat.value())
+            || (popupType == PopupManager::AlertMessage && popupMessage.value())
+            || (popupType == PopupManager::AlertHeadline && popupHeadline.value())
+            || (popupType == PopupManager::AlertFile && popupFile.value())
+            || (popupType == PopupManager::AlertAvCall && popupMessage.value())
+            || (popupType == PopupManager::AlertComposing && popupComposing.value())) {
 #ifdef PSI_PLUGINS
             if (e->type() != PsiEvent::Plugin) {
 #endif
@@ -5323,7 +6406,7 @@ UserListItem *PsiAccount::addUserListItem(const Jid &jid, const QString &nick)
         // make a resource so the contact appears online
         QString      name = j.node();
         UserResource ur;
-        for (const ConferenceBookmark &c : d->bookmarkManager->conferences()) {
+        for (const ConferenceBookmark &c : bookmarkManager()->conferences()) {
             if (c.jid().full() == j.bare())
                 name = c.name();
         }
@@ -5343,7 +6426,7 @@ UserListItem *PsiAccount::addUserListItem(const Jid &jid, const QString &nick)
     //        serv->getVCard(item->jid);
     //}
 
-    d->userList.append(u);
+    d->addUser(u);
     cpUpdate(*u);
     return u;
 }
@@ -5355,7 +6438,7 @@ void PsiAccount::addMucItem(const Jid &jid)
     UserListItem *u = find(jid);
     if (u) {
         d->removeEntry(jid);
-        d->userList.removeAll(u);
+        d->removeUser(u);
         delete u;
     }
     if (!d->groupchats.contains(jid.bare()))
@@ -5366,6 +6449,14 @@ void PsiAccount::addMucItem(const Jid &jid)
 // put an event into the event queue, and update the related alerts
 void PsiAccount::queueEvent(const PsiEvent::Ptr &e, ActivationType activationType)
 {
+    static const auto raiseOnEvent      = PsiOptions::handle<bool>("options.ui.contactlist.raise-on-new-event");
+    static const auto chatAutoPopup     = PsiOptions::handle<bool>("options.ui.chat.auto-popup");
+    static const auto headlineAutoPopup = PsiOptions::handle<bool>("options.ui.message.auto-popup-headlines");
+    static const auto messageAutoPopup  = PsiOptions::handle<bool>("options.ui.message.auto-popup");
+    static const auto fileAutoPopup     = PsiOptions::handle<bool>("options.ui.file-transfer.auto-popup");
+    static const auto suppressNotOnRoster
+        = PsiOptions::handle<bool>("options.ui.notifications.popup-dialogs.suppress-when-not-on-roster");
+
     // do we have roster item for this?
     UserListItem *u = find(e->jid());
     if (!u) {
@@ -5375,7 +6466,7 @@ void PsiAccount::queueEvent(const PsiEvent::Ptr &e, ActivationType activationTyp
             nick              = ae->nick();
         } else if (e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
-            if (me->message().type() != "error")
+            if (me->message().type() != QLatin1String("error"))
                 nick = me->nick();
         }
 
@@ -5386,7 +6477,7 @@ void PsiAccount::queueEvent(const PsiEvent::Ptr &e, ActivationType activationTyp
     d->eventQueue->enqueue(e);
 
     updateReadNext(e->jid());
-    if (PsiOptions::instance()->getOption("options.ui.contactlist.raise-on-new-event").toBool())
+    if (raiseOnEvent.value())
         d->psi->raiseMainwin();
 
     // update the roster
@@ -5405,31 +6496,27 @@ void PsiAccount::queueEvent(const PsiEvent::Ptr &e, ActivationType activationTyp
         if (e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
             const Message &   m  = me->message();
-            if (m.type() == "chat")
-                doPopup = PsiOptions::instance()->getOption("options.ui.chat.auto-popup").toBool();
-            else if (m.type() == "headline")
-                doPopup = PsiOptions::instance()->getOption("options.ui.message.auto-popup-headlines").toBool();
+            if (m.type() == QLatin1String("chat"))
+                doPopup = chatAutoPopup.value();
+            else if (m.type() == QLatin1String("headline"))
+                doPopup = headlineAutoPopup.value();
             else
-                doPopup = PsiOptions::instance()->getOption("options.ui.message.auto-popup").toBool();
+                doPopup = messageAutoPopup.value();
         } else if (e->type() == PsiEvent::File) {
-            doPopup = PsiOptions::instance()->getOption("options.ui.file-transfer.auto-popup").toBool();
+            doPopup = fileAutoPopup.value();
         }
 #ifdef PSI_PLUGINS
         else if (e->type() == PsiEvent::Plugin)
             doPopup = false;
 #endif
         else {
-            doPopup = PsiOptions::instance()->getOption("options.ui.message.auto-popup").toBool();
+            doPopup = messageAutoPopup.value();
         }
 
         // Popup
         if (doPopup) {
             UserListItem *u = find(e->jid());
-            if (u
-                && (!PsiOptions::instance()
-                         ->getOption("options.ui.notifications.popup-dialogs.suppress-when-not-on-roster")
-                         .toBool()
-                    || u->inList()))
+            if (u && (!suppressNotOnRoster.value() || u->inList()))
                 openNextEvent(*u, activationType);
         }
     }
@@ -5473,7 +6560,7 @@ void PsiAccount::openNextEvent(ActivationType activationType)
         u = new UserListItem();
         u->setJid(e->jid());
         u->setInList(false);
-        d->userList.append(u);
+        d->addUser(u);
     }
     openNextEvent(*u, activationType);
 }
@@ -5664,6 +6751,16 @@ void PsiAccount::chatMessagesRead(const Jid &j)
     //    if(PsiOptions::instance()->getOption("options.ui.chat.alert-for-already-open-chats").toBool()) {
     processChats(j);
     //    }
+    chatDisplayed(j);
+}
+
+void PsiAccount::chatDisplayed(const Jid &j)
+{
+    static const auto sendMarkers = PsiOptions::handle<bool>("options.ui.notifications.send-chat-markers");
+
+    // one marker for everything read, not one per message
+    if (sendMarkers.value() && d->receipts && d->acknowledges(j))
+        d->receipts->displayed(j);
 }
 
 #ifdef GROUPCHAT
@@ -5685,36 +6782,65 @@ void PsiAccount::logEvent(const Jid &j, const PsiEvent::Ptr &e, int type)
         return;
 
     if (type == EDB::GroupChatContact) {
-        if (!PsiOptions::instance()->getOption("options.history.store-muc-private").toBool())
+        static const auto storeMucPrivate = PsiOptions::handle<bool>("options.history.store-muc-private");
+        if (!storeMucPrivate.value())
             return;
         if ((edb()->features() & EDB::PrivateContacts) == 0)
             return;
     }
 
-    EDBHandle *h = new EDBHandle(d->psi->edb());
-    connect(h, SIGNAL(finished()), SLOT(edb_finished()));
-    h->append(id(), j, e, type);
+    d->logQueue.append({ j, e, type });
+    d->historyPrefetch->invalidate(j);
+    if (!d->logFlushTimer->isActive())
+        d->logFlushTimer->start();
 }
 
-void PsiAccount::edb_finished()
+void PsiAccount::flushLog()
 {
-    EDBHandle *h = static_cast<EDBHandle *>(sender());
-    delete h;
+    d->logFlushTimer->stop();
+    if (d->logQueue.isEmpty())
+        return;
+
+    QList<Jid> jids;
+    for (const EDBAppendItem &item : qAsConst(d->logQueue))
+        if (!jids.contains(item.jid))
+            jids += item.jid;
+
+    EDBHandle *h = new EDBHandle(d->psi->edb());
+    connect(h, &EDBHandle::finished, this, [this, h, jids]() {
+        delete h;
+        if (!d->historyPrefetch)
+            return;
+        // pages loaded while this was written miss it, chats with unread events are likely opened next
+        for (const Jid &j : jids) {
+            d->historyPrefetch->invalidate(j);
+            if (d->eventQueue->count(j, false) > 0)
+                d->historyPrefetch->prefetch(j);
+        }
+    });
+    h->append(id(), d->logQueue);
+    d->logQueue.clear();
 }
 
 bool PsiAccount::groupChatJoin(const QString &host, const QString &room, const QString &nick, const QString &pass,
                                bool nohistory)
 {
-    if (nohistory)
+    const QString roomJid = Jid(room, host).bare();
+    d->mucStatusQueue.removeAll(roomJid);
+    if (nohistory) {
+        d->mucStatusSent.remove(roomJid);
         return d->client->groupChatJoin(host, room, nick, pass, 0);
-    else {
+    } else {
         QDateTime  since;
         GCMainDlg *w = findDialog<GCMainDlg *>(Jid(room, host));
         if (w)
             since = w->lastMsgTime();
+        if (!since.isValid())
+            since = d->autoJoinQueue->lastSeen(Jid(room, host));
 
         Status s = d->loginStatus;
         s.setXSigned("");
+        d->mucStatusSent[roomJid] = mucStatusKey(s);
 
         return d->client->groupChatJoin(
             host, room, nick, pass, PsiOptions::instance()->getOption("options.muc.context.maxchars").toInt(),
@@ -5725,24 +6851,65 @@ bool PsiAccount::groupChatJoin(const QString &host, const QString &room, const Q
 
 void PsiAccount::groupChatChangeNick(const QString &host, const QString &room, const QString &nick, const Status &s)
 {
+    d->mucStatusSent[Jid(room, host).bare()] = mucStatusKey(s);
     d->client->groupChatChangeNick(host, room, nick, s);
 }
 
 void PsiAccount::groupChatSetStatus(const QString &host, const QString &room, const Status &s)
 {
+    d->mucStatusSent[Jid(room, host).bare()] = mucStatusKey(s);
     d->client->groupChatSetStatus(host, room, s);
 }
 
+void PsiAccount::groupChatQueueStatus(const Jid &room)
+{
+    const QString roomJid = room.bare();
+    if (d->mucStatusQueue.contains(roomJid))
+        return;
+    // all rooms react to the same status change, they are sent together on the next pass
+    d->mucStatusQueue += roomJid;
+    if (!d->mucStatusTimer->isActive())
+        d->mucStatusTimer->start(0);
+}
+
+void PsiAccount::flushGroupChatStatus()
+{
+    if (!loggedIn()) {
+        d->mucStatusQueue.clear();
+        return;
+    }
+
+    Status s = status();
+    s.setXSigned("");
+    const QString key = mucStatusKey(s);
+
+    // a round of rooms at a time, servers limit the stanza rate
+    int sent = 0;
+    while (!d->mucStatusQueue.isEmpty() && sent < MUC_STATUS_BURST) {
+        const Jid room(d->mucStatusQueue.takeFirst());
+        auto      last = d->mucStatusSent.find(room.bare());
+        if (last != d->mucStatusSent.end() && last.value() == key)
+            continue;
+        d->mucStatusSent[room.bare()] = key;
+        d->client->groupChatSetStatus(room.domain(), room.node(), s);
+        ++sent;
+    }
+    if (!d->mucStatusQueue.isEmpty())
+        d->mucStatusTimer->start(MUC_STATUS_INTERVAL);
+}
+
 void PsiAccount::groupChatLeave(const QString &host, const QString &room)
 {
     Jid j(room + '@' + host);
     d->groupchats.removeAll(j.bare());
+    d->mucStatusQueue.removeAll(j.bare());
+    d->mucStatusSent.remove(j.bare());
     d->client->groupChatLeave(host, room,
                               PsiOptions::instance()->getOption("options.muc.leave-status-message").toString());
     UserListItem *u = find(j);
     if (u) {
         d->removeEntry(j);
-        d->userList.removeAll(u);
+        d->removeUser(u);
         delete u;
     }
 }
@@ -5762,16 +6929,21 @@ void PsiAccount::shareImage(const Jid &target, const QImage &image, const QStrin
     Q_UNUSED(description)
 
     // this method is intended to use xep-0385. But let's do something simple first. xep-0385 will be implemented later
-    auto buffer = new QBuffer();
-    buffer->open(QIODevice::ReadWrite);
-    image.save(buffer, "PNG");
-    buffer->seek(0);
+    // encoded straight to disk and uploaded from there, big screenshots don't stay in memory
+    auto file = new QTemporaryFile(QDir::tempPath() + QLatin1String("/psi-share-XXXXXX.png"));
+    if (!file->open() || !image.save(file, "PNG") || !file->seek(0)) {
+        delete file;
+        callback(QString());
+        return;
+    }
 
+    // sent right from the chat, so it goes ahead of file transfers
+    auto dev = d->psi->transferScheduler()->throttle(file, this, TransferScheduler::Interactive);
     auto hfu = d->client->httpFileUploadManager()->upload(
-        buffer, size_t(buffer->size()),
+        dev, size_t(file->size()),
         QString("psi-share-%1.png").arg(QString::number(QDateTime::currentMSecsSinceEpoch())),
         QLatin1String("image/png"));
-    buffer->setParent(hfu);
+    dev->setParent(hfu);
 
     connect(hfu, &HttpFileUpload::finished, this, [hfu, callback]() {
         if (hfu->success()) {
@@ -5784,14 +6956,7 @@ void PsiAccount::shareImage(const Jid &target, const QImage &image, const QStrin
     });
 }
 
-GCContact *PsiAccount::findGCContact(const Jid &j) const
-{
-    for (GCContact *c : qAsConst(d->gcbank)) {
-        if (c->jid.compare(j))
-            return c;
-    }
-    return nullptr;
-}
+GCContact *PsiAccount::findGCContact(const Jid &j) const { return d->gcIndex.value(j.full()); }
 
 Status PsiAccount::gcContactStatus(const Jid &j)
 {
@@ -5808,6 +6973,8 @@ const QStringList &PsiAccount::groupchats() const { return d->groupchats; }
 void PsiAccount::client_groupChatJoined(const Jid &j)
 {
 #ifdef GROUPCHAT
+    d->autoJoinQueue->done(j);
+
     // d->client->groupChatSetStatus(j.host(), j.user(), d->loginStatus);
 
     GCMainDlg *m = findDialog<GCMainDlg *>(Jid(j.bare()));
@@ -5839,6 +7006,9 @@ void PsiAccount::client_groupChatJoined(const Jid &j)
 
 void PsiAccount::client_groupChatLeft(const Jid &j)
 {
+    d->mucStatusQueue.removeAll(j.bare());
+    d->mucStatusSent.remove(j.bare());
+
     // remove all associated groupchat contacts from the bank
     for (QList<GCContact *>::Iterator it = d->gcbank.begin(); it != d->gcbank.end();) {
         GCContact *c = *it;
@@ -5855,6 +7025,7 @@ void PsiAccount::client_groupChatLeft(const Jid &j)
         }
 
         simulateContactOffline(u);
+        d->gcIndex.remove(c->jid.full());
         it = d->gcbank.erase(it);
         delete c;
     }
@@ -5876,6 +7047,7 @@ void PsiAccount::client_groupChatPresence(const Jid &j, const Status &s)
         c      = new GCContact;
         c->jid = j;
         d->gcbank.append(c);
+        d->gcIndex.insert(j.full(), c);
     }
     c->status = s;
 
@@ -5896,6 +7068,8 @@ void PsiAccount::client_groupChatPresence(const Jid &j, const Status &s)
 void PsiAccount::client_groupChatError(const Jid &j, int code, const QString &str)
 {
 #ifdef GROUPCHAT
+    d->autoJoinQueue->done(j);
+
     GCMainDlg *w = findDialog<GCMainDlg *>(Jid(j.bare()));
     if (w) {
         w->error(code, str);
@@ -6188,7 +7362,9 @@ void PsiAccount::optionsUpdate()
     setRCEnabled(o->getOption("options.external-control.adhoc-remote-control.enable").toBool());
 
     // Roster item exchange
-    d->rosterItemExchangeTask->setIgnoreNonRoster(o->getOption("options.messages.ignore-non-roster-contacts").toBool());
+    if (d->rosterItemExchangeTask)
+        d->rosterItemExchangeTask->setIgnoreNonRoster(
+            o->getOption("options.messages.ignore-non-roster-contacts").toBool());
 
     // Caps manager
     d->client->capsManager()->setEnabled(o->getOption("options.service-discovery.enable-entity-capabilities").toBool());
@@ -6208,7 +7384,7 @@ void PsiAccount::optionsUpdate()
 
 void PsiAccount::setRCEnabled(bool b)
 {
-    if (b && !d->rcSetStatusServer) {
+    if (b && !d->rcSetStatusServer && d->ahcManager) {
         d->rcSetStatusServer  = new RCSetStatusServer(d->ahcManager);
         d->rcForwardServer    = new RCForwardServer(d->ahcManager);
         d->rcLeaveMucServer   = new RCLeaveMucServer(d->ahcManager);
@@ -6245,9 +7421,9 @@ void PsiAccount::invokeGCMessage(const Jid &j)
     ur.setStatus(c->status);
     u->userResourceList().append(ur);
 
-    d->userList.append(u);
+    d->addUser(u);
     actionSendMessage(j);
-    d->userList.removeAll(u);
+    d->removeUser(u);
     delete u;
 }
 
@@ -6272,10 +7448,10 @@ void PsiAccount::invokeGCChat(const Jid &j)
     ur.setStatus(c->status);
     u->userResourceList().append(ur);
 
-    d->userList.append(u);
+    d->addUser(u);
     actionOpenChat(j);
     cpUpdate(*u);
-    // d->userList.removeAll(u);
+    // d->removeUser(u);
     // delete u;
 }
 
@@ -6378,9 +7554,17 @@ bool PsiAccount::ensureKey(const Jid &j)
 
 ServerInfoManager *PsiAccount::serverInfoManager() { return d->client->serverInfoManager(); }
 
-PEPManager *PsiAccount::pepManager() { return d->pepManager; }
+PEPManager *PsiAccount::pepManager()
+{
+    createManagers();
+    return d->pepManager;
+}
 
-BookmarkManager *PsiAccount::bookmarkManager() { return d->bookmarkManager; }
+BookmarkManager *PsiAccount::bookmarkManager()
+{
+    createManagers();
+    return d->bookmarkManager;
+}
 
 QStringList PsiAccount::groupList() const { return d->groupList(); }
 
@@ -6389,7 +7573,11 @@ QStringList PsiAccount::groupList() const { return d->groupList(); }
  */
 void PsiAccount::updateEntry(const UserListItem &u) { profileUpdateEntry(u); }
 
-AvCallManager *PsiAccount::avCallManager() { return d->avCallManager; }
+AvCallManager *PsiAccount::avCallManager()
+{
+    createManagers();
+    return d->avCallManager;
+}
 
 /**
  * \brief Returns the current contents of the debug ringbuffer.
@@ -6398,15 +7586,14 @@ AvCallManager *PsiAccount::avCallManager() { return d->avCallManager; }
  */
 QList<PsiAccount::xmlRingElem> PsiAccount::dumpRingbuf() { return d->dumpRingbuf(); }
 
+quint64 PsiAccount::stanzasReceived() const { return d->stanzasReceived; }
+
+quint64 PsiAccount::stanzasSent() const { return d->stanzasSent; }
+
 /**
  * Frees ringbuffer memory and makes it compact.
  */
-void PsiAccount::clearRingbuf()
-{
-    d->xmlRingbuf.clear();
-    d->xmlRingbufWrite = 0;
-    d->xmlRingbuf.resize(10);
-}
+void PsiAccount::clearRingbuf() { d->clearRingbuf(); }
 
 /**
  * Helper to prevent automated outgoing presences from happening
@@ -44,7 +44,10 @@ class AvatarFactory;
 class AvCallManager;
 class BookmarkManager;
 class ChatDlg;
+class ChatHistoryPrefetch;
+class ChatStateSender;
 class ConferenceBookmark;
+class ContactInfoCache;
 class ContactProfile;
 class EDB;
 class EventDlg;
@@ -54,6 +57,7 @@ class FileSharingItem;
 #ifdef GOOGLE_FT
 class GoogleFileTransfer;
 #endif
+class MamSync;
 class PEPManager;
 class PrivacyManager;
 class PsiAccount;
@@ -68,6 +72,7 @@ class QMimeData;
 class QSSLCert;
 class QString;
 class QWidget;
+class ReceiptScheduler;
 class TabManager;
 class Tune;
 class URLBookmark;
@@ -136,6 +141,10 @@ public:
     EDB *                   edb() const;
     PsiCon *                psi() const;
     AvatarFactory *         avatarFactory() const;
+    ChatHistoryPrefetch *   historyPrefetch() const;
+    MamSync *               mamSync() const;
+    ContactInfoCache *      contactInfo() const;
+    ChatStateSender *       chatStates() const;
     PrivacyManager *        privacyManager() const;
     VoiceCaller *           voiceCaller() const;
 #ifdef WHITEBOARDING
@@ -204,11 +213,13 @@ public:
     void doWakeup();
 
     void        showXmlConsole();
+    void        showPerformanceDlg();
     void        openAddUserDlg();
     void        openAddUserDlg(const XMPP::Jid &jid, const QString &nick, const QString &group);
     bool        groupChatJoin(const QString &host, const QString &room, const QString &nick, const QString &pass,
                               bool nohistory = false);
     void        groupChatSetStatus(const QString &host, const QString &room, const Status &);
+    void        groupChatQueueStatus(const Jid &room); // the account status, sent with the other rooms
     void        groupChatChangeNick(const QString &host, const QString &room, const QString &nick, const Status &);
     void        groupChatLeave(const QString &host, const QString &room);
     void        setLocalMucBookmarks(const QStringList &sl);
@@ -257,6 +268,7 @@ public:
 #endif
 
     QStringList hiddenChats(const Jid &) const;
+    void        chatDisplayed(const Jid &); // the chat is seen up to its latest message
 
     bool isPgpEnabled(const Jid &jid) const;
     void setPgpEnabled(const Jid &jid, const bool value);
@@ -285,16 +297,24 @@ public:
     void    clearCurrentConnectionError();
     QString currentConnectionError() const;
     int     currentConnectionErrorCondition() const;
+    // milliseconds the last login took until roster, presence, server features and bookmarks were there,
+    // -1 while it isn't done
+    qint64 timeToUsable() const;
 
     enum xmlRingType { RingXmlIn, RingXmlOut, RingSysMsg };
     class xmlRingElem {
     public:
-        int       type;
-        QDateTime time;
-        QString   xml;
+        int        type;
+        QDateTime  time;
+        QByteArray data; // utf-8, qCompress()ed if compressed is set
+        bool       compressed = false;
+
+        QString xml() const { return QString::fromUtf8(compressed ? qUncompress(data) : data); }
     };
     QList<xmlRingElem> dumpRingbuf();
     void               clearRingbuf();
+    quint64            stanzasReceived() const; // since the account was created
+    quint64            stanzasSent() const;
     void               addMucItem(const Jid &);
     QStringList        groupList() const;
     void               updateEntry(const UserListItem &u);
@@ -445,6 +465,10 @@ private slots:
     void client_rosterItemAdded(const RosterItem &);
     void client_rosterItemUpdated(const RosterItem &);
     void client_rosterItemRemoved(const RosterItem &);
+    void queueResourceAvailable(const Jid &, const Resource &);
+    void queueResourceUnavailable(const Jid &, const Resource &);
+    void flushPresenceQueue();
+    void flushCapsQueue();
     void client_resourceAvailable(const Jid &, const Resource &);
     void client_resourceUnavailable(const Jid &, const Resource &);
     void client_presenceError(const Jid &, int, const QString &);
@@ -461,11 +485,13 @@ private slots:
     void client_incomingFileTransfer();
     void client_incomingJingle(Jingle::Session *session);
     void sessionStart_finished();
+    void rosterVersion_finished();
 
     void serverFeaturesChanged();
     void setPEPAvailable(bool);
 
     void bookmarksAvailabilityChanged();
+    void bookmarksFetched();
 
     void incomingHttpAuthRequest(const PsiHttpAuthRequest &);
 
@@ -478,12 +504,12 @@ private slots:
 
     void itemPublished(const Jid &, const QString &, const PubSubItem &);
     void itemRetracted(const Jid &, const QString &, const PubSubRetraction &);
+    void pepItemsDelivered();
 
     void chatMessagesRead(const Jid &);
 #ifdef GROUPCHAT
     void groupChatMessagesRead(const Jid &);
 #endif
-    void edb_finished();
 
     void pgp_verifyFinished();
     void pgp_encryptFinished();
@@ -526,18 +552,28 @@ private:
 
     void login();
     void logout(bool fast, const Status &s);
+    void createManagers();
 
     void          deleteAllDialogs();
     void          simulateContactOffline(UserListItem *);
     void          simulateRosterOffline();
+    void          sendRosterExchangeSets();
+    void          abortRosterExchange();
     void          cpUpdate(const UserListItem &, const QString &rname = "", bool fromPresence = false);
+    void          pepChanged(UserListItem *);
     UserListItem *addUserListItem(const Jid &jid, const QString &nick = "");
     void          logEvent(const Jid &, const PsiEvent::Ptr &, int);
+    void          flushLog();
+    void          flushGroupChatStatus();
+    void          queuePresence(const Jid &, const Resource &, bool available);
+    void          presenceSound(SoundType sound);
     void          queueEvent(const PsiEvent::Ptr &e, ActivationType activationType);
     void          openNextEvent(const UserListItem &, ActivationType activationType);
     void          updateReadNext(const Jid &);
     ChatDlg *     ensureChatDlg(const Jid &);
     void          lastStepLogin();
+    void          checkOwnVCard();
+    void          enableCarbons();
     void          processIncomingMessage(const Message &);
     void          processMessageQueue();
     void          processPgpEncryptedMessage(const Message &);
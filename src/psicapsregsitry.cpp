@@ -2,23 +2,267 @@
 
 #include "applicationinfo.h"
 #include "iodeviceopener.h"
+#include "xmpp_discoitem.h"
+#include "xmpp_jid.h"
 
-PsiCapsRegistry::PsiCapsRegistry(QObject *parent) : CapsRegistry(parent) { }
+#include <QDateTime>
+#include <QDomDocument>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QtConcurrentRun>
 
-void PsiCapsRegistry::saveData(const QByteArray &data)
+#define CAPS_STORE_CONNECTION "caps"
+
+// registrations coming in a burst (login) are written in one transaction
+#define CAPS_FLUSH_DELAY 2000
+
+// nodes not seen for this many days are dropped at startup
+#define CAPS_MAX_AGE 30
+
+struct CapsRow {
+    QString node;
+    QString disco;
+    qint64  lastSeen;
+};
+
+static QString cacheFile(const QString &name)
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/" + name;
+}
+
+// called in the io thread only
+static bool openStore(bool *created)
+{
+    QSqlDatabase db = QSqlDatabase::database(CAPS_STORE_CONNECTION, false);
+    if (db.isOpen()) {
+        return true;
+    }
+    if (!db.isValid()) {
+        db = QSqlDatabase::addDatabase("QSQLITE", CAPS_STORE_CONNECTION);
+        db.setDatabaseName(cacheFile("caps.db"));
+    }
+    if (!db.open()) {
+        qWarning("%s\n%s", "PsiCapsRegistry: Can't open base.", qUtf8Printable(db.lastError().text()));
+        return false;
+    }
+    QSqlQuery query(db);
+    query.exec("PRAGMA journal_mode = WAL;");
+    query.exec("PRAGMA synchronous = NORMAL;");
+    if (!db.tables(QSql::Tables).contains("caps")) {
+        if (!query.exec("CREATE TABLE `caps` ("
+                        "`node` TEXT NOT NULL PRIMARY KEY, "
+                        "`disco` TEXT NOT NULL, "
+                        "`last_seen` INTEGER NOT NULL"
+                        ");")) {
+            qWarning("%s", qUtf8Printable(query.lastError().text()));
+            db.close();
+            return false;
+        }
+        if (created) {
+            *created = true;
+        }
+    }
+    return true;
+}
+
+static bool writeRows(const QList<CapsRow> &rows)
+{
+    if (!openStore(nullptr)) {
+        return false;
+    }
+    QSqlDatabase db = QSqlDatabase::database(CAPS_STORE_CONNECTION, false);
+    if (!db.transaction()) {
+        return false;
+    }
+    QSqlQuery query(db);
+    query.prepare("INSERT OR REPLACE INTO `caps` (`node`, `disco`, `last_seen`) VALUES (?, ?, ?);");
+    for (const CapsRow &row : rows) {
+        query.addBindValue(row.node);
+        query.addBindValue(row.disco);
+        query.addBindValue(row.lastSeen);
+        if (!query.exec()) {
+            qWarning("%s", qUtf8Printable(query.lastError().text()));
+            db.rollback();
+            return false;
+        }
+    }
+    return db.commit();
+}
+
+static QList<CapsRow> readRows(bool *created)
+{
+    QList<CapsRow> ret;
+    if (!openStore(created)) {
+        return ret;
+    }
+    QSqlQuery query(QSqlDatabase::database(CAPS_STORE_CONNECTION, false));
+    query.setForwardOnly(true);
+    if (query.exec("SELECT `node`, `disco`, `last_seen` FROM `caps`;")) {
+        while (query.next()) {
+            ret.append({ query.value(0).toString(), query.value(1).toString(), query.value(2).toLongLong() });
+        }
+    }
+    return ret;
+}
+
+static QString discoToString(const XMPP::DiscoItem &item)
+{
+    QDomDocument doc;
+    doc.appendChild(item.toDiscoInfoResult(&doc));
+    return doc.toString(-1);
+}
+
+PsiCapsRegistry::PsiCapsRegistry(QObject *parent) : CapsRegistry(parent)
+{
+    io_.setMaxThreadCount(1);
+    io_.setExpiryTimeout(-1); // the connection lives in that thread
+
+    flushTimer_.setSingleShot(true);
+    flushTimer_.setInterval(CAPS_FLUSH_DELAY);
+    connect(&flushTimer_, &QTimer::timeout, this, &PsiCapsRegistry::flush);
+    connect(this, &CapsRegistry::registered, this, &PsiCapsRegistry::capsRegistered);
+}
+
+PsiCapsRegistry::~PsiCapsRegistry()
 {
-    QFile          file(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/caps.xml");
-    IODeviceOpener opener(&file, QIODevice::WriteOnly);
-    if (!opener.isOpen()) {
-        qWarning("Caps: Unable to open IO device");
+    flush();
+    QtConcurrent::run(&io_, []() {
+        {
+            QSqlDatabase db = QSqlDatabase::database(CAPS_STORE_CONNECTION, false);
+            if (db.isOpen())
+                db.close();
+        }
+        QSqlDatabase::removeDatabase(CAPS_STORE_CONNECTION);
+    });
+    io_.waitForDone();
+}
+
+/**
+ * \brief Reads the store. On the first start the old caps.xml is taken over.
+ */
+void PsiCapsRegistry::open()
+{
+    bool                 created = false;
+    const QList<CapsRow> rows    = QtConcurrent::run(&io_, readRows, &created).result();
+
+    if (created) {
+        CapsRegistry::load(); // from caps.xml
+        QList<CapsRow> imported;
+        const qint64   now = QDateTime::currentSecsSinceEpoch();
+        for (auto it = capsInfo_.constBegin(); it != capsInfo_.constEnd(); ++it) {
+            imported.append({ it.key(), discoToString(it.value().disco()), now });
+        }
+        QtConcurrent::run(&io_, [imported]() {
+            if (writeRows(imported)) {
+                QFile::remove(cacheFile("caps.xml"));
+            }
+        });
+        return;
+    }
+
+    const qint64 oldest = QDateTime::currentDateTime().addDays(-CAPS_MAX_AGE).toSecsSinceEpoch();
+    for (const CapsRow &row : rows) {
+        if (row.lastSeen < oldest) {
+            continue;
+        }
+        QDomDocument doc;
+        if (!doc.setContent(row.disco)) {
+            continue;
+        }
+        XMPP::CapsInfo info;
+        info.setDisco(XMPP::DiscoItem::fromDiscoInfoResult(doc.documentElement()));
+        info.setLastSeen(QDateTime::fromSecsSinceEpoch(row.lastSeen));
+        capsInfo_.insert(row.node, info);
+    }
+    QtConcurrent::run(&io_, [oldest]() {
+        QSqlQuery query(QSqlDatabase::database(CAPS_STORE_CONNECTION, false));
+        query.prepare("DELETE FROM `caps` WHERE `last_seen` < ?;");
+        query.addBindValue(oldest);
+        query.exec();
+    });
+}
+
+/**
+ * \brief Client name, version and os of \a jid.
+ *
+ * These are worked out of the disco info once per caps node,
+ * all resources running the same client share the result.
+ */
+PsiCapsRegistry::ClientInfo PsiCapsRegistry::clientInfo(XMPP::CapsManager *cm, const XMPP::Jid &jid)
+{
+    return static_cast<PsiCapsRegistry *>(CapsRegistry::instance())->resolveClient(cm, jid);
+}
+
+/**
+ * \brief Disco info \a jid announced with its caps, an empty item when they aren't known.
+ */
+XMPP::DiscoItem PsiCapsRegistry::discoInfo(XMPP::CapsManager *cm, const XMPP::Jid &jid)
+{
+    const XMPP::CapsSpec spec = cm->capsSpec(jid);
+    if (!spec.isValid() || !CapsRegistry::instance()->isRegistered(spec.flatten())) {
+        return XMPP::DiscoItem();
+    }
+    return CapsRegistry::instance()->disco(spec.flatten());
+}
+
+PsiCapsRegistry::ClientInfo PsiCapsRegistry::resolveClient(XMPP::CapsManager *cm, const XMPP::Jid &jid)
+{
+    const QString node = cm->capsSpec(jid).flatten();
+    auto          it   = clients_.constFind(node);
+    if (it != clients_.constEnd()) {
+        return *it;
+    }
+
+    ClientInfo info;
+    info.name = cm->clientName(jid);
+    if (!info.name.isEmpty()) {
+        info.version = cm->clientVersion(jid);
+        info.os      = cm->osVersion(jid);
+    }
+    if (isRegistered(node)) { // unknown caps are resolved later and reported with capsChanged
+        clients_.insert(node, info);
+        // in use, so keep it from getting too old. once per session is enough
+        pending_.insert(node, discoToString(disco(node)));
+        if (!flushTimer_.isActive()) {
+            flushTimer_.start();
+        }
+    }
+    return info;
+}
+
+void PsiCapsRegistry::capsRegistered(const XMPP::CapsSpec &spec)
+{
+    const QString node = spec.flatten();
+    pending_.insert(node, discoToString(disco(node)));
+    if (!flushTimer_.isActive()) {
+        flushTimer_.start();
+    }
+}
+
+void PsiCapsRegistry::flush()
+{
+    flushTimer_.stop();
+    if (pending_.isEmpty()) {
         return;
     }
-    file.write(data);
+    QList<CapsRow> rows;
+    const qint64   now = QDateTime::currentSecsSinceEpoch();
+    for (auto it = pending_.constBegin(); it != pending_.constEnd(); ++it) {
+        rows.append({ it.key(), it.value(), now });
+    }
+    pending_.clear();
+    QtConcurrent::run(&io_, [rows]() {
+        if (!writeRows(rows)) {
+            qWarning("PsiCapsRegistry: can't save %d caps nodes", rows.size());
+        }
+    });
 }
 
 QByteArray PsiCapsRegistry::loadData()
 {
-    QFile file(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/caps.xml");
+    QFile file(cacheFile("caps.xml"));
     if (file.exists()) {
         IODeviceOpener opener(&file, QIODevice::ReadOnly);
         if (opener.isOpen()) {
@@ -3,14 +3,46 @@
 
 #include "xmpp_caps.h"
 
+#include <QHash>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace XMPP {
+class Jid;
+}
+
+// Keeps the registry in an sqlite table, one row per caps node. Rows are written as nodes get
+// registered, so nothing has to be serialized as a whole.
 class PsiCapsRegistry : public XMPP::CapsRegistry {
     Q_OBJECT
 
 public:
+    struct ClientInfo {
+        QString name;
+        QString version;
+        QString os;
+    };
+
     PsiCapsRegistry(QObject *parent = nullptr);
+    ~PsiCapsRegistry();
+
+    void                   open();
+    static ClientInfo      clientInfo(XMPP::CapsManager *cm, const XMPP::Jid &jid);
+    static XMPP::DiscoItem discoInfo(XMPP::CapsManager *cm, const XMPP::Jid &jid);
 
-    void       saveData(const QByteArray &data);
     QByteArray loadData();
+
+private slots:
+    void capsRegistered(const XMPP::CapsSpec &spec);
+    void flush();
+
+private:
+    ClientInfo resolveClient(XMPP::CapsManager *cm, const XMPP::Jid &jid);
+
+    QThreadPool                io_; // all store access, in order
+    QTimer                     flushTimer_;
+    QHash<QString, QString>    pending_; // node -> disco xml, not written yet
+    QHash<QString, ClientInfo> clients_; // node -> client, shared by every resource with these caps
 };
 
 #endif // PSICAPSREGSITRY_H
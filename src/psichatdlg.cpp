@@ -625,11 +625,13 @@ void PsiChatDlg::setContactToolTip(QString text)
 void PsiChatDlg::showOwnFingerprint()
 {
 #ifdef HAVE_PGPUTIL
-    const QString &&fingerprint = PGPUtil::getFingerprint(account()->pgpKeyId());
-    if (!fingerprint.isEmpty()) {
-        const QString &&msg = tr("Fingerprint for account \"%1\": %2").arg(account()->name(), fingerprint);
-        appendSysMsg(msg);
-    }
+    PGPUtil::instance().whenKeysLoaded(this, [this]() {
+        const QString &&fingerprint = PGPUtil::getFingerprint(account()->pgpKeyId());
+        if (!fingerprint.isEmpty()) {
+            const QString &&msg = tr("Fingerprint for account \"%1\": %2").arg(account()->name(), fingerprint);
+            appendSysMsg(msg);
+        }
+    });
 #endif // HAVE_PGPUTIL
 }
 
@@ -639,12 +641,7 @@ void PsiChatDlg::sendOwnPublicKey()
     if (!account()->hasPgp())
         return;
 
-    const auto &&keyData = PGPUtil::getPublicKeyData(account()->pgpKeyId());
-    sendMessage(keyData);
-
-    const auto &&keyOwnerName = PGPUtil::getKeyOwnerName(account()->pgpKeyId());
-    const auto &&shortId      = account()->pgpKeyId().right(8);
-    appendSysMsg(tr("Public key \"%1\" sent").arg(keyOwnerName + " " + shortId));
+    sendPublicKeyData(account()->pgpKeyId());
 #endif // HAVE_PGPUTIL
 }
 
@@ -656,12 +653,25 @@ void PsiChatDlg::sendPublicKey()
     if (keyId.isEmpty())
         return;
 
-    const auto &&keyData = PGPUtil::getPublicKeyData(keyId);
-    sendMessage(keyData);
+    sendPublicKeyData(keyId);
+#endif // HAVE_PGPUTIL
+}
 
-    const auto &&keyOwnerName = PGPUtil::getKeyOwnerName(keyId);
-    const auto &&shortId      = keyId.right(8);
-    appendSysMsg(tr("Public key \"%1\" sent").arg(keyOwnerName + " " + shortId));
+void PsiChatDlg::sendPublicKeyData(const QString &keyId)
+{
+#ifdef HAVE_PGPUTIL
+    // gpg exports in the background
+    PGPUtil::exportPublicKey(keyId, this, [this, keyId](const QString &keyData) {
+        sendMessage(keyData);
+
+        PGPUtil::instance().whenKeysLoaded(this, [this, keyId]() {
+            const auto &&keyOwnerName = PGPUtil::getKeyOwnerName(keyId);
+            const auto &&shortId      = keyId.right(8);
+            appendSysMsg(tr("Public key \"%1\" sent").arg(keyOwnerName + " " + shortId));
+        });
+    });
+#else
+    Q_UNUSED(keyId)
 #endif // HAVE_PGPUTIL
 }
 
@@ -59,6 +59,7 @@ private:
     void showOwnFingerprint();
     void sendOwnPublicKey();
     void sendPublicKey();
+    void sendPublicKeyData(const QString &keyId);
     void sendMessage(const QString &body);
 
 private slots:
@@ -38,6 +38,7 @@
 #include "common.h"
 #include "contactupdatesmanager.h"
 #include "dbus.h"
+#include "debug.h"
 #include "desktoputil.h"
 #include "edbsqlite.h"
 #include "eventdlg.h"
@@ -75,17 +76,24 @@
 #include "psirichtext.h"
 #include "psithememanager.h"
 #include "psitoolbar.h"
+#include "reconnectscheduler.h"
 #include "s5b.h"
 #include "shortcutmanager.h"
+#include "spellcheckservice.h"
 #include "spellchecker/aspellchecker.h"
+#include "stallwatchdog.h"
+#include "startupprofiler.h"
+#include "startupscheduler.h"
 #include "statusdlg.h"
 #include "systemwatch/systemwatch.h"
 #include "tabdlg.h"
 #include "tabmanager.h"
+#include "transferscheduler.h"
 #include "tunecontrollermanager.h"
 #include "urlobject.h"
 #include "userlist.h"
 #ifdef HAVE_WEBSERVER
+#include "filesharinghttpproxy.h"
 #include "webserver.h"
 #endif
 #include "xmpp_caps.h"
@@ -131,6 +139,7 @@
 #include <QPixmapCache>
 #include <QPointer>
 #include <QSessionManager>
+#include <QThread>
 
 static const char *tunePublishOptionPath          = "options.extended-presence.tune.publish";
 static const char *tuneUrlFilterOptionPath        = "options.extended-presence.tune.url-filter";
@@ -297,9 +306,13 @@ public:
     IconSelectPopup *     iconSelect         = nullptr;
     NetworkAccessManager *nam                = nullptr;
     FileSharingManager *  fileSharingManager = nullptr;
+    TransferScheduler *   transferScheduler  = nullptr;
+    ReconnectScheduler *  reconnectScheduler = nullptr;
     PsiThemeManager *     themeManager       = nullptr;
 #ifdef HAVE_WEBSERVER
-    WebServer *webServer = nullptr;
+    WebServer *webServer   = nullptr;
+    WebServer *shareServer = nullptr; // shared files are streamed off the gui thread
+    QThread *  shareThread = nullptr;
 #endif
 #ifdef FILETRANSFER
     FileTransDlg *ftwin = nullptr;
@@ -359,11 +372,9 @@ PsiCon::PsiCon() : QObject(nullptr)
 
     d->defaultMenuBar = new QMenuBar(nullptr);
 
-    XMPP::CapsRegistry::setInstance(new PsiCapsRegistry(this));
-    XMPP::CapsRegistry *pcr = XMPP::CapsRegistry::instance();
-    connect(pcr, SIGNAL(destroyed(QObject *)), pcr, SLOT(save()));
-    connect(pcr, SIGNAL(registered(const XMPP::CapsSpec &)), pcr, SLOT(save()));
-    pcr->load();
+    PsiCapsRegistry *pcr = new PsiCapsRegistry(this); // saves itself as nodes get registered
+    XMPP::CapsRegistry::setInstance(pcr);
+    pcr->open();
 }
 
 PsiCon::~PsiCon()
@@ -431,6 +442,9 @@ bool PsiCon::init()
     PsiRichText::setAllowedImageDirs(QStringList() << ApplicationInfo::resourcesDir()
                                                    << ApplicationInfo::homeDir(ApplicationInfo::CacheLocation));
 
+    StartupProfiler *profiler = StartupProfiler::instance();
+    profiler->phase("options");
+
     // To allow us to upgrade from old hardcoded options gracefully, be careful about the order here
     PsiOptions *options = PsiOptions::instance();
     // load the system-wide defaults, if they exist
@@ -478,6 +492,7 @@ bool PsiCon::init()
         common_smallFontSize = minimumFontSize;
     FancyLabel::setSmallFontSize(common_smallFontSize);
 
+    profiler->phase("accounts.xml");
     QFile accountsFile(pathToProfile(activeProfile, ApplicationInfo::ConfigLocation) + "/accounts.xml");
     bool  accountMigration = false;
     if (!accountsFile.exists()) {
@@ -514,9 +529,15 @@ bool PsiCon::init()
     if (!css.isEmpty())
         d->iconSelect->setStyleSheet(css);
 
+    // iconsets are loaded in worker threads, their icons have to end up in this one.
+    // sound prefs are needed by the iconsets as well
+    Anim::setMainThread(QThread::currentThread());
+    PsiConObject *psiConObject = new PsiConObject(this);
+
     // first thing, try to load the iconset
+    profiler->phase("iconsets");
     bool result = true;
-    if (!PsiIconset::instance()->loadAll()) {
+    if (!PsiIconset::instance()->loadStartup()) {
         // LEGOPTS.iconset = "stellar";
         // if(!is.load(LEGOPTS.iconset)) {
         QMessageBox::critical(nullptr, tr("Error"),
@@ -525,21 +546,29 @@ bool PsiCon::init()
         //}
     }
 
+    profiler->phase("network");
     d->nam                = new NetworkAccessManager(this);
     d->fileSharingManager = new FileSharingManager(this);
+    d->transferScheduler  = new TransferScheduler(this);
+    d->reconnectScheduler = new ReconnectScheduler(this);
 #ifdef HAVE_WEBSERVER
     d->webServer = new WebServer(this);
-    d->webServer->route("/psi/account",
-                        [this](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
-                            if (req->method() != qhttp::EHTTP_GET)
-                                return false;
-                            PsiAccount *acc;
-                            QString     id;
-                            std::tie(acc, id) = d->uriToShareSource(req->url().path());
-                            if (!acc)
-                                return false;
-                            return d->fileSharingManager->downloadHttpRequest(acc, id, req, res);
-                        });
+    d->webServer->startListening();
+
+    d->shareServer = new WebServer;
+    d->shareServer->route("/psi/account/",
+                          [this](qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res) -> bool {
+                              if (req->method() != qhttp::EHTTP_GET)
+                                  return false;
+                              new FileSharingHttpProxy(this, req, res); // looks up the share in the gui thread
+                              return true;
+                          });
+    d->shareThread = new QThread(this);
+    d->shareThread->setObjectName("shareserver");
+    d->shareServer->moveToThread(d->shareThread);
+    connect(d->shareThread, &QThread::finished, d->shareServer, &QObject::deleteLater);
+    d->shareThread->start();
+    QMetaObject::invokeMethod(d->shareServer, "startListening", Qt::BlockingQueuedConnection);
 #endif
     d->nam->route("/psi/account/", [this](const QNetworkRequest &req) -> QNetworkReply * {
         PsiAccount *acc;
@@ -550,6 +579,7 @@ bool PsiCon::init()
         return new FileSharingNAMReply(acc, id, req);
     });
 
+    profiler->phase("themes");
     d->themeManager = new PsiThemeManager(this);
 #ifdef WEBKIT
     d->themeManager->registerProvider(new ChatViewThemeProvider(this), true);
@@ -565,11 +595,8 @@ bool PsiCon::init()
     if (!d->actionList)
         d->actionList = new PsiActionList(this);
 
-    PsiConObject *psiConObject = new PsiConObject(this);
-
-    Anim::setMainThread(QThread::currentThread());
-
     // setup the main window
+    profiler->phase("mainwin");
     d->mainwin = new MainWin(options->getOption("options.ui.contactlist.always-on-top").toBool(),
                              (options->getOption("options.ui.systemtray.enable").toBool()
                               && options->getOption("options.contactlist.use-toolwindow").toBool()),
@@ -636,17 +663,27 @@ bool PsiCon::init()
     connect(sw, SIGNAL(sleep()), this, SLOT(doSleep()));
     connect(sw, SIGNAL(wakeup()), this, SLOT(doWakeup()));
 
+    // not needed to show the roster, so done after the main window is painted
+    auto deferred = new StartupScheduler(this);
+    connect(deferred, &StartupScheduler::finished, deferred, &QObject::deleteLater);
+    deferred->add(
+        "iconsets.deferred", {}, []() { PsiIconset::instance()->parseDeferred(); },
+        []() { PsiIconset::instance()->loadDeferred(); });
+
 #ifdef PSI_PLUGINS
     // Plugin Manager
+    profiler->phase("plugins");
     connect(PluginManager::instance(), &PluginManager::pluginEnabled, this,
             [this](const QString &) { slotApplyOptions(); });
     PluginManager::instance()->initNewSession(this);
+    deferred->add("plugins", {}, std::function<void()>(), []() { PluginManager::instance()->loadEnabledPlugins(); });
 #endif
 
     // Global shortcuts
     setShortcuts();
 
     // load accounts
+    profiler->phase("accounts");
     {
         QList<UserAccount> accs;
         QStringList        bases = d->accountTree.getChildOptionNames("accounts", true, true);
@@ -697,6 +734,7 @@ bool PsiCon::init()
     checkAccountsEmpty();
 
     // Import for SQLite history
+    profiler->phase("history");
     if (d->contactList->defaultAccount()) {
         EDBSqLite *edb = new EDBSqLite(this);
         d->edb         = edb;
@@ -726,11 +764,17 @@ bool PsiCon::init()
 
     // init spellchecker
     optionChanged("options.ui.spell-check.langs");
+    optionChanged("options.tracing.enabled");
+    optionChanged("options.stall-watchdog.threshold");
 
-    // try autologin if needed
-    for (PsiAccount *account : d->contactList->accounts()) {
-        account->autoLogin();
-    }
+    // try autologin if needed, plugins are to see the session from its start
+    deferred->add("autologin", { "plugins" }, std::function<void()>(), [this]() {
+        for (PsiAccount *account : d->contactList->accounts()) {
+            account->autoLogin();
+        }
+    });
+    deferred->startAfterPaint(d->mainwin);
+    profiler->phase(QString());
 
     return result;
 }
@@ -754,6 +798,11 @@ void PsiCon::deinit()
 #ifdef HAVE_WEBSERVER
     delete d->webServer;
     d->webServer = nullptr;
+    d->shareThread->quit();
+    d->shareThread->wait();
+    delete d->shareThread;
+    d->shareThread = nullptr;
+    d->shareServer = nullptr; // deleted in its thread
 #endif
 
     d->idle.stop();
@@ -790,6 +839,11 @@ void PsiCon::deinit()
     GlobalShortcutManager::clear();
 
     DesktopUtil::unsetUrlHandler("xmpp");
+
+    StallWatchdog::setThreshold(0);
+
+    // spans recorded since tracing got enabled, the file isn't touched when nothing was
+    Trace::writeChromeJson(ApplicationInfo::currentProfileDir(ApplicationInfo::DataLocation) + "/trace.json");
 }
 
 // will gracefully finish all network activity and other async stuff
@@ -853,7 +907,8 @@ QStringList PsiCon::xmppFatures() const
                                          << "http://jabber.org/protocol/tune"
                                          << "http://jabber.org/protocol/geoloc"
                                          << "urn:xmpp:avatar:data"
-                                         << "urn:xmpp:avatar:metadata";
+                                         << "urn:xmpp:avatar:metadata"
+                                         << "urn:xmpp:bookmarks:1+notify";
 
     static QList<OptFeatureMap> fmap = QList<OptFeatureMap>()
         << OptFeatureMap("options.service-discovery.last-activity", QStringList() << "jabber:iq:last")
@@ -866,7 +921,8 @@ QStringList PsiCon::xmppFatures() const
                                        << "urn:xmpp:avatar:metadata+notify")
         << OptFeatureMap("options.messages.send-composing-events",
                          QStringList() << "http://jabber.org/protocol/chatstates")
-        << OptFeatureMap("options.ui.notifications.send-receipts", QStringList() << "urn:xmpp:receipts");
+        << OptFeatureMap("options.ui.notifications.send-receipts", QStringList() << "urn:xmpp:receipts")
+        << OptFeatureMap("options.ui.notifications.send-chat-markers", QStringList() << "urn:xmpp:chat-markers:0");
 
     for (const OptFeatureMap &f : qAsConst(fmap)) {
         if (PsiOptions::instance()->getOption(f.option).toBool()) {
@@ -883,6 +939,10 @@ NetworkAccessManager *PsiCon::networkAccessManager() const { return d->nam; }
 
 FileSharingManager *PsiCon::fileSharingManager() const { return d->fileSharingManager; }
 
+TransferScheduler *PsiCon::transferScheduler() const { return d->transferScheduler; }
+
+ReconnectScheduler *PsiCon::reconnectScheduler() const { return d->reconnectScheduler; }
+
 PsiThemeManager *PsiCon::themeManager() const { return d->themeManager; }
 
 WebServer *PsiCon::webServer() const
@@ -894,6 +954,20 @@ WebServer *PsiCon::webServer() const
 #endif
 }
 
+WebServer *PsiCon::shareServer() const
+{
+#ifdef HAVE_WEBSERVER
+    return d->shareServer;
+#else
+    return nullptr;
+#endif
+}
+
+std::pair<PsiAccount *, QString> PsiCon::uriToShareSource(const QString &path) const
+{
+    return d->uriToShareSource(path);
+}
+
 TuneControllerManager *PsiCon::tuneManager() const { return d->tuneManager; }
 
 AlertManager *PsiCon::alertManager() const { return &(d->alertManager); }
@@ -1430,6 +1504,16 @@ void PsiCon::optionChanged(const QString &option)
         return;
     }
 
+    if (option == QString::fromLatin1("options.tracing.enabled")) {
+        Trace::setEnabled(PsiOptions::instance()->getOption(option).toBool());
+        return;
+    }
+
+    if (option == QString::fromLatin1("options.stall-watchdog.threshold")) {
+        StallWatchdog::setThreshold(PsiOptions::instance()->getOption(option).toInt());
+        return;
+    }
+
     if (option == QString::fromLatin1("options.ui.spell-check.langs")) {
         if (PsiOptions::instance()->getOption("options.ui.spell-check.enabled").toBool()) {
             auto langs = LanguageManager::deserializeLanguageSet(PsiOptions::instance()->getOption(option).toString());
@@ -1442,7 +1526,7 @@ void PsiCon::optionChanged(const QString &option)
                 langs = LanguageManager::bestUiMatch(langs).toSet();
 #endif
             }
-            SpellChecker::instance()->setActiveLanguages(langs);
+            SpellCheckService::instance()->setActiveLanguages(langs);
         }
         return;
     }
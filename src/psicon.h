@@ -28,6 +28,7 @@
 
 #include <QList>
 #include <functional>
+#include <utility>
 
 class AccountsComboBox;
 class AlertManager;
@@ -49,11 +50,13 @@ class PsiActionList;
 class PsiCon;
 class PsiContactList;
 class PsiThemeManager;
+class ReconnectScheduler;
 class PsiToolBar;
 class QMenuBar;
 class QThread;
 class TabDlg;
 class TabManager;
+class TransferScheduler;
 class TuneController;
 class UserListItem;
 class WebServer;
@@ -81,8 +84,13 @@ public:
     TabManager *           tabManager() const;
     NetworkAccessManager * networkAccessManager() const;
     FileSharingManager *   fileSharingManager() const;
+    TransferScheduler *    transferScheduler() const;
+    ReconnectScheduler *   reconnectScheduler() const;
     PsiThemeManager *      themeManager() const;
     WebServer *            webServer() const;
+    WebServer *            shareServer() const; // lives in its own thread
+
+    std::pair<PsiAccount *, QString> uriToShareSource(const QString &path) const;
 
     AlertManager *alertManager() const;
 
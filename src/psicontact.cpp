@@ -118,6 +118,7 @@ PsiContact::PsiContact(const UserListItem &u, PsiAccount *account, bool isSelf)
     d->account_ = account;
     if (d->account_) {
         connect(d->account_->avatarFactory(), &AvatarFactory::avatarChanged, this, &PsiContact::avatarChanged);
+        connect(d->account_->avatarFactory(), &AvatarFactory::avatarRendered, this, &PsiContact::avatarChanged);
     }
     connect(VCardFactory::instance(), &VCardFactory::vcardChanged, this, &PsiContact::vcardChanged);
     update(u);
@@ -683,6 +684,8 @@ void PsiContact::avatarChanged(const Jid &j)
 {
     if (!j.compare(jid(), false))
         return;
+    // other copies of the item have the old avatar in their tooltips too
+    UserListItem::invalidateTips();
     emit updated();
 }
 
@@ -332,6 +332,7 @@ void PsiContactList::link(PsiAccount *account)
     connect(account, SIGNAL(endBulkContactUpdate()), this, SIGNAL(endBulkContactUpdate()));
     connect(account, SIGNAL(rosterRequestFinished()), this, SIGNAL(rosterRequestFinished()));
     accounts_.append(account);
+    accountIds_.insert(account->id(), account);
     if (account->enabled())
         addEnabledAccount(account);
     connect(account, SIGNAL(enabledChanged()), SLOT(accountEnabledChanged()));
@@ -348,6 +349,8 @@ void PsiContactList::unlink(PsiAccount *account)
         return;
     disconnect(account, SIGNAL(updatedActivity()), this, SIGNAL(accountActivityChanged()));
     accounts_.removeAll(account);
+    if (accountIds_.value(account->id()) == account)
+        accountIds_.remove(account->id());
     removeEnabledAccount(account);
     emit accountCountChanged();
 }
@@ -454,25 +457,40 @@ void PsiContactList::accountEnabledChanged()
         removeEnabledAccount(account);
 }
 
-PsiAccount *PsiContactList::getAccount(const QString &id) const
+PsiAccount *PsiContactList::getAccount(const QString &id) const { return accountIds_.value(id); }
+
+PsiAccount *PsiContactList::getAccountByJid(const XMPP::Jid &jid) const
 {
     for (PsiAccount *account : accounts())
-        if (account->id() == id)
+        if (account->jid().compare(jid, false))
             return account;
 
     return nullptr;
 }
 
-PsiAccount *PsiContactList::getAccountByJid(const XMPP::Jid &jid) const
+const QList<PsiContact *> &PsiContactList::contacts() const { return contacts_; }
+
+/**
+ * Returns contacts with the bare jid of \a jid from all enabled accounts.
+ */
+QList<PsiContact *> PsiContactList::contactsFor(const XMPP::Jid &jid) const
 {
-    for (PsiAccount *account : accounts())
-        if (account->jid().compare(jid, false))
-            return account;
+    return contactJids_.values(jid.bare());
+}
 
+/**
+ * Returns the contact with the bare jid of \a jid, from \a account if it's not null.
+ */
+PsiContact *PsiContactList::findContact(const XMPP::Jid &jid, PsiAccount *account) const
+{
+    for (auto it = contactJids_.constFind(jid.bare()); it != contactJids_.constEnd() && it.key() == jid.bare(); ++it) {
+        if (!account || it.value()->account() == account)
+            return it.value();
+    }
     return nullptr;
 }
 
-const QList<PsiContact *> &PsiContactList::contacts() const { return contacts_; }
+bool PsiContactList::hasContact(const XMPP::Jid &jid) const { return contactJids_.contains(jid.bare()); }
 
 void PsiContactList::addEnabledAccount(PsiAccount *account)
 {
@@ -507,15 +525,24 @@ void PsiContactList::removeEnabledAccount(PsiAccount *account)
 
 void PsiContactList::accountAddedContact(PsiContact *contact)
 {
-    Q_ASSERT(!contacts_.contains(contact));
+    Q_ASSERT(!contactRows_.contains(contact));
+    contactRows_.insert(contact, contacts_.size());
     contacts_.append(contact);
+    contactJids_.insert(contact->jid().bare(), contact);
     emit addedContact(contact);
 }
 
 void PsiContactList::accountRemovedContact(PsiContact *contact)
 {
-    Q_ASSERT(contacts_.contains(contact));
-    contacts_.removeAll(contact);
+    Q_ASSERT(contactRows_.contains(contact));
+    // the last contact takes the place of the removed one, the order of contacts_ doesn't matter
+    int row = contactRows_.take(contact);
+    if (row != contacts_.size() - 1) {
+        contacts_[row] = contacts_.last();
+        contactRows_[contacts_[row]] = row;
+    }
+    contacts_.removeLast();
+    contactJids_.remove(contact->jid().bare(), contact);
     emit removedContact(contact);
 }
 
@@ -22,6 +22,7 @@
 
 #include "profiles.h"
 
+#include <QHash>
 #include <QList>
 #include <functional>
 
@@ -83,6 +84,9 @@ public:
     void unlink(PsiAccount *);
 
     const QList<PsiContact *> &contacts() const;
+    QList<PsiContact *>        contactsFor(const XMPP::Jid &jid) const;
+    PsiContact *               findContact(const XMPP::Jid &jid, PsiAccount *account = nullptr) const;
+    bool                       hasContact(const XMPP::Jid &jid) const;
 
 public slots:
     void setShowAgents(bool);
@@ -169,6 +173,10 @@ private:
     QList<PsiAccount *> accounts_, enabledAccounts_;
     QList<PsiContact *> contacts_;
 
+    QHash<QString, PsiAccount *>      accountIds_;
+    QHash<PsiContact *, int>          contactRows_; // position in contacts_
+    QMultiHash<QString, PsiContact *> contactJids_; // bare jid -> contacts of all enabled accounts
+
     bool    showAgents_;
     bool    showHidden_;
     bool    showSelf_;
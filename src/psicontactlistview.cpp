@@ -19,6 +19,7 @@
 
 #include "psicontactlistview.h"
 
+#include "contactinfocache.h"
 #include "contactlistitem.h"
 #include "contactlistmodel.h"
 #include "contactlistproxymodel.h"
@@ -27,17 +28,25 @@
 #include "psiaccount.h"
 #include "psicontact.h"
 #include "psioptions.h"
+#include "psitiplabel.h"
 #include "psitooltip.h"
+#include "userlist.h"
 
 #include <QApplication>
+#include <QCursor>
 #include <QDesktopWidget>
 #include <QFileInfo>
 #include <QHelpEvent>
 #include <QLayout>
 #include <QMimeData>
+#include <QMouseEvent>
+#include <QPersistentModelIndex>
+#include <QScrollBar>
 #include <QTimer>
 
 static const int           recalculateTimerTimeout = 500;
+static const int           contactInfoDwell        = 1500; // tooltip shown this long before the contact is asked
+static const int           tipPrebuildDelay        = 300;  // the list is still this long before visible tips are built
 static const QLatin1String groupIndentOption("options.ui.contactlist.group-indent");
 
 class PsiContactListView::Private : public QObject {
@@ -48,6 +57,16 @@ public:
         recalculateSizeTimer = new QTimer(this);
         recalculateSizeTimer->setInterval(recalculateTimerTimeout);
         connect(recalculateSizeTimer, SIGNAL(timeout()), SLOT(doRecalculateSize()));
+
+        contactInfoTimer = new QTimer(this);
+        contactInfoTimer->setInterval(contactInfoDwell);
+        contactInfoTimer->setSingleShot(true);
+        connect(contactInfoTimer, &QTimer::timeout, this, &Private::requestContactInfo);
+
+        tipPrebuildTimer = new QTimer(this);
+        tipPrebuildTimer->setInterval(tipPrebuildDelay);
+        tipPrebuildTimer->setSingleShot(true);
+        connect(tipPrebuildTimer, &QTimer::timeout, this, &Private::prebuildTips);
     }
 
     bool allowResize() const { return allowAutoresize && !lv->window()->isMaximized(); }
@@ -116,8 +135,68 @@ private slots:
         }
     }
 
+    // the pointer rested on a contact, so what its tooltip lacks is worth asking for
+    void requestContactInfo()
+    {
+        ContactListItem *item    = tipIndex.isValid() ? lv->itemProxy(tipIndex) : nullptr;
+        PsiContact *     contact = item && item->isContact() ? item->contact() : nullptr;
+        if (!contact || contact->isConference() || !contact->account() || !contact->account()->isAvailable())
+            return;
+
+        ContactInfoCache *cache = contact->account()->contactInfo();
+        connect(cache, &ContactInfoCache::updated, this, &Private::contactInfoUpdated, Qt::UniqueConnection);
+
+        const UserListItem &u = contact->userListItem();
+        if (u.userResourceList().isEmpty()) {
+            if (u.lastAvailable().isNull())
+                cache->request(u.jid().bare(), ContactInfoCache::LastActivity);
+            return;
+        }
+        for (const UserResource &r : u.userResourceList()) {
+            int kinds = 0;
+            if (r.clientName().isEmpty())
+                kinds |= ContactInfoCache::Version;
+            if (!r.timezoneOffset().hasValue())
+                kinds |= ContactInfoCache::Time;
+            if (kinds)
+                cache->request(u.jid().withResource(r.name()), kinds);
+        }
+    }
+
+    void contactInfoUpdated()
+    {
+        // refresh the tooltip if it is still up
+        PsiTipLabel *tip = PsiTipLabel::instance();
+        if (!tipIndex.isValid() || !tip || !tip->isVisible() || !lv->viewport()->underMouse())
+            return;
+        if (lv->indexAt(lv->viewport()->mapFromGlobal(QCursor::pos())) != tipIndex)
+            return;
+        lv->showToolTip(tipIndex, QCursor::pos());
+    }
+
+    void cancelContactInfo()
+    {
+        contactInfoTimer->stop();
+        tipIndex = QPersistentModelIndex();
+    }
+
+    // the contacts cache their tooltips, so hovering one of the visible rows later is cheap
+    void prebuildTips()
+    {
+        if (!lv->isVisible() || !lv->model())
+            return;
+        const int   height = lv->viewport()->height();
+        QModelIndex index  = lv->indexAt(QPoint(0, 0));
+        for (; index.isValid() && lv->visualRect(index).top() < height; index = lv->indexBelow(index)) {
+            ContactListItem *item = lv->itemProxy(index);
+            if (item && item->isContact())
+                item->contact()->toolTip();
+        }
+    }
+
 public slots:
     void recalculateSize() { recalculateSizeTimer->start(); }
+    void scheduleTipPrebuild() { tipPrebuildTimer->start(); }
 
 private:
     bool determineAutoRosterSizeGrowSide()
@@ -132,9 +211,12 @@ private:
     }
 
 public:
-    bool                allowAutoresize;
-    PsiContactListView *lv;
-    QTimer *            recalculateSizeTimer;
+    bool                  allowAutoresize;
+    PsiContactListView *  lv;
+    QTimer *              recalculateSizeTimer;
+    QTimer *              contactInfoTimer;
+    QTimer *              tipPrebuildTimer;
+    QPersistentModelIndex tipIndex; // row the tooltip is shown for
 };
 
 PsiContactListView::PsiContactListView(QWidget *parent) : ContactListDragView(parent)
@@ -150,6 +232,8 @@ PsiContactListView::PsiContactListView(QWidget *parent) : ContactListDragView(pa
     connect(this, SIGNAL(expanded(QModelIndex)), d, SLOT(recalculateSize()));
     connect(this, SIGNAL(collapsed(QModelIndex)), d, SLOT(recalculateSize()));
     connect(this, SIGNAL(modelItemsUpdated()), d, SLOT(recalculateSize()));
+    connect(this, SIGNAL(modelItemsUpdated()), d, SLOT(scheduleTipPrebuild()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), d, SLOT(scheduleTipPrebuild()));
 }
 
 ContactListViewDelegate *PsiContactListView::itemDelegate() const
@@ -169,6 +253,25 @@ void PsiContactListView::showToolTip(const QModelIndex &index, const QPoint &glo
 {
     QString text = index.data(Qt::ToolTipRole).toString();
     PsiToolTip::showText(globalPos, text, this);
+
+    if (index != d->tipIndex) {
+        d->cancelContactInfo();
+        d->tipIndex = index;
+        if (index.isValid())
+            d->contactInfoTimer->start();
+    }
+}
+
+bool PsiContactListView::viewportEvent(QEvent *event)
+{
+    // moving on before the dwell is over asks nothing
+    if (d->tipIndex.isValid()) {
+        if (event->type() == QEvent::Leave
+            || (event->type() == QEvent::MouseMove
+                && indexAt(static_cast<QMouseEvent *>(event)->pos()) != d->tipIndex))
+            d->cancelContactInfo();
+    }
+    return ContactListDragView::viewportEvent(event);
 }
 
 bool PsiContactListView::acceptableDragOperation(QDropEvent *e)
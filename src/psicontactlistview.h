@@ -47,6 +47,7 @@ protected slots:
 protected:
     // reimplemented
     void showToolTip(const QModelIndex &index, const QPoint &globalPos) const;
+    bool viewportEvent(QEvent *event);
     void dragEnterEvent(QDragEnterEvent *e);
     void dropEvent(QDropEvent *e);
     void dragMoveEvent(QDragMoveEvent *e);
@@ -583,8 +583,10 @@ EventItem::EventItem(const PsiEvent::Ptr &_e)
 
 EventItem::EventItem(const EventItem &from)
 {
-    e    = from.e;
-    v_id = from.v_id;
+    e         = from.e;
+    v_id      = from.v_id;
+    v_jidKey  = from.v_jidKey;
+    v_fromKey = from.v_fromKey;
 }
 
 EventItem::~EventItem() { }
@@ -622,8 +624,11 @@ void EventQueue::setEnabled(bool enabled) { enabled_ = enabled; }
 
 EventQueue &EventQueue::operator=(const EventQueue &from)
 {
-    while (!list_.isEmpty())
-        delete list_.takeFirst();
+    qDeleteAll(list_);
+    list_.clear();
+    byJid_.clear();
+    byFrom_.clear();
+    typeCount_.clear();
 
     psi_     = from.psi_;
     account_ = from.account_;
@@ -636,6 +641,46 @@ EventQueue &EventQueue::operator=(const EventQueue &from)
     return *this;
 }
 
+// lists are kept sorted by priority, equal ones in arrival order
+static void insertByPriority(QList<EventItem *> &list, EventItem *i)
+{
+    int prior = i->event()->priority();
+    int n     = list.size();
+    while (n > 0 && list.at(n - 1)->event()->priority() < prior)
+        --n;
+    list.insert(n, i);
+}
+
+static void removeFromBucket(QHash<QString, QList<EventItem *>> &buckets, const QString &key, EventItem *i)
+{
+    auto it = buckets.find(key);
+    if (it == buckets.end())
+        return;
+    it->removeOne(i);
+    if (it->isEmpty())
+        buckets.erase(it);
+}
+
+void EventQueue::insertItem(EventItem *i)
+{
+    i->v_jidKey  = i->event()->jid().bare();
+    i->v_fromKey = i->event()->from().bare();
+    insertByPriority(list_, i);
+    insertByPriority(byJid_[i->v_jidKey], i);
+    insertByPriority(byFrom_[i->v_fromKey], i);
+    ++typeCount_[i->event()->type()];
+}
+
+void EventQueue::removeItem(EventItem *i)
+{
+    list_.removeOne(i);
+    removeFromBucket(byJid_, i->v_jidKey, i);
+    removeFromBucket(byFrom_, i->v_fromKey, i);
+    if (--typeCount_[i->event()->type()] <= 0)
+        typeCount_.remove(i->event()->type());
+    delete i;
+}
+
 int EventQueue::nextId() const
 {
     if (list_.isEmpty())
@@ -649,19 +694,16 @@ int EventQueue::nextId() const
 
 int EventQueue::count() const { return list_.count(); }
 
-int EventQueue::contactCount() const
-{
-    QSet<QString> set;
-    for (EventItem *i : list_) {
-        set.insert(i->event()->jid().bare());
-    }
-    return set.size();
-}
+int EventQueue::contactCount() const { return byJid_.size(); }
 
 int EventQueue::count(const Jid &j, bool compareRes) const
 {
+    const QList<EventItem *> bucket = byJid_.value(j.bare());
+    if (!compareRes)
+        return bucket.size();
+
     int total = 0;
-    for (EventItem *i : list_) {
+    for (EventItem *i : bucket) {
         Jid j2(i->event()->jid());
         if (j.compare(j2, compareRes))
             ++total;
@@ -671,24 +713,7 @@ int EventQueue::count(const Jid &j, bool compareRes) const
 
 void EventQueue::enqueue(const PsiEvent::Ptr &e)
 {
-    EventItem *i = new EventItem(e);
-
-    int  prior = e->priority();
-    bool found = false;
-
-    // skip all with higher or equal priority
-    for (EventItem *ei : qAsConst(list_)) {
-        if (ei && ei->event()->priority() < prior) {
-            list_.insert(list_.indexOf(ei), i);
-            found = true;
-            break;
-        }
-    }
-
-    // everything else
-    if (!found)
-        list_.append(i);
-
+    insertItem(new EventItem(e));
     emit queueChanged();
 }
 
@@ -699,9 +724,8 @@ void EventQueue::dequeue(const PsiEvent::Ptr &e)
 
     for (EventItem *i : qAsConst(list_)) {
         if (e == i->event()) {
-            list_.removeAll(i);
+            removeItem(i);
             emit queueChanged();
-            delete i;
             return;
         }
     }
@@ -709,13 +733,13 @@ void EventQueue::dequeue(const PsiEvent::Ptr &e)
 
 PsiEvent::Ptr EventQueue::dequeue(const Jid &j, bool compareRes)
 {
-    for (EventItem *i : qAsConst(list_)) {
+    const QList<EventItem *> bucket = byJid_.value(j.bare());
+    for (EventItem *i : bucket) {
         PsiEvent::Ptr e = i->event();
         Jid           j2(e->jid());
         if (j.compare(j2, compareRes)) {
-            list_.removeAll(i);
+            removeItem(i);
             emit queueChanged();
-            delete i;
             return e;
         }
     }
@@ -725,7 +749,8 @@ PsiEvent::Ptr EventQueue::dequeue(const Jid &j, bool compareRes)
 
 PsiEvent::Ptr EventQueue::peek(const Jid &j, bool compareRes) const
 {
-    for (EventItem *i : list_) {
+    const QList<EventItem *> bucket = byJid_.value(j.bare());
+    for (EventItem *i : bucket) {
         PsiEvent::Ptr e = i->event();
         Jid           j2(e->jid());
         if (j.compare(j2, compareRes)) {
@@ -745,9 +770,8 @@ PsiEvent::Ptr EventQueue::dequeueNext()
     if (!i)
         return PsiEvent::Ptr();
     PsiEvent::Ptr e = i->event();
-    list_.removeAll(i);
+    removeItem(i);
     emit queueChanged();
-    delete i;
     return e;
 }
 
@@ -764,7 +788,11 @@ PsiEvent::Ptr EventQueue::peekNext() const
 
 PsiEvent::Ptr EventQueue::peekFirstChat(const Jid &j, bool compareRes) const
 {
-    for (EventItem *i : list_) {
+    if (!typeCount_.contains(PsiEvent::Message))
+        return PsiEvent::Ptr();
+
+    const QList<EventItem *> bucket = byFrom_.value(j.bare());
+    for (EventItem *i : bucket) {
         PsiEvent::Ptr e = i->event();
         if (e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
@@ -783,8 +811,9 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
 {
     bool changed = false;
 
-    for (QList<EventItem *>::Iterator it = list_.begin(); it != list_.end();) {
-        PsiEvent::Ptr e       = (*it)->event();
+    const QList<EventItem *> bucket = byFrom_.value(j.bare());
+    for (EventItem *i : bucket) {
+        PsiEvent::Ptr e       = i->event();
         bool          extract = false;
         if (e->type() == PsiEvent::Message) {
             MessageEvent::Ptr me = e.staticCast<MessageEvent>();
@@ -799,14 +828,9 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
         }
 
         if (extract && removeEvents) {
-            EventItem *ei = *it;
-            it            = list_.erase(it);
-            delete ei;
+            removeItem(i);
             changed = true;
-            continue;
         }
-
-        ++it;
     }
 
     if (changed)
@@ -815,8 +839,9 @@ void EventQueue::extractChats(QList<PsiEvent::Ptr> *el, const Jid &j, bool compa
 
 void EventQueue::extractByJid(QList<PsiEvent::Ptr> *list, const XMPP::Jid &jid)
 {
-    for (QList<EventItem *>::Iterator it = list_.begin(); it != list_.end(); it++) {
-        PsiEvent::Ptr e = (*it)->event();
+    const QList<EventItem *> bucket = byFrom_.value(jid.bare());
+    for (EventItem *i : bucket) {
+        PsiEvent::Ptr e = i->event();
         if (jid.compare(e->from(), false)) {
             list->append(e);
         }
@@ -829,23 +854,19 @@ void EventQueue::extractMessages(QList<PsiEvent::Ptr> *el) { extractByType(PsiEv
 // this function extracts all auths from the queue, and returns a list of them
 void EventQueue::extractByType(int type, QList<PsiEvent::Ptr> *el)
 {
-    bool changed = false;
+    if (!typeCount_.contains(type))
+        return;
 
-    for (QList<EventItem *>::Iterator it = list_.begin(); it != list_.end();) {
-        PsiEvent::Ptr e = (*it)->event();
+    const QList<EventItem *> items = list_;
+    for (EventItem *i : items) {
+        PsiEvent::Ptr e = i->event();
         if (e->type() == type) {
             el->append(e);
-            EventItem *ei = *it;
-            it            = list_.erase(it);
-            delete ei;
-            changed = true;
-            continue;
+            removeItem(i);
         }
-        ++it;
     }
 
-    if (changed)
-        emit queueChanged();
+    emit queueChanged();
 }
 
 void EventQueue::printContent() const
@@ -859,10 +880,11 @@ void EventQueue::printContent() const
 
 void EventQueue::clear()
 {
-    while (!list_.isEmpty()) {
-        EventItem *i = list_.takeFirst();
-        delete i;
-    }
+    qDeleteAll(list_);
+    list_.clear();
+    byJid_.clear();
+    byFrom_.clear();
+    typeCount_.clear();
 
     emit queueChanged();
 }
@@ -872,16 +894,13 @@ void EventQueue::clear(const Jid &j, bool compareRes)
 {
     bool changed = false;
 
-    for (QList<EventItem *>::Iterator it = list_.begin(); it != list_.end();) {
-        PsiEvent::Ptr e = (*it)->event();
-        Jid           j2(e->jid());
+    const QList<EventItem *> bucket = byJid_.value(j.bare());
+    for (EventItem *i : bucket) {
+        Jid j2(i->event()->jid());
         if (j.compare(j2, compareRes)) {
-            EventItem *ei = *it;
-            it            = list_.erase(it);
-            delete ei;
+            removeItem(i);
             changed = true;
-        } else
-            ++it;
+        }
     }
 
     if (changed)
@@ -950,7 +969,8 @@ QList<EventQueue::PsiEventId> EventQueue::eventsFor(const XMPP::Jid &jid, bool c
 {
     QList<PsiEventId> result;
 
-    for (EventItem *i : qAsConst(list_)) {
+    const QList<EventItem *> bucket = byFrom_.value(jid.bare());
+    for (EventItem *i : bucket) {
         if (i->event()->from().compare(jid, compareRes))
             result << QPair<int, PsiEvent::Ptr>(i->id(), i->event());
     }
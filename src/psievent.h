@@ -28,6 +28,7 @@
 #include <QDateTime>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QHash>
 #include <QList>
 #include <QObject>
 #include <QPointer>
@@ -345,8 +346,12 @@ public:
     PsiEvent::Ptr event() const;
 
 private:
+    friend class EventQueue;
+
     PsiEvent::Ptr e;
     int           v_id;
+    QString       v_jidKey;  // bare jid() and from() at the time it was queued
+    QString       v_fromKey; // (EventQueue buckets)
 };
 
 // event queue
@@ -396,10 +401,18 @@ signals:
     void queueChanged();
 
 private:
+    void insertItem(EventItem *i);
+    void removeItem(EventItem *i);
+
     QList<EventItem *> list_;
     PsiCon *           psi_;
     PsiAccount *       account_;
     bool               enabled_;
+
+    // same items as list_ and in the same order, split by bare jid() / from()
+    QHash<QString, QList<EventItem *>> byJid_;
+    QHash<QString, QList<EventItem *>> byFrom_;
+    QHash<int, int>                    typeCount_;
 };
 
 #endif // PSIEVENT_H
@@ -31,6 +31,9 @@
 #include <QSet>
 #include <QStandardPaths>
 #include <QTextStream>
+#include <QVarLengthArray>
+#include <QtConcurrentMap>
+#include <vector>
 
 using namespace XMPP;
 
@@ -53,23 +56,21 @@ struct ClientIconCheck {
  *   word "fork" or "plus" somewhere inside, "psi-plus" icons will be used. For psi-ny (New Year edition) icon
  *   caps whould start with "psi" and have "ny" somewhere in the middle.
  *
- * The structire below will look like
+ * The left parts are compiled into a trie, its nodes keep the checks like
  *
- * {
  *   "psi"  => [
  *                {"psi-plus",["fork", "plus"]}
  *                {"psi-ny",["ny"]}
  *             ]
  *   "psi+" => [{"psi-plus",[]}]
- * }
  *
  * Where psi/psi+        - caps/client name (or its beginning) as it comes from client_icons.txt.
  *       psi-plus/psi-ny - icon name
  *       fork/plus/ny    - parts of caps/client name
  *
- * Now for example we need to lookup icon for caps node "psiplus.com". The most still mathing item here is "psi",
- * (psi+ won't match because psiplus.com doesn't start with psi+). And we don't have anything like "psip" or "psipl"..
- * So we review just "psi" (all its items consequently)
+ * Now for example we need to lookup icon for caps node "psiplus.com". Walking the trie along the name gives
+ * all the matching left parts, here just "psi" (psi+ won't match because psiplus.com doesn't start with psi+).
+ * The longest one is reviewed first (all its items consequently), then the shorter ones.
  * Both items in "psi" have clarification list. For the first item we take its clarification list ["fork", "plus"]
  * and review if any item is in "psiplus.com". The "plus" will be found, so the icon "psi-plus" will be returned.
  *
@@ -80,7 +81,81 @@ struct ClientIconCheck {
  * caps node = https://www.psi-im.org/helloworld/caps
  * resulting client name = psi-im.org/helloworld
  */
-typedef QMap<QString, QList<ClientIconCheck>> ClientIconMap;
+class ClientIconTrie {
+public:
+    bool isEmpty() const { return nodes_.size() == 1 && nodes_[0].checks.isEmpty(); }
+
+    void insert(const QString &leftPart, const ClientIconCheck &ic)
+    {
+        int n = 0;
+        for (const QChar &c : leftPart) {
+            auto it = nodes_[n].children.constFind(c);
+            if (it == nodes_[n].children.constEnd()) {
+                nodes_.emplace_back();
+                nodes_[n].children.insert(c, int(nodes_.size()) - 1);
+                n = int(nodes_.size()) - 1;
+            } else {
+                n = it.value();
+            }
+        }
+        nodes_[n].checks.append(ic);
+    }
+
+    // keeps elements with a lot of # first
+    void sort()
+    {
+        for (auto &node : nodes_) {
+            std::stable_sort(node.checks.begin(), node.checks.end(),
+                             [](const auto &a, const auto &b) { return a.inside.size() > b.inside.size(); });
+        }
+    }
+
+    QString lookup(const QString &name) const
+    {
+        QVarLengthArray<std::pair<int, int>, 32> matched; // node, length of its left part
+        if (!nodes_[0].checks.isEmpty()) {
+            matched.append({ 0, 0 });
+        }
+        int n = 0;
+        for (int i = 0; i < name.size(); ++i) {
+            auto it = nodes_[n].children.constFind(name[i]);
+            if (it == nodes_[n].children.constEnd()) {
+                break;
+            }
+            n = it.value();
+            if (!nodes_[n].checks.isEmpty()) {
+                matched.append({ n, i + 1 });
+            }
+        }
+
+        for (int k = matched.size() - 1; k >= 0; --k) {
+            const auto &ics = nodes_[matched[k].first].checks;
+            for (const ClientIconCheck &ic : ics) {
+                bool ok = true;
+                for (const QString &s : ic.inside) {
+                    if (name.indexOf(s, matched[k].second) == -1) {
+                        ok = false;
+                        break;
+                    }
+                }
+                if (ok) {
+                    return ic.icon;
+                }
+            }
+        }
+        return QString();
+    }
+
+private:
+    struct Node {
+        QHash<QChar, int>      children; // index in nodes_
+        QList<ClientIconCheck> checks;
+    };
+    std::vector<Node> nodes_ { Node() };
+};
+
+// resolved jids kept before the cache is dropped
+#define JID_ICONSETS_CACHE_SIZE 4096
 
 //----------------------------------------------------------------------------
 // PsiIconset
@@ -92,9 +167,10 @@ private:
 
 public:
     Iconset                system, moods, clients, activities, affiliations;
-    ClientIconMap          client2icon;
+    ClientIconTrie         client2icon;
     QString                cur_system, cur_status, cur_moods, cur_clients, cur_activity, cur_affiliations;
     QStringList            cur_emoticons;
+    EmoticonMatcher        emoticonMatcher;
     QMap<QString, QString> cur_service_status;
     QMap<QString, QString> cur_custom_status;
     struct StatusIconsets {
@@ -105,11 +181,23 @@ public:
         bool               useServicesIcons = false;
         QList<IconsetItem> list;
         QList<IconsetItem> customList;
+
+        QHash<QString, QStringList> jidIconsets; // bare jid => matched iconsets, the preferred first
     } status_icons;
 
+    // iconsets parsed on the thread pool by preload(), path => result of Iconset::load()
+    struct Preloaded {
+        QString         path;
+        Iconset::Format format = Iconset::Format::Psi;
+        Iconset         iconset;
+        bool            ok = false;
+    };
+    QHash<QString, Preloaded> preloaded;
+    QVector<Preloaded>        deferred; // to be parsed by parseDeferred()
+
     Private(PsiIconset *_psi) { psi = _psi; }
 
-    QString iconsetPath(QString name, Iconset::Format format = Iconset::Format::Psi)
+    QString iconsetPath(QString name, Iconset::Format format = Iconset::Format::Psi, bool warn = true)
     {
         if (format == Iconset::Format::Psi) {
             const auto &dataDirs = ApplicationInfo::dataDirs();
@@ -132,10 +220,116 @@ public:
             }
         }
 
-        qWarning("PsiIconset::Private::iconsetPath(\"%s\"): not found", qPrintable(name));
+        if (warn) {
+            qWarning("PsiIconset::Private::iconsetPath(\"%s\"): not found", qPrintable(name));
+        }
         return QString();
     }
 
+    bool load(Iconset *is, const QString &path, Iconset::Format format = Iconset::Format::Psi)
+    {
+        auto it = preloaded.find(path);
+        if (it == preloaded.end() || it->format != format) {
+            return is->load(path, format);
+        }
+
+        bool ok = it->ok;
+        *is     = it->iconset;
+        preloaded.erase(it);
+        return ok;
+    }
+
+    // the iconsets don't depend on each other, so the ones loadStartup() needs are parsed in parallel.
+    // the rest isn't parsed yet, just listed in deferred
+    void preload()
+    {
+        QVector<Preloaded> list;
+        QSet<QString>      paths;
+
+        auto add = [&list, &paths](const QString &path, Iconset::Format format = Iconset::Format::Psi) {
+            if (!path.isEmpty() && !paths.contains(path)) {
+                paths << path;
+                list.append({ path, format, Iconset(), false });
+            }
+        };
+        auto addSelected = [this, &add](const QString &type, const QString &option) {
+            QString name = PsiOptions::instance()->getOption(option).toString();
+            if (name != "default") {
+                add(iconsetPath(type + "/" + name, Iconset::Format::Psi, false));
+            }
+        };
+
+        add(":/iconsets/system/default");
+        addSelected("system", "options.iconsets.system");
+        add(":/iconsets/roster/default");
+        addSelected("roster", "options.iconsets.status");
+        const auto &rosterNames = rosterIconsetNames();
+        for (const QString &name : rosterNames) {
+            if (name != PsiOptions::instance()->getOption("options.iconsets.status").toString()) {
+                add(iconsetPath("roster/" + name, Iconset::Format::Psi, false));
+            }
+        }
+        add(iconsetPath("affiliations/default", Iconset::Format::Psi, false));
+        addSelected("affiliations", "options.iconsets.affiliations");
+        parse(list);
+
+        list.clear();
+        for (const QString &type : { "moods", "activities", "clients" }) {
+            add(iconsetPath(type + "/default", Iconset::Format::Psi, false));
+            addSelected(type, "options.iconsets." + type);
+        }
+        const auto emoticons = PsiOptions::instance()->getOption("options.iconsets.emoticons").toStringList();
+        for (const QString &name : emoticons) {
+            QString path = iconsetPath("emoticons/" + name, Iconset::Format::Psi, false);
+            if (!path.isEmpty()) {
+                add(path);
+            } else {
+                add(iconsetPath(name, Iconset::Format::KdeEmoticons, false), Iconset::Format::KdeEmoticons);
+            }
+        }
+
+        deferred = list;
+    }
+
+    void parse(QVector<Preloaded> &list)
+    {
+        QtConcurrent::blockingMap(list, [](Preloaded &p) { p.ok = p.iconset.load(p.path, p.format); });
+        for (const Preloaded &p : qAsConst(list)) {
+            preloaded.insert(p.path, p);
+        }
+    }
+
+    // fills cur_service_status and cur_custom_status
+    QSet<QString> rosterIconsetNames()
+    {
+        QSet<QString> names;
+        cur_service_status.clear();
+
+        const auto &services = PsiOptions::instance()->mapKeyList("options.iconsets.service-status");
+        for (const QVariant &service : services) {
+            QString val = PsiOptions::instance()
+                              ->getOption(PsiOptions::instance()->mapLookup("options.iconsets.service-status", service)
+                                          + ".iconset")
+                              .toString();
+            if (val.isEmpty())
+                continue;
+            names << val;
+            cur_service_status.insert(service.toString(), val);
+        }
+
+        QStringList customicons
+            = PsiOptions::instance()->getChildOptionNames("options.iconsets.custom-status", true, true);
+        cur_custom_status.clear();
+        for (const QString &base : customicons) {
+            QString regexp  = PsiOptions::instance()->getOption(base + ".regexp").toString();
+            QString iconset = PsiOptions::instance()->getOption(base + ".iconset").toString();
+            names << iconset;
+            cur_custom_status.insert(regexp, iconset);
+        }
+
+        return names;
+    }
+
     void stripFirstAnimFrame(Iconset &is)
     {
         QListIterator<PsiIcon *> it = is.iterator();
@@ -179,50 +373,60 @@ public:
 
     PsiIcon *jid2icon(const Jid &jid, const QString &iconName)
     {
-        // first level -- global default icon
-        PsiIcon *icon = const_cast<PsiIcon *>(IconsetFactory::iconPtr(iconName));
-
-        // second level -- transport icon
-        if (jid.node().isEmpty() || status_icons.useServicesIcons) {
-            for (const StatusIconsets::IconsetItem &item : qAsConst(status_icons.list)) {
-                if (item.regexp.isEmpty() ? jid.node().isEmpty() : (item.regexp.indexIn(jid.domain()) != -1)) {
-                    const Iconset *is = psi->roster.value(item.iconset);
-                    if (is) {
-                        PsiIcon *i = const_cast<PsiIcon *>(is->icon(iconName));
-                        if (i) {
-                            icon = i;
-                            break;
-                        }
-                    }
+        // custom icons first, then transport icons
+        const QStringList &iconsets = jidIconsets(jid);
+        for (const QString &name : iconsets) {
+            const Iconset *is = psi->roster.value(name);
+            if (is) {
+                PsiIcon *i = const_cast<PsiIcon *>(is->icon(iconName));
+                if (i) {
+                    return i;
                 }
             }
         }
 
-        // third level -- custom icons
+        // global default icon
+        return const_cast<PsiIcon *>(IconsetFactory::iconPtr(iconName));
+    }
+
+    // the regexps are evaluated once per jid, not on each status icon request
+    const QStringList &jidIconsets(const Jid &jid)
+    {
+        const QString bare = jid.bare();
+        auto          it   = status_icons.jidIconsets.constFind(bare);
+        if (it != status_icons.jidIconsets.constEnd()) {
+            return it.value();
+        }
+
+        QStringList iconsets;
         for (const StatusIconsets::IconsetItem &item : qAsConst(status_icons.customList)) {
-            if (item.regexp.indexIn(jid.bare()) != -1) {
-                const Iconset *is = psi->roster.value(item.iconset);
-                if (is) {
-                    PsiIcon *i = const_cast<PsiIcon *>(is->icon(iconName));
-                    if (i) {
-                        icon = i;
-                        break;
-                    }
+            if (item.regexp.indexIn(bare) != -1) {
+                iconsets.append(item.iconset);
+            }
+        }
+        if (jid.node().isEmpty() || status_icons.useServicesIcons) {
+            for (const StatusIconsets::IconsetItem &item : qAsConst(status_icons.list)) {
+                if (item.regexp.isEmpty() ? jid.node().isEmpty() : (item.regexp.indexIn(jid.domain()) != -1)) {
+                    iconsets.append(item.iconset);
                 }
             }
         }
 
-        return icon;
+        if (status_icons.jidIconsets.size() >= JID_ICONSETS_CACHE_SIZE) {
+            status_icons.jidIconsets.clear();
+        }
+        return status_icons.jidIconsets.insert(bare, iconsets).value();
     }
 
     Iconset systemIconset(bool *ok)
     {
         Iconset def;
-        *ok = def.load(":/iconsets/system/default");
+        *ok = load(&def, ":/iconsets/system/default");
 
         if (PsiOptions::instance()->getOption("options.iconsets.system").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("system/" + PsiOptions::instance()->getOption("options.iconsets.system").toString()));
+            load(&is,
+                 iconsetPath("system/" + PsiOptions::instance()->getOption("options.iconsets.system").toString()));
 
             loadIconset(&def, &is);
         }
@@ -235,11 +439,11 @@ public:
     Iconset *defaultRosterIconset(bool *ok)
     {
         Iconset *def = new Iconset;
-        *ok          = def->load(":/iconsets/roster/default");
+        *ok          = load(def, ":/iconsets/roster/default");
 
         if (PsiOptions::instance()->getOption("options.iconsets.status").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("roster/" + PsiOptions::instance()->getOption("options.iconsets.status").toString()));
+            load(&is, iconsetPath("roster/" + PsiOptions::instance()->getOption("options.iconsets.status").toString()));
 
             loadIconset(def, &is);
         }
@@ -252,11 +456,11 @@ public:
     Iconset moodsIconset(bool *ok)
     {
         Iconset def;
-        *ok = def.load(iconsetPath("moods/default"));
+        *ok = load(&def, iconsetPath("moods/default"));
 
         if (PsiOptions::instance()->getOption("options.iconsets.moods").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("moods/" + PsiOptions::instance()->getOption("options.iconsets.moods").toString()));
+            load(&is, iconsetPath("moods/" + PsiOptions::instance()->getOption("options.iconsets.moods").toString()));
 
             loadIconset(&def, &is);
         }
@@ -269,12 +473,12 @@ public:
     Iconset activityIconset(bool *ok)
     {
         Iconset def;
-        *ok = def.load(iconsetPath("activities/default"));
+        *ok = load(&def, iconsetPath("activities/default"));
 
         if (PsiOptions::instance()->getOption("options.iconsets.activities").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("activities/"
-                                + PsiOptions::instance()->getOption("options.iconsets.activities").toString()));
+            load(&is, iconsetPath("activities/"
+                                  + PsiOptions::instance()->getOption("options.iconsets.activities").toString()));
 
             loadIconset(&def, &is);
         }
@@ -287,11 +491,12 @@ public:
     Iconset clientsIconset(bool *ok)
     {
         Iconset def;
-        *ok = def.load(iconsetPath("clients/default"));
+        *ok = load(&def, iconsetPath("clients/default"));
 
         if (PsiOptions::instance()->getOption("options.iconsets.clients").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("clients/" + PsiOptions::instance()->getOption("options.iconsets.clients").toString()));
+            load(&is,
+                 iconsetPath("clients/" + PsiOptions::instance()->getOption("options.iconsets.clients").toString()));
 
             loadIconset(&def, &is);
         }
@@ -304,12 +509,12 @@ public:
     Iconset affiliationsIconset(bool *ok)
     {
         Iconset def;
-        *ok = def.load(iconsetPath("affiliations/default"));
+        *ok = load(&def, iconsetPath("affiliations/default"));
 
         if (PsiOptions::instance()->getOption("options.iconsets.affiliations").toString() != "default") {
             Iconset is;
-            is.load(iconsetPath("affiliations/"
-                                + PsiOptions::instance()->getOption("options.iconsets.affiliations").toString()));
+            load(&is, iconsetPath("affiliations/"
+                                  + PsiOptions::instance()->getOption("options.iconsets.affiliations").toString()));
 
             loadIconset(&def, &is);
         }
@@ -326,7 +531,7 @@ public:
         const auto names = PsiOptions::instance()->getOption("options.iconsets.emoticons").toStringList();
         for (const QString &name : names) {
             Iconset *is = new Iconset;
-            if (is->load(iconsetPath("emoticons/" + name))) {
+            if (load(is, iconsetPath("emoticons/" + name))) {
                 // PsiIconset::removeAnimation(is);
                 is->addToFactory();
                 emo.append(is);
@@ -334,7 +539,7 @@ public:
             }
             delete is;
             is = new Iconset;
-            if (is->load(iconsetPath(name, Iconset::Format::KdeEmoticons), Iconset::Format::KdeEmoticons)) {
+            if (load(is, iconsetPath(name, Iconset::Format::KdeEmoticons), Iconset::Format::KdeEmoticons)) {
                 is->addToFactory();
                 emo.append(is);
             } else
@@ -348,8 +553,12 @@ public:
 PsiIconset::PsiIconset() : QObject(QCoreApplication::instance())
 {
     d = new Private(this);
+    Iconset::setCacheDir(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/iconsets");
+    Iconset::setSharedImageDir(PsiOptions::instance()->getOption("options.iconsets.shared-cache").toString());
     d->status_icons.useServicesIcons
         = PsiOptions::instance()->getOption("options.ui.contactlist.use-transport-icons").toBool();
+    IconsetFactory::setMemoryBudget(
+        PsiOptions::instance()->getOption("options.iconsets.memory-budget").toLongLong() * 1024);
     connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString &)), SLOT(optionChanged(const QString &)));
     connect(PsiOptions::instance(), SIGNAL(destroyed()), SLOT(reset()));
 }
@@ -400,29 +609,7 @@ bool PsiIconset::loadRoster()
     d->cur_status = PsiOptions::instance()->getOption("options.iconsets.status").toString();
 
     // load only necessary roster iconsets
-    QSet<QString> rosterIconsets;
-    d->cur_service_status.clear();
-
-    const auto &services = PsiOptions::instance()->mapKeyList("options.iconsets.service-status");
-    for (const QVariant &service : services) {
-        QString val = PsiOptions::instance()
-                          ->getOption(PsiOptions::instance()->mapLookup("options.iconsets.service-status", service)
-                                      + ".iconset")
-                          .toString();
-        if (val.isEmpty())
-            continue;
-        rosterIconsets << val;
-        d->cur_service_status.insert(service.toString(), val);
-    }
-
-    QStringList customicons = PsiOptions::instance()->getChildOptionNames("options.iconsets.custom-status", true, true);
-    d->cur_custom_status.clear();
-    for (const QString &base : customicons) {
-        QString regexp  = PsiOptions::instance()->getOption(base + ".regexp").toString();
-        QString iconset = PsiOptions::instance()->getOption(base + ".iconset").toString();
-        rosterIconsets << iconset;
-        d->cur_custom_status.insert(regexp, iconset);
-    }
+    const QSet<QString> rosterIconsets = d->rosterIconsetNames();
 
     for (const QString &it2 : qAsConst(rosterIconsets)) {
         if (it2 == PsiOptions::instance()->getOption("options.iconsets.status").toString()) {
@@ -430,7 +617,7 @@ bool PsiIconset::loadRoster()
         }
 
         Iconset *is = new Iconset;
-        if (is->load(d->iconsetPath("roster/" + it2))) {
+        if (d->load(is, d->iconsetPath("roster/" + it2))) {
             is->addToFactory();
             d->stripFirstAnimFrame(*is);
             roster.insert(it2, is);
@@ -449,6 +636,7 @@ void PsiIconset::loadEmoticons()
         qDeleteAll(emoticons);
         emoticons.clear();
         emoticons = d->emoticons();
+        d->emoticonMatcher.build(emoticons);
 
         d->cur_emoticons = cur_emoticons;
         emit emoticonsChanged();
@@ -501,7 +689,7 @@ bool PsiIconset::loadClients()
             iconNames.insert(it.next()->name().section('/', 1, 1));
         }
 
-        ClientIconMap cm; // start part, spec[spec2[spec3]]
+        ClientIconTrie cm; // start part, spec[spec2[spec3]]
 
         auto readClientsDesc = [&](const QString &filePath) {
             QFile capsConv(filePath);
@@ -536,24 +724,12 @@ bool PsiIconset::loadClients()
                         } else {
                             ic.inside.clear();
                         }
-                        ClientIconMap::Iterator it = cm.find(spec[0]);
-                        if (it == cm.end()) {
-                            cm.insert(spec[0], QList<ClientIconCheck>() << ic);
-                        } else {
-                            it.value().append(ic);
-                        }
+                        cm.insert(spec[0], ic);
                     }
                 }
             }
 
-            // do some sorting to keep elements with a lot of # first
-            for (auto &checkList : cm) {
-                std::sort(checkList.begin(), checkList.end(),
-                          [](const auto &a, const auto &b) { return a.inside.size() > b.inside.size(); });
-            }
-
-            /* insert end boundry element to make search implementation simple */
-            cm.insert(QLatin1String("~"), QList<ClientIconCheck>());
+            cm.sort();
             return true;
         };
 
@@ -594,6 +770,7 @@ void PsiIconset::loadStatusIconDefinitions()
 {
     d->status_icons.list.clear();
     d->status_icons.customList.clear();
+    d->status_icons.jidIconsets.clear();
     const auto &servicesV = PsiOptions::instance()->mapKeyList("options.iconsets.service-status");
     for (const QVariant &serviceV : servicesV) {
         QString                                          service = serviceV.toString();
@@ -659,16 +836,57 @@ void PsiIconset::loadStatusIconDefinitions()
 
 bool PsiIconset::loadAll()
 {
-    if (!loadSystem() || !loadRoster())
+    if (!loadStartup())
         return false;
+    parseDeferred();
+    loadDeferred();
+    return true;
+}
+
+/**
+ * Loads the iconsets needed to show the roster. The others are only listed to be loaded by
+ * parseDeferred() and loadDeferred() later.
+ */
+bool PsiIconset::loadStartup()
+{
+    d->preload();
+    if (!loadSystem() || !loadRoster()) {
+        d->preloaded.clear();
+        d->deferred.clear();
+        return false;
+    }
+
+    loadAffiliations();
+    loadStatusIconDefinitions();
+    d->preloaded.clear();
+    return true;
+}
+
+/**
+ * Parses what loadStartup() left for later. Doesn't touch anything else,
+ * so may be called from a worker thread, as long as loadDeferred() waits for it.
+ */
+void PsiIconset::parseDeferred()
+{
+    QtConcurrent::blockingMap(d->deferred,
+                              [](Private::Preloaded &p) { p.ok = p.iconset.load(p.path, p.format); });
+}
+
+/**
+ * Applies the iconsets parsed by parseDeferred(): emoticons, moods, activities and clients
+ */
+void PsiIconset::loadDeferred()
+{
+    for (const Private::Preloaded &p : qAsConst(d->deferred)) {
+        d->preloaded.insert(p.path, p);
+    }
+    d->deferred.clear();
 
     loadEmoticons();
     loadMoods();
     loadActivity();
     loadClients();
-    loadAffiliations();
-    loadStatusIconDefinitions();
-    return true;
+    d->preloaded.clear();
 }
 
 void PsiIconset::optionChanged(const QString &option)
@@ -688,6 +906,9 @@ void PsiIconset::optionChanged(const QString &option)
     } else if (option == "options.ui.contactlist.use-transport-icons") {
         d->status_icons.useServicesIcons
             = PsiOptions::instance()->getOption("options.ui.contactlist.use-transport-icons").toBool();
+        d->status_icons.jidIconsets.clear();
+    } else if (option == "options.iconsets.memory-budget") {
+        IconsetFactory::setMemoryBudget(PsiOptions::instance()->getOption(option).toLongLong() * 1024);
     }
 
     // currently we rely on PsiCon calling reloadRoster() when
@@ -986,6 +1207,8 @@ PsiIcon PsiIconset::status(UserListItem *u)
 
 const Iconset &PsiIconset::system() const { return d->system; }
 
+const EmoticonMatcher &PsiIconset::emoticonMatcher() const { return d->emoticonMatcher; }
+
 void PsiIconset::stripFirstAnimFrame(Iconset *is)
 {
     if (is)
@@ -1007,30 +1230,7 @@ QString PsiIconset::caps2client(const QString &name)
     if (d->client2icon.isEmpty()) {
         return QString();
     }
-
-    auto it = d->client2icon.lowerBound(name);
-    // if name starts with found key or with key of previous item
-    if ((it != d->client2icon.end() && name.startsWith(it.key()))
-        || (it != d->client2icon.begin() && name.startsWith((--it).key()))) {
-
-        const auto &ics = it.value();
-        for (const ClientIconCheck &ic : ics) {
-            if (ic.inside.isEmpty()) {
-                return ic.icon;
-            }
-            bool matched = true;
-            for (const QString &s : ic.inside) {
-                if (name.indexOf(s, it.key().size()) == -1) {
-                    matched = false;
-                    break;
-                }
-            }
-            if (matched) {
-                return ic.icon;
-            }
-        }
-    }
-    return QString();
+    return d->client2icon.lookup(name);
 }
 
 PsiIconset *PsiIconset::instance()
@@ -20,6 +20,7 @@
 #ifndef PSIICONSET_H
 #define PSIICONSET_H
 
+#include "emoticonmatcher.h"
 #include "iconset.h"
 #include "psievent.h"
 
@@ -40,6 +41,9 @@ public:
     bool loadSystem();
     void reloadRoster();
     bool loadAll();
+    bool loadStartup();
+    void parseDeferred();
+    void loadDeferred();
 
     QHash<QString, Iconset *> roster;
     QList<Iconset *>          emoticons;
@@ -48,6 +52,7 @@ public:
     Iconset                   clients;
     Iconset                   affiliations;
     const Iconset &           system() const;
+    const EmoticonMatcher &   emoticonMatcher() const; // over all emoticons
     void                      stripFirstAnimFrame(Iconset *);
     static void               removeAnimation(Iconset *);
 
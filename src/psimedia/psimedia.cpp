@@ -368,29 +368,19 @@ QList<VideoParams> Features::supportedVideoModes() { return d->supportedVideoMod
 //----------------------------------------------------------------------------
 // RtpPacket
 //----------------------------------------------------------------------------
-class RtpPacket::Private : public QSharedData {
-public:
-    QByteArray rawValue;
-    int        portOffset;
-
-    Private(const QByteArray &_rawValue, int _portOffset) : rawValue(_rawValue), portOffset(_portOffset) { }
-};
-
-RtpPacket::RtpPacket() : d(nullptr) { }
+RtpPacket::RtpPacket() : portOffset_(-1) { }
 
-RtpPacket::RtpPacket(const QByteArray &rawValue, int portOffset) : d(new Private(rawValue, portOffset)) { }
+RtpPacket::RtpPacket(const QByteArray &rawValue, int portOffset) : rawValue_(rawValue), portOffset_(portOffset) { }
 
-RtpPacket::RtpPacket(const RtpPacket &other) = default;
-
-RtpPacket::~RtpPacket() = default;
-
-RtpPacket &RtpPacket::operator=(const RtpPacket &other) = default;
+RtpPacket::RtpPacket(QByteArray &&rawValue, int portOffset) : rawValue_(std::move(rawValue)), portOffset_(portOffset)
+{
+}
 
-bool RtpPacket::isNull() const { return (d ? false : true); }
+bool RtpPacket::isNull() const { return portOffset_ < 0; }
 
-QByteArray RtpPacket::rawValue() const { return d->rawValue; }
+const QByteArray &RtpPacket::rawValue() const { return rawValue_; }
 
-int RtpPacket::portOffset() const { return d->portOffset; }
+int RtpPacket::portOffset() const { return portOffset_; }
 
 //----------------------------------------------------------------------------
 // RtpChannel
@@ -411,7 +401,7 @@ RtpPacket RtpChannel::read()
 {
     if (d->c) {
         PRtpPacket pp = d->c->read();
-        return RtpPacket(pp.rawValue, pp.portOffset);
+        return RtpPacket(std::move(pp.rawValue), pp.portOffset);
     } else
         return RtpPacket();
 }
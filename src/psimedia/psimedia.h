@@ -22,7 +22,6 @@
 #define PSIMEDIA_H
 
 #include <QMetaType>
-#include <QSharedDataPointer>
 #include <QSize>
 #include <QStringList>
 #ifdef QT_GUI_LIB
@@ -180,22 +179,21 @@ private:
     Private *d;
 };
 
+// a plain value, copying one only shares the implicitly shared payload
 class RtpPacket {
 public:
     RtpPacket();
     RtpPacket(const QByteArray &rawValue, int portOffset);
-    RtpPacket(const RtpPacket &other);
-    ~RtpPacket();
-    RtpPacket &operator=(const RtpPacket &other);
+    RtpPacket(QByteArray &&rawValue, int portOffset);
 
     bool isNull() const;
 
-    QByteArray rawValue() const;
-    int        portOffset() const;
+    const QByteArray &rawValue() const;
+    int               portOffset() const;
 
 private:
-    class Private;
-    QSharedDataPointer<Private> d;
+    QByteArray rawValue_;
+    int        portOffset_; // -1 for a null packet
 };
 
 // may drop packets if not read fast enough.
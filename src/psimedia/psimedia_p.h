@@ -90,6 +90,14 @@ public:
         auto p = provider();
         if (!p)
             return;
+        // one context per provider, a second one would probe and monitor the hardware again
+        if (c) {
+            if (c->qobject()->parent() == p->qobject())
+                return;
+            c->qobject()->disconnect(this);
+            delete c->qobject();
+            c = nullptr;
+        }
         c = p->createFeatures();
         c->qobject()->setParent(p->qobject());
         connect(c->qobject(), SIGNAL(destroyed()), this, SLOT(cleanup()));
@@ -21,6 +21,7 @@
 
 #include "applicationinfo.h"
 #include "common.h"
+#include "optionstreewriter.h"
 #ifdef PSI_PLUGINS
 #include "pluginmanager.h"
 #endif
@@ -31,11 +32,120 @@
 #include "xmpp_task.h"
 #include "xmpp_xmlcommon.h"
 
+#include <QBuffer>
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QSaveFile>
+#include <QThreadPool>
 #include <QTimer>
+#include <QtConcurrent>
+#include <algorithm>
 
 using namespace XMPP;
 
+// options are saved this long after the last change
+#define AUTOSAVE_DELAY 1000
+// and at least this often while they keep changing
+#define AUTOSAVE_MAX_DELAY 10000
+
+// binary copies of loaded option files, so startup doesn't have to parse xml
+#define SNAPSHOT_MAGIC 0x5053534e // "PSSN"
+#define SNAPSHOT_FORMAT 1
+#define SNAPSHOT_STREAM_VERSION QDataStream::Qt_5_6
+
+static QString snapshotFile(const QString &source)
+{
+    const QByteArray key
+        = QCryptographicHash::hash(QFileInfo(source).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/options/" + QString::fromLatin1(key.toHex())
+        + ".bin";
+}
+
+static QByteArray sourceHash(const QString &source)
+{
+    QFile              f(source);
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    if (!f.open(QIODevice::ReadOnly) || !hash.addData(&f))
+        return QByteArray();
+    return hash.result();
+}
+
+static QByteArray treeSnapshot(const OptionsTree *tree)
+{
+    QByteArray  data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(SNAPSHOT_STREAM_VERSION);
+    tree->toBinary(out);
+    return data;
+}
+
+/**
+ * Stores \a tree as the snapshot of \a source, which must have the same content.
+ * Called in background, so only what's passed is used.
+ */
+static void writeSnapshot(const QString &source, const QByteArray &tree)
+{
+    const QByteArray sum = sourceHash(source);
+    const QFileInfo  fi(source);
+    const QString    fileName = snapshotFile(source);
+    if (sum.isEmpty() || !QDir().mkpath(QFileInfo(fileName).absolutePath()))
+        return;
+
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&f);
+    out.setVersion(SNAPSHOT_STREAM_VERSION);
+    out << quint32(SNAPSHOT_MAGIC) << quint32(SNAPSHOT_FORMAT) << ApplicationInfo::version() << fi.size()
+        << fi.lastModified().toMSecsSinceEpoch() << sum;
+    out.writeRawData(tree.constData(), tree.size());
+    f.commit();
+}
+
+/**
+ * Reads the snapshot header of \a source. Returns a null hash if there's no usable snapshot,
+ * \a check tells whether size and time of the source have to match too.
+ */
+static QByteArray readSnapshotHeader(QDataStream &in, const QString &source, bool check)
+{
+    quint32    magic = 0, format = 0;
+    QString    version;
+    qint64     size = 0, mtime = 0;
+    QByteArray sum;
+    in.setVersion(SNAPSHOT_STREAM_VERSION);
+    in >> magic >> format >> version >> size >> mtime >> sum;
+    if (in.status() != QDataStream::Ok || magic != SNAPSHOT_MAGIC || format != SNAPSHOT_FORMAT
+        || version != ApplicationInfo::version())
+        return QByteArray();
+    if (check) {
+        const QFileInfo fi(source);
+        if (size != fi.size() || mtime != fi.lastModified().toMSecsSinceEpoch())
+            return QByteArray();
+    }
+    return sum;
+}
+
+// size and time can't tell a file restored with both unchanged, so the content is compared later
+static void verifySnapshot(const QString &source)
+{
+    QFile f(snapshotFile(source));
+    if (!f.open(QIODevice::ReadOnly))
+        return;
+    QDataStream      in(&f);
+    const QByteArray sum = readSnapshotHeader(in, source, false);
+    f.close();
+    if (!sum.isEmpty() && sum != sourceHash(source)) {
+        qWarning("PsiOptions: %s changed behind the options cache, it will be reloaded next time",
+                 qUtf8Printable(source));
+        QFile::remove(f.fileName());
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 class OptionsStorageTask : public Task {
@@ -101,8 +211,10 @@ private:
  */
 PsiOptions *PsiOptions::instance()
 {
-    if (!instance_)
+    if (!instance_) {
         instance_ = new PsiOptions();
+        instance_->updateAllCached();
+    }
     return instance_;
 }
 
@@ -240,7 +352,41 @@ bool PsiOptions::exists(QString fileName) { return OptionsTree::exists(fileName)
  * \param file Name of the xml config file to load
  * \return Success
  */
-bool PsiOptions::load(QString file) { return loadOptions(file, "options", ApplicationInfo::optionsNS()); }
+bool PsiOptions::load(QString file)
+{
+    bool ret = loadSnapshot(file);
+    if (!ret && QFileInfo::exists(file)) {
+        // parse separately, so the snapshot holds just this file and merges in the same way as it will next time
+        OptionsTree source;
+        ret = source.loadOptions(file, "options", ApplicationInfo::optionsNS());
+        if (ret) {
+            const QByteArray tree = treeSnapshot(&source);
+            QDataStream      in(tree);
+            in.setVersion(SNAPSHOT_STREAM_VERSION);
+            fromBinary(in);
+            QtConcurrent::run(saver_, writeSnapshot, file, tree);
+        }
+    } else if (!ret) {
+        ret = loadOptions(file, "options", ApplicationInfo::optionsNS());
+    }
+    updateAllCached(); // loading doesn't tell about every option
+    return ret;
+}
+
+/**
+ * Merges the snapshot of \a file if it's still up to date
+ */
+bool PsiOptions::loadSnapshot(const QString &file)
+{
+    QFile f(snapshotFile(file));
+    if (!QFileInfo::exists(file) || !f.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream in(&f);
+    if (readSnapshotHeader(in, file, true).isEmpty() || !fromBinary(in))
+        return false; // a partial merge is fine, the xml is loaded on top
+    QtConcurrent::run(saver_, verifySnapshot, file);
+    return true;
+}
 
 /**
  * Loads the options stored in the private storage of
@@ -265,12 +411,22 @@ bool PsiOptions::save(QString file)
     return saveOptions(file, "options", ApplicationInfo::optionsNS(), ApplicationInfo::version());
 }
 
-PsiOptions::PsiOptions() : OptionsTree(), autoSaveTimer_(nullptr)
+PsiOptions::PsiOptions() :
+    OptionsTree(), autoSaveTimer_(nullptr), saver_(nullptr), saveWatcher_(nullptr), dirty_(false),
+    savePending_(false)
 {
     autoSaveTimer_ = new QTimer(this);
     autoSaveTimer_->setSingleShot(true);
-    autoSaveTimer_->setInterval(1000);
+    autoSaveTimer_->setInterval(AUTOSAVE_DELAY);
     connect(autoSaveTimer_, SIGNAL(timeout()), SLOT(saveToAutoFile()));
+    saver_ = new QThreadPool(this);
+    saver_->setMaxThreadCount(1);
+    saveWatcher_ = new QFutureWatcher<bool>(this);
+    connect(saveWatcher_, &QFutureWatcher<bool>::finished, this, &PsiOptions::autoSaveFinished);
+    connect(this, &OptionsTree::optionChanged, this, &PsiOptions::updateCached);
+    connect(this, &OptionsTree::optionInserted, this, &PsiOptions::updateCached);
+    connect(this, &OptionsTree::optionRemoved, this, &PsiOptions::updateCached);
+    connect(this, &OptionsTree::optionChanged, this, &PsiOptions::dispatchWatchers);
 
     setParent(QCoreApplication::instance());
     autoSave(false);
@@ -292,8 +448,11 @@ PsiOptions::~PsiOptions()
     // since we queue connection to saveToAutoFile, so if some option was saved prior
     // to program termination, the PsiOptions is never given the chance to save
     // the changed option
-    if (!autoFile_.isEmpty()) {
-        saveToAutoFile();
+    saver_->waitForDone();
+    const QFuture<bool> last       = saveWatcher_->future();
+    const bool          lastFailed = last.resultCount() > 0 && !last.result();
+    if (!autoFile_.isEmpty() && (dirty_ || savePending_ || lastFailed) && save(autoFile_)) {
+        writeSnapshot(autoFile_, treeSnapshot(this));
     }
 }
 
@@ -306,21 +465,74 @@ PsiOptions::~PsiOptions()
 void PsiOptions::autoSave(bool autoSave, QString autoFile)
 {
     if (autoSave) {
-        connect(this, SIGNAL(optionChanged(const QString &)), autoSaveTimer_, SLOT(start()));
+        connect(this, SIGNAL(optionChanged(const QString &)), SLOT(markDirty()), Qt::UniqueConnection);
         autoFile_ = autoFile;
     } else {
-        disconnect(this, SIGNAL(optionChanged(const QString &)), autoSaveTimer_, SLOT(start()));
+        disconnect(this, SIGNAL(optionChanged(const QString &)), this, SLOT(markDirty()));
         autoFile = "";
     }
 }
 
 /**
- * Saves to the previously set file, if automatic saving is enabled
+ * Schedules an automatic save. Bursts of changes are coalesced into one save, but a steady
+ * stream of them doesn't postpone it for longer than AUTOSAVE_MAX_DELAY.
+ */
+void PsiOptions::markDirty()
+{
+    if (!dirty_) {
+        dirty_ = true;
+        dirtySince_.start();
+    }
+    autoSaveTimer_->start(int(qBound(qint64(0), AUTOSAVE_MAX_DELAY - dirtySince_.elapsed(), qint64(AUTOSAVE_DELAY))));
+}
+
+static bool writeOptionsFile(const QString &fileName, const QByteArray &data, const QByteArray &tree)
+{
+    // commit() syncs the data to disk before replacing the old file
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size() || !f.commit())
+        return false;
+    writeSnapshot(fileName, tree);
+    return true;
+}
+
+/**
+ * Saves to the previously set file, if automatic saving is enabled.
+ * The tree is only serialized here, writing and syncing the file happens in background.
  */
 void PsiOptions::saveToAutoFile()
 {
-    if (!autoFile_.isEmpty()) {
-        save(autoFile_);
+    if (autoFile_.isEmpty() || !dirty_) {
+        return;
+    }
+    if (saveWatcher_->isRunning()) {
+        savePending_ = true;
+        return;
+    }
+
+    QByteArray data;
+    QBuffer    buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    OptionsTreeWriter writer(this);
+    writer.setName("options");
+    writer.setNameSpace(ApplicationInfo::optionsNS());
+    writer.setVersion(ApplicationInfo::version());
+    writer.write(&buffer);
+
+    dirty_       = false;
+    savePending_ = false;
+    saveWatcher_->setFuture(QtConcurrent::run(saver_, writeOptionsFile, autoFile_, data, treeSnapshot(this)));
+}
+
+void PsiOptions::autoSaveFinished()
+{
+    if (!saveWatcher_->result()) {
+        qWarning("PsiOptions: failed to save %s", qUtf8Printable(autoFile_));
+        dirty_ = true; // try again with the next change
+    }
+    if (savePending_) {
+        savePending_ = false;
+        saveToAutoFile();
     }
 }
 
@@ -334,6 +546,91 @@ void PsiOptions::getOptionsStorage_finished()
         QDomElement e = t->options();
         e.setAttribute("xmlns", ApplicationInfo::optionsNS());
         loadOptions(e, "options", ApplicationInfo::optionsNS());
+        updateAllCached();
+    }
+}
+
+PsiOptions::CachedOption *PsiOptions::cachedOption(const QString &name, int typeId, CachedOption *(*create)())
+{
+    if (!cached_)
+        cached_ = new QHash<QString, QHash<int, CachedOption *>>;
+    auto &byType = (*cached_)[name];
+    auto  c      = byType.value(typeId);
+    if (!c) {
+        c = create();
+        c->update(instance()->getOption(name));
+        byType.insert(typeId, c);
+    }
+    return c;
+}
+
+void PsiOptions::updateCached(const QString &name)
+{
+    if (this != instance_ || !cached_)
+        return;
+    auto it = cached_->constFind(name);
+    if (it == cached_->constEnd())
+        return;
+    const QVariant value = getOption(name);
+    for (auto c : it.value())
+        c->update(value);
+}
+
+void PsiOptions::updateAllCached()
+{
+    if (this != instance_ || !cached_)
+        return;
+    for (auto it = cached_->constBegin(); it != cached_->constEnd(); ++it) {
+        const QVariant value = getOption(it.key());
+        for (auto c : it.value())
+            c->update(value);
+    }
+}
+
+void PsiOptions::watch(const QString &prefix, QObject *context, std::function<void(const QString &)> callback)
+{
+    if (!watchRoot_)
+        watchRoot_ = new WatchNode;
+    QString path = prefix;
+    if (path.endsWith(QLatin1String(".*")))
+        path.chop(2);
+
+    WatchNode *node = watchRoot_;
+    if (!path.isEmpty()) {
+        const QStringList parts = path.split('.');
+        for (const QString &part : parts) {
+            WatchNode *&child = node->children[part];
+            if (!child)
+                child = new WatchNode;
+            node = child;
+        }
+    }
+    node->watchers.append({ context, std::move(callback) });
+    // nodes are never freed, so capturing one is safe
+    connect(context, &QObject::destroyed, [node]() {
+        node->watchers.erase(std::remove_if(node->watchers.begin(), node->watchers.end(),
+                                            [](const Watcher &w) { return w.context.isNull(); }),
+                             node->watchers.end());
+    });
+}
+
+void PsiOptions::dispatchWatchers(const QString &name)
+{
+    if (this != instance_ || !watchRoot_)
+        return;
+    // collect first, a callback may subscribe more or delete other subscribers
+    QList<Watcher>    matched = watchRoot_->watchers;
+    WatchNode *       node    = watchRoot_;
+    const QStringList parts   = name.split('.');
+    for (const QString &part : parts) {
+        node = node->children.value(part);
+        if (!node)
+            break;
+        matched += node->watchers;
+    }
+    for (const Watcher &w : qAsConst(matched)) {
+        if (w.context)
+            w.callback(name);
     }
 }
 
@@ -373,3 +670,7 @@ void PsiOptions::resetOption(const QString &name)
 
 PsiOptions *PsiOptions::instance_ = nullptr;
 PsiOptions *PsiOptions::defaults_ = nullptr;
+// outlives the instances, so handles stay valid across reset()
+QHash<QString, QHash<int, PsiOptions::CachedOption *>> *PsiOptions::cached_ = nullptr;
+
+PsiOptions::WatchNode *PsiOptions::watchRoot_ = nullptr;
@@ -22,11 +22,18 @@
 
 #include "optionstree.h"
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <functional>
+
 // Some hard coded options
 #define MINIMUM_OPACITY 10
 
 class QString;
+class QThreadPool;
 class QTimer;
+template <typename T> class QFutureWatcher;
 
 namespace XMPP {
 class Client;
@@ -49,18 +56,83 @@ public:
     void autoSave(bool autoSave, QString autoFile = "");
     void resetOption(const QString &name);
 
+    /**
+     * Typed view of an option for hot paths. The name is resolved once and the value is kept
+     * up to date as the option changes, so reading it is just a pointer load.
+     */
+    template <typename T> class Handle {
+    public:
+        inline const T &value() const { return *value_; }
+        inline operator const T &() const { return *value_; }
+
+    private:
+        friend class PsiOptions;
+        inline Handle(const T *value) : value_(value) { }
+        const T *value_;
+    };
+
+    template <typename T> static Handle<T> handle(const char *name)
+    {
+        auto c = cachedOption(QString::fromLatin1(name), qMetaTypeId<T>(), []() -> CachedOption * {
+            return new CachedValue<T>;
+        });
+        return Handle<T>(&static_cast<CachedValue<T> *>(c)->value);
+    }
+
+    /**
+     * Calls \a callback when an option under \a prefix ("options.ui.chat" or "options.ui.chat.*"), or that
+     * exact option, changes. Unlike optionChanged() only matching subscribers are called.
+     * The subscription ends when \a context is destroyed.
+     */
+    static void watch(const QString &prefix, QObject *context, std::function<void(const QString &)> callback);
+
     // don't call this normally
     PsiOptions();
 
 private slots:
     void saveToAutoFile();
+    void autoSaveFinished();
+    void markDirty();
     void getOptionsStorage_finished();
+    void updateCached(const QString &name);
+    void dispatchWatchers(const QString &name);
 
 private:
-    QString            autoFile_;
-    QTimer *           autoSaveTimer_;
-    static PsiOptions *instance_;
-    static PsiOptions *defaults_;
+    struct CachedOption {
+        virtual ~CachedOption() { }
+        virtual void update(const QVariant &v) = 0;
+    };
+    template <typename T> struct CachedValue : CachedOption {
+        T    value = T();
+        void update(const QVariant &v) override { value = v.value<T>(); }
+    };
+
+    struct Watcher {
+        QPointer<QObject>                    context;
+        std::function<void(const QString &)> callback;
+    };
+    // one node per name segment, watchers of a prefix are kept on its last segment
+    struct WatchNode {
+        QHash<QString, WatchNode *> children;
+        QList<Watcher>              watchers;
+    };
+
+    static CachedOption *cachedOption(const QString &name, int typeId, CachedOption *(*create)());
+    void                 updateAllCached();
+    bool                 loadSnapshot(const QString &file);
+
+    QString               autoFile_;
+    QTimer *              autoSaveTimer_;
+    QThreadPool *         saver_;
+    QFutureWatcher<bool> *saveWatcher_;
+    QElapsedTimer         dirtySince_;
+    bool                  dirty_;
+    bool                  savePending_; // changed again while the previous save was in flight
+    static PsiOptions *   instance_;
+    static PsiOptions *   defaults_;
+
+    static QHash<QString, QHash<int, CachedOption *>> *cached_; // option name -> value type -> value
+    static WatchNode *                                  watchRoot_;
 };
 
 #endif // PSIOPTIONS_H
@@ -35,7 +35,9 @@
 
 #include <QApplication>
 #include <QBoxLayout>
+#include <QElapsedTimer>
 #include <QHBoxLayout>
+#include <QHash>
 #include <QLabel>
 #include <QLayout>
 #include <QList>
@@ -50,11 +52,55 @@
  */
 static int MaxPopups = 5;
 
+/**
+ * New popups shown within POPUP_RATE_WINDOW milliseconds at most,
+ * the ones over it are counted in a single summary popup.
+ */
+#define POPUP_RATE_MAX 5
+#define POPUP_RATE_WINDOW 2000
+
 /**
  * Holds a list of Psi Popups.
  */
 static QList<PsiPopup *> *psiPopupList = nullptr;
 
+/**
+ * Shown popups by id, for dropping duplicates.
+ */
+static QHash<QString, PsiPopup *> *psiPopupIds = nullptr;
+
+/**
+ * Shown message popups by type and bare jid, later messages
+ * from the same contact or room are merged into them.
+ */
+static QHash<QString, PsiPopup *> *psiPopupBursts = nullptr;
+
+static const QString summaryKey = QStringLiteral("summary");
+
+static QString burstKey(PopupManager::PopupType type, const Jid &j)
+{
+    if (type != PopupManager::AlertMessage && type != PopupManager::AlertChat
+        && type != PopupManager::AlertGcHighlight)
+        return QString();
+    return QString::number(type) + '/' + j.bare();
+}
+
+// true if too many popups were shown lately
+static bool rateExceeded()
+{
+    static QElapsedTimer clock;
+    static QList<qint64> shown;
+    if (!clock.isValid())
+        clock.start();
+    const qint64 now = clock.elapsed();
+    while (!shown.isEmpty() && now - shown.first() > POPUP_RATE_WINDOW)
+        shown.removeFirst();
+    if (shown.count() >= POPUP_RATE_MAX)
+        return true;
+    shown.append(now);
+    return false;
+}
+
 //----------------------------------------------------------------------------
 // PsiPopup::Private
 //----------------------------------------------------------------------------
@@ -67,6 +113,8 @@ public:
 
     void        init(const PsiIcon *titleIcon, const QString &titleText, PsiAccount *_acc);
     QBoxLayout *createContactInfo(const QPixmap &avatar, const PsiIcon *icon, const QString &text);
+    bool        merge(const QString &key, const PsiEvent::Ptr &event, const QString &text);
+    void        addEvent(const PsiEvent::Ptr &event, const QString &text);
 
 private slots:
     void popupDestroyed();
@@ -85,6 +133,10 @@ public:
     PsiIcon *               titleIcon;
     bool                    display;
     bool                    doAlertIcon;
+    QString                 burst;     // key in psiPopupBursts
+    int                     count = 1; // events shown by this popup
+    QString                 name;      // html of the contact name
+    QLabel *                textLabel = nullptr;
 };
 
 PsiPopup::Private::Private(PsiPopup *p) :
@@ -97,6 +149,10 @@ PsiPopup::Private::~Private()
 {
     if (psiPopupList)
         psiPopupList->removeAll(psiPopup);
+    if (psiPopupIds && psiPopupIds->value(id) == psiPopup)
+        psiPopupIds->remove(id);
+    if (psiPopupBursts && !burst.isEmpty() && psiPopupBursts->value(burst) == psiPopup)
+        psiPopupBursts->remove(burst);
 
     if (popup)
         delete popup;
@@ -112,8 +168,23 @@ void PsiPopup::Private::init(const PsiIcon *_titleIcon, const QString &titleText
     account = acc;
     display = true;
 
-    if (!psiPopupList)
-        psiPopupList = new QList<PsiPopup *>();
+    if (!psiPopupList) {
+        psiPopupList   = new QList<PsiPopup *>();
+        psiPopupIds    = new QHash<QString, PsiPopup *>();
+        psiPopupBursts = new QHash<QString, PsiPopup *>();
+    }
+
+    // a storm of events gets a summary instead of a window each, popup stays null then
+    if (burst != summaryKey && rateExceeded()) {
+        if (!merge(summaryKey, PsiEvent::Ptr(), QString())) {
+            PsiPopup *summary = new PsiPopup(psiPopup->parent());
+            summary->setDuration(psiPopup->duration());
+            summary->d->burst = summaryKey;
+            summary->popup(acc, PopupManager::AlertNone, Jid(), nullptr, tr("Notifications"), QPixmap(), nullptr,
+                           tr("%n more notification(s)", "", 1));
+        }
+        return;
+    }
 
     if (psiPopupList->count() >= MaxPopups && MaxPopups > 0)
         delete psiPopupList->first();
@@ -140,6 +211,34 @@ void PsiPopup::Private::init(const PsiIcon *_titleIcon, const QString &titleText
     id += titleText;
 }
 
+// adds an event to the shown popup with the key, if there is one
+bool PsiPopup::Private::merge(const QString &key, const PsiEvent::Ptr &event, const QString &text)
+{
+    PsiPopup *pp = key.isEmpty() || !psiPopupBursts ? nullptr : psiPopupBursts->value(key);
+    if (!pp || !pp->d->popup || !pp->d->popup->isVisible()) // a hidden one is about to be deleted
+        return false;
+    pp->d->addEvent(event, text);
+    return true;
+}
+
+void PsiPopup::Private::addEvent(const PsiEvent::Ptr &e, const QString &text)
+{
+    ++count;
+    if (e)
+        event = e;
+    if (textLabel) {
+        QString html;
+        if (burst == summaryKey)
+            html = tr("%n more notification(s)", "", count);
+        else
+            html = (text.isEmpty() ? "<font size=\"+1\">" + name + "</font>" : clipText(text)) + "<br><i>"
+                + tr("%n new message(s)", "", count) + "</i>";
+        textLabel->setText(QString("<qt>%1</qt>").arg(html));
+    }
+    // resizes, moves and restarts the hide timer
+    popup->show();
+}
+
 void PsiPopup::Private::popupDestroyed()
 {
     popup = nullptr;
@@ -151,7 +250,7 @@ void PsiPopup::Private::popupClicked(int button)
     if (button == int(Qt::LeftButton)) {
         if (event)
             psi->processEvent(event, UserAction);
-        else if (account) {
+        else if (account && !jid.isEmpty()) { // not for the summary
             // FIXME: it should work in most cases, but
             // maybe it's better to fix UserList::find()?
             Jid j(jid.bare());
@@ -195,6 +294,7 @@ QBoxLayout *PsiPopup::Private::createContactInfo(const QPixmap &avatar, const Ps
     textLabel->setText(QString("<qt>%1</qt>").arg(clipText(text)));
     textLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Maximum);
     dataBox->addWidget(textLabel);
+    this->textLabel = textLabel;
 
     return dataBox;
 }
@@ -210,7 +310,12 @@ PsiPopup::~PsiPopup() { delete d; }
 void PsiPopup::popup(PsiAccount *acc, PopupManager::PopupType type, const Jid &j, const Resource &r,
                      const UserListItem *item, const PsiEvent::Ptr &event)
 {
-    d->popupType  = type;
+    d->popupType = type;
+    d->burst     = burstKey(type, j);
+    if (d->merge(d->burst, event, QString())) {
+        deleteLater();
+        return;
+    }
     PsiIcon *icon = nullptr;
     QString  text = title(type, &d->doAlertIcon, &icon);
     d->init(icon, text, acc);
@@ -221,6 +326,12 @@ void PsiPopup::popup(PsiAccount *acc, PopupManager::PopupType type, const Jid &j
                      const QString &titleText, const QPixmap &avatar, const PsiIcon *icon, const QString &text)
 {
     d->popupType = type;
+    if (d->burst.isEmpty())
+        d->burst = burstKey(type, j);
+    if (d->burst != summaryKey && d->merge(d->burst, PsiEvent::Ptr(), text)) {
+        deleteLater();
+        return;
+    }
     d->init(titleIcon, titleText, acc);
     setJid(j);
     setData(avatar, icon, text);
@@ -290,12 +401,14 @@ void PsiPopup::setData(const Jid &j, const Resource &r, const UserListItem *u, c
             name = "<nobr>" + TextUtil::escape(name) + " &lt;" + TextUtil::escape(jid) + "&gt;" + "</nobr>";
     } else
         name = "<nobr>&lt;" + TextUtil::escape(jid) + "&gt;</nobr>";
+    d->name = name;
 
-    QString statusString = TextUtil::plain2rich(status);
+    int flags = 0;
     if (PsiOptions::instance()->getOption("options.ui.emoticons.use-emoticons").toBool())
-        statusString = TextUtil::emoticonify(statusString);
+        flags |= TextUtil::FormatEmoticons;
     if (PsiOptions::instance()->getOption("options.ui.chat.legacy-formatting").toBool())
-        statusString = TextUtil::legacyFormat(statusString);
+        flags |= TextUtil::FormatLegacy;
+    QString statusString = TextUtil::formatPlain(status, flags);
 
     if (!statusString.isEmpty())
         statusString = "<br>" + statusString;
@@ -385,18 +498,20 @@ void PsiPopup::show()
     }
 
     if (!d->id.isEmpty() /*&& LEGOPTS.ppNoDupes*/) {
-        for (PsiPopup *pp : qAsConst(*psiPopupList)) {
-            if (d->id == pp->id() && pp->popup()) {
-                pp->popup()->restartHideTimer();
+        PsiPopup *pp = psiPopupIds->value(d->id);
+        if (pp && pp->popup()) {
+            pp->popup()->restartHideTimer();
 
-                d->display = false;
-                break;
-            }
+            d->display = false;
         }
     }
 
     if (d->display) {
         psiPopupList->append(this);
+        if (!d->id.isEmpty())
+            psiPopupIds->insert(d->id, this);
+        if (!d->burst.isEmpty())
+            psiPopupBursts->insert(d->burst, this);
         d->popup->show();
     } else {
         deleteLater();
@@ -415,6 +530,10 @@ void PsiPopup::deleteAll()
     psiPopupList->clear();
     delete psiPopupList;
     psiPopupList = nullptr;
+    delete psiPopupIds;
+    psiPopupIds = nullptr;
+    delete psiPopupBursts;
+    psiPopupBursts = nullptr;
 }
 
 #include "psipopup.moc"
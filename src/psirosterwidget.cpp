@@ -34,10 +34,12 @@
 #include "widgets/actionlineedit.h"
 #include "widgets/iconaction.h"
 
+#include <QHash>
 #include <QKeyEvent>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QSet>
 #include <QSortFilterProxyModel>
 #include <QStackedWidget>
 #include <QVBoxLayout>
@@ -56,6 +58,9 @@ static const QString enableGroupsOptionPath       = "options.ui.contactlist.enab
 // PsiRosterFilterProxyModel
 //----------------------------------------------------------------------------
 
+// Keeps the searchable text of every row (name, jid and groups, case folded) together
+// with a trigram index over it, so a filter change touches only the candidate rows
+// instead of matching every contact again
 class PsiRosterFilterProxyModel : public QSortFilterProxyModel {
     Q_OBJECT
 public:
@@ -66,24 +71,71 @@ public:
         setSortLocaleAware(true);
     }
 
-protected:
     // reimplemented
-    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+    void setSourceModel(QAbstractItemModel *model)
     {
-        QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+        if (sourceModel())
+            disconnect(sourceModel(), nullptr, this, nullptr);
+
+        // connected before the base class so the index is up to date when it refilters
+        connect(model, &QAbstractItemModel::rowsInserted, this, &PsiRosterFilterProxyModel::indexRows);
+        connect(model, &QAbstractItemModel::rowsAboutToBeRemoved, this, &PsiRosterFilterProxyModel::unindexRows);
+        connect(model, &QAbstractItemModel::dataChanged, this, &PsiRosterFilterProxyModel::reindexRows);
+        connect(model, &QAbstractItemModel::modelAboutToBeReset, this, &PsiRosterFilterProxyModel::clearIndex);
+        connect(model, &QAbstractItemModel::modelReset, this, &PsiRosterFilterProxyModel::rebuildIndex);
+
+        clearIndex();
+        QSortFilterProxyModel::setSourceModel(model);
+        rebuildIndex();
+    }
 
-        QStringList data;
-        if (index.isValid()) {
-            // TODO: also check for vCard value
-            data << index.data(Qt::DisplayRole).toString() << index.data(ContactListModel::JidRole).toString();
-        }
+    void setFilterText(const QString &text)
+    {
+        const QString query = text.toCaseFolded();
+        if (query == query_)
+            return;
+
+        if (!query.isEmpty()) {
+            QList<ContactListItem *> candidates;
+            if (!query_.isEmpty() && query.contains(query_)) {
+                // the usual case of typing one more character, narrow the previous result
+                candidates = matches_.values();
+            } else if (query.length() >= 3) {
+                const QSet<ContactListItem *> *smallest = nullptr;
+                for (int i = 0; i + 3 <= query.length(); ++i) {
+                    auto it = trigrams_.constFind(trigram(query, i));
+                    if (it == trigrams_.constEnd()) {
+                        smallest = &emptySet_;
+                        break;
+                    }
+                    if (!smallest || it->size() < smallest->size())
+                        smallest = &(*it);
+                }
+                candidates = smallest->values();
+            } else {
+                candidates = texts_.keys();
+            }
 
-        for (const QString &str : qAsConst(data)) {
-            if (str.contains(filterRegExp()))
-                return true;
+            matches_.clear();
+            for (ContactListItem *item : qAsConst(candidates)) {
+                if (texts_.value(item).contains(query))
+                    matches_.insert(item);
+            }
         }
 
-        return false;
+        query_ = query;
+        invalidateFilter();
+    }
+
+protected:
+    // reimplemented
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+    {
+        if (query_.isEmpty())
+            return true;
+
+        QModelIndex index = sourceModel()->index(sourceRow, 0, sourceParent);
+        return matches_.contains(static_cast<ContactListItem *>(index.internalPointer()));
     }
 
     // reimplemented
@@ -95,6 +147,105 @@ protected:
             return false;
         return item1->lessThan(item2);
     }
+
+private slots:
+    void indexRows(const QModelIndex &parent, int first, int last)
+    {
+        for (int row = first; row <= last; ++row) {
+            QModelIndex index = sourceModel()->index(row, 0, parent);
+            indexItem(index);
+            if (sourceModel()->hasChildren(index))
+                indexRows(index, 0, sourceModel()->rowCount(index) - 1);
+        }
+    }
+
+    void unindexRows(const QModelIndex &parent, int first, int last)
+    {
+        for (int row = first; row <= last; ++row) {
+            QModelIndex index = sourceModel()->index(row, 0, parent);
+            if (sourceModel()->hasChildren(index))
+                unindexRows(index, 0, sourceModel()->rowCount(index) - 1);
+            unindexItem(static_cast<ContactListItem *>(index.internalPointer()));
+        }
+    }
+
+    void reindexRows(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+    {
+        for (int row = topLeft.row(); row <= bottomRight.row(); ++row)
+            indexItem(sourceModel()->index(row, 0, topLeft.parent()));
+    }
+
+    void clearIndex()
+    {
+        texts_.clear();
+        trigrams_.clear();
+        matches_.clear();
+    }
+
+    void rebuildIndex()
+    {
+        clearIndex();
+        if (sourceModel())
+            indexRows(QModelIndex(), 0, sourceModel()->rowCount() - 1);
+    }
+
+private:
+    static quint64 trigram(const QString &text, int pos)
+    {
+        return (quint64(text.at(pos).unicode()) << 32) | (quint64(text.at(pos + 1).unicode()) << 16)
+            | quint64(text.at(pos + 2).unicode());
+    }
+
+    void indexItem(const QModelIndex &index)
+    {
+        ContactListItem *item = static_cast<ContactListItem *>(index.internalPointer());
+        if (!item)
+            return;
+
+        // TODO: also check for vCard value
+        QStringList fields;
+        fields << index.data(Qt::DisplayRole).toString() << index.data(ContactListModel::JidRole).toString();
+        if (item->isContact() && item->contact())
+            fields += item->contact()->groups();
+        // fields are newline separated, so a query never matches across them
+        const QString text = fields.join('\n').toCaseFolded();
+
+        auto it = texts_.constFind(item);
+        if (it != texts_.constEnd() && *it == text)
+            return;
+
+        unindexItem(item);
+        texts_.insert(item, text);
+        for (int i = 0; i + 3 <= text.length(); ++i)
+            trigrams_[trigram(text, i)].insert(item);
+        if (!query_.isEmpty() && text.contains(query_))
+            matches_.insert(item);
+    }
+
+    void unindexItem(ContactListItem *item)
+    {
+        auto it = texts_.find(item);
+        if (it == texts_.end())
+            return;
+
+        const QString &text = *it;
+        for (int i = 0; i + 3 <= text.length(); ++i) {
+            auto t = trigrams_.find(trigram(text, i));
+            if (t != trigrams_.end()) {
+                t->remove(item);
+                if (t->isEmpty())
+                    trigrams_.erase(t);
+            }
+        }
+        texts_.erase(it);
+        matches_.remove(item);
+    }
+
+    QString                                 query_; // case folded filter text
+    QHash<ContactListItem *, QString>       texts_;
+    QHash<quint64, QSet<ContactListItem *>> trigrams_;
+    QSet<ContactListItem *>                 matches_; // rows matching query_
+    const QSet<ContactListItem *>           emptySet_;
 };
 
 //----------------------------------------------------------------------------
@@ -238,7 +389,7 @@ void PsiRosterWidget::setShowStatusMsg(bool enabled)
 void PsiRosterWidget::filterEditTextChanged(const QString &text)
 {
     if (filterModel_)
-        filterModel_->setFilterRegExp(QRegExp::escape(text));
+        static_cast<PsiRosterFilterProxyModel *>(filterModel_)->setFilterText(text);
 }
 
 void PsiRosterWidget::quitFilteringMode() { setFilterModeEnabled(false); }
@@ -19,24 +19,56 @@
 
 #include "psithememodel.h"
 
+#include "applicationinfo.h"
 #include "psiiconset.h"
 #include "psithememanager.h"
 #include "textutil.h"
 
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
 #include <QIcon>
+#include <QImage>
 #include <QPixmap>
+#include <QSaveFile>
 #include <QtConcurrentMap>
 
+// themes listed before are not loaded again, until they change on disk
+static const quint32 THEME_INFO_CACHE_MAGIC   = 0x50535449; // "PSTI"
+static const quint32 THEME_INFO_CACHE_VERSION = 1;
+
 class PsiThemeModel;
 
+static QDataStream &operator<<(QDataStream &out, const ThemeItemInfo &ti)
+{
+    return out << ti.id << ti.title << ti.version << ti.description << ti.authors << ti.creation << ti.homeUrl
+               << ti.previewFile << ti.stamp << ti.hasPreview;
+}
+
+static QDataStream &operator>>(QDataStream &in, ThemeItemInfo &ti)
+{
+    in >> ti.id >> ti.title >> ti.version >> ti.description >> ti.authors >> ti.creation >> ti.homeUrl
+        >> ti.previewFile >> ti.stamp >> ti.hasPreview;
+    ti.isValid = true;
+    return in;
+}
+
 struct PsiThemeModel::Loader {
-    Loader(PsiThemeProvider *provider_) : provider(provider_) { }
+    Loader(PsiThemeProvider *provider_, const QHash<QString, ThemeItemInfo> &cached_, const QString &cacheDir_) :
+        provider(provider_), cached(cached_), cacheDir(cacheDir_)
+    {
+    }
 
     typedef ThemeItemInfo result_type;
 
     ThemeItemInfo operator()(const QString &id)
     {
         ThemeItemInfo ti;
+        if (restore(id, ti)) {
+            return ti;
+        }
         ti.id       = id;
         Theme theme = provider->theme(id);
         if (theme.load()) {
@@ -66,6 +98,67 @@ struct PsiThemeModel::Loader {
         }
     }
 
+    // the newest modification time of the theme files
+    static qint64 themeStamp(const QString &filePath)
+    {
+        QFileInfo fi(filePath);
+        qint64    stamp = fi.lastModified().toMSecsSinceEpoch();
+        if (fi.isDir()) {
+            QDirIterator it(filePath, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden,
+                            QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                it.next();
+                stamp = qMax(stamp, it.fileInfo().lastModified().toMSecsSinceEpoch());
+            }
+        }
+        return stamp;
+    }
+
+    // takes the info from the cache if the theme didn't change since it was listed
+    bool restore(const QString &id, ThemeItemInfo &ti) const
+    {
+        auto it = cached.constFind(id);
+        if (it == cached.constEnd()) {
+            return false;
+        }
+        Theme theme = provider->theme(id);
+        if (!theme.exists() || themeStamp(theme.filePath()) != it->stamp
+            || (it->hasPreview && !QFile::exists(it->previewFile))) {
+            return false;
+        }
+        ti           = it.value();
+        ti.isCurrent = provider->current().id() == ti.id;
+        return true;
+    }
+
+    // themes with a preview ship a screenshot.png, it's scaled down once and kept in the cache dir
+    QString savePreview(const Theme &theme, const ThemeItemInfo &ti) const
+    {
+        const QByteArray key
+            = (ti.id + QLatin1Char('\n') + ti.version + QLatin1Char('\n') + QString::number(ti.stamp)).toUtf8();
+        const QString fileName = cacheDir + QLatin1Char('/')
+            + QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".png");
+        if (QFile::exists(fileName)) {
+            return fileName;
+        }
+
+        QImage img = QImage::fromData(theme.loadData(QLatin1String("screenshot.png")));
+        if (img.isNull()) {
+            return QString();
+        }
+        const int width = provider->screenshotWidth();
+        if (width > 0 && img.width() > width) {
+            img = img.scaledToWidth(width, Qt::SmoothTransformation);
+        }
+        QDir().mkpath(cacheDir);
+        QSaveFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly) || !img.save(&f, "PNG") || !f.commit()) {
+            return QString();
+        }
+        return fileName;
+    }
+
     void fillThemeInfo(ThemeItemInfo &ti, const Theme &theme) const
     {
         ti.id          = theme.id();
@@ -76,12 +169,19 @@ struct PsiThemeModel::Loader {
         ti.creation    = theme.creation();
         ti.homeUrl     = theme.homeUrl();
 
+        ti.stamp      = themeStamp(theme.filePath());
         ti.hasPreview = theme.hasPreview();
-        ti.isValid    = true;
-        ti.isCurrent  = provider->current().id() == ti.id;
+        if (ti.hasPreview) {
+            ti.previewFile = savePreview(theme, ti);
+            ti.hasPreview  = !ti.previewFile.isEmpty();
+        }
+        ti.isValid   = true;
+        ti.isCurrent = provider->current().id() == ti.id;
     }
 
-    PsiThemeProvider *provider;
+    PsiThemeProvider *            provider;
+    QHash<QString, ThemeItemInfo> cached; // a copy, the model's one is updated while loader threads read this
+    QString                       cacheDir;
 };
 
 //------------------------------------------------------------------------------
@@ -95,24 +195,85 @@ PsiThemeModel::PsiThemeModel(PsiThemeProvider *provider, QObject *parent) :
     connect(&themeWatcher, SIGNAL(finished()), SLOT(loadComplete()));
 }
 
-PsiThemeModel::~PsiThemeModel() { delete loader; }
+PsiThemeModel::~PsiThemeModel()
+{
+    saveInfoCache();
+    delete loader;
+}
 
-void PsiThemeModel::onThreadedResultReadyAt(int index)
+void PsiThemeModel::addTheme(const ThemeItemInfo &ti)
 {
-    ThemeItemInfo ti = themeWatcher.resultAt(index);
-    if (ti.isValid) {
-        beginInsertRows(QModelIndex(), themesInfo.size(), themesInfo.size());
-        themesInfo.append(ti);
-        endInsertRows();
+    if (!ti.isValid) {
+        return;
     }
+    auto it = infoCache.constFind(ti.id);
+    if (it == infoCache.constEnd() || it->stamp != ti.stamp || it->previewFile != ti.previewFile) {
+        infoCache.insert(ti.id, ti);
+        infoCacheChanged = true;
+    }
+    beginInsertRows(QModelIndex(), themesInfo.size(), themesInfo.size());
+    themesInfo.append(ti);
+    endInsertRows();
+}
+
+QString PsiThemeModel::cacheDir() const
+{
+    return ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + QLatin1String("/themes/")
+        + QLatin1String(provider->type());
 }
 
-void PsiThemeModel::loadComplete() { qDebug("Themes loading finished"); }
+void PsiThemeModel::loadInfoCache()
+{
+    QFile f(cacheDir() + QLatin1String(".cache"));
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QDataStream                   in(&f);
+    quint32                       magic, version;
+    QString                       appVersion;
+    QHash<QString, ThemeItemInfo> cached;
+    in >> magic >> version >> appVersion;
+    if (in.status() != QDataStream::Ok || magic != THEME_INFO_CACHE_MAGIC || version != THEME_INFO_CACHE_VERSION
+        || appVersion != ApplicationInfo::version()) {
+        return;
+    }
+    in >> cached;
+    if (in.status() == QDataStream::Ok) {
+        infoCache = cached;
+    }
+}
+
+void PsiThemeModel::saveInfoCache()
+{
+    if (!infoCacheChanged) {
+        return;
+    }
+    const QString fileName = cacheDir() + QLatin1String(".cache");
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream out(&f);
+    out << THEME_INFO_CACHE_MAGIC << THEME_INFO_CACHE_VERSION << ApplicationInfo::version() << infoCache;
+    if (out.status() == QDataStream::Ok && f.commit()) {
+        infoCacheChanged = false;
+    }
+}
+
+void PsiThemeModel::onThreadedResultReadyAt(int index) { addTheme(themeWatcher.resultAt(index)); }
+
+void PsiThemeModel::loadComplete()
+{
+    qDebug("Themes loading finished");
+    saveInfoCache();
+}
 
 void PsiThemeModel::load()
 {
     Q_ASSERT(!loader);
-    loader = new Loader(provider);
+    loadInfoCache();
+    loader = new Loader(provider, infoCache, cacheDir());
     if (provider->threadedLoading()) {
         themesFuture = QtConcurrent::mapped(provider->themeIds(), *loader);
         themeWatcher.setFuture(themesFuture);
@@ -120,13 +281,13 @@ void PsiThemeModel::load()
         QStringList ids = provider->themeIds();
         qDebug() << ids;
         for (const QString &id : ids) {
-            loader->asyncLoad(id, [this](const ThemeItemInfo &ti) {
-                if (ti.isValid) {
-                    beginInsertRows(QModelIndex(), themesInfo.size(), themesInfo.size());
-                    themesInfo.append(ti);
-                    endInsertRows();
-                }
-            });
+            // the cached ones don't need even the asynchronous loading
+            ThemeItemInfo ti;
+            if (loader->restore(id, ti)) {
+                addTheme(ti);
+                continue;
+            }
+            loader->asyncLoad(id, [this](const ThemeItemInfo &ti) { addTheme(ti); });
         }
     }
 }
@@ -181,6 +342,10 @@ QVariant PsiThemeModel::data(const QModelIndex &index, int role) const
     case HasPreviewRole: {
         return themesInfo[index.row()].hasPreview;
     }
+    case PreviewRole: {
+        const ThemeItemInfo &ti = themesInfo[index.row()];
+        return ti.hasPreview ? QPixmap(ti.previewFile) : QPixmap();
+    }
     case IsCurrent:
         return themesInfo[index.row()].isCurrent;
     }
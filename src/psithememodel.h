@@ -22,6 +22,7 @@
 
 #include <QAbstractListModel>
 #include <QFutureWatcher>
+#include <QHash>
 #include <QStringList>
 
 class PsiThemeProvider;
@@ -35,17 +36,19 @@ struct ThemeItemInfo {
     QStringList authors;
     QString     creation;
     QString     homeUrl;
+    QString     previewFile; // scaled down screenshot in the cache dir
+    qint64      stamp = 0;   // newest modification time of the theme files
 
-    bool hasPreview;
-    bool isValid   = false;
-    bool isCurrent = false;
+    bool hasPreview = false;
+    bool isValid    = false;
+    bool isCurrent  = false;
 };
 
 class PsiThemeModel : public QAbstractListModel {
     Q_OBJECT
 
 public:
-    enum ThemeRoles { IdRole = Qt::UserRole + 1, HasPreviewRole, TitleRole, IsCurrent };
+    enum ThemeRoles { IdRole = Qt::UserRole + 1, HasPreviewRole, TitleRole, IsCurrent, PreviewRole };
 
     PsiThemeModel(PsiThemeProvider *provider, QObject *parent);
     ~PsiThemeModel();
@@ -64,12 +67,19 @@ private slots:
     void loadComplete();
 
 private:
+    void    addTheme(const ThemeItemInfo &ti);
+    QString cacheDir() const;
+    void    loadInfoCache();
+    void    saveInfoCache();
+
     struct Loader;
     Loader *                      loader   = nullptr;
     PsiThemeProvider *            provider = nullptr;
     QFutureWatcher<ThemeItemInfo> themeWatcher;
     QFuture<ThemeItemInfo>        themesFuture;
     QList<ThemeItemInfo>          themesInfo;
+    QHash<QString, ThemeItemInfo> infoCache; // id => info of themes loaded before
+    bool                          infoCacheChanged = false;
 };
 
 #endif // PSITHEMEMODEL_H
@@ -0,0 +1,153 @@
+/*
+ * receiptscheduler.cpp - coalesces delivery receipts and chat markers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "receiptscheduler.h"
+
+#include "psiaccount.h"
+#include "xmpp_client.h"
+#include "xmpp_message.h"
+#include "xmpp_task.h"
+
+#include <QDomElement>
+#include <QTimer>
+
+#define CHAT_MARKERS_NS "urn:xmpp:chat-markers:0"
+// quiet time before the queued receipts go out, milliseconds
+#define RECEIPT_DELAY 500
+// longest a receipt waits during a steady stream of messages, milliseconds
+#define RECEIPT_MAX_DELAY 2000
+
+using namespace XMPP;
+
+// notes the latest markable message of each contact, the messages themselves are left to the client
+class ChatMarkerTask : public Task {
+public:
+    ChatMarkerTask(Task *parent) : Task(parent) { }
+
+    bool take(const QDomElement &e)
+    {
+        if (e.tagName() != "message" || e.attribute("id").isEmpty() || e.attribute("type") == "groupchat")
+            return false;
+        QDomElement markable = e.firstChildElement("markable");
+        if (!markable.isNull() && markable.namespaceURI() == CHAT_MARKERS_NS) {
+            const Jid from(e.attribute("from"));
+            latest_.insert(from.bare(), { from, e.attribute("id") });
+        }
+        return false;
+    }
+
+    bool takeLatest(const Jid &jid, Jid *from, QString *id)
+    {
+        auto it = latest_.find(jid.bare());
+        if (it == latest_.end())
+            return false;
+        *from = it.value().first;
+        *id   = it.value().second;
+        latest_.erase(it);
+        return true;
+    }
+
+    void clear() { latest_.clear(); }
+
+    void sendDisplayed(const Jid &to, const QString &id)
+    {
+        QDomElement m = doc()->createElement("message");
+        m.setAttribute("to", to.full());
+        m.setAttribute("type", "chat");
+        m.setAttribute("id", client()->genUniqueId());
+        QDomElement displayed = doc()->createElementNS(CHAT_MARKERS_NS, "displayed");
+        displayed.setAttribute("id", id);
+        m.appendChild(displayed);
+        // the other clients of the contact learn it from the archive
+        m.appendChild(doc()->createElementNS("urn:xmpp:hints", "store"));
+        send(m);
+    }
+
+private:
+    QHash<QString, QPair<Jid, QString>> latest_; // bare jid -> sender and message id
+};
+
+ReceiptScheduler::ReceiptScheduler(PsiAccount *account) : QObject(account), account_(account)
+{
+    timer_ = new QTimer(this);
+    timer_->setSingleShot(true);
+    connect(timer_, &QTimer::timeout, this, &ReceiptScheduler::flush);
+
+    task_ = new ChatMarkerTask(account_->client()->rootTask());
+}
+
+ReceiptScheduler::~ReceiptScheduler() { delete task_; }
+
+void ReceiptScheduler::receipt(const Jid &to, const QString &id)
+{
+    receipts_ += Ack { to, id };
+    schedule();
+}
+
+void ReceiptScheduler::displayed(const Jid &jid)
+{
+    Ack marker;
+    if (!task_ || !task_->takeLatest(jid, &marker.to, &marker.id))
+        return;
+    // an earlier marker of the conversation is covered by this one
+    markers_.insert(jid.bare(), marker);
+    schedule();
+}
+
+void ReceiptScheduler::clear()
+{
+    timer_->stop();
+    receipts_.clear();
+    markers_.clear();
+    if (task_)
+        task_->clear();
+}
+
+void ReceiptScheduler::schedule()
+{
+    if (!timer_->isActive())
+        firstQueued_.start();
+    else if (firstQueued_.elapsed() >= RECEIPT_MAX_DELAY)
+        return;
+    timer_->start(qMin<qint64>(RECEIPT_DELAY, qMax<qint64>(0, RECEIPT_MAX_DELAY - firstQueued_.elapsed())));
+}
+
+void ReceiptScheduler::flush()
+{
+    if (!account_->isAvailable()) {
+        clear();
+        return;
+    }
+
+    // written in one go, stream management acks them together
+    const QList<Ack> receipts = receipts_;
+    receipts_.clear();
+    for (const Ack &r : receipts) {
+        Message m(r.to);
+        m.setMessageReceiptId(r.id);
+        m.setMessageReceipt(ReceiptReceived);
+        account_->dj_sendMessage(m, false);
+    }
+
+    const QHash<QString, Ack> markers = markers_;
+    markers_.clear();
+    if (task_)
+        for (const Ack &marker : markers)
+            task_->sendDisplayed(marker.to, marker.id);
+}
@@ -0,0 +1,68 @@
+/*
+ * receiptscheduler.h - coalesces delivery receipts and chat markers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RECEIPTSCHEDULER_H
+#define RECEIPTSCHEDULER_H
+
+#include "xmpp_jid.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+
+class ChatMarkerTask;
+class PsiAccount;
+class QTimer;
+
+// Holds back XEP-0184 receipts and XEP-0333 displayed markers for a moment and sends them
+// all in one pass, so a catch-up burst doesn't turn into as many single writes and stream
+// management acks. Only the latest displayed marker of a conversation is sent
+class ReceiptScheduler : public QObject {
+    Q_OBJECT
+public:
+    ReceiptScheduler(PsiAccount *account);
+    ~ReceiptScheduler();
+
+    // receipt for the message id from to
+    void receipt(const XMPP::Jid &to, const QString &id);
+    // the messages of jid were seen, marks the latest markable one
+    void displayed(const XMPP::Jid &jid);
+    // nothing queued is sent, e.g. after a disconnect
+    void clear();
+
+private:
+    struct Ack {
+        XMPP::Jid to;
+        QString   id;
+    };
+
+    void schedule();
+    void flush();
+
+    PsiAccount *             account_;
+    QPointer<ChatMarkerTask> task_;
+    QTimer *                 timer_;
+    QElapsedTimer            firstQueued_;
+    QList<Ack>               receipts_;
+    QHash<QString, Ack>      markers_; // bare jid -> displayed marker to send
+};
+
+#endif // RECEIPTSCHEDULER_H
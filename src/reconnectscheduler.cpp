@@ -0,0 +1,165 @@
+/*
+ * reconnectscheduler.cpp - reconnects of all accounts, spread over time and servers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "reconnectscheduler.h"
+
+#include "psiaccount.h"
+#include "psioptions.h"
+
+#include <QNetworkConfigurationManager>
+#include <QRandomGenerator>
+
+#include <algorithm>
+#include <limits>
+
+// backoff of a server without failed attempts, milliseconds. doubled with each failure
+#define RECONNECT_BASE_DELAY 1000
+// the longest backoff, milliseconds
+#define RECONNECT_MAX_DELAY (2 * 60 * 1000)
+// a login that didn't end by then gives its slot to the next one, milliseconds
+#define RECONNECT_SLOT_TIMEOUT 60000
+
+static const QString maxParallelOptionPath = "options.account.max-parallel-logins";
+
+ReconnectScheduler::ReconnectScheduler(QObject *parent) :
+    QObject(parent), network_(new QNetworkConfigurationManager(this))
+{
+    clock_.start();
+    timer_.setSingleShot(true);
+    connect(&timer_, &QTimer::timeout, this, &ReconnectScheduler::startDue);
+    connect(network_, &QNetworkConfigurationManager::onlineStateChanged, this,
+            &ReconnectScheduler::onlineStateChanged);
+    connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, &ReconnectScheduler::optionChanged);
+    optionChanged(maxParallelOptionPath);
+}
+
+ReconnectScheduler::~ReconnectScheduler() { }
+
+void ReconnectScheduler::optionChanged(const QString &option)
+{
+    if (option == maxParallelOptionPath) {
+        maxParallel_ = qMax(0, PsiOptions::instance()->getOption(option).toInt());
+        startDue();
+    }
+}
+
+bool ReconnectScheduler::isOnline() const
+{
+    // without any known configuration there is no telling, so assume a network
+    return network_->isOnline() || network_->allConfigurations().isEmpty();
+}
+
+int ReconnectScheduler::schedule(PsiAccount *acc, const QString &server, const std::function<void()> &login)
+{
+    // a login still running has just failed
+    if (running_.contains(acc)) {
+        int &failures = failures_[server];
+        failures      = qMin(failures + 1, 8);
+    }
+    cancel(acc);
+
+    // half of the backoff is fixed, the other half random
+    const int backoff = int(qMin<qint64>(qint64(RECONNECT_BASE_DELAY) << failures_.value(server), RECONNECT_MAX_DELAY));
+    const int delay   = backoff / 2 + QRandomGenerator::global()->bounded(backoff / 2 + 1);
+
+    Pending p { acc, server, clock_.elapsed() + delay, login };
+    auto    it = std::upper_bound(queue_.begin(), queue_.end(), p.due,
+                               [](qint64 due, const Pending &other) { return due < other.due; });
+    queue_.insert(it, p);
+    restartTimer();
+    return delay;
+}
+
+void ReconnectScheduler::loggedIn(PsiAccount *acc)
+{
+    if (running_.contains(acc))
+        failures_.remove(running_.value(acc).server);
+    cancel(acc);
+}
+
+void ReconnectScheduler::cancel(PsiAccount *acc)
+{
+    queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                [acc](const Pending &p) { return !p.acc || p.acc == acc; }),
+                 queue_.end());
+    release(acc);
+}
+
+void ReconnectScheduler::release(PsiAccount *acc)
+{
+    if (running_.remove(acc))
+        startDue();
+    else
+        restartTimer();
+}
+
+void ReconnectScheduler::onlineStateChanged(bool online)
+{
+    if (online) {
+        // whatever failed while the network was gone says nothing about the servers,
+        // everyone waiting goes now, a little apart
+        failures_.clear();
+        const qint64 now = clock_.elapsed();
+        for (Pending &p : queue_)
+            p.due = now + QRandomGenerator::global()->bounded(RECONNECT_BASE_DELAY);
+        std::sort(queue_.begin(), queue_.end(), [](const Pending &a, const Pending &b) { return a.due < b.due; });
+        startDue();
+    } else {
+        restartTimer();
+    }
+}
+
+void ReconnectScheduler::startDue()
+{
+    const qint64 now = clock_.elapsed();
+    for (auto it = running_.begin(); it != running_.end();) {
+        if (now - it->started >= RECONNECT_SLOT_TIMEOUT)
+            it = running_.erase(it);
+        else
+            ++it;
+    }
+
+    if (isOnline()) {
+        while (!queue_.isEmpty() && queue_.first().due <= now && (!maxParallel_ || running_.size() < maxParallel_)) {
+            Pending p = queue_.takeFirst();
+            if (!p.acc)
+                continue;
+            running_.insert(p.acc, Running { p.server, now });
+            p.login();
+        }
+    }
+    restartTimer();
+}
+
+void ReconnectScheduler::restartTimer()
+{
+    if (queue_.isEmpty() || !isOnline()) {
+        timer_.stop();
+        return;
+    }
+
+    // the first one due, or with all slots taken the first slot to time out
+    qint64 next = queue_.first().due;
+    if (maxParallel_ && running_.size() >= maxParallel_) {
+        next = std::numeric_limits<qint64>::max();
+        for (const Running &r : qAsConst(running_))
+            next = qMin(next, r.started + RECONNECT_SLOT_TIMEOUT);
+    }
+    timer_.start(int(qMax<qint64>(0, next - clock_.elapsed())));
+}
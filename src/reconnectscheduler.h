@@ -0,0 +1,85 @@
+/*
+ * reconnectscheduler.h - reconnects of all accounts, spread over time and servers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RECONNECTSCHEDULER_H
+#define RECONNECTSCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+
+#include <functional>
+
+class PsiAccount;
+class QNetworkConfigurationManager;
+
+// Decides when the accounts that lost their connection log in again. Each server backs off exponentially
+// (with jitter) on its own, nothing is tried while the network is down and everything waiting is tried as soon
+// as it is back, and only a few logins run their handshakes at the same time.
+class ReconnectScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ReconnectScheduler(QObject *parent = nullptr);
+    ~ReconnectScheduler();
+
+    // login is called when the turn of acc comes, replacing what acc had scheduled before.
+    // returns the backoff in milliseconds, the network and the other logins may add to it
+    int schedule(PsiAccount *acc, const QString &server, const std::function<void()> &login);
+    // acc is logged in, its slot is free and its server starts over with short delays
+    void loggedIn(PsiAccount *acc);
+    // acc doesn't reconnect (anymore), its slot is free
+    void cancel(PsiAccount *acc);
+
+    bool isOnline() const;
+
+private slots:
+    void optionChanged(const QString &option);
+    void onlineStateChanged(bool online);
+    void startDue();
+
+private:
+    struct Pending {
+        QPointer<PsiAccount>  acc;
+        QString               server;
+        qint64                due; // msecs of clock_
+        std::function<void()> login;
+    };
+
+    struct Running {
+        QString server;
+        qint64  started;
+    };
+
+    void release(PsiAccount *acc);
+    void restartTimer();
+
+    QList<Pending>                 queue_;    // sorted by due
+    QHash<PsiAccount *, Running>   running_;  // logins between their start and their end
+    QHash<QString, int>            failures_; // attempts failed in a row, per server
+    QNetworkConfigurationManager * network_;
+    QElapsedTimer                  clock_;
+    QTimer                         timer_;
+    int                            maxParallel_ = 0; // 0 - no limit
+};
+
+#endif // RECONNECTSCHEDULER_H
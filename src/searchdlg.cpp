@@ -29,13 +29,29 @@
 #include "xmpp_xdata.h"
 #include "xmpp_xmlcommon.h"
 
+#include <QAbstractTableModel>
 #include <QDomElement>
+#include <QHeaderView>
 #include <QLineEdit>
 #include <QMessageBox>
 #include <QPointer>
+#include <QSortFilterProxyModel>
+#include <QStyle>
+#include <QTimer>
 
 using namespace XMPP;
 
+#define RSM_NS "http://jabber.org/protocol/rsm"
+
+// results requested per page from services with result set management
+#define SEARCH_PAGE_SIZE 500
+// report items turned into rows per event loop turn
+#define SEARCH_PARSE_CHUNK 200
+// rows measured for the initial column widths
+#define SEARCH_SIZE_SAMPLE 100
+// widest a column gets sized to
+#define SEARCH_MAX_COLUMN_WIDTH 300
+
 //----------------------------------------------------------------------------
 // JT_XSearch
 //----------------------------------------------------------------------------
@@ -45,7 +61,7 @@ class JT_XSearch : public JT_Search {
 public:
     JT_XSearch(Task *parent);
 
-    void setForm(const Form &frm, const XData &_form);
+    void setForm(const Form &frm, const XData &_form, int max = 0, const QString &after = QString());
 
     bool        take(const QDomElement &);
     QDomElement iq() const;
@@ -67,7 +83,7 @@ bool JT_XSearch::take(const QDomElement &x)
 
 QDomElement JT_XSearch::iq() const { return _iq; }
 
-void JT_XSearch::setForm(const Form &frm, const XData &_form)
+void JT_XSearch::setForm(const Form &frm, const XData &_form, int max, const QString &after)
 {
     JT_Search::set(frm);
 
@@ -78,6 +94,15 @@ void JT_XSearch::setForm(const Form &frm, const XData &_form)
     XData form(_form);
     form.setType(XData::Data_Submit);
     query.appendChild(form.toXml(doc()));
+
+    // XEP-0059 result set management
+    if (max > 0) {
+        QDomElement set = doc()->createElementNS(RSM_NS, "set");
+        set.appendChild(textTag(doc(), "max", QString::number(max)));
+        if (!after.isEmpty())
+            set.appendChild(textTag(doc(), "after", after));
+        query.appendChild(set);
+    }
 }
 
 void JT_XSearch::onGo()
@@ -88,6 +113,73 @@ void JT_XSearch::onGo()
         JT_Search::onGo();
 }
 
+//----------------------------------------------------------------------------
+// SearchResultModel
+//----------------------------------------------------------------------------
+
+class SearchResultModel : public QAbstractTableModel {
+public:
+    SearchResultModel(QObject *parent) : QAbstractTableModel(parent) { }
+
+    // names are the report field vars, labels go into the header
+    void setColumns(const QStringList &names, const QStringList &labels)
+    {
+        beginResetModel();
+        names_  = names;
+        labels_ = labels;
+        rows_.clear();
+        endResetModel();
+    }
+
+    void append(const QVector<QStringList> &rows)
+    {
+        if (rows.isEmpty())
+            return;
+        beginInsertRows(QModelIndex(), rows_.size(), rows_.size() + rows.size() - 1);
+        rows_ += rows;
+        endInsertRows();
+    }
+
+    void clear()
+    {
+        beginResetModel();
+        rows_.clear();
+        endResetModel();
+    }
+
+    int     column(const QString &name) const { return names_.indexOf(name); }
+    QString text(int row, int column) const { return rows_[row].value(column); }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : rows_.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : names_.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override
+    {
+        if (!index.isValid() || role != Qt::DisplayRole)
+            return QVariant();
+        return text(index.row(), index.column());
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override
+    {
+        if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+            return QVariant();
+        return labels_.value(section);
+    }
+
+private:
+    QStringList          names_;
+    QStringList          labels_;
+    QVector<QStringList> rows_;
+};
+
 //----------------------------------------------------------------------------
 // SearchDlg
 //----------------------------------------------------------------------------
@@ -104,38 +196,50 @@ public:
     {
         QList<NickAndJid> result;
 
-        int jid;
-        int nick;
-        if (!xdata) {
-            jid  = 4;
-            nick = 0;
-        } else {
-            jid  = 0;
-            nick = 0;
-
-            int         i       = 0;
-            const auto &reports = xdata_form.report();
-            for (const auto &report : reports) {
-                QString name = report.name;
-                if (name == "jid")
-                    jid = i;
-
-                if (name == "nickname" || name == "nick" || name == "title")
-                    nick = i;
+        int jid  = qMax(0, model->column("jid"));
+        int nick = 0;
+        for (const char *name : { "nickname", "nick", "title" }) {
+            if (model->column(name) != -1) {
+                nick = model->column(name);
+                break;
             }
         }
 
-        const auto &items = dlg->lv_results->selectedItems();
-        for (QTreeWidgetItem *i : items) {
+        const auto &rows = dlg->lv_results->selectionModel()->selectedRows();
+        for (const QModelIndex &index : rows) {
+            int        row = proxy->mapToSource(index).row();
             NickAndJid nickJid;
-            nickJid.jid  = XMPP::Jid(i->text(jid));
-            nickJid.nick = i->text(nick);
+            nickJid.jid  = XMPP::Jid(model->text(row, jid));
+            nickJid.nick = model->text(row, nick);
             result << nickJid;
         }
 
         return result;
     }
 
+    void setLegacyColumns()
+    {
+        model->setColumns({ "nick", "first", "last", "email", "jid" },
+                          { SearchDlg::tr("Nickname"), SearchDlg::tr("First Name"), SearchDlg::tr("Last Name"),
+                            SearchDlg::tr("E-Mail Address"), SearchDlg::tr("XMPP Address") });
+    }
+
+    // measuring every row is what used to stall the dialog, the first few are a good enough guess
+    void sizeColumns()
+    {
+        QTreeView *  view    = dlg->lv_results;
+        QFontMetrics fm(view->font());
+        const int    margin  = (view->style()->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, view) + 1) * 2;
+        const int    samples = qMin(model->rowCount(), SEARCH_SIZE_SAMPLE);
+        for (int c = 0; c < model->columnCount(); ++c) {
+            int w = view->header()->sectionSizeHint(c);
+            for (int r = 0; r < samples; ++r)
+                w = qMax(w, fm.horizontalAdvance(model->text(r, c)) + margin);
+            view->setColumnWidth(c, qMin(w, SEARCH_MAX_COLUMN_WIDTH));
+        }
+        sized = true;
+    }
+
     SearchDlg *          dlg;
     PsiAccount *         pa = nullptr;
     Jid                  jid;
@@ -149,8 +253,19 @@ public:
     QList<QLabel *>    lb_field;
     QList<QLineEdit *> le_field;
     XDataWidget *      xdata = nullptr;
-    XData              xdata_form;
     QScrollArea *      scrollArea = nullptr;
+
+    SearchResultModel *    model = nullptr;
+    QSortFilterProxyModel *proxy = nullptr;
+    bool                   sized = false; // columns fitted to the first rows
+
+    // the form submitted, again for every further page
+    XData       submitted;
+    bool        rsm = true; // false once the service refused a paged query
+    QString     after;      // uid of the last item of the previous page
+    int         pageRows = 0;
+    int         total    = -1; // result count the service announced
+    QDomElement pendingItem;   // next report item of the current page to turn into a row
 };
 
 SearchDlg::SearchDlg(const Jid &jid, PsiAccount *pa) : QDialog(nullptr)
@@ -183,8 +298,16 @@ SearchDlg::SearchDlg(const Jid &jid, PsiAccount *pa) : QDialog(nullptr)
     pb_stop->setEnabled(false);
     pb_search->setEnabled(false);
 
-    connect(lv_results, SIGNAL(itemSelectionChanged()), SLOT(selectionChanged()));
-    connect(lv_results, SIGNAL(itemActivated(QTreeWidgetItem *, int)), SLOT(itemActivated(QTreeWidgetItem *, int)));
+    d->model = new SearchResultModel(this);
+    d->proxy = new QSortFilterProxyModel(this);
+    d->proxy->setSourceModel(d->model);
+    d->setLegacyColumns();
+    lv_results->setModel(d->proxy);
+    lv_results->sortByColumn(0, Qt::AscendingOrder);
+
+    connect(lv_results->selectionModel(), SIGNAL(selectionChanged(QItemSelection, QItemSelection)),
+            SLOT(selectionChanged()));
+    connect(lv_results, SIGNAL(activated(QModelIndex)), SLOT(itemActivated(QModelIndex)));
     connect(pb_close, SIGNAL(clicked()), SLOT(close()));
     connect(pb_search, SIGNAL(clicked()), SLOT(doSearchSet()));
     connect(pb_stop, SIGNAL(clicked()), SLOT(doStop()));
@@ -226,17 +349,6 @@ SearchDlg::~SearchDlg()
     }
 }*/
 
-void SearchDlg::addEntry(const QString &jid, const QString &nick, const QString &first, const QString &last,
-                         const QString &email)
-{
-    QTreeWidgetItem *lvi = new QTreeWidgetItem(lv_results);
-    lvi->setText(0, nick);
-    lvi->setText(1, first);
-    lvi->setText(2, last);
-    lvi->setText(3, email);
-    lvi->setText(4, jid);
-}
-
 void SearchDlg::doSearchGet()
 {
     lb_instructions->setText(tr("<qt>Fetching search form for %1 ...</qt>").arg(d->jid.full()));
@@ -257,26 +369,6 @@ void SearchDlg::doSearchSet()
     if (!d->pa->checkConnected(this))
         return;
 
-    d->jt = new JT_XSearch(d->pa->client()->rootTask());
-
-    if (!d->xdata) {
-        Form submitForm = d->form;
-
-        Q_ASSERT(submitForm.count() == d->le_field.count());
-        // import the changes back into the form.
-        // the QPtrList of QLineEdits should be in the same order
-        for (int i = 0; i < submitForm.count(); ++i) {
-            submitForm[i].setValue(d->le_field[i]->text());
-        }
-
-        d->jt->set(submitForm);
-    } else {
-        XData form;
-        form.setFields(d->xdata->fields());
-
-        d->jt->setForm(d->form, form);
-    }
-
     clear();
 
     pb_search->setEnabled(false);
@@ -285,21 +377,49 @@ void SearchDlg::doSearchSet()
     d->busy->start();
 
     d->type = 1;
+    if (d->xdata) {
+        d->submitted.setFields(d->xdata->fields());
+        requestPage();
+        return;
+    }
+
+    d->jt = new JT_XSearch(d->pa->client()->rootTask());
+
+    Form submitForm = d->form;
+
+    Q_ASSERT(submitForm.count() == d->le_field.count());
+    // import the changes back into the form.
+    // the QPtrList of QLineEdits should be in the same order
+    for (int i = 0; i < submitForm.count(); ++i) {
+        submitForm[i].setValue(d->le_field[i]->text());
+    }
+
+    d->jt->set(submitForm);
+    connect(d->jt, SIGNAL(finished()), SLOT(jt_finished()));
+    d->jt->go(true);
+}
+
+void SearchDlg::requestPage()
+{
+    d->jt = new JT_XSearch(d->pa->client()->rootTask());
+    d->jt->setForm(d->form, d->submitted, d->rsm ? SEARCH_PAGE_SIZE : 0, d->after);
     connect(d->jt, SIGNAL(finished()), SLOT(jt_finished()));
     d->jt->go(true);
 }
 
 void SearchDlg::jt_finished()
 {
-    d->busy->stop();
     JT_XSearch *jt = d->jt;
     d->jt          = nullptr;
 
     if (d->type == 1) {
-        d->gr_form->setEnabled(true);
-        pb_search->setEnabled(true);
-        pb_stop->setEnabled(false);
-    }
+        if (d->xdata) {
+            pageFinished(jt);
+            return;
+        }
+        searchFinished();
+    } else
+        d->busy->stop();
 
     if (jt->success()) {
         if (d->type == 0) {
@@ -363,58 +483,17 @@ void SearchDlg::jt_finished()
             qApp->processEvents();
             resize(sizeHint());
         } else {
-            lv_results->setUpdatesEnabled(false);
-
-            if (!d->xdata) {
-                const QList<SearchResult> &list = jt->results();
-                if (list.isEmpty())
-                    QMessageBox::information(this, tr("Search Results"), tr("Search returned 0 results."));
-                else {
-                    for (const auto &r : list) {
-                        addEntry(r.jid().full(), r.nick(), r.first(), r.last(), r.email());
-                    }
-                }
-            } else {
-                XData    form;
-                QDomNode n = queryTag(jt->iq()).firstChild();
-                for (; !n.isNull(); n = n.nextSibling()) {
-                    QDomElement i = n.toElement();
-                    if (i.isNull())
-                        continue;
-
-                    if (i.namespaceURI() == "jabber:x:data") {
-                        form.fromXml(i);
-                        break;
-                    }
-                }
-
-                QStringList header_labels;
-                for (const XData::ReportField &report : form.report()) {
-                    header_labels << report.label;
-                }
-
-                lv_results->clear();
-                lv_results->setColumnCount(0);
-                lv_results->setHeaderLabels(header_labels);
-
-                for (XData::ReportItem ri : form.reportItems()) {
-                    int              i   = 0;
-                    QTreeWidgetItem *lvi = new QTreeWidgetItem(lv_results);
-                    for (const XData::ReportField &report : form.report()) {
-                        lvi->setText(i++, ri[report.name]);
-                    }
-                }
-
-                d->xdata_form = form;
-            }
-
-            for (int i = 0; i < lv_results->columnCount(); ++i) {
-                lv_results->resizeColumnToContents(i);
-                lv_results->setColumnWidth(i, qMin(lv_results->columnWidth(i), 300));
+            const QList<SearchResult> &list = jt->results();
+            if (list.isEmpty())
+                QMessageBox::information(this, tr("Search Results"), tr("Search returned 0 results."));
+            else {
+                QVector<QStringList> rows;
+                rows.reserve(list.size());
+                for (const auto &r : list)
+                    rows += QStringList { r.nick(), r.first(), r.last(), r.email(), r.jid().full() };
+                d->model->append(rows);
+                d->sizeColumns();
             }
-
-            lv_results->sortByColumn(0, Qt::AscendingOrder);
-            lv_results->setUpdatesEnabled(true);
         }
     } else {
         if (d->type == 0) {
@@ -428,9 +507,109 @@ void SearchDlg::jt_finished()
     }
 }
 
+void SearchDlg::pageFinished(JT_XSearch *jt)
+{
+    if (!jt->success()) {
+        // a service without result set management may refuse the <set/>, then ask for everything at once
+        if (d->rsm && d->after.isEmpty()) {
+            d->rsm = false;
+            requestPage();
+            return;
+        }
+        searchFinished();
+        QMessageBox::critical(this, tr("Error"),
+                              tr("Error retrieving search results.\nReason: %1").arg(jt->statusString()));
+        return;
+    }
+
+    QDomElement query = queryTag(jt->iq());
+    QDomElement x;
+    for (QDomElement e = query.firstChildElement(); !e.isNull(); e = e.nextSiblingElement()) {
+        if (e.namespaceURI() == "jabber:x:data") {
+            x = e;
+            break;
+        }
+    }
+
+    if (d->after.isEmpty()) {
+        QStringList names, labels;
+        for (QDomElement f = x.firstChildElement("reported").firstChildElement("field"); !f.isNull();
+             f = f.nextSiblingElement("field")) {
+            names += f.attribute("var");
+            labels += f.attribute("label", f.attribute("var"));
+        }
+        d->model->setColumns(names, labels);
+        d->sized = false;
+    }
+
+    QDomElement set;
+    for (QDomElement e = query.firstChildElement("set"); !e.isNull(); e = e.nextSiblingElement("set")) {
+        if (e.namespaceURI() == RSM_NS) {
+            set = e;
+            break;
+        }
+    }
+    const QString last = set.firstChildElement("last").text();
+    bool          ok;
+    const int     count = set.firstChildElement("count").text().toInt(&ok);
+    if (ok)
+        d->total = count;
+    // a service ignoring <after/> would hand out the same page forever
+    d->after       = last != d->after ? last : QString();
+    d->pageRows    = 0;
+    d->pendingItem = x.firstChildElement("item");
+    parseResults();
+}
+
+void SearchDlg::parseResults()
+{
+    // a late call after a stop, or while the next page is on its way
+    if (d->pendingItem.isNull() && (d->jt || !d->busy->isActive()))
+        return;
+
+    QVector<QStringList> rows;
+    for (int n = 0; n < SEARCH_PARSE_CHUNK && !d->pendingItem.isNull(); ++n) {
+        QStringList row;
+        for (int c = 0; c < d->model->columnCount(); ++c)
+            row += QString();
+        for (QDomElement f = d->pendingItem.firstChildElement("field"); !f.isNull();
+             f = f.nextSiblingElement("field")) {
+            int c = d->model->column(f.attribute("var"));
+            if (c != -1)
+                row[c] = f.firstChildElement("value").text();
+        }
+        rows += row;
+        d->pendingItem = d->pendingItem.nextSiblingElement("item");
+    }
+    d->pageRows += rows.size();
+    d->model->append(rows);
+    if (!d->sized && (d->model->rowCount() >= SEARCH_SIZE_SAMPLE || d->pendingItem.isNull()))
+        d->sizeColumns();
+
+    if (!d->pendingItem.isNull())
+        QTimer::singleShot(0, this, SLOT(parseResults()));
+    else if (!d->after.isEmpty() && d->pageRows > 0 && (d->total < 0 || d->model->rowCount() < d->total))
+        requestPage();
+    else
+        searchFinished();
+}
+
+void SearchDlg::searchFinished()
+{
+    d->pendingItem = QDomElement();
+    d->busy->stop();
+    d->gr_form->setEnabled(true);
+    pb_search->setEnabled(true);
+    pb_stop->setEnabled(false);
+}
+
 void SearchDlg::clear()
 {
-    lv_results->clear();
+    d->model->clear();
+    d->after.clear();
+    d->sized       = false;
+    d->total       = -1;
+    d->pendingItem = QDomElement();
     pb_add->setEnabled(false);
     pb_info->setEnabled(false);
 }
@@ -443,23 +622,20 @@ void SearchDlg::doStop()
     delete d->jt;
     d->jt = nullptr;
 
-    d->busy->stop();
-    d->gr_form->setEnabled(true);
-    pb_search->setEnabled(true);
-    pb_stop->setEnabled(false);
+    // rows already shown stay
+    searchFinished();
 }
 
 void SearchDlg::selectionChanged()
 {
-    bool enable = !lv_results->selectedItems().isEmpty();
+    bool enable = lv_results->selectionModel()->hasSelection();
     pb_add->setEnabled(enable);
     pb_info->setEnabled(enable);
 }
 
-void SearchDlg::itemActivated(QTreeWidgetItem *item, int column)
+void SearchDlg::itemActivated(const QModelIndex &index)
 {
-    Q_UNUSED(item);
-    Q_UNUSED(column);
+    Q_UNUSED(index);
     doInfo();
 }
 
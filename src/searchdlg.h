@@ -24,7 +24,9 @@
 
 #include <QDialog>
 
+class JT_XSearch;
 class PsiAccount;
+class QModelIndex;
 class QString;
 class QStringList;
 
@@ -47,8 +49,9 @@ private slots:
     void doSearchGet();
     void doSearchSet();
     void selectionChanged();
-    void itemActivated(QTreeWidgetItem *item, int column);
+    void itemActivated(const QModelIndex &index);
     void jt_finished();
+    void parseResults();
     void doStop();
     void doAdd();
     void doInfo();
@@ -57,8 +60,9 @@ private:
     class Private;
     Private *d;
 
-    void addEntry(const QString &jid, const QString &nick, const QString &first, const QString &last,
-                  const QString &email);
+    void requestPage();
+    void pageFinished(JT_XSearch *jt);
+    void searchFinished();
     void clear();
 };
 
@@ -307,7 +307,7 @@ SendButtonTemplatesMenu::SendButtonTemplatesMenu(QWidget *parent) : QMenu(parent
 {
     setSeparatorsCollapsible(true);
     update();
-    connect(PsiOptions::instance(), SIGNAL(optionChanged(const QString &)), SLOT(optionChanged(const QString &)));
+    PsiOptions::watch("options.ui.chat", this, [this](const QString &option) { optionChanged(option); });
 }
 
 void SendButtonTemplatesMenu::setParams(bool ps)
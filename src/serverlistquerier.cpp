@@ -19,89 +19,182 @@
 
 #include "serverlistquerier.h"
 
-#include <QDomDocument>
-#include <QDomElement>
-#include <QDomNodeList>
+#include "applicationinfo.h"
+#include "filecache.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QNetworkRequest>
-#include <QStringList>
-#include <QUrl>
+#include <QRegExp>
+#include <QXmlStreamReader>
 
-// #define XML_SERVER_LIST
+#define SERVERLIST_URL "https://xmpp.net/directory.php"
 #define SERVERLIST_MAX_REDIRECT 5
+// a cached list younger than this is used without asking the server, seconds
+#define SERVERLIST_FRESH_AGE (24 * 3600)
+// and it is kept this long for offline use, seconds
+#define SERVERLIST_MAX_AGE (30 * 24 * 3600)
 
 // legacy format could be found here as well
 // https://list.jabber.at/api/?format=services-full.xml
 // original http://xmpp.org/services/services.xml does not work anymore (checked on 2016-03-27)
 
-ServerListQuerier::ServerListQuerier(QObject *parent) : QObject(parent), redirectCount_(0)
+ServerListQuerier::ServerListQuerier(QObject *parent) : QObject(parent), redirectCount_(0), revalidating_(false)
 {
     http_ = new QNetworkAccessManager(this);
-    url_  = QUrl("https://xmpp.net/directory.php");
+}
+
+FileCache *ServerListQuerier::cache()
+{
+    static FileCache *cache = nullptr;
+    if (!cache)
+        cache = new FileCache(ApplicationInfo::homeDir(ApplicationInfo::CacheLocation) + "/serverlist",
+                              QCoreApplication::instance());
+    return cache;
+}
+
+static XMPP::Hash cacheId()
+{
+    return XMPP::Hash(XMPP::Hash::Sha1, QCryptographicHash::hash(SERVERLIST_URL, QCryptographicHash::Sha1));
 }
 
 void ServerListQuerier::getList()
 {
-    redirectCount_       = 0;
-    QNetworkReply *reply = http_->get(QNetworkRequest(url_));
+    // the cached list is shown at once, also offline, and refreshed in the background when it gets old
+    FileCacheItem *item = cache()->get(cacheId());
+    if (!item) {
+        download(false);
+        return;
+    }
+    bool fresh = item->created().secsTo(QDateTime::currentDateTime()) < SERVERLIST_FRESH_AGE;
+    item->loadData(this, [this, fresh](const QByteArray &data) {
+        QStringList servers = parse(data);
+        if (servers.isEmpty()) {
+            download(false);
+            return;
+        }
+        emit listReceived(servers);
+        if (!fresh)
+            download(true);
+    });
+}
+
+void ServerListQuerier::download(bool revalidate)
+{
+    redirectCount_ = 0;
+    revalidating_  = revalidate;
+    url_           = QUrl(SERVERLIST_URL);
+
+    QNetworkRequest req(url_);
+    FileCacheItem * item = revalidate ? cache()->get(cacheId()) : nullptr;
+    if (item) {
+        const QVariantMap md = item->metadata();
+        if (!md.value("etag").toByteArray().isEmpty())
+            req.setRawHeader("If-None-Match", md.value("etag").toByteArray());
+        if (!md.value("last-modified").toByteArray().isEmpty())
+            req.setRawHeader("If-Modified-Since", md.value("last-modified").toByteArray());
+    }
+    QNetworkReply *reply = http_->get(req);
     connect(reply, SIGNAL(finished()), SLOT(get_finished()));
 }
 
+// the format is told by the content: json of the providers list, xml of the old service list, or the html directory
+QStringList ServerListQuerier::parse(const QByteArray &data)
+{
+    QStringList      servers;
+    const QByteArray head  = data.left(64).trimmed();
+    const char       first = head.isEmpty() ? 0 : head[0];
+
+    if (first == '[' || first == '{') {
+        // a list of jids, or of objects with a jid
+        QJsonDocument doc   = QJsonDocument::fromJson(data);
+        QJsonArray    items = doc.isArray() ? doc.array() : doc.object().value("items").toArray();
+        for (const QJsonValue &v : qAsConst(items)) {
+            QString jid = v.isString() ? v.toString() : v.toObject().value("jid").toString();
+            if (!jid.isEmpty())
+                servers.append(jid);
+        }
+    } else if (data.contains("<item")) {
+        // one pass over the document, nothing but the jids is kept
+        QXmlStreamReader reader(data);
+        while (!reader.atEnd()) {
+            if (reader.readNext() == QXmlStreamReader::StartElement && reader.name() == QLatin1String("item")) {
+                QString jid = reader.attributes().value("jid").toString();
+                if (!jid.isEmpty())
+                    servers.append(jid);
+            }
+        }
+    } else {
+        QString contents = QString::fromUtf8(data);
+        int     index    = 0;
+        QRegExp re("data-original-title=\"([^\"]+)\"");
+        while ((index = contents.indexOf(re, index + 1)) != -1) {
+            servers.append(re.cap(1));
+        }
+    }
+    return servers;
+}
+
 void ServerListQuerier::get_finished()
 {
     QNetworkReply *reply = static_cast<QNetworkReply *>(sender());
+    reply->deleteLater();
 
     if (reply->error()) {
-        emit error(reply->errorString());
-    } else {
-        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
-        if (status == 200) {
-#ifdef XML_SERVER_LIST
-            // Parse the XML file
-            QDomDocument doc;
-            if (!doc.setContent(reply->readAll())) {
+        if (!revalidating_)
+            emit error(reply->errorString());
+        return;
+    }
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 304) {
+        // still the same, good for another while
+        if (FileCacheItem *item = cache()->get(cacheId()))
+            item->reborn();
+    } else if (status == 200) {
+        // QNetworkAccessManager asks for gzip and inflates it itself
+        QByteArray  data    = reply->readAll();
+        QStringList servers = parse(data);
+        if (servers.isEmpty()) {
+            if (!revalidating_)
                 emit error(tr("Unable to parse server list"));
-                return;
-            }
+            return;
+        }
 
-            // Fill the list
-            QStringList  servers;
-            QDomNodeList items = doc.elementsByTagName("item");
-            for (int i = 0; i < items.count(); i++) {
-                QString jid = items.item(i).toElement().attribute("jid");
-                if (!jid.isEmpty()) {
-                    servers.push_back(jid);
-                }
-            }
-#else
-            QStringList servers;
-            QString     contents = QString::fromUtf8(reply->readAll());
-            int         index    = 0;
-            QRegExp     re("data-original-title=\"([^\"]+)\"");
-            while ((index = contents.indexOf(re, index + 1)) != -1) {
-                servers.append(re.cap(1));
-            }
-#endif
+        QVariantMap md;
+        md.insert("etag", reply->rawHeader("ETag"));
+        md.insert("last-modified", reply->rawHeader("Last-Modified"));
+        cache()->remove(cacheId());
+        cache()->append(cacheId(), data, md, SERVERLIST_MAX_AGE);
+
+        if (!revalidating_)
             emit listReceived(servers);
-        } else if (reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
-            if (redirectCount_ >= SERVERLIST_MAX_REDIRECT) {
+    } else if (reply->attribute(QNetworkRequest::RedirectionTargetAttribute).isValid()) {
+        if (redirectCount_ >= SERVERLIST_MAX_REDIRECT) {
+            if (!revalidating_)
                 emit error(tr("Maximum redirect count reached"));
-                return;
-            }
+            return;
+        }
 
-            url_ = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).value<QUrl>().resolved(url_);
-            if (url_.isValid()) {
-                QNetworkReply *newReply = http_->get(QNetworkRequest(url_));
-                connect(newReply, SIGNAL(finished()), SLOT(get_finished()));
-                ++redirectCount_;
-            } else {
-                emit error(tr("Invalid redirect URL %1").arg(url_.toString()));
-                return;
-            }
-        } else {
-            emit error(tr("Unexpected HTTP status code: %1").arg(status));
+        url_ = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).value<QUrl>().resolved(url_);
+        if (url_.isValid()) {
+            QNetworkRequest req(url_);
+            // the validators go along, they are about the same list
+            req.setRawHeader("If-None-Match", reply->request().rawHeader("If-None-Match"));
+            req.setRawHeader("If-Modified-Since", reply->request().rawHeader("If-Modified-Since"));
+            QNetworkReply *newReply = http_->get(req);
+            connect(newReply, SIGNAL(finished()), SLOT(get_finished()));
+            ++redirectCount_;
+        } else if (!revalidating_) {
+            emit error(tr("Invalid redirect URL %1").arg(url_.toString()));
         }
+    } else if (!revalidating_) {
+        emit error(tr("Unexpected HTTP status code: %1").arg(status));
     }
-    reply->deleteLater();
 }
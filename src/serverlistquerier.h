@@ -21,8 +21,10 @@
 #define SERVERLISTQUERIER_H
 
 #include <QObject>
+#include <QStringList>
 #include <QUrl>
 
+class FileCache;
 class QNetworkAccessManager;
 
 class ServerListQuerier : public QObject {
@@ -40,9 +42,15 @@ protected slots:
     void get_finished();
 
 private:
+    void download(bool revalidate);
+
+    static FileCache * cache();
+    static QStringList parse(const QByteArray &data);
+
     QNetworkAccessManager *http_;
     QUrl                   url_;
     int                    redirectCount_;
+    bool                   revalidating_; // the cached list was shown already, a failure isn't reported
 };
 
 #endif // SERVERLISTQUERIER_H
@@ -11,6 +11,9 @@
  */
 ShortcutManager::ShortcutManager() : QObject(QCoreApplication::instance())
 {
+    // parsed again on the next lookup
+    PsiOptions::watch("options.shortcuts", this, [this](const QString &) { resolved_.clear(); });
+
     // Make sure that there is at least one shortcut for sending messages
     if (shortcuts("chat.send").isEmpty()) {
         qWarning("Restoring chat.send shortcut");
@@ -44,11 +47,8 @@ ShortcutManager *ShortcutManager::instance()
  */
 QKeySequence ShortcutManager::shortcut(const QString &name)
 {
-    QVariant            variant = PsiOptions::instance()->getOption(QString("options.shortcuts.%1").arg(name));
-    QList<QKeySequence> list    = shortcuts(name);
-    if (!list.isEmpty())
-        return list.first();
-    return variant.value<QKeySequence>();
+    const QList<QKeySequence> list = shortcuts(name);
+    return list.isEmpty() ? QKeySequence() : list.first();
 }
 
 /**
@@ -74,7 +74,10 @@ static bool shortcutManagerKeySequenceLessThan(const QKeySequence &k1, const QKe
  */
 QList<QKeySequence> ShortcutManager::shortcuts(const QString &name)
 {
-    return readShortcutsFromOptions(name, PsiOptions::instance());
+    auto it = resolved_.constFind(name);
+    if (it == resolved_.constEnd())
+        it = resolved_.insert(name, readShortcutsFromOptions(name, PsiOptions::instance()));
+    return it.value();
 }
 
 /**
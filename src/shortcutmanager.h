@@ -1,11 +1,12 @@
 #ifndef SHORTCUTMANAGER_H
 #define SHORTCUTMANAGER_H
 
+#include <QHash>
+#include <QKeySequence>
 #include <QList>
 #include <QObject>
 
 class PsiOptions;
-class QKeySequence;
 class QString;
 
 class ShortcutManager : public QObject {
@@ -21,6 +22,8 @@ public:
 private:
     ShortcutManager();
     static ShortcutManager *instance_;
+
+    QHash<QString, QList<QKeySequence>> resolved_; // shortcut name -> parsed sequences
 };
 
 #endif // SHORTCUTMANAGER_H
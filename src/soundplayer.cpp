@@ -0,0 +1,158 @@
+/*
+ * soundplayer.cpp - plays notification sounds in process
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "soundplayer.h"
+
+#include "applicationinfo.h"
+#include "common.h"
+#include "psioptions.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSoundEffect>
+#include <QTimer>
+#include <QUrl>
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+#include <QSound>
+#endif
+
+#define SOUND_OPTIONS "options.ui.notifications.sounds"
+// the same sound isn't started again within this time, milliseconds
+#define SOUND_REPEAT_INTERVAL 250
+// decoded sounds kept, the configured ones and what plugins play
+#define SOUND_MAX_EFFECTS 32
+
+SoundPlayer *SoundPlayer::instance_ = nullptr;
+
+SoundPlayer *SoundPlayer::instance()
+{
+    if (!instance_)
+        instance_ = new SoundPlayer();
+    return instance_;
+}
+
+SoundPlayer::SoundPlayer() : QObject(QCoreApplication::instance())
+{
+    clock_.start();
+
+    // the configured sounds are decoded before the first event needs them
+    PsiOptions::watch(SOUND_OPTIONS, this, [this](const QString &) { preload(); });
+    QTimer::singleShot(0, this, &SoundPlayer::preload);
+}
+
+SoundPlayer::~SoundPlayer() { instance_ = nullptr; }
+
+QString SoundPlayer::resolve(const QString &file) const
+{
+    if (QDir::isRelativePath(file))
+        return ApplicationInfo::resourcesDir() + '/' + file;
+    return file;
+}
+
+void SoundPlayer::preload()
+{
+    PsiOptions *o = PsiOptions::instance();
+    if (!o->getOption(SOUND_OPTIONS ".enable").toBool())
+        return;
+    for (const QString &name : o->getChildOptionNames(SOUND_OPTIONS, true)) {
+        const QVariant v = o->getOption(name);
+        if (v.type() == QVariant::String && !v.toString().isEmpty())
+            effect(resolve(v.toString()));
+    }
+}
+
+QSoundEffect *SoundPlayer::effect(const QString &path)
+{
+    if (QSoundEffect *e = effects_.value(path))
+        return e;
+    // QSoundEffect plays uncompressed wave files only
+    if (failed_.contains(path) || !path.endsWith(QLatin1String(".wav"), Qt::CaseInsensitive) || !QFile::exists(path))
+        return nullptr;
+
+    if (effects_.size() >= SOUND_MAX_EFFECTS) {
+        for (auto it = effects_.begin(); it != effects_.end(); ++it) {
+            if (!it.value()->isPlaying()) {
+                pending_.remove(it.key());
+                it.value()->deleteLater();
+                effects_.erase(it);
+                break;
+            }
+        }
+    }
+
+    QSoundEffect *e = new QSoundEffect(this);
+    connect(e, &QSoundEffect::statusChanged, this, [this, e, path]() {
+        if (e->status() == QSoundEffect::Ready) {
+            if (pending_.remove(path))
+                e->play();
+        } else if (e->status() == QSoundEffect::Error) {
+            // no audio backend or a format it can't decode
+            failed_.insert(path);
+            effects_.remove(path);
+            e->deleteLater();
+            if (pending_.remove(path))
+                playFallback(path);
+        }
+    });
+    e->setSource(QUrl::fromLocalFile(path));
+    effects_.insert(path, e);
+    return e;
+}
+
+void SoundPlayer::play(const QString &file)
+{
+    const QString path = resolve(file);
+
+    // a burst of events gets one sound
+    const qint64 now  = clock_.elapsed();
+    auto         last = lastPlay_.find(path);
+    if (last != lastPlay_.end() && now - last.value() < SOUND_REPEAT_INTERVAL)
+        return;
+    lastPlay_.insert(path, now);
+
+    QSoundEffect *e = effect(path);
+    if (!e)
+        playFallback(path);
+    else if (e->status() == QSoundEffect::Ready)
+        e->play();
+    else
+        pending_.insert(path);
+}
+
+void SoundPlayer::playFallback(const QString &path)
+{
+    if (!QFile::exists(path))
+        return;
+
+#if defined(Q_OS_WIN) || defined(Q_OS_MAC)
+    QSound::play(path);
+#else
+    static const auto playerOption = PsiOptions::handle<QString>(SOUND_OPTIONS ".unix-sound-player");
+
+    QString player = playerOption.value();
+    if (player.isEmpty())
+        player = soundDetectPlayer();
+    QStringList args = player.split(' ');
+    args += path;
+    QString prog = args.takeFirst();
+    QProcess::startDetached(prog, args);
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+ * soundplayer.h - plays notification sounds in process
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SOUNDPLAYER_H
+#define SOUNDPLAYER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+class QSoundEffect;
+
+// Keeps the configured sounds decoded in QSoundEffects, so an event only starts playback.
+// Repeats of a sound within a short time are dropped. What QSoundEffect can't play goes
+// to QSound, or the external player on unix
+class SoundPlayer : public QObject {
+    Q_OBJECT
+public:
+    static SoundPlayer *instance();
+    ~SoundPlayer();
+
+    // file is absolute or relative to the resources dir
+    void play(const QString &file);
+
+private:
+    SoundPlayer();
+
+    QString       resolve(const QString &file) const;
+    QSoundEffect *effect(const QString &path);
+    void          preload();
+    void          playFallback(const QString &path);
+
+    static SoundPlayer *instance_;
+
+    QHash<QString, QSoundEffect *> effects_;
+    QSet<QString>                  failed_;   // paths QSoundEffect couldn't load
+    QSet<QString>                  pending_;  // to be played once loaded
+    QHash<QString, qint64>         lastPlay_; // path => clock_ time
+    QElapsedTimer                  clock_;
+};
+
+#endif // SOUNDPLAYER_H
@@ -0,0 +1,260 @@
+/*
+ * spellcheckservice.cpp - spell checking off the gui thread
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "spellcheckservice.h"
+
+#include "memorytrimmer.h"
+#include "spellchecker/spellchecker.h"
+
+#include <QColor>
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QTextBlock>
+#include <QTextBlockUserData>
+#include <QTextCharFormat>
+#include <QTextDocument>
+#include <QThread>
+#include <QTimer>
+
+// verdicts kept, for all languages together
+#define SPELL_CACHE_SIZE 20000
+// rough size of a cached verdict with its key
+#define SPELL_CACHE_ENTRY_BYTES 96
+
+//----------------------------------------------------------------------------
+// SpellCheckWorker
+//----------------------------------------------------------------------------
+
+class SpellCheckWorker : public QObject {
+    Q_OBJECT
+public:
+    SpellCheckWorker(QMutex *mutex) : QObject(nullptr), mutex_(mutex) { }
+
+public slots:
+    void check(const QString &languages, const QStringList &words)
+    {
+        QList<bool> correct;
+        correct.reserve(words.size());
+        {
+            QMutexLocker locker(mutex_);
+            for (const QString &word : words)
+                correct += SpellChecker::instance()->isCorrect(word);
+        }
+        emit checked(languages, words, correct);
+    }
+
+signals:
+    void checked(const QString &languages, const QStringList &words, const QList<bool> &correct);
+
+private:
+    QMutex *mutex_;
+};
+
+//----------------------------------------------------------------------------
+// SpellCheckService
+//----------------------------------------------------------------------------
+
+SpellCheckService *SpellCheckService::instance_ = nullptr;
+
+SpellCheckService *SpellCheckService::instance()
+{
+    if (!instance_)
+        instance_ = new SpellCheckService();
+    return instance_;
+}
+
+SpellCheckService::SpellCheckService() : QObject(QCoreApplication::instance()), cache_(SPELL_CACHE_SIZE)
+{
+    qRegisterMetaType<QList<bool>>("QList<bool>");
+
+    flushTimer_ = new QTimer(this);
+    flushTimer_->setSingleShot(true);
+    flushTimer_->setInterval(0);
+    connect(flushTimer_, &QTimer::timeout, this, &SpellCheckService::flushQueue);
+
+    thread_ = new QThread(this);
+    worker_ = new SpellCheckWorker(&mutex_);
+    worker_->moveToThread(thread_);
+    connect(worker_, &SpellCheckWorker::checked, this, &SpellCheckService::worker_checked, Qt::QueuedConnection);
+    thread_->start(QThread::LowPriority);
+
+    // verdicts are checked again in the background, the highlighting catches up
+    MemoryTrimmer::instance()->add(
+        this, [this]() { return qint64(cache_.size()) * SPELL_CACHE_ENTRY_BYTES; },
+        [this](MemoryTrimmer::Level level) {
+            if (level == MemoryTrimmer::Critical)
+                cache_.clear();
+        });
+}
+
+SpellCheckService::~SpellCheckService()
+{
+    thread_->quit();
+    thread_->wait();
+    delete worker_;
+    instance_ = nullptr;
+}
+
+SpellCheckService::Verdict SpellCheckService::verdict(const QString &word)
+{
+    const QString k = key(languages_, word);
+    if (bool *correct = cache_.object(k))
+        return *correct ? Correct : Misspelled;
+    if (!queued_.contains(k)) {
+        // a whole highlighting pass goes to the worker as one batch
+        queued_.insert(k);
+        pending_ += word;
+        flushTimer_->start();
+    }
+    return Unknown;
+}
+
+void SpellCheckService::flushQueue()
+{
+    if (pending_.isEmpty())
+        return;
+    QMetaObject::invokeMethod(worker_, "check", Qt::QueuedConnection, Q_ARG(QString, languages_),
+                              Q_ARG(QStringList, pending_));
+    pending_.clear();
+}
+
+void SpellCheckService::worker_checked(const QString &languages, const QStringList &words, const QList<bool> &correct)
+{
+    for (int i = 0; i < words.size(); ++i) {
+        const QString k = key(languages, words[i]);
+        queued_.remove(k);
+        cache_.insert(k, new bool(correct[i]));
+    }
+    // late results for languages no longer active only fill the cache
+    if (languages == languages_)
+        emit checked(words);
+}
+
+bool SpellCheckService::isCorrect(const QString &word)
+{
+    const QString k = key(languages_, word);
+    if (bool *correct = cache_.object(k))
+        return *correct;
+    bool res;
+    {
+        QMutexLocker locker(&mutex_);
+        res = SpellChecker::instance()->isCorrect(word);
+    }
+    cache_.insert(k, new bool(res));
+    return res;
+}
+
+QList<QString> SpellCheckService::suggestions(const QString &word)
+{
+    QMutexLocker locker(&mutex_);
+    return SpellChecker::instance()->suggestions(word);
+}
+
+bool SpellCheckService::add(const QString &word)
+{
+    bool res;
+    {
+        QMutexLocker locker(&mutex_);
+        res = SpellChecker::instance()->add(word);
+    }
+    if (res)
+        cache_.insert(key(languages_, word), new bool(true));
+    return res;
+}
+
+void SpellCheckService::setActiveLanguages(const QSet<LanguageManager::LangId> &langs)
+{
+    QStringList names;
+    for (const LanguageManager::LangId &id : langs)
+        names += LanguageManager::toString(id);
+    names.sort();
+    {
+        QMutexLocker locker(&mutex_);
+        SpellChecker::instance()->setActiveLanguages(langs);
+    }
+    if (names.join(',') != languages_) {
+        languages_ = names.join(',');
+        emit languagesChanged();
+    }
+}
+
+//----------------------------------------------------------------------------
+// SpellCheckHighlighter
+//----------------------------------------------------------------------------
+
+// words of a block that weren't checked yet when it was highlighted
+class PendingWords : public QTextBlockUserData {
+public:
+    QSet<QString> words;
+};
+
+SpellCheckHighlighter::SpellCheckHighlighter(QTextDocument *document) : QSyntaxHighlighter(document)
+{
+    connect(SpellCheckService::instance(), &SpellCheckService::checked, this, &SpellCheckHighlighter::checked);
+    connect(SpellCheckService::instance(), &SpellCheckService::languagesChanged, this,
+            &SpellCheckHighlighter::rehighlight);
+}
+
+void SpellCheckHighlighter::highlightBlock(const QString &text)
+{
+    static const QRegularExpression wordRx("\\b\\w+\\b");
+
+    QTextCharFormat tcf;
+    tcf.setUnderlineColor(QColor(255, 0, 0));
+    tcf.setUnderlineStyle(QTextCharFormat::SpellCheckUnderline);
+
+    SpellCheckService *             service = SpellCheckService::instance();
+    PendingWords *                  pending = nullptr;
+    QRegularExpressionMatchIterator it      = wordRx.globalMatch(text);
+    while (it.hasNext()) {
+        const QRegularExpressionMatch m = it.next();
+        switch (service->verdict(m.captured())) {
+        case SpellCheckService::Misspelled:
+            setFormat(m.capturedStart(), m.capturedLength(), tcf);
+            break;
+        case SpellCheckService::Unknown:
+            if (!pending)
+                pending = new PendingWords;
+            pending->words.insert(m.captured());
+            break;
+        case SpellCheckService::Correct:
+            break;
+        }
+    }
+    // replaces (and deletes) what the previous pass left
+    setCurrentBlockUserData(pending);
+}
+
+void SpellCheckHighlighter::checked(const QStringList &words)
+{
+    for (QTextBlock b = document()->begin(); b.isValid(); b = b.next()) {
+        auto *pending = static_cast<PendingWords *>(b.userData());
+        if (!pending)
+            continue;
+        for (const QString &word : words) {
+            if (pending->words.contains(word)) {
+                rehighlightBlock(b);
+                break;
+            }
+        }
+    }
+}
+
+#include "spellcheckservice.moc"
@@ -0,0 +1,95 @@
+/*
+ * spellcheckservice.h - spell checking off the gui thread
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SPELLCHECKSERVICE_H
+#define SPELLCHECKSERVICE_H
+
+#include "languagemanager.h"
+
+#include <QCache>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QSyntaxHighlighter>
+
+class QThread;
+class QTimer;
+class SpellCheckWorker;
+
+// Checks words on a worker thread and keeps the verdicts for all chat edits.
+// SpellChecker isn't thread safe, so the gui thread reaches it only through here
+class SpellCheckService : public QObject {
+    Q_OBJECT
+public:
+    enum Verdict { Unknown, Correct, Misspelled };
+
+    static SpellCheckService *instance();
+    ~SpellCheckService();
+
+    // cached verdict, an Unknown word is queued for the worker
+    Verdict verdict(const QString &word);
+
+    // these block while the worker is checking
+    bool           isCorrect(const QString &word);
+    QList<QString> suggestions(const QString &word);
+    bool           add(const QString &word);
+    void           setActiveLanguages(const QSet<LanguageManager::LangId> &langs);
+
+signals:
+    // verdicts for these words are cached now
+    void checked(const QStringList &words);
+    void languagesChanged();
+
+private slots:
+    void flushQueue();
+    void worker_checked(const QString &languages, const QStringList &words, const QList<bool> &correct);
+
+private:
+    SpellCheckService();
+
+    QString key(const QString &languages, const QString &word) const { return languages + '\n' + word; }
+
+    static SpellCheckService *instance_;
+
+    QMutex                mutex_; // held around every SpellChecker call
+    QCache<QString, bool> cache_; // languages + word -> correct
+    QString               languages_;
+    QSet<QString>         queued_;  // keys on their way to the worker
+    QStringList           pending_; // words for the next batch
+    QTimer *              flushTimer_;
+    QThread *             thread_;
+    SpellCheckWorker *    worker_;
+};
+
+// Underlines misspelled words with the verdicts of SpellCheckService, a block with
+// words still being checked is highlighted again once they are ready
+class SpellCheckHighlighter : public QSyntaxHighlighter {
+    Q_OBJECT
+public:
+    SpellCheckHighlighter(QTextDocument *document);
+
+protected:
+    void highlightBlock(const QString &text) override;
+
+private slots:
+    void checked(const QStringList &words);
+};
+
+#endif // SPELLCHECKSERVICE_H
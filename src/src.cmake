@@ -96,6 +96,7 @@ list(APPEND HEADERS
     alertmanager.h
     applicationinfo.h
     avatars.h
+    blobstore.h
     bobfilecache.h
     bookmarkmanagedlg.h
     bookmarkmanager.h
@@ -105,12 +106,15 @@ list(APPEND HEADERS
     changepwdlg.h
     chatdlg.h
     chateditproxy.h
+    chathistoryprefetch.h
     chatsplitter.h
+    chatstatesender.h
     chatview.h
     chatviewcommon.h
     coloropt.h
     common.h
     conferencebookmark.h
+    contactinfocache.h
     contactlistaccountmenu.h
     contactlistdragmodel.h
     contactlistdragview.h
@@ -132,9 +136,11 @@ list(APPEND HEADERS
     dummystream.h
     edbflatfile.h
     edbsqlite.h
+    emoticonmatcher.h
     eventdb.h
     eventdlg.h
     filecache.h
+    filehasher.h
     filesharedlg.h
     filesharingdownloader.h
     filesharingitem.h
@@ -154,11 +160,13 @@ list(APPEND HEADERS
     groupmenu.h
     historycontactlistmodel.h
     historydlg.h
+    historyexport.h
     historyimp.h
     hoverabletreeview.h
     htmltextcontroller.h
     httpauthmanager.h
     httputil.h
+    imagepreviewcache.h
     infodlg.h
     invitetogroupchatmenu.h
     jidutil.h
@@ -166,8 +174,10 @@ list(APPEND HEADERS
     main.h
     mainwin.h
     mainwin_p.h
+    mamsync.h
     mcmdcompletion.h
     mcmdmanager.h
+    memorytrimmer.h
     messageview.h
     miniclient.h
     minicmd.h
@@ -189,6 +199,7 @@ list(APPEND HEADERS
     networkaccessmanager.h
     passdialog.h
     pepmanager.h
+    performancedlg.h
     pgpkeydlg.h
     pgputil.h
     pixmaputil.h
@@ -228,6 +239,8 @@ list(APPEND HEADERS
     psitrayicon.h
     pubsubsubscription.h
     rc.h
+    receiptscheduler.h
+    reconnectscheduler.h
     registrationdlg.h
     resourcemenu.h
     rosteravatarframe.h
@@ -238,6 +251,11 @@ list(APPEND HEADERS
     serverlistquerier.h
     shortcutmanager.h
     showtextdlg.h
+    soundplayer.h
+    spellcheckservice.h
+    stallwatchdog.h
+    startupprofiler.h
+    startupscheduler.h
     statuscombobox.h
     statusdlg.h
     statusmenu.h
@@ -249,6 +267,7 @@ list(APPEND HEADERS
     textutil.h
     theme.h
     theme_p.h
+    transferscheduler.h
     translationmanager.h
     urlbookmark.h
     userlist.h
@@ -347,6 +366,7 @@ list(APPEND SOURCES
     alertmanager.cpp
     applicationinfo.cpp
     avatars.cpp
+    blobstore.cpp
     bobfilecache.cpp
     bookmarkmanagedlg.cpp
     bookmarkmanager.cpp
@@ -356,11 +376,14 @@ list(APPEND SOURCES
     changepwdlg.cpp
     chatdlg.cpp
     chateditproxy.cpp
+    chathistoryprefetch.cpp
     chatsplitter.cpp
+    chatstatesender.cpp
     chatviewcommon.cpp
     coloropt.cpp
     common.cpp
     conferencebookmark.cpp
+    contactinfocache.cpp
     contactlistaccountmenu.cpp
     contactlistdragmodel.cpp
     contactlistdragview.cpp
@@ -379,9 +402,11 @@ list(APPEND SOURCES
     dummystream.cpp
     edbflatfile.cpp
     edbsqlite.cpp
+    emoticonmatcher.cpp
     eventdb.cpp
     eventdlg.cpp
     filecache.cpp
+    filehasher.cpp
     filesharedlg.cpp
     filesharingdownloader.cpp
     filesharingitem.cpp
@@ -401,11 +426,13 @@ list(APPEND SOURCES
     groupmenu.cpp
     historycontactlistmodel.cpp
     historydlg.cpp
+    historyexport.cpp
     historyimp.cpp
     hoverabletreeview.cpp
     htmltextcontroller.cpp
     httpauthmanager.cpp
     httputil.cpp
+    imagepreviewcache.cpp
     infodlg.cpp
     invitetogroupchatmenu.cpp
     jidutil.cpp
@@ -413,9 +440,11 @@ list(APPEND SOURCES
     main.cpp
     mainwin.cpp
     mainwin_p.cpp
+    mamsync.cpp
     mcmdcompletion.cpp
     mcmdmanager.cpp
     mcmdsimplesite.cpp
+    memorytrimmer.cpp
     messageview.cpp
     miniclient.cpp
     mood.cpp
@@ -436,6 +465,7 @@ list(APPEND SOURCES
     networkaccessmanager.cpp
     passdialog.cpp
     pepmanager.cpp
+    performancedlg.cpp
     pgpkeydlg.cpp
     pgputil.cpp
     pixmaputil.cpp
@@ -470,6 +500,8 @@ list(APPEND SOURCES
     psitrayicon.cpp
     pubsubsubscription.cpp
     rc.cpp
+    receiptscheduler.cpp
+    reconnectscheduler.cpp
     registrationdlg.cpp
     resourcemenu.cpp
     rosteravatarframe.cpp
@@ -480,6 +512,11 @@ list(APPEND SOURCES
     serverlistquerier.cpp
     shortcutmanager.cpp
     showtextdlg.cpp
+    soundplayer.cpp
+    spellcheckservice.cpp
+    stallwatchdog.cpp
+    startupprofiler.cpp
+    startupscheduler.cpp
     statuscombobox.cpp
     statusdlg.cpp
     statusmenu.cpp
@@ -490,6 +527,7 @@ list(APPEND SOURCES
     textutil.cpp
     theme.cpp
     theme_p.cpp
+    transferscheduler.cpp
     translationmanager.cpp
     urlbookmark.cpp
     userlist.cpp
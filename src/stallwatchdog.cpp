@@ -0,0 +1,162 @@
+/*
+ * stallwatchdog.cpp - reports a blocked gui thread with its stack
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "stallwatchdog.h"
+
+#include "debug.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+#include <atomic>
+
+#if defined(__GLIBC__) || defined(Q_OS_MACOS)
+#define STALL_BACKTRACE
+#include <csignal>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// the gui thread confirms it's alive this often, milliseconds
+#define STALL_PONG_INTERVAL 100
+// frames of the gui thread stack captured
+#define STALL_MAX_FRAMES 64
+
+namespace {
+QElapsedTimer       pongClock;
+std::atomic<qint64> lastPong { 0 };
+
+#ifdef STALL_BACKTRACE
+pthread_t        guiThread;
+void *           frames[STALL_MAX_FRAMES];
+std::atomic<int> frameCount { -1 };
+
+// runs on the gui thread, backtrace() is fine here once it was called outside of the handler
+void captureStack(int)
+{
+    frameCount.store(backtrace(frames, STALL_MAX_FRAMES), std::memory_order_release);
+}
+#endif
+
+class WatchdogThread : public QThread {
+public:
+    int threshold = 0;
+
+    void stop()
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        cond.wakeAll();
+    }
+
+protected:
+    void run() override
+    {
+        QMutexLocker locker(&mutex);
+        bool         reported = false;
+        while (!stopping) {
+            cond.wait(&mutex, ulong(qMax(STALL_PONG_INTERVAL, threshold / 4)));
+            const qint64 stalled = pongClock.elapsed() - lastPong.load(std::memory_order_acquire);
+            if (stalled < threshold)
+                reported = false;
+            else if (!reported && !stopping) {
+                report(stalled);
+                reported = true;
+            }
+        }
+    }
+
+private:
+    QMutex         mutex;
+    QWaitCondition cond;
+    bool           stopping = false;
+
+    void report(qint64 stalled)
+    {
+        const char *path;
+        int         line;
+        SlowTimer::guiScope(&path, &line);
+        const QString scope = SlowTimer::relativeScope(path, line);
+        WARNING() << "[stall]"
+                  << QString("gui thread blocked for %1 ms%2")
+                         .arg(stalled)
+                         .arg(scope.isEmpty() ? QString() : QString(" in ") + scope);
+#ifdef STALL_BACKTRACE
+        frameCount.store(-1, std::memory_order_relaxed);
+        pthread_kill(guiThread, SIGUSR2);
+        for (int n = 0; n < 50 && frameCount.load(std::memory_order_acquire) < 0; ++n)
+            QThread::msleep(2);
+        const int count = frameCount.load(std::memory_order_acquire);
+        if (count > 0) {
+            char **symbols = backtrace_symbols(frames, count);
+            // skip the handler and the signal trampoline
+            for (int n = 2; n < count; ++n)
+                WARNING() << "[stall]" << QString("  #%1 %2").arg(n - 2).arg(symbols ? symbols[n] : "?");
+            free(symbols);
+        }
+#endif
+    }
+};
+
+WatchdogThread *watchdog = nullptr;
+QTimer *        pongTimer = nullptr;
+}
+
+void StallWatchdog::setThreshold(int msecs)
+{
+    if (watchdog) {
+        watchdog->stop();
+        watchdog->wait();
+        delete watchdog;
+        watchdog = nullptr;
+        delete pongTimer;
+        pongTimer = nullptr;
+    }
+    if (msecs <= 0)
+        return;
+
+    if (!pongClock.isValid()) {
+        pongClock.start();
+#ifdef STALL_BACKTRACE
+        guiThread = pthread_self();
+        backtrace(frames, 1); // loads libgcc now, not in the signal handler
+        struct sigaction sa = {};
+        sa.sa_handler       = captureStack;
+        sa.sa_flags         = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR2, &sa, nullptr);
+#endif
+    }
+
+    lastPong.store(pongClock.elapsed(), std::memory_order_release);
+    pongTimer = new QTimer;
+    pongTimer->setInterval(STALL_PONG_INTERVAL);
+    QObject::connect(pongTimer, &QTimer::timeout,
+                     []() { lastPong.store(pongClock.elapsed(), std::memory_order_release); });
+    pongTimer->start();
+
+    watchdog            = new WatchdogThread;
+    watchdog->threshold = msecs;
+    watchdog->setObjectName("StallWatchdog");
+    watchdog->start(QThread::LowPriority);
+}
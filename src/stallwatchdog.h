@@ -0,0 +1,31 @@
+/*
+ * stallwatchdog.h - reports a blocked gui thread with its stack
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+// A thread watching the gui event loop. When the loop doesn't answer for the threshold, the innermost
+// SLOW_TIMER scope of the gui thread and, where backtrace() is available, its stack are logged once per stall
+class StallWatchdog {
+public:
+    // 0 stops the watchdog. call from the gui thread
+    static void setThreshold(int msecs);
+};
+
+#endif // STALLWATCHDOG_H
@@ -0,0 +1,124 @@
+/*
+ * startupprofiler.cpp - timing of the startup phases
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "startupprofiler.h"
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+StartupProfiler *StartupProfiler::instance()
+{
+    static StartupProfiler profiler;
+    return &profiler;
+}
+
+StartupProfiler::StartupProfiler() : reportFile_(QString::fromLocal8Bit(qgetenv("PSI_STARTUP_PROFILE")))
+{
+    clock_.start();
+}
+
+qint64 StartupProfiler::threadCpuTime()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exited, &kernel, &user))
+        return 0;
+    auto toUsecs = [](const FILETIME &t) { return ((qint64(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10; };
+    return toUsecs(kernel) + toUsecs(user);
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+void StartupProfiler::phase(const QString &name)
+{
+    if (!isEnabled())
+        return;
+    const qint64 now = clock_.nsecsElapsed() / 1000;
+    const qint64 cpu = threadCpuTime();
+    if (!current_.isEmpty())
+        add({ current_, QStringLiteral("gui"), currentStart_, now - currentStart_, cpu - currentCpuStart_ });
+    current_         = name;
+    currentStart_    = now;
+    currentCpuStart_ = cpu;
+}
+
+void StartupProfiler::add(const Record &r)
+{
+    QMutexLocker locker(&mutex_);
+    records_.append(r);
+}
+
+StartupProfiler::Scope::Scope(const QString &name) : name_(name), start_(0), cpuStart_(0)
+{
+    if (!StartupProfiler::instance()->isEnabled())
+        return;
+    start_    = StartupProfiler::instance()->clock_.nsecsElapsed() / 1000;
+    cpuStart_ = threadCpuTime();
+    timer_.start();
+}
+
+StartupProfiler::Scope::~Scope()
+{
+    if (!timer_.isValid())
+        return;
+    const bool gui = QThread::currentThread() == QCoreApplication::instance()->thread();
+    StartupProfiler::instance()->add({ name_, gui ? QStringLiteral("gui") : QStringLiteral("worker"), start_,
+                                       timer_.nsecsElapsed() / 1000, threadCpuTime() - cpuStart_ });
+}
+
+void StartupProfiler::writeReport()
+{
+    if (!isEnabled())
+        return;
+    phase(QString());
+
+    QJsonArray phases;
+    {
+        QMutexLocker locker(&mutex_);
+        for (const Record &r : qAsConst(records_)) {
+            phases.append(QJsonObject { { "name", r.name },
+                                        { "thread", r.thread },
+                                        { "start_us", double(r.start) },
+                                        { "wall_us", double(r.wall) },
+                                        { "cpu_us", double(r.cpu) } });
+        }
+    }
+    QFile f(reportFile_);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning("StartupProfiler: can't write %s", qUtf8Printable(reportFile_));
+        return;
+    }
+    f.write(QJsonDocument(QJsonObject { { "total_us", double(clock_.nsecsElapsed() / 1000) }, { "phases", phases } })
+                .toJson());
+}
@@ -0,0 +1,78 @@
+/*
+ * startupprofiler.h - timing of the startup phases
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+// Records wall and cpu time of the startup phases. Set PSI_STARTUP_PROFILE to a file name
+// to get them written there as json once the startup is over.
+class StartupProfiler {
+public:
+    static StartupProfiler *instance();
+
+    bool isEnabled() const { return !reportFile_.isEmpty(); }
+
+    // ends the current phase of the gui thread and starts the next one, an empty name just ends it
+    void phase(const QString &name);
+
+    // measures the scope it lives in, for phases running concurrently
+    class Scope {
+    public:
+        Scope(const QString &name);
+        ~Scope();
+
+    private:
+        QString       name_;
+        qint64        start_;
+        qint64        cpuStart_;
+        QElapsedTimer timer_;
+    };
+
+    void writeReport();
+
+private:
+    StartupProfiler();
+
+    struct Record {
+        QString name;
+        QString thread;
+        qint64  start; // usecs since the profiler was created
+        qint64  wall;
+        qint64  cpu; // of the recording thread
+    };
+
+    void          add(const Record &r);
+    static qint64 threadCpuTime();
+
+    QString       reportFile_;
+    QElapsedTimer clock_;
+    QMutex        mutex_;
+    QList<Record> records_;
+    QString       current_;
+    qint64        currentStart_    = 0;
+    qint64        currentCpuStart_ = 0;
+};
+
+#endif // STARTUPPROFILER_H
@@ -0,0 +1,155 @@
+/*
+ * startupscheduler.cpp - deferred initialization after the first paint
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "startupscheduler.h"
+
+#include "startupprofiler.h"
+
+#include <QEvent>
+#include <QTimer>
+#include <QWidget>
+#include <QtConcurrent>
+
+StartupScheduler::StartupScheduler(QObject *parent) : QObject(parent) { }
+
+StartupScheduler::~StartupScheduler() { pool_.waitForDone(); }
+
+void StartupScheduler::add(const QString &name, const QStringList &after, const std::function<void()> &work,
+                           const std::function<void()> &finish)
+{
+    Task task;
+    task.name   = name;
+    task.after  = after;
+    task.work   = work;
+    task.finish = finish;
+    tasks_.append(task);
+    if (started_)
+        schedule();
+}
+
+void StartupScheduler::startAfterPaint(QWidget *widget)
+{
+    if (!widget || !widget->isVisible()) {
+        QTimer::singleShot(0, this, &StartupScheduler::start);
+        return;
+    }
+    // the window paints its children when it handles the update request
+    widget_ = widget;
+    widget_->installEventFilter(this);
+}
+
+bool StartupScheduler::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == widget_ && event->type() == QEvent::UpdateRequest) {
+        widget_->removeEventFilter(this);
+        widget_ = nullptr;
+        QTimer::singleShot(0, this, &StartupScheduler::start);
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void StartupScheduler::start()
+{
+    if (started_)
+        return;
+    started_ = true;
+    schedule();
+}
+
+int StartupScheduler::indexOf(const QString &name) const
+{
+    for (int i = 0; i < tasks_.size(); ++i) {
+        if (tasks_[i].name == name)
+            return i;
+    }
+    return -1;
+}
+
+bool StartupScheduler::isReady(const Task &task) const
+{
+    for (const QString &name : task.after) {
+        int i = indexOf(name);
+        if (i != -1 && tasks_[i].state != Done)
+            return false;
+    }
+    return true;
+}
+
+void StartupScheduler::schedule()
+{
+    bool allDone = true;
+    for (int i = 0; i < tasks_.size(); ++i) {
+        Task &task = tasks_[i];
+        if (task.state != Done)
+            allDone = false;
+        if (task.state != Waiting || !isReady(task))
+            continue;
+
+        if (!task.work) {
+            task.state = Finishing;
+            continue;
+        }
+        task.state   = Working;
+        auto watcher = new QFutureWatcher<void>(this);
+        connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, name = task.name]() {
+            watcher->deleteLater();
+            tasks_[indexOf(name)].state = Finishing;
+            schedule();
+        });
+        watcher->setFuture(QtConcurrent::run(&pool_, [name = task.name, work = task.work]() {
+            StartupProfiler::Scope scope(name);
+            work();
+        }));
+    }
+
+    if (allDone) {
+        StartupProfiler::instance()->writeReport();
+        emit finished();
+        return;
+    }
+    // one finish per event loop pass, so the window stays responsive meanwhile
+    if (!finishQueued_) {
+        for (const Task &task : qAsConst(tasks_)) {
+            if (task.state == Finishing) {
+                finishQueued_ = true;
+                QTimer::singleShot(0, this, &StartupScheduler::runNextFinish);
+                break;
+            }
+        }
+    }
+}
+
+void StartupScheduler::runNextFinish()
+{
+    finishQueued_ = false;
+    for (int i = 0; i < tasks_.size(); ++i) {
+        if (tasks_[i].state != Finishing)
+            continue;
+        // may add more tasks
+        const Task task = tasks_[i];
+        if (task.finish) {
+            StartupProfiler::Scope scope(task.name);
+            task.finish();
+        }
+        tasks_[i].state = Done;
+        break;
+    }
+    schedule();
+}
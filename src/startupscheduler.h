@@ -0,0 +1,79 @@
+/*
+ * startupscheduler.h - deferred initialization after the first paint
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef STARTUPSCHEDULER_H
+#define STARTUPSCHEDULER_H
+
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include <QThreadPool>
+
+#include <functional>
+
+class QWidget;
+
+// Runs the parts of the startup which aren't needed to show the roster once the main window got painted.
+// A task may wait for others, tasks not waiting for each other have their work done in parallel.
+class StartupScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    explicit StartupScheduler(QObject *parent = nullptr);
+    ~StartupScheduler();
+
+    // work runs in a worker thread, finish in the gui thread after it. either may be empty
+    void add(const QString &name, const QStringList &after, const std::function<void()> &work,
+             const std::function<void()> &finish = std::function<void()>());
+
+    // starts once widget is painted, or right away if it isn't going to be shown
+    void startAfterPaint(QWidget *widget);
+
+signals:
+    void finished();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    enum State { Waiting, Working, Finishing, Done };
+
+    struct Task {
+        QString               name;
+        QStringList           after;
+        std::function<void()> work;
+        std::function<void()> finish;
+        State                 state = Waiting;
+    };
+
+    void start();
+    void schedule();
+    void runNextFinish();
+    bool isReady(const Task &task) const;
+    int  indexOf(const QString &name) const;
+
+    QList<Task> tasks_;
+    QThreadPool pool_;
+    QWidget *   widget_       = nullptr;
+    bool        started_      = false;
+    bool        finishQueued_ = false;
+};
+
+#endif // STARTUPSCHEDULER_H
@@ -24,6 +24,42 @@
 #include <QPalette>
 #include <QPixmapCache>
 
+// scaled variants kept per image
+#define SCALED_PIXMAP_VARIANTS 5
+
+bool ScaledPixmapCache::find(const QSize &size, qreal dpr, QPixmap *pm)
+{
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->size == size && qFuzzyCompare(it->dpr, dpr)) {
+            if (QPixmapCache::find(it->key, pm)) {
+                // most recently used go last
+                entries_.splice(entries_.end(), entries_, it);
+                return true;
+            }
+            entries_.erase(it); // evicted by QPixmapCache
+            return false;
+        }
+    }
+    return false;
+}
+
+void ScaledPixmapCache::insert(const QSize &size, qreal dpr, const QPixmap &pm)
+{
+    entries_.push_back(Entry { QPixmapCache::insert(pm), size, dpr });
+    if (entries_.size() > SCALED_PIXMAP_VARIANTS) {
+        QPixmapCache::remove(entries_.front().key);
+        entries_.pop_front();
+    }
+}
+
+void ScaledPixmapCache::clear()
+{
+    for (const Entry &e : entries_) {
+        QPixmapCache::remove(e.key);
+    }
+    entries_.clear();
+}
+
 QSize SvgIconEngine::actualSize(const QSize &size, QIcon::Mode mode, QIcon::State state)
 {
     Q_UNUSED(mode);
@@ -36,9 +72,12 @@ QIconEngine *SvgIconEngine::clone() const { return new SvgIconEngine(name, rende
 void SvgIconEngine::paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state)
 {
     Q_UNUSED(mode);
-    Q_UNUSED(state);
     auto r = rect.isEmpty() ? QRect(0, 0, painter->device()->width(), painter->device()->height()) : rect;
-    renderer->render(painter, r);
+    // rasterized once per size and dpr instead of rendering the svg on each paint
+    auto pm = scaledPixmap(r.size(), painter->device()->devicePixelRatioF(), QIcon::Normal, state);
+    QRect target(QPoint(), pm.size() / pm.devicePixelRatio());
+    target.moveCenter(r.center());
+    painter->drawPixmap(target, pm);
 }
 
 void SvgIconEngine::virtual_hook(int id, void *data)
@@ -58,7 +97,7 @@ void SvgIconEngine::virtual_hook(int id, void *data)
 #if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
     case QIconEngine::ScaledPixmapHook: {
         auto arg    = reinterpret_cast<ScaledPixmapArgument *>(data);
-        arg->pixmap = pixmap(arg->size * arg->scale, arg->mode, arg->state);
+        arg->pixmap = scaledPixmap(arg->size, arg->scale, arg->mode, arg->state);
         break;
     }
 #endif
@@ -67,40 +106,25 @@ void SvgIconEngine::virtual_hook(int id, void *data)
 
 QPixmap SvgIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
 {
-    QPixmap     pm;
-    static auto findCache = [](std::list<CacheEntry> &cache, const QSize &size, QPixmap &pm) mutable {
-        auto it = cache.begin();
-        while (it != cache.end()) {
-            if (it->size == size) {
-                if (QPixmapCache::find(it->key, &pm)) {
-                    return true;
-                }
-                cache.erase(it);
-                return false;
-            }
-            ++it;
-        }
-        return false;
-    };
-
-    static auto insertCache = [](std::list<CacheEntry> &cache, const QSize &size, const QPixmap &pm) mutable {
-        cache.push_back(CacheEntry { QPixmapCache::insert(pm), size });
-        if (cache.size() > 5) {
-            QPixmapCache::remove(cache.front().key);
-        }
-    };
+    return scaledPixmap(size, 1.0, mode, state);
+}
 
-    if (mode == QIcon::Disabled && findCache(disabledCache, size, pm))
+// size is in device independent pixels
+QPixmap SvgIconEngine::scaledPixmap(const QSize &size, qreal dpr, QIcon::Mode mode, QIcon::State state)
+{
+    Q_UNUSED(state)
+    QPixmap pm;
+    if (mode == QIcon::Disabled && disabledCache.find(size, dpr, &pm))
         return pm;
 
-    if (findCache(normalCache, size, pm)) {
+    if (normalCache.find(size, dpr, &pm)) {
         if (mode == QIcon::Active || mode == QIcon::Normal)
             return pm;
     }
 
     if (!pm) {
-        pm = renderPixmap(size, mode, state);
-        insertCache(normalCache, size, pm);
+        pm = renderPixmap(size, dpr);
+        normalCache.insert(size, dpr, pm);
     } // else we need selected or disabled from normal which we took from the cache
 
     if (mode == QIcon::Selected) {
@@ -130,18 +154,18 @@ QPixmap SvgIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State
             }
         }
         pm = QPixmap::fromImage(img);
-        insertCache(disabledCache, size, pm);
+        pm.setDevicePixelRatio(dpr);
+        disabledCache.insert(size, dpr, pm);
     }
 
     return pm;
 }
 
-QPixmap SvgIconEngine::renderPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state)
+QPixmap SvgIconEngine::renderPixmap(const QSize &size, qreal dpr)
 {
-    Q_UNUSED(mode)
-    Q_UNUSED(state)
     auto    sz = size.isEmpty() ? renderer->defaultSize() : renderer->defaultSize().scaled(size, Qt::KeepAspectRatio);
-    QPixmap pix(sz);
+    QPixmap pix(sz * dpr);
+    pix.setDevicePixelRatio(dpr);
     pix.fill(Qt::transparent);
     QPainter p(&pix);
     renderer->render(&p);
@@ -25,16 +25,29 @@
 #include <QSvgRenderer>
 #include <memory>
 
-class SvgIconEngine : public QIconEngine {
+// a few scaled variants of one image. they live in QPixmapCache, so all of them share its memory limit
+class ScaledPixmapCache {
+public:
+    ~ScaledPixmapCache() { clear(); }
 
-    QString                       name;
-    std::shared_ptr<QSvgRenderer> renderer;
+    bool find(const QSize &size, qreal dpr, QPixmap *pm);
+    void insert(const QSize &size, qreal dpr, const QPixmap &pm);
+    void clear();
 
-    struct CacheEntry {
+private:
+    struct Entry {
         QPixmapCache::Key key;
         QSize             size;
+        qreal             dpr;
     };
-    std::list<CacheEntry> normalCache, disabledCache;
+    std::list<Entry> entries_;
+};
+
+class SvgIconEngine : public QIconEngine {
+
+    QString                       name;
+    std::shared_ptr<QSvgRenderer> renderer;
+    ScaledPixmapCache             normalCache, disabledCache;
 
 public:
     SvgIconEngine(const QString &name, std::shared_ptr<QSvgRenderer> renderer) : name(name), renderer(renderer) { }
@@ -47,7 +60,8 @@ public:
     QPixmap pixmap(const QSize &size, QIcon::Mode mode, QIcon::State state) override;
 
 private:
-    QPixmap renderPixmap(const QSize &size, QIcon::Mode mode, QIcon::State state);
+    QPixmap scaledPixmap(const QSize &size, qreal dpr, QIcon::Mode mode, QIcon::State state);
+    QPixmap renderPixmap(const QSize &size, qreal dpr);
 };
 
 #endif // SVGICONENGINE_H
@@ -333,7 +333,9 @@ bool SxeManager::processNegotiationAsJoiner(const QDomNode &negotiationElement,
             }
 
             negotiation->session->startImporting(doc);
-            negotiation->state = SxeNegotiation::DocumentBegan;
+            negotiation->state     = SxeNegotiation::DocumentBegan;
+            negotiation->importSxe = negotiation->importDoc.createElementNS(SXENS, "sxe");
+            negotiation->importSxe.setAttribute("session", negotiation->sessionId);
         } else {
             // creating the session failed for some reason
             qDebug("Failed to create session.");
@@ -343,17 +345,20 @@ bool SxeManager::processNegotiationAsJoiner(const QDomNode &negotiationElement,
 
     } else if (negotiationElement.nodeName() != "document-end" && negotiation->state == SxeNegotiation::DocumentBegan) {
 
-        // pass the edit to the session
-        QDomElement sxe = doc.createElementNS(SXENS, "sxe");
-        sxe.setAttribute("session", negotiation->sessionId);
-        sxe.appendChild(negotiationElement.cloneNode());
-        negotiation->session->processIncomingSxeElement(sxe, QString());
+        // collect the edit, the whole document is passed to the session at once
+        negotiation->importSxe.appendChild(negotiation->importDoc.importNode(negotiationElement, true));
 
     } else if (negotiationElement.nodeName() == "document-end" && negotiation->state == SxeNegotiation::DocumentBegan) {
 
         // The initial document has been received and we're done
         negotiation->state = SxeNegotiation::Finished;
 
+        // build the document in one pass, with a single documentUpdated()
+        if (negotiation->importSxe.hasChildNodes())
+            negotiation->session->processIncomingSxeElement(negotiation->importSxe, QString());
+        negotiation->importSxe = QDomElement();
+        negotiation->importDoc = QDomDocument();
+
         // Decode the 'used-sxe-ids' field
         const auto tmp = negotiationElement.toElement().attribute("used-sxe-ids").split(";");
         for (const QString &usedId : tmp)
@@ -401,9 +406,8 @@ QPointer<SxeSession> SxeManager::processNegotiationMessage(const Message &messag
     QDomElement response = doc.createElementNS(SXENS, "negotiation");
 
     // Process each child of the <sxe/>
-    QDomNode n;
-    for (int i = 0; i < message.sxe().childNodes().count(); i++) {
-        n = message.sxe().childNodes().at(i);
+    // (siblings are walked directly, indexing childNodes() restarts from the first child every time)
+    for (QDomNode n = message.sxe().firstChild(); !n.isNull(); n = n.nextSibling()) {
 
         // skip non-elements
         if (!n.isElement())
@@ -412,13 +416,13 @@ QPointer<SxeSession> SxeManager::processNegotiationMessage(const Message &messag
         if (n.nodeName() == "negotiation") {
 
             // Process each child element of <negotiation/>
-            for (int j = 0; j < n.childNodes().count(); j++) {
+            for (QDomNode child = n.firstChild(); !child.isNull(); child = child.nextSibling()) {
 
                 if (negotiation->role == SxeNegotiation::Participant) {
-                    if (!processNegotiationAsParticipant(n.childNodes().at(j), negotiation, response))
+                    if (!processNegotiationAsParticipant(child, negotiation, response))
                         return nullptr;
                 } else if (negotiation->role == SxeNegotiation::Joiner) {
-                    if (!processNegotiationAsJoiner(n.childNodes().at(j), negotiation, response, message))
+                    if (!processNegotiationAsJoiner(child, negotiation, response, message))
                         return nullptr;
                 } else {
                     Q_ASSERT(false);
@@ -93,6 +93,11 @@ class SxeManager : public QObject {
         QList<QString> features;
         /*! \brief The session created for this negotiation.*/
         QPointer<SxeSession> session;
+        /*! \brief The edits received between <document-begin/> and <document-end/>.
+         *      They are applied to the session in one pass at <document-end/>.
+         */
+        QDomDocument importDoc;
+        QDomElement  importSxe;
     };
 
 public:
@@ -24,11 +24,19 @@
 #include "QTimer"
 #include "QUuid"
 
+// how many processed <sxe/> ids are remembered for rejecting duplicates
+#define SXE_USED_IDS_WINDOW 10000
+
 using namespace XMPP;
 
 // The maxlength of a chdata that gets put in one edit
 enum { MAXCHDATA = 1024 };
 
+// edits flushed within this window go out in one <sxe/>
+#define SXE_FLUSH_WINDOW 40 // ms
+// and consecutive <sxe/> elements are at least this far apart
+#define SXE_MIN_SEND_INTERVAL 100 // ms
+
 //----------------------------------------------------------------------------
 // SxeSession
 //----------------------------------------------------------------------------
@@ -40,6 +48,10 @@ SxeSession::SxeSession(SxeManager *manager, const Jid &target, const QString &se
     queueing_(false), importing_(false), features_(features), uuidMaxPostfix_(0)
 
 {
+    flushTimer_ = new QTimer(this);
+    flushTimer_->setSingleShot(true);
+    connect(flushTimer_, SIGNAL(timeout()), SLOT(sendQueuedEdits()));
+
     setUUIDPrefix();
 }
 
@@ -65,6 +77,7 @@ void SxeSession::initializeDocument(const QDomDocument &doc)
     // recordByNode_.clear();
     recordByNodeId_.clear();
     queuedIncomingEdits_.clear();
+    queuedIncomingIds_.clear();
     queuedOutgoingEdits_.clear();
 
     // import prolog
@@ -105,15 +118,14 @@ bool SxeSession::processSxe(const QDomElement &sxe, const QString &id)
         return false;
     }
 
-    if (!id.isEmpty())
-        usedSxeIds_ += id;
-
     // store incoming edits when queueing
     if (queueing_) {
         // Make sure the element is not already in the queue.
-        for (const IncomingEdit &i : qAsConst(queuedIncomingEdits_))
-            if (i.xml == sxe)
+        if (!id.isEmpty()) {
+            if (queuedIncomingIds_.contains(id))
                 return false;
+            queuedIncomingIds_ += id;
+        }
 
         IncomingEdit incoming;
         incoming.id  = id;
@@ -123,6 +135,10 @@ bool SxeSession::processSxe(const QDomElement &sxe, const QString &id)
         return false;
     }
 
+    // the id is used once the edit is applied, so queued edits aren't rejected as their own duplicates
+    if (!id.isEmpty())
+        addUsedSxeId(id);
+
     // create an SxeEdit for each child of the <sxe/>
     QList<SxeEdit *> edits;
     for (QDomNode n = sxe.firstChild(); !n.isNull(); n = n.nextSibling()) {
@@ -174,6 +190,9 @@ QList<const SxeEdit *> SxeSession::startQueueing()
 
     queueing_ = true;
 
+    // the snapshot includes our pending edits, so they must reach the others before it
+    sendQueuedEdits();
+
     // Return all the effective Edits to the session so far (snapshot)
     // make sure that they are added in the right order (parents first)
     QString                      rootid;
@@ -230,6 +249,7 @@ void SxeSession::stopQueueing()
             IncomingEdit queued = queuedIncomingEdits_.takeFirst();
             processSxe(queued.xml, queued.id);
         }
+        queuedIncomingIds_.clear();
 
         emit documentUpdated(true);
     }
@@ -253,7 +273,12 @@ void SxeSession::stopImporting()
     importing_ = false;
 }
 
-void SxeSession::endSession() { deleteLater(); }
+void SxeSession::endSession()
+{
+    // whatever is still pending goes out before SxeManager announces that we left
+    sendQueuedEdits();
+    deleteLater();
+}
 
 const QDomNode SxeSession::insertNodeBefore(const QDomNode &node, const QDomNode &parent, const QDomNode &referenceNode)
 {
@@ -466,6 +491,19 @@ void SxeSession::setNodeValue(const QDomNode &node, const QString &value, int fr
 
 void SxeSession::flush()
 {
+    if (queuedOutgoingEdits_.isEmpty() || flushTimer_->isActive())
+        return;
+
+    // pace the stanzas, erasing for example flushes on every mouse move
+    int delay = SXE_FLUSH_WINDOW;
+    if (lastSent_.isValid())
+        delay = qMax(delay, int(SXE_MIN_SEND_INTERVAL - lastSent_.elapsed()));
+    flushTimer_->start(delay);
+}
+
+void SxeSession::sendQueuedEdits()
+{
+    flushTimer_->stop();
     if (queuedOutgoingEdits_.isEmpty())
         return;
 
@@ -481,6 +519,7 @@ void SxeSession::flush()
 
     // pass the bundle to SxeManager
     emit newSxeElement(sxe, target(), groupChat_);
+    lastSent_.start();
 }
 
 QDomNode SxeSession::generateNewNode(const QDomNode node, const QString &parent, double primaryWeight)
@@ -702,9 +741,17 @@ bool SxeSession::removeSmaller(SxeRecord *meta1, SxeRecord *meta2)
     }
 }
 
-void SxeSession::addUsedSxeId(QString id) { usedSxeIds_ += id; }
+void SxeSession::addUsedSxeId(const QString &id)
+{
+    if (usedSxeIds_.contains(id))
+        return;
+    usedSxeIds_ += id;
+    usedSxeIdOrder_.enqueue(id);
+    while (usedSxeIdOrder_.size() > SXE_USED_IDS_WINDOW)
+        usedSxeIds_.remove(usedSxeIdOrder_.dequeue());
+}
 
-QList<QString> SxeSession::usedSxeIds() { return usedSxeIds_; }
+QList<QString> SxeSession::usedSxeIds() const { return usedSxeIdOrder_; }
 
 void SxeSession::queueOutgoingEdit(SxeEdit *edit)
 {
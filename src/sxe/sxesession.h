@@ -24,13 +24,17 @@
 #include "sxerecord.h"
 
 #include <QDomNode>
+#include <QElapsedTimer>
 #include <QList>
 #include <QObject>
 #include <QPointer>
+#include <QQueue>
+#include <QSet>
 
 #define SXENS "http://jabber.org/protocol/sxe"
 /*  ^^^^ make sure corresponds to NS used for parsing in iris/src/xmpp/xmpp-im/types.cpp ^^^^ */
 
+class QTimer;
 class SxeManager;
 
 namespace XMPP {
@@ -101,10 +105,12 @@ public:
      */
     void stopImporting();
 
-    /*! \brief Add the given ID to the list of used IDs for <sxe/> elements.*/
-    void addUsedSxeId(QString id);
-    /*! \brief Return the list of used IDs for <sxe/> elements.*/
-    QList<QString> usedSxeIds();
+    /*! \brief Add the given ID to the list of used IDs for <sxe/> elements.
+     *  Only the most recent SXE_USED_IDS_WINDOW IDs are remembered.
+     */
+    void addUsedSxeId(const QString &id);
+    /*! \brief Return the list of used IDs for <sxe/> elements, oldest first.*/
+    QList<QString> usedSxeIds() const;
 
     void setUUIDPrefix(const QString uuidPrefix = QString());
     /*! \brief Returns a random UUID without enclosing { }. */
@@ -134,7 +140,9 @@ public slots:
     /*! \brief Sets the value of \a node to \a value. */
     void setNodeValue(const QDomNode &node, const QString &value, int from = -1, int n = 0);
 
-    /*! \brief Sends all queued edits.*/
+    /*! \brief Sends all queued edits.
+     *  Edits flushed within a short window are sent together as one <sxe/> element.
+     */
     void flush();
 
 signals:
@@ -170,6 +178,8 @@ signals:
     void sessionEnded(SxeSession *);
 
 private slots:
+    /*! \brief Passes all queued edits to SxeManager as one <sxe/> element.*/
+    void sendQueuedEdits();
     /*! \brief Adds \a node to the document tree and emits the appropriate public signals. */
     void handleNodeToBeAdded(const QDomNode &node, bool remote);
     /*! \brief Moves \a node in the document tree and emits the appropriate public signals. */
@@ -225,8 +235,14 @@ private:
     QHash<QString, SxeRecord *> recordByNodeId_;
     /*! \brief List of queued incoming sxe elements.*/
     QList<IncomingEdit> queuedIncomingEdits_;
+    /*! \brief Identifiers of the elements in queuedIncomingEdits_.*/
+    QSet<QString> queuedIncomingIds_;
     /*! \brief List of queued outgoing sxe elements.*/
     QList<QDomNode> queuedOutgoingEdits_;
+    /*! \brief Delays flush() so that bursts of edits share one stanza.*/
+    QTimer *flushTimer_;
+    /*! \brief Time since the last <sxe/> element was sent.*/
+    QElapsedTimer lastSent_;
     /*! \brief QDomDocument representing the the contents when queueing_ was set true.*/
     QList<SxeEdit *> snapshot_;
     /*! \brief True if the target is a groupchat.*/
@@ -240,7 +256,9 @@ private:
     /*! \brief A list of supported features for the session.*/
     QList<QString> features_;
     /*! \brief Identifiers for the <sxe/> elements that have been processed already.*/
-    QList<QString> usedSxeIds_;
+    QSet<QString> usedSxeIds_;
+    /*! \brief The same identifiers in the order they were used, for trimming the window.*/
+    QQueue<QString> usedSxeIdOrder_;
     /*! \brief A unique id is generated as "uuidPrefix.counter".*/
     QString uuidPrefix_;
     int     uuidMaxPostfix_;
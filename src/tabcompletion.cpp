@@ -56,17 +56,6 @@ void TabCompletion::highlight(bool set)
         }*/
 }
 
-void TabCompletion::moveCursorToOffset(QTextCursor &cur, int offset, QTextCursor::MoveMode mode)
-{
-    cur.movePosition(QTextCursor::Start, mode);
-    for (int i = 0; i < offset; i++) { // some sane limit on iterations
-        if (cur.position() >= offset)
-            break; // done our work
-        if (!cur.movePosition(QTextCursor::NextCharacter, mode))
-            break; // failed?
-    }
-}
-
 /** Find longest common (case insensitive) prefix of \a list.
  */
 QString TabCompletion::longestCommonPrefix(QStringList list)
@@ -186,8 +175,8 @@ void TabCompletion::tryComplete()
         int begin, end;
         setup(wholeText, cursor.position(), begin, end);
         replacementCursor_ = QTextCursor(textEdit_->document());
-        moveCursorToOffset(replacementCursor_, begin);
-        moveCursorToOffset(replacementCursor_, end, QTextCursor::KeepAnchor);
+        replacementCursor_.setPosition(begin);
+        replacementCursor_.setPosition(end, QTextCursor::KeepAnchor);
 
         if (toComplete_.isEmpty() && typingStatus_ == TypingStatus::TabbingCompletions) {
             typingStatus_ = TypingStatus::MultipleSuggestions;
@@ -220,7 +209,7 @@ void TabCompletion::tryComplete()
 
         QTextCursor newPos(replacementCursor_);
 
-        moveCursorToOffset(replacementCursor_, start, QTextCursor::KeepAnchor);
+        replacementCursor_.setPosition(start, QTextCursor::KeepAnchor);
 
         newPos.clearSelection();
 
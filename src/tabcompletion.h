@@ -52,8 +52,6 @@ private:
     QString longestCommonPrefix(QStringList list);
     QString suggestCompletion(bool *replaced);
 
-    void moveCursorToOffset(QTextCursor &cur, int offset, QTextCursor::MoveMode mode = QTextCursor::MoveAnchor);
-
     enum class TypingStatus : char {
         Normal,
         TabPressed,         // initial completion
@@ -2,6 +2,7 @@
 
 #include "coloropt.h"
 #include "common.h"
+#include "debug.h"
 #include "emojiregistry.h"
 #include "psiiconset.h"
 #include "psioptions.h"
@@ -488,86 +489,325 @@ QString TextUtil::linkify(const QString &in)
 // sickening
 QString TextUtil::emoticonify(const QString &in)
 {
+    TRACE_SCOPE("TextUtil::emoticonify");
+    const EmoticonMatcher &matcher = PsiIconset::instance()->emoticonMatcher();
+
     RTParse p(in);
     while (!p.atEnd()) {
         // returns us the first chunk as a plaintext string
         QString str = p.next();
 
-        int i = 0;
-        while (i >= 0) {
-            // find closest emoticon
-            int      ePos    = -1;
-            PsiIcon *closest = nullptr;
-
-            int foundPos = -1, foundLen = -1;
-
-            for (const Iconset *iconset : qAsConst(PsiIconset::instance()->emoticons)) {
-                QListIterator<PsiIcon *> it = iconset->iterator();
-                while (it.hasNext()) {
-                    PsiIcon *icon = it.next();
-                    if (icon->regExp().isEmpty())
-                        continue;
-
-                    // some hackery
-                    int  iii = i;
-                    bool searchAgain;
-
-                    // search the first occurance of the emoticon in the remaining text
-                    // which is surronded with at least one space
-                    do {
-                        searchAgain = false;
-
-                        // find the closest match
-                        const QRegExp &rx = icon->regExp();
-                        int            n  = rx.indexIn(str, iii);
-                        if (n == -1)
-                            continue;
-
-                        if (ePos == -1 || n < ePos || (rx.matchedLength() > foundLen && n < ePos + foundLen)) {
-                            bool leftSpace  = n == 0 || (n > 0 && str[n - 1].isSpace());
-                            bool rightSpace = (n + rx.matchedLength() == int(str.length()))
-                                || (n + rx.matchedLength() < int(str.length())
-                                    && str[n + rx.matchedLength()].isSpace());
-                            // there must be whitespace at least on one side of the emoticon
-                            if (leftSpace || rightSpace) {
-                                ePos    = n;
-                                closest = icon;
-
-                                foundPos = n;
-                                foundLen = rx.matchedLength();
-                                break;
-                            }
-
-                            searchAgain = true;
-                        }
-
-                        iii = n + rx.matchedLength();
-                    } while (searchAgain);
-                }
-            }
-
-            QString s;
-            if (ePos == -1)
-                s = str.mid(i);
-            else
-                s = str.mid(i, ePos - i);
-            emojiconifyPlainText(p, s);
-            // p.putPlain(s);
-
-            if (!closest)
-                break;
-
+        int        i       = 0;
+        const auto matches = matcher.match(str);
+        for (const EmoticonMatcher::Match &m : matches) {
+            emojiconifyPlainText(p, str.mid(i, m.pos - i));
             p.putRich(QString("<icon name=\"%1\" text=\"%2\" size=\"%3\" type=\"smiley\">")
-                          .arg(TextUtil::escape(closest->name()), TextUtil::escape(str.mid(foundPos, foundLen)),
+                          .arg(TextUtil::escape(m.icon->name()), TextUtil::escape(str.mid(m.pos, m.length)),
                                QString::number(-1.4)));
-            i = foundPos + foundLen;
+            i = m.pos + m.length;
         }
+        emojiconifyPlainText(p, str.mid(i));
     }
 
     QString out = p.output();
     return out;
 }
 
+// plain2rich, linkify, emoticonify and legacyFormat in a single walk over plain text
+class PlainFormatter {
+public:
+    PlainFormatter(const QString &in, int flags) : in(in), flags(flags) { out.reserve(in.size() * 5 / 4 + 16); }
+
+    QString format();
+
+private:
+    int  putChar(int i);
+    int  putLink(int i, int limit);
+    int  putAtStyle(int i);
+    int  putEmoticon(int i);
+    int  putEmoji(int i);
+    bool openLegacy(int i);
+    void closeLegacy();
+    bool emoticonAt(int i) const;
+
+    const QString &in;
+    const int      flags;
+    QString        out;
+
+    QList<EmoticonMatcher::Match> emoticons;
+    int                           nextEmoticon = 0;
+    int                           emojiPos     = -1; // of the next emoji, in.size() if none left
+    int                           emojiLen     = 0;
+    int                           legacyClose  = -1; // position of the pending legacy markup closing char
+    QLatin1String                 legacyTag { "" };
+};
+
+QString PlainFormatter::format()
+{
+    if (flags & TextUtil::FormatEmoticons)
+        emoticons = PsiIconset::instance()->emoticonMatcher().match(in);
+
+    for (int i = 0; i < in.size();) {
+        if (i == legacyClose) {
+            out += in[i];
+            closeLegacy();
+            ++i;
+            continue;
+        }
+
+        int next = i;
+        if (flags & TextUtil::FormatLinks) {
+            next = putLink(i, legacyClose == -1 ? in.size() : legacyClose);
+            if (next == i)
+                next = putAtStyle(i);
+        }
+        if (next == i && (flags & TextUtil::FormatEmoticons)) {
+            next = putEmoticon(i);
+            if (next == i)
+                next = putEmoji(i);
+        }
+        if (next == i && (flags & TextUtil::FormatLegacy) && legacyClose == -1 && openLegacy(i))
+            next = i + 1;
+        if (next == i)
+            next = i + putChar(i);
+
+        // a token swallowed the closing char, keep the markup balanced
+        if (legacyClose != -1 && next > legacyClose)
+            closeLegacy();
+        i = next;
+    }
+    if (legacyClose != -1)
+        closeLegacy();
+    return out;
+}
+
+void PlainFormatter::closeLegacy()
+{
+    out += QLatin1String("</");
+    out += legacyTag;
+    out += QLatin1Char('>');
+    legacyClose = -1;
+}
+
+// same as plain2rich() for one char, returns chars consumed
+int PlainFormatter::putChar(int i)
+{
+    const QChar c = in[i];
+#ifdef Q_OS_WIN
+    if (c == '\r' && i + 1 < in.size() && in[i + 1] == '\n') {
+        out += "<br>";
+        return 2;
+    }
+#endif
+    if (c == '\n')
+        out += "<br>";
+    else if (c == ' ' && !out.isEmpty() && out[out.size() - 1] == ' ')
+        out += "&nbsp;";
+    else if (c == '\t')
+        out += "&nbsp; &nbsp; &nbsp; ";
+    else if (c == '<')
+        out += "&lt;";
+    else if (c == '>')
+        out += "&gt;";
+    else if (c == '\"')
+        out += "&quot;";
+    else if (c == '\'')
+        out += "&apos;";
+    else if (c == '&')
+        out += "&amp;";
+    else
+        out += c;
+    return 1;
+}
+
+// see TextUtil::linkify()
+int PlainFormatter::putLink(int i, int limit)
+{
+    static const struct {
+        const char *prefix;
+        int         skip;
+        const char *href;
+    } schemes[] = {
+        { "xmpp:", 5, "" },   { "mailto:", 7, "" }, { "http://", 7, "" }, { "https://", 8, "" },
+        { "ftp://", 6, "" },  { "news://", 7, "" }, { "ed2k://", 7, "" }, { "file://", 7, "" },
+        { "magnet:", 7, "" }, { "www.", 0, "http://" }, { "ftp.", 0, "ftp://" },
+    };
+
+    const QChar c = in[i].toLower();
+    if (!(c == 'x' || c == 'm' || c == 'h' || c == 'f' || c == 'n' || c == 'e' || c == 'w'))
+        return i;
+    // make sure the previous char is not alphanumeric
+    if (i > 0 && in[i - 1].isLetterOrNumber())
+        return i;
+
+    int         n    = -1;
+    const char *href = nullptr;
+    for (const auto &s : schemes) {
+        if (linkify_pmatch(in, i, QLatin1String(s.prefix))) {
+            n    = i + s.skip;
+            href = s.href;
+            break;
+        }
+    }
+    if (n == -1)
+        return i;
+
+    // find whitespace (or end)
+    QMap<QChar, int> brackets;
+    brackets['('] = brackets[')'] = brackets['['] = brackets[']'] = brackets['{'] = brackets['}'] = 0;
+    QMap<QChar, QChar> openingBracket;
+    openingBracket[')'] = '(';
+    openingBracket[']'] = '[';
+    openingBracket['}'] = '{';
+    int x2;
+    for (x2 = n; x2 < limit; ++x2) {
+        if (in.at(x2).isSpace() || linkify_isOneOf(in.at(x2), "\"\'`<>"))
+            break;
+        if (brackets.contains(in.at(x2)))
+            ++brackets[in.at(x2)];
+    }
+    const QString pre = in.mid(i, x2 - i);
+
+    // go backward hacking off unwanted punctuation
+    int cutoff;
+    for (cutoff = pre.length() - 1; cutoff >= 0; --cutoff) {
+        if (!linkify_isOneOf(pre.at(cutoff), "!?,.()[]{}<>\""))
+            break;
+        if (linkify_isOneOf(pre.at(cutoff), ")]}")
+            && brackets[pre.at(cutoff)] - brackets[openingBracket[pre.at(cutoff)]] <= 0) {
+            break;
+        }
+        if (brackets.contains(pre.at(cutoff)))
+            --brackets[pre.at(cutoff)];
+    }
+    ++cutoff;
+
+    const QString link = pre.left(cutoff);
+    if (link.isEmpty() || !linkify_okUrl(link))
+        return i;
+
+    const QString url = linkify_htmlsafe(TextUtil::escape(QLatin1String(href) + link));
+#ifdef WEBKIT
+    out += QString("<a href=\"%1\">").arg(url);
+#else
+    auto linkColor = ColorOpt::instance()->color("options.ui.look.colors.messages.link");
+    out += QString("<a href=\"%1\" style=\"color:%2\">").arg(url, linkColor.name());
+#endif
+    out += TextUtil::escape(link) + QLatin1String("</a>");
+    // trailing punctuation goes through the normal path
+    return i + cutoff;
+}
+
+static bool linkify_isAtStyleChar(const QChar &c) { return c.isLetterOrNumber() || linkify_isOneOf(c, "_.-+"); }
+
+// user@host.domain at the start of a word
+int PlainFormatter::putAtStyle(int i)
+{
+    if (!linkify_isAtStyleChar(in[i]) || (i > 0 && linkify_isAtStyleChar(in[i - 1])))
+        return i;
+
+    int at = i + 1;
+    while (at < in.size() && linkify_isAtStyleChar(in[at]))
+        ++at;
+    if (at == in.size() || in[at] != '@')
+        return i;
+    int x2 = at + 1;
+    while (x2 < in.size() && linkify_isAtStyleChar(in[x2]))
+        ++x2;
+
+    const QString link = in.mid(i, x2 - i);
+    if (!linkify_okEmail(link))
+        return i;
+    out += QString("<a href=\"x-psi-atstyle:%1\">").arg(link) + link + QLatin1String("</a>");
+    return x2;
+}
+
+bool PlainFormatter::emoticonAt(int i) const
+{
+    for (int k = nextEmoticon; k < emoticons.size() && emoticons[k].pos <= i; ++k) {
+        if (emoticons[k].pos == i)
+            return true;
+    }
+    return false;
+}
+
+int PlainFormatter::putEmoticon(int i)
+{
+    while (nextEmoticon < emoticons.size() && emoticons[nextEmoticon].pos < i)
+        ++nextEmoticon;
+    if (nextEmoticon == emoticons.size() || emoticons[nextEmoticon].pos != i)
+        return i;
+
+    const EmoticonMatcher::Match &m = emoticons[nextEmoticon++];
+    out += QString("<icon name=\"%1\" text=\"%2\" size=\"%3\" type=\"smiley\">")
+               .arg(TextUtil::escape(m.icon->name()), TextUtil::escape(in.mid(m.pos, m.length)),
+                    QString::number(-1.4));
+    return i + m.length;
+}
+
+// a run of adjacent emojis, see emojiconifyPlainText()
+int PlainFormatter::putEmoji(int i)
+{
+    const auto &reg = EmojiRegistry::instance();
+    if (i > emojiPos) {
+        const QStringRef ref = reg.findEmoji(in, i);
+        emojiPos             = ref.isEmpty() ? in.size() : ref.position();
+        emojiLen             = ref.size();
+    }
+    if (emojiPos != i)
+        return i;
+
+    int end = i;
+    while (emojiPos == end) {
+        end += emojiLen;
+        const QStringRef ref = reg.findEmoji(in, end);
+        emojiPos             = ref.isEmpty() ? in.size() : ref.position();
+        emojiLen             = ref.size();
+    }
+#if defined(WEBKIT) || defined(WEBENGINE)
+    out += QLatin1String(R"html(<span class="emojis">)html")
+#else
+    out += QLatin1String(
+        R"html(<span style="font-family: 'Apple Color Emoji', 'Noto Color Emoji', 'Segoe UI Emoji'; font-size:1.5em">)html")
+#endif
+        + in.midRef(i, end - i) + QLatin1String("</span>");
+    return end;
+}
+
+// see TextUtil::legacyFormat()
+bool PlainFormatter::openLegacy(int i)
+{
+    const QChar c = in[i];
+    if (c == '_')
+        legacyTag = QLatin1String("u");
+    else if (c == '*')
+        legacyTag = QLatin1String("b");
+    else if (c == '/')
+        legacyTag = QLatin1String("i");
+    else
+        return false;
+    if (!out.isEmpty() && !out.endsWith('>') && !out[out.size() - 1].isSpace())
+        return false;
+
+    int end = i + 1;
+    while (end < in.size() && !in[end].isSpace())
+        ++end;
+    // the last marker char followed by whitespace, the end or an emoticon
+    for (int k = end - 1; k > i + 1; --k) {
+        if (in[k] == c && (k + 1 == end || emoticonAt(k + 1))) {
+            out += QLatin1Char('<');
+            out += legacyTag;
+            out += QLatin1Char('>');
+            out += c;
+            legacyClose = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+QString TextUtil::formatPlain(const QString &plain, int flags) { return PlainFormatter(plain, flags).format(); }
+
 QString TextUtil::img2title(const QString &in)
 {
     QString ret = in;
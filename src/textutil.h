@@ -20,6 +20,10 @@ QString legacyFormat(const QString &);
 QString emoticonify(const QString &in);
 QString img2title(const QString &in);
 
+enum FormatFlag { FormatLinks = 0x1, FormatEmoticons = 0x2, FormatLegacy = 0x4 };
+// plain2rich() followed by the flagged steps, done in one pass
+QString formatPlain(const QString &plain, int flags);
+
 QString prepareMessageText(const QString &text, bool isEmote = false, bool isHtml = false);
 
 QString sizeUnit(qlonglong n, qlonglong *div = nullptr);
@@ -26,14 +26,27 @@
 #include "psithemeprovider.h"
 #include "theme_p.h"
 #ifdef Theme_ZIP
-#include "zip/zip.h"
+#include "ziparchives.h"
 #endif
 
+#include <QDateTime>
 #include <QDir>
 #include <QDirIterator>
 #include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
 #include <QStringList>
 
+namespace {
+struct CaseFoldedIndex {
+    qint64                  mtime;
+    QHash<QString, QString> paths; // lower case relative path => real relative path
+};
+
+QMutex                          indexMutex;
+QHash<QString, CaseFoldedIndex> indexes; // theme dir => its index
+}
+
 //--------------------------------------
 // Theme
 //--------------------------------------
@@ -80,7 +93,7 @@ QWidget *Theme::previewWidget() { return d->previewWidget(); }
 bool Theme::isCompressed(const QFileInfo &fi)
 {
     QString sfx = fi.suffix();
-    return fi.isDir() && (sfx == QLatin1String("jisp") || sfx == QLatin1String("zip") || sfx == QLatin1String("theme"));
+    return !fi.isDir() && (sfx == QLatin1String("jisp") || sfx == QLatin1String("zip") || sfx == QLatin1String("theme"));
 }
 
 bool Theme::isCompressed() const { return isCompressed(QFileInfo(d->filepath)); }
@@ -96,33 +109,12 @@ QByteArray Theme::loadData(const QString &fileName, const QString &themePath, bo
     if (fi.isDir()) {
         QFile file(themePath + '/' + fileName);
         if (caseInsensetive && !file.exists()) {
-            QDir       d(themePath);
-            const auto tmp = fileName.toLower().split('/');
-            for (const QString &name : tmp) {
-                if (name.isEmpty()) { // force relative path and drop double slahses
-                    continue;
-                }
-                QDirIterator di(d);
-                QFileInfo    fi;
-                bool         found = false;
-                while (di.hasNext()) {
-                    di.next();
-                    if (di.fileName().compare(name, Qt::CaseInsensitive) == 0) {
-                        found = true;
-                        fi    = di.fileInfo();
-                        break;
-                    }
-                }
-                if (!found) {
-                    qDebug("%s Not found: %s/%s", __FUNCTION__, qPrintable(d.path()), qPrintable(name));
-                    return ba;
-                }
-                if (fi.isFile()) {
-                    file.setFileName(fi.filePath());
-                    break;
-                }
-                d.cd(fi.fileName()); // so that was directory. go into.
+            QString real = caseFoldedPath(fileName, themePath);
+            if (real.isEmpty()) {
+                qDebug("%s Not found: %s/%s", __FUNCTION__, qPrintable(themePath), qPrintable(fileName));
+                return ba;
             }
+            file.setFileName(themePath + '/' + real);
         }
         // qDebug("read data from %s", qPrintable(file.fileName()));
         if (!file.open(QIODevice::ReadOnly)) {
@@ -137,21 +129,11 @@ QByteArray Theme::loadData(const QString &fileName, const QString &themePath, bo
     }
 #ifdef Theme_ZIP
     else if (fi.suffix() == "jisp" || fi.suffix() == "zip" || fi.suffix() == "theme") {
-        UnZip z(themePath);
-        if (!z.open())
-            return ba;
-        if (caseInsensetive) {
-            z.setCaseSensitivity(UnZip::CS_Insensitive);
-        }
-
-        QString n = fi.completeBaseName() + '/' + fileName;
-        if (!z.readFile(n, &ba)) {
-            n = "/" + fileName;
-            if (loaded) {
-                *loaded = z.readFile(n, &ba);
-            } else {
-                z.readFile(n, &ba);
-            }
+        QString n  = fi.completeBaseName() + '/' + fileName;
+        bool    ok = ZipArchives::readFile(themePath, n, &ba, caseInsensetive)
+            || ZipArchives::readFile(themePath, "/" + fileName, &ba, caseInsensetive);
+        if (loaded) {
+            *loaded = ok;
         }
     }
 #endif
@@ -161,6 +143,32 @@ QByteArray Theme::loadData(const QString &fileName, const QString &themePath, bo
 
 QByteArray Theme::loadData(const QString &fileName, bool *loaded) const { return d->loadData(fileName, loaded); }
 
+QString Theme::caseFoldedPath(const QString &fileName, const QString &themeDir)
+{
+    const QString dir   = QDir(themeDir).path();
+    const qint64  mtime = QFileInfo(dir).lastModified().toMSecsSinceEpoch();
+
+    QMutexLocker locker(&indexMutex);
+    auto         it = indexes.find(dir);
+    if (it == indexes.end() || it->mtime != mtime) {
+        CaseFoldedIndex index { mtime, {} };
+        const int       skip = dir.length() + 1;
+        QDirIterator    di(dir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+        while (di.hasNext()) {
+            QString real = di.next().mid(skip);
+            index.paths.insert(real.toLower(), real);
+        }
+        it = indexes.insert(dir, index);
+    }
+
+    // force relative path and drop double slashes
+    QString key = QDir::cleanPath(fileName.toLower());
+    while (key.startsWith(QLatin1Char('/'))) {
+        key.remove(0, 1);
+    }
+    return it->paths.value(key);
+}
+
 Theme::ResourceLoader *Theme::resourceLoader() const { return d->resourceLoader(); }
 
 const QString Theme::id() const { return d ? d->id : QString(); }
@@ -81,6 +81,9 @@ public:
                                bool *loaded = nullptr);
     QByteArray        loadData(const QString &fileName, bool *loaded = nullptr) const;
     ResourceLoader *  resourceLoader() const;
+    // real path of `fileName` in theme directory `themeDir` matched case insensitively, empty if there is none.
+    // all the directory is indexed on first use and then again only when it changes
+    static QString caseFoldedPath(const QString &fileName, const QString &themeDir);
 
     const QString      id() const;
     void               setId(const QString &id);
@@ -17,10 +17,17 @@
  *
  */
 
+#ifndef NO_Theme_ZIP
+#define Theme_ZIP
+#endif
+
 #include "theme_p.h"
 
+#ifdef Theme_ZIP
+#include "ziparchives.h"
+#endif
+
 #include <QDir>
-#include <QDirIterator>
 
 ThemePrivate::ThemePrivate(PsiThemeProvider *provider) :
     provider(provider), name(QObject::tr("Unnamed")), caseInsensitiveFS(false)
@@ -52,10 +59,7 @@ QByteArray ThemePrivate::loadData(const QString &fileName, bool *loaded) const
 
 class FSResourceLoader : public Theme::ResourceLoader {
     QDir baseDir;
-
-    // case insensetive file cache.
-    QHash<QString, QString> ciFSCache; // lower case to real path
-    bool                    caseInsensetive;
+    bool caseInsensetive;
 
 public:
     FSResourceLoader(const QDir &d, bool caseInsensetive) : baseDir(d), caseInsensetive(caseInsensetive) { }
@@ -64,10 +68,7 @@ public:
     {
         QFile file(baseDir.filePath(fileName));
         if (caseInsensetive && !file.exists()) {
-            if (ciFSCache.isEmpty()) {
-                updateCiFsCache();
-            }
-            QString realFN = ciFSCache.value(fileName.toLower());
+            QString realFN = Theme::caseFoldedPath(fileName, baseDir.path());
             if (!realFN.isEmpty()) {
                 file.setFileName(baseDir.filePath(realFN));
             }
@@ -81,16 +82,6 @@ public:
         return file.readAll();
     }
 
-    void updateCiFsCache()
-    {
-        int          skip = baseDir.path().length() + 1;
-        QDirIterator di(baseDir.path(), QDir::Files, QDirIterator::Subdirectories);
-        while (di.hasNext()) {
-            QString real = di.next().mid(skip);
-            ciFSCache.insert(real.toLower(), real);
-        }
-    }
-
     bool fileExists(const QString &fileName)
     {
         QString base = baseDir.path() + QLatin1Char('/');
@@ -98,10 +89,7 @@ public:
             return true;
         }
         if (caseInsensetive) {
-            if (ciFSCache.isEmpty()) {
-                updateCiFsCache();
-            }
-            QString realFN = ciFSCache.value(fileName.toLower());
+            QString realFN = Theme::caseFoldedPath(fileName, baseDir.path());
             if (!realFN.isEmpty() && QFileInfo::exists(base + realFN)) {
                 return true;
             }
@@ -112,19 +100,23 @@ public:
 
 #ifdef Theme_ZIP
 class ZipResourceLoader : public Theme::ResourceLoader {
-    UnZip   z;
+    QString archive;
     QString baseName;
+    bool    caseInsensetive;
 
 public:
-    ZipResourceLoader(UnZip &&z, const QString &baseName) : z(std::move(z)), baseName(baseName) { }
+    ZipResourceLoader(const QString &archive, const QString &baseName, bool caseInsensetive) :
+        archive(archive), baseName(baseName), caseInsensetive(caseInsensetive)
+    {
+    }
 
     QByteArray loadData(const QString &fileName)
     {
         QString    n = baseName + QLatin1Char('/') + fileName;
         QByteArray ba;
 
-        if (!z.readFile(n, &ba)) {
-            z.readFile(n.mid(baseName.count()), &ba);
+        if (!ZipArchives::readFile(archive, n, &ba, caseInsensetive)) {
+            ZipArchives::readFile(archive, n.mid(baseName.count()), &ba, caseInsensetive);
         }
 
         return ba;
@@ -134,10 +126,10 @@ public:
     {
         QString n = baseName + QLatin1Char('/') + fileName;
 
-        if (z.fileExists(n)) {
+        if (ZipArchives::fileExists(archive, n, caseInsensetive)) {
             return true;
         }
-        return z.fileExists(n.mid(baseName.count()));
+        return ZipArchives::fileExists(archive, n.mid(baseName.count()), caseInsensetive);
     }
 };
 #endif
@@ -152,13 +144,7 @@ Theme::ResourceLoader *ThemePrivate::resourceLoader() const
     }
 #ifdef Theme_ZIP
     else if (Theme::isCompressed(fi)) {
-        UnZip z;
-        if (z.open()) {
-            if (caseInsensitiveFS) {
-                z.setCaseSensitivity(UnZip::CS_Insensitive);
-            }
-            return new ZipResourceLoader(std::move(z), fi.completeBaseName());
-        }
+        return new ZipResourceLoader(fi.filePath(), fi.completeBaseName(), caseInsensitiveFS);
     }
 #endif
     return nullptr;
@@ -23,64 +23,345 @@
 
 //#include <QApplication>
 #include <QBuffer>
+#include <QGuiApplication>
 #include <QImage>
 #include <QImageReader>
+#include <QMutex>
 #include <QObject>
 #include <QThread>
 #include <QTimer>
+#include <memory>
 
 /**
  * \class Anim
  * \brief Class for handling animations
  *
  * Anim is a class that can load animations. Generally, it looks like
- * QMovie but it loads animations in one pass and stores it in memory.
+ * QMovie but it keeps decoded frames in memory, so they are decoded only once
+ * while the animation is playing.
  *
- * Each frame of Anim is stored as Impix.
+ * Each frame of Anim is stored as Impix. Only the first frame is decoded on
+ * construction, the others as the playback reaches them. Anims made from the
+ * same data share their frames, and the frames are freed again when none of
+ * them played for a while.
  */
 
+// decoded frames are freed when nothing played them for this long, msecs
+#define ANIM_FRAMES_IDLE_TIMEOUT 60000
+
 static QThread *animMainThread = nullptr;
 
 //! \if _hide_doc_
-class Anim::Private : public QObject, public QSharedData {
+class AnimFrames {
+public:
+    class Frame {
+    public:
+        Impix impix;
+        int   period = 100;
+    };
+
+    AnimFrames(const QByteArray &data);
+    ~AnimFrames();
+
+    static std::shared_ptr<AnimFrames> get(const QByteArray &data);
+
+    int count() const { return frames_.count(); }
+    int looping() const { return looping_; }
+
+    const Frame &frame(int n);
+
+    void start();
+    void play();
+    void stop();
+    bool release(qint64 now);
+
+private:
+    bool decodeNext();
+
+    QByteArray                    data_;
+    QList<Frame>                  frames_;      // frames from decoded_ on have no image
+    int                           decoded_ = 0; // the first one is never freed
+    int                           looping_ = 0;
+    bool                          keep_    = false; // can't be decoded again, never freed
+    std::unique_ptr<QBuffer>      buffer_;
+    std::unique_ptr<QImageReader> reader_;
+    int                           readerPos_ = 0;
+    int                           playing_   = 0;
+    qint64                        idleSince_ = 0;
+};
+
+// data => frames of all the animations alive, and the frames waiting to be freed
+class AnimFramesRegistry : public QObject {
     Q_OBJECT
 public:
-    QTimer *frametimer;
+    static AnimFramesRegistry *instance()
+    {
+        static AnimFramesRegistry *registry = new AnimFramesRegistry();
+        return registry;
+    }
+
+    qint64 elapsed() const { return clock_.elapsed(); }
 
+    void watch(AnimFrames *frames)
+    {
+        {
+            QMutexLocker locker(&mutex);
+            idle.insert(frames);
+        }
+        QMetaObject::invokeMethod(this, "updateTimer", Qt::AutoConnection);
+    }
+
+    QMutex                                       mutex; // anims are also created in iconset loader threads
+    QHash<QByteArray, std::weak_ptr<AnimFrames>> stores;
+    QSet<AnimFrames *>                           idle;
+
+private slots:
+    void updateTimer()
+    {
+        QMutexLocker locker(&mutex);
+        if (!idle.isEmpty() && !timer_->isActive())
+            timer_->start();
+    }
+
+    void sweep()
+    {
+        QMutexLocker locker(&mutex);
+        const qint64 now = elapsed();
+        for (auto it = idle.begin(); it != idle.end();) {
+            if ((*it)->release(now))
+                it = idle.erase(it);
+            else
+                ++it;
+        }
+        if (idle.isEmpty())
+            timer_->stop();
+    }
+
+private:
+    AnimFramesRegistry() : QObject(nullptr), timer_(new QTimer(this))
+    {
+        if (animMainThread && animMainThread != QThread::currentThread()) {
+            moveToThread(animMainThread);
+        }
+        timer_->setInterval(ANIM_FRAMES_IDLE_TIMEOUT / 4);
+        connect(timer_, SIGNAL(timeout()), SLOT(sweep()));
+        clock_.start();
+    }
+
+    QTimer *      timer_;
+    QElapsedTimer clock_;
+};
+
+AnimFrames::AnimFrames(const QByteArray &data) : data_(data)
+{
+    QBuffer buffer(&data_);
+    buffer.open(QBuffer::ReadOnly);
+    QImageReader reader(&buffer);
+
+    const int  count     = reader.imageCount();
+    const bool animation = reader.supportsAnimation();
+    looping_             = reader.loopCount();
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        return;
+    }
+    Frame first;
+    first.impix  = Impix(image);
+    first.period = reader.nextImageDelay();
+    frames_.append(first);
+    decoded_ = 1;
+
+    if (!animation && count <= 1) {
+        // we're gonna slice the single image we've got if we're absolutely sure
+        // that it's can be cut into multiple frames
+        if ((image.width() / image.height() > 0) && !(image.width() % image.height())) {
+            int          h = image.height();
+            QList<Frame> newFrames;
+
+            for (int i = 0; i < image.width() / image.height(); i++) {
+                Frame newFrame;
+                newFrame.impix  = Impix(image.copy(i * h, 0, h, h));
+                newFrame.period = 120;
+                newFrames.append(newFrame);
+            }
+
+            frames_  = newFrames;
+            decoded_ = frames_.count();
+            looping_ = 0;
+        }
+        keep_ = true;
+        return;
+    }
+
+    if (count <= 0) {
+        // the format can't tell the number of frames without decoding them
+        while (reader.canRead()) {
+            image = reader.read();
+            if (image.isNull()) {
+                break;
+            }
+            Frame newFrame;
+            newFrame.impix  = Impix(image);
+            newFrame.period = reader.nextImageDelay();
+            frames_.append(newFrame);
+        }
+        decoded_ = frames_.count();
+        return;
+    }
+
+    for (int i = 1; i < count; i++) {
+        frames_.append(Frame());
+    }
+}
+
+AnimFrames::~AnimFrames()
+{
+    AnimFramesRegistry *registry = AnimFramesRegistry::instance();
+    QMutexLocker        locker(&registry->mutex);
+    registry->idle.remove(this);
+    auto it = registry->stores.find(data_);
+    if (it != registry->stores.end() && it->expired()) {
+        registry->stores.erase(it);
+    }
+}
+
+std::shared_ptr<AnimFrames> AnimFrames::get(const QByteArray &data)
+{
+    AnimFramesRegistry *registry = AnimFramesRegistry::instance();
+    {
+        QMutexLocker locker(&registry->mutex);
+        if (auto frames = registry->stores.value(data).lock()) {
+            return frames;
+        }
+    }
+
+    // decoded without the lock, a concurrent loader of the same data may win
+    auto                        frames = std::make_shared<AnimFrames>(data);
+    std::shared_ptr<AnimFrames> existing;
+    {
+        QMutexLocker locker(&registry->mutex);
+        existing = registry->stores.value(data).lock();
+        if (!existing) {
+            registry->stores.insert(data, frames);
+        }
+    }
+    return existing ? existing : frames;
+}
+
+// decodes the frames up to n on the way
+const AnimFrames::Frame &AnimFrames::frame(int n)
+{
+    // the first frame is used by loader threads too, leave the rest alone for it
+    if (n == 0) {
+        return frames_.at(0);
+    }
+    while (n >= decoded_ && decodeNext()) { }
+    return frames_.at(n);
+}
+
+// starts decoding the frames following the first one
+void AnimFrames::start()
+{
+    if (decoded_ < frames_.count()) {
+        decodeNext();
+    }
+}
+
+void AnimFrames::play() { playing_++; }
+
+void AnimFrames::stop()
+{
+    if (--playing_ == 0 && !keep_ && decoded_ > 1) {
+        idleSince_ = AnimFramesRegistry::instance()->elapsed();
+        AnimFramesRegistry::instance()->watch(this);
+    }
+}
+
+// frees all the frames but the first one, if nothing played them for a while.
+// returns false while still waiting for that
+bool AnimFrames::release(qint64 now)
+{
+    if (playing_ > 0) {
+        return true;
+    }
+    if (now - idleSince_ < ANIM_FRAMES_IDLE_TIMEOUT) {
+        return false;
+    }
+
+    for (int i = 1; i < decoded_; i++) {
+        frames_[i].impix = Impix();
+    }
+    decoded_ = 1;
+    reader_.reset();
+    buffer_.reset();
+    return true;
+}
+
+bool AnimFrames::decodeNext()
+{
+    if (!reader_) {
+        buffer_.reset(new QBuffer(&data_));
+        buffer_->open(QBuffer::ReadOnly);
+        reader_.reset(new QImageReader(buffer_.get()));
+        readerPos_ = 0;
+    }
+    // frames depend on the previous ones, so the reader always goes from the start
+    while (readerPos_ < decoded_) {
+        reader_->read();
+        readerPos_++;
+    }
+
+    QImage image = reader_->read();
+    readerPos_++;
+    if (image.isNull()) {
+        // broken data, keep showing the last good frame
+        for (int i = decoded_; i < frames_.count(); i++) {
+            frames_[i] = frames_[decoded_ - 1];
+        }
+        decoded_ = frames_.count();
+        keep_    = true;
+    } else {
+        frames_[decoded_].impix  = Impix(image);
+        frames_[decoded_].period = reader_->nextImageDelay();
+        decoded_++;
+    }
+
+    if (decoded_ == frames_.count()) {
+        reader_.reset();
+        buffer_.reset();
+    }
+    return !image.isNull();
+}
+
+class Anim::Private : public QObject, public QSharedData {
+    Q_OBJECT
+public:
     bool empty;
     bool paused;
 
     int speed;
     int lasttimerinterval;
 
-    int looping, loop;
-
-    class Frame {
-    public:
-        Impix impix;
-        int   period = 100;
-    };
+    int loop;
 
-    QList<Frame> frames;
-    int          frame;
+    std::shared_ptr<AnimFrames> frames;    // shared with every Anim made from the same data
+    int                         first = 0; // frames dropped by stripFirstFrame()
+    int                         frame;
 
 public:
     void init()
     {
-        frametimer = new QTimer();
         if (animMainThread && animMainThread != QThread::currentThread()) {
-            frametimer->moveToThread(animMainThread);
             moveToThread(animMainThread);
         }
-        QObject::connect(frametimer, SIGNAL(timeout()), this, SLOT(refresh()));
 
         speed             = 120;
         lasttimerinterval = -1;
 
-        looping = 0; // MNG movies doesn't have loop flag?
-        loop    = 0;
-        frame   = 0;
-        paused  = true;
+        loop   = 0;
+        frame  = 0;
+        paused = true;
     }
 
     Private() { init(); }
@@ -91,13 +372,12 @@ public:
 
         speed             = from.speed;
         lasttimerinterval = from.lasttimerinterval;
-        looping           = from.looping;
         loop              = from.loop;
         frame             = from.frame;
-        paused            = from.paused;
         frames            = from.frames;
+        first             = from.first;
 
-        if (!paused)
+        if (!from.paused)
             unpause();
     }
 
@@ -105,60 +385,28 @@ public:
     {
         init();
 
-        QBuffer buffer(const_cast<QByteArray *>(ba));
-        buffer.open(QBuffer::ReadOnly);
-        QImageReader reader(&buffer);
-
-        while (reader.canRead()) {
-            QImage image = reader.read();
-            if (!image.isNull()) {
-                Frame newFrame;
-                newFrame.impix  = Impix(image);
-                newFrame.period = reader.nextImageDelay();
-                frames.append(newFrame);
-            } else {
-                break;
-            }
-        }
-
-        looping = reader.loopCount();
-
-        if (!reader.supportsAnimation() && (frames.count() == 1)) {
-            QImage frame = frames[0].impix.image();
-
-            // we're gonna slice the single image we've got if we're absolutely sure
-            // that it's can be cut into multiple frames
-            if ((frame.width() / frame.height() > 0) && !(frame.width() % frame.height())) {
-                int          h = frame.height();
-                QList<Frame> newFrames;
-
-                for (int i = 0; i < frame.width() / frame.height(); i++) {
-                    Frame newFrame;
-                    newFrame.impix  = Impix(frame.copy(i * h, 0, h, h));
-                    newFrame.period = 120;
-                    newFrames.append(newFrame);
-                }
-
-                frames  = newFrames;
-                looping = 0;
-            }
-        }
+        frames = AnimFrames::get(*ba);
     }
 
     ~Private()
     {
-        if (frametimer)
-            delete frametimer;
+        AnimClock::instance()->unschedule(this);
+        if (!paused && frames)
+            frames->stop();
     }
 
     void pause()
     {
+        if (!paused && frames)
+            frames->stop();
         paused = true;
-        frametimer->stop();
+        AnimClock::instance()->unschedule(this);
     }
 
     void unpause()
     {
+        if (paused && frames)
+            frames->play();
         paused = false;
         restartTimer();
     }
@@ -170,19 +418,22 @@ public:
             restartTimer();
     }
 
-    int numFrames() const { return frames.count(); }
+    int numFrames() const { return frames ? frames->count() - first : 0; }
+
+    const AnimFrames::Frame &frameAt(int n) const { return frames->frame(first + n); }
 
     void restartTimer()
     {
+        AnimClock *clock = AnimClock::instance();
         if (!paused && speed > 0) {
-            int frameperiod = frames[frame].period;
+            int frameperiod = frameAt(frame).period;
             int i           = frameperiod >= 0 ? frameperiod * 100 / speed : 0;
-            if (i != lasttimerinterval || !frametimer->isActive()) {
+            if (i != lasttimerinterval || !clock->isScheduled(this)) {
                 lasttimerinterval = i;
-                frametimer->start(i);
+                clock->schedule(this, clock->elapsed() + i);
             }
         } else {
-            frametimer->stop();
+            clock->unschedule(this);
         }
     }
 
@@ -197,7 +448,7 @@ public slots:
             frame = 0;
 
             loop++;
-            if (looping > 0 && loop >= looping) {
+            if (frames->looping() > 0 && loop >= frames->looping()) {
                 frame = numFrames() - 1;
                 pause();
                 restart();
@@ -233,17 +484,17 @@ Anim::~Anim() { }
 /**
  * Returns QPixmap of current frame.
  */
-const QPixmap &Anim::framePixmap() const { return d->frames[d->frame].impix.pixmap(); }
+const QPixmap &Anim::framePixmap() const { return d->frameAt(d->frame).impix.pixmap(); }
 
 /**
  * Returns QImage of current frame.
  */
-const QImage &Anim::frameImage() const { return d->frames[d->frame].impix.image(); }
+const QImage &Anim::frameImage() const { return d->frameAt(d->frame).impix.image(); }
 
 /**
  * Returns Impix of current frame.
  */
-const Impix &Anim::frameImpix() const { return d->frames[d->frame].impix; }
+const Impix &Anim::frameImpix() const { return d->frameAt(d->frame).impix; }
 
 /**
  * Returns total number of frames in animation.
@@ -258,7 +509,7 @@ int Anim::frameNumber() const { return d->frame; }
 /**
  * Returns Impix of animation frame number \a n.
  */
-const Impix &Anim::frame(int n) const { return d->frames[n].impix; }
+const Impix &Anim::frame(int n) const { return d->frameAt(n).impix; }
 
 /**
  * Returns \c true if numFrames() == 0 and \c false otherwise.
@@ -320,6 +571,8 @@ void Anim::restart()
  */
 void Anim::connectUpdate(QObject *receiver, const char *member)
 {
+    if (d->frames)
+        d->frames->start();
     QObject::connect(d, SIGNAL(areaChanged()), receiver, member);
 }
 
@@ -356,7 +609,7 @@ void Anim::stripFirstFrame()
 {
     detach();
     if (numFrames() > 1) {
-        d->frames.takeFirst();
+        d->first++;
 
         if (!paused())
             restart();
@@ -374,4 +627,125 @@ void Anim::setMainThread(QThread *thread) { animMainThread = thread; }
  */
 QThread *Anim::mainThread() { return animMainThread; }
 
+//----------------------------------------------------------------------------
+// AnimClock
+//----------------------------------------------------------------------------
+
+/**
+ * \class AnimClock
+ * \brief One timer that drives all animations
+ *
+ * Every Anim advances its frames on ticks of this clock instead of owning a
+ * timer, so all animations change frames at the same moments and the widgets
+ * showing them repaint once per tick. Widgets that animate on their own (like
+ * roster alerts) register with addClient() and listen to the frame() signal.
+ *
+ * The clock stops when nothing is animating and while the application is hidden.
+ */
+
+AnimClock *AnimClock::instance()
+{
+    static AnimClock *clock = nullptr;
+    if (!clock)
+        clock = new AnimClock();
+    return clock;
+}
+
+AnimClock::AnimClock() : QObject(nullptr)
+{
+    if (animMainThread && animMainThread != QThread::currentThread()) {
+        moveToThread(animMainThread);
+    }
+    timer_.setInterval(FrameInterval);
+    connect(&timer_, SIGNAL(timeout()), SLOT(tick()));
+    if (qGuiApp) {
+        connect(qGuiApp, SIGNAL(applicationStateChanged(Qt::ApplicationState)),
+                SLOT(applicationStateChanged(Qt::ApplicationState)));
+    }
+    clock_.start();
+}
+
+/**
+ * Returns msecs since the clock was created. Frame times are measured in these.
+ */
+qint64 AnimClock::elapsed() const { return clock_.elapsed(); }
+
+/**
+ * Keeps the clock ticking for \a client until removeClient() is called or \a client is destroyed.
+ */
+void AnimClock::addClient(QObject *client)
+{
+    if (clients_.contains(client))
+        return;
+    clients_.insert(client);
+    connect(client, SIGNAL(destroyed(QObject *)), this, SLOT(clientDestroyed(QObject *)));
+    updateTimer();
+}
+
+void AnimClock::removeClient(QObject *client)
+{
+    if (!clients_.remove(client))
+        return;
+    disconnect(client, SIGNAL(destroyed(QObject *)), this, SLOT(clientDestroyed(QObject *)));
+    updateTimer();
+}
+
+void AnimClock::clientDestroyed(QObject *client)
+{
+    clients_.remove(client);
+    updateTimer();
+}
+
+void AnimClock::schedule(Anim::Private *anim, qint64 due)
+{
+    anims_.insert(anim, due);
+    updateTimer();
+}
+
+void AnimClock::unschedule(Anim::Private *anim)
+{
+    due_.removeOne(anim);
+    if (anims_.remove(anim))
+        updateTimer();
+}
+
+bool AnimClock::isScheduled(Anim::Private *anim) const { return anims_.contains(anim); }
+
+void AnimClock::tick()
+{
+    const qint64 now = elapsed();
+
+    // refresh() reschedules, so collect the due ones first. a frame change may
+    // destroy other animations, unschedule() drops them from due_ then
+    for (auto it = anims_.begin(); it != anims_.end();) {
+        if (it.value() <= now) {
+            due_.append(it.key());
+            it = anims_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (!due_.isEmpty()) {
+        due_.takeFirst()->refresh();
+    }
+
+    emit frame(now);
+    updateTimer();
+}
+
+void AnimClock::applicationStateChanged(Qt::ApplicationState state)
+{
+    suspended_ = (state == Qt::ApplicationHidden || state == Qt::ApplicationSuspended);
+    updateTimer();
+}
+
+void AnimClock::updateTimer()
+{
+    bool run = !suspended_ && (!anims_.isEmpty() || !clients_.isEmpty());
+    if (run && !timer_.isActive())
+        timer_.start();
+    else if (!run && timer_.isActive())
+        timer_.stop();
+}
+
 #include "anim.moc"
@@ -21,11 +21,16 @@
 #define ANIM_H
 
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
 #include <QSharedDataPointer>
+#include <QTimer>
 
 class Impix;
 class QImage;
-class QObject;
 class QPixmap;
 class QThread;
 
@@ -69,4 +74,42 @@ private:
     QSharedDataPointer<Private> d;
 };
 
+class AnimClock : public QObject {
+    Q_OBJECT
+public:
+    static const int FrameInterval = 20; // msecs
+
+    static AnimClock *instance();
+
+    qint64 elapsed() const;
+
+    void addClient(QObject *client);
+    void removeClient(QObject *client);
+
+signals:
+    void frame(qint64 elapsed);
+
+private slots:
+    void tick();
+    void clientDestroyed(QObject *client);
+    void applicationStateChanged(Qt::ApplicationState state);
+
+private:
+    friend class Anim::Private;
+
+    AnimClock();
+
+    void schedule(Anim::Private *anim, qint64 due);
+    void unschedule(Anim::Private *anim);
+    bool isScheduled(Anim::Private *anim) const;
+    void updateTimer();
+
+    QTimer                         timer_;
+    QElapsedTimer                  clock_;
+    QSet<QObject *>                clients_;
+    QHash<Anim::Private *, qint64> anims_;
+    QList<Anim::Private *>         due_;
+    bool                           suspended_ = false;
+};
+
 #endif // ANIM_H
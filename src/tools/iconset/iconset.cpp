@@ -30,39 +30,270 @@
 
 #include "anim.h"
 #ifdef ICONSET_ZIP
-#include "zip/zip.h"
+#include "ziparchives.h"
 #endif
 #include "svgiconengine.h"
 
 #include <QApplication>
+#include <QAtomicInt>
 #include <QBuffer>
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
 #include <QDomDocument>
 #include <QFile>
 #include <QFileInfo>
 #include <QIcon>
 #include <QIconEngine>
 #include <QLocale>
+#include <QMutex>
 #include <QObject>
 #include <QPainter>
 #include <QRegExp>
+#include <QSaveFile>
+#include <QSet>
 #include <QSharedData>
 #include <QSharedDataPointer>
 #include <QSvgRenderer>
 #include <QTextCodec>
 #include <QThread>
 #include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
 #ifdef ICONSET_SOUND
-#include <QDataStream>
 #include <qca_basic.h>
 #endif
 
+static const quint32 ICONSET_CACHE_MAGIC   = 0x50534943; // "PSIC"
+static const quint32 ICONSET_CACHE_VERSION = 1;
+
+// see Iconset::setCacheDir()
+static struct {
+    QString   dir;
+    QString   appVersion;
+    QDateTime binaryTimestamp;
+} iconsetCache;
+
+// see IconsetFactory::setMemoryBudget()
+#define ICONSET_MEMORY_CHECK_INTERVAL 15000 // ms
+#define ICONSET_MEMORY_IDLE_CHECKS    4     // icons unused for so many checks may be unloaded
+
+// advanced on every memory check, icons remember it when they are used
+static std::atomic<int> iconUseEpoch { 0 };
+
 static void moveToMainThread(QObject *obj)
 {
     if (Anim::mainThread() && Anim::mainThread() != QThread::currentThread())
         obj->moveToThread(Anim::mainThread());
 }
 
+// reads \a fileName from the iconset directory or archive \a dir
+static QByteArray loadIconsetData(const QString &fileName, const QString &dir)
+{
+    QByteArray ba;
+
+    QFileInfo fi(dir);
+    if (!Iconset::isSourceAllowed(fi)) {
+        qWarning("%s is invalid icons source", qPrintable(dir));
+        return ba;
+    }
+    if (fi.isDir()) {
+        QFile file(dir + '/' + fileName);
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning("%s is not found in %s", qPrintable(fileName), qPrintable(dir));
+            return ba;
+        }
+
+        ba = file.readAll();
+    }
+#ifdef ICONSET_ZIP
+    else { // else its zip or jisp file
+        ZipArchives::readFile(dir, fi.completeBaseName() + '/' + fileName, &ba);
+    }
+#endif
+
+    return ba;
+}
+
+//----------------------------------------------------------------------------
+// SharedImages
+//----------------------------------------------------------------------------
+
+// see Iconset::setSharedImageDir()
+#define SHARED_IMAGES_FILE       "images.bin"
+#define SHARED_IMAGES_MAGIC      0x50534958 // "PSIX"
+#define SHARED_IMAGES_FORMAT     1
+#define SHARED_IMAGES_MAX_PIXELS (256 * 256)        // bigger images stay private
+#define SHARED_IMAGES_MAX_SIZE   (64 * 1024 * 1024) // bytes of pixel data in the file
+
+/**
+ * Decoded icon images in a file that every process of the host maps read-only,
+ * so the pixels of the same iconset are in memory once. Images are found by the
+ * hash of their encoded data. Images missing from the file are collected and
+ * written, together with the old ones, to a new file on exit, so the next
+ * processes pick them up. The mapping is never released, images point into it.
+ */
+class SharedImages {
+public:
+    struct Header {
+        quint32 magic;
+        quint32 format;
+        quint32 count;
+        quint32 reserved;
+    };
+
+    // sorted by key
+    struct Entry {
+        char    key[20];
+        quint32 imageFormat;
+        quint32 width;
+        quint32 height;
+        quint32 bytesPerLine;
+        quint32 reserved;
+        quint64 offset;
+    };
+
+    static SharedImages *instance; // null unless enabled
+
+    SharedImages(const QString &dir) : fileName_(dir + "/" SHARED_IMAGES_FILE)
+    {
+        file_ = new QFile(fileName_);
+        if (!file_->open(QIODevice::ReadOnly) || file_->size() < qint64(sizeof(Header)))
+            return;
+        const uchar *data = file_->map(0, file_->size());
+        if (!data)
+            return;
+
+        Header header;
+        memcpy(&header, data, sizeof(Header));
+        if (header.magic != SHARED_IMAGES_MAGIC || header.format != SHARED_IMAGES_FORMAT
+            || qint64(sizeof(Header) + sizeof(Entry) * quint64(header.count)) > file_->size())
+            return;
+        data_    = data;
+        size_    = file_->size();
+        entries_ = reinterpret_cast<const Entry *>(data + sizeof(Header));
+        count_   = header.count;
+    }
+
+    QImage find(const QByteArray &key) const
+    {
+        const Entry *e = std::lower_bound(entries_, entries_ + count_, key, [](const Entry &e, const QByteArray &key) {
+            return memcmp(e.key, key.constData(), sizeof(e.key)) < 0;
+        });
+        if (e == entries_ + count_ || memcmp(e->key, key.constData(), sizeof(e->key)) != 0 || !valid(*e))
+            return QImage();
+        // read-only, a write to the image detaches it from the file
+        return QImage(data_ + e->offset, int(e->width), int(e->height), int(e->bytesPerLine),
+                      QImage::Format(e->imageFormat));
+    }
+
+    void add(const QByteArray &key, const QImage &image)
+    {
+        if (qint64(image.width()) * image.height() > SHARED_IMAGES_MAX_PIXELS)
+            return;
+        // the formats raster pixmaps use, so QPixmap::fromImage() doesn't need a copy
+        QImage converted = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                                                         : QImage::Format_RGB32);
+        QMutexLocker locker(&mutex_);
+        pending_.insert(key, converted);
+    }
+
+    bool owns(const uchar *bits) const { return data_ && bits >= data_ && bits < data_ + size_; }
+
+    void save()
+    {
+        QMutexLocker locker(&mutex_);
+        if (pending_.isEmpty())
+            return;
+
+        struct Item {
+            QByteArray   key;
+            const Entry *entry;
+            QImage       image;
+        };
+        std::vector<Item> items;
+        qint64            total = 0;
+        for (quint32 i = 0; i < count_; ++i) {
+            if (valid(entries_[i])) {
+                items.push_back({ QByteArray(entries_[i].key, sizeof(entries_[i].key)), entries_ + i, QImage() });
+                total += qint64(entries_[i].bytesPerLine) * entries_[i].height;
+            }
+        }
+        for (auto it = pending_.constBegin(); it != pending_.constEnd(); ++it) {
+            total += it.value().sizeInBytes();
+            if (total > SHARED_IMAGES_MAX_SIZE)
+                break;
+            items.push_back({ it.key(), nullptr, it.value() });
+        }
+        pending_.clear();
+        std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.key < b.key; });
+        items.erase(std::unique(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.key == b.key; }),
+                    items.end());
+
+        QDir().mkpath(QFileInfo(fileName_).absolutePath());
+        QSaveFile f(fileName_);
+        if (!f.open(QIODevice::WriteOnly))
+            return; // a read-only shared dir, somebody else fills it
+
+        Header header { SHARED_IMAGES_MAGIC, SHARED_IMAGES_FORMAT, quint32(items.size()), 0 };
+        f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        // pixel data follows the index, each image 16 bytes aligned
+        quint64 offset = sizeof(Header) + sizeof(Entry) * items.size();
+        for (const Item &item : items) {
+            offset = (offset + 15) & ~quint64(15);
+            Entry e;
+            if (item.entry) {
+                e = *item.entry;
+            } else {
+                memset(&e, 0, sizeof(e));
+                memcpy(e.key, item.key.constData(), sizeof(e.key));
+                e.imageFormat  = quint32(item.image.format());
+                e.width        = quint32(item.image.width());
+                e.height       = quint32(item.image.height());
+                e.bytesPerLine = quint32(item.image.bytesPerLine());
+            }
+            e.offset = offset;
+            f.write(reinterpret_cast<const char *>(&e), sizeof(e));
+            offset += quint64(e.bytesPerLine) * e.height;
+        }
+        qint64 pos = f.pos();
+        for (const Item &item : items) {
+            static const char zeros[16] = {};
+            f.write(zeros, ((pos + 15) & ~qint64(15)) - pos);
+            if (item.entry)
+                f.write(reinterpret_cast<const char *>(data_ + item.entry->offset),
+                        qint64(item.entry->bytesPerLine) * item.entry->height);
+            else
+                f.write(reinterpret_cast<const char *>(item.image.constBits()), item.image.sizeInBytes());
+            pos = f.pos();
+        }
+        f.commit();
+    }
+
+private:
+    bool valid(const Entry &e) const
+    {
+        return (e.imageFormat == QImage::Format_ARGB32_Premultiplied || e.imageFormat == QImage::Format_RGB32)
+            && e.width > 0 && e.height > 0 && e.bytesPerLine >= quint64(e.width) * 4 && e.offset % 16 == 0
+            && e.offset + quint64(e.bytesPerLine) * e.height <= quint64(size_);
+    }
+
+    QString                   fileName_;
+    QFile *                   file_    = nullptr;
+    const uchar *             data_    = nullptr;
+    qint64                    size_    = 0;
+    const Entry *             entries_ = nullptr;
+    quint32                   count_   = 0;
+    QMutex                    mutex_;
+    QHash<QByteArray, QImage> pending_;
+};
+
+SharedImages *SharedImages::instance = nullptr;
+
 //----------------------------------------------------------------------------
 // Impix
 //----------------------------------------------------------------------------
@@ -167,6 +398,22 @@ void Impix::setImage(const QImage &x)
     d->image = x;
 }
 
+/**
+ * Returns number of bytes held by the image and the pixmap.
+ */
+qint64 Impix::memoryUsage() const
+{
+    const Private *p = d.constData();
+    // pixels mapped from the shared file aren't ours, a raster pixmap made of them shares them too
+    if (SharedImages::instance && SharedImages::instance->owns(p->image.constBits()))
+        return 0;
+    qint64 bytes = qint64(p->image.bytesPerLine()) * p->image.height();
+    if (p->pixmap) {
+        bytes += qint64(p->pixmap->width()) * p->pixmap->height() * p->pixmap->depth() / 8;
+    }
+    return bytes;
+}
+
 QSize Impix::size() const
 {
     if (d->pixmap)
@@ -183,11 +430,18 @@ bool Impix::loadFromData(const QByteArray &ba)
     delete d->pixmap;
     d->pixmap = nullptr;
 
-    QImage img;
-    if (img.loadFromData(ba)) {
+    SharedImages *   shared = SharedImages::instance;
+    const QByteArray key    = shared ? QCryptographicHash::hash(ba, QCryptographicHash::Sha1) : QByteArray();
+    QImage           img    = shared ? shared->find(key) : QImage();
+    if (!img.isNull()) {
+        setImage(img);
+        ret = true;
+    } else if (img.loadFromData(ba)) {
         Q_ASSERT(img.width() > 0);
         Q_ASSERT(img.height() > 0);
         setImage(img);
+        if (shared)
+            shared->add(key, img);
         ret = true;
     }
 
@@ -274,6 +528,8 @@ public:
         scalable    = from.scalable;
         svgRenderer = from.svgRenderer;
         anim.reset(from.anim ? new Anim(*from.anim) : nullptr);
+        source.reset(from.source ? new Source(*from.source) : nullptr);
+        origin.reset(from.origin ? new Source(*from.origin) : nullptr);
         icon           = nullptr;
         activatedCount = from.activatedCount;
     }
@@ -295,21 +551,127 @@ signals:
     void iconModified();
 
 public:
+    // would return 'true' on success
+    bool decode(const QByteArray &ba, bool isAnim, bool isScalable)
+    {
+        scaledCache.clear();
+        delete icon;
+        icon        = nullptr;
+        rawData     = ba;
+        scalable    = isScalable;
+        svgRenderer = nullptr;
+        if (scalable) {
+            svgRenderer = std::make_shared<QSvgRenderer>(ba);
+            if (!svgRenderer->isValid()) {
+                svgRenderer.reset();
+            } else {
+                moveToMainThread(svgRenderer.get());
+            }
+        }
+        if (svgRenderer) {
+            return true;
+        }
+
+        bool ret = false;
+        if (isAnim) {
+            anim.reset(new Anim(ba));
+            ret = anim->numFrames() > 0;
+            if (ret) {
+                impix = anim->frame(0);
+            }
+            if (anim->numFrames() < 2) {
+                anim.reset();
+            }
+        }
+
+        if (!ret && impix.loadFromData(ba))
+            ret = true;
+
+        return ret;
+    }
+
+    // icons restored from the iconset cache read their image on first use
+    void ensureLoaded() const
+    {
+        lastUse = iconUseEpoch.load(std::memory_order_relaxed);
+        if (!source) {
+            return;
+        }
+
+        Private *               self = const_cast<Private *>(this);
+        std::unique_ptr<Source> src(std::move(self->source));
+        // no file name when the icon was unloaded and only its raw data is left
+        const QByteArray ba = src->fileName.isEmpty() ? rawData : loadIconsetData(src->fileName, src->dir);
+        if (!self->decode(ba, src->isAnim, scalable)) {
+            qWarning("PsiIcon: failed to load %s from %s", qPrintable(src->fileName), qPrintable(src->dir));
+        } else if (self->anim && src->stripFirstFrame) {
+            self->anim->stripFirstFrame();
+        }
+        if (!src->fileName.isEmpty()) {
+            self->origin = std::move(src);
+        }
+    }
+
+    // bytes held by the decoded image and the raw data. animation frames are released by Anim itself
+    qint64 memoryUsage() const
+    {
+        if (source) {
+            return 0;
+        }
+        return impix.memoryUsage() + rawData.size();
+    }
+
+    // frees the decoded image, ensureLoaded() reads it again from the iconset or from the raw data
+    bool unload()
+    {
+        if (source || anim || activatedCount > 0 || (!origin && rawData.isEmpty())) {
+            return false;
+        }
+        if (origin) {
+            source = std::move(origin);
+            rawData.clear();
+        } else {
+            source.reset(new Source);
+        }
+        scaledCache.clear();
+        delete icon;
+        icon  = nullptr;
+        impix = Impix();
+        svgRenderer.reset();
+        return true;
+    }
+
     QPixmap pixmap(const QSize &desiredSize = QSize()) const
     {
+        ensureLoaded();
+        QPixmap pix;
         if (svgRenderer) {
-            QSize   sz = desiredSize.isEmpty() ? svgRenderer->defaultSize()
-                                               : svgRenderer->defaultSize().scaled(desiredSize, Qt::KeepAspectRatio);
-            QPixmap pix(sz);
+            if (scaledCache.find(desiredSize, 1.0, &pix)) {
+                return pix;
+            }
+            QSize sz = desiredSize.isEmpty() ? svgRenderer->defaultSize()
+                                             : svgRenderer->defaultSize().scaled(desiredSize, Qt::KeepAspectRatio);
+            pix = QPixmap(sz);
             pix.fill(Qt::transparent);
             QPainter p(&pix);
             svgRenderer->render(&p);
+            p.end();
+            scaledCache.insert(desiredSize, 1.0, pix);
             return pix;
         }
 
-        QPixmap pix = anim ? anim->framePixmap() : impix.pixmap();
-        if (scalable)
-            return pix.scaled(desiredSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if (!scalable) {
+            return anim ? anim->framePixmap() : impix.pixmap();
+        }
+        // animation frames change all the time, only the still image is worth keeping
+        if (!anim && scaledCache.find(desiredSize, 1.0, &pix)) {
+            return pix;
+        }
+        pix = (anim ? anim->framePixmap() : impix.pixmap())
+                  .scaled(desiredSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        if (!anim) {
+            scaledCache.insert(desiredSize, 1.0, pix);
+        }
         return pix;
     }
 
@@ -317,6 +679,13 @@ public slots:
     void animUpdate() { emit pixmapChanged(); }
 
 public:
+    struct Source {
+        QString dir;
+        QString fileName;
+        bool    isAnim          = false;
+        bool    stripFirstFrame = false;
+    };
+
     QString         name;
     QRegExp         regExp;
     QList<IconText> text;
@@ -327,8 +696,12 @@ public:
     std::unique_ptr<Anim>         anim;
     std::shared_ptr<QSvgRenderer> svgRenderer;
     QIcon *                       icon = nullptr;
+    mutable ScaledPixmapCache     scaledCache; // pixmap(desiredSize) results
     mutable QByteArray            rawData;
     bool                          scalable = false;
+    std::unique_ptr<Source>       source;      // not decoded yet
+    std::unique_ptr<Source>       origin;      // where the decoded image came from
+    mutable int                   lastUse = 0; // iconUseEpoch of the last access
 
     int activatedCount = 0;
     friend class PsiIcon;
@@ -389,7 +762,11 @@ void PsiIcon::detach() { d.detach(); }
 /**
  * Returns \c true when icon contains animation.
  */
-bool PsiIcon::isAnimated() const { return d->anim != nullptr; }
+bool PsiIcon::isAnimated() const
+{
+    d->ensureLoaded();
+    return d->anim != nullptr;
+}
 
 /**
  * Returns QPixmap of current frame.
@@ -401,6 +778,7 @@ QPixmap PsiIcon::pixmap(const QSize &desiredSize) const { return d->pixmap(desir
  */
 QImage PsiIcon::image(const QSize &desiredSize) const
 {
+    d->ensureLoaded();
     if (d->anim) {
         return d->anim->frameImage();
     }
@@ -423,7 +801,11 @@ QImage PsiIcon::image(const QSize &desiredSize) const
  * Returns Impix of first animation frame.
  * \sa setImpix()
  */
-const Impix &PsiIcon::impix() const { return d->impix; }
+const Impix &PsiIcon::impix() const
+{
+    d->ensureLoaded();
+    return d->impix;
+}
 
 /**
  * Returns Impix of current animation frame.
@@ -431,6 +813,7 @@ const Impix &PsiIcon::impix() const { return d->impix; }
  */
 const Impix &PsiIcon::frameImpix() const
 {
+    d->ensureLoaded();
     if (d->anim) {
         return d->anim->frameImpix();
     }
@@ -443,13 +826,15 @@ const Impix &PsiIcon::frameImpix() const
  */
 QIcon PsiIcon::icon() const
 {
+    d->ensureLoaded();
     if (d->icon) {
         return *d->icon;
     }
 
+    // the engine keeps its rasterized sizes, so all copies of the icon share them
     if (d->svgRenderer) {
-        auto eng = new SvgIconEngine(d->name, d->svgRenderer);
-        return QIcon(eng);
+        const_cast<Private *>(d.data())->icon = new QIcon(new SvgIconEngine(d->name, d->svgRenderer));
+        return *d->icon;
     }
     const_cast<Private *>(d.data())->icon = new QIcon(d->impix.pixmap());
     return *d->icon;
@@ -460,6 +845,7 @@ QIcon PsiIcon::icon() const
  */
 const QByteArray &PsiIcon::raw() const
 {
+    d->ensureLoaded();
     if (d->rawData.isEmpty()) {
         QPixmap pix = impix().pixmap();
         if (!pix.isNull()) {
@@ -473,6 +859,7 @@ const QByteArray &PsiIcon::raw() const
 
 QSize PsiIcon::size(const QSize &desiredSize) const
 {
+    d->ensureLoaded();
     if (d->scalable) {
         QSize origSize = d->svgRenderer ? d->svgRenderer->defaultSize() : d->impix.size();
         if (!desiredSize.width() && !desiredSize.height())
@@ -490,6 +877,12 @@ QSize PsiIcon::size(const QSize &desiredSize) const
 
 bool PsiIcon::isScalable() const { return d->scalable; }
 
+/**
+ * Returns number of bytes held by the decoded image and its raw data.
+ * Icons which are not decoded yet take nothing.
+ */
+qint64 PsiIcon::memoryUsage() const { return d->memoryUsage(); }
+
 const QString &PsiIcon::mimeType() const { return d->mime; }
 
 /**
@@ -502,7 +895,10 @@ void PsiIcon::setImpix(const Impix &impix, bool doDetach)
         detach();
     }
 
+    d->source.reset();
+    d->origin.reset();
     d->impix = impix;
+    d->scaledCache.clear();
     if (d->icon) {
         delete d->icon;
         d->icon = nullptr;
@@ -515,7 +911,11 @@ void PsiIcon::setImpix(const Impix &impix, bool doDetach)
 /**
  * Returns pointer to Anim object, or \a 0 if PsiIcon doesn't contain an animation.
  */
-const Anim *PsiIcon::anim() const { return d->anim.get(); }
+const Anim *PsiIcon::anim() const
+{
+    d->ensureLoaded();
+    return d->anim.get();
+}
 
 /**
  * Sets the animation for icon to \a anim. Also sets Impix to be the first frame of animation.
@@ -528,6 +928,8 @@ void PsiIcon::setAnim(const Anim &anim, bool doDetach)
         detach();
     }
 
+    d->source.reset();
+    d->origin.reset();
     d->anim.reset(new Anim(anim));
 
     if (d->anim->numFrames() > 0) {
@@ -557,6 +959,7 @@ void PsiIcon::removeAnim(bool doDetach)
         detach();
     }
 
+    d->ensureLoaded();
     if (!d->anim) {
         return;
     }
@@ -710,28 +1113,13 @@ bool PsiIcon::loadFromData(const QString &mime, const QByteArray &ba, bool isAni
         return ret;
 
     detach();
-    d->rawData     = ba;
-    d->scalable    = isScalable;
-    d->svgRenderer = nullptr;
-    if (d->scalable) {
-        d->svgRenderer = std::make_shared<QSvgRenderer>(ba);
-        if (!d->svgRenderer->isValid()) {
-            d->svgRenderer.reset();
-            d->svgRenderer = nullptr;
-        }
-    }
-    if (d->svgRenderer) {
-        ret = true;
-    } else {
-        if (isAnim) {
-            Anim *anim = new Anim(ba);
-            setAnim(*anim);
-            ret = anim->numFrames() > 0;
-            delete anim; // shared data rules ;)
-        }
+    d->source.reset();
+    d->origin.reset();
+    ret = d->decode(ba, isAnim, isScalable);
 
-        if (!ret && d->impix.loadFromData(ba))
-            ret = true;
+    if (d->anim && d->activatedCount > 0) {
+        d->activatedCount = 0;
+        activated(false); // restart the animation, but don't play the sound
     }
 
     if (ret) {
@@ -743,6 +1131,21 @@ bool PsiIcon::loadFromData(const QString &mime, const QByteArray &ba, bool isAni
     return ret;
 }
 
+/**
+ * Like loadFromData(), but the image is read from \a fileName of the iconset \a dir
+ * and decoded only when it is needed for the first time.
+ * Iconset::load uses this function for icons restored from the cache.
+ */
+void PsiIcon::setDeferredData(const QString &mime, const QString &dir, const QString &fileName, bool isAnim,
+                              bool isScalable)
+{
+    detach();
+    d->source.reset(new Private::Source { dir, fileName, isAnim, false });
+    d->origin.reset();
+    d->mime     = mime;
+    d->scalable = isScalable;
+}
+
 /**
  * You need to call this function, when PsiIcon is \e triggered, i.e. it is shown on screen
  * and it must start animation (if it has not animation, this function will do nothing).
@@ -754,6 +1157,7 @@ bool PsiIcon::loadFromData(const QString &mime, const QByteArray &ba, bool isAni
  */
 void PsiIcon::activated(bool playSound)
 {
+    d->ensureLoaded();
     d->activatedCount++;
 
 #ifdef ICONSET_SOUND
@@ -805,7 +1209,9 @@ void PsiIcon::stripFirstAnimFrame()
 {
     detach();
 
-    if (d->anim) {
+    if (d->source) {
+        d->source->stripFirstFrame = true;
+    } else if (d->anim) {
         d->anim->stripFirstFrame();
     }
 }
@@ -847,6 +1253,14 @@ private:
     static IconsetFactoryPrivate *instance_;
     QList<Iconset *> *            iconsets_;
     mutable QPixmap *             emptyPixmap_;
+    qint64                        memoryBudget_ = 0; // bytes, 0 for no limit
+    QTimer *                      memoryTimer_  = nullptr;
+
+    // name => icon of the first registered iconset having it, rebuilt on first lookup after a change
+    mutable QHash<QString, const PsiIcon *> index_;
+    mutable std::atomic<bool>               indexValid_ { false }; // iconsets are also loaded in worker threads
+
+    void buildIndex() const;
 
 public:
     const QPixmap &emptyPixmap() const
@@ -874,6 +1288,9 @@ public:
     void registerIconset(const Iconset *);
     void unregisterIconset(const Iconset *);
 
+    void setMemoryBudget(qint64 bytes);
+    void trimMemory();
+
 public:
     static IconsetFactoryPrivate *instance()
     {
@@ -885,6 +1302,22 @@ public:
 
     const PsiIcon *icon(const QString &name) const;
 
+    // any change of icons in any iconset, registered or not
+    static void iconsetChanged()
+    {
+        if (instance_) {
+            instance_->indexValid_ = false;
+        }
+    }
+
+    // unlike instance(), doesn't create the factory. iconsets may be destroyed in loader threads
+    static void iconsetDestroyed(const Iconset *i)
+    {
+        if (instance_) {
+            instance_->unregisterIconset(i);
+        }
+    }
+
     static void reset()
     {
         delete instance_;
@@ -903,6 +1336,7 @@ void IconsetFactoryPrivate::registerIconset(const Iconset *i)
 
     if (!iconsets_->contains(const_cast<Iconset *>(i))) {
         iconsets_->append(const_cast<Iconset *>(i));
+        indexValid_ = false;
     }
 }
 
@@ -910,30 +1344,111 @@ void IconsetFactoryPrivate::unregisterIconset(const Iconset *i)
 {
     if (iconsets_ && iconsets_->contains(const_cast<Iconset *>(i))) {
         iconsets_->removeAll(const_cast<Iconset *>(i));
+        indexValid_ = false;
     }
 }
 
-const PsiIcon *IconsetFactoryPrivate::icon(const QString &name) const
+void IconsetFactoryPrivate::buildIndex() const
+{
+    index_.clear();
+    for (const Iconset *const iconset : qAsConst(*iconsets_)) {
+        if (!iconset) {
+            continue;
+        }
+        QListIterator<PsiIcon *> it = iconset->iterator();
+        while (it.hasNext()) {
+            const PsiIcon *icon = it.next();
+            // earlier registered iconsets take precedence
+            if (!index_.contains(icon->name())) {
+                index_.insert(icon->name(), icon);
+            }
+        }
+    }
+    indexValid_ = true;
+}
+
+void IconsetFactoryPrivate::setMemoryBudget(qint64 bytes)
 {
+    memoryBudget_ = bytes;
+    if (memoryBudget_ <= 0) {
+        delete memoryTimer_;
+        memoryTimer_ = nullptr;
+        return;
+    }
+    if (!memoryTimer_) {
+        memoryTimer_ = new QTimer(this);
+        memoryTimer_->setInterval(ICONSET_MEMORY_CHECK_INTERVAL);
+        connect(memoryTimer_, &QTimer::timeout, this, &IconsetFactoryPrivate::trimMemory);
+        memoryTimer_->start();
+    }
+}
+
+// unloads icons unused for a while, least recently used first, until the decoded ones fit into the budget
+void IconsetFactoryPrivate::trimMemory()
+{
+    const int epoch = ++iconUseEpoch;
     if (!iconsets_) {
-        return nullptr;
+        return;
     }
 
-    const PsiIcon *out = nullptr;
-    for (const Iconset *const iconset : qAsConst(*iconsets_)) {
-        if (iconset) {
-            out = iconset->icon(name);
+    qint64                                                total = 0;
+    QSet<const PsiIcon::Private *>                        seen; // icons are shared between iconsets
+    std::vector<std::pair<int, const PsiIcon::Private *>> idle;
+    for (const Iconset *iconset : qAsConst(*iconsets_)) {
+        for (const PsiIcon *icon : *iconset) {
+            const PsiIcon::Private *p = icon->d.constData();
+            if (seen.contains(p)) {
+                continue;
+            }
+            seen.insert(p);
+            total += p->memoryUsage();
+            if (epoch - p->lastUse > ICONSET_MEMORY_IDLE_CHECKS) {
+                idle.emplace_back(p->lastUse, p);
+            }
         }
+    }
+    if (total <= memoryBudget_) {
+        return;
+    }
 
-        if (out) {
+    std::sort(idle.begin(), idle.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    int unloaded = 0;
+    for (const auto &i : idle) {
+        if (total <= memoryBudget_) {
             break;
         }
+        const qint64 bytes = i.second->memoryUsage();
+        if (const_cast<PsiIcon::Private *>(i.second)->unload()) {
+            total -= bytes;
+            ++unloaded;
+        }
+    }
+    qDebug("IconsetFactory: unloaded %d icons, %lld KiB of decoded icons left", unloaded, total / 1024);
+}
+
+const PsiIcon *IconsetFactoryPrivate::icon(const QString &name) const
+{
+    if (!iconsets_) {
+        return nullptr;
+    }
+
+    if (!indexValid_) {
+        buildIndex();
     }
-    return out;
+    return index_.value(name);
 }
 
 void IconsetFactory::reset() { IconsetFactoryPrivate::reset(); }
 
+/**
+ * Limits memory taken by decoded images of the registered iconsets to \a bytes.
+ * Above it, icons unused for a minute are unloaded, they are decoded again
+ * from the iconset or their raw data when they are used next time.
+ * Animated icons and icons being shown are never unloaded. 0 means no limit.
+ * \sa Iconset::memoryUsage()
+ */
+void IconsetFactory::setMemoryBudget(qint64 bytes) { IconsetFactoryPrivate::instance()->setMemoryBudget(bytes); }
+
 /**
  * Returns pointer to PsiIcon with name \a name, or \a 0 if PsiIcon with that name wasn't
  * found in IconsetFactory.
@@ -1030,13 +1545,20 @@ private:
     }
 
 public:
-    QString                    id, name, version, description, creation, homeUrl, filename;
-    QStringList                authors;
-    QHash<QString, PsiIcon *>  dict; // unsorted hash for fast search
-    QList<PsiIcon *>           list; // sorted list
-    QHash<QString, QString>    info;
-    int                        iconSize_;
-    QHash<QString, QByteArray> zipCache;
+    QString                   id, name, version, description, creation, homeUrl, filename;
+    QStringList               authors;
+    QHash<QString, PsiIcon *> dict; // unsorted hash for fast search
+    QList<PsiIcon *>          list; // sorted list
+    QHash<QString, QString>   info;
+    int                       iconSize_;
+
+    // where the image of each icon is, collected while parsing for the cache
+    struct CacheEntry {
+        QString file;
+        bool    isAnim   = false;
+        bool    autoName = false;
+    };
+    QHash<QString, CacheEntry> cacheEntries;
 
 public:
     Private() { init(); }
@@ -1084,36 +1606,6 @@ public:
         }
     }
 
-    QByteArray loadData(const QString &fileName, const QString &dir)
-    {
-        QByteArray ba;
-
-        QFileInfo fi(dir);
-        if (!Iconset::isSourceAllowed(fi)) {
-            qWarning("%s is invalid icons source", qPrintable(dir));
-            return ba;
-        }
-        if (fi.isDir()) {
-            QFile file(dir + '/' + fileName);
-            if (!file.open(QIODevice::ReadOnly)) {
-                qWarning("%s is not found in %s", qPrintable(fileName), qPrintable(dir));
-                return ba;
-            }
-
-            ba = file.readAll();
-        }
-#ifdef ICONSET_ZIP
-        else { // else its zip or jisp file
-            UnZip z(dir);
-            if (zipCache.isEmpty())
-                zipCache = z.unpackAll();
-            ba = zipCache.value(fi.completeBaseName() + '/' + fileName);
-        }
-#endif
-
-        return ba;
-    }
-
     void loadMeta(const QDomElement &i, const QString &dir)
     {
         Q_UNUSED(dir);
@@ -1160,7 +1652,7 @@ public:
         }
     }
 
-    static int icon_counter; // used to give unique names to icons
+    static QAtomicInt icon_counter; // used to give unique names to icons
 
     // will return 'true' when icon is loaded ok
     bool loadKdeEmoticon(const QDomElement &emot, const QString &dir, QSize &size)
@@ -1241,6 +1733,7 @@ public:
         icon.blockSignals(false);
 
         append(baseFN, new PsiIcon(icon));
+        cacheEntries.insert(baseFN, { finfo.filePath().mid(dir.length() + 1), isAnimated, false });
         return true;
     }
 
@@ -1253,7 +1746,8 @@ public:
         QList<PsiIcon::IconText> text;
         QHash<QString, QString>  graphic, sound, object; // mime => filename
 
-        QString name       = QString::asprintf("icon_%04d", icon_counter++);
+        QString name       = QString::asprintf("icon_%04d", icon_counter.fetchAndAddRelaxed(1));
+        bool    autoName   = true;
         bool    isAnimated = false;
         bool    isImage    = false;
         bool    isScalable = false;
@@ -1279,7 +1773,8 @@ public:
             } else if (tag == "x") {
                 QString attr = e.attribute("xmlns");
                 if (attr == "name") {
-                    name = e.text();
+                    name     = e.text();
+                    autoName = false;
                 } else if (attr == "type") {
                     if (e.text() == "animation") {
                         isAnimated = true;
@@ -1333,15 +1828,17 @@ public:
             }
         }
 
+        CacheEntry entry;
+
         bool loadSuccess = std::any_of(preferredGraphic.begin(), preferredGraphic.end(), [&, this](const auto &mime) {
             QString fileName = graphic.value(mime);
             // if format supports animations, then load graphic as animation, and
             // if there is only one frame, then later it would be converted to single Impix
-            QByteArray ba = this->loadData(fileName, dir);
+            QByteArray ba = loadIconsetData(fileName, dir);
             Q_ASSERT(!dir.startsWith(QLatin1String(":/")) || !ba.isEmpty());
+            entry = { fileName, isAnimated || (!isImage && animationMime.indexOf(mime) != -1), autoName };
             if (!ba.isEmpty()
-                && icon.loadFromData(mime, ba, isAnimated || (!isImage && animationMime.indexOf(mime) != -1),
-                                     isScalable || scalableMime.indexOf(mime) != -1))
+                && icon.loadFromData(mime, ba, entry.isAnim, isScalable || scalableMime.indexOf(mime) != -1))
                 return true;
 
             qDebug("Iconset::load(): Couldn't load %s (%s) graphic for the %s icon for the %s iconset",
@@ -1374,7 +1871,7 @@ public:
                 file.open(QIODevice::WriteOnly);
                 QDataStream out(&file);
 
-                QByteArray data = this->loadData(fileName, dir); // "this" for compatibility with old gcc
+                QByteArray data = loadIconsetData(fileName, dir);
                 if (data.isEmpty()) {
                     qDebug("Iconset::load(): Couldn't load %s (%s) audio for the %s icon for the %s iconset. "
                            "file is empty",
@@ -1415,6 +1912,7 @@ public:
 
         if (loadSuccess) {
             append(name, new PsiIcon(icon));
+            cacheEntries.insert(name, entry);
         } else {
             qWarning("can't load icon because of unknown type");
         }
@@ -1485,6 +1983,139 @@ public:
         return success;
     }
 
+    static QDateTime sourceTimestamp(const QString &dir, const QString &defFile)
+    {
+        // resources change only together with the binary
+        if (dir.startsWith(QLatin1String(":/"))) {
+            return iconsetCache.binaryTimestamp;
+        }
+        QFileInfo fi(dir);
+        return fi.isDir() ? QFileInfo(dir + '/' + defFile).lastModified() : fi.lastModified();
+    }
+
+    static QString cacheFileName(const QString &dir, const QString &defFile)
+    {
+        const QByteArray key = (defFile + ':' + dir).toUtf8();
+        return iconsetCache.dir + '/'
+            + QString::fromLatin1(QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex())
+            + QLatin1String(".cache");
+    }
+
+    // restores what saveCache() wrote, images are read by the icons on first use
+    bool loadCache(const QString &dir, const QString &defFile)
+    {
+        if (iconsetCache.dir.isEmpty()) {
+            return false;
+        }
+
+        QFile f(cacheFileName(dir, defFile));
+        if (!f.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+
+        QDataStream in(&f);
+        quint32     magic = 0, cacheVersion = 0;
+        QString     appVersion, path;
+        QDateTime   stamp;
+        in >> magic >> cacheVersion;
+        if (in.status() != QDataStream::Ok || magic != ICONSET_CACHE_MAGIC || cacheVersion != ICONSET_CACHE_VERSION) {
+            return false;
+        }
+        in >> appVersion >> path >> stamp;
+        if (in.status() != QDataStream::Ok || appVersion != iconsetCache.appVersion || path != dir
+            || stamp != sourceTimestamp(dir, defFile)) {
+            return false;
+        }
+
+        Private c;
+        int     count = 0;
+        in >> c.name >> c.version >> c.description >> c.creation >> c.homeUrl >> c.authors >> c.info >> c.iconSize_
+            >> count;
+        for (int i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+            QString name, file, mime, regExp, sound;
+            bool    autoName = false, isAnim = false, isScalable = false;
+            int     textCount = 0;
+            in >> name >> autoName >> file >> isAnim >> mime >> isScalable >> regExp >> sound >> textCount;
+
+            QList<PsiIcon::IconText> text;
+            for (int j = 0; j < textCount && in.status() == QDataStream::Ok; j++) {
+                QString lang, t;
+                in >> lang >> t;
+                text.append(PsiIcon::IconText(lang, t));
+            }
+
+            // sounds unpacked from archives don't survive the restart
+            if (!sound.isEmpty() && !QFileInfo::exists(sound)) {
+                return false;
+            }
+
+            if (autoName) {
+                name = QString::asprintf("icon_%04d", icon_counter.fetchAndAddRelaxed(1));
+            }
+
+            PsiIcon icon;
+            icon.blockSignals(true);
+            icon.setName(name);
+            icon.setText(text);
+            if (!regExp.isEmpty()) {
+                icon.setRegExp(QRegExp(regExp));
+            }
+            if (!sound.isEmpty()) {
+                icon.setSound(sound);
+            }
+            icon.setDeferredData(mime, dir, file, isAnim, isScalable);
+            icon.blockSignals(false);
+
+            c.append(name, new PsiIcon(icon));
+        }
+        if (in.status() != QDataStream::Ok) {
+            return false;
+        }
+
+        setInformation(c);
+        for (PsiIcon *icon : qAsConst(c.list)) {
+            append(icon->name(), icon);
+        }
+        c.list.clear();
+        c.dict.clear();
+        return true;
+    }
+
+    void saveCache(const QString &dir, const QString &defFile) const
+    {
+        const QDateTime stamp = sourceTimestamp(dir, defFile);
+        if (iconsetCache.dir.isEmpty() || !stamp.isValid()) {
+            return;
+        }
+
+        QDir().mkpath(iconsetCache.dir);
+        QSaveFile f(cacheFileName(dir, defFile));
+        if (!f.open(QIODevice::WriteOnly)) {
+            return;
+        }
+
+        QDataStream out(&f);
+        out << ICONSET_CACHE_MAGIC << ICONSET_CACHE_VERSION << iconsetCache.appVersion << dir << stamp;
+        out << name << version << description << creation << homeUrl << authors << info << iconSize_
+            << int(list.count());
+        for (const PsiIcon *icon : list) {
+            auto it = cacheEntries.constFind(icon->name());
+            if (it == cacheEntries.constEnd()) {
+                return;
+            }
+
+            out << icon->name() << it->autoName << it->file << it->isAnim << icon->mimeType() << icon->isScalable()
+                << icon->regExp().pattern() << icon->sound() << int(icon->text().count());
+            for (const PsiIcon::IconText &t : icon->text()) {
+                out << t.lang << t.text;
+            }
+        }
+
+        if (out.status() == QDataStream::Ok) {
+            f.commit();
+        }
+    }
+
     void setInformation(const Private &from)
     {
         name        = from.name;
@@ -1500,7 +2131,7 @@ public:
 };
 //! \endif
 
-int Iconset::Private::icon_counter = 0;
+QAtomicInt Iconset::Private::icon_counter(0);
 
 // static int iconset_counter = 0;
 
@@ -1527,7 +2158,7 @@ Iconset::Iconset(const Iconset &from)
 /**
  * Destroys Iconset, and frees all allocated Icons.
  */
-Iconset::~Iconset() { IconsetFactoryPrivate::instance()->unregisterIconset(this); }
+Iconset::~Iconset() { IconsetFactoryPrivate::iconsetDestroyed(this); }
 
 /**
  * Copies all Icons as well as additional information from Iconset \a from.
@@ -1535,6 +2166,7 @@ Iconset::~Iconset() { IconsetFactoryPrivate::instance()->unregisterIconset(this)
 Iconset &Iconset::operator=(const Iconset &from)
 {
     d = from.d;
+    IconsetFactoryPrivate::iconsetChanged();
 
     return *this;
 }
@@ -1547,7 +2179,12 @@ Iconset Iconset::copy() const
     return is;
 }
 
-void Iconset::detach() { d.detach(); }
+// every modification of icons goes through here, so the factory index is dropped here as well
+void Iconset::detach()
+{
+    d.detach();
+    IconsetFactoryPrivate::iconsetChanged();
+}
 
 /**
  * Appends icons from Iconset \a from to this Iconset.
@@ -1580,6 +2217,19 @@ void Iconset::clear()
  */
 int Iconset::count() const { return d->list.count(); }
 
+/**
+ * Returns number of bytes held by decoded images of the icons.
+ * \sa IconsetFactory::setMemoryBudget()
+ */
+qint64 Iconset::memoryUsage() const
+{
+    qint64 bytes = 0;
+    for (const PsiIcon *icon : d->list) {
+        bytes += icon->memoryUsage();
+    }
+    return bytes;
+}
+
 /**
  * Loads Icons and additional information from directory \a dir. Directory can usual directory,
  * or a .zip/.jisp archive. There must exist file named \c icondef.xml in that directory.
@@ -1615,7 +2265,12 @@ bool Iconset::load(const QString &dir, Format format)
         return false;
     }
 
-    ba = d->loadData(fileName, dir);
+    if (d->loadCache(dir, fileName)) {
+        d->filename = dir;
+        return true;
+    }
+
+    ba = loadIconsetData(fileName, dir);
     if (!ba.isEmpty()) {
         QDomDocument doc;
         if (doc.setContent(ba, false)) {
@@ -1632,10 +2287,14 @@ bool Iconset::load(const QString &dir, Format format)
                    "Failed to load icondef.xml");
         qWarning("Iconset::load(\"%s\"): Failed to load icondef.xml", qPrintable(dir));
     }
-    d->zipCache.clear();
 
     // QPixmap::setDefaultOptimization( optimization );
 
+    if (ret) {
+        d->saveCache(dir, fileName);
+    }
+    d->cacheEntries.clear();
+
     return ret;
 }
 
@@ -1810,4 +2469,30 @@ void Iconset::setSoundPrefs(QString unpackPath, QObject *receiver, const char *s
 #endif
 }
 
+/**
+ * Enables the cache of parsed iconset definitions in \a dir. Iconsets loaded again
+ * with unchanged definitions skip the XML parsing and read their images on first use.
+ * Use this function before creation of Iconsets. Empty \a dir disables the cache.
+ */
+/**
+ * Maps decoded images from the shared file in \a dir, see SharedImages.
+ * It's only set up once, as images keep pointing into the mapped file. Empty \a dir does nothing.
+ */
+void Iconset::setSharedImageDir(const QString &dir)
+{
+    if (SharedImages::instance || dir.isEmpty())
+        return;
+    SharedImages::instance = new SharedImages(dir);
+    QObject::connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit,
+                     []() { SharedImages::instance->save(); });
+}
+
+void Iconset::setCacheDir(const QString &dir)
+{
+    // the loader threads only read these
+    iconsetCache.dir             = dir;
+    iconsetCache.appVersion      = QCoreApplication::applicationVersion();
+    iconsetCache.binaryTimestamp = QFileInfo(QCoreApplication::applicationFilePath()).lastModified();
+}
+
 #include "iconset.moc"
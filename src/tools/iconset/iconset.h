@@ -61,7 +61,8 @@ public:
         return *this;
     }
 
-    QSize size() const;
+    QSize  size() const;
+    qint64 memoryUsage() const;
 
     bool loadFromData(const QByteArray &);
 
@@ -122,6 +123,7 @@ public:
     QSize             size(const QSize &desiredSize = QSize()) const;
     bool              isScalable() const;
     const QString &   mimeType() const;
+    qint64            memoryUsage() const;
 
     virtual const Impix &impix() const;
     virtual const Impix &frameImpix() const;
@@ -156,6 +158,8 @@ public:
 
     bool blockSignals(bool);
     bool loadFromData(const QString &mime, const QByteArray &, bool isAnimation, bool isScalable = false);
+    void setDeferredData(const QString &mime, const QString &dir, const QString &fileName, bool isAnimation,
+                         bool isScalable = false);
 
     void stripFirstAnimFrame();
 
@@ -176,6 +180,7 @@ public:
     class Private;
 
 private:
+    friend class IconsetFactoryPrivate;
     QSharedDataPointer<Private> d;
 };
 
@@ -190,8 +195,9 @@ public:
     Iconset &operator=(const Iconset &);
     Iconset &operator+=(const Iconset &);
 
-    void clear();
-    int  count() const;
+    void   clear();
+    int    count() const;
+    qint64 memoryUsage() const;
 
     bool load(const QString &dir, Format format = Format::Psi);
 
@@ -225,6 +231,8 @@ public:
 
     static bool isSourceAllowed(const QFileInfo &fi);
     static void setSoundPrefs(QString unpackPath, QObject *receiver, const char *slot);
+    static void setCacheDir(const QString &dir);
+    static void setSharedImageDir(const QString &dir);
 
     Iconset copy() const;
     void    detach();
@@ -250,6 +258,8 @@ public:
     static const QStringList icons();
 
     static const QByteArray raw(const QString &name);
+
+    static void setMemoryBudget(qint64 bytes);
 };
 
 #endif // ICONSET_H
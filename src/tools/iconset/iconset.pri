@@ -3,8 +3,10 @@ DEPENDPATH  += $$PWD
 
 SOURCES += \
     $$PWD/iconset.cpp \
-    $$PWD/anim.cpp
+    $$PWD/anim.cpp \
+    $$PWD/ziparchives.cpp
 
 HEADERS += \
     $$PWD/iconset.h \
-    $$PWD/anim.h
+    $$PWD/anim.h \
+    $$PWD/ziparchives.h
@@ -0,0 +1,149 @@
+/*
+ * ziparchives.cpp - zip archives shared by iconsets and themes
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "ziparchives.h"
+
+#include "zip/zip.h"
+
+#include <QCache>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+
+// number of archives kept open
+#define ZIP_OPEN_ARCHIVES 8
+// memory for inflated members
+#define ZIP_MEMBER_CACHE_SIZE (4 * 1024) // KiB
+
+namespace {
+struct OpenArchive {
+    UnZip *                  zip;
+    qint64                   mtime;
+    QHash<QString, QString> *folded; // lower case member => real member, built on first use
+};
+
+QMutex                      mutex;
+QHash<QString, OpenArchive> archives;
+QStringList                 recent; // most recently used first
+QCache<QString, QByteArray> members(ZIP_MEMBER_CACHE_SIZE);
+
+void close(const QString &fileName)
+{
+    auto it = archives.find(fileName);
+    if (it != archives.end()) {
+        delete it->zip;
+        delete it->folded;
+        archives.erase(it);
+    }
+    recent.removeOne(fileName);
+}
+
+// the mutex has to be locked
+OpenArchive *archive(const QString &fileName)
+{
+    const qint64 mtime = QFileInfo(fileName).lastModified().toMSecsSinceEpoch();
+    auto         it    = archives.find(fileName);
+    if (it != archives.end()) {
+        if (it->mtime == mtime) {
+            if (recent.first() != fileName) {
+                recent.removeOne(fileName);
+                recent.prepend(fileName);
+            }
+            return &it.value();
+        }
+        close(fileName);
+    }
+
+    UnZip *zip = new UnZip(fileName);
+    if (!zip->open()) {
+        delete zip;
+        return nullptr;
+    }
+    while (recent.size() >= ZIP_OPEN_ARCHIVES) {
+        close(QString(recent.last())); // a copy, the list is changed by close()
+    }
+    recent.prepend(fileName);
+    return &archives.insert(fileName, { zip, mtime, nullptr }).value();
+}
+
+// the mutex has to be locked
+QString realMember(OpenArchive *a, const QString &member, bool caseInsensitive)
+{
+    if (!caseInsensitive) {
+        return member;
+    }
+    if (!a->folded) {
+        a->folded = new QHash<QString, QString>;
+        const QStringList names = a->zip->list();
+        for (const QString &name : names) {
+            a->folded->insert(name.toLower(), name);
+        }
+    }
+    return a->folded->value(member.toLower());
+}
+}
+
+bool ZipArchives::readFile(const QString &archiveName, const QString &member, QByteArray *data, bool caseInsensitive)
+{
+    QMutexLocker locker(&mutex);
+    OpenArchive *a = archive(archiveName);
+    if (!a) {
+        return false;
+    }
+
+    const QString real = realMember(a, member, caseInsensitive);
+    if (real.isEmpty()) {
+        return false;
+    }
+
+    // mtime is a part of the key, so members of a replaced archive are never hit
+    const QString key = QString::number(a->mtime) + archiveName + QLatin1Char('\n') + real;
+    QByteArray *  cached = members.object(key);
+    if (cached) {
+        *data = *cached;
+        return true;
+    }
+
+    if (!a->zip->readFile(real, data)) {
+        return false;
+    }
+    members.insert(key, new QByteArray(*data), qMax(1, data->size() / 1024));
+    return true;
+}
+
+bool ZipArchives::fileExists(const QString &archiveName, const QString &member, bool caseInsensitive)
+{
+    QMutexLocker locker(&mutex);
+    OpenArchive *a = archive(archiveName);
+    if (!a) {
+        return false;
+    }
+    const QString real = realMember(a, member, caseInsensitive);
+    return !real.isEmpty() && a->zip->fileExists(real);
+}
+
+void ZipArchives::clear()
+{
+    QMutexLocker locker(&mutex);
+    while (!recent.isEmpty()) {
+        close(QString(recent.first()));
+    }
+    members.clear();
+}
@@ -0,0 +1,39 @@
+/*
+ * ziparchives.h - zip archives shared by iconsets and themes
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ZIPARCHIVES_H
+#define ZIPARCHIVES_H
+
+#include <QByteArray>
+#include <QString>
+
+// A few recently used archives are kept open, so the central directory of each is read once.
+// Members are inflated only when asked for, the last ones read stay in a bounded cache.
+// Archives are reopened when they change on disk. Safe to use from any thread.
+class ZipArchives {
+public:
+    static bool readFile(const QString &archive, const QString &member, QByteArray *data,
+                         bool caseInsensitive = false);
+    static bool fileExists(const QString &archive, const QString &member, bool caseInsensitive = false);
+
+    // closes all archives and drops cached members
+    static void clear();
+};
+
+#endif // ZIPARCHIVES_H
@@ -23,8 +23,10 @@
 #include "optionstreereader.h"
 #include "optionstreewriter.h"
 
+#include <QBuffer>
 #include <QDomDocument>
 #include <QDomElement>
+#include <QSaveFile>
 #include <QStringList>
 
 /**
@@ -223,20 +225,32 @@ QVariantList OptionsTree::mapKeyList(const QString &basename, bool sortedByNumbe
  * \param configName Name of the root element for the file
  * \param configVersion Version of the config format
  * \param configNS Namespace of the config format
+ * \param streamWriter Serialize with OptionsTreeWriter instead of building a QDomDocument
  * \return 'true' if the file saves, 'false' if it fails
  */
 bool OptionsTree::saveOptions(const QString &fileName, const QString &configName, const QString &configNS,
                               const QString &configVersion, bool streamWriter) const
 {
-    AtomicXmlFile f(fileName);
     if (streamWriter) {
+        // serialized in memory first, so the file gets one write and is replaced atomically on commit()
+        QByteArray data;
+        QBuffer    buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
         OptionsTreeWriter writer(this);
         writer.setName(configName);
         writer.setNameSpace(configNS);
         writer.setVersion(configVersion);
-        return f.saveDocument(&writer);
+        if (!writer.write(&buffer))
+            return false;
+
+        QSaveFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly) || f.write(data) != data.size())
+            return false;
+        return f.commit();
     }
-    QDomDocument doc(configName);
+
+    AtomicXmlFile f(fileName);
+    QDomDocument  doc(configName);
 
     QDomElement base = doc.createElement(configName);
     base.setAttribute("version", configVersion);
@@ -254,6 +268,7 @@ bool OptionsTree::saveOptions(const QString &fileName, const QString &configName
  * \param configName Name of the root element to check for
  * \param configVersion If specified, the function will fail if the file version doesn't match
  * \param configNS Namespace of the config format
+ * \param streamReader Parse with OptionsTreeReader instead of building a QDomDocument
  * \return 'true' if the file loads, 'false' if it fails
  */
 bool OptionsTree::loadOptions(const QString &fileName, const QString &configName, const QString &configNS,
@@ -278,6 +293,17 @@ bool OptionsTree::loadOptions(const QString &fileName, const QString &configName
  */
 bool OptionsTree::exists(QString fileName) { return AtomicXmlFile::exists(fileName); }
 
+/**
+ * Writes all options in a binary form meant for caching, not for storage
+ */
+void OptionsTree::toBinary(QDataStream &out) const { tree_.toBinary(out); }
+
+/**
+ * Merges options written by toBinary(), like loadOptions() would
+ * \return 'true' if the data was read completely
+ */
+bool OptionsTree::fromBinary(QDataStream &in) { return tree_.fromBinary(in); }
+
 /**
  * Loads all options from an XML element
  * \param base the element to read the options from
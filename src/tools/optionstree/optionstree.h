@@ -63,13 +63,16 @@ public:
     QVariantList mapKeyList(const QString &basename, bool sortedByNumbers = false) const;
 
     bool        saveOptions(const QString &fileName, const QString &configName, const QString &configNS,
-                            const QString &configVersion, bool streamWriter = false) const;
+                            const QString &configVersion, bool streamWriter = true) const;
     bool        loadOptions(const QString &fileName, const QString &configName, const QString &configNS = "",
-                            const QString &configVersion = "", bool streamReader = false);
+                            const QString &configVersion = "", bool streamReader = true);
     bool        loadOptions(const QDomElement &name, const QString &configName, const QString &configNS = "",
                             const QString &configVersion = "");
     static bool exists(QString fileName);
 
+    void toBinary(QDataStream &out) const;
+    bool fromBinary(QDataStream &in);
+
 signals:
     void optionChanged(const QString &option);
     void optionAboutToBeInserted(const QString &option);
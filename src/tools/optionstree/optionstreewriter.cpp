@@ -28,12 +28,13 @@ bool OptionsTreeWriter::write(QIODevice *device)
     writeDTD(QString("<!DOCTYPE %1>").arg(configName_));
     writeStartElement(configName_);
     writeAttribute("version", configVersion_);
-    writeAttribute("xmlns", configNS_);
+    if (!configNS_.isEmpty())
+        writeAttribute("xmlns", configNS_);
 
     writeTree(&options_->tree_);
 
     writeEndDocument();
-    return true;
+    return !hasError();
 }
 
 void OptionsTreeWriter::writeTree(const VariantTree *tree)
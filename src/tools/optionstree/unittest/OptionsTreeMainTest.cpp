@@ -7,6 +7,9 @@
 #include <QObject>
 #include <QTime>
 #include <QtTest/QtTest>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
 
 class Benchmark {
 public:
@@ -31,6 +34,21 @@ private:
     QList<int> results_;
 };
 
+// peak resident set size of the process in KiB, 0 where unknown
+static long peakMemory()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+#ifdef Q_OS_MAC
+        return usage.ru_maxrss / 1024;
+#else
+        return usage.ru_maxrss;
+#endif
+#endif
+    return 0;
+}
+
 class OptionsTreeMainTest : public QObject {
     Q_OBJECT
 
@@ -131,7 +149,7 @@ private slots:
         QBENCHMARK
         {
             OptionsTree tree;
-            tree.loadOptions(dir() + "/mbl_options.xml", "options", "https://psi-im.org/options", "0.1");
+            tree.loadOptions(dir() + "/mbl_options.xml", "options", "https://psi-im.org/options", "0.1", false);
         }
     }
 
@@ -156,7 +174,7 @@ private slots:
         QBENCHMARK
         {
             OptionsTree tree;
-            tree.loadOptions(dir() + "/mbl_accounts.xml", "accounts", "https://psi-im.org/options", "0.1");
+            tree.loadOptions(dir() + "/mbl_accounts.xml", "accounts", "https://psi-im.org/options", "0.1", false);
         }
     }
 
@@ -173,7 +191,10 @@ private slots:
     {
         OptionsTree tree;
         tree.loadOptions(dir() + "/mbl_accounts.xml", "accounts", "https://psi-im.org/options", "0.1");
-        QBENCHMARK { tree.saveOptions(dir() + "/mbl_accounts2.xml", "accounts", "https://psi-im.org/options", "0.1"); }
+        QBENCHMARK
+        {
+            tree.saveOptions(dir() + "/mbl_accounts2.xml", "accounts", "https://psi-im.org/options", "0.1", false);
+        }
     }
 
     void benchSaveAccountsStream()
@@ -185,6 +206,56 @@ private slots:
             tree.saveOptions(dir() + "/mbl_accounts2.xml", "accounts", "https://psi-im.org/options", "0.1", true);
         }
     }
+    // about 10 MB of options, written once and shared by the benchmarks below
+    QString largeFile()
+    {
+        const QString fileName = QDir::tempPath() + "/optionstree_large.xml";
+        if (!QFile::exists(fileName)) {
+            OptionsTree tree;
+            const QString value(100, QLatin1Char('x'));
+            for (int i = 0; i < 1000; ++i) {
+                for (int j = 0; j < 70; ++j)
+                    tree.setOption(QString("group%1.item%2.value").arg(i).arg(j), value);
+            }
+            tree.saveOptions(fileName, "options", "https://psi-im.org/options", "0.1");
+            qWarning() << "large file size" << QFileInfo(fileName).size();
+        }
+        return fileName;
+    }
+
+    void benchLoadLarge_data()
+    {
+        // ru_maxrss only grows, so the cheaper row goes first
+        QTest::addColumn<bool>("stream");
+        QTest::newRow("stream") << true;
+        QTest::newRow("dom") << false;
+    }
+
+    void benchLoadLarge()
+    {
+        QFETCH(bool, stream);
+        const QString fileName = largeFile();
+        const long    before   = peakMemory();
+        QBENCHMARK
+        {
+            OptionsTree tree;
+            tree.loadOptions(fileName, "options", "https://psi-im.org/options", "0.1", stream);
+        }
+        qWarning() << "peak memory growth, KiB:" << peakMemory() - before;
+    }
+
+    void benchSaveLarge_data() { benchLoadLarge_data(); }
+
+    void benchSaveLarge()
+    {
+        QFETCH(bool, stream);
+        OptionsTree tree;
+        tree.loadOptions(largeFile(), "options", "https://psi-im.org/options", "0.1");
+        const QString fileName = QDir::tempPath() + "/optionstree_large2.xml";
+        const long    before   = peakMemory();
+        QBENCHMARK { tree.saveOptions(fileName, "options", "https://psi-im.org/options", "0.1", stream); }
+        qWarning() << "peak memory growth, KiB:" << peakMemory() - before;
+    }
     // #endif
 
     // #endif
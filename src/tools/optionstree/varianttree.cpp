@@ -20,6 +20,7 @@
 #include "varianttree.h"
 
 #include <QColor>
+#include <QDataStream>
 #include <QDomDocument>
 #include <QDomDocumentFragment>
 #include <QDomElement>
@@ -27,6 +28,7 @@
 #include <QRect>
 #include <QSize>
 #include <QStringList>
+#include <QTextStream>
 
 // FIXME: Helpers from xmpp_xmlcommon.h would be very appropriate for
 // void VariantTree::variantToElement(const QVariant& var, QDomElement& e)
@@ -360,6 +362,72 @@ void VariantTree::fromXml(const QDomElement &ele)
     }
 }
 
+/**
+ * Writes the tree in QDataStream format, a much faster to read equivalent of toXml()
+ */
+void VariantTree::toBinary(QDataStream &out) const
+{
+    QHash<QString, QString> unknowns;
+    for (auto it = unknowns_.constBegin(); it != unknowns_.constEnd(); ++it) {
+        QString     xml;
+        QTextStream ts(&xml);
+        it.value().save(ts, 0);
+        unknowns.insert(it.key(), xml);
+    }
+    out << values_ << comments_ << unknowns << unknowns2_;
+
+    out << quint32(trees_.size());
+    for (auto it = trees_.constBegin(); it != trees_.constEnd(); ++it) {
+        out << it.key();
+        it.value()->toBinary(out);
+    }
+}
+
+/**
+ * Merges a tree written by toBinary() into this one, the same way fromXml() does
+ */
+bool VariantTree::fromBinary(QDataStream &in)
+{
+    QHash<QString, QVariant> values;
+    QHash<QString, QString>  comments;
+    QHash<QString, QString>  unknowns;
+    QHash<QString, QString>  unknowns2;
+    in >> values >> comments >> unknowns >> unknowns2;
+    if (in.status() != QDataStream::Ok)
+        return false;
+
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it)
+        values_[it.key()] = it.value();
+    for (auto it = comments.constBegin(); it != comments.constEnd(); ++it)
+        comments_[it.key()] = it.value();
+    for (auto it = unknowns2.constBegin(); it != unknowns2.constEnd(); ++it)
+        unknowns2_[it.key()] = it.value();
+    for (auto it = unknowns.constBegin(); it != unknowns.constEnd(); ++it) {
+        QDomDocument doc;
+        if (!doc.setContent(it.value()))
+            continue;
+        if (!unknownsDoc)
+            unknownsDoc = new QDomDocument();
+        QDomDocumentFragment frag(unknownsDoc->createDocumentFragment());
+        frag.appendChild(unknownsDoc->importNode(doc.documentElement(), true));
+        unknowns_[it.key()] = frag;
+    }
+
+    quint32 count = 0;
+    in >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString name;
+        in >> name;
+        if (name.isEmpty())
+            return false;
+        if (!trees_.contains(name))
+            trees_[name] = new VariantTree(this);
+        if (!trees_[name]->fromBinary(in))
+            return false;
+    }
+    return in.status() == QDataStream::Ok;
+}
+
 /**
  * Extracts a variant from an element.
  * The attribute of the element is used to determine the type.
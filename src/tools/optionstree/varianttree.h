@@ -24,6 +24,7 @@
 #include <QObject>
 #include <QVariant>
 
+class QDataStream;
 class QDomDocument;
 class QDomDocumentFragment;
 class QDomElement;
@@ -65,6 +66,8 @@ public:
 
     void toXml(QDomDocument &doc, QDomElement &ele) const;
     void fromXml(const QDomElement &ele);
+    void toBinary(QDataStream &out) const;
+    bool fromBinary(QDataStream &in);
 
     static bool isValidNodeName(const QString &name);
 
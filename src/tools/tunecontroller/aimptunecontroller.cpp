@@ -45,6 +45,7 @@ int AimpTuneController::getAimpStatus(const HWND &aimp) const
 void AimpTuneController::check()
 {
     HWND aimp = findAimp();
+    setPlayerPresent(aimp != nullptr);
     if (getAimpStatus(aimp) == PLAYING) {
         sendTune(getTune());
     } else {
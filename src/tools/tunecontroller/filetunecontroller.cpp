@@ -27,6 +27,8 @@
 #include <QFileInfo>
 #include <QTextStream>
 
+static const int ChangedDelay = 300;
+
 /**
  * \class FileTuneController
  * \brief A player-independent class for controlling any player through files.
@@ -45,7 +47,7 @@
  *        read.
  */
 FileTuneController::FileTuneController(const QString &songFile) :
-    PollingTuneController(), _songFile(songFile), _waitForCreated(true), _watchFunctional(false)
+    PollingTuneController(), _songFile(songFile), _size(-1), _waitForCreated(true), _watchFunctional(false)
 {
     // old mechanism of work with tune file
     startPoll();
@@ -55,9 +57,15 @@ FileTuneController::FileTuneController(const QString &songFile) :
     // watching. on the other hand if watch is recognized as functional polling will be disabled, so the user should
     // understand if he suddenly removed the directory with watched file tunes won't work at all.
     _tuneFileWatcher = new QCA::FileWatch(_songFile, this); // qca watch works on non-existing files ;)
+    _changedTimer.setSingleShot(true);
+    _changedTimer.setInterval(ChangedDelay);
+    connect(&_changedTimer, &QTimer::timeout, this, [this]() {
+        _modified = QDateTime(); // read it whatever the timestamps say
+        check();
+    });
     connect(_tuneFileWatcher, &QCA::FileWatch::changed, this, [this]() {
         _watchFunctional = true;
-        check();
+        _changedTimer.start();
     });
 }
 
@@ -65,15 +73,29 @@ Tune FileTuneController::currentTune() const { return _currentTune; }
 
 void FileTuneController::check()
 {
-    Tune existedTune = _currentTune;
-    _currentTune     = Tune(); // just a reset
-    if (QFile::exists(_songFile)) {
+    QFileInfo fi(_songFile);
+    // no file, so no player writes it: the fallback polling slows down
+    setPlayerPresent(fi.exists());
+    if (fi.exists()) {
         if (_waitForCreated && _watchFunctional) {
             if (isPolling()) {
                 stopPoll();
             }
             _waitForCreated = false;
         }
+        // unchanged since it was read last time
+        if (fi.lastModified() == _modified && fi.size() == _size) {
+            return;
+        }
+        _modified = fi.lastModified();
+        _size     = fi.size();
+    } else {
+        _modified = QDateTime();
+    }
+
+    Tune existedTune = _currentTune;
+    _currentTune     = Tune(); // just a reset
+    if (fi.exists()) {
         QFile file(_songFile);
         if (file.open(QIODevice::ReadOnly)) {
             QTextStream stream(&file);
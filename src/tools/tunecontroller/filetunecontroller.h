@@ -24,6 +24,9 @@
 #include "pollingtunecontroller.h"
 #include "tune.h"
 
+#include <QDateTime>
+#include <QTimer>
+
 namespace QCA {
 class FileWatch;
 }
@@ -43,6 +46,9 @@ protected slots:
 private:
     QString         _songFile;
     QCA::FileWatch *_tuneFileWatcher;
+    QTimer          _changedTimer; // players write the file in several steps
+    QDateTime       _modified;     // of the file as last read
+    qint64          _size;
     Tune            _currentTune;
     bool            _waitForCreated;
     bool _watchFunctional; // is able to work at all (for example it is known NFS doesn't support fs notifications)
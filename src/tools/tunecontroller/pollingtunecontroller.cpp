@@ -34,12 +34,42 @@
 /**
  * \brief Constructs the controller.
  */
-PollingTuneController::PollingTuneController()
+PollingTuneController::PollingTuneController() : _interval(DefaultInterval), _backOff(0)
 {
     connect(&_timer, SIGNAL(timeout()), SLOT(check()));
     _timer.setInterval(DefaultInterval);
 }
 
+/**
+ * \brief Sets the interval polling goes back to once a player is present.
+ */
+void PollingTuneController::setInterval(int interval)
+{
+    _interval = interval;
+    if (!_backOff) {
+        _timer.setInterval(interval);
+    }
+}
+
+/**
+ * \brief Called from check() with whether the player runs at all.
+ *
+ * The interval is doubled with every check that finds no player, up to
+ * MaxInterval, so an idle controller hardly wakes up.
+ */
+void PollingTuneController::setPlayerPresent(bool present)
+{
+    if (present) {
+        if (_backOff) {
+            _backOff = 0;
+            _timer.setInterval(_interval);
+        }
+        return;
+    }
+    _backOff = qMin(qMax(_backOff, _interval) * 2, int(MaxInterval));
+    _timer.setInterval(_backOff);
+}
+
 /**
  * Polls for new song info.
  */
@@ -30,14 +30,20 @@ class PollingTuneController : public TuneController {
 
 private:
     static const int DefaultInterval = 10000;
+    static const int MaxInterval     = 60000; // reached while no player runs
     QTimer           _timer;
+    int              _interval;
+    int              _backOff;
 
 public:
     PollingTuneController();
     inline bool isPolling() const { return _timer.isActive(); }
-    inline void startPoll() { _timer.start(DefaultInterval); }
+    inline void startPoll() { _timer.start(); }
     inline void stopPoll() { _timer.stop(); }
-    inline void setInterval(int interval) { _timer.setInterval(interval); }
+    void        setInterval(int interval);
+
+protected:
+    void setPlayerPresent(bool present);
 
 protected slots:
     virtual void check();
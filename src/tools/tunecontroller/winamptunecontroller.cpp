@@ -147,11 +147,12 @@ void WinAmpTuneController::check()
 #else
     HWND h = FindWindow("Winamp v1.x", nullptr);
 #endif
+    setInterval(NormInterval); // getTune() may ask for a quick retry
     if (h && SendMessage(h, WM_WA_IPC, 0, IPC_ISPLAYING) == 1) {
         tune = getTune(h);
     }
     prevTune_ = tune;
-    setInterval(NormInterval);
+    setPlayerPresent(h != nullptr);
     PollingTuneController::check();
 }
 
@@ -0,0 +1,229 @@
+/*
+ * transferscheduler.cpp - shared limits of outgoing file transfers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "transferscheduler.h"
+
+#include "psioptions.h"
+
+#include <QIODevice>
+#include <QPointer>
+
+#include <limits>
+
+// tokens are refilled this many times a second
+#define SHAPER_TICKS_PER_SECOND 10
+// part of each tick kept for interactive transfers while there are some
+#define SHAPER_INTERACTIVE_RESERVE 4
+
+static const QString maxParallelOptionPath      = "options.file-transfer.max-parallel";
+static const QString globalRateLimitOptionPath  = "options.file-transfer.global-rate-limit";
+static const QString accountRateLimitOptionPath = "options.file-transfer.account-rate-limit";
+
+//----------------------------------------------------------------------------
+// ThrottledDevice
+//----------------------------------------------------------------------------
+// sequential reader of the source, each read takes tokens from the scheduler
+class ThrottledDevice : public QIODevice {
+public:
+    ThrottledDevice(TransferScheduler *scheduler, QIODevice *source, PsiAccount *acc,
+                    TransferScheduler::Priority prio) :
+        QIODevice(source->parent()),
+        scheduler(scheduler), source(source), acc(acc), prio(prio)
+    {
+        source->setParent(this);
+        connect(source, &QIODevice::readyRead, this, &QIODevice::readyRead);
+        open(QIODevice::ReadOnly);
+        scheduler->addDevice(this);
+    }
+
+    ~ThrottledDevice()
+    {
+        if (scheduler)
+            scheduler->removeDevice(this);
+    }
+
+    bool isSequential() const override { return true; }
+
+    qint64 bytesAvailable() const override
+    {
+        qint64 avail = source->bytesAvailable();
+        if (scheduler)
+            avail = qMin(avail, scheduler->allowance(acc, prio));
+        return QIODevice::bytesAvailable() + avail;
+    }
+
+    bool atEnd() const override { return QIODevice::bytesAvailable() == 0 && source->atEnd(); }
+
+    void close() override
+    {
+        source->close();
+        QIODevice::close();
+    }
+
+    // more tokens came
+    void wake()
+    {
+        if (waiting) {
+            waiting = false;
+            emit readyRead();
+        }
+    }
+
+    QPointer<TransferScheduler>       scheduler;
+    QIODevice *                       source;
+    PsiAccount *                      acc;
+    const TransferScheduler::Priority prio;
+    bool                              waiting = false;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        if (source->atEnd())
+            return -1;
+        qint64 n = scheduler ? scheduler->grant(acc, prio, maxSize) : maxSize;
+        if (!n) {
+            waiting = true;
+            return 0;
+        }
+        return source->read(data, n);
+    }
+
+    qint64 writeData(const char *, qint64) override { return -1; }
+};
+
+//----------------------------------------------------------------------------
+// TransferScheduler
+//----------------------------------------------------------------------------
+TransferScheduler::TransferScheduler(QObject *parent) : QObject(parent)
+{
+    tick_.setInterval(1000 / SHAPER_TICKS_PER_SECOND);
+    connect(&tick_, &QTimer::timeout, this, &TransferScheduler::tick);
+    connect(PsiOptions::instance(), &PsiOptions::optionChanged, this, &TransferScheduler::optionChanged);
+    optionChanged(maxParallelOptionPath);
+    optionChanged(globalRateLimitOptionPath);
+    optionChanged(accountRateLimitOptionPath);
+}
+
+TransferScheduler::~TransferScheduler() { }
+
+void TransferScheduler::optionChanged(const QString &option)
+{
+    if (option == maxParallelOptionPath) {
+        maxParallel_ = qMax(0, PsiOptions::instance()->getOption(option).toInt());
+        startQueued();
+    } else if (option == globalRateLimitOptionPath) {
+        globalRate_   = qMax(0, PsiOptions::instance()->getOption(option).toInt()) * 1024LL;
+        globalTokens_ = globalRate_ / SHAPER_TICKS_PER_SECOND;
+    } else if (option == accountRateLimitOptionPath) {
+        accountRate_ = qMax(0, PsiOptions::instance()->getOption(option).toInt()) * 1024LL;
+        accountTokens_.clear();
+    }
+}
+
+void TransferScheduler::schedule(PsiAccount *acc, Priority prio, const std::function<QObject *()> &start)
+{
+    int i = 0;
+    while (i < queue_.size() && queue_[i].prio <= prio)
+        ++i;
+    queue_.insert(i, { acc, prio, start });
+    startQueued();
+}
+
+void TransferScheduler::release(QObject *transfer)
+{
+    if (!running_.remove(transfer))
+        return;
+    disconnect(transfer, nullptr, this, nullptr);
+    startQueued();
+}
+
+void TransferScheduler::startQueued()
+{
+    while (!queue_.isEmpty()
+           && (!maxParallel_ || running_.size() < maxParallel_ || queue_.first().prio == Interactive)) {
+        auto     p        = queue_.takeFirst();
+        QObject *transfer = p.start();
+        if (!transfer)
+            continue;
+        running_.insert(transfer);
+        connect(transfer, &QObject::destroyed, this, [this, transfer]() { release(transfer); });
+    }
+}
+
+QIODevice *TransferScheduler::throttle(QIODevice *dev, PsiAccount *acc, Priority prio)
+{
+    if (!globalRate_ && !accountRate_)
+        return dev;
+    return new ThrottledDevice(this, dev, acc, prio);
+}
+
+qint64 TransferScheduler::allowance(PsiAccount *acc, Priority prio) const
+{
+    qint64 n = std::numeric_limits<qint64>::max();
+    if (globalRate_) {
+        n = globalTokens_;
+        if (prio != Interactive && !devices_.isEmpty() && devices_.first()->prio == Interactive)
+            n -= globalRate_ / SHAPER_TICKS_PER_SECOND / SHAPER_INTERACTIVE_RESERVE;
+    }
+    if (accountRate_)
+        n = qMin(n, accountTokens_.value(acc, accountRate_ / SHAPER_TICKS_PER_SECOND));
+    return qMax(n, qint64(0));
+}
+
+qint64 TransferScheduler::grant(PsiAccount *acc, Priority prio, qint64 wanted)
+{
+    qint64 n = qMin(wanted, allowance(acc, prio));
+    if (globalRate_)
+        globalTokens_ -= n;
+    if (accountRate_)
+        accountTokens_[acc] = accountTokens_.value(acc, accountRate_ / SHAPER_TICKS_PER_SECOND) - n;
+    return n;
+}
+
+void TransferScheduler::tick()
+{
+    // a device idle for a while may send a second worth of data at once, not more
+    if (globalRate_)
+        globalTokens_ = qMin(globalTokens_ + globalRate_ / SHAPER_TICKS_PER_SECOND, globalRate_);
+    for (auto it = accountTokens_.begin(); it != accountTokens_.end(); ++it)
+        it.value() = qMin(it.value() + accountRate_ / SHAPER_TICKS_PER_SECOND, accountRate_);
+
+    // interactive first, they are in front
+    const auto devices = devices_;
+    for (auto dev : devices) {
+        if (devices_.contains(dev))
+            dev->wake();
+    }
+}
+
+void TransferScheduler::addDevice(ThrottledDevice *dev)
+{
+    int i = 0;
+    while (i < devices_.size() && devices_[i]->prio <= dev->prio)
+        ++i;
+    devices_.insert(i, dev);
+    tick_.start();
+}
+
+void TransferScheduler::removeDevice(ThrottledDevice *dev)
+{
+    devices_.removeOne(dev);
+    if (devices_.isEmpty())
+        tick_.stop();
+}
@@ -0,0 +1,89 @@
+/*
+ * transferscheduler.h - shared limits of outgoing file transfers
+ * Copyright (C) 2026  Psi Development Team
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TRANSFERSCHEDULER_H
+#define TRANSFERSCHEDULER_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include <functional>
+
+class PsiAccount;
+class QIODevice;
+class ThrottledDevice;
+
+// Keeps outgoing transfers (jingle file transfers, http uploads) within the configured number of parallel
+// transfers and the global and per-account upload rates, so they don't starve the chat on slow uplinks.
+class TransferScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    enum Priority {
+        Interactive, // sent right from the chat, never queued and served first
+        Normal,
+        Background
+    };
+
+    explicit TransferScheduler(QObject *parent = nullptr);
+    ~TransferScheduler();
+
+    // start is called when a transfer slot is free and returns the started transfer or nullptr.
+    // the slot stays taken until the transfer is released or destroyed
+    void schedule(PsiAccount *acc, Priority prio, const std::function<QObject *()> &start);
+    void release(QObject *transfer);
+
+    // returns a device reading from the opened dev within the rate limits, or dev itself if there are no limits.
+    // the returned device takes the parent of dev and becomes its parent
+    QIODevice *throttle(QIODevice *dev, PsiAccount *acc, Priority prio);
+
+private slots:
+    void optionChanged(const QString &option);
+    void tick();
+
+private:
+    friend class ThrottledDevice;
+
+    struct Pending {
+        PsiAccount *               acc;
+        Priority                   prio;
+        std::function<QObject *()> start;
+    };
+
+    qint64 allowance(PsiAccount *acc, Priority prio) const;
+    qint64 grant(PsiAccount *acc, Priority prio, qint64 wanted);
+    void   addDevice(ThrottledDevice *dev);
+    void   removeDevice(ThrottledDevice *dev);
+    void   startQueued();
+
+    QList<Pending>              queue_; // sorted by priority
+    QSet<QObject *>             running_;
+    QList<ThrottledDevice *>    devices_; // sorted by priority
+    QHash<PsiAccount *, qint64> accountTokens_;
+    qint64                      globalTokens_ = 0;
+    int                         maxParallel_  = 0; // 0 - no limit
+    qint64                      globalRate_   = 0; // bytes per second, 0 - no limit
+    qint64                      accountRate_  = 0;
+    QTimer                      tick_;
+};
+
+#endif // TRANSFERSCHEDULER_H
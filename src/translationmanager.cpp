@@ -41,6 +41,9 @@ TranslationManager::TranslationManager()
     // The qt translator
     qt_translator_ = new QTranslator(nullptr);
 
+    qmFile_   = nullptr;
+    qtQmFile_ = nullptr;
+
     // Self-destruct
     connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), SLOT(deleteLater()));
 }
@@ -54,6 +57,10 @@ TranslationManager::~TranslationManager()
     QCoreApplication::instance()->removeTranslator(qt_translator_);
     delete qt_translator_;
     qt_translator_ = nullptr;
+
+    // unmapped only after the translators are gone
+    delete qmFile_;
+    delete qtQmFile_;
 }
 
 TranslationManager *TranslationManager::instance()
@@ -76,9 +83,38 @@ QString TranslationManager::currentXMLLanguage() const
     return xmllang;
 }
 
-bool loadQtTranslationHelper(const QString &language, const QString &dir, QTranslator *qt_translator)
+/**
+ * Loads prefix + language from dir, falling back to shorter language names like
+ * QTranslator::load() does ("pt_BR" -> "pt"). The catalogue is memory-mapped and
+ * used in place, \a file keeps the mapping alive as long as the translator needs it.
+ */
+static bool loadMapped(QTranslator *translator, QFile **file, const QString &prefix, const QString &language,
+                       const QString &dir)
+{
+    QString lang = language;
+    while (!lang.isEmpty()) {
+        QFile *f = new QFile(dir + "/" + prefix + lang + ".qm");
+        if (f->open(QIODevice::ReadOnly)) {
+            const uchar *data = f->map(0, f->size());
+            if (data ? translator->load(data, int(f->size()), dir) : translator->load(f->fileName())) {
+                delete *file;
+                *file = data ? f : nullptr;
+                if (!data)
+                    delete f;
+                return true;
+            }
+        }
+        delete f;
+
+        int n = lang.lastIndexOf('_');
+        lang  = n > 0 ? lang.left(n) : QString();
+    }
+    return false;
+}
+
+bool loadQtTranslationHelper(const QString &language, const QString &dir, QTranslator *qt_translator, QFile **file)
 {
-    return qt_translator->load("qt_" + language, dir);
+    return loadMapped(qt_translator, file, "qt_", language, dir);
 }
 
 bool TranslationManager::loadQtTranslation(const QString &language)
@@ -87,12 +123,13 @@ bool TranslationManager::loadQtTranslation(const QString &language)
     for (const QString &dir : dirs) {
         if (!QFile::exists(dir))
             continue;
-        if (loadQtTranslationHelper(language, dir, qt_translator_)) {
+        if (loadQtTranslationHelper(language, dir, qt_translator_, &qtQmFile_)) {
             return true;
         }
     }
 
-    return loadQtTranslationHelper(language, QLibraryInfo::location(QLibraryInfo::TranslationsPath), qt_translator_);
+    return loadQtTranslationHelper(language, QLibraryInfo::location(QLibraryInfo::TranslationsPath), qt_translator_,
+                                   &qtQmFile_);
 }
 
 void TranslationManager::loadTranslation(const QString &language)
@@ -111,7 +148,7 @@ void TranslationManager::loadTranslation(const QString &language)
     for (const QString &dir : dirs) {
         if (!QFile::exists(dir))
             continue;
-        if (translator_->load("psi_" + language, dir)) {
+        if (loadMapped(translator_, &qmFile_, "psi_", language, dir)) {
             loadQtTranslation(language);
 
             if (currentLanguage_ == "en") {
@@ -126,6 +163,10 @@ void TranslationManager::loadTranslation(const QString &language)
 
 VarList TranslationManager::availableTranslations()
 {
+    // every catalogue has to be opened for its language name, so it's done once
+    if (!languages_.isEmpty())
+        return languages_;
+
     VarList langs;
 
     // We always support english
@@ -153,21 +194,26 @@ VarList TranslationManager::availableTranslations()
             // printf("found [%s], lang=[%s]\n", str.latin1(), lang.latin1());
 
             // get the language_name
-            QString     name = QString("[") + str + "]";
-            QTranslator t(nullptr);
-            if (!t.load(str, dirName))
-                continue;
-
-            // Is translate equivalent to the old findMessage? I hope so
-            // Qt4 conversion
-            QString s = t.translate("@default", "language_name");
-            if (!s.isEmpty())
-                name = s;
+            QString name = QString("[") + str + "]";
+            QFile * f    = nullptr;
+            {
+                QTranslator t(nullptr);
+                if (!loadMapped(&t, &f, "psi_", lang, dirName))
+                    continue;
+
+                // Is translate equivalent to the old findMessage? I hope so
+                // Qt4 conversion
+                QString s = t.translate("@default", "language_name");
+                if (!s.isEmpty())
+                    name = s;
+            }
+            delete f;
 
             langs.set(lang, name);
         }
     }
 
+    languages_ = langs;
     return langs;
 }
 
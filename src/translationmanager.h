@@ -20,10 +20,12 @@
 #ifndef TRANSLATIONMANAGER_H
 #define TRANSLATIONMANAGER_H
 
+#include "varlist.h"
+
 #include <QObject>
 
+class QFile;
 class QTranslator;
-class VarList;
 
 class TranslationManager : public QObject {
     Q_OBJECT
@@ -48,6 +50,9 @@ private:
     // QString currentLanguageName_;
     QTranslator *translator_;
     QTranslator *qt_translator_;
+    QFile *      qmFile_;    // catalogue mapped by translator_
+    QFile *      qtQmFile_;  // catalogue mapped by qt_translator_
+    VarList      languages_; // filled on the first availableTranslations()
 
     static TranslationManager *instance_;
 };
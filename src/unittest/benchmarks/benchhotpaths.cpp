@@ -0,0 +1,174 @@
+#include "applicationinfo.h"
+#include "edbsqlite.h"
+#include "filecache.h"
+#include "optionstree.h"
+#include "profiles.h"
+#include "psiiconset.h"
+#include "textutil.h"
+#include "xmpp_hash.h"
+
+#include <QCryptographicHash>
+#include <QSignalSpy>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include <QtTest/QtTest>
+
+// rows of the synthetic history
+#define BENCH_HISTORY_EVENTS 1000000
+// contacts the history is spread over
+#define BENCH_HISTORY_CONTACTS 500
+// items in the file cache
+#define BENCH_CACHE_ITEMS 5000
+
+// Benchmarks of the code known to be hot. Fixtures are synthetic but sized like a long used profile,
+// run with e.g. "./benchhotpaths -iterations 10" or "./benchhotpaths benchLinkify"
+class BenchHotPaths : public QObject {
+    Q_OBJECT
+private:
+    QTemporaryDir     home;
+    EDBSqLite *       edb     = nullptr;
+    OptionsTree *     options = nullptr;
+    FileCache *       cache   = nullptr;
+    QList<XMPP::Hash> cacheIds;
+    QString           longMessage;
+    const QString     accId = "bench";
+    const XMPP::Jid   jid   = XMPP::Jid("contact42@example.org");
+
+    static XMPP::Jid contactJid(int n) { return XMPP::Jid(QString("contact%1@example.org").arg(n)); }
+
+    // written with one transaction on a side connection, going through the worker would take hours
+    void fillHistory()
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "bench_fill");
+        db.setDatabaseName(ApplicationInfo::historyDir() + "/history.db");
+        QVERIFY(db.open());
+        QSqlQuery query(db);
+        QVERIFY(db.transaction());
+        query.prepare("INSERT INTO `contacts` (`id`, `acc_id`, `type`, `jid`, `lifetime`) VALUES (?, ?, 0, ?, -1);");
+        for (int n = 0; n < BENCH_HISTORY_CONTACTS; ++n) {
+            query.addBindValue(n + 1);
+            query.addBindValue(accId);
+            query.addBindValue(contactJid(n).full());
+            QVERIFY(query.exec());
+        }
+        query.prepare("INSERT INTO `events` (`contact_id`, `date`, `type`, `direction`, `m_text`) "
+                      "VALUES (?, ?, 1, ?, ?);");
+        QDateTime date = QDateTime::currentDateTime().addSecs(-BENCH_HISTORY_EVENTS);
+        for (int n = 0; n < BENCH_HISTORY_EVENTS; ++n) {
+            query.addBindValue(n % BENCH_HISTORY_CONTACTS + 1);
+            query.addBindValue(date.addSecs(n).toString(Qt::ISODate));
+            query.addBindValue(n % 2);
+            query.addBindValue(QString("message %1, see you at https://example.org/page/%1 :)").arg(n));
+            QVERIFY(query.exec());
+        }
+        QVERIFY(db.commit());
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase("bench_fill");
+    }
+
+private slots:
+    void initTestCase()
+    {
+        QVERIFY(home.isValid());
+        qputenv("PSIDATADIR", home.path().toLocal8Bit());
+        activeProfile = "bench";
+        QVERIFY(QDir().mkpath(ApplicationInfo::historyDir()));
+
+        edb = new EDBSqLite(nullptr);
+        fillHistory();
+
+        options = new OptionsTree;
+        for (int n = 0; n < 1000; ++n)
+            options->setOption(QString("options.bench.group%1.option%2").arg(n / 50).arg(n % 50), n);
+
+        cache = new FileCache(home.path() + "/cache");
+        cache->setSyncPolicy(FileCache::FlushOverflow);
+        for (int n = 0; n < BENCH_CACHE_ITEMS; ++n) {
+            const QByteArray data = QByteArray::number(n).repeated(64);
+            cacheIds += XMPP::Hash(XMPP::Hash::Sha1, QCryptographicHash::hash(data, QCryptographicHash::Sha1));
+            cache->append(cacheIds.last(), data);
+        }
+
+        PsiIconset::instance()->loadAll();
+        for (int n = 0; n < 200; ++n)
+            longMessage += QString("line %1 with a link www.example.org/%1 and a smile :) or two ;-) ").arg(n);
+    }
+
+    void cleanupTestCase()
+    {
+        delete cache;
+        delete options;
+        delete edb;
+    }
+
+    void benchHistoryAppend()
+    {
+        EDBHandle     h(edb);
+        QSignalSpy    spy(&h, SIGNAL(writeFinished(int, bool)));
+        XMPP::Message m(jid);
+        m.setType("chat");
+        m.setBody("benchmark message");
+        m.setTimeStamp(QDateTime::currentDateTime());
+        PsiEvent::Ptr e(new MessageEvent(m, nullptr));
+        QBENCHMARK
+        {
+            h.append(accId, jid, e, EDB::Contact);
+            QVERIFY(spy.wait());
+        }
+    }
+
+    void benchHistoryGet()
+    {
+        EDBHandle  h(edb);
+        QSignalSpy spy(&h, SIGNAL(resultReady(int, EDBResult, int)));
+        QBENCHMARK
+        {
+            h.get(accId, jid, QDateTime(), EDB::Backward, 0, 50);
+            QVERIFY(spy.wait());
+        }
+    }
+
+    void benchHistoryFind()
+    {
+        EDBHandle  h(edb);
+        QSignalSpy spy(&h, SIGNAL(resultReady(int, EDBResult, int)));
+        QBENCHMARK
+        {
+            h.find(accId, "page/4242", jid, QDateTime(), EDB::Forward);
+            QVERIFY(spy.wait());
+        }
+    }
+
+    void benchLinkify()
+    {
+        QBENCHMARK { TextUtil::linkify(longMessage); }
+    }
+
+    void benchEmoticonify()
+    {
+        QBENCHMARK { TextUtil::emoticonify(longMessage); }
+    }
+
+    void benchGetOption()
+    {
+        QBENCHMARK
+        {
+            for (int n = 0; n < 1000; ++n)
+                options->getOption("options.bench.group7.option13");
+        }
+    }
+
+    void benchFileCacheGet()
+    {
+        QBENCHMARK
+        {
+            for (const XMPP::Hash &id : qAsConst(cacheIds))
+                cache->get(id);
+        }
+    }
+};
+
+QTEST_MAIN(BenchHotPaths)
+#include "benchhotpaths.moc"
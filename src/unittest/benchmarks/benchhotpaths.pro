@@ -0,0 +1,6 @@
+TARGET = benchhotpaths
+SOURCES += benchhotpaths.cpp
+
+QT += sql
+
+include(../half_of_psi.pri)
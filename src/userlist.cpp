@@ -205,8 +205,13 @@ void UserResourceList::sort() { std::sort(begin(), end()); }
 //----------------------------------------------------------------------------
 // UserListItem
 //----------------------------------------------------------------------------
+
+// bumped when something every tooltip depends on changes: options, iconsets, avatars
+static int tipGeneration = 0;
+
 UserListItem::UserListItem(bool self)
 {
+    v_revision      = 0;
     v_inList        = false;
     v_self          = self;
     v_private       = false;
@@ -220,7 +225,11 @@ UserListItem::UserListItem(bool self)
 
 bool UserListItem::inList() const { return v_inList; }
 
-void UserListItem::setMood(const Mood &mood) { v_mood = mood; }
+void UserListItem::setMood(const Mood &mood)
+{
+    v_mood = mood;
+    ++v_revision;
+}
 
 const Mood &UserListItem::mood() const { return v_mood; }
 
@@ -260,15 +269,27 @@ QString UserListItem::findClient(const UserResource &ur) const
     return res;
 }
 
-void UserListItem::setActivity(const Activity &activity) { v_activity = activity; }
+void UserListItem::setActivity(const Activity &activity)
+{
+    v_activity = activity;
+    ++v_revision;
+}
 
 const Activity &UserListItem::activity() const { return v_activity; }
 
-void UserListItem::setTune(const QString &t) { v_tune = t; }
+void UserListItem::setTune(const QString &t)
+{
+    v_tune = t;
+    ++v_revision;
+}
 
 const QString &UserListItem::tune() const { return v_tune; }
 
-void UserListItem::setGeoLocation(const GeoLocation &geoLocation) { v_geoLocation = geoLocation; }
+void UserListItem::setGeoLocation(const GeoLocation &geoLocation)
+{
+    v_geoLocation = geoLocation;
+    ++v_revision;
+}
 
 const GeoLocation &UserListItem::geoLocation() const { return v_geoLocation; }
 
@@ -282,19 +303,28 @@ const PhysicalLocation& UserListItem::physicalLocation() const
     return v_physicalLocation;
 }*/
 
-void UserListItem::setAvatarFactory(AvatarFactory *av) { v_avatarFactory = av; }
+void UserListItem::setAvatarFactory(AvatarFactory *av)
+{
+    v_avatarFactory = av;
+    ++v_revision;
+}
 
 void UserListItem::setJid(const Jid &j)
 {
     LiveRosterItem::setJid(j);
     v_isTransport = !jid().full().contains(QLatin1Char('@'));
+    ++v_revision;
 }
 
 bool UserListItem::isTransport() const { return v_isTransport; }
 
 bool UserListItem::isConference() const { return v_isConference; }
 
-void UserListItem::setConference(bool b) { v_isConference = b; }
+void UserListItem::setConference(bool b)
+{
+    v_isConference = b;
+    ++v_revision;
+}
 
 void UserListItem::setPending(int p, int h)
 {
@@ -374,20 +404,42 @@ bool UserListItem::isSelf() const { return v_self; }
 
 void UserListItem::setInList(bool b) { v_inList = b; }
 
-void UserListItem::setLastAvailable(const QDateTime &t) { v_t = t; }
+void UserListItem::setLastAvailable(const QDateTime &t)
+{
+    v_t = t;
+    ++v_revision;
+}
 
-void UserListItem::setPresenceError(const QString &e) { v_perr = e; }
+void UserListItem::setPresenceError(const QString &e)
+{
+    v_perr = e;
+    ++v_revision;
+}
 
-UserResourceList &UserListItem::userResourceList() { return v_url; }
+// the resources may be changed through the reference
+UserResourceList &UserListItem::userResourceList()
+{
+    ++v_revision;
+    return v_url;
+}
 
-UserResourceList::Iterator UserListItem::priority() { return v_url.priority(); }
+UserResourceList::Iterator UserListItem::priority()
+{
+    ++v_revision;
+    return v_url.priority();
+}
 
 const UserResourceList &UserListItem::userResourceList() const { return v_url; }
 
-void UserListItem::removeAllResources() { return v_url.clear(); }
+void UserListItem::removeAllResources()
+{
+    ++v_revision;
+    v_url.clear();
+}
 
 void UserListItem::removeResource(const QString &resource)
 {
+    ++v_revision;
     // v_url.removeAll(*rit);//we cant use it since operator== is used for other purpose
     QMutableListIterator<UserResource> i(v_url);
     while (i.hasNext()) {
@@ -404,7 +456,44 @@ QString UserListItem::makeTip(bool trim, bool doLinkify) const
     return "<qt>" + makeBareTip(trim, doLinkify) + "</qt>";
 }
 
+/**
+ * The tooltip is rebuilt only when something it shows has changed since the last call,
+ * hovering the same contact again returns the cached text.
+ */
 QString UserListItem::makeBareTip(bool trim, bool doLinkify) const
+{
+    static const bool watching = []() {
+        const char *options[] = { "options.ui.contactlist.tooltip", "options.ui.emoticons.use-emoticons",
+                                  "options.ui.chat.legacy-formatting", "options.ui.look.font", "options.iconsets" };
+        for (const char *option : options)
+            PsiOptions::watch(QLatin1String(option), qApp, [](const QString &) { invalidateTips(); });
+        return true;
+    }();
+    Q_UNUSED(watching);
+
+    // name, subscription and the last status are set through LiveRosterItem, so they are compared
+    const int     sub        = subscription().type();
+    const QString lastStatus = lastUnavailableStatus().status();
+    if (v_tip.revision != v_revision || v_tip.generation != tipGeneration || v_tip.trim != trim
+        || v_tip.doLinkify != doLinkify || v_tip.subscription != sub || v_tip.name != name()
+        || v_tip.lastStatus != lastStatus
+        || (v_tip.expires.isValid() && v_tip.expires <= QDateTime::currentDateTimeUtc())) {
+        v_tip.revision     = v_revision;
+        v_tip.generation   = tipGeneration;
+        v_tip.trim         = trim;
+        v_tip.doLinkify    = doLinkify;
+        v_tip.subscription = sub;
+        v_tip.name         = name();
+        v_tip.lastStatus   = lastStatus;
+        v_tip.expires      = QDateTime();
+        v_tip.text         = buildBareTip(trim, doLinkify, &v_tip.expires);
+    }
+    return v_tip.text;
+}
+
+void UserListItem::invalidateTips() { ++tipGeneration; }
+
+QString UserListItem::buildBareTip(bool trim, bool doLinkify, QDateTime *expires) const
 {
     // NOTE: If you add something to the tooltip,
     // you most probably want to wrap it with TextUtil::escape()
@@ -566,7 +655,10 @@ QString UserListItem::makeBareTip(bool trim, bool doLinkify) const
 
             // Entity Time
             if (r.timezoneOffset().hasValue()) {
-                QDateTime dt = QDateTime::currentDateTimeUtc().addSecs(r.timezoneOffset().value() * 60);
+                const QDateTime now = QDateTime::currentDateTimeUtc();
+                QDateTime       dt  = now.addSecs(r.timezoneOffset().value() * 60);
+                // shown to the minute
+                *expires = now.addSecs(60 - now.time().second());
                 str += QString("<div class='layer1'><%1=\"%2\"> ").arg(imgTag, "psi/time") + QObject::tr("Time")
                     + QString(": %1 (%2)").arg(QLocale().toString(dt, QLocale::ShortFormat), r.timezoneOffsetString())
                     + "</div>";
@@ -681,6 +773,7 @@ bool UserListItem::isSecure(const QString &rname) const { return secList.contain
 
 void UserListItem::setSecure(const QString &rname, bool b)
 {
+    ++v_revision;
     for (const QString &s : qAsConst(secList)) {
         if (s == rname) {
             if (!b)
@@ -694,7 +787,11 @@ void UserListItem::setSecure(const QString &rname, bool b)
 
 const QString &UserListItem::publicKeyID() const { return v_keyID; }
 
-void UserListItem::setPublicKeyID(const QString &k) { v_keyID = k; }
+void UserListItem::setPublicKeyID(const QString &k)
+{
+    v_keyID = k;
+    ++v_revision;
+}
 
 //----------------------------------------------------------------------------
 // UserList
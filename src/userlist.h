@@ -119,6 +119,7 @@ public:
     bool            isSelf() const;
     QString         makeTip(bool trim = true, bool doLinkify = true) const;
     QString         makeBareTip(bool trim, bool doLinkify) const;
+    static void     invalidateTips();
     QString         makeDesc() const;
     bool            isPrivate() const;
     const Mood &    mood() const;
@@ -160,6 +161,23 @@ public:
     void           setPublicKeyID(const QString &);
 
 private:
+    // last makeBareTip() result, valid while none of this changed
+    struct TipCache {
+        int       revision     = -1;
+        int       generation   = -1;
+        bool      trim         = false;
+        bool      doLinkify    = false;
+        int       subscription = -1;
+        QString   name;
+        QString   lastStatus;
+        QDateTime expires; // the entity time in it is out of date then
+        QString   text;
+    };
+
+    QString buildBareTip(bool trim, bool doLinkify, QDateTime *expires) const;
+
+    int              v_revision; // bumped by whatever the tooltip shows
+    mutable TipCache v_tip;
     int              lastmsgtype, v_pending, v_hPending;
     bool             v_inList;
     QDateTime        v_t;
@@ -21,31 +21,267 @@
 
 #include "applicationinfo.h"
 #include "jidutil.h"
-#include "profiles.h"
+#include "memorytrimmer.h"
 #include "psiaccount.h"
 #include "xmpp_client.h"
 #include "xmpp_tasks.h"
 #include "xmpp_vcard.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
 #include <QDir>
 #include <QDomDocument>
 #include <QFile>
+#include <QFutureWatcher>
 #include <QMap>
 #include <QObject>
-#include <QTextStream>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTimer>
+#include <QtConcurrentRun>
 
 #include <functional>
 
+// size of the runtime cache in KiB, photos make up most of it
+#define VCARD_CACHE_SIZE 4096
+
+#define VCARD_STORE_CONNECTION "vcards"
+
+// server requests running at once per account, interactive ones aren't counted against it
+#define VCARD_MAX_REQUESTS 3
+// pause after the server refused a request for lack of resources, doubled while it keeps refusing, ms
+#define VCARD_BACKOFF_MIN 5000
+#define VCARD_BACKOFF_MAX 120000
+
+//----------------------------------------------------------------------------
+// VCardStore
+//----------------------------------------------------------------------------
+
+// All vcards of the profile in one SQLite file instead of an xml file per contact.
+// Photos are kept once per SHA-1 in their own table, so the vcard rows stay small.
+// It's only used from the io thread of VCardFactory, the connection belongs to that thread.
+class VCardStore {
+public:
+    VCardStore(const QString &dir) : dir_(dir), failed_(false) { }
+
+    VCard load(const QString &bareJid);
+    bool  save(const QString &bareJid, const VCard &vcard);
+    void  close();
+
+private:
+    bool open();
+    bool write(QSqlDatabase &db, const QString &bareJid, const VCard &vcard);
+    void importFiles(QSqlDatabase &db, QStringList *imported);
+
+    QString dir_;
+    bool    failed_;
+};
+
+bool VCardStore::open()
+{
+    QSqlDatabase db = QSqlDatabase::database(VCARD_STORE_CONNECTION, false);
+    if (db.isOpen()) {
+        return true;
+    }
+    if (failed_) {
+        return false;
+    }
+
+    failed_ = true;
+    db      = QSqlDatabase::addDatabase("QSQLITE", VCARD_STORE_CONNECTION);
+    db.setDatabaseName(dir_ + "/vcards.db");
+    if (!db.open()) {
+        qWarning("%s\n%s", "VCardStore::open(): Can't open base.", qUtf8Printable(db.lastError().text()));
+        return false;
+    }
+    QSqlQuery query(db);
+    query.exec("PRAGMA journal_mode = WAL;");
+    query.exec("PRAGMA synchronous = NORMAL;");
+    if (!db.tables(QSql::Tables).contains("vcards")) {
+        // first start with the store, take over the old per contact files
+        QStringList imported;
+        if (!db.transaction()) {
+            db.close();
+            return false;
+        }
+        query.exec("CREATE TABLE `vcards` ("
+                   "`jid` TEXT NOT NULL PRIMARY KEY, "
+                   "`photo` BLOB, "
+                   "`data` TEXT"
+                   ");");
+        query.exec("CREATE TABLE `photos` ("
+                   "`hash` BLOB NOT NULL PRIMARY KEY, "
+                   "`data` BLOB"
+                   ");");
+        importFiles(db, &imported);
+        if (!db.commit()) {
+            qWarning("%s\n%s", "VCardStore::open(): Can't create tables.", qUtf8Printable(db.lastError().text()));
+            db.close();
+            return false;
+        }
+        QDir dir(dir_);
+        for (const QString &fileName : qAsConst(imported)) {
+            dir.remove(fileName);
+        }
+    }
+    failed_ = false;
+    return true;
+}
+
+void VCardStore::close()
+{
+    {
+        QSqlDatabase db = QSqlDatabase::database(VCARD_STORE_CONNECTION, false);
+        if (db.isOpen())
+            db.close();
+    }
+    QSqlDatabase::removeDatabase(VCARD_STORE_CONNECTION);
+}
+
+void VCardStore::importFiles(QSqlDatabase &db, QStringList *imported)
+{
+    QDir              dir(dir_);
+    const QStringList files = dir.entryList(QStringList() << "*.xml", QDir::Files);
+    for (const QString &fileName : files) {
+        QFile        file(dir.filePath(fileName));
+        QDomDocument doc;
+        if (file.open(QIODevice::ReadOnly) && doc.setContent(&file, false)) {
+            const VCard vcard = VCard::fromXml(doc.documentElement());
+            if (!vcard.isNull() && !write(db, JIDUtil::decode(fileName.left(fileName.length() - 4)), vcard)) {
+                continue;
+            }
+        }
+        imported->append(fileName);
+    }
+}
+
+VCard VCardStore::load(const QString &bareJid)
+{
+    if (!open()) {
+        return VCard();
+    }
+
+    QSqlQuery query(QSqlDatabase::database(VCARD_STORE_CONNECTION));
+    query.prepare("SELECT `vcards`.`data`, `photos`.`data` FROM `vcards` "
+                  "LEFT JOIN `photos` ON `photos`.`hash` = `vcards`.`photo` WHERE `vcards`.`jid` = :jid;");
+    query.bindValue(":jid", bareJid.toLower());
+    if (!query.exec() || !query.next()) {
+        return VCard();
+    }
+    QDomDocument doc;
+    if (!doc.setContent(query.value(0).toString(), false)) {
+        return VCard();
+    }
+    VCard vcard = VCard::fromXml(doc.documentElement());
+    if (!vcard.isNull() && !query.value(1).isNull()) {
+        vcard.setPhoto(query.value(1).toByteArray());
+    }
+    return vcard;
+}
+
+bool VCardStore::save(const QString &bareJid, const VCard &vcard)
+{
+    if (!open()) {
+        return false;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(VCARD_STORE_CONNECTION);
+    if (!db.transaction()) {
+        return false;
+    }
+    if (!write(db, bareJid, vcard)) {
+        db.rollback();
+        return false;
+    }
+    return db.commit();
+}
+
+bool VCardStore::write(QSqlDatabase &db, const QString &bareJid, const VCard &vcard)
+{
+    const QString jid = bareJid.toLower();
+    QSqlQuery     query(db);
+
+    QByteArray oldHash;
+    query.prepare("SELECT `photo` FROM `vcards` WHERE `jid` = :jid;");
+    query.bindValue(":jid", jid);
+    if (query.exec() && query.next()) {
+        oldHash = query.value(0).toByteArray();
+    }
+
+    QByteArray hash;
+    VCard      stripped = vcard;
+    if (!vcard.photo().isEmpty()) {
+        hash = QCryptographicHash::hash(vcard.photo(), QCryptographicHash::Sha1);
+        query.prepare("INSERT OR IGNORE INTO `photos` (`hash`, `data`) VALUES (:hash, :data);");
+        query.bindValue(":hash", hash);
+        query.bindValue(":data", vcard.photo());
+        if (!query.exec()) {
+            return false;
+        }
+        stripped.setPhoto(QByteArray());
+    }
+
+    QDomDocument doc;
+    doc.appendChild(stripped.toXml(&doc));
+    query.prepare("INSERT OR REPLACE INTO `vcards` (`jid`, `photo`, `data`) VALUES (:jid, :photo, :data);");
+    query.bindValue(":jid", jid);
+    query.bindValue(":photo", hash.isEmpty() ? QVariant(QVariant::ByteArray) : QVariant(hash));
+    query.bindValue(":data", doc.toString(-1));
+    if (!query.exec()) {
+        return false;
+    }
+
+    // drop the previous photo when nobody else has the same one
+    if (!oldHash.isEmpty() && oldHash != hash) {
+        query.prepare("DELETE FROM `photos` WHERE `hash` = :hash "
+                      "AND NOT EXISTS (SELECT 1 FROM `vcards` WHERE `photo` = :used);");
+        query.bindValue(":hash", oldHash);
+        query.bindValue(":used", oldHash);
+        query.exec();
+    }
+    return true;
+}
+
+//----------------------------------------------------------------------------
+// VCardFactory
+//----------------------------------------------------------------------------
+
 /**
  * \brief Factory for retrieving and changing VCards.
  */
-VCardFactory::VCardFactory() : QObject(qApp), dictSize_(5) { }
+VCardFactory::VCardFactory() : QObject(qApp), vcardCache_(VCARD_CACHE_SIZE), store_(nullptr)
+{
+    io_.setMaxThreadCount(1);
+    io_.setExpiryTimeout(-1); // the store's connection lives in that thread
+
+    // everything cached is in the store, unsaved_ keeps what isn't yet
+    MemoryTrimmer::instance()->add(
+        this, [this]() { return qint64(vcardCache_.totalCost()) * 1024; },
+        [this](MemoryTrimmer::Level) { vcardCache_.clear(); });
+}
 
 /**
  * \brief Destroys all cached VCards.
  */
-VCardFactory::~VCardFactory() { }
+VCardFactory::~VCardFactory()
+{
+    // let the pending writes reach the disk
+    if (store_) {
+        VCardStore *store = store_;
+        QtConcurrent::run(&io_, [store]() { store->close(); });
+    }
+    io_.waitForDone();
+    delete store_;
+}
+
+VCardStore *VCardFactory::store()
+{
+    if (!store_) {
+        store_ = new VCardStore(ApplicationInfo::vCardDir());
+    }
+    return store_;
+}
 
 /**
  * \brief Returns the VCardFactory instance.
@@ -59,20 +295,46 @@ VCardFactory *VCardFactory::instance()
 }
 
 /**
- * Adds a vcard to the cache (and removes other items if necessary)
+ * Adds a vcard to the cache (least recently used ones are dropped when it's full)
  */
-void VCardFactory::checkLimit(const QString &jid, const VCard &vcard)
+void VCardFactory::cacheVCard(const QString &jid, const VCard &vcard)
 {
-    if (vcardList_.contains(jid)) {
-        vcardList_.removeAll(jid);
-        vcardDict_.remove(jid);
-    } else if (vcardList_.size() > dictSize_) {
-        QString j = vcardList_.takeLast();
-        vcardDict_.remove(j);
+    missing_.remove(jid);
+    vcardCache_.insert(jid, new VCard(vcard), vcard.photo().size() / 1024 + 1);
+}
+
+/**
+ * Reads the vcard of \a bareJid from disk in background. vcardChanged() is emitted when it's there
+ */
+void VCardFactory::loadVCard(const QString &bareJid)
+{
+    if (missing_.contains(bareJid) || loading_.contains(bareJid)) {
+        return;
     }
 
-    vcardDict_.insert(jid, vcard);
-    vcardList_.push_front(jid);
+    loading_.insert(bareJid);
+    auto watcher = new QFutureWatcher<VCard>(this);
+    connect(watcher, &QFutureWatcher<VCard>::finished, this, [this, watcher, bareJid]() {
+        const VCard vcard = watcher->result();
+        watcher->deleteLater();
+        loading_.remove(bareJid);
+        if (vcardCache_.contains(bareJid) || unsaved_.contains(bareJid)) {
+            return; // got a fresher one meanwhile
+        }
+        if (vcard.isNull()) {
+            missing_.insert(bareJid);
+            return;
+        }
+        cacheVCard(bareJid, vcard);
+
+        Jid j(bareJid);
+        emit vcardChanged(j);
+        if (!vcard.photo().isEmpty()) {
+            emit vcardPhotoAvailable(j, false);
+        }
+    });
+    VCardStore *store = this->store();
+    watcher->setFuture(QtConcurrent::run(&io_, [store, bareJid]() { return store->load(bareJid); }));
 }
 
 void VCardFactory::taskFinished()
@@ -114,23 +376,27 @@ void VCardFactory::mucTaskFinished()
 
 void VCardFactory::saveVCard(const Jid &j, const VCard &vcard, bool notifyPhoto)
 {
-    checkLimit(j.bare(), vcard);
-
-    // save vCard to disk
+    const QString bareJid = j.bare();
+    cacheVCard(bareJid, vcard);
 
-    // ensure that there's a vcard directory to save into
-    QDir p(pathToProfile(activeProfile, ApplicationInfo::CacheLocation));
-    QDir v(pathToProfile(activeProfile, ApplicationInfo::CacheLocation) + "/vcard");
-    if (!v.exists())
-        p.mkdir("vcard");
+    // save vCard to disk in background. until it's written readers get it from unsaved_
+    auto &pending = unsaved_[bareJid];
+    pending.first = vcard;
+    ++pending.second;
 
-    QFile file(ApplicationInfo::vCardDir() + '/' + JIDUtil::encode(j.bare()).toLower() + ".xml");
-    file.open(QIODevice::WriteOnly);
-    QTextStream out(&file);
-    out.setCodec("UTF-8");
-    QDomDocument doc;
-    doc.appendChild(vcard.toXml(&doc));
-    out << doc.toString(4);
+    VCardStore *store   = this->store();
+    auto        watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, bareJid]() {
+        if (!watcher->result()) {
+            qWarning("VCardFactory: can't save vcard of %s", qUtf8Printable(bareJid));
+        }
+        watcher->deleteLater();
+        auto it = unsaved_.find(bareJid);
+        if (it != unsaved_.end() && --it->second == 0) {
+            unsaved_.erase(it);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&io_, [store, bareJid, vcard]() { return store->save(bareJid, vcard); }));
 
     Jid  jid = j;
     emit vcardChanged(jid);
@@ -155,27 +421,60 @@ const VCard VCardFactory::mucVcard(const Jid &j) const
 
 /**
  * \brief Call this, when you need a cached vCard.
+ *
+ * Reads it from disk right away if it isn't in memory yet.
+ * Use cachedVCard() where that can't wait, e.g. when painting.
  */
 VCard VCardFactory::vcard(const Jid &j)
 {
+    const QString bareJid = j.bare();
+
     // first, try to get vCard from runtime cache
-    if (vcardDict_.contains(j.bare())) {
-        return vcardDict_[j.bare()];
+    VCard *cached = vcardCache_.object(bareJid);
+    if (cached) {
+        return *cached;
+    }
+    auto it = unsaved_.constFind(bareJid);
+    if (it != unsaved_.constEnd()) {
+        cacheVCard(bareJid, it->first);
+        return it->first;
+    }
+    if (missing_.contains(bareJid)) {
+        return VCard();
     }
 
-    // then try to load from cache on disk
-    QFile file(ApplicationInfo::vCardDir() + '/' + JIDUtil::encode(j.bare()).toLower() + ".xml");
-    file.open(QIODevice::ReadOnly);
-    QDomDocument doc;
-
-    if (doc.setContent(&file, false)) {
-        VCard vcard = VCard::fromXml(doc.documentElement());
-        if (!vcard.isNull()) {
-            checkLimit(j.bare(), vcard);
-            return vcard;
-        }
+    // then try to load from cache on disk. it goes through the io thread to stay behind pending writes
+    VCardStore *store = this->store();
+    VCard       vcard = QtConcurrent::run(&io_, [store, bareJid]() { return store->load(bareJid); }).result();
+    if (vcard.isNull()) {
+        missing_.insert(bareJid);
+        return VCard();
     }
+    cacheVCard(bareJid, vcard);
+    return vcard;
+}
+
+/**
+ * \brief Returns the vCard only if it's in memory already, never touches the disk.
+ *
+ * Otherwise it's read in background and vcardChanged() is emitted once it's loaded.
+ */
+VCard VCardFactory::cachedVCard(const Jid &j)
+{
+    const QString bareJid = j.bare();
 
+    VCard *cached = vcardCache_.object(bareJid);
+    if (cached) {
+        ++stats_.hits;
+        return *cached;
+    }
+    auto it = unsaved_.constFind(bareJid);
+    if (it != unsaved_.constEnd()) {
+        ++stats_.hits;
+        return it->first;
+    }
+    ++stats_.misses;
+    loadVCard(bareJid);
     return VCard();
 }
 
@@ -224,24 +523,135 @@ void VCardFactory::updateVCardFinished()
 
 /**
  * \brief Call this when you need to retrieve fresh vCard from server (and store it in cache afterwards)
+ *
+ * Requests are queued per account and go out by \a priority, a few at a time, so a roster
+ * without avatar hashes doesn't flood the server. A non-interactive request for a jid that is
+ * already waiting or running joins that one and gets the same task back.
  */
 JT_VCard *VCardFactory::getVCard(const Jid &jid, Task *rootTask, const QObject *obj, std::function<void()> &&cb,
-                                 bool cacheVCard, bool isMuc, bool notifyPhoto)
+                                 bool cacheVCard, bool isMuc, bool notifyPhoto, Priority priority)
 {
-    JT_VCard *task = new JT_VCard(rootTask);
+    if (!requests_.contains(rootTask)) {
+        // the account went away or reconnected, its tasks are gone with the root task
+        connect(rootTask, &QObject::destroyed, this, [this, rootTask]() { requests_.remove(rootTask); });
+    }
+    RequestQueue &q   = requests_[rootTask];
+    const QString key = jid.full();
+
+    JT_VCard *task = priority == InteractivePriority ? nullptr : q.shared.value(key).data();
+    if (task) {
+        if (notifyPhoto) {
+            task->setProperty("phntf", true);
+        }
+        if (cacheVCard) {
+            cacheResult(task, isMuc);
+        }
+        task->connect(task, &JT_VCard::finished, obj, cb);
+        for (int p = BackgroundPriority; p < priority; ++p) {
+            if (q.queued[p].removeOne(task)) {
+                q.queued[priority].append(task);
+                break;
+            }
+        }
+        startRequests(rootTask);
+        return task;
+    }
+
+    task = new JT_VCard(rootTask);
     if (notifyPhoto) {
         task->setProperty("phntf", true);
     }
     if (cacheVCard) {
-        if (isMuc)
-            task->connect(task, SIGNAL(finished()), this, SLOT(mucTaskFinished()));
-        else
-            task->connect(task, SIGNAL(finished()), this, SLOT(taskFinished()));
+        cacheResult(task, isMuc);
     }
     task->connect(task, &JT_VCard::finished, obj, cb);
     task->get(Jid(jid.full()));
-    task->go(true);
+
+    connect(task, &JT_VCard::finished, this, [this, rootTask, task]() {
+        // legacy code of resource-constraint, the server wants us to slow down
+        if (!task->success() && task->statusCode() == 500) {
+            throttle(rootTask);
+        } else if (requests_.contains(rootTask)) {
+            requests_[rootTask].backoff = 0;
+        }
+    });
+    // finished tasks delete themselves, those deleted before (a closed dialog) end up here as well
+    connect(task, &QObject::destroyed, this,
+            [this, rootTask, key](QObject *obj) { requestDone(rootTask, key, obj); });
+    if (priority != InteractivePriority) {
+        q.shared.insert(key, task);
+    }
+    q.queued[priority].append(task);
+    startRequests(rootTask);
     return task;
 }
 
+void VCardFactory::cacheResult(JT_VCard *task, bool isMuc)
+{
+    if (task->property("cache").toBool()) {
+        return;
+    }
+    task->setProperty("cache", true);
+    if (isMuc)
+        task->connect(task, SIGNAL(finished()), this, SLOT(mucTaskFinished()));
+    else
+        task->connect(task, SIGNAL(finished()), this, SLOT(taskFinished()));
+}
+
+void VCardFactory::startRequests(Task *rootTask)
+{
+    auto it = requests_.find(rootTask);
+    if (it == requests_.end()) {
+        return;
+    }
+    RequestQueue &q = *it;
+    for (int p = InteractivePriority; p >= BackgroundPriority; --p) {
+        const bool limited = p != InteractivePriority;
+        if (limited && q.paused) {
+            return;
+        }
+        QList<QPointer<JT_VCard>> &queue = q.queued[p];
+        while (!queue.isEmpty() && (!limited || q.running.size() < VCARD_MAX_REQUESTS)) {
+            JT_VCard *task = queue.takeFirst();
+            if (!task) {
+                continue; // deleted while waiting
+            }
+            q.running.insert(task);
+            task->go(true);
+        }
+    }
+}
+
+void VCardFactory::requestDone(Task *rootTask, const QString &key, QObject *task)
+{
+    auto it = requests_.find(rootTask);
+    if (it == requests_.end()) {
+        return;
+    }
+    auto sit = it->shared.find(key);
+    if (sit != it->shared.end() && sit->isNull()) {
+        it->shared.erase(sit);
+    }
+    if (it->running.remove(task)) {
+        startRequests(rootTask);
+    }
+}
+
+void VCardFactory::throttle(Task *rootTask)
+{
+    auto it = requests_.find(rootTask);
+    if (it == requests_.end() || it->paused) {
+        return;
+    }
+    it->backoff = it->backoff ? qMin(it->backoff * 2, VCARD_BACKOFF_MAX) : VCARD_BACKOFF_MIN;
+    it->paused  = true;
+    QTimer::singleShot(it->backoff, this, [this, rootTask]() {
+        auto it = requests_.find(rootTask);
+        if (it != requests_.end()) {
+            it->paused = false;
+            startRequests(rootTask);
+        }
+    });
+}
+
 VCardFactory *VCardFactory::instance_ = nullptr;
@@ -20,13 +20,18 @@
 #ifndef VCARDFACTORY_H
 #define VCARDFACTORY_H
 
+#include <QCache>
 #include <QHash>
 #include <QMap>
 #include <QObject>
+#include <QPointer>
+#include <QSet>
 #include <QStringList>
+#include <QThreadPool>
 #include <functional>
 
 class PsiAccount;
+class VCardStore;
 
 namespace XMPP {
 class JT_VCard;
@@ -40,14 +45,27 @@ class VCardFactory : public QObject {
     Q_OBJECT
 
 public:
+    // order in which queued server requests go out
+    enum Priority {
+        BackgroundPriority, // nobody waits for it, e.g. a contact name to resolve
+        NormalPriority,     // shown somewhere, e.g. the avatar of a roster row
+        InteractivePriority // the user waits for it, e.g. an open InfoDlg. never shared or held back
+    };
+
+    struct Stats {
+        quint64 hits   = 0; // cachedVCard() answered from memory
+        quint64 misses = 0; // cachedVCard() had to go to disk
+    };
+
     static VCardFactory *instance();
     VCard                vcard(const Jid &);
+    VCard                cachedVCard(const Jid &);
     const VCard          mucVcard(const Jid &j) const;
     void                 setVCard(const Jid &, const VCard &, bool notifyPhoto = true);
     void setVCard(const PsiAccount *account, const VCard &v, QObject *obj = nullptr, const char *slot = nullptr);
     void setTargetVCard(const PsiAccount *account, const VCard &v, const Jid &mucJid, QObject *obj, const char *slot);
     JT_VCard *getVCard(const Jid &, Task *rootTask, const QObject *, std::function<void()> &&cb, bool cacheVCard = true,
-                       bool isMuc = false, bool notifyPhoto = true);
+                       bool isMuc = false, bool notifyPhoto = true, Priority priority = NormalPriority);
 
 signals:
     void vcardChanged(const Jid &);
@@ -55,8 +73,10 @@ signals:
         const Jid &,
         bool isMuc); // dedicated for AvatarFactory. it will almost always work except requests from AvatarFactory
 
+    const Stats &stats() const { return stats_; }
+
 protected:
-    void checkLimit(const QString &jid, const VCard &vcard);
+    void cacheVCard(const QString &jid, const VCard &vcard);
 
 private slots:
     void updateVCardFinished();
@@ -64,18 +84,38 @@ private slots:
     void mucTaskFinished();
 
 private:
+    // vcard requests of one account
+    struct RequestQueue {
+        QList<QPointer<JT_VCard>>          queued[InteractivePriority + 1];
+        QHash<QString, QPointer<JT_VCard>> shared;      // full jid => waiting or running request others can join
+        QSet<QObject *>                    running;     // started and not finished yet
+        int                                backoff = 0; // ms, grows while the server refuses requests
+        bool                               paused  = false;
+    };
+
     VCardFactory();
     ~VCardFactory();
 
     static VCardFactory *                instance_;
-    const int                            dictSize_;
-    QStringList                          vcardList_;
-    QMap<QString, VCard>                 vcardDict_;
+    Stats                                stats_;
+    QCache<QString, VCard>               vcardCache_; // bare jid => vcard, cost in KiB
+    QSet<QString>                        missing_;    // bare jids known to have no vcard on disk
+    QSet<QString>                        loading_;    // bare jids being read in background
+    QHash<QString, QPair<VCard, int>>    unsaved_;    // bare jid => {latest vcard, pending writes}
+    QThreadPool                          io_;         // one thread, so disk reads and writes keep their order
+    VCardStore *                         store_;      // used from io_ only
     QMap<QString, QHash<QString, VCard>> mucVcardDict_; // QHash in case of big mucs mucBareJid => {resoure => vcard}
     QMap<QString, QQueue<QString>>
         lastMucVcards_; // to limit the hash above. this one keeps ordered resource. mucBareJid => resource_list
+    QHash<Task *, RequestQueue> requests_; // root task of the account => its requests
 
-    void saveVCard(const Jid &, const VCard &, bool notifyPhoto);
+    void        saveVCard(const Jid &, const VCard &, bool notifyPhoto);
+    void        cacheResult(JT_VCard *task, bool isMuc);
+    void        startRequests(Task *rootTask);
+    void        requestDone(Task *rootTask, const QString &key, QObject *task);
+    void        throttle(Task *rootTask);
+    void        loadVCard(const QString &bareJid);
+    VCardStore *store();
 };
 
 #endif // VCARDFACTORY_H
@@ -2,22 +2,17 @@
 
 #include <QFile>
 #include <QTcpServer>
+#include <QVarLengthArray>
 
-WebServer::WebServer(QObject *parent) : qhttp::server::QHttpServer(parent)
+WebServer::WebServer(QObject *parent) : qhttp::server::QHttpServer(parent) { }
+
+void WebServer::startListening()
 {
     using namespace qhttp::server;
     listen( // listening on 0.0.0.0:8080
         QHostAddress::LocalHost, 0, [this](QHttpRequest *req, QHttpResponse *res) {
-            // very global stuff first
-            QString path = req->url().path();
-            // qDebug() << "LOADING: " << path << serverPort();
-
-            for (auto &h : pathHandlers) {
-                if (path.startsWith(h.first)) {
-                    if (h.second(req, res)) {
-                        return;
-                    }
-                }
+            if (dispatch(req, res)) {
+                return;
             }
 
             if (!defaultHandler || !defaultHandler(req, res)) {
@@ -25,30 +20,74 @@ WebServer::WebServer(QObject *parent) : qhttp::server::QHttpServer(parent)
                 res->end();
             }
         });
+    address = tcpServer()->serverAddress();
+    port    = tcpServer()->serverPort();
 }
 
-quint16 WebServer::serverPort() const { return tcpServer()->serverPort(); }
+quint16 WebServer::serverPort() const { return port; }
 
-QHostAddress WebServer::serverAddress() const { return tcpServer()->serverAddress(); }
+QHostAddress WebServer::serverAddress() const { return address; }
 
 QUrl WebServer::serverUrl()
 {
     QUrl u;
     u.setScheme(QLatin1String("http"));
-    u.setHost(tcpServer()->serverAddress().toString());
-    u.setPort(tcpServer()->serverPort());
+    u.setHost(address.toString());
+    u.setPort(port);
     return u;
 }
 
+// the longest matching route is asked first, then the shorter ones
+bool WebServer::dispatch(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res)
+{
+    const QString path = req->url().path();
+    // qDebug() << "LOADING: " << path << serverPort();
+
+    QVarLengthArray<int, 8> matched;
+    int                     node = 0;
+    if (!routes[0].handlers.isEmpty())
+        matched.append(0);
+    for (const QChar c : path) {
+        node = routes[node].children.value(c, -1);
+        if (node == -1)
+            break;
+        if (!routes[node].handlers.isEmpty())
+            matched.append(node);
+    }
+
+    for (int i = matched.size() - 1; i >= 0; --i) {
+        const auto handlers = routes[matched[i]].handlers; // a handler may change routes
+        for (const auto &h : handlers) {
+            if (h(req, res)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void WebServer::route(const char *path, const WebServer::Handler &handler)
 {
-    pathHandlers.append(QPair<QString, Handler>(QLatin1String(path), handler));
+    int node = 0;
+    for (const QChar c : QString(QLatin1String(path))) {
+        int next = routes[node].children.value(c, -1);
+        if (next == -1) {
+            next = routes.size();
+            routes.append(RouteNode());
+            routes[node].children.insert(c, next);
+        }
+        node = next;
+    }
+    routes[node].handlers.append(handler);
 }
 
 void WebServer::unroute(const char *path)
 {
-    QString pstr = QLatin1String(path);
-    auto    it
-        = std::remove_if(pathHandlers.begin(), pathHandlers.end(), [pstr](const auto &v) { return v.first == pstr; });
-    pathHandlers.erase(it, pathHandlers.end());
+    int node = 0;
+    for (const QChar c : QString(QLatin1String(path))) {
+        node = routes[node].children.value(c, -1);
+        if (node == -1)
+            return;
+    }
+    routes[node].handlers.clear(); // the nodes are left for the next route()
 }
@@ -5,7 +5,10 @@
 #include "qhttpserverrequest.hpp"
 #include "qhttpserverresponse.hpp"
 
+#include <QHash>
+#include <QHostAddress>
 #include <QObject>
+#include <QVector>
 #include <functional>
 
 class WebServer : public qhttp::server::QHttpServer {
@@ -24,9 +27,23 @@ public:
 
     inline void setDefaultHandler(const Handler &h) { defaultHandler = h; }
 
+public slots:
+    // handlers are called in the thread the server listens in. routes have to be set up before that
+    void startListening();
+
 private:
-    QList<QPair<QString, Handler>> pathHandlers;
-    Handler                        defaultHandler;
+    // routes are kept in a character trie. node 0 is the root
+    struct RouteNode {
+        QHash<QChar, int> children;
+        QList<Handler>    handlers;
+    };
+
+    bool dispatch(qhttp::server::QHttpRequest *req, qhttp::server::QHttpResponse *res);
+
+    QVector<RouteNode> routes = QVector<RouteNode>(1);
+    Handler            defaultHandler;
+    QHostAddress       address; // kept here so the url can be asked from any thread
+    quint16            port = 0;
 };
 
 #endif // WEBSERVER_H
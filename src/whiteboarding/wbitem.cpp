@@ -81,8 +81,8 @@ WbItem::WbItem(SxeSession *session, QSvgRenderer *renderer, QDomElement node, Wb
     // Enable drag-n-drop
     setAcceptDrops(true);
 
-    // Don't cache the SVG
-    setCachingEnabled(false);
+    // Cache the rendering, WbWidget only invalidates items whose node changed
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
 
     // Set the renderer for the item
     setSharedRenderer(renderer);
@@ -291,20 +291,21 @@ void WbItem::removeFromScene()
     setElementId(QString());
 }
 
-void WbItem::resetPos()
+void WbItem::resetPos(int z)
 {
     // set the x & y approriately;
     setPos(renderer()->boundsOnElement(id()).topLeft());
 
     // set the drawing order
-    // TODO: optimize
-    int          i        = 0;
-    QDomNodeList children = node_.parentNode().childNodes();
-    while (children.at(i) != node_) {
-        i++;
+    if (z < 0) {
+        z                     = 0;
+        QDomNodeList children = node_.parentNode().childNodes();
+        while (children.at(z) != node_) {
+            z++;
+        }
     }
 
-    setZValue(i);
+    setZValue(z);
 }
 
 WbItemMenu *WbItem::constructContextMenu()
@@ -84,8 +84,10 @@ public:
     /*! \brief Removes the item from the scene. */
     void removeFromScene();
 
-    /*! \brief Resets the position of the item according to the SVG and clears any QGraphicsItem transformations.*/
-    void resetPos();
+    /*! \brief Resets the position of the item according to the SVG and clears any QGraphicsItem transformations.
+     *  \a z is the item's index among its siblings if the caller knows it, otherwise it is looked up.
+     */
+    void resetPos(int z = -1);
 
     /*! \brief Returns a QTransform based on \a string provided in the SVG 'transform' attribute format.*/
     static QMatrix parseSvgTransform(QString string);
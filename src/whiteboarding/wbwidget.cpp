@@ -38,6 +38,11 @@ WbWidget::WbWidget(SxeSession *session, QWidget *parent) : QGraphicsView(parent)
     fillColor_   = Qt::transparent;
     strokeWidth_ = 1;
     session_     = session;
+    layoutDirty_ = true;
+
+    rerenderTimer_ = new QTimer(this);
+    rerenderTimer_->setSingleShot(true);
+    connect(rerenderTimer_, SIGNAL(timeout()), SLOT(rerender()));
 
     //    setCacheMode(CacheBackground);
     setRenderHint(QPainter::Antialiasing);
@@ -51,7 +56,8 @@ WbWidget::WbWidget(SxeSession *session, QWidget *parent) : QGraphicsView(parent)
 
     // create the scene
     scene_ = new WbScene(session_, this);
-    scene_->setItemIndexMethod(QGraphicsScene::NoIndex);
+    // boards can have thousands of items, the index keeps painting and hit tests to the exposed ones
+    scene_->setItemIndexMethod(QGraphicsScene::BspTreeIndex);
     setRenderHint(QPainter::Antialiasing);
     setTransformationAnchor(AnchorUnderMouse);
     setResizeAnchor(AnchorViewCenter);
@@ -83,6 +89,11 @@ WbWidget::WbWidget(SxeSession *session, QWidget *parent) : QGraphicsView(parent)
     connect(session_, SIGNAL(nodeAdded(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
     connect(session_, SIGNAL(nodeMoved(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
     connect(session_, SIGNAL(chdataChanged(QDomNode, bool)), SLOT(checkForViewBoxChange(QDomNode)));
+    // find out which items need to be rerendered
+    connect(session_, SIGNAL(nodeAdded(QDomNode, bool)), SLOT(invalidateNode(QDomNode)));
+    connect(session_, SIGNAL(nodeMoved(QDomNode, bool)), SLOT(invalidateNode(QDomNode)));
+    connect(session_, SIGNAL(nodeToBeRemoved(QDomNode, bool)), SLOT(invalidateNode(QDomNode)));
+    connect(session_, SIGNAL(chdataChanged(QDomNode, bool)), SLOT(invalidateNode(QDomNode)));
 
     // set the default mode to select
     setMode(Mode::Select);
@@ -343,7 +354,7 @@ void WbWidget::handleDocumentUpdated(bool remote)
 {
     Q_UNUSED(remote);
     inspectNodes();
-    rerender();
+    rerenderTimer_->start(0);
 }
 
 void WbWidget::inspectNodes()
@@ -387,6 +398,7 @@ void WbWidget::removeWbItem(WbItem *wbitem)
         // items_.takeAt(items_.indexOf(wbitem));
 
         idlessItems_.removeAll(wbitem);
+        dirtyItems_.remove(wbitem);
 
         delete wbitem;
     }
@@ -434,8 +446,32 @@ void WbWidget::checkForRemovalOfId(QDomNode node)
     }
 }
 
+void WbWidget::invalidateNode(const QDomNode &node)
+{
+    const QDomElement root = session_->document().documentElement();
+
+    // items themselves being added, moved or removed change the drawing order of the others
+    QDomNode n = node.isAttr() ? QDomNode(node.toAttr().ownerElement()) : node;
+    if (n == node && n.parentNode() == root) {
+        layoutDirty_ = true;
+        return;
+    }
+
+    while (!n.isNull() && n.parentNode() != root)
+        n = n.parentNode();
+
+    // anything in <defs/> may be referenced by any item
+    WbItem *item = n.isNull() || n.nodeName() == "defs" ? nullptr : wbItem(n);
+    if (item)
+        dirtyItems_ += item;
+    else
+        layoutDirty_ = true;
+}
+
 void WbWidget::rerender()
 {
+    rerenderTimer_->stop();
+
     QString     xmldump;
     QTextStream stream(&xmldump);
     session_->document().save(stream, 1);
@@ -443,15 +479,36 @@ void WbWidget::rerender()
     // qDebug("Document in WbWidget:");
     // qDebug() << xmldump.toLatin1();
 
+    // the renderer would repaint every item, unchanged ones keep their cached rendering instead
+    renderer_.blockSignals(true);
     renderer_.load(xmldump.toLatin1());
+    renderer_.blockSignals(false);
+
+    if (layoutDirty_) {
+        // the drawing order of all items in one pass over the root's children
+        QHash<QString, int> zValues;
+        const QDomNodeList  children = session_->document().documentElement().childNodes();
+        for (int i = 0; i < children.size(); i++) {
+            if (children.at(i).isElement())
+                zValues.insert(children.at(i).toElement().attribute("id"), i);
+        }
 
-    // Update all positions if changed
-    for (WbItem *wbitem : qAsConst(items_)) {
-        // resetting elementId is necessary for rendering some updates to the element (e.g. adding child elements to
-        // <g/>)
-        wbitem->setElementId(wbitem->id());
+        // Update all positions if changed
+        for (WbItem *wbitem : qAsConst(items_)) {
+            // resetting elementId is necessary for rendering some updates to the element (e.g. adding child elements
+            // to <g/>)
+            wbitem->setElementId(wbitem->id());
 
-        // qDebug() << QString("Rerendering %1").arg((unsigned int) wbitem).toLatin1();
-        wbitem->resetPos();
+            // qDebug() << QString("Rerendering %1").arg((unsigned int) wbitem).toLatin1();
+            wbitem->resetPos(wbitem->id().isEmpty() ? -1 : zValues.value(wbitem->id(), -1));
+        }
+    } else {
+        for (WbItem *wbitem : qAsConst(dirtyItems_)) {
+            wbitem->setElementId(wbitem->id());
+            wbitem->resetPos(int(wbitem->zValue()));
+        }
     }
+
+    layoutDirty_ = false;
+    dirtyItems_.clear();
 }
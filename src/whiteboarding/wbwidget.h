@@ -28,6 +28,7 @@
 
 #include <QFileDialog>
 #include <QGraphicsView>
+#include <QSet>
 #include <QSvgRenderer>
 #include <QTime>
 #include <QTimer>
@@ -135,6 +136,12 @@ private:
     QTimer *adding_;
     /*! \brief The primary renderer used for rendering the document.*/
     QSvgRenderer renderer_;
+    /*! \brief Coalesces the documentUpdated() signals of a burst of edits into one rerender().*/
+    QTimer *rerenderTimer_;
+    /*! \brief Items whose nodes changed since the last rerender().*/
+    QSet<WbItem *> dirtyItems_;
+    /*! \brief True if items were added, moved or removed since the last rerender(), all items are then updated.*/
+    bool layoutDirty_;
 
 private slots:
     /*! \brief Tries to add 'id' attributes to nodes in deletionQueue_ if they still don't have them.*/
@@ -165,7 +172,11 @@ private slots:
     // /*! \brief Deletes the WbItem's in the deletion queue. */
     // void flushDeletionQueue();
 
-    /*! \brief Rerenders the contents of the document.*/
+    /*! \brief Marks the item containing \a node for the next rerender().*/
+    void invalidateNode(const QDomNode &node);
+    /*! \brief Rerenders the contents of the document.
+     *  Only items whose nodes changed are repositioned and repainted, unless the layout changed.
+     */
     void rerender();
 };
 
@@ -20,6 +20,8 @@
 #include "emojiregistry.h"
 #include "emojidb.cpp"
 
+#include <cstring>
+
 const EmojiRegistry &EmojiRegistry::instance()
 {
     static EmojiRegistry i;
@@ -35,16 +37,29 @@ bool EmojiRegistry::isEmoji(const QString &code) const
 
 EmojiRegistry::Category EmojiRegistry::startCategory(QStringRef in) const
 {
-    if (in.isEmpty())
+    return startCategory(in.unicode(), in.length());
+}
+
+bool EmojiRegistry::inRanges(quint32 ucs) const
+{
+    if (ucs >= blockIndex_.size() * 256)
+        return false;
+    const auto &block = blocks_[blockIndex_[ucs >> 8]];
+    return (block[(ucs >> 6) & 3] >> (ucs & 63)) & 1;
+}
+
+EmojiRegistry::Category EmojiRegistry::startCategory(const QChar *in, int length) const
+{
+    if (!length)
         return Category::None;
     std::uint32_t ucs;
     if (in[0].isHighSurrogate()) {
-        if (in.length() == 1)
+        if (length == 1)
             return Category::None;
         ucs = QChar::surrogateToUcs4(in[0], in[1]);
     } else {
         ucs = in[0].unicode();
-        if (ucs < 256 && (in.length() == 1 || in[1].unicode() != 0xfe0f)) {
+        if (ucs < 256 && (length == 1 || in[1].unicode() != 0xfe0f)) {
             return Category::None; // allow only full-qualified emojis from low range
         }
     }
@@ -52,19 +67,12 @@ EmojiRegistry::Category EmojiRegistry::startCategory(QStringRef in) const
         return Category::ZWJ;
     if (ucs == 0xfe0f)
         return Category::FullQualify;
-    if (ucs <= 0x39 && in.length() > 2 && (ucs >= 0x30 || ucs == 0x2a || ucs == 0x23) && in[1].unicode() == 0xfe0f
+    if (ucs <= 0x39 && length > 2 && (ucs >= 0x30 || ucs == 0x2a || ucs == 0x23) && in[1].unicode() == 0xfe0f
         && in[2].unicode() == 0x20e3)
         // number, * or #. excludes 10 keycap
         return Category::SimpleKeycap;
 
-    bool found = false;
-    auto lb    = ranges_.lower_bound(ucs);
-    if (lb == ranges_.end() || lb->first != ucs) {
-        --lb;
-        found = (ucs > lb->first && ucs <= lb->second); // if this is a final range
-    } else
-        found = lb->first == ucs;
-    if (found) {
+    if (inRanges(ucs)) {
         if (ucs >= 0x1f3fb && ucs <= 0x1f3ff)
             return Category::SkinTone;
         return Category::Emoji; // there more cases to review. like emoji tags/flags etc
@@ -83,15 +91,41 @@ int EmojiRegistry::count() const
     return count;
 }
 
+// first position from \a from which may start an emoji. chars below 256 may only
+// start one when followed by a variation selector, so runs of them are skipped
+// four at a time
+static int skipLatin(const QChar *s, int from, int size)
+{
+    int idx = from;
+    while (idx + 4 <= size) {
+        quint64 word;
+        std::memcpy(&word, s + idx, sizeof(word));
+        if (word & Q_UINT64_C(0xff00ff00ff00ff00))
+            break;
+        idx += 4;
+    }
+    while (idx < size && s[idx].unicode() < 256)
+        ++idx;
+    // the last latin char may be followed by fe0f
+    return idx > from && idx < size && s[idx].unicode() == 0xfe0f ? idx - 1 : idx;
+}
+
 QStringRef EmojiRegistry::findEmoji(const QString &in, int idx) const
 {
-    int emojiStart = -1;
+    const QChar *s          = in.unicode();
+    const int    size       = in.size();
+    int          emojiStart = -1;
 
     bool gotEmoji = false;
     bool gotSkin  = false;
     bool gotFQ    = false;
-    for (; idx < in.size(); idx++) {
-        auto category = startCategory(QStringRef(&in, idx, in.size() - idx));
+    for (; idx < size; idx++) {
+        if (emojiStart == -1) {
+            idx = skipLatin(s, idx, size);
+            if (idx == size)
+                break;
+        }
+        auto category = startCategory(s + idx, size - idx);
         if (gotEmoji && category != Category::None) {
             if (category == Category::ZWJ) { // zero-width joiner
                 gotEmoji = false;
@@ -131,7 +165,21 @@ QStringRef EmojiRegistry::findEmoji(const QString &in, int idx) const
     return emojiStart == -1 ? QStringRef() : QStringRef(&in, emojiStart, idx - emojiStart);
 }
 
-EmojiRegistry::EmojiRegistry() : groups(std::move(db)), ranges_(std::move(ranges)) { }
+EmojiRegistry::EmojiRegistry() : groups(std::move(db))
+{
+    blockIndex_.fill(0);
+    blocks_.push_back({});
+    for (auto const &r : ranges) {
+        for (quint32 ucs = r.first; ucs <= r.second && ucs < blockIndex_.size() * 256; ++ucs) {
+            auto &index = blockIndex_[ucs >> 8];
+            if (!index) {
+                index = quint16(blocks_.size());
+                blocks_.push_back({});
+            }
+            blocks_[index][(ucs >> 6) & 3] |= quint64(1) << (ucs & 63);
+        }
+    }
+}
 
 EmojiRegistry::iterator &EmojiRegistry::iterator::operator++()
 {
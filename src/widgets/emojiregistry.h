@@ -22,6 +22,7 @@
 
 #include <QString>
 
+#include <array>
 #include <map>
 #include <vector>
 
@@ -87,7 +88,13 @@ private:
     EmojiRegistry(const EmojiRegistry &) = delete;
     EmojiRegistry &operator=(const EmojiRegistry &) = delete;
 
-    const std::map<quint32, quint32> ranges_; // start to end range mapping
+    Category startCategory(const QChar *in, int length) const;
+    bool     inRanges(quint32 ucs) const;
+
+    // emoji start code points as a two-level bitmap over planes 0-1:
+    // 256 code points block -> index in blocks_, block 0 is empty
+    std::array<quint16, 0x20000 / 256>   blockIndex_;
+    std::vector<std::array<quint64, 4>> blocks_;
 };
 
 #endif // EMOJIREGISTRY_H
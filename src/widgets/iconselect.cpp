@@ -23,194 +23,71 @@
 #include "iconset.h"
 #include "psitooltip.h"
 
-#include <QAbstractButton>
 #include <QApplication>
 #include <QDesktopWidget>
 #include <QEvent>
-#include <QLabel>
-#include <QLayout>
+#include <QHelpEvent>
+#include <QKeyEvent>
+#include <QLineEdit>
 #include <QMouseEvent>
 #include <QPainter>
+#include <QPixmapCache>
 #include <QScrollArea>
 #include <QScrollBar>
 #include <QStyle>
 #include <QStyleOption>
 #include <QTextCodec>
+#include <QToolTip>
 #include <QWidgetAction>
 
 #include <cmath>
 
+// space between the cells
+#define ICONSELECT_SPACING 1
+// around the image inside a cell
+#define ICONSELECT_MARGIN 2
+
 //----------------------------------------------------------------------------
-// IconSelectButton
+// IconSelect -- the widget that does all dirty work
 //----------------------------------------------------------------------------
 
 //! \if _hide_doc_
 /**
-    \class IconSelectButton
-    \brief This button is used by IconSelect and displays one PsiIcon
-*/
-class IconSelectButton : public QAbstractButton {
-    Q_OBJECT
-
-private:
-    PsiIcon *ic;
-    QSize    s;
-    QSize    maxIconSize;
-    bool     animated;
-
-public:
-    IconSelectButton(QWidget *parent) : QAbstractButton(parent)
-    {
-        ic       = nullptr;
-        animated = false;
-        connect(this, SIGNAL(clicked()), SLOT(iconClicked()));
-    }
-
-    ~IconSelectButton()
-    {
-        iconStop();
-
-        if (ic) {
-            delete ic;
-            ic = nullptr;
-        }
-    }
-
-    void setIcon(const PsiIcon *i, const QSize &maxSize = QSize())
-    {
-        iconStop();
-
-        if (ic) {
-            delete ic;
-            ic = nullptr;
-        }
-
-        maxIconSize = maxSize;
-        if (i)
-            ic = new PsiIcon(*(const_cast<PsiIcon *>(i)));
-        else
-            ic = nullptr;
-    }
-
-    const PsiIcon *icon() const { return ic; }
-
-    QSize sizeHint() const { return s; }
-    void  setSizeHint(QSize sh) { s = sh; }
-
-signals:
-    void iconSelected(const PsiIcon *);
-    void textSelected(QString);
-
-private:
-    void iconStart()
-    {
-        if (ic) {
-            connect(ic, SIGNAL(pixmapChanged()), SLOT(iconUpdated()));
-            if (!animated) {
-                ic->activated(false);
-                animated = true;
-            }
-
-            if (!ic->text().isEmpty()) {
-                // and list of possible variants in the ToolTip
-                QStringList toolTip;
-                for (const PsiIcon::IconText &t : ic->text()) {
-                    toolTip += t.text;
-                }
-
-                QString toolTipText = toolTip.join(", ");
-                if (toolTipText.length() > 30)
-                    toolTipText = toolTipText.left(30) + "...";
-
-                setToolTip(toolTipText);
-            }
-        }
-    }
-
-    void iconStop()
-    {
-        if (ic) {
-            disconnect(ic, nullptr, this, nullptr);
-            if (animated) {
-                ic->stop();
-                animated = false;
-            }
-        }
-    }
-
-    void enterEvent(QEvent *)
-    {
-        iconStart();
-        setFocus();
-        update();
-    } // focus follows mouse mode
-    void leaveEvent(QEvent *)
-    {
-        iconStop();
-        clearFocus();
-        update();
-    }
-
-private slots:
-    void iconUpdated() { update(); }
-
-    void iconClicked()
-    {
-        clearFocus();
-        if (ic) {
-            emit iconSelected(ic);
-            emit textSelected(ic->defaultText());
-        } else {
-            emit textSelected(text());
-        }
-    }
-
-private:
-    // reimplemented
-    void paintEvent(QPaintEvent *)
-    {
-        QPainter                  p(this);
-        QFlags<QStyle::StateFlag> flags = QStyle::State_Active | QStyle::State_Enabled;
-
-        if (hasFocus())
-            flags |= QStyle::State_Selected;
-
-        QStyleOptionMenuItem opt;
-        opt.palette = palette();
-        opt.state   = flags;
-        opt.font    = font();
-        opt.rect    = rect();
-        style()->drawControl(QStyle::CE_MenuItem, &opt, &p, this);
-
-        if (ic) {
-            QPixmap pix = ic->pixmap(maxIconSize);
-            if (pix.width() > maxIconSize.width() || pix.height() > maxIconSize.height()) {
-                pix = pix.scaled(maxIconSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-            }
-            p.drawPixmap((width() - pix.width()) / 2, (height() - pix.height()) / 2, pix);
-        } else {
-            p.drawText(opt.rect, Qt::AlignVCenter | Qt::AlignCenter, text());
-        }
-    }
-};
-//! \endif
-
-//----------------------------------------------------------------------------
-// IconSelect -- the widget that does all dirty work
-//----------------------------------------------------------------------------
+    \class IconSelect
+    \brief Paints the icons of an Iconset (or font emojis) as a grid of cells
 
+    There are no widgets per icon, only the cells inside the visible area
+    are painted. Cells are filtered by setFilter().
+*/
 class IconSelect : public QWidget {
     Q_OBJECT
 
 private:
+    struct Cell {
+        const PsiIcon *icon = nullptr; // points into `is`, nullptr for font emojis
+        QString        text;           // font emoji
+        QString        toolTip;
+        QString        searchText; // lower case
+        QPixmap        pix;        // painted image, prepared on first paint
+    };
+
     IconSelectPopup *menu;
     Iconset          is;
-    QGridLayout *    grid;
-    bool             shown;
-    bool             emojiSorting;
+    bool             emojiSorting = false;
+    QVector<Cell>    cells;
+    QVector<int>     visible; // indexes of cells passing the filter
+    QString          filter;
+    QFont            emojiFont;
+    QSize            tileSize;
+    QSize            maxIconSize;
+    int              columns   = 1;
+    int              hover     = -1;      // in `visible`
+    PsiIcon *        hoverIcon = nullptr; // animated copy of the hovered icon
 
 signals:
     void updatedGeometry();
+    void iconSelected(const PsiIcon *);
+    void textSelected(QString);
 
 public:
     IconSelect(IconSelectPopup *parentMenu);
@@ -220,38 +97,44 @@ public:
     const Iconset &iconset() const;
 
     void setEmojiSortingEnabled(bool enabled);
+    void setFilter(const QString &text);
+    void activate(int index);
 
 protected:
     QList<PsiIcon *> sortEmojis() const;
-    void             noIcons();
-    void             createLayout();
-
-    void paintEvent(QPaintEvent *)
-    {
-        QPainter p(this);
-
-        QStyleOptionMenuItem opt;
-        opt.palette = palette();
-        opt.rect    = rect();
-        style()->drawControl(QStyle::CE_MenuEmptyArea, &opt, &p, this);
-    }
+    void             relayout();
+    QRect            cellRect(int index) const;
+    int              cellAt(const QPoint &pos) const;
+    void             setHover(int index);
+    QPixmap          emojiPixmap(const QString &code) const;
+    const QPixmap &  cellPixmap(Cell &cell) const;
+
+    bool event(QEvent *e);
+    void paintEvent(QPaintEvent *e);
+    void mouseMoveEvent(QMouseEvent *e);
+    void mouseReleaseEvent(QMouseEvent *e);
+    void keyPressEvent(QKeyEvent *e);
+    void leaveEvent(QEvent *);
+    void hideEvent(QHideEvent *);
 
 protected slots:
     void closeMenu();
+    void hoverIconUpdated();
 };
 
 IconSelect::IconSelect(IconSelectPopup *parentMenu) : QWidget(parentMenu)
 {
     menu = parentMenu;
+    connect(this, &IconSelect::iconSelected, menu, &IconSelectPopup::iconSelected);
+    connect(this, &IconSelect::textSelected, menu, &IconSelectPopup::textSelected);
     connect(menu, SIGNAL(textSelected(QString)), SLOT(closeMenu()));
 
-    grid = nullptr;
-    noIcons();
-
-    Q_UNUSED(shown)
+    setMouseTracking(true);
+    setFocusPolicy(Qt::StrongFocus);
+    relayout();
 }
 
-IconSelect::~IconSelect() { }
+IconSelect::~IconSelect() { setHover(-1); }
 
 void IconSelect::closeMenu()
 {
@@ -264,35 +147,12 @@ void IconSelect::closeMenu()
     menu->close();
 }
 
-void IconSelect::createLayout()
-{
-    Q_ASSERT(!grid);
-    grid = new QGridLayout(this);
-    grid->setMargin(style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this));
-    grid->setSpacing(1);
-}
-
-void IconSelect::noIcons()
-{
-    createLayout();
-    QLabel *lbl = new QLabel(this);
-    grid->addWidget(lbl, 0, 0);
-    lbl->setText(tr("No icons available"));
-    emit updatedGeometry();
-}
-
 void IconSelect::setIconset(const Iconset &iconset)
 {
+    setHover(-1);
     is = iconset;
-
-    // delete all children
-    if (grid) {
-        delete grid;
-        grid = nullptr;
-
-        QObjectList list = children();
-        qDeleteAll(list);
-    }
+    cells.clear();
+    filter.clear();
 
     bool fontEmojiMode = is.count() == 0;
 
@@ -301,96 +161,87 @@ void IconSelect::setIconset(const Iconset &iconset)
     float w = 0, h = 0;
     auto  fontSz            = qApp->fontMetrics().height();
     int   maxPrefTileHeight = fontSz * 2;
-    auto  maxPrefSize       = QSize(maxPrefTileHeight, maxPrefTileHeight);
+    maxIconSize             = QSize(maxPrefTileHeight, maxPrefTileHeight);
 
     double count; // the 'double' type is somewhat important for MSVC.NET here
     if (fontEmojiMode) {
         count = EmojiRegistry::instance().count();
         w     = fontSz * 1.5;
         h     = fontSz * 1.5;
-    } else {
-        QListIterator<PsiIcon *> it = is.iterator();
-        for (count = 0; it.hasNext(); count++) {
-            PsiIcon *icon    = it.next();
-            auto     pix     = icon->pixmap(maxPrefSize);
-            auto     pixSize = pix.size();
-            if (pix.width() > maxPrefSize.width() || pix.height() > maxPrefSize.height()) {
-                pixSize.scale(maxPrefSize, Qt::KeepAspectRatio);
-            }
-            w += pixSize.width();
-            h += pixSize.height();
-        }
-        w /= float(count);
-        h /= float(count);
-    }
-
-    const int margin   = 2;
-    int       tileSize = int(qMax(w, h)) + 2 * margin;
-
-    QRect r       = QApplication::desktop()->availableGeometry(menu);
-    int   maxSize = qMin(r.width(), r.height()) / 3;
-
-    int size       = int(ceil(std::sqrt(count)));
-    int maxColumns = int(maxSize / tileSize);
-    size           = size > maxColumns ? maxColumns : size;
-
-    // now, fill grid with elements
-    createLayout();
-
-    int row    = 0;
-    int column = 0;
 
-    if (fontEmojiMode) {
-        auto font = qApp->font();
-        if (font.pointSize() == -1)
-            font.setPixelSize(font.pixelSize() * 1.5);
+        emojiFont = qApp->font();
+        if (emojiFont.pointSize() == -1)
+            emojiFont.setPixelSize(emojiFont.pixelSize() * 1.5);
         else
-            font.setPointSize(font.pointSize() * 1.5);
+            emojiFont.setPointSize(emojiFont.pointSize() * 1.5);
 #if defined(Q_OS_WIN)
-        font.setFamily("Segoe UI Emoji");
+        emojiFont.setFamily("Segoe UI Emoji");
 #elif defined(Q_OS_MAC)
-        font.setFamily("Apple Color Emoji");
+        emojiFont.setFamily("Apple Color Emoji");
 #else
-        font.setFamily("Noto Color Emoji");
+        emojiFont.setFamily("Noto Color Emoji");
 #endif
+        cells.reserve(int(count));
         for (auto const &emoji : EmojiRegistry::instance()) {
-            IconSelectButton *b = new IconSelectButton(this);
-            b->setFont(font);
-            grid->addWidget(b, row, column);
-            b->setText(emoji.code);
-            b->setToolTip(emoji.name);
-            b->setSizeHint(QSize(tileSize, tileSize));
-            connect(b, qOverload<const PsiIcon *>(&IconSelectButton::iconSelected), menu,
-                    &IconSelectPopup::iconSelected);
-            connect(b, &IconSelectButton::textSelected, menu, &IconSelectPopup::textSelected);
-
-            if (++column >= size) {
-                ++row;
-                column = 0;
-            }
+            Cell c;
+            c.text       = emoji.code;
+            c.toolTip    = emoji.name;
+            c.searchText = emoji.name.toLower();
+            cells.append(c);
         }
     } else {
-        QListIterator<PsiIcon *> it = is.iterator();
-        QList<PsiIcon *>         sortIcons;
+        QList<PsiIcon *> icons;
         if (emojiSorting) {
-            sortIcons = sortEmojis();
-            it        = QListIterator<PsiIcon *>(sortIcons);
+            icons = sortEmojis();
+        } else {
+            for (PsiIcon *icon : is) {
+                icons.append(icon);
+            }
         }
-        while (it.hasNext()) {
-            IconSelectButton *b = new IconSelectButton(this);
-            grid->addWidget(b, row, column);
-            b->setIcon(it.next(), maxPrefSize);
-            b->setSizeHint(QSize(tileSize, tileSize));
-            connect(b, qOverload<const PsiIcon *>(&IconSelectButton::iconSelected), menu,
-                    &IconSelectPopup::iconSelected);
-            connect(b, &IconSelectButton::textSelected, menu, &IconSelectPopup::textSelected);
-
-            if (++column >= size) {
-                ++row;
-                column = 0;
+        cells.reserve(icons.count());
+        for (count = 0; count < icons.count(); count++) {
+            PsiIcon *icon    = icons[int(count)];
+            auto     pixSize = icon->size(maxIconSize);
+            if (pixSize.width() > maxIconSize.width() || pixSize.height() > maxIconSize.height()) {
+                pixSize.scale(maxIconSize, Qt::KeepAspectRatio);
             }
+            w += pixSize.width();
+            h += pixSize.height();
+
+            Cell        c;
+            QStringList texts;
+            for (const PsiIcon::IconText &t : icon->text()) {
+                texts += t.text;
+            }
+            c.icon       = icon;
+            c.toolTip    = texts.join(", ");
+            c.searchText = (texts.join(QLatin1Char(' ')) + QLatin1Char(' ') + icon->name()).toLower();
+            if (c.toolTip.length() > 30)
+                c.toolTip = c.toolTip.left(30) + "...";
+            cells.append(c);
+        }
+        if (count > 0) {
+            w /= float(count);
+            h /= float(count);
         }
     }
+
+    int tile = int(qMax(w, h)) + 2 * ICONSELECT_MARGIN;
+    tileSize = QSize(tile, tile);
+
+    QRect r       = QApplication::desktop()->availableGeometry(menu);
+    int   maxSize = qMin(r.width(), r.height()) / 3;
+
+    int size   = int(ceil(std::sqrt(count)));
+    int maxCol = int(maxSize / tile);
+    columns    = qMax(1, size > maxCol ? maxCol : size);
+
+    visible.resize(cells.size());
+    for (int i = 0; i < cells.size(); i++) {
+        visible[i] = i;
+    }
+    relayout();
+    update();
     emit updatedGeometry();
 }
 
@@ -398,8 +249,77 @@ const Iconset &IconSelect::iconset() const { return is; }
 
 void IconSelect::setEmojiSortingEnabled(bool enabled) { emojiSorting = enabled; }
 
+// shows only cells having `text` in their name or texts
+void IconSelect::setFilter(const QString &text)
+{
+    const QString query = text.trimmed().toLower();
+    if (query == filter) {
+        return;
+    }
+
+    // typing one more letter narrows the current result, no need to look at all the cells
+    QVector<int> from;
+    if (!filter.isEmpty() && query.contains(filter)) {
+        from = visible;
+    } else {
+        from.resize(cells.size());
+        for (int i = 0; i < cells.size(); i++) {
+            from[i] = i;
+        }
+    }
+    filter = query;
+
+    setHover(-1);
+    visible.clear();
+    for (int i : qAsConst(from)) {
+        if (query.isEmpty() || cells[i].searchText.contains(query)) {
+            visible.append(i);
+        }
+    }
+    relayout();
+    update();
+    if (!visible.isEmpty()) {
+        setHover(0);
+    }
+}
+
+void IconSelect::activate(int index)
+{
+    if (index < 0 || index >= visible.size()) {
+        return;
+    }
+    const Cell &c = cells[visible[index]];
+    if (c.icon) {
+        emit iconSelected(c.icon);
+        emit textSelected(c.icon->defaultText());
+    } else {
+        emit textSelected(c.text);
+    }
+}
+
 QList<PsiIcon *> IconSelect::sortEmojis() const
 {
+    // the order depends on the iconset only, so it's worked out once per iconset
+    static QHash<QString, QStringList> sortedNames;
+
+    const QString key = is.fileName().isEmpty()
+        ? QString()
+        : is.fileName() + QLatin1Char('\n') + is.version() + QLatin1Char('\n') + QString::number(is.count());
+    auto it = key.isEmpty() ? sortedNames.constEnd() : sortedNames.constFind(key);
+    if (it != sortedNames.constEnd()) {
+        QList<PsiIcon *> ret;
+        ret.reserve(it->count());
+        for (const QString &name : *it) {
+            PsiIcon *icon = const_cast<PsiIcon *>(is.icon(name));
+            if (icon) {
+                ret.append(icon);
+            }
+        }
+        if (ret.count() == is.count()) {
+            return ret;
+        }
+    }
+
     QList<PsiIcon *> ret;
     QList<PsiIcon *> notEmoji;
     ret.reserve(is.count());
@@ -432,9 +352,240 @@ QList<PsiIcon *> IconSelect::sortEmojis() const
     }
 
     ret += notEmoji;
+    if (!key.isEmpty()) {
+        QStringList names;
+        names.reserve(ret.count());
+        for (const PsiIcon *icon : qAsConst(ret)) {
+            names.append(icon->name());
+        }
+        sortedNames.insert(key, names);
+    }
     return ret;
 }
 
+void IconSelect::relayout()
+{
+    const int frame = style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this);
+    if (cells.isEmpty()) {
+        QSize sz = fontMetrics().size(0, tr("No icons available"));
+        setFixedHeight(sz.height() + 2 * frame);
+        setMinimumWidth(sz.width() + 2 * frame);
+        return;
+    }
+    const int rows = qMax(1, (visible.size() + columns - 1) / columns);
+    setMinimumWidth(columns * (tileSize.width() + ICONSELECT_SPACING) - ICONSELECT_SPACING + 2 * frame);
+    setFixedHeight(rows * (tileSize.height() + ICONSELECT_SPACING) - ICONSELECT_SPACING + 2 * frame);
+}
+
+QRect IconSelect::cellRect(int index) const
+{
+    const int frame = style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this);
+    return QRect(frame + (index % columns) * (tileSize.width() + ICONSELECT_SPACING),
+                 frame + (index / columns) * (tileSize.height() + ICONSELECT_SPACING), tileSize.width(),
+                 tileSize.height());
+}
+
+int IconSelect::cellAt(const QPoint &pos) const
+{
+    const int frame = style()->pixelMetric(QStyle::PM_MenuPanelWidth, nullptr, this);
+    if (pos.x() < frame || pos.y() < frame) {
+        return -1;
+    }
+    const int col   = (pos.x() - frame) / (tileSize.width() + ICONSELECT_SPACING);
+    const int row   = (pos.y() - frame) / (tileSize.height() + ICONSELECT_SPACING);
+    const int index = row * columns + col;
+    if (col >= columns || index >= visible.size() || !cellRect(index).contains(pos)) {
+        return -1;
+    }
+    return index;
+}
+
+// the hovered icon is animated, like in the chat
+void IconSelect::setHover(int index)
+{
+    if (index == hover) {
+        return;
+    }
+    if (hover != -1) {
+        update(cellRect(hover));
+    }
+    if (hoverIcon) {
+        hoverIcon->stop();
+        delete hoverIcon;
+        hoverIcon = nullptr;
+    }
+
+    hover = index;
+    if (hover == -1) {
+        return;
+    }
+    const Cell &c = cells[visible[hover]];
+    if (c.icon) {
+        hoverIcon = new PsiIcon(*c.icon);
+        connect(hoverIcon, SIGNAL(pixmapChanged()), SLOT(hoverIconUpdated()));
+        hoverIcon->activated(false);
+    }
+    update(cellRect(hover));
+
+    QScrollArea *area = qobject_cast<QScrollArea *>(parentWidget() ? parentWidget()->parentWidget() : nullptr);
+    if (area) {
+        const QRect r = cellRect(hover);
+        area->ensureVisible(r.center().x(), r.center().y(), r.width() / 2, r.height() / 2);
+    }
+}
+
+void IconSelect::hoverIconUpdated()
+{
+    if (hover != -1) {
+        update(cellRect(hover));
+    }
+}
+
+// rendered glyphs are shared through QPixmapCache, so reopening the picker doesn't render the font again
+QPixmap IconSelect::emojiPixmap(const QString &code) const
+{
+    const qreal   dpr = devicePixelRatioF();
+    const QString key = QLatin1String("iconselect/") + QString::number(tileSize.width()) + QLatin1Char('/')
+        + QString::number(dpr) + QLatin1Char('/') + code;
+    QPixmap pix;
+    if (QPixmapCache::find(key, &pix)) {
+        return pix;
+    }
+    pix = QPixmap(tileSize * dpr);
+    pix.setDevicePixelRatio(dpr);
+    pix.fill(Qt::transparent);
+    QPainter p(&pix);
+    p.setFont(emojiFont);
+    p.drawText(QRect(QPoint(0, 0), tileSize), Qt::AlignCenter, code);
+    p.end();
+    QPixmapCache::insert(key, pix);
+    return pix;
+}
+
+const QPixmap &IconSelect::cellPixmap(Cell &cell) const
+{
+    if (cell.pix.isNull()) {
+        if (cell.icon) {
+            cell.pix = cell.icon->pixmap(maxIconSize);
+            if (cell.pix.width() > maxIconSize.width() || cell.pix.height() > maxIconSize.height()) {
+                cell.pix = cell.pix.scaled(maxIconSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+        } else {
+            cell.pix = emojiPixmap(cell.text);
+        }
+    }
+    return cell.pix;
+}
+
+bool IconSelect::event(QEvent *e)
+{
+    if (e->type() == QEvent::ToolTip) {
+        QHelpEvent *he    = static_cast<QHelpEvent *>(e);
+        int         index = cellAt(he->pos());
+        if (index == -1 || cells[visible[index]].toolTip.isEmpty()) {
+            QToolTip::hideText();
+            e->ignore();
+        } else {
+            QToolTip::showText(he->globalPos(), cells[visible[index]].toolTip, this, cellRect(index));
+        }
+        return true;
+    }
+    return QWidget::event(e);
+}
+
+void IconSelect::paintEvent(QPaintEvent *e)
+{
+    QPainter p(this);
+
+    QStyleOptionMenuItem opt;
+    opt.palette = palette();
+    opt.rect    = rect();
+    style()->drawControl(QStyle::CE_MenuEmptyArea, &opt, &p, this);
+
+    if (cells.isEmpty()) {
+        p.drawText(rect(), Qt::AlignCenter, tr("No icons available"));
+        return;
+    }
+
+    // only the rows inside the exposed area
+    const int rowHeight = tileSize.height() + ICONSELECT_SPACING;
+    const int firstRow  = qMax(0, e->rect().top() / rowHeight - 1);
+    const int lastRow   = e->rect().bottom() / rowHeight + 1;
+    const int last      = qMin(visible.size(), (lastRow + 1) * columns);
+    for (int i = firstRow * columns; i < last; i++) {
+        const QRect r = cellRect(i);
+        if (!r.intersects(e->rect())) {
+            continue;
+        }
+
+        QStyleOptionMenuItem item;
+        item.palette = palette();
+        item.state   = QStyle::State_Active | QStyle::State_Enabled;
+        if (i == hover)
+            item.state |= QStyle::State_Selected;
+        item.font = font();
+        item.rect = r;
+        style()->drawControl(QStyle::CE_MenuItem, &item, &p, this);
+
+        QPixmap pix;
+        if (i == hover && hoverIcon) {
+            pix = hoverIcon->pixmap(maxIconSize);
+            if (pix.width() > maxIconSize.width() || pix.height() > maxIconSize.height()) {
+                pix = pix.scaled(maxIconSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            }
+        } else {
+            pix = cellPixmap(cells[visible[i]]);
+        }
+        const QSize sz = pix.size() / pix.devicePixelRatio();
+        p.drawPixmap(r.x() + (r.width() - sz.width()) / 2, r.y() + (r.height() - sz.height()) / 2, pix);
+    }
+}
+
+void IconSelect::mouseMoveEvent(QMouseEvent *e) { setHover(cellAt(e->pos())); }
+
+void IconSelect::mouseReleaseEvent(QMouseEvent *e)
+{
+    if (e->button() != Qt::LeftButton) {
+        return;
+    }
+    const int index = cellAt(e->pos());
+    if (index != -1) {
+        activate(index);
+    }
+}
+
+void IconSelect::keyPressEvent(QKeyEvent *e)
+{
+    int index = hover;
+    switch (e->key()) {
+    case Qt::Key_Left:
+        index = qMax(0, index - 1);
+        break;
+    case Qt::Key_Right:
+        index = qMin(visible.size() - 1, index + 1);
+        break;
+    case Qt::Key_Up:
+        index = index < columns ? index : index - columns;
+        break;
+    case Qt::Key_Down:
+        index = index == -1 ? 0 : (index + columns < visible.size() ? index + columns : index);
+        break;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        activate(hover == -1 ? 0 : hover);
+        return;
+    default:
+        QWidget::keyPressEvent(e);
+        return;
+    }
+    setHover(visible.isEmpty() ? -1 : qMax(0, index));
+}
+
+void IconSelect::leaveEvent(QEvent *) { setHover(-1); }
+
+void IconSelect::hideEvent(QHideEvent *) { setHover(-1); }
+//! \endif
+
 //----------------------------------------------------------------------------
 // IconSelectPopup
 //----------------------------------------------------------------------------
@@ -448,6 +599,26 @@ public:
     IconSelect *     icsel_;
     QWidgetAction *  widgetAction_;
     QScrollArea *    scrollArea_;
+    QWidgetAction *  searchAction_;
+    QLineEdit *      search_;
+
+    // the grid is navigated and activated from the search field
+    bool eventFilter(QObject *o, QEvent *e)
+    {
+        if (o == search_ && e->type() == QEvent::KeyPress) {
+            switch (static_cast<QKeyEvent *>(e)->key()) {
+            case Qt::Key_Up:
+            case Qt::Key_Down:
+            case Qt::Key_Return:
+            case Qt::Key_Enter:
+                QCoreApplication::sendEvent(icsel_, e);
+                return true;
+            default:
+                break;
+            }
+        }
+        return QObject::eventFilter(o, e);
+    }
 
 public slots:
     void updatedGeometry()
@@ -463,6 +634,12 @@ public slots:
         parent_->removeAction(widgetAction_);
         parent_->addAction(widgetAction_);
     }
+
+    void aboutToShow()
+    {
+        search_->clear();
+        search_->setFocus();
+    }
 };
 
 IconSelectPopup::IconSelectPopup(QWidget *parent) : QMenu(parent)
@@ -475,6 +652,17 @@ IconSelectPopup::IconSelectPopup(QWidget *parent) : QMenu(parent)
     d->scrollArea_->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     d->scrollArea_->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     d->scrollArea_->setWidgetResizable(true);
+
+    d->search_ = new QLineEdit(this);
+    d->search_->setPlaceholderText(tr("Search"));
+    d->search_->setClearButtonEnabled(true);
+    d->search_->installEventFilter(d);
+    d->searchAction_ = new QWidgetAction(this);
+    d->searchAction_->setDefaultWidget(d->search_);
+    addAction(d->searchAction_);
+    connect(d->search_, &QLineEdit::textChanged, d->icsel_, &IconSelect::setFilter);
+    connect(this, &QMenu::aboutToShow, d, &IconSelectPopup::Private::aboutToShow);
+
     connect(d->icsel_, &IconSelect::updatedGeometry, d, &IconSelectPopup::Private::updatedGeometry);
     d->updatedGeometry();
 }
@@ -29,6 +29,7 @@
 #include <QPainter>
 
 #ifndef WIDGET_PLUGIN
+#include "anim.h"
 #include "iconset.h"
 #include "pixmaputil.h"
 #include <QBitmap>
@@ -165,7 +166,36 @@ public:
     }
 
 public slots:
-    void update() { setData(Qt::UserRole, data(Qt::UserRole).toInt() + 1); }
+    void update()
+    {
+#ifndef WIDGET_PLUGIN
+        // icons change frames on the shared animation clock, repaint once per frame
+        if (!dirty) {
+            dirty = true;
+            AnimClock::instance()->addClient(this);
+            connect(AnimClock::instance(), &AnimClock::frame, this, &RealIconWidgetItem::flush);
+        }
+#else
+        setData(Qt::UserRole, data(Qt::UserRole).toInt() + 1);
+#endif
+    }
+
+#ifndef WIDGET_PLUGIN
+private slots:
+    void flush()
+    {
+        disconnect(AnimClock::instance(), &AnimClock::frame, this, &RealIconWidgetItem::flush);
+        AnimClock::instance()->removeClient(this);
+        dirty = false;
+
+        QListWidget *lw = listWidget();
+        if (lw && lw->isVisible())
+            lw->viewport()->update(lw->visualItemRect(this));
+    }
+
+private:
+    bool dirty = false;
+#endif
 };
 
 //----------------------------------------------------------------------------
@@ -586,6 +586,11 @@ void PsiRichText::setAllowedImageDirs(const QStringList &dirs) { allowedImageDir
 
 QTextCharFormat PsiRichText::markerFormat(const QString &uniqueId) { return TextMarkerFormat(uniqueId); }
 
+QString PsiRichText::markerId(const QTextCharFormat &format)
+{
+    return format.objectType() == MarkerFormatType ? format.stringProperty(TextMarkerFormat::MarkerId) : QString();
+}
+
 void PsiRichText::insertMarker(QTextCursor &cursor, const QString &uniqueId)
 {
     cursor.insertText(QString(QChar::ObjectReplacementCharacter), TextMarkerFormat(uniqueId));
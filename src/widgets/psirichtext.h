@@ -44,6 +44,7 @@ public:
     static QString convertToPlainText(const QTextDocument *doc);
 
     static QTextCharFormat markerFormat(const QString &uniqueId);
+    static QString         markerId(const QTextCharFormat &format); // null if format isn't a marker
     static void            insertMarker(QTextCursor &cursor, const QString &uniqueId);
     static QTextCursor     findMarker(const QTextCursor &cursor,
                                       const QString &    uniqueId); // will modify cursor to stay right after marker.
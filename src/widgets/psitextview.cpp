@@ -28,14 +28,19 @@
 #include <QTextDocumentFragment>
 #include <QTextFragment>
 #include <QTimer>
+#include <memory>
 
 #include "filesharingdownloader.h"
 #include "filesharingmanager.h"
+#include "imagepreviewcache.h"
 #include "psirichtext.h"
 #include "qiteaudio.h"
 #include "textutil.h"
 #include "urlobject.h"
 
+// inline images are shown scaled into this box
+#define SHARE_PREVIEW_SIZE QSize(640, 480)
+
 //----------------------------------------------------------------------------
 // PsiTextView::Private
 //----------------------------------------------------------------------------
@@ -69,6 +74,35 @@ public:
         }
         return attrs;
     }
+
+    // a blank image of the preview size stands in until the real one is decoded
+    QImage requestPreview(PsiTextView *view, FileSharingItem *item, const QUrl &url)
+    {
+        auto       previews = ImagePreviewCache::instance();
+        QByteArray key      = item->previewKey();
+        QImage     img      = previews->cached(key, SHARE_PREVIEW_SIZE);
+        if (!img.isNull())
+            return img;
+
+        QSize size = ImagePreviewCache::previewSize(item->fileName(), SHARE_PREVIEW_SIZE);
+        img        = QImage(size.isValid() ? size : QSize(1, 1), QImage::Format_ARGB32_Premultiplied);
+        img.fill(Qt::transparent);
+
+        auto conn    = std::make_shared<QMetaObject::Connection>();
+        auto onReady = [view, key, url, conn](const QByteArray &readyKey, const QSize &maxSize, const QImage &image) {
+            if (readyKey != key || maxSize != SHARE_PREVIEW_SIZE)
+                return;
+            QObject::disconnect(*conn);
+            if (image.isNull())
+                return;
+            // the size is already in the image format, so it's only repainted
+            view->document()->addResource(QTextDocument::ImageResource, url, image);
+            view->viewport()->update();
+        };
+        *conn = connect(previews, &ImagePreviewCache::ready, this, onReady);
+        previews->request(key, item->fileName(), SHARE_PREVIEW_SIZE);
+        return img;
+    }
 };
 //! endif
 
@@ -136,7 +170,7 @@ span.emojis {
                       if (vimg.isValid()) {
                           img = vimg.value<QImage>();
                       } else {
-                          img = item->preview(QSize(640, 480));
+                          img = d->requestPreview(this, item, url);
                           document()->addResource(QTextDocument::ImageResource, url, img);
                       }
 
@@ -149,7 +183,7 @@ span.emojis {
                   // otherwise we have to download it
                   connect(item, &FileSharingItem::downloadFinished, this, [this, anchorName, url, item, insertAfter]() {
                       item->disconnect(this);
-                      document()->addResource(QTextDocument::ImageResource, url, item->preview(QSize(640, 480)));
+                      document()->addResource(QTextDocument::ImageResource, url, item->preview(SHARE_PREVIEW_SIZE));
                       auto        prevCur = textCursor();
                       QTextCursor cur(document());
                       cur.setPosition(insertAfter);
@@ -32,6 +32,7 @@
 #include <QPixmap>
 #include <QStyleOptionTab>
 #include <QStylePainter>
+#include <QTimer>
 #include <memory>
 
 #define PINNED_CHARS 12
@@ -62,11 +63,15 @@ class TabBar::Private {
 public:
     Private(TabBar *base);
 
-    void  layoutTabs();
-    int   pinnedTabWidthHint() const;
-    QSize tabSizeHint(QStyleOptionTab tab) const;
-    void  balanseCloseButtons();
-    bool  indexAtBottom(int index) const;
+    void            layoutTabs();
+    QStyleOptionTab prepareTab(int index, QSize *hint) const;
+    int             pinnedTabWidthHint() const;
+    QSize           tabSizeHint(QStyleOptionTab tab) const;
+    QSize           cachedTabSizeHint(const QStyleOptionTab &tab) const;
+    void            tabChanged(int index);
+    bool            refreshTab(int index);
+    void            balanseCloseButtons();
+    bool            indexAtBottom(int index) const;
 
     TabBar *                 q;
     QVector<QStyleOptionTab> hackedTabs;
@@ -84,6 +89,11 @@ public:
     bool                     stopRecursive;
     bool                     indexAlwaysAtBottom;
 
+    QVector<QSize>                tabHints;    // size hint of each of hackedTabs, before it got stretched
+    mutable QHash<QString, QSize> hintCache;   // text and decorations -> size hint
+    int                           pinnedWidth; // of the last layout
+    QTimer *                      layoutTimer; // one relayout for all the tab changes of an event loop turn
+
     struct {
         QList<int> tabs;
         int        barWidth;
@@ -96,8 +106,13 @@ public:
 TabBar::Private::Private(TabBar *base) :
     q(base), hackedTabs(), closeButtons(), tabsClosable(false), multiRow(false), hoverTab(-1), dragsEnabled(true),
     dragTab(-1), dragInsertIndex(-1), dragHoverTab(-1), mousePressPoint(), pinnedTabs(0), update(true),
-    stopRecursive(false), indexAlwaysAtBottom(false), cachedLayout({ QList<int>(), 0, 0, 0., LayoutSf() })
+    stopRecursive(false), indexAlwaysAtBottom(false), pinnedWidth(0),
+    cachedLayout({ QList<int>(), 0, 0, 0., LayoutSf() })
 {
+    layoutTimer = new QTimer(q);
+    layoutTimer->setSingleShot(true);
+    layoutTimer->setInterval(0);
+    QObject::connect(layoutTimer, &QTimer::timeout, q, &TabBar::layoutTabs);
     balanseCloseButtons();
 }
 
@@ -237,17 +252,18 @@ void TabBar::Private::layoutTabs()
     if (!update)
         return;
 
+    layoutTimer->stop(); // this is it
     pinnedTabs = qMin(pinnedTabs, q->count());
     hackedTabs.clear();
+    tabHints.clear();
 
-    QTabBar::ButtonPosition closeSide = static_cast<QTabBar::ButtonPosition>(
-        q->style()->styleHint(QStyle::SH_TabBar_CloseButtonPosition, nullptr, q));
     // Tabs maybe 0 width in all-in-one mode
     int barWidth      = qMax(q->width(), 1);
     int tabsWidthHint = 0;
 
     int pinnedTabWidth = pinnedTabWidthHint();
     int pinnedInRow    = barWidth / pinnedTabWidth;
+    pinnedWidth        = pinnedTabWidth;
 
     // Protect zero divide
     if (!pinnedInRow)
@@ -258,31 +274,9 @@ void TabBar::Private::layoutTabs()
 
     // Prepare hacked tabs
     for (int i = 0; i < q->count(); i++) {
-        QStyleOptionTab tab;
-        q->initStyleOption(&tab, i);
-        if (i == 0) {
-            tab.rect.setLeft(0);
-        }
-
-        tab.state &= ~QStyle::State_MouseOver;
-        tab.position = QStyleOptionTab::Beginning;
-
-        if (tabsClosable && i >= pinnedTabs) {
-            tab.rect.setWidth(tab.rect.width() + closeButtons.at(i)->size().width());
-            if (closeSide == QTabBar::LeftSide) {
-                tab.leftButtonSize = closeButtons.at(i)->size();
-            } else {
-                tab.rightButtonSize = closeButtons.at(i)->size();
-            }
-        }
-
-        tab.rect.setSize(tabSizeHint(tab));
-        // Make pinned tab if need
-        if (i < pinnedTabs) {
-            tab.text = tab.text.left(tab.text.leftRef(PINNED_CHARS).contains("&") ? (PINNED_CHARS + 1) : PINNED_CHARS);
-            tab.rect.setWidth(pinnedTabWidth);
-        }
-        hackedTabs << tab;
+        QSize hint;
+        hackedTabs << prepareTab(i, &hint);
+        tabHints << hint;
     }
 
     // Extra checking for no any tabs (maybe can be dropped?)
@@ -423,6 +417,84 @@ void TabBar::Private::layoutTabs()
     q->resize(q->sizeHint());
 }
 
+QStyleOptionTab TabBar::Private::prepareTab(int i, QSize *hint) const
+{
+    QTabBar::ButtonPosition closeSide = static_cast<QTabBar::ButtonPosition>(
+        q->style()->styleHint(QStyle::SH_TabBar_CloseButtonPosition, nullptr, q));
+
+    QStyleOptionTab tab;
+    q->initStyleOption(&tab, i);
+    if (i == 0) {
+        tab.rect.setLeft(0);
+    }
+
+    tab.state &= ~QStyle::State_MouseOver;
+    tab.position = QStyleOptionTab::Beginning;
+
+    if (tabsClosable && i >= pinnedTabs) {
+        tab.rect.setWidth(tab.rect.width() + closeButtons.at(i)->size().width());
+        if (closeSide == QTabBar::LeftSide) {
+            tab.leftButtonSize = closeButtons.at(i)->size();
+        } else {
+            tab.rightButtonSize = closeButtons.at(i)->size();
+        }
+    }
+
+    *hint = cachedTabSizeHint(tab);
+    tab.rect.setSize(*hint);
+    // Make pinned tab if need
+    if (i < pinnedTabs) {
+        tab.text = tab.text.left(tab.text.leftRef(PINNED_CHARS).contains("&") ? (PINNED_CHARS + 1) : PINNED_CHARS);
+        tab.rect.setWidth(pinnedWidth);
+    }
+    return tab;
+}
+
+// a tab got new text, icon or color. if its size stays, only what it paints is updated,
+// otherwise one relayout runs for all the changes of this event loop turn
+void TabBar::Private::tabChanged(int index)
+{
+    if (multiRow && !refreshTab(index) && !layoutTimer->isActive())
+        layoutTimer->start();
+    q->update();
+}
+
+bool TabBar::Private::refreshTab(int index)
+{
+    if (!update || layoutTimer->isActive() || hackedTabs.size() != q->count() || index < 0
+        || index >= hackedTabs.size())
+        return false;
+
+    QSize           hint;
+    QStyleOptionTab tab = prepareTab(index, &hint);
+    if (index < pinnedTabs ? hint.height() != tabHints[index].height() : hint != tabHints[index])
+        return false;
+
+    // keeps its place in the layout
+    QStyleOptionTab &old = hackedTabs[index];
+    old.text             = tab.text;
+    old.icon             = tab.icon;
+    old.palette          = tab.palette;
+    return true;
+}
+
+// most changes of a tab are only its color or the same text again
+QSize TabBar::Private::cachedTabSizeHint(const QStyleOptionTab &tab) const
+{
+    const QString key = tab.text + '\n' + QString::number(tab.icon.isNull()) + ' '
+        + QString::number(tab.leftButtonSize.width()) + ' ' + QString::number(tab.rightButtonSize.width()) + ' '
+        + QString::number(tab.iconSize.width()) + 'x' + QString::number(tab.iconSize.height()) + ' '
+        + QString::number(int(tab.shape));
+    auto it = hintCache.constFind(key);
+    if (it != hintCache.constEnd())
+        return *it;
+
+    // texts of closed tabs and old unread counts go from time to time
+    if (hintCache.size() > 4 * qMax(q->count(), 16))
+        hintCache.clear();
+    return *hintCache.insert(key, tabSizeHint(tab));
+}
+
 inline static bool verticalTabs(QTabBar::Shape shape)
 {
     return shape == QTabBar::RoundedWest || shape == QTabBar::RoundedEast || shape == QTabBar::TriangularWest
@@ -663,20 +735,26 @@ void TabBar::setCurrentIndex(int index)
 
 void TabBar::setTabText(int index, const QString &text)
 {
+    if (text == tabText(index))
+        return;
     QTabBar::setTabText(index, text);
-    layoutTabs();
+    d->tabChanged(index);
 }
 
 void TabBar::setTabTextColor(int index, const QColor &color)
 {
+    if (color == tabTextColor(index))
+        return;
     QTabBar::setTabTextColor(index, color);
-    layoutTabs();
+    d->tabChanged(index);
 }
 
 void TabBar::setTabIcon(int index, const QIcon &icon)
 {
+    if (icon.cacheKey() == tabIcon(index).cacheKey())
+        return;
     QTabBar::setTabIcon(index, icon);
-    layoutTabs();
+    d->tabChanged(index);
 }
 
 QRect TabBar::tabRect(int index) const
@@ -809,8 +887,7 @@ QSize TabBar::tabSizeHint(int index) const
         return QSize();
     }
 
-    QStyleOptionTab opt = d->hackedTabs.at(index);
-    return d->tabSizeHint(opt);
+    return d->cachedTabSizeHint(d->hackedTabs.at(index));
 }
 
 void TabBar::setTabsClosable(bool b)
@@ -1172,6 +1249,16 @@ void TabBar::leaveEvent(QEvent *event)
     QTabBar::leaveEvent(event);
 }
 
+void TabBar::changeEvent(QEvent *event)
+{
+    QTabBar::changeEvent(event);
+    if (event->type() == QEvent::FontChange || event->type() == QEvent::StyleChange) {
+        d->hintCache.clear();
+        if (d->multiRow)
+            layoutTabs();
+    }
+}
+
 void TabBar::tabInserted(int index)
 {
     QTabBar::tabInserted(index);
@@ -68,6 +68,7 @@ protected:
     void dropEvent(QDropEvent *event);
 
     void leaveEvent(QEvent *event);
+    void changeEvent(QEvent *event);
     void tabInserted(int index);
     void tabRemoved(int index);
 
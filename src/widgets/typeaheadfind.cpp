@@ -28,7 +28,12 @@
 #include <QCheckBox>
 #include <QLabel>
 #include <QLineEdit>
+#include <QStringMatcher>
 #include <QTextEdit>
+#include <algorithm>
+
+// hits highlighted at most, around the current one
+#define FIND_MAX_HIGHLIGHTS 1000
 
 /**
  * \class TypeAheadFindBar
@@ -55,27 +60,15 @@ public:
         if (caseSensitive)
             options |= QTextDocument::FindCaseSensitively;
 
-        if (backward) {
+        if (backward)
             options |= QTextDocument::FindBackward;
 
-            if (widgetType == TypeAheadFindBar::Type::WebView) {
-                // FIXME make it work with web
-            } else {
-                // move cursor before currect selection
-                // to prevent finding the same occurence again
-                QTextCursor cursor = te->textCursor();
-                cursor.setPosition(cursor.selectionStart());
-                cursor.movePosition(QTextCursor::Left);
-                te->setTextCursor(cursor);
-            }
-        }
         find(text, options);
     }
 
     // real search code
 
-    void find(const QString &str, QTextDocument::FindFlags options,
-              QTextCursor::MoveOperation start = QTextCursor::NoMove)
+    void find(const QString &str, QTextDocument::FindFlags options)
     {
         if (widgetType == TypeAheadFindBar::Type::WebView) {
 #ifdef WEBKIT
@@ -101,25 +94,106 @@ public:
 
         // If we are here then it's not webkit/engine.
 
-        if (start != QTextCursor::NoMove) {
-            QTextCursor cursor = te->textCursor();
-            cursor.movePosition(start);
-            te->setTextCursor(cursor);
+        updateMatches(str, options & QTextDocument::FindCaseSensitively);
+        if (matches.isEmpty()) {
+            current = -1;
+            te->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+            updateFoundStyle(false);
+            updateCount();
+            return;
         }
 
-        bool found = te->find(text, options);
-        if (!found && start == QTextCursor::NoMove) {
-            find(text, options, options & QTextDocument::FindBackward ? QTextCursor::End : QTextCursor::Start);
-            return;
+        // the first hit after the cursor, or the last one before the selection, wrapping around
+        QTextCursor cursor = te->textCursor();
+        if (options & QTextDocument::FindBackward) {
+            auto it = std::lower_bound(matches.constBegin(), matches.constEnd(), cursor.selectionStart());
+            current = (it == matches.constBegin() ? matches.size() : int(it - matches.constBegin())) - 1;
+        } else {
+            auto it = std::lower_bound(matches.constBegin(), matches.constEnd(), cursor.position());
+            current = it == matches.constEnd() ? 0 : int(it - matches.constBegin());
+        }
+        cursor.setPosition(matches[current]);
+        cursor.setPosition(matches[current] + str.length(), QTextCursor::KeepAnchor);
+        te->setTextCursor(cursor);
+
+        highlightMatches(str.length());
+        updateFoundStyle(true);
+        updateCount();
+    }
+
+    // positions of all occurrences of str in the document. a longer query starting with the
+    // previous one only needs the previous hits checked, the document is scanned again otherwise
+    void updateMatches(const QString &str, bool cs)
+    {
+        const Qt::CaseSensitivity sensitivity = cs ? Qt::CaseSensitive : Qt::CaseInsensitive;
+        if (documentChanged || cs != matchedCase || matchedText.isEmpty()
+            || !str.startsWith(matchedText, sensitivity)) {
+            if (documentChanged)
+                plainText = te->toPlainText();
+            documentChanged = false;
+            matches.clear();
+            // overlapping hits too, a longer query may start inside a hit of this one
+            const QStringMatcher matcher(str, sensitivity);
+            for (int pos = matcher.indexIn(plainText, 0); pos != -1; pos = matcher.indexIn(plainText, pos + 1))
+                matches += pos;
+        } else if (str.length() != matchedText.length()) {
+            QVector<int> narrowed;
+            for (int pos : qAsConst(matches)) {
+                if (plainText.midRef(pos, str.length()).compare(str, sensitivity) == 0)
+                    narrowed += pos;
+            }
+            matches = narrowed;
+        }
+        matchedText = str;
+        matchedCase = cs;
+    }
+
+    void highlightMatches(int length)
+    {
+        QList<QTextEdit::ExtraSelection> extras;
+        QTextEdit::ExtraSelection        highlight;
+        highlight.format.setBackground(QColor(255, 255, 0, 128));
+        const int from = qMax(0, qMin(current - FIND_MAX_HIGHLIGHTS / 2, matches.size() - FIND_MAX_HIGHLIGHTS));
+        const int to   = qMin(matches.size(), from + FIND_MAX_HIGHLIGHTS);
+        for (int i = from; i < to; ++i) {
+            highlight.cursor = QTextCursor(te->document());
+            highlight.cursor.setPosition(matches[i]);
+            highlight.cursor.setPosition(matches[i] + length, QTextCursor::KeepAnchor);
+            extras << highlight;
         }
+        te->setExtraSelections(extras);
+    }
 
-        updateFoundStyle(found);
+    void updateCount()
+    {
+        if (matches.isEmpty())
+            lb_count->setText(text.isEmpty() ? QString() : TypeAheadFindBar::tr("No matches"));
+        else
+            lb_count->setText(TypeAheadFindBar::tr("%1 of %2").arg(current + 1).arg(matches.size()));
+    }
+
+    void resetMatches()
+    {
+        matches.clear();
+        matchedText.clear();
+        current = -1;
+        if (widgetType == TypeAheadFindBar::Type::TextEdit)
+            te->setExtraSelections(QList<QTextEdit::ExtraSelection>());
+        lb_count->clear();
     }
 
     QString                text;
     bool                   caseSensitive;
     TypeAheadFindBar::Type widgetType;
 
+    // incremental search in the text edit
+    QString      plainText;              // the document when it was last scanned
+    bool         documentChanged = true; // plainText is stale
+    QString      matchedText;            // query the matches are for
+    bool         matchedCase = false;
+    QVector<int> matches;      // sorted document positions
+    int          current = -1; // index of the selected match
+
     QTextEdit *te;
 #ifdef WEBKIT
     WebView *wv;
@@ -128,6 +202,7 @@ public:
     QAction *  act_prev;
     QAction *  act_next;
     QCheckBox *cb_case;
+    QLabel *   lb_count;
 };
 
 /**
@@ -184,6 +259,13 @@ void TypeAheadFindBar::init()
     connect(d->cb_case, SIGNAL(stateChanged(int)), SLOT(caseToggled(int)));
     addWidget(d->cb_case);
 
+    d->lb_count = new QLabel(this);
+    addWidget(d->lb_count);
+
+    if (d->widgetType == Type::TextEdit) {
+        connect(d->te->document(), &QTextDocument::contentsChanged, this, [this]() { d->documentChanged = true; });
+    }
+
     addWidget(new StretchWidget(this));
 
     optionsUpdate();
@@ -226,6 +308,7 @@ void TypeAheadFindBar::open()
  */
 void TypeAheadFindBar::close()
 {
+    d->resetMatches();
     hide();
     emit visibilityChanged(false);
 }
@@ -235,11 +318,13 @@ void TypeAheadFindBar::close()
  */
 void TypeAheadFindBar::toggleVisibility()
 {
-    if (isVisible())
+    if (isVisible()) {
+        d->resetMatches();
         hide();
-    else
+    } else {
         // show();
         open();
+    }
 }
 
 /**
@@ -264,6 +349,8 @@ void TypeAheadFindBar::textChanged(const QString &str)
             cursor.clearSelection();
             d->te->setTextCursor(cursor);
         }
+        d->text.clear();
+        d->resetMatches();
         d->le_find->setStyleSheet("");
     } else {
         d->act_prev->setEnabled(true);
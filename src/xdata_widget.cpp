@@ -26,20 +26,29 @@
 #include "xmpp_tasks.h"
 #include "xmpp_xdata.h"
 
+#include <QAbstractListModel>
 #include <QCheckBox>
 #include <QComboBox>
+#include <QCompleter>
 #include <QGridLayout>
 #include <QLabel>
 #include <QLayout>
 #include <QLineEdit>
-#include <QListWidget>
+#include <QListView>
 #include <QNetworkReply>
 #include <QNetworkRequest>
 #include <QObject>
+#include <QSortFilterProxyModel>
 #include <QSpacerItem>
 #include <QTextEdit>
+#include <QTimer>
 #include <QUrl>
 
+// fields built right away, the rest follow in chunks of this size on the next event loop passes
+#define XDATA_FIELDS_CHUNK 40
+// options above which a list field can be filtered
+#define XDATA_FILTER_THRESHOLD 20
+
 using namespace XMPP;
 
 class XDataMediaWidget : public QLabel {
@@ -119,6 +128,77 @@ private:
     QString      _type;
 };
 
+//----------------------------------------------------------------------------
+// XDataOptionsModel
+//----------------------------------------------------------------------------
+// the options of a list field, views create widgets only for the visible rows
+class XDataOptionsModel : public QAbstractListModel {
+public:
+    XDataOptionsModel(const XData::Field &f, bool checkable, QObject *parent) :
+        QAbstractListModel(parent), checkable_(checkable)
+    {
+        const XData::Field::OptionList opts = f.options();
+        const QStringList              sel  = f.value();
+        labels_.reserve(opts.size());
+        values_.reserve(opts.size());
+        for (const XData::Field::Option &o : opts) {
+            labels_ += o.label.isEmpty() ? o.value : o.label;
+            values_ += o.value;
+            if (checkable_)
+                checked_ += sel.contains(o.value) || (!o.label.isEmpty() && sel.contains(o.label));
+        }
+    }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const { return parent.isValid() ? 0 : labels_.size(); }
+
+    QVariant data(const QModelIndex &index, int role) const
+    {
+        if (!index.isValid() || index.row() >= labels_.size())
+            return QVariant();
+        if (role == Qt::DisplayRole)
+            return labels_.at(index.row());
+        if (role == Qt::CheckStateRole && checkable_)
+            return checked_.at(index.row()) ? Qt::Checked : Qt::Unchecked;
+        return QVariant();
+    }
+
+    bool setData(const QModelIndex &index, const QVariant &value, int role)
+    {
+        if (!checkable_ || role != Qt::CheckStateRole || !index.isValid())
+            return false;
+        checked_[index.row()] = value.toInt() == Qt::Checked;
+        emit dataChanged(index, index, { Qt::CheckStateRole });
+        return true;
+    }
+
+    Qt::ItemFlags flags(const QModelIndex &index) const
+    {
+        Qt::ItemFlags f = QAbstractListModel::flags(index);
+        if (checkable_)
+            f |= Qt::ItemIsUserCheckable;
+        return f;
+    }
+
+    int indexOf(const QString &value) const { return values_.indexOf(value); }
+
+    QString value(int row) const { return values_.value(row); }
+
+    QStringList checkedValues() const
+    {
+        QStringList val;
+        for (int n = 0; n < values_.size(); ++n)
+            if (checked_.at(n))
+                val += values_.at(n);
+        return val;
+    }
+
+private:
+    bool          checkable_;
+    QStringList   labels_;
+    QStringList   values_;
+    QVector<bool> checked_;
+};
+
 //----------------------------------------------------------------------------
 // XDataField
 //----------------------------------------------------------------------------
@@ -342,21 +422,17 @@ public:
 
         grid->addLayout(layout, row, 0);
 
-        QString sel;
-        if (!f.value().isEmpty())
-            sel = f.value().constFirst();
-
-        XData::Field::OptionList           opts = f.options();
-        XData::Field::OptionList::Iterator it   = opts.begin();
-        for (; it != opts.end(); ++it) {
-            QString lbl = (*it).label;
-            if (lbl.isEmpty())
-                lbl = (*it).value;
-
-            combo->addItem(lbl);
-            if ((*it).value == sel)
-                combo->setCurrentIndex(combo->count() - 1);
+        model = new XDataOptionsModel(f, false, combo);
+        combo->setModel(model);
+        if (model->rowCount() > XDATA_FILTER_THRESHOLD) {
+            // typing filters the options, and the width isn't measured over all of them
+            combo->setEditable(true);
+            combo->completer()->setCompletionMode(QCompleter::PopupCompletion);
+            combo->completer()->setFilterMode(Qt::MatchContains);
+            combo->setSizeAdjustPolicy(QComboBox::AdjustToMinimumContentsLengthWithIcon);
+            combo->setMinimumContentsLength(20);
         }
+        combo->setCurrentIndex(f.value().isEmpty() ? -1 : model->indexOf(f.value().constFirst()));
 
         QLabel *req = new QLabel(reqText(), xdw);
         grid->addWidget(req, row, 1);
@@ -370,26 +446,23 @@ public:
 
     XData::Field field() const
     {
-        QString lbl = combo->currentText();
-
         XData::Field f = XDataField::field();
         QStringList  val;
 
-        XData::Field::OptionList           opts = f.options();
-        XData::Field::OptionList::Iterator it   = opts.begin();
-        for (; it != opts.end(); ++it) {
-            if ((*it).label == lbl || (*it).value == lbl) {
-                val << (*it).value;
-                break;
-            }
-        }
+        // the typed text of a filtered combo may differ from the last chosen option
+        int row = combo->isEditable() ? combo->findText(combo->currentText(), Qt::MatchFixedString) : -1;
+        if (row < 0)
+            row = combo->currentIndex();
+        if (row >= 0)
+            val << model->value(row);
 
         f.setValue(val);
         return f;
     }
 
 private:
-    QComboBox *combo;
+    QComboBox *        combo;
+    XDataOptionsModel *model;
 };
 
 ////////////////////////////////////////
@@ -403,25 +476,27 @@ public:
         label->setWordWrap(true);
         grid->addWidget(label, row, 0);
 
-        list = new QListWidget(xdw);
-        grid->addWidget(list, row, 1);
-        list->setSelectionMode(QAbstractItemView::MultiSelection);
-
-        XData::Field::OptionList           opts = f.options();
-        XData::Field::OptionList::Iterator it   = opts.begin();
-        for (; it != opts.end(); ++it) {
-            QString lbl = (*it).label;
-            if (lbl.isEmpty())
-                lbl = (*it).value;
-
-            QListWidgetItem *item = new QListWidgetItem(lbl, list);
-
-            QStringList           val = f.value();
-            QStringList::Iterator sit = val.begin();
-            for (; sit != val.end(); ++sit)
-                if ((*it).label == *sit || (*it).value == *sit)
-                    item->setSelected(true);
+        QVBoxLayout *layout = new QVBoxLayout;
+        list                = new QListView(xdw);
+        model               = new XDataOptionsModel(f, true, list);
+        list->setUniformItemSizes(true);
+        list->setSelectionMode(QAbstractItemView::NoSelection);
+        if (model->rowCount() > XDATA_FILTER_THRESHOLD) {
+            // hidden rows keep their check state, it lives in the model
+            QSortFilterProxyModel *proxy = new QSortFilterProxyModel(list);
+            proxy->setSourceModel(model);
+            proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+            QLineEdit *filter = new QLineEdit(xdw);
+            filter->setPlaceholderText(QObject::tr("Filter"));
+            filter->setClearButtonEnabled(true);
+            QObject::connect(filter, &QLineEdit::textChanged, proxy, &QSortFilterProxyModel::setFilterFixedString);
+            layout->addWidget(filter);
+            list->setModel(proxy);
+        } else {
+            list->setModel(model);
         }
+        layout->addWidget(list);
+        grid->addLayout(layout, row, 1);
 
         QLabel *req = new QLabel(reqText(), xdw);
         grid->addWidget(req, row, 2);
@@ -436,29 +511,13 @@ public:
     XData::Field field() const
     {
         XData::Field f = XDataField::field();
-        QStringList  val;
-
-        for (int i = 0; i < list->count(); i++) {
-            QListWidgetItem *item = list->item(i);
-            if (item->isSelected()) {
-                QString                            lbl  = item->text();
-                XData::Field::OptionList           opts = f.options();
-                XData::Field::OptionList::Iterator it   = opts.begin();
-                for (; it != opts.end(); ++it) {
-                    if ((*it).label == lbl || (*it).value == lbl) {
-                        val << (*it).value;
-                        break;
-                    }
-                }
-            }
-        }
-
-        f.setValue(val);
+        f.setValue(model->checkedValues());
         return f;
     }
 
 private:
-    QListWidget *list;
+    QListView *        list;
+    XDataOptionsModel *model;
 };
 
 ////////////////////////////////////////
@@ -530,6 +589,10 @@ XDataWidget::XDataWidget(PsiCon *psi, QWidget *parent, XMPP::Client *client, XMP
     owner_  = owner;
     layout_ = new QVBoxLayout(this);
     layout_->setContentsMargins(0, 0, 0, 0);
+
+    buildTimer_ = new QTimer(this);
+    buildTimer_->setSingleShot(true);
+    connect(buildTimer_, &QTimer::timeout, this, [this]() { buildFields(XDATA_FIELDS_CHUNK); });
 }
 
 XDataWidget::~XDataWidget() { qDeleteAll(fields_); }
@@ -559,6 +622,9 @@ void XDataWidget::setForm(const XMPP::XData &d, bool withInstructions)
 {
     qDeleteAll(fields_);
     fields_.clear();
+    pending_.clear();
+    grid_ = nullptr;
+    buildTimer_->stop();
 
     QLayoutItem *child;
     while ((child = layout_->takeAt(0)) != nullptr) {
@@ -639,6 +705,8 @@ XData::FieldList XDataWidget::fields() const
     for (const auto &field : fields_) {
         f.append(field->field());
     }
+    // untouched as the user couldn't get to them yet
+    f += pending_;
 
     return f;
 }
@@ -649,47 +717,60 @@ void XDataWidget::setFields(const XData::FieldList &f)
     layout_->addWidget(fields);
     if (f.count()) {
         // FIXME
-        QGridLayout *grid = new QGridLayout(fields);
-        grid->setSpacing(3);
-
-        XData::FieldList::ConstIterator it = f.begin();
-        for (; it != f.end(); ++it) {
-            XDataField *f;
-            switch ((*it).type()) {
-            case XData::Field::Field_Boolean:
-                f = new XDataField_Boolean(*it, grid, this);
-                break;
-            case XData::Field::Field_Fixed:
-                f = new XDataField_Fixed(*it, grid, this);
-                break;
-            case XData::Field::Field_Hidden:
-                f = new XDataField_Hidden(*it, this);
-                break;
-            case XData::Field::Field_JidSingle:
-                f = new XDataField_JidSingle(*it, grid, this);
-                break;
-            case XData::Field::Field_ListMulti:
-                f = new XDataField_ListMulti(*it, grid, this);
-                break;
-            case XData::Field::Field_ListSingle:
-                f = new XDataField_ListSingle(*it, grid, this);
-                break;
-            case XData::Field::Field_TextMulti:
-                f = new XDataField_TextMulti(*it, grid, this);
-                break;
-            case XData::Field::Field_JidMulti:
-                f = new XDataField_JidMulti(*it, grid, this);
-                break;
-            case XData::Field::Field_TextPrivate:
-                f = new XDataField_TextPrivate(*it, grid, this);
-                break;
-
-            default:
-                f = new XDataField_TextSingle(*it, grid, this);
-            }
-            fields_.append(f);
+        grid_ = new QGridLayout(fields);
+        grid_->setSpacing(3);
+
+        // a huge form shows its first fields right away, the rest is added while it is on screen
+        pending_ = f;
+        buildFields(XDATA_FIELDS_CHUNK);
+    }
+}
+
+void XDataWidget::buildFields(int count)
+{
+    if (!grid_)
+        return;
+
+    QGridLayout *grid = grid_;
+    for (int n = 0; n < count && !pending_.isEmpty(); ++n) {
+        const XData::Field field = pending_.takeFirst();
+        XDataField *       f;
+        switch (field.type()) {
+        case XData::Field::Field_Boolean:
+            f = new XDataField_Boolean(field, grid, this);
+            break;
+        case XData::Field::Field_Fixed:
+            f = new XDataField_Fixed(field, grid, this);
+            break;
+        case XData::Field::Field_Hidden:
+            f = new XDataField_Hidden(field, this);
+            break;
+        case XData::Field::Field_JidSingle:
+            f = new XDataField_JidSingle(field, grid, this);
+            break;
+        case XData::Field::Field_ListMulti:
+            f = new XDataField_ListMulti(field, grid, this);
+            break;
+        case XData::Field::Field_ListSingle:
+            f = new XDataField_ListSingle(field, grid, this);
+            break;
+        case XData::Field::Field_TextMulti:
+            f = new XDataField_TextMulti(field, grid, this);
+            break;
+        case XData::Field::Field_JidMulti:
+            f = new XDataField_JidMulti(field, grid, this);
+            break;
+        case XData::Field::Field_TextPrivate:
+            f = new XDataField_TextPrivate(field, grid, this);
+            break;
+
+        default:
+            f = new XDataField_TextSingle(field, grid, this);
         }
+        fields_.append(f);
     }
+    if (!pending_.isEmpty())
+        buildTimer_->start(0);
 }
 
 XDataField *XDataWidget::fieldByVar(const QString &var) const
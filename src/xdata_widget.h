@@ -30,6 +30,8 @@
 #include <QWidget>
 
 class PsiCon;
+class QGridLayout;
+class QTimer;
 class XDataField;
 
 namespace XMPP {
@@ -60,10 +62,14 @@ protected slots:
 private:
     void setInstructions(const QString &);
     void setFields(const XMPP::XData::FieldList &);
+    void buildFields(int count);
 
 private:
     typedef QList<XDataField *> XDataFieldList;
     XDataFieldList              fields_;
+    XMPP::XData::FieldList      pending_; // not built yet, they follow fields_
+    QGridLayout *               grid_ = nullptr;
+    QTimer *                    buildTimer_;
     QString                     registrarType_;
     QVBoxLayout *               layout_;
     PsiCon *                    psi_;
@@ -20,21 +20,199 @@
 #include "xmlconsole.h"
 
 #include "iconset.h"
+#include "jidutil.h"
 #include "psiaccount.h"
 #include "psicon.h"
 #include "psicontactlist.h"
 #include "textutil.h"
 #include "xmpp_client.h"
 
+#include <QAbstractListModel>
+#include <QAction>
+#include <QApplication>
 #include <QCheckBox>
+#include <QClipboard>
+#include <QFontDatabase>
 #include <QHBoxLayout>
 #include <QLayout>
+#include <QListView>
 #include <QMessageBox>
+#include <QPainter>
 #include <QPushButton>
 #include <QScrollBar>
+#include <QStyledItemDelegate>
 #include <QTextEdit>
-#include <QTextFrame>
+#include <QTimer>
 #include <QVBoxLayout>
+#include <QXmlStreamReader>
+#include <algorithm>
+
+// stanzas kept in the console, the oldest are dropped first
+#define XMLCONSOLE_MAX_RECORDS 5000
+// stanzas arriving within this many milliseconds are added to the view together
+#define XMLCONSOLE_FLUSH_INTERVAL 50
+
+enum { IncomingRole = Qt::UserRole, LinesRole, ColumnsRole };
+
+//----------------------------------------------------------------------------
+// XmlConsoleModel
+//----------------------------------------------------------------------------
+// Fixed-capacity ring of stanzas. Rows carry their line and column counts so the view can
+// size them without touching the text, which is read only for the rows being painted
+class XmlConsoleModel : public QAbstractListModel {
+public:
+    struct Record {
+        QString xml;
+        bool    incoming = false;
+        int     lines    = 1;
+        int     columns  = 0;
+    };
+
+    using QAbstractListModel::QAbstractListModel;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override { return parent.isValid() ? 0 : count_; }
+
+    QVariant data(const QModelIndex &index, int role) const override
+    {
+        if (!index.isValid() || index.row() >= count_)
+            return QVariant();
+        const Record &r = record(index.row());
+        switch (role) {
+        case Qt::DisplayRole:
+            return r.xml;
+        case IncomingRole:
+            return r.incoming;
+        case LinesRole:
+            return r.lines;
+        case ColumnsRole:
+            return r.columns;
+        default:
+            return QVariant();
+        }
+    }
+
+    const Record &record(int row) const { return ring_[(head_ + row) % XMLCONSOLE_MAX_RECORDS]; }
+
+    void append(bool incoming, const QString &xml)
+    {
+        Record r;
+        r.xml      = xml;
+        r.incoming = incoming;
+        int from   = 0;
+        for (int to; (to = xml.indexOf('\n', from)) != -1; from = to + 1) {
+            r.columns = qMax(r.columns, to - from);
+            ++r.lines;
+        }
+        r.columns = qMax(r.columns, xml.size() - from);
+        pending_ += r;
+        if (pending_.size() > XMLCONSOLE_MAX_RECORDS)
+            pending_.removeFirst();
+    }
+
+    bool hasPending() const { return !pending_.isEmpty(); }
+
+    // moves the pending stanzas into the ring with one removal and one insertion
+    void flush()
+    {
+        if (pending_.isEmpty())
+            return;
+        if (ring_.isEmpty())
+            ring_.resize(XMLCONSOLE_MAX_RECORDS);
+
+        const int drop = qMin(count_, count_ + pending_.size() - XMLCONSOLE_MAX_RECORDS);
+        if (drop > 0) {
+            beginRemoveRows(QModelIndex(), 0, drop - 1);
+            for (int n = 0; n < drop; ++n)
+                ring_[(head_ + n) % XMLCONSOLE_MAX_RECORDS] = Record();
+            head_ = (head_ + drop) % XMLCONSOLE_MAX_RECORDS;
+            count_ -= drop;
+            endRemoveRows();
+        }
+
+        beginInsertRows(QModelIndex(), count_, count_ + pending_.size() - 1);
+        for (Record &r : pending_)
+            ring_[(head_ + count_++) % XMLCONSOLE_MAX_RECORDS] = std::move(r);
+        pending_.clear();
+        endInsertRows();
+    }
+
+    void clear()
+    {
+        beginResetModel();
+        ring_.clear();
+        pending_.clear();
+        head_  = 0;
+        count_ = 0;
+        endResetModel();
+    }
+
+private:
+    QVector<Record> ring_;
+    QList<Record>   pending_;
+    int             head_  = 0;
+    int             count_ = 0;
+};
+
+//----------------------------------------------------------------------------
+// XmlConsoleDelegate
+//----------------------------------------------------------------------------
+// Paints a stanza in a fixed-pitch font, markup in the direction color and character data in white
+class XmlConsoleDelegate : public QStyledItemDelegate {
+public:
+    using QStyledItemDelegate::QStyledItemDelegate;
+
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const override
+    {
+        const QFontMetrics fm(option.font);
+        return QSize(index.data(ColumnsRole).toInt() * fm.horizontalAdvance('x') + 4,
+                     index.data(LinesRole).toInt() * fm.lineSpacing());
+    }
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override
+    {
+        painter->save();
+        painter->setFont(option.font);
+        if (option.state & QStyle::State_Selected)
+            painter->fillRect(option.rect, option.palette.highlight());
+
+        const QColor       markup = index.data(IncomingRole).toBool() ? Qt::yellow : Qt::red;
+        const QColor       text   = Qt::white;
+        const QFontMetrics fm(option.font);
+        const QString      xml = index.data(Qt::DisplayRole).toString();
+
+        bool inTag = false;
+        int  y     = option.rect.top() + fm.ascent();
+        int  from  = 0;
+        while (from <= xml.size() && y - fm.ascent() < option.rect.bottom()) {
+            int to = xml.indexOf('\n', from);
+            if (to == -1)
+                to = xml.size();
+            // split the line where markup starts or ends
+            int x = option.rect.left() + 2;
+            for (int n = from; n < to;) {
+                int m = n;
+                while (m < to && (inTag ? xml[m] != '>' : xml[m] != '<'))
+                    ++m;
+                if (inTag && m < to)
+                    ++m; // '>' belongs to the tag
+                if (!inTag && m == n) {
+                    inTag = true;
+                    continue;
+                }
+                const QString part = xml.mid(n, m - n);
+                painter->setPen(inTag ? markup : text);
+                painter->drawText(x, y, part);
+                x += fm.horizontalAdvance(part);
+                if (inTag && m > n && xml[m - 1] == '>')
+                    inTag = false;
+                n = m;
+            }
+            y += fm.lineSpacing();
+            from = to + 1;
+        }
+        painter->restore();
+    }
+};
 
 //----------------------------------------------------------------------------
 // XmlConsole
@@ -53,13 +231,29 @@ XmlConsole::XmlConsole(PsiAccount *_pa) : QWidget()
 
     prompt = nullptr;
 
-    ui_.te->setUndoRedoEnabled(false);
-    ui_.te->setReadOnly(true);
-    ui_.te->setAcceptRichText(false);
-
-    QTextFrameFormat f = ui_.te->document()->rootFrame()->frameFormat();
-    f.setBackground(QBrush(Qt::black));
-    ui_.te->document()->rootFrame()->setFrameFormat(f);
+    model_ = new XmlConsoleModel(this);
+    ui_.lv_records->setModel(model_);
+    ui_.lv_records->setItemDelegate(new XmlConsoleDelegate(ui_.lv_records));
+    ui_.lv_records->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    ui_.lv_records->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    ui_.lv_records->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    ui_.lv_records->setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
+    ui_.lv_records->setLayoutMode(QListView::Batched);
+    QPalette pal = ui_.lv_records->palette();
+    pal.setColor(QPalette::Base, Qt::black);
+    ui_.lv_records->setPalette(pal);
+
+    QAction *copyAction = new QAction(tr("&Copy"), ui_.lv_records);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setShortcutContext(Qt::WidgetShortcut);
+    connect(copyAction, SIGNAL(triggered()), SLOT(copy()));
+    ui_.lv_records->addAction(copyAction);
+    ui_.lv_records->setContextMenuPolicy(Qt::ActionsContextMenu);
+
+    flushTimer_ = new QTimer(this);
+    flushTimer_->setSingleShot(true);
+    flushTimer_->setInterval(XMLCONSOLE_FLUSH_INTERVAL);
+    connect(flushTimer_, SIGNAL(timeout()), SLOT(flushRecords()));
 
     connect(ui_.pb_clear, SIGNAL(clicked()), SLOT(clear()));
     connect(ui_.pb_input, SIGNAL(clicked()), SLOT(insertXml()));
@@ -71,12 +265,17 @@ XmlConsole::XmlConsole(PsiAccount *_pa) : QWidget()
 
 XmlConsole::~XmlConsole() { pa->dialogUnregister(this); }
 
-void XmlConsole::clear()
+void XmlConsole::clear() { model_->clear(); }
+
+void XmlConsole::copy()
 {
-    ui_.te->clear();
-    QTextFrameFormat f = ui_.te->document()->rootFrame()->frameFormat();
-    f.setBackground(QBrush(Qt::black));
-    ui_.te->document()->rootFrame()->setFrameFormat(f);
+    QModelIndexList rows = ui_.lv_records->selectionModel()->selectedRows();
+    std::sort(rows.begin(), rows.end());
+    QStringList text;
+    for (const QModelIndex &index : rows)
+        text += index.data(Qt::DisplayRole).toString();
+    if (!text.isEmpty())
+        QApplication::clipboard()->setText(text.join('\n'));
 }
 
 void XmlConsole::updateCaption()
@@ -95,21 +294,26 @@ bool XmlConsole::filtered(const QString &str) const
         // Only do parsing if needed
         if (!ui_.le_jid->text().isEmpty() || !ui_.ck_iq->isChecked() || !ui_.ck_message->isChecked()
             || !ui_.ck_presence->isChecked() || !ui_.ck_sm->isChecked()) {
-            QDomDocument doc;
-            if (!doc.setContent(str))
+            // the root start tag holds all we filter on, the rest of the stanza isn't read
+            QXmlStreamReader reader(str);
+            reader.setNamespaceProcessing(false);
+            while (!reader.atEnd() && reader.readNext() != QXmlStreamReader::StartElement) { }
+            if (!reader.isStartElement())
                 return true;
 
-            QDomElement e  = doc.documentElement();
-            QString     tn = e.tagName();
-            if ((tn == "iq" && !ui_.ck_iq->isChecked()) || (tn == "message" && !ui_.ck_message->isChecked())
-                || (tn == "presence" && !ui_.ck_presence->isChecked())
-                || ((tn == "a" || tn == "r") && !ui_.ck_sm->isChecked()))
+            const QStringRef tn = reader.name();
+            if ((tn == QLatin1String("iq") && !ui_.ck_iq->isChecked())
+                || (tn == QLatin1String("message") && !ui_.ck_message->isChecked())
+                || (tn == QLatin1String("presence") && !ui_.ck_presence->isChecked())
+                || ((tn == QLatin1String("a") || tn == QLatin1String("r")) && !ui_.ck_sm->isChecked()))
                 return true;
 
             if (!ui_.le_jid->text().isEmpty()) {
-                Jid  jid(ui_.le_jid->text());
-                bool hasResource = !jid.resource().isEmpty();
-                if (!jid.compare(e.attribute("to"), hasResource) && !jid.compare(e.attribute("from"), hasResource))
+                const QXmlStreamAttributes attrs       = reader.attributes();
+                const Jid                  jid         = JIDUtil::intern(ui_.le_jid->text());
+                bool                       hasResource = !jid.resource().isEmpty();
+                if (!jid.compare(JIDUtil::intern(attrs.value("to").toString()), hasResource)
+                    && !jid.compare(JIDUtil::intern(attrs.value("from").toString()), hasResource))
                     return true;
             }
         }
@@ -120,41 +324,40 @@ bool XmlConsole::filtered(const QString &str) const
 
 void XmlConsole::dumpRingbuf()
 {
-    QList<PsiAccount::xmlRingElem> buf        = pa->dumpRingbuf();
-    bool                           enablesave = ui_.ck_enable->isChecked();
+    const QList<PsiAccount::xmlRingElem> buf        = pa->dumpRingbuf();
+    bool                                 enablesave = ui_.ck_enable->isChecked();
     ui_.ck_enable->setChecked(true);
     QString stamp;
     for (const PsiAccount::xmlRingElem &el : buf) {
-        stamp = "<!-- TS:" + el.time.toString(Qt::ISODate) + "-->";
-        if (el.type == PsiAccount::RingXmlOut) {
-            client_xmlOutgoing(stamp + el.xml);
-        } else {
-            client_xmlIncoming(stamp + el.xml);
-        }
+        stamp             = "<!-- TS:" + el.time.toString(Qt::ISODate) + "-->";
+        const QString str = stamp + el.xml();
+        if (!filtered(str))
+            model_->append(el.type != PsiAccount::RingXmlOut, str);
     }
     ui_.ck_enable->setChecked(enablesave);
+    // the whole ring goes into the view in one insertion
+    flushTimer_->stop();
+    flushRecords();
 }
 
 void XmlConsole::addRecord(bool incoming, const QString &str)
 {
     if (!filtered(str)) {
-        int         prevSPos = ui_.te->verticalScrollBar()->value();
-        bool        atBottom = (prevSPos == ui_.te->verticalScrollBar()->maximum());
-        QTextCursor prevCur  = ui_.te->textCursor();
-
-        ui_.te->moveCursor(QTextCursor::End);
-        ui_.te->setTextColor(incoming ? Qt::yellow : Qt::red);
-        ui_.te->insertPlainText(str + '\n');
-
-        if (!atBottom) {
-            ui_.te->setTextCursor(prevCur);
-            ui_.te->verticalScrollBar()->setValue(prevSPos);
-        } else {
-            ui_.te->verticalScrollBar()->setValue(ui_.te->verticalScrollBar()->maximum());
-        }
+        model_->append(incoming, str);
+        if (!flushTimer_->isActive())
+            flushTimer_->start();
     }
 }
 
+void XmlConsole::flushRecords()
+{
+    QScrollBar *sb       = ui_.lv_records->verticalScrollBar();
+    bool        atBottom = sb->value() == sb->maximum();
+    model_->flush();
+    if (atBottom)
+        ui_.lv_records->scrollToBottom();
+}
+
 void XmlConsole::client_xmlIncoming(const QString &str) { addRecord(true, str); }
 
 void XmlConsole::client_xmlOutgoing(const QString &str) { addRecord(false, str); }
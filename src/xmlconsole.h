@@ -29,6 +29,8 @@
 class PsiAccount;
 class QCheckBox;
 class QTextEdit;
+class QTimer;
+class XmlConsoleModel;
 class XmlPrompt;
 
 class XmlConsole : public QWidget {
@@ -40,6 +42,8 @@ public:
 
 private slots:
     void clear();
+    void copy();
+    void flushRecords();
     void updateCaption();
     void insertXml();
     void dumpRingbuf();
@@ -55,6 +59,8 @@ private:
     Ui::XMLConsole      ui_;
     PsiAccount *        pa;
     QPointer<XmlPrompt> prompt;
+    XmlConsoleModel *   model_;
+    QTimer *            flushTimer_;
 };
 
 class XmlPrompt : public QDialog {
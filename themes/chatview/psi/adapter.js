@@ -77,6 +77,7 @@ function psiThemeAdapter(chat) {
             groupping : false,
             chatElement : null,
             chat : chat,
+            maxMessages : 0, // options.ui.chat.max-log-messages
 
             TemplateVar : function(name, param) {
                 this.name = name;
@@ -113,7 +114,36 @@ function psiThemeAdapter(chat) {
                 } else {
                     chat.util.appendHtml(shared.chatElement, html);
                 }
-                shared.scroller.invalidate();
+                if (!shared.batching) {
+                    shared.trimLog();
+                }
+                shared.invalidateScroll();
+            },
+
+            // drops the oldest messages over the limit, unless the user is reading back
+            trimLog : function() {
+                var el = shared.chatElement;
+                if (!shared.maxMessages || !shared.scroller.atBottom) {
+                    return;
+                }
+                while (el.childElementCount > shared.maxMessages) {
+                    var first = el.firstElementChild;
+                    if (first === trackbar) {
+                        trackbar = null;
+                    }
+                    el.removeChild(first);
+                }
+            },
+
+            // scrolling reads the layout, so within a batch it's done once at the end
+            batching : false,
+            scrollPending : false,
+            invalidateScroll : function() {
+                if (shared.batching) {
+                    shared.scrollPending = true;
+                } else {
+                    shared.scroller.invalidate();
+                }
             },
 
             stopGroupping : function() {
@@ -257,7 +287,7 @@ function psiThemeAdapter(chat) {
                 }
                 if (data.type == "replace") {
                     if (chat.util.replaceMessage(shared.chatElement, session.isMuc, data.local, data.sender, data.replaceId, data.id, data.message)) {
-                        shared.scroller.invalidate();
+                        shared.invalidateScroll();
                         return;
                     }
                     data.type = "message";
@@ -324,7 +354,7 @@ function psiThemeAdapter(chat) {
                         shared.chatElement.removeChild(trackbar);
                     }
                     shared.chatElement.appendChild(trackbar);
-                    shared.scroller.invalidate();
+                    shared.invalidateScroll();
                     shared.stopGroupping(); //groupping impossible
                 } else if (data.type == "clear") {
                     shared.stopGroupping(); //groupping impossible
@@ -336,6 +366,23 @@ function psiThemeAdapter(chat) {
             }
         };
 
+        chat.adapter.beginBatch = function() {
+            shared.batching = true;
+        };
+
+        chat.adapter.endBatch = function() {
+            shared.batching = false;
+            shared.trimLog();
+            if (shared.scrollPending) {
+                shared.scrollPending = false;
+                shared.scroller.invalidate();
+            }
+        };
+
+        var updateMaxMessages = function(value) { shared.maxMessages = value; };
+        chat.util.psiOption("options.ui.chat.max-log-messages", updateMaxMessages);
+        chat.util.connectOptionChange("options.ui.chat.max-log-messages", updateMaxMessages);
+
         shared.session.newMessage.connect(chat.receiveObject);
         shared.session.scrollRequested.connect((value) => {
                                                    if (shared.scroller && shared.scroller.cancel)
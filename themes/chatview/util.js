@@ -751,6 +751,18 @@ function initPsiTheme() {
         AudioMessage : AudioMessage,
 
         receiveObject : function(data) {
+            if (data.type == "batch") { // a few objects sent at once
+                // adapters may implement beginBatch/endBatch to lay out and scroll once per batch
+                if (chat.adapter.beginBatch) chat.adapter.beginBatch();
+                try {
+                    for (var j = 0; j < data.items.length; j++) {
+                        chat.receiveObject(data.items[j]);
+                    }
+                } finally {
+                    if (chat.adapter.endBatch) chat.adapter.endBatch();
+                }
+                return;
+            }
             for(var i=0; i < chat.hooks.length; i++) {
                 try {
                     chat.hooks[i](chat, data);